@@ -3893,6 +3893,15 @@ stbi_inline static stbi_uc stbi__zget8(stbi__zbuf *z)
 
 static void stbi__fill_bits(stbi__zbuf *z)
 {
+   // fast path: enough input left that no byte needs a bounds check
+   if (z->zbuffer_end - z->zbuffer >= 4) {
+      do {
+         STBI_ASSERT(z->code_buffer < (1U << z->num_bits));
+         z->code_buffer |= (unsigned int) *z->zbuffer++ << z->num_bits;
+         z->num_bits += 8;
+      } while (z->num_bits <= 24);
+      return;
+   }
    do {
       STBI_ASSERT(z->code_buffer < (1U << z->num_bits));
       z->code_buffer |= (unsigned int) stbi__zget8(z) << z->num_bits;
@@ -4010,6 +4019,17 @@ static int stbi__parse_huffman_block(stbi__zbuf *a)
          if (dist == 1) { // run of one byte; common in images.
             stbi_uc v = *p;
             if (len) { do *zout++ = v; while (--len); }
+         } else if (dist >= 8 && zout + len + 8 <= a->zout_end) {
+            // source and destination don't overlap within 8 bytes, so copy
+            // in 8-byte chunks; the last chunk may write past len, but stays
+            // inside the buffer and is overwritten by the following output.
+            char *end = zout + len;
+            do {
+               memcpy(zout, p, 8);
+               zout += 8;
+               p += 8;
+            } while (zout < end);
+            zout = end;
          } else {
             if (len) { do *zout++ = *p++; while (--len); }
          }
@@ -4324,6 +4344,111 @@ static int stbi__paeth(int a, int b, int c)
    return c;
 }
 
+#ifdef STBI_SSE2
+// SSE2 unfiltering for 8-bit RGB/RGBA scanlines. Sub, Avg and Paeth depend on
+// the previous pixel, so these work on one pixel per iteration with the
+// channels in parallel; Up has no such dependency and works 16 bytes at a time.
+// raw holds raw_n bytes per pixel, cur and prior hold out_n bytes per pixel;
+// if out_n > raw_n, alpha is set to 255. The pixel before cur must already be
+// decoded.
+stbi_inline static __m128i stbi__png_load_pixel(const stbi_uc *p, int n)
+{
+   stbi__uint32 v = p[0] | (p[1] << 8) | (p[2] << 16);
+   if (n == 4) v |= (stbi__uint32) p[3] << 24;
+   return _mm_cvtsi32_si128((int) v);
+}
+
+stbi_inline static void stbi__png_store_pixel(stbi_uc *p, __m128i v, int n)
+{
+   stbi__uint32 u = (stbi__uint32) _mm_cvtsi128_si32(v);
+   p[0] = (stbi_uc) u;
+   p[1] = (stbi_uc) (u >> 8);
+   p[2] = (stbi_uc) (u >> 16);
+   if (n == 4) p[3] = (stbi_uc) (u >> 24);
+}
+
+stbi_inline static __m128i stbi__png_abs16(__m128i v)
+{
+   return _mm_max_epi16(v, _mm_sub_epi16(_mm_setzero_si128(), v));
+}
+
+static void stbi__png_unfilter_row_sse2(int filter, stbi_uc *cur, const stbi_uc *prior, const stbi_uc *raw, int count, int raw_n, int out_n)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i alpha = _mm_cvtsi32_si128(out_n > raw_n ? (int) 0xff000000 : 0);
+   __m128i a, b, c, d;
+   int i;
+
+   switch (filter) {
+      case STBI__F_sub:
+         a = stbi__png_load_pixel(cur - out_n, out_n);
+         for (i=0; i < count; ++i, raw += raw_n, cur += out_n) {
+            a = _mm_or_si128(_mm_add_epi8(stbi__png_load_pixel(raw, raw_n), a), alpha);
+            stbi__png_store_pixel(cur, a, out_n);
+         }
+         break;
+
+      case STBI__F_up:
+         i = 0;
+         if (raw_n == out_n) {
+            int nk = count * raw_n;
+            for (; i + 16 <= nk; i += 16) {
+               d = _mm_loadu_si128((const __m128i *) (raw + i));
+               b = _mm_loadu_si128((const __m128i *) (prior + i));
+               _mm_storeu_si128((__m128i *) (cur + i), _mm_add_epi8(d, b));
+            }
+            for (; i < nk; ++i)
+               cur[i] = STBI__BYTECAST(raw[i] + prior[i]);
+            break;
+         }
+         for (; i < count; ++i, raw += raw_n, cur += out_n, prior += out_n) {
+            d = _mm_add_epi8(stbi__png_load_pixel(raw, raw_n), stbi__png_load_pixel(prior, out_n));
+            stbi__png_store_pixel(cur, _mm_or_si128(d, alpha), out_n);
+         }
+         break;
+
+      case STBI__F_avg:
+         a = stbi__png_load_pixel(cur - out_n, out_n);
+         for (i=0; i < count; ++i, raw += raw_n, cur += out_n, prior += out_n) {
+            // _mm_avg_epu8 rounds up; PNG wants (a+b)>>1
+            b = stbi__png_load_pixel(prior, out_n);
+            c = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+            a = _mm_or_si128(_mm_add_epi8(stbi__png_load_pixel(raw, raw_n), c), alpha);
+            stbi__png_store_pixel(cur, a, out_n);
+         }
+         break;
+
+      case STBI__F_paeth:
+         // work in 16-bit lanes so a+b-c can't overflow
+         a = _mm_unpacklo_epi8(stbi__png_load_pixel(cur - out_n, out_n), zero);
+         c = _mm_unpacklo_epi8(stbi__png_load_pixel(prior - out_n, out_n), zero);
+         for (i=0; i < count; ++i, raw += raw_n, cur += out_n, prior += out_n) {
+            __m128i pa, pb, pc, smallest, pred;
+            b = _mm_unpacklo_epi8(stbi__png_load_pixel(prior, out_n), zero);
+            pa = _mm_sub_epi16(b, c);
+            pb = _mm_sub_epi16(a, c);
+            pc = stbi__png_abs16(_mm_add_epi16(pa, pb));
+            pa = stbi__png_abs16(pa);
+            pb = stbi__png_abs16(pb);
+            smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+            // prefer a, then b, then c, as stbi__paeth does
+            pred = c;
+            d = _mm_cmpeq_epi16(pb, smallest);
+            pred = _mm_or_si128(_mm_and_si128(d, b), _mm_andnot_si128(d, pred));
+            d = _mm_cmpeq_epi16(pa, smallest);
+            pred = _mm_or_si128(_mm_and_si128(d, a), _mm_andnot_si128(d, pred));
+
+            d = _mm_add_epi8(stbi__png_load_pixel(raw, raw_n), _mm_packus_epi16(pred, pred));
+            d = _mm_or_si128(d, alpha);
+            stbi__png_store_pixel(cur, d, out_n);
+            a = _mm_unpacklo_epi8(d, zero);
+            c = b;
+         }
+         break;
+   }
+}
+#endif
+
 static const stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
 // create the png data from post-deflated data
@@ -4339,6 +4464,9 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    int output_bytes = out_n*bytes;
    int filter_bytes = img_n*bytes;
    int width = x;
+   #ifdef STBI_SSE2
+   int use_sse2 = stbi__sse2_available();
+   #endif
 
    STBI_ASSERT(out_n == s->img_n || out_n == s->img_n+1);
    a->out = (stbi_uc *) stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
@@ -4405,6 +4533,14 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
          prior += 1;
       }
 
+      #ifdef STBI_SSE2
+      if (use_sse2 && depth == 8 && (img_n == 3 || img_n == 4) && filter >= STBI__F_sub && filter <= STBI__F_paeth) {
+         stbi__png_unfilter_row_sse2(filter, cur, prior, raw, x - 1, img_n, out_n);
+         raw += (x - 1) * img_n;
+         continue;
+      }
+      #endif
+
       // this is a little gross, so that we don't switch per-pixel or per-component
       if (depth < 8 || img_n == out_n) {
          int nk = (width - 1)*filter_bytes;
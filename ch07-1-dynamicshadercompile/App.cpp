@@ -1,8 +1,15 @@
 ﻿#include "App.h"
+#include "AssetFileSystem.h"
+#include "MappedFile.h"
+#include "TextureAtlas.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
 #include <iostream>
-#include <fstream>
 #include <vector>
 #include <string>
+#include <random>
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
@@ -23,6 +30,28 @@ using namespace DirectX::PackedVector;
 
 namespace
 {
+// テクスチャアトラスの設定.
+const int AtlasPageSize = 1024;
+const int AtlasPadding = 2;         // バイリニアフィルタ用に画像の周囲へ複製するピクセル数.
+
+// 中央の画像の周りに並べるスプライトの数と配置.
+const int SpriteColumns = 40;
+const int SpriteRows = 25;
+const int SpriteCount = SpriteColumns * SpriteRows;
+const float SpriteSpacing = 0.2f;
+const float SpriteDepth = 1.0f;     // 中央の画像より奥に置く.
+const int MinSpriteImageSize = 8;
+const int MaxSpriteImageSize = 64;
+
+// 中央の画像を拡大してタイルに分けたファイルを作り, バーチャルテクスチャとして描画する.
+const wchar_t* VirtualTextureFileName = L"Parrots.vt";
+const int VirtualTextureSize = 1920;        // 1 辺のタイル数が 2 の累乗になる大きさ.
+const int VirtualTextureTileSize = 120;
+const int VirtualTextureBorder = 4;         // 余白を含めて 128 ピクセルのタイルになる.
+const int VirtualTextureSlots = 8;          // 物理テクスチャの 1 辺に並べるタイル数.
+const int MaxTileUploadsPerFrame = 8;
+const int FeedbackGridSize = 16;            // 見えている範囲を調べる格子の分割数.
+
 // 実行体のあるファイルパスを返却する.
 std::wstring GetExecutionDirectory()
 {
@@ -34,46 +63,145 @@ std::wstring GetExecutionDirectory()
     return strPath;
 }
 
-bool LoadBinaryFile(const std::wstring& textureFileName, std::vector<uint8_t>& loadBuf)
+// 実行体のあるディレクトリにあるファイルのパスを返却する.
+std::string GetFilePathA(const std::wstring& fileName)
 {
-    loadBuf.clear();
     std::wstring path = GetExecutionDirectory();
     path += std::wstring(L"\\");
-    path += textureFileName;
+    path += fileName;
+
+    int length = WideCharToMultiByte(CP_ACP, 0, path.c_str(), -1, nullptr, 0, nullptr, nullptr);
+    std::string result(length, '\0');
+    WideCharToMultiByte(CP_ACP, 0, path.c_str(), -1, &result[0], length, nullptr, nullptr);
+    result.resize(length - 1);
+    return result;
+}
 
-    std::ifstream infile(path, std::ifstream::binary);
-    if (!infile)
+// 起動時に読み込んだファイルの集計.
+struct FileLoadStats
+{
+    int count;
+    int archiveCount;   // そのうちアーカイブから読み込んだ数.
+    uint64_t bytes;
+    double msec;
+};
+FileLoadStats fileLoadStats = {};
+
+// 実行体と同じディレクトリに置くアーカイブ. 無ければ個別のファイルを読み込む.
+// アーカイブは ch07-2-deferredrendering/tools/AssetPacker で作ります.
+const wchar_t* AssetArchiveFileName = L"Assets.pak";
+
+// 画像とシェーダーはこのファイルシステムから読み込む.
+AssetFileSystem assetFileSystem;
+
+// アーカイブがあれば登録し, 無ければ実行体のディレクトリのファイルを使う.
+void MountAssets()
+{
+    const std::string archivePath = GetFilePathA(AssetArchiveFileName);
+    if (assetFileSystem.MountArchive(archivePath.c_str()))
     {
-        return false;
+        OutputDebugStringA(("Mounted " + archivePath + "\n").c_str());
     }
+    assetFileSystem.MountDirectory(GetFilePathA(L"").c_str());
+}
 
-    int size = static_cast<int>(infile.seekg(0, std::ifstream::end).tellg());
-    loadBuf.resize(size);
-    infile.seekg(0, std::ifstream::beg);
-    infile.read(reinterpret_cast<char*>(loadBuf.data()), size);
-    return true;
+// ファイルを開き, 起動時の読み込みの集計に加える.
+// アーカイブの圧縮していないファイルとディレクトリのファイルは読み取り専用でメモリへマップし,
+// 内容はページフォルトで必要な分だけ読み込まれるため, 計測する時間はファイルを開いてマップするまで.
+bool OpenAsset(const char* name, AssetFile& file, MappedFile::AccessHint hint)
+{
+    auto begin = std::chrono::steady_clock::now();
+    bool result = assetFileSystem.Open(name, file, hint);
+    auto end = std::chrono::steady_clock::now();
+    fileLoadStats.msec += std::chrono::duration<double, std::milli>(end - begin).count();
+    if (result)
+    {
+        ++fileLoadStats.count;
+        fileLoadStats.archiveCount += file.IsFromArchive() ? 1 : 0;
+        fileLoadStats.bytes += file.GetSize();
+    }
+    return result;
 }
 
-IDirect3DTexture9* CreateTextureFromFile(
-    IDirect3DDevice9Ex* pd3dDev, 
-    const std::wstring& textureFileName)
+// 画像ファイルを RGBA の 32 ビット画像として読み込む.
+bool LoadImageFile(const char* imageFileName, int& width, int& height, std::vector<uint8_t>& rgba)
 {
-    std::vector<uint8_t> buf;
-    if (!LoadBinaryFile(textureFileName, buf))
+    AssetFile file;
+    if (!OpenAsset(imageFileName, file, MappedFile::Sequential))
     {
-        return nullptr;
+        return false;
     }
-    int width = 0, height = 0;
     int request_component = 4;  // R,G,B,A の4コンポーネント.
     int component = 0;
     uint8_t* pLoad = stbi_load_from_memory(
-        buf.data(), 
-        int(buf.size()), 
+        file.GetData(), 
+        int(file.GetSize()), 
         &width, 
         &height, 
         &component, 
         request_component);
+    if (!pLoad)
+    {
+        return false;
+    }
+    rgba.assign(pLoad, pLoad + size_t(width) * height * 4);
+    stbi_image_free(pLoad);
+    return true;
+}
 
+// RGBA 画像をバイリニア補間で size x size の大きさにする.
+void ResizeImage(const uint8_t* src, int width, int height, int size, std::vector<uint8_t>& dst)
+{
+    dst.resize(size_t(size) * size * 4);
+    for (int y = 0; y < size; ++y)
+    {
+        float fy = (y + 0.5f) * height / size - 0.5f;
+        int y0 = int(floorf(fy));
+        float ty = fy - y0;
+        int y1 = (y0 + 1 < height) ? y0 + 1 : height - 1;
+        y0 = (y0 < 0) ? 0 : y0;
+        for (int x = 0; x < size; ++x)
+        {
+            float fx = (x + 0.5f) * width / size - 0.5f;
+            int x0 = int(floorf(fx));
+            float tx = fx - x0;
+            int x1 = (x0 + 1 < width) ? x0 + 1 : width - 1;
+            x0 = (x0 < 0) ? 0 : x0;
+
+            const uint8_t* p00 = &src[(size_t(y0) * width + x0) * 4];
+            const uint8_t* p01 = &src[(size_t(y0) * width + x1) * 4];
+            const uint8_t* p10 = &src[(size_t(y1) * width + x0) * 4];
+            const uint8_t* p11 = &src[(size_t(y1) * width + x1) * 4];
+            uint8_t* out = &dst[(size_t(y) * size + x) * 4];
+            for (int c = 0; c < 4; ++c)
+            {
+                float top = p00[c] + (p01[c] - p00[c]) * tx;
+                float bottom = p10[c] + (p11[c] - p10[c]) * tx;
+                out[c] = uint8_t(top + (bottom - top) * ty + 0.5f);
+            }
+        }
+    }
+}
+
+// RGBA の 1 行を DirectX9 にあうようにチャンネルを入れ替えながら書き込む.
+void CopyRowToBGRA(uint8_t* dst, const uint8_t* src, int width)
+{
+    for (int x = 0; x < width; ++x)
+    {
+        int idx = 4 * x;
+        dst[idx + 0] = src[idx + 2];
+        dst[idx + 1] = src[idx + 1];
+        dst[idx + 2] = src[idx + 0];
+        dst[idx + 3] = src[idx + 3];
+    }
+}
+
+IDirect3DTexture9* CreateTextureFromImage(
+    IDirect3DDevice9Ex* pd3dDev,
+    int width,
+    int height,
+    const uint8_t* rgba)
+{
     // テクスチャを生成する.
     HRESULT hr;
     IDirect3DTexture9* pTexture = nullptr;
@@ -104,48 +232,26 @@ IDirect3DTexture9* CreateTextureFromFile(
         nullptr);
     if (FAILED(hr))
     {
+        pTexture->Release();
         return nullptr;
     }
 
-    // RGBA 画像を DirectX9 にあうようにチャンネル入れ替え.
-    const int lineBytes = width * sizeof(uint32_t); // 横方向１行のバイト数.
-    for (int y = 0; y < height; ++y)
-    {
-        uint8_t* p = &pLoad[y*lineBytes];
-        for (int x = 0; x < width; ++x)
-        {
-            int idx = 4 * x;
-            uint8_t r, g, b, a;
-
-            r = p[idx + 0];
-            g = p[idx + 1];
-            b = p[idx + 2];
-            a = p[idx + 3];
-
-            p[idx + 0] = b;
-            p[idx + 1] = g;
-            p[idx + 2] = r;
-            p[idx + 3] = a;
-        }
-    }
-
     D3DLOCKED_RECT locked;
     hr = pStaging->LockRect(0, &locked, nullptr, 0);
     if (FAILED(hr))
     {
+        pStaging->Release();
+        pTexture->Release();
         return nullptr;
     }
 
-    // 作業用テクスチャに画像データを書き込む.
-    uint8_t* dst = static_cast<uint8_t*>(locked.pBits);
-    uint8_t* src = pLoad;
-    int y = width;
-    while (y > 0)
+    // RGBA 画像を DirectX9 にあうようにチャンネルを入れ替えながら, 作業用テクスチャに書き込む.
+    const int lineBytes = width * sizeof(uint32_t); // 横方向１行のバイト数.
+    for (int y = 0; y < height; ++y)
     {
-        memcpy_s(dst, locked.Pitch, src, lineBytes);
-        dst += locked.Pitch;
-        src += lineBytes;
-        y--;
+        const uint8_t* src = &rgba[y*lineBytes];
+        uint8_t* dst = static_cast<uint8_t*>(locked.pBits) + y * locked.Pitch;
+        CopyRowToBGRA(dst, src, width);
     }
     pStaging->UnlockRect(0);
 
@@ -153,19 +259,18 @@ IDirect3DTexture9* CreateTextureFromFile(
     hr = pd3dDev->UpdateTexture(pStaging, pTexture);
         
     // 後始末.
-    stbi_image_free(pLoad);
     pStaging->Release();
 
     return pTexture;
 }
 
 bool CompileShader(
-    const std::wstring& shaderFile, 
+    const char* shaderFile, 
     bool isVertexShader, 
     std::vector<uint8_t>& compiled)
 {
-    std::vector<uint8_t> buf;
-    if (!LoadBinaryFile(shaderFile, buf))
+    AssetFile file;
+    if (!OpenAsset(shaderFile, file, MappedFile::Sequential))
     {
         return false;
     }
@@ -175,8 +280,8 @@ bool CompileShader(
     const char* profile = isVertexShader ? "vs_3_0" : "ps_3_0";
     HRESULT hr;
     hr = D3DCompile(
-        buf.data(), 
-        buf.size(), 
+        file.GetData(), 
+        file.GetSize(), 
         nullptr, 
         nullptr, 
         nullptr, 
@@ -215,6 +320,9 @@ App::App()
     m_Declaration(nullptr), m_VertexBuffer(nullptr),
     m_IndexBuffer(nullptr),
     m_VertexShader(nullptr), m_PixelShader(nullptr),
+    m_VTPhysical(nullptr), m_VTPhysicalStaging(nullptr),
+    m_VTPageTable(nullptr), m_VTPageTableStaging(nullptr),
+    m_VTPixelShader(nullptr),
     m_VertexCount(0), m_IndexCount(0)
 {
     ZeroMemory(&m_d3dpp, sizeof(m_d3dpp));
@@ -227,6 +335,8 @@ App::~App()
 bool App::Initialize(HWND hWnd, int width, int height)
 {
     HRESULT hr;
+    MountAssets();
+
     hr = Direct3DCreate9Ex(D3D_SDK_VERSION, &m_d3d9);
     if (FAILED(hr))
     {
@@ -265,7 +375,18 @@ bool App::Initialize(HWND hWnd, int width, int height)
     {
         return false;
     }
-    if (!SetupBuffers())
+
+    // 全ての画像を 1 つのアトラスにまとめ, ページごとに 1 回で描画する.
+    TextureAtlas atlas(AtlasPageSize, AtlasPageSize, AtlasPadding);
+    if (!SetupAtlas(atlas))
+    {
+        return false;
+    }
+    if (!SetupBuffers(atlas))
+    {
+        return false;
+    }
+    if (!SetupVirtualTexture())
     {
         return false;
     }
@@ -274,10 +395,12 @@ bool App::Initialize(HWND hWnd, int width, int height)
     {
         return false;
     }
-
-    std::wstring texFile = L"Parrots.png";
-
-    m_Texture = CreateTextureFromFile(m_d3dDev, texFile);
+    {
+        char buf[128];
+        sprintf_s(buf, "Startup I/O: %d files (%d from archive), %d KB, %.2f ms\n",
+            fileLoadStats.count, fileLoadStats.archiveCount, int(fileLoadStats.bytes / 1024), fileLoadStats.msec);
+        OutputDebugStringA(buf);
+    }
 
     // ビュー行列とプロジェクション行列をセットアップ.
     
@@ -313,11 +436,19 @@ bool App::Initialize(HWND hWnd, int width, int height)
     vp.MaxZ = 1.0f;
     m_d3dDev->SetViewport(&vp);
 
+    m_StartTime = std::chrono::steady_clock::now();
     return true;
 }
 
 void App::Render()
 {
+    // 中央の画像をゆっくり拡大縮小・移動させ, 見える範囲と必要な詳細度を変える.
+    float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - m_StartTime).count();
+    float scale = 2.5f - 1.5f * cosf(seconds * 0.5f);
+    XMMATRIX quadWorld = XMMatrixScaling(scale, scale, 1.0f) *
+        XMMatrixTranslation(sinf(seconds * 0.3f) * (scale - 1.0f) * 0.8f, 0.0f, 0.0f);
+    UpdateVirtualTexture(quadWorld);
+
     // 画面を塗りつぶす.
     DWORD dwClearFlags = D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER | D3DCLEAR_STENCIL;
     DWORD dwClearColor = D3DCOLOR_RGBA(0x40, 0x80, 0xFF, 0x00);
@@ -345,27 +476,50 @@ void App::Render()
     m_d3dDev->SetStreamSource(0, m_VertexBuffer, 0, sizeof(MyVertex));
     m_d3dDev->SetIndices(m_IndexBuffer);
 
-    // テクスチャをセット.
-    m_d3dDev->SetTexture(0, m_Texture);
-
     // レンダーステートを変更(アルファブレンド有効化,カリング).
     m_d3dDev->SetRenderState(D3DRS_CULLMODE, D3DCULL_CCW);
     m_d3dDev->SetRenderState(D3DRS_ALPHABLENDENABLE, TRUE);
     m_d3dDev->SetRenderState(D3DRS_SRCBLEND, D3DBLEND_SRCALPHA);
     m_d3dDev->SetRenderState(D3DRS_DESTBLEND, D3DBLEND_INVSRCALPHA);
 
+    // アトラスのページごとにテクスチャをセットし, インデックス付き描画を行う.
+    for (const auto& batch : m_Batches)
+    {
+        m_d3dDev->SetTexture(0, m_AtlasPages[batch.page]);
+        m_d3dDev->DrawIndexedPrimitive(
+            D3DPT_TRIANGLELIST, 
+            0, 
+            batch.minVertex, 
+            batch.vertexCount, 
+            batch.startIndex, 
+            batch.primitiveCount);
+    }
 
-    // プリミティブの数は インデックス数 / 3 で求まる.
-    int primitiveCount = m_IndexCount / 3;
+    // 中央の画像. ページテーブルを引いて物理テクスチャを参照するシェーダーで描画する.
+    XMStoreFloat4x4(&mtxWorld, XMMatrixTranspose(quadWorld));
+    m_d3dDev->SetVertexShaderConstantF(0, &mtxWorld.m[0][0], 4);
 
-    // インデックス付き描画を行う.
-    m_d3dDev->DrawIndexedPrimitive(
-        D3DPT_TRIANGLELIST, 
-        0, 
-        0, 
-        m_VertexCount, 
-        0, 
-        primitiveCount);
+    const VirtualTextureFile::Header& header = m_VirtualTexture.GetHeader();
+    const int pageSize = m_VirtualTexture.GetPageSize();
+    float vtParams[8] = {
+        float(header.size / header.tileSize), float(header.tileSize), float(header.border), float(pageSize),
+        1.0f / float(pageSize * m_VirtualTexture.GetSlotsPerSide()), 0.0f, 0.0f, 0.0f,
+    };
+    m_d3dDev->SetPixelShaderConstantF(0, vtParams, 2);
+    m_d3dDev->SetPixelShader(m_VTPixelShader);
+
+    // 物理テクスチャはバイリニア, ページテーブルはポイントサンプリング.
+    m_d3dDev->SetTexture(1, m_VTPhysical);
+    m_d3dDev->SetSamplerState(1, D3DSAMP_MINFILTER, D3DTEXF_LINEAR);
+    m_d3dDev->SetSamplerState(1, D3DSAMP_MAGFILTER, D3DTEXF_LINEAR);
+    m_d3dDev->SetSamplerState(1, D3DSAMP_ADDRESSU, D3DTADDRESS_CLAMP);
+    m_d3dDev->SetSamplerState(1, D3DSAMP_ADDRESSV, D3DTADDRESS_CLAMP);
+    m_d3dDev->SetTexture(2, m_VTPageTable);
+    m_d3dDev->SetSamplerState(2, D3DSAMP_MINFILTER, D3DTEXF_POINT);
+    m_d3dDev->SetSamplerState(2, D3DSAMP_MAGFILTER, D3DTEXF_POINT);
+    m_d3dDev->SetSamplerState(2, D3DSAMP_ADDRESSU, D3DTADDRESS_CLAMP);
+    m_d3dDev->SetSamplerState(2, D3DSAMP_ADDRESSV, D3DTADDRESS_CLAMP);
+    m_d3dDev->DrawIndexedPrimitive(D3DPT_TRIANGLELIST, 0, 0, 4, 0, 2);
 
     m_d3dDev->EndScene();
     HRESULT hr;
@@ -391,7 +545,23 @@ void App::Render()
 
 void App::Terminate()
 {
-    SafeRelease(m_Texture);
+    const VirtualTexture::Stats& stats = m_VirtualTexture.GetStats();
+    char buf[160];
+    sprintf_s(buf, "VirtualTexture: %u requests, %u loads, %u uploads, %u evictions, %u dropped\n",
+        stats.requests, stats.loads, stats.uploads, stats.evictions, stats.dropped);
+    OutputDebugStringA(buf);
+    m_VirtualTexture.Close();
+
+    SafeRelease(m_VTPhysical);
+    SafeRelease(m_VTPhysicalStaging);
+    SafeRelease(m_VTPageTable);
+    SafeRelease(m_VTPageTableStaging);
+    SafeRelease(m_VTPixelShader);
+    for (auto& page : m_AtlasPages)
+    {
+        SafeRelease(page);
+    }
+    m_AtlasPages.clear();
     SafeRelease(m_VertexBuffer);
     SafeRelease(m_IndexBuffer);
     SafeRelease(m_Declaration);
@@ -399,6 +569,7 @@ void App::Terminate()
     SafeRelease(m_PixelShader);
     SafeRelease(m_d3dDev);
     SafeRelease(m_d3d9);
+    assetFileSystem.UnmountAll();
 }
 
 // 頂点宣言の作成・準備を行います.
@@ -415,23 +586,125 @@ bool App::SetupVertexDeclaration()
     return SUCCEEDED(hr);
 }
 
+// 画像を読み込んでアトラスにまとめ, ページごとのテクスチャを作成します.
+// スプライト用に切り出した画像を 0 番から登録します. 中央の画像はバーチャルテクスチャで描画します.
+bool App::SetupAtlas(TextureAtlas& atlas)
+{
+    int width = 0, height = 0;
+    std::vector<uint8_t> image;
+    if (!LoadImageFile("Parrots.png", width, height, image))
+    {
+        return false;
+    }
+
+    // 大きさの異なる小さな画像の代わりに, 読み込んだ画像の一部を切り出して使う.
+    std::mt19937 random(0);
+    for (int i = 0; i < SpriteCount; ++i)
+    {
+        int w = MinSpriteImageSize + int(random() % (MaxSpriteImageSize - MinSpriteImageSize + 1));
+        int h = MinSpriteImageSize + int(random() % (MaxSpriteImageSize - MinSpriteImageSize + 1));
+        w = (w < width) ? w : width;
+        h = (h < height) ? h : height;
+        int x = int(random() % (width - w + 1));
+        int y = int(random() % (height - h + 1));
+        atlas.AddImage(w, h, &image[(size_t(y) * width + x) * 4], width * 4);
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    if (!atlas.Build())
+    {
+        return false;
+    }
+    auto end = std::chrono::steady_clock::now();
+    char buf[160];
+    sprintf_s(buf, "TextureAtlas: %d images, %d pages, occupancy %.1f%%, %.2f ms\n",
+        SpriteCount, atlas.GetPageCount(), atlas.GetOccupancy() * 100.0f,
+        std::chrono::duration<double, std::milli>(end - begin).count());
+    OutputDebugStringA(buf);
+
+    for (int page = 0; page < atlas.GetPageCount(); ++page)
+    {
+        IDirect3DTexture9* texture = CreateTextureFromImage(
+            m_d3dDev, atlas.GetPageWidth(), atlas.GetPageHeight(), atlas.GetPage(page).data());
+        if (!texture)
+        {
+            return false;
+        }
+        m_AtlasPages.push_back(texture);
+    }
+    return true;
+}
+
 // 頂点バッファ・インデックスバッファの作成・準備を行います.
-bool App::SetupBuffers()
+// 先頭に中央の画像の四角形を置き, その後ろにスプライトをアトラスのページ順に並べてページごとの描画範囲を記録します.
+bool App::SetupBuffers(const TextureAtlas& atlas)
 {
-    MyVertex vertices[] = {
+    MyVertex quad[] = {
         { XMFLOAT3(-1.0f, 1.0f, 0.0f), XMFLOAT2(0.0f,0.0f) },
         { XMFLOAT3( 1.0f, 1.0f, 0.0f), XMFLOAT2(1.0f,0.0f) },
         { XMFLOAT3( 1.0f,-1.0f, 0.0f), XMFLOAT2(1.0f,1.0f) },
         { XMFLOAT3(-1.0f,-1.0f, 0.0f), XMFLOAT2(0.0f,1.0f) },
     };
-    uint16_t indices[] = {
+    uint16_t quadIndices[] = {
         0, 1, 2,
         2, 3, 0
     };
-    UINT lengthVB = sizeof(vertices);
-    UINT lengthIB = sizeof(indices);
-    m_VertexCount = sizeof(vertices)/sizeof(vertices[0]);
-    m_IndexCount = sizeof(indices)/sizeof(indices[0]);
+
+    // 中央の画像はバーチャルテクスチャの UV をそのまま使う.
+    std::vector<MyVertex> vertices(quad, quad + 4);
+    std::vector<uint16_t> indices(quadIndices, quadIndices + 6);
+
+    // スプライトの番号をページ順に並べる.
+    std::vector<int> order(SpriteCount);
+    for (int i = 0; i < SpriteCount; ++i)
+    {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&atlas](int a, int b) {
+        return atlas.GetRegion(a).page < atlas.GetRegion(b).page;
+    });
+
+    m_Batches.clear();
+    for (int image : order)
+    {
+        // スプライトは縦横比を保って格子状に並べる.
+        const TextureAtlas::Region& region = atlas.GetRegion(image);
+        MyVertex v[4];
+        memcpy(v, quad, sizeof(quad));
+        int column = image % SpriteColumns;
+        int row = image / SpriteColumns;
+        float cx = (column - (SpriteColumns - 1) * 0.5f) * SpriteSpacing;
+        float cy = (row - (SpriteRows - 1) * 0.5f) * SpriteSpacing;
+        float scale = SpriteSpacing * 0.45f / float((region.width > region.height) ? region.width : region.height);
+        for (auto& vertex : v)
+        {
+            vertex.Pos = XMFLOAT3(
+                cx + vertex.Pos.x * region.width * scale,
+                cy + vertex.Pos.y * region.height * scale,
+                SpriteDepth);
+        }
+        atlas.RemapTexCoords(image, v, 4, sizeof(MyVertex), offsetof(MyVertex, UV));
+
+        int page = region.page;
+        if (m_Batches.empty() || m_Batches.back().page != page)
+        {
+            DrawBatch batch = { page, UINT(vertices.size()), 0, UINT(indices.size()), 0 };
+            m_Batches.push_back(batch);
+        }
+        DrawBatch& batch = m_Batches.back();
+        for (uint16_t index : quadIndices)
+        {
+            indices.push_back(uint16_t(vertices.size() + index));
+        }
+        vertices.insert(vertices.end(), v, v + 4);
+        batch.vertexCount += 4;
+        batch.primitiveCount += 2;
+    }
+
+    UINT lengthVB = UINT(vertices.size() * sizeof(MyVertex));
+    UINT lengthIB = UINT(indices.size() * sizeof(uint16_t));
+    m_VertexCount = int(vertices.size());
+    m_IndexCount = int(indices.size());
 
     HRESULT hr;
     hr = m_d3dDev->CreateVertexBuffer(
@@ -463,27 +736,201 @@ bool App::SetupBuffers()
     if (SUCCEEDED(hr))
     {
         // 事前に用意した頂点データをコピーする.
-        memcpy_s(p, lengthVB, vertices, lengthVB);
+        memcpy_s(p, lengthVB, vertices.data(), lengthVB);
         m_VertexBuffer->Unlock();
     }
     hr = m_IndexBuffer->Lock(0, 0, &p, 0);
     if (SUCCEEDED(hr))
     {
         // 事前に用意したインデックスデータをコピーする.
-        memcpy_s(p, lengthIB, indices, lengthIB);
+        memcpy_s(p, lengthIB, indices.data(), lengthIB);
         m_IndexBuffer->Unlock();
     }
 
     return true;
 }
 
+// 中央の画像のバーチャルテクスチャを開き, 物理テクスチャとページテーブルを作成します.
+// タイルに分けたファイルが無ければ, Parrots.png を拡大して作ります.
+bool App::SetupVirtualTexture()
+{
+    const std::string fileName = GetFilePathA(VirtualTextureFileName);
+    if (!m_VirtualTexture.Open(fileName.c_str(), VirtualTextureSlots))
+    {
+        int width = 0, height = 0;
+        std::vector<uint8_t> image, scaled;
+        if (!LoadImageFile("Parrots.png", width, height, image))
+        {
+            return false;
+        }
+        auto begin = std::chrono::steady_clock::now();
+        ResizeImage(image.data(), width, height, VirtualTextureSize, scaled);
+        if (!VirtualTextureFile::Build(fileName.c_str(), scaled.data(), VirtualTextureSize, VirtualTextureTileSize, VirtualTextureBorder))
+        {
+            return false;
+        }
+        auto end = std::chrono::steady_clock::now();
+        char buf[160];
+        sprintf_s(buf, "VirtualTexture: built %d x %d tiles, %.2f ms\n",
+            VirtualTextureSize / VirtualTextureTileSize, VirtualTextureSize / VirtualTextureTileSize,
+            std::chrono::duration<double, std::milli>(end - begin).count());
+        OutputDebugStringA(buf);
+
+        if (!m_VirtualTexture.Open(fileName.c_str(), VirtualTextureSlots))
+        {
+            return false;
+        }
+    }
+
+    // 物理テクスチャとページテーブルは, 作業用テクスチャへ書き込んでから転送する.
+    const UINT physicalSize = UINT(m_VirtualTexture.GetPageSize() * m_VirtualTexture.GetSlotsPerSide());
+    const UINT tiles = UINT(m_VirtualTexture.GetPageTable().GetTileCount());
+    const D3DFORMAT format = D3DFMT_A8R8G8B8;
+    HRESULT hr;
+    hr = m_d3dDev->CreateTexture(physicalSize, physicalSize, 1, 0, format, D3DPOOL_DEFAULT, &m_VTPhysical, nullptr);
+    if (FAILED(hr))
+    {
+        return false;
+    }
+    hr = m_d3dDev->CreateTexture(physicalSize, physicalSize, 1, 0, format, D3DPOOL_SYSTEMMEM, &m_VTPhysicalStaging, nullptr);
+    if (FAILED(hr))
+    {
+        return false;
+    }
+    hr = m_d3dDev->CreateTexture(tiles, tiles, 1, 0, format, D3DPOOL_DEFAULT, &m_VTPageTable, nullptr);
+    if (FAILED(hr))
+    {
+        return false;
+    }
+    hr = m_d3dDev->CreateTexture(tiles, tiles, 1, 0, format, D3DPOOL_SYSTEMMEM, &m_VTPageTableStaging, nullptr);
+    if (FAILED(hr))
+    {
+        return false;
+    }
+    UploadPageTable();
+    return true;
+}
+
+// 中央の四角形を格子に分けて画面へ投影し, 見えている升目ごとに UV の範囲と詳細度を求めてタイルを要求します.
+// その後, 読み込みの終わったタイルを物理テクスチャへ書き込み, ページテーブルを更新します.
+void App::UpdateVirtualTexture(const XMMATRIX& world)
+{
+    m_VirtualTexture.BeginFrame();
+
+    // 格子点の画面上の位置. z には w を入れ, 視点の後ろにある点を区別する.
+    const XMMATRIX wvp = world * m_mtxView * m_mtxProj;
+    const float width = float(m_d3dpp.BackBufferWidth);
+    const float height = float(m_d3dpp.BackBufferHeight);
+    const int points = FeedbackGridSize + 1;
+    std::vector<XMFLOAT3> screen(points * points);
+    for (int j = 0; j < points; ++j)
+    {
+        for (int i = 0; i < points; ++i)
+        {
+            float u = float(i) / FeedbackGridSize;
+            float v = float(j) / FeedbackGridSize;
+            XMVECTOR p = XMVector4Transform(XMVectorSet(u * 2.0f - 1.0f, 1.0f - v * 2.0f, 0.0f, 1.0f), wvp);
+            float w = XMVectorGetW(p);
+            XMFLOAT3& s = screen[j * points + i];
+            s.x = (w > 0.0f) ? (XMVectorGetX(p) / w * 0.5f + 0.5f) * width : 0.0f;
+            s.y = (w > 0.0f) ? (0.5f - XMVectorGetY(p) / w * 0.5f) * height : 0.0f;
+            s.z = w;
+        }
+    }
+
+    const float texelsPerCell = float(m_VirtualTexture.GetHeader().size) / FeedbackGridSize;
+    for (int j = 0; j < FeedbackGridSize; ++j)
+    {
+        for (int i = 0; i < FeedbackGridSize; ++i)
+        {
+            const XMFLOAT3& c00 = screen[j * points + i];
+            const XMFLOAT3& c10 = screen[j * points + i + 1];
+            const XMFLOAT3& c01 = screen[(j + 1) * points + i];
+            const XMFLOAT3& c11 = screen[(j + 1) * points + i + 1];
+            if (c00.z <= 0.0f || c10.z <= 0.0f || c01.z <= 0.0f || c11.z <= 0.0f)
+            {
+                continue;
+            }
+            float minX = c00.x, maxX = c00.x, minY = c00.y, maxY = c00.y;
+            for (const XMFLOAT3* c : { &c10, &c01, &c11 })
+            {
+                minX = (c->x < minX) ? c->x : minX;
+                maxX = (c->x > maxX) ? c->x : maxX;
+                minY = (c->y < minY) ? c->y : minY;
+                maxY = (c->y > maxY) ? c->y : maxY;
+            }
+            if (maxX < 0.0f || minX > width || maxY < 0.0f || minY > height)
+            {
+                continue;
+            }
+
+            // 升目の長い方の辺に合わせ, 細かい方のミップを選ぶ.
+            float du = hypotf(c10.x - c00.x, c10.y - c00.y);
+            float dv = hypotf(c01.x - c00.x, c01.y - c00.y);
+            float pixels = (du > dv) ? du : dv;
+            float texelsPerPixel = texelsPerCell / ((pixels > 1.0f) ? pixels : 1.0f);
+            m_VirtualTexture.RequestRegion(
+                float(i) / FeedbackGridSize, float(j) / FeedbackGridSize,
+                float(i + 1) / FeedbackGridSize, float(j + 1) / FeedbackGridSize,
+                texelsPerPixel);
+        }
+    }
+
+    // 読み込みの終わったタイルを作業用テクスチャのスロットの位置へ書き込む.
+    // ロックした範囲が UpdateTexture での転送の対象になる.
+    const int pageSize = m_VirtualTexture.GetPageSize();
+    const int slotsPerSide = m_VirtualTexture.GetSlotsPerSide();
+    int uploads = m_VirtualTexture.Update(MaxTileUploadsPerFrame, [&](int slot, const uint8_t* pixels) {
+        RECT rect;
+        rect.left = (slot % slotsPerSide) * pageSize;
+        rect.top = (slot / slotsPerSide) * pageSize;
+        rect.right = rect.left + pageSize;
+        rect.bottom = rect.top + pageSize;
+        D3DLOCKED_RECT locked;
+        if (FAILED(m_VTPhysicalStaging->LockRect(0, &locked, &rect, 0)))
+        {
+            return;
+        }
+        for (int y = 0; y < pageSize; ++y)
+        {
+            uint8_t* dst = static_cast<uint8_t*>(locked.pBits) + y * locked.Pitch;
+            CopyRowToBGRA(dst, pixels + size_t(y) * pageSize * 4, pageSize);
+        }
+        m_VTPhysicalStaging->UnlockRect(0);
+    });
+    if (uploads > 0)
+    {
+        m_d3dDev->UpdateTexture(m_VTPhysicalStaging, m_VTPhysical);
+        UploadPageTable();
+    }
+}
+
+// ページテーブルの内容をテクスチャへ転送します.
+void App::UploadPageTable()
+{
+    const PageTable& pageTable = m_VirtualTexture.GetPageTable();
+    const int tiles = pageTable.GetTileCount();
+    D3DLOCKED_RECT locked;
+    if (FAILED(m_VTPageTableStaging->LockRect(0, &locked, nullptr, 0)))
+    {
+        return;
+    }
+    for (int y = 0; y < tiles; ++y)
+    {
+        uint8_t* dst = static_cast<uint8_t*>(locked.pBits) + y * locked.Pitch;
+        memcpy_s(dst, tiles * sizeof(uint32_t), &pageTable.GetEntries()[size_t(y) * tiles], tiles * sizeof(uint32_t));
+    }
+    m_VTPageTableStaging->UnlockRect(0);
+    m_d3dDev->UpdateTexture(m_VTPageTableStaging, m_VTPageTable);
+}
+
 bool App::LoadShader()
 {
     HRESULT hr;
     std::vector<uint8_t> buf;
 
     // Vertex Shader
-    if (!CompileShader(L"VertexShader.hlsl", true, buf))
+    if (!CompileShader("VertexShader.hlsl", true, buf))
     {
         return false;
     }
@@ -497,7 +944,7 @@ bool App::LoadShader()
 
     // Pixel Shader
 
-    if (!CompileShader(L"PixelShader.hlsl", false, buf))
+    if (!CompileShader("PixelShader.hlsl", false, buf))
     {
         return false;
     }
@@ -509,5 +956,18 @@ bool App::LoadShader()
     {
         return false;
     }
+
+    // Pixel Shader (Virtual Texture)
+    if (!CompileShader("VirtualTexturePS.hlsl", false, buf))
+    {
+        return false;
+    }
+    hr = m_d3dDev->CreatePixelShader(
+        reinterpret_cast<DWORD*>(buf.data()), 
+        &m_VTPixelShader);
+    if (FAILED(hr))
+    {
+        return false;
+    }
     return true;
 }
@@ -3,6 +3,11 @@
 
 #include <DirectXMath.h>
 #include <DirectXPackedVector.h>
+#include <chrono>
+#include <vector>
+#include "VirtualTexture.h"
+
+class TextureAtlas;
 
 
 class App
@@ -25,7 +30,11 @@ private:
         }
         v = nullptr;
     }
-    bool SetupBuffers();
+    bool SetupAtlas(TextureAtlas& atlas);
+    bool SetupBuffers(const TextureAtlas& atlas);
+    bool SetupVirtualTexture();
+    void UpdateVirtualTexture(const DirectX::XMMATRIX& world);
+    void UploadPageTable();
     bool SetupVertexDeclaration();
     bool LoadShader();
 
@@ -44,7 +53,28 @@ private:
     IDirect3DIndexBuffer9* m_IndexBuffer;
     IDirect3DVertexShader9* m_VertexShader;
     IDirect3DPixelShader9*  m_PixelShader;
-    IDirect3DTexture9*  m_Texture;
+
+    // アトラスのページと, ページごとの描画範囲.
+    struct DrawBatch
+    {
+        int page;
+        UINT minVertex;
+        UINT vertexCount;
+        UINT startIndex;
+        UINT primitiveCount;
+    };
+    std::vector<IDirect3DTexture9*> m_AtlasPages;
+    std::vector<DrawBatch> m_Batches;
+
+    // 中央の画像はバーチャルテクスチャで描画する.
+    // 読み込んだタイルは作業用テクスチャに書き込み, フレームごとにまとめて転送する.
+    VirtualTexture m_VirtualTexture;
+    IDirect3DTexture9* m_VTPhysical;
+    IDirect3DTexture9* m_VTPhysicalStaging;
+    IDirect3DTexture9* m_VTPageTable;
+    IDirect3DTexture9* m_VTPageTableStaging;
+    IDirect3DPixelShader9* m_VTPixelShader;
+    std::chrono::steady_clock::time_point m_StartTime;
 
     DirectX::XMMATRIX m_mtxView; // ビュー行列.
     DirectX::XMMATRIX m_mtxProj; // プロジェクション行列.
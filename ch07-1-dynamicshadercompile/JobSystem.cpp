@@ -0,0 +1,446 @@
+﻿#include "JobSystem.h"
+
+#include <cstdio>
+
+struct JobSystem::Job
+{
+    std::function<void()> func;
+    JobCounter* counter;
+    Job* next;      // 同じカウンターの完了を待つ次のジョブ.
+};
+
+namespace
+{
+// Chase-Lev のデック. 持ち主のスレッドだけが Push() と Pop() を行い, 他のスレッドは Steal() で古い方から取る.
+// 容量は固定で, 一杯なら Push() は false を返す.
+class WorkStealingQueue
+{
+public:
+    static const int64_t Capacity = 4096;
+
+    WorkStealingQueue()
+        : m_top(0), m_bottom(0)
+    {
+        for (auto& job : m_jobs)
+        {
+            job.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    bool Push(JobSystem::Job* job)
+    {
+        const int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+        const int64_t top = m_top.load(std::memory_order_acquire);
+        if (bottom - top >= Capacity)
+        {
+            return false;
+        }
+        m_jobs[bottom & (Capacity - 1)].store(job, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    JobSystem::Job* Pop()
+    {
+        const int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+        m_bottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = m_top.load(std::memory_order_relaxed);
+        if (top > bottom)
+        {
+            // 空だった.
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        JobSystem::Job* job = m_jobs[bottom & (Capacity - 1)].load(std::memory_order_relaxed);
+        if (top == bottom)
+        {
+            // 最後の 1 つは盗もうとしているスレッドと取り合う.
+            if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                job = nullptr;
+            }
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    JobSystem::Job* Steal()
+    {
+        int64_t top = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t bottom = m_bottom.load(std::memory_order_acquire);
+        if (top >= bottom)
+        {
+            return nullptr;
+        }
+        JobSystem::Job* job = m_jobs[top & (Capacity - 1)].load(std::memory_order_relaxed);
+        if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            // 他のスレッドが先に取った.
+            return nullptr;
+        }
+        return job;
+    }
+
+private:
+    // 盗む側が書き換える top と, 持ち主が書き換える bottom は別のキャッシュラインに置く.
+    alignas(64) std::atomic<int64_t> m_top;
+    alignas(64) std::atomic<int64_t> m_bottom;
+    alignas(64) std::atomic<JobSystem::Job*> m_jobs[Capacity];
+};
+
+// 現在のスレッドがどのジョブシステムの何番のワーカーか.
+thread_local const JobSystem* t_system = nullptr;
+thread_local int t_workerIndex = -1;
+// 盗む相手を選ぶための乱数.
+thread_local uint32_t t_random = 0;
+
+uint32_t NextRandom()
+{
+    if (t_random == 0)
+    {
+        t_random = uint32_t(std::hash<std::thread::id>()(std::this_thread::get_id())) | 1;
+    }
+    // xorshift32.
+    t_random ^= t_random << 13;
+    t_random ^= t_random >> 17;
+    t_random ^= t_random << 5;
+    return t_random;
+}
+
+// ジョブが見つからないとき, 眠る前に探し直す回数.
+const int SpinCount = 64;
+}
+
+struct JobSystem::Worker
+{
+    WorkStealingQueue queue;
+    std::atomic<uint64_t> executed;
+    std::atomic<uint64_t> stolen;
+    std::atomic<uint64_t> inlined;
+    std::atomic<uint64_t> sleeps;
+
+    Worker()
+        : executed(0), stolen(0), inlined(0), sleeps(0)
+    {
+    }
+};
+
+JobCounter::JobCounter()
+    : m_count(0), m_finishing(0), m_waitingJobs(nullptr)
+{
+}
+
+JobSystem::JobSystem(int threadCount)
+    : m_injectedPending(0), m_queuedCount(0), m_sleepingCount(0), m_quit(false),
+    m_externalExecuted(0), m_externalStolen(0), m_injectedCount(0)
+{
+    if (threadCount <= 0)
+    {
+        threadCount = std::max(1, int(std::thread::hardware_concurrency()));
+    }
+    for (int i = 0; i + 1 < threadCount; ++i)
+    {
+        m_workers.push_back(new Worker());
+    }
+    // 全てのデックを作ってからスレッドを起動する.
+    for (int i = 0; i + 1 < threadCount; ++i)
+    {
+        m_threads.push_back(std::thread(&JobSystem::WorkerMain, this, i));
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_quit = true;
+    }
+    m_wake.notify_all();
+    for (auto& thread : m_threads)
+    {
+        thread.join();
+    }
+    // ワーカーが無ければ, 残りはここで実行する.
+    while (Job* job = FindJob(-1))
+    {
+        Execute(job);
+    }
+    for (auto worker : m_workers)
+    {
+        delete worker;
+    }
+}
+
+JobSystem& JobSystem::GetShared()
+{
+    static JobSystem system(0);
+    return system;
+}
+
+void JobSystem::Run(std::function<void()> func, JobCounter* counter, JobCounter* dependency)
+{
+    Job* job = new Job();
+    job->func = std::move(func);
+    job->counter = counter;
+    job->next = nullptr;
+    if (counter)
+    {
+        counter->m_count.fetch_add(1);
+    }
+
+    if (dependency)
+    {
+        // Finish() はカウンターが 0 になってからロックを取って一覧を空にするので,
+        // ロックの中で 0 でなければ, 一覧に加えたジョブは必ず Finish() が追加する.
+        std::lock_guard<std::mutex> lock(dependency->m_mutex);
+        if (dependency->m_count.load() != 0)
+        {
+            job->next = dependency->m_waitingJobs;
+            dependency->m_waitingJobs = job;
+            return;
+        }
+    }
+    Schedule(job);
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+    const int index = GetCurrentWorkerIndex();
+    while (counter.m_count.load() != 0 || counter.m_finishing.load() != 0)
+    {
+        Job* job = FindJob(index);
+        if (job)
+        {
+            Execute(job);
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+JobSystem::Stats JobSystem::GetStats() const
+{
+    Stats stats;
+    stats.executed = m_externalExecuted.load(std::memory_order_relaxed);
+    stats.stolen = m_externalStolen.load(std::memory_order_relaxed);
+    stats.injected = m_injectedCount.load(std::memory_order_relaxed);
+    stats.inlined = 0;
+    stats.sleeps = 0;
+    for (auto worker : m_workers)
+    {
+        stats.executed += worker->executed.load(std::memory_order_relaxed);
+        stats.stolen += worker->stolen.load(std::memory_order_relaxed);
+        stats.inlined += worker->inlined.load(std::memory_order_relaxed);
+        stats.sleeps += worker->sleeps.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+void JobSystem::ResetStats()
+{
+    m_externalExecuted.store(0, std::memory_order_relaxed);
+    m_externalStolen.store(0, std::memory_order_relaxed);
+    m_injectedCount.store(0, std::memory_order_relaxed);
+    for (auto worker : m_workers)
+    {
+        worker->executed.store(0, std::memory_order_relaxed);
+        worker->stolen.store(0, std::memory_order_relaxed);
+        worker->inlined.store(0, std::memory_order_relaxed);
+        worker->sleeps.store(0, std::memory_order_relaxed);
+    }
+}
+
+std::string JobSystem::Report() const
+{
+    const Stats stats = GetStats();
+    char buf[256];
+    snprintf(buf, sizeof(buf),
+        "Jobs: %llu executed, %llu stolen, %llu injected, %llu inlined, %llu sleeps (%d threads)\n",
+        (unsigned long long)stats.executed, (unsigned long long)stats.stolen,
+        (unsigned long long)stats.injected, (unsigned long long)stats.inlined,
+        (unsigned long long)stats.sleeps, GetThreadCount());
+    return buf;
+}
+
+void JobSystem::WorkerMain(int index)
+{
+    t_system = this;
+    t_workerIndex = index;
+    Worker* worker = m_workers[index];
+    for (;;)
+    {
+        Job* job = nullptr;
+        for (int i = 0; i < SpinCount && !job; ++i)
+        {
+            job = FindJob(index);
+            if (!job)
+            {
+                std::this_thread::yield();
+            }
+        }
+        if (job)
+        {
+            Execute(job);
+            continue;
+        }
+
+        // 追加する側は m_queuedCount を増やしてから m_sleepingCount を見るので,
+        // こちらは m_sleepingCount を増やしてから m_queuedCount を見れば起こし損ねない.
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_sleepingCount.fetch_add(1);
+        if (m_queuedCount.load() <= 0 && !m_quit)
+        {
+            worker->sleeps.fetch_add(1, std::memory_order_relaxed);
+            m_wake.wait(lock, [this]() { return m_queuedCount.load() > 0 || m_quit; });
+        }
+        m_sleepingCount.fetch_sub(1);
+        // 終了の指示があっても, 残っているジョブは実行してから抜ける.
+        if (m_quit && m_queuedCount.load() <= 0)
+        {
+            break;
+        }
+    }
+    t_system = nullptr;
+    t_workerIndex = -1;
+}
+
+JobSystem::Job* JobSystem::FindJob(int index)
+{
+    if (m_queuedCount.load(std::memory_order_relaxed) <= 0)
+    {
+        return nullptr;
+    }
+
+    Job* job = nullptr;
+    if (index >= 0)
+    {
+        job = m_workers[index]->queue.Pop();
+    }
+    if (!job && m_injectedPending.load(std::memory_order_relaxed) > 0)
+    {
+        std::lock_guard<std::mutex> lock(m_injectMutex);
+        if (!m_injected.empty())
+        {
+            job = m_injected.front();
+            m_injected.pop_front();
+            m_injectedPending.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+    if (!job && !m_workers.empty())
+    {
+        // 乱数で決めた相手から順に盗む.
+        const int count = int(m_workers.size());
+        const int start = int(NextRandom() % uint32_t(count));
+        for (int i = 0; i < count && !job; ++i)
+        {
+            const int victim = (start + i) % count;
+            if (victim != index)
+            {
+                job = m_workers[victim]->queue.Steal();
+            }
+        }
+        if (job)
+        {
+            if (index >= 0)
+            {
+                m_workers[index]->stolen.fetch_add(1, std::memory_order_relaxed);
+            }
+            else
+            {
+                m_externalStolen.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+    if (job)
+    {
+        m_queuedCount.fetch_sub(1);
+    }
+    return job;
+}
+
+void JobSystem::Schedule(Job* job)
+{
+    // 眠っているワーカーが取り損ねないよう, 先に数えておく.
+    m_queuedCount.fetch_add(1);
+    const int index = GetCurrentWorkerIndex();
+    if (index >= 0)
+    {
+        if (!m_workers[index]->queue.Push(job))
+        {
+            // デックが一杯ならその場で実行する.
+            m_queuedCount.fetch_sub(1);
+            m_workers[index]->inlined.fetch_add(1, std::memory_order_relaxed);
+            Execute(job);
+            return;
+        }
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(m_injectMutex);
+        m_injected.push_back(job);
+        m_injectedPending.fetch_add(1, std::memory_order_relaxed);
+        m_injectedCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (m_sleepingCount.load() > 0)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+        }
+        m_wake.notify_one();
+    }
+}
+
+void JobSystem::Execute(Job* job)
+{
+    job->func();
+    JobCounter* counter = job->counter;
+    delete job;
+
+    const int index = GetCurrentWorkerIndex();
+    if (index >= 0)
+    {
+        m_workers[index]->executed.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        m_externalExecuted.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (counter)
+    {
+        Finish(counter);
+    }
+}
+
+void JobSystem::Finish(JobCounter* counter)
+{
+    // m_count が 0 になった後も, 一覧を空にするまでは Wait() から戻らないようにする.
+    counter->m_finishing.fetch_add(1);
+    if (counter->m_count.fetch_sub(1) == 1)
+    {
+        Job* waiting = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(counter->m_mutex);
+            waiting = counter->m_waitingJobs;
+            counter->m_waitingJobs = nullptr;
+        }
+        while (waiting)
+        {
+            Job* next = waiting->next;
+            waiting->next = nullptr;
+            Schedule(waiting);
+            waiting = next;
+        }
+    }
+    counter->m_finishing.fetch_sub(1);
+}
+
+int JobSystem::GetCurrentWorkerIndex() const
+{
+    return t_system == this ? t_workerIndex : -1;
+}
@@ -0,0 +1,153 @@
+﻿#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class JobCounter;
+
+// 複数のスレッドでジョブを実行するスケジューラー. D3D には依存しません.
+//
+// ワーカースレッドはそれぞれ Chase-Lev のデック (両端キュー) を持ち, 自分で追加したジョブは
+// 新しいものから取り出し, 自分のデックが空なら他のワーカーのデックの古いものから盗みます.
+// ワーカー以外のスレッドから追加したジョブは, ロックで守った共有のキューに入ります.
+//
+// ジョブの完了は JobCounter で待ちます. Wait() は待つ間も他のジョブを実行するので,
+// ジョブの中から別のジョブを追加して待っても止まりません.
+// ファイルの読み込みのように長く止まる処理はジョブにせず, 専用のスレッドで行ってください.
+// ジョブは例外を投げないでください.
+class JobSystem
+{
+public:
+    struct Job;
+
+    struct Stats
+    {
+        uint64_t executed;  // 実行したジョブ.
+        uint64_t stolen;    // 他のワーカーのデックから盗んだジョブ.
+        uint64_t injected;  // ワーカー以外のスレッドから追加したジョブ.
+        uint64_t inlined;   // デックが一杯のため, 追加せずにその場で実行したジョブ.
+        uint64_t sleeps;    // ジョブが無くワーカーが眠った回数.
+    };
+
+    // threadCount は Wait() を呼ぶスレッドを含めた, ジョブを実行するスレッドの数です.
+    // threadCount - 1 個のワーカースレッドを作ります. 0 以下ならハードウェアのスレッド数にします.
+    explicit JobSystem(int threadCount);
+    // 残っているジョブを全て実行してからスレッドを終了します.
+    ~JobSystem();
+
+    // 共有のジョブシステム. 最初に呼んだときにハードウェアのスレッド数で作ります.
+    static JobSystem& GetShared();
+
+    // Wait() を呼ぶスレッドを含めた数.
+    int GetThreadCount() const { return int(m_workers.size()) + 1; }
+
+    // func を実行するジョブを追加します. counter が nullptr でなければ, 完了するまで counter を増やしておきます.
+    // dependency が nullptr でなければ, その時点で dependency に数えているジョブが全て完了してから実行します.
+    void Run(std::function<void()> func, JobCounter* counter, JobCounter* dependency = nullptr);
+
+    // counter のジョブが全て完了するまで, 他のジョブを実行しながら待ちます.
+    // 戻った後は counter を破棄しても構いません.
+    void Wait(JobCounter& counter);
+
+    // [0, count) を grainSize 以下の範囲に分け, func(begin, end) を並列に実行して完了を待ちます.
+    // 範囲は後ろ半分をジョブにしながら分けていくので, 空いたワーカーは大きな残りを盗みます.
+    template<class F>
+    void ParallelFor(size_t count, size_t grainSize, const F& func);
+
+    Stats GetStats() const;
+    void ResetStats();
+    std::string Report() const;
+
+private:
+    JobSystem(const JobSystem&);
+    JobSystem& operator=(const JobSystem&);
+
+    struct Worker;
+
+    template<class F>
+    void Split(size_t begin, size_t end, size_t grainSize, const F& func, JobCounter& counter);
+
+    void WorkerMain(int index);
+    // 実行するジョブを探します. index はワーカーの番号で, ワーカー以外のスレッドなら -1 です.
+    Job* FindJob(int index);
+    void Schedule(Job* job);
+    void Execute(Job* job);
+    void Finish(JobCounter* counter);
+    int GetCurrentWorkerIndex() const;
+
+    std::vector<Worker*> m_workers;
+    std::vector<std::thread> m_threads;
+
+    // ワーカー以外のスレッドから追加したジョブ.
+    std::mutex m_injectMutex;
+    std::deque<Job*> m_injected;
+    std::atomic<int> m_injectedPending;     // m_injected の数. ロックを取らずに空か調べるため.
+
+    // デックと共有のキューにあるジョブの数. 0 の間はワーカーが眠る.
+    std::atomic<int> m_queuedCount;
+    std::atomic<int> m_sleepingCount;
+    bool m_quit;
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wake;
+
+    // ワーカー以外のスレッドでの統計. ワーカーの分は Worker が持つ.
+    std::atomic<uint64_t> m_externalExecuted;
+    std::atomic<uint64_t> m_externalStolen;
+    std::atomic<uint64_t> m_injectedCount;
+};
+
+// 完了していないジョブの数. JobSystem::Run() で増え, ジョブの完了で減ります.
+// 待っている間は新しいジョブを数えないでください.
+class JobCounter
+{
+public:
+    JobCounter();
+
+    bool IsDone() const { return m_count.load() == 0; }
+
+private:
+    JobCounter(const JobCounter&);
+    JobCounter& operator=(const JobCounter&);
+
+    friend class JobSystem;
+
+    std::atomic<int> m_count;
+    // 完了の処理中のスレッドの数. 0 に戻るまで Wait() は戻らない.
+    std::atomic<int> m_finishing;
+    // 完了を待って実行するジョブの一覧.
+    std::mutex m_mutex;
+    JobSystem::Job* m_waitingJobs;
+};
+
+template<class F>
+void JobSystem::ParallelFor(size_t count, size_t grainSize, const F& func)
+{
+    JobCounter counter;
+    Split(0, count, std::max<size_t>(grainSize, 1), func, counter);
+    Wait(counter);
+}
+
+template<class F>
+void JobSystem::Split(size_t begin, size_t end, size_t grainSize, const F& func, JobCounter& counter)
+{
+    while (end - begin > grainSize)
+    {
+        const size_t middle = begin + (end - begin) / 2;
+        Run([this, middle, end, grainSize, &func, &counter]() {
+            Split(middle, end, grainSize, func, counter);
+        }, &counter);
+        end = middle;
+    }
+    if (begin < end)
+    {
+        func(begin, end);
+    }
+}
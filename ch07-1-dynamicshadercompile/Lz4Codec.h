@@ -0,0 +1,26 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// LZ4 のブロック形式による圧縮. D3D には依存しません.
+//
+// 出力は LZ4 のブロック形式 (フレームのヘッダやチェックサムは含まない) と互換です.
+// 各シーケンスは次の形で並びます.
+//   トークン (上位 4 ビットがリテラル長, 下位 4 ビットが一致長 - 4).
+//   15 を超える長さは 255 の続くバイトで延長する.
+//   リテラル, 2 バイトの距離 (リトルエンディアン), 延長した一致長.
+// 最後のシーケンスはリテラルのみで終わります.
+//
+// 圧縮は 4 バイトのハッシュで直前の出現位置だけを探す高速な方式で, 圧縮率より展開の速さを優先します.
+// 展開は出力の大きさがあらかじめ分かっている前提で, 入力が壊れている場合は false を返します.
+namespace Lz4Codec
+{
+    // srcSize バイトを圧縮したときの最大の大きさ.
+    size_t GetMaxCompressedSize(size_t srcSize);
+
+    // dst には GetMaxCompressedSize(srcSize) バイト以上を用意します. 圧縮後の大きさを返します.
+    size_t Compress(const uint8_t* src, size_t srcSize, uint8_t* dst);
+
+    // 展開した大きさが dstSize と一致しなければ false を返します.
+    bool Decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize);
+}
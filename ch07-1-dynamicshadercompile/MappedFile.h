@@ -0,0 +1,51 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// ファイルを読み込み専用でメモリに割り当てるクラス. D3D には依存しません.
+// Windows ではファイルマッピング, それ以外では mmap を使います.
+// 内容はヒープへコピーせず, 割り当てたメモリをそのまま stbi_load_from_memory やシェーダーの作成に渡します.
+// 2 GB を超えるファイルも扱えます (32 ビット版ではアドレス空間の範囲まで).
+class MappedFile
+{
+public:
+    // 読み込み方のヒント. OS の先読みの方針を変えます.
+    enum AccessHint
+    {
+        Normal,
+        Sequential,     // 先頭から順に 1 回読む.
+        Random,         // 飛び飛びに読む.
+        WillNeed,       // すぐに全体を読むので先読みさせる.
+    };
+
+    MappedFile();
+    ~MappedFile();
+
+    bool Open(const char* fileName, AccessHint hint = Normal);
+#ifdef _WIN32
+    bool Open(const wchar_t* fileName, AccessHint hint = Normal);
+#endif
+    void Close();
+
+    bool IsOpen() const { return m_isOpen; }
+    // 空のファイルでは nullptr.
+    const uint8_t* GetData() const { return m_data; }
+    size_t GetSize() const { return m_size; }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+#ifdef _WIN32
+    bool Map(AccessHint hint);
+#endif
+    void Advise(AccessHint hint);
+
+    const uint8_t* m_data;
+    size_t m_size;
+    bool m_isOpen;
+#ifdef _WIN32
+    void* m_file;       // HANDLE
+    void* m_mapping;    // HANDLE
+#endif
+};
@@ -0,0 +1,45 @@
+﻿#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#include "JobSystem.h"
+
+// JobSystem::GetShared() による簡単な並列実行. D3D には依存しません.
+
+// threadCount が 0 以下ならハードウェアのスレッド数を返します.
+inline int GetThreadCount(int threadCount)
+{
+    if (threadCount > 0)
+    {
+        return threadCount;
+    }
+    return std::max(1, int(std::thread::hardware_concurrency()));
+}
+
+// func(i) を i = 0 .. count - 1 について並列に実行し, 完了を待ちます.
+// 1 つずつジョブにして共有のワーカーで実行し, 呼び出したスレッドも待つ間に実行します.
+// そのためジョブの中から呼んでも構いません.
+template<class F>
+void ParallelFor(int count, F func)
+{
+    JobSystem::GetShared().ParallelFor(size_t(std::max(count, 0)), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            func(int(i));
+        }
+    });
+}
+
+// [0, size) を threadCount 個の連続した範囲に分け, func(begin, end) を並列に実行します.
+// 1 つの範囲が minSize より小さくならないようにスレッド数を減らします.
+template<class F>
+void ParallelRange(size_t size, int threadCount, size_t minSize, F func)
+{
+    size_t count = size / std::max<size_t>(minSize, 1);
+    count = std::max<size_t>(1, std::min<size_t>(count, GetThreadCount(threadCount)));
+    ParallelFor(int(count), [&](int i) {
+        func(size * i / count, size * (i + 1) / count);
+    });
+}
@@ -0,0 +1,209 @@
+﻿#include "TextureAtlas.h"
+#include <algorithm>
+#include <cstring>
+
+TextureAtlas::TextureAtlas(int pageWidth, int pageHeight, int padding)
+    : m_pageWidth(pageWidth), m_pageHeight(pageHeight), m_padding(padding)
+{
+}
+
+int TextureAtlas::AddImage(int width, int height, const uint8_t* rgba, int pitch)
+{
+    Image image;
+    image.width = width;
+    image.height = height;
+    image.pixels.resize(size_t(width) * height * 4);
+    for (int y = 0; y < height; ++y)
+    {
+        memcpy(&image.pixels[size_t(y) * width * 4], rgba + size_t(y) * pitch, size_t(width) * 4);
+    }
+    m_images.push_back(std::move(image));
+    return int(m_images.size()) - 1;
+}
+
+bool TextureAtlas::Build()
+{
+    // 高い画像から順に置くと隙間が少なくなる.
+    std::vector<int> order(m_images.size());
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = int(i);
+    }
+    std::stable_sort(order.begin(), order.end(), [this](int a, int b) {
+        if (m_images[a].height != m_images[b].height)
+        {
+            return m_images[a].height > m_images[b].height;
+        }
+        return m_images[a].width > m_images[b].width;
+    });
+
+    m_regions.assign(m_images.size(), Region());
+    m_pages.clear();
+    std::vector<std::vector<Segment>> skylines;
+    for (int index : order)
+    {
+        const Image& image = m_images[index];
+        const int width = image.width + m_padding * 2;
+        const int height = image.height + m_padding * 2;
+        if (width > m_pageWidth || height > m_pageHeight)
+        {
+            return false;
+        }
+
+        // 置けるページが無ければ新しいページを追加する.
+        Region& region = m_regions[index];
+        int x = 0, y = 0;
+        region.page = -1;
+        for (size_t page = 0; page < skylines.size() && region.page < 0; ++page)
+        {
+            if (Insert(skylines[page], width, height, x, y))
+            {
+                region.page = int(page);
+            }
+        }
+        if (region.page < 0)
+        {
+            skylines.push_back(std::vector<Segment>(1, Segment{ 0, 0, m_pageWidth }));
+            m_pages.push_back(std::vector<uint8_t>(size_t(m_pageWidth) * m_pageHeight * 4, 0));
+            Insert(skylines.back(), width, height, x, y);
+            region.page = int(skylines.size()) - 1;
+        }
+
+        region.x = x + m_padding;
+        region.y = y + m_padding;
+        region.width = image.width;
+        region.height = image.height;
+        region.u0 = float(region.x) / m_pageWidth;
+        region.v0 = float(region.y) / m_pageHeight;
+        region.u1 = float(region.x + region.width) / m_pageWidth;
+        region.v1 = float(region.y + region.height) / m_pageHeight;
+        CopyImage(image, region);
+    }
+    return true;
+}
+
+// スカイライン上で, 置いた後の上端が最も低くなる位置を探して置く.
+bool TextureAtlas::Insert(std::vector<Segment>& skyline, int width, int height, int& x, int& y) const
+{
+    size_t best = skyline.size();
+    int bestTop = m_pageHeight + 1;
+    int bestWidth = 0;
+    for (size_t i = 0; i < skyline.size(); ++i)
+    {
+        const int left = skyline[i].x;
+        if (left + width > m_pageWidth)
+        {
+            break;
+        }
+        // [left, left + width) にかかる区間の最も高い位置に置く.
+        int top = 0;
+        int covered = 0;
+        for (size_t k = i; covered < width; ++k)
+        {
+            top = std::max(top, skyline[k].y);
+            covered = skyline[k].x + skyline[k].width - left;
+        }
+        if (top + height > m_pageHeight)
+        {
+            continue;
+        }
+        if (top + height < bestTop || (top + height == bestTop && skyline[i].width < bestWidth))
+        {
+            best = i;
+            bestTop = top + height;
+            bestWidth = skyline[i].width;
+        }
+    }
+    if (best == skyline.size())
+    {
+        return false;
+    }
+
+    x = skyline[best].x;
+    y = bestTop - height;
+
+    // 置いた範囲を 1 つの区間にし, 覆われた区間を削る.
+    Segment placed = { x, bestTop, width };
+    skyline.insert(skyline.begin() + best, placed);
+    for (size_t i = best + 1; i < skyline.size();)
+    {
+        const int right = placed.x + placed.width;
+        if (skyline[i].x >= right)
+        {
+            break;
+        }
+        const int shrink = right - skyline[i].x;
+        if (skyline[i].width <= shrink)
+        {
+            skyline.erase(skyline.begin() + i);
+            continue;
+        }
+        skyline[i].x += shrink;
+        skyline[i].width -= shrink;
+        break;
+    }
+    // 同じ高さで隣り合う区間をまとめる.
+    for (size_t i = 0; i + 1 < skyline.size();)
+    {
+        if (skyline[i].y == skyline[i + 1].y)
+        {
+            skyline[i].width += skyline[i + 1].width;
+            skyline.erase(skyline.begin() + i + 1);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+    return true;
+}
+
+// 画像を書き込み, 周囲の余白には端のピクセルを複製する.
+void TextureAtlas::CopyImage(const Image& image, const Region& region)
+{
+    std::vector<uint8_t>& page = m_pages[region.page];
+    const size_t pagePitch = size_t(m_pageWidth) * 4;
+    for (int y = -m_padding; y < image.height + m_padding; ++y)
+    {
+        const int srcY = std::min(std::max(y, 0), image.height - 1);
+        const uint8_t* src = &image.pixels[size_t(srcY) * image.width * 4];
+        uint8_t* dst = &page[(region.y + y) * pagePitch + size_t(region.x) * 4];
+        for (int x = -m_padding; x < 0; ++x)
+        {
+            memcpy(dst + x * 4, src, 4);
+        }
+        memcpy(dst, src, size_t(image.width) * 4);
+        for (int x = image.width; x < image.width + m_padding; ++x)
+        {
+            memcpy(dst + x * 4, src + (image.width - 1) * 4, 4);
+        }
+    }
+}
+
+float TextureAtlas::GetOccupancy() const
+{
+    if (m_pages.empty())
+    {
+        return 0.0f;
+    }
+    double used = 0.0;
+    for (const auto& image : m_images)
+    {
+        used += double(image.width) * image.height;
+    }
+    return float(used / (double(m_pageWidth) * m_pageHeight * m_pages.size()));
+}
+
+void TextureAtlas::RemapTexCoords(int image, void* vertices, size_t vertexCount, size_t stride, size_t texcoordOffset) const
+{
+    const Region& region = m_regions[image];
+    uint8_t* p = static_cast<uint8_t*>(vertices) + texcoordOffset;
+    for (size_t i = 0; i < vertexCount; ++i, p += stride)
+    {
+        float uv[2];
+        memcpy(uv, p, sizeof(uv));
+        uv[0] = region.u0 + uv[0] * (region.u1 - region.u0);
+        uv[1] = region.v0 + uv[1] * (region.v1 - region.v0);
+        memcpy(p, uv, sizeof(uv));
+    }
+}
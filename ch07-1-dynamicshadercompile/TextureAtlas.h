@@ -0,0 +1,64 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 小さな画像を大きなページにまとめるテクスチャアトラス. D3D には依存しません.
+//
+// 画像は高さの大きい順に, スカイライン法 (各列の高さの輪郭を保持して, 一番低い位置に置く) で詰めます.
+// 入り切らない場合は新しいページを追加します.
+// バイリニアフィルタで隣の画像がにじまないよう, 各画像の周囲に端のピクセルを padding だけ複製します.
+class TextureAtlas
+{
+public:
+    struct Region
+    {
+        int page;
+        int x, y;           // ページ内の位置 (余白を含まない).
+        int width, height;
+        float u0, v0;       // 元の画像の (0, 0) に対応するテクスチャ座標.
+        float u1, v1;       // 元の画像の (1, 1) に対応するテクスチャ座標.
+    };
+
+    TextureAtlas(int pageWidth, int pageHeight, int padding);
+
+    // RGBA の画像を追加し, 画像の番号を返します. 画素はコピーします.
+    int AddImage(int width, int height, const uint8_t* rgba, int pitch);
+    // 追加した画像を配置してページを作ります. ページより大きな画像があれば false を返します.
+    bool Build();
+
+    int GetPageWidth() const { return m_pageWidth; }
+    int GetPageHeight() const { return m_pageHeight; }
+    int GetImageCount() const { return int(m_images.size()); }
+    int GetPageCount() const { return int(m_pages.size()); }
+    // ページの RGBA 画像.
+    const std::vector<uint8_t>& GetPage(int page) const { return m_pages[page]; }
+    const Region& GetRegion(int image) const { return m_regions[image]; }
+    // ページの面積に対する, 画像 (余白を含まない) の面積の割合.
+    float GetOccupancy() const;
+
+    // 画像 image を参照していたテクスチャ座標 (XMFLOAT2) をアトラス上の座標に書き換えます.
+    void RemapTexCoords(int image, void* vertices, size_t vertexCount, size_t stride, size_t texcoordOffset) const;
+
+private:
+    struct Image
+    {
+        int width, height;
+        std::vector<uint8_t> pixels;
+    };
+    // スカイラインの 1 区間.
+    struct Segment
+    {
+        int x, y, width;
+    };
+
+    bool Insert(std::vector<Segment>& skyline, int width, int height, int& x, int& y) const;
+    void CopyImage(const Image& image, const Region& region);
+
+    int m_pageWidth;
+    int m_pageHeight;
+    int m_padding;
+    std::vector<Image> m_images;
+    std::vector<Region> m_regions;
+    std::vector<std::vector<uint8_t>> m_pages;
+};
@@ -0,0 +1,555 @@
+﻿#include "VirtualTexture.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+const uint32_t FileMagic = 'V' | ('T' << 8) | ('E' << 16) | ('X' << 24);
+const uint32_t FileVersion = 1;
+const int MaxTileCount = 1 << 14;   // タイルキーに入る 1 辺のタイル数.
+const int MaxMipCount = 15;         // 同じくミップレベル数.
+const int MaxSlotsPerSide = 256;    // ページテーブルの 8 ビットに入るスロット位置.
+
+bool IsPowerOfTwo(int value)
+{
+    return value > 0 && (value & (value - 1)) == 0;
+}
+
+int GetMipCount(int tileCount)
+{
+    int mipCount = 1;
+    while ((1 << (mipCount - 1)) < tileCount)
+    {
+        ++mipCount;
+    }
+    return mipCount;
+}
+
+// mip より前のミップに含まれるタイルの総数.
+uint64_t GetLevelStart(int tileCount, int mip)
+{
+    uint64_t start = 0;
+    for (int level = 0; level < mip; ++level)
+    {
+        uint64_t n = uint64_t(tileCount >> level);
+        start += n * n;
+    }
+    return start;
+}
+
+// 2x2 の平均で半分の大きさの画像を作る.
+void Downsample(const std::vector<uint8_t>& src, int size, std::vector<uint8_t>& dst)
+{
+    const int half = size / 2;
+    dst.resize(size_t(half) * half * 4);
+    for (int y = 0; y < half; ++y)
+    {
+        const uint8_t* row0 = &src[size_t(y * 2) * size * 4];
+        const uint8_t* row1 = row0 + size_t(size) * 4;
+        uint8_t* out = &dst[size_t(y) * half * 4];
+        for (int x = 0; x < half * 4; ++x)
+        {
+            int c = (x & ~3) * 2 + (x & 3);
+            out[x] = uint8_t((row0[c] + row0[c + 4] + row1[c] + row1[c + 4] + 2) / 4);
+        }
+    }
+}
+}
+
+bool VirtualTextureFile::Build(const char* fileName, const uint8_t* rgba, int size, int tileSize, int border)
+{
+    if (tileSize <= 0 || border < 0 || border >= tileSize || size % tileSize != 0)
+    {
+        return false;
+    }
+    const int tileCount = size / tileSize;
+    if (!IsPowerOfTwo(tileCount) || tileCount > MaxTileCount)
+    {
+        return false;
+    }
+
+    Header header;
+    header.magic = FileMagic;
+    header.version = FileVersion;
+    header.size = uint32_t(size);
+    header.tileSize = uint32_t(tileSize);
+    header.border = uint32_t(border);
+    header.mipCount = uint32_t(GetMipCount(tileCount));
+
+    std::ofstream outfile(fileName, std::ofstream::binary);
+    if (!outfile)
+    {
+        return false;
+    }
+    outfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    // 余白の部分はミップの端のピクセルで埋める.
+    const int pageSize = tileSize + border * 2;
+    std::vector<uint8_t> level(rgba, rgba + size_t(size) * size * 4);
+    std::vector<uint8_t> next;
+    std::vector<uint8_t> page(size_t(pageSize) * pageSize * 4);
+    int levelSize = size;
+    for (uint32_t mip = 0; mip < header.mipCount; ++mip)
+    {
+        const int tiles = tileCount >> mip;
+        for (int ty = 0; ty < tiles; ++ty)
+        {
+            for (int tx = 0; tx < tiles; ++tx)
+            {
+                for (int py = 0; py < pageSize; ++py)
+                {
+                    int sy = ty * tileSize - border + py;
+                    sy = std::min(std::max(sy, 0), levelSize - 1);
+                    uint8_t* dst = &page[size_t(py) * pageSize * 4];
+                    for (int px = 0; px < pageSize; ++px)
+                    {
+                        int sx = tx * tileSize - border + px;
+                        sx = std::min(std::max(sx, 0), levelSize - 1);
+                        const uint8_t* src = &level[(size_t(sy) * levelSize + sx) * 4];
+                        dst[px * 4 + 0] = src[0];
+                        dst[px * 4 + 1] = src[1];
+                        dst[px * 4 + 2] = src[2];
+                        dst[px * 4 + 3] = src[3];
+                    }
+                }
+                outfile.write(reinterpret_cast<const char*>(page.data()), page.size());
+            }
+        }
+        if (mip + 1 < header.mipCount)
+        {
+            Downsample(level, levelSize, next);
+            level.swap(next);
+            levelSize /= 2;
+        }
+    }
+    return bool(outfile);
+}
+
+bool VirtualTextureFile::Open(const char* fileName)
+{
+    // タイルは要求のあった場所だけを飛び飛びに読むので, 先読みはさせない.
+    if (!m_file.Open(fileName, MappedFile::Random) || m_file.GetSize() < sizeof(m_header))
+    {
+        m_file.Close();
+        return false;
+    }
+    memcpy(&m_header, m_file.GetData(), sizeof(m_header));
+    if (m_header.magic != FileMagic || m_header.version != FileVersion)
+    {
+        m_file.Close();
+        return false;
+    }
+    if (m_header.tileSize == 0 || m_header.size % m_header.tileSize != 0 || m_header.border >= m_header.tileSize)
+    {
+        m_file.Close();
+        return false;
+    }
+    const int tileCount = int(m_header.size / m_header.tileSize);
+    if (!IsPowerOfTwo(tileCount) || tileCount > MaxTileCount || int(m_header.mipCount) != GetMipCount(tileCount))
+    {
+        m_file.Close();
+        return false;
+    }
+    // 途中で切れたファイルを読まないよう, 全てのタイルが収まっているか確かめておく.
+    const uint64_t fileSize = sizeof(Header) + GetLevelStart(tileCount, int(m_header.mipCount)) * GetTileBytes();
+    if (m_file.GetSize() < fileSize)
+    {
+        m_file.Close();
+        return false;
+    }
+    return true;
+}
+
+bool VirtualTextureFile::ReadTile(uint32_t key, uint8_t* dst) const
+{
+    const int mip = GetTileMip(key);
+    const int tiles = GetTileCount(0) >> mip;
+    const int x = GetTileX(key);
+    const int y = GetTileY(key);
+    if (!m_file.IsOpen() || mip >= int(m_header.mipCount) || x >= tiles || y >= tiles)
+    {
+        return false;
+    }
+    const uint64_t index = GetLevelStart(GetTileCount(0), mip) + uint64_t(y) * tiles + x;
+    memcpy(dst, m_file.GetData() + sizeof(Header) + index * GetTileBytes(), GetTileBytes());
+    return true;
+}
+
+PageCache::PageCache(int slotCount)
+    : m_slots(slotCount), m_head(-1), m_tail(-1)
+{
+    // 空きスロットは 0 番から順に使われるよう, 0 番をリストの末尾に置く.
+    for (int i = 0; i < slotCount; ++i)
+    {
+        Slot& slot = m_slots[i];
+        slot.key = InvalidTileKey;
+        slot.lastFrame = 0;
+        slot.prev = (i + 1 < slotCount) ? i + 1 : -1;
+        slot.next = i - 1;
+        slot.pinned = false;
+    }
+    if (slotCount > 0)
+    {
+        m_head = slotCount - 1;
+        m_tail = 0;
+    }
+}
+
+int PageCache::Find(uint32_t key) const
+{
+    auto it = m_lookup.find(key);
+    return (it != m_lookup.end()) ? it->second : -1;
+}
+
+void PageCache::Touch(int slot, uint32_t frame)
+{
+    m_slots[slot].lastFrame = frame;
+    if (!m_slots[slot].pinned && m_head != slot)
+    {
+        Unlink(slot);
+        PushFront(slot);
+    }
+}
+
+int PageCache::Allocate(uint32_t key, uint32_t frame, uint32_t& evicted)
+{
+    evicted = InvalidTileKey;
+    const int slot = m_tail;
+    if (slot < 0)
+    {
+        return -1;
+    }
+    // 末尾のスロットも現在のフレームで使っているなら, 全てのスロットが使用中.
+    Slot& s = m_slots[slot];
+    if (s.key != InvalidTileKey && s.lastFrame == frame)
+    {
+        return -1;
+    }
+    if (s.key != InvalidTileKey)
+    {
+        evicted = s.key;
+        m_lookup.erase(s.key);
+    }
+    s.key = key;
+    m_lookup[key] = slot;
+    Touch(slot, frame);
+    return slot;
+}
+
+void PageCache::Pin(int slot)
+{
+    if (!m_slots[slot].pinned)
+    {
+        Unlink(slot);
+        m_slots[slot].pinned = true;
+    }
+}
+
+void PageCache::Unlink(int slot)
+{
+    Slot& s = m_slots[slot];
+    if (s.prev >= 0)
+    {
+        m_slots[s.prev].next = s.next;
+    }
+    else
+    {
+        m_head = s.next;
+    }
+    if (s.next >= 0)
+    {
+        m_slots[s.next].prev = s.prev;
+    }
+    else
+    {
+        m_tail = s.prev;
+    }
+    s.prev = s.next = -1;
+}
+
+void PageCache::PushFront(int slot)
+{
+    Slot& s = m_slots[slot];
+    s.prev = -1;
+    s.next = m_head;
+    if (m_head >= 0)
+    {
+        m_slots[m_head].prev = slot;
+    }
+    m_head = slot;
+    if (m_tail < 0)
+    {
+        m_tail = slot;
+    }
+}
+
+PageTable::PageTable(int tileCount, int mipCount, int slotsPerSide)
+    : m_tileCount(tileCount), m_slotsPerSide(slotsPerSide), m_levels(mipCount)
+{
+    for (int mip = 0; mip < mipCount; ++mip)
+    {
+        const int tiles = tileCount >> mip;
+        m_levels[mip].assign(size_t(tiles) * tiles, -1);
+    }
+    // 読み込み済みのタイルが無い間は, 最上位のミップの 0 番のスロットを指しておく.
+    m_entries.assign(size_t(tileCount) * tileCount, 0xFF000000 | (uint32_t(mipCount - 1) << 16));
+    m_dirtyMin[0] = m_dirtyMin[1] = tileCount;
+    m_dirtyMax[0] = m_dirtyMax[1] = -1;
+}
+
+void PageTable::SetResident(uint32_t key, int slot)
+{
+    const int mip = GetTileMip(key);
+    const int x = GetTileX(key);
+    const int y = GetTileY(key);
+    m_levels[mip][size_t(y) * (m_tileCount >> mip) + x] = slot;
+
+    // このタイルが覆う mip 0 のタイルを作り直す.
+    m_dirtyMin[0] = std::min(m_dirtyMin[0], x << mip);
+    m_dirtyMin[1] = std::min(m_dirtyMin[1], y << mip);
+    m_dirtyMax[0] = std::max(m_dirtyMax[0], ((x + 1) << mip) - 1);
+    m_dirtyMax[1] = std::max(m_dirtyMax[1], ((y + 1) << mip) - 1);
+}
+
+int PageTable::GetResident(uint32_t key) const
+{
+    const int mip = GetTileMip(key);
+    return m_levels[mip][size_t(GetTileY(key)) * (m_tileCount >> mip) + GetTileX(key)];
+}
+
+bool PageTable::Update()
+{
+    if (m_dirtyMin[0] > m_dirtyMax[0])
+    {
+        return false;
+    }
+    const int mipCount = int(m_levels.size());
+    for (int y = m_dirtyMin[1]; y <= m_dirtyMax[1]; ++y)
+    {
+        for (int x = m_dirtyMin[0]; x <= m_dirtyMax[0]; ++x)
+        {
+            uint32_t entry = 0xFF000000 | (uint32_t(mipCount - 1) << 16);
+            for (int mip = 0; mip < mipCount; ++mip)
+            {
+                const int slot = m_levels[mip][size_t(y >> mip) * (m_tileCount >> mip) + (x >> mip)];
+                if (slot >= 0)
+                {
+                    entry = 0xFF000000 | (uint32_t(mip) << 16) |
+                        (uint32_t(slot / m_slotsPerSide) << 8) | uint32_t(slot % m_slotsPerSide);
+                    break;
+                }
+            }
+            m_entries[size_t(y) * m_tileCount + x] = entry;
+        }
+    }
+    m_dirtyMin[0] = m_dirtyMin[1] = m_tileCount;
+    m_dirtyMax[0] = m_dirtyMax[1] = -1;
+    return true;
+}
+
+VirtualTexture::VirtualTexture()
+    : m_slotsPerSide(0), m_frame(0), m_stats(), m_quit(false)
+{
+}
+
+VirtualTexture::~VirtualTexture()
+{
+    Close();
+}
+
+bool VirtualTexture::Open(const char* fileName, int slotsPerSide)
+{
+    Close();
+    if (slotsPerSide <= 0 || slotsPerSide > MaxSlotsPerSide || !m_file.Open(fileName))
+    {
+        return false;
+    }
+    const VirtualTextureFile::Header& header = m_file.GetHeader();
+    if (int(header.mipCount) > MaxMipCount)
+    {
+        return false;
+    }
+    m_slotsPerSide = slotsPerSide;
+    m_frame = 0;
+    m_stats = Stats();
+    m_cache = PageCache(slotsPerSide * slotsPerSide);
+    m_pageTable = PageTable(m_file.GetTileCount(0), int(header.mipCount), slotsPerSide);
+
+    m_quit = false;
+    m_thread = std::thread(&VirtualTexture::StreamingThread, this);
+
+    // 最上位のミップは常に読み込んでおき, 他のタイルが無い場所の代わりに使う.
+    Request(MakeTileKey(int(header.mipCount) - 1, 0, 0));
+    return true;
+}
+
+void VirtualTexture::Close()
+{
+    if (m_thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_wakeup.notify_all();
+        m_thread.join();
+    }
+    m_queue.clear();
+    m_pending.clear();
+    m_loaded.clear();
+}
+
+void VirtualTexture::BeginFrame()
+{
+    ++m_frame;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (uint32_t key : m_queue)
+    {
+        m_pending.erase(key);
+    }
+    m_queue.clear();
+}
+
+void VirtualTexture::RequestRegion(float u0, float v0, float u1, float v1, float texelsPerPixel)
+{
+    const int mipCount = int(m_file.GetHeader().mipCount);
+    int mip = 0;
+    while (mip + 1 < mipCount && float(1 << (mip + 1)) <= texelsPerPixel)
+    {
+        ++mip;
+    }
+    u0 = std::min(std::max(u0, 0.0f), 1.0f);
+    v0 = std::min(std::max(v0, 0.0f), 1.0f);
+    u1 = std::min(std::max(u1, 0.0f), 1.0f);
+    v1 = std::min(std::max(v1, 0.0f), 1.0f);
+
+    // 粗いミップから順に要求し, 詳細なタイルが届くまでの代わりを先に用意する.
+    for (int level = mipCount - 1; level >= mip; --level)
+    {
+        const int tiles = m_file.GetTileCount(level);
+        const int x0 = std::min(int(u0 * tiles), tiles - 1);
+        const int y0 = std::min(int(v0 * tiles), tiles - 1);
+        const int x1 = std::max(std::min(int(std::ceil(u1 * tiles)), tiles) - 1, x0);
+        const int y1 = std::max(std::min(int(std::ceil(v1 * tiles)), tiles) - 1, y0);
+        for (int y = y0; y <= y1; ++y)
+        {
+            for (int x = x0; x <= x1; ++x)
+            {
+                const uint32_t key = MakeTileKey(level, x, y);
+                const int slot = m_cache.Find(key);
+                if (slot >= 0)
+                {
+                    m_cache.Touch(slot, m_frame);
+                }
+                else
+                {
+                    Request(key);
+                }
+            }
+        }
+    }
+}
+
+void VirtualTexture::Request(uint32_t key)
+{
+    bool notify = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_pending.insert(key).second)
+        {
+            m_queue.push_back(key);
+            ++m_stats.requests;
+            notify = true;
+        }
+    }
+    if (notify)
+    {
+        m_wakeup.notify_one();
+    }
+}
+
+int VirtualTexture::Update(int maxUploads, const std::function<void(int slot, const uint8_t* pixels)>& upload)
+{
+    std::vector<LoadedTile> loaded;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const size_t count = std::min(m_loaded.size(), size_t(std::max(maxUploads, 0)));
+        loaded.assign(std::make_move_iterator(m_loaded.begin()), std::make_move_iterator(m_loaded.begin() + count));
+        m_loaded.erase(m_loaded.begin(), m_loaded.begin() + count);
+    }
+    m_stats.loads += uint32_t(loaded.size());
+
+    const int topMip = int(m_file.GetHeader().mipCount) - 1;
+    int uploads = 0;
+    for (const auto& tile : loaded)
+    {
+        if (m_cache.Find(tile.key) >= 0)
+        {
+            continue;
+        }
+        uint32_t evicted;
+        const int slot = m_cache.Allocate(tile.key, m_frame, evicted);
+        if (slot < 0)
+        {
+            ++m_stats.dropped;
+            continue;
+        }
+        if (evicted != InvalidTileKey)
+        {
+            m_pageTable.SetResident(evicted, -1);
+            ++m_stats.evictions;
+        }
+        upload(slot, tile.pixels.data());
+        m_pageTable.SetResident(tile.key, slot);
+        if (GetTileMip(tile.key) == topMip)
+        {
+            m_cache.Pin(slot);
+        }
+        ++uploads;
+    }
+    m_stats.uploads += uint32_t(uploads);
+
+    if (!loaded.empty())
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto& tile : loaded)
+        {
+            m_pending.erase(tile.key);
+        }
+    }
+    m_pageTable.Update();
+    return uploads;
+}
+
+void VirtualTexture::StreamingThread()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        m_wakeup.wait(lock, [this] { return m_quit || !m_queue.empty(); });
+        if (m_quit)
+        {
+            break;
+        }
+        const uint32_t key = m_queue.front();
+        m_queue.pop_front();
+        lock.unlock();
+
+        LoadedTile tile;
+        tile.key = key;
+        tile.pixels.resize(m_file.GetTileBytes());
+        const bool succeeded = m_file.ReadTile(key, tile.pixels.data());
+
+        lock.lock();
+        if (succeeded)
+        {
+            m_loaded.push_back(std::move(tile));
+        }
+        else
+        {
+            m_pending.erase(key);
+        }
+    }
+}
@@ -0,0 +1,188 @@
+﻿#pragma once
+#include "MappedFile.h"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// 巨大な画像をタイル単位で読み込むバーチャルテクスチャ. D3D には依存しません.
+//
+// 画像はミップマップごとに tileSize 四方のタイルへ分け, 周囲に border ピクセルの余白を付けてファイルに保存します.
+// 描画時は見えている範囲のタイルだけを別スレッドで読み込み, 固定数のスロットを持つ物理テクスチャへ書き込みます.
+// ページテーブルには mip 0 のタイルごとに, 読み込み済みの最も詳細なタイルのスロットとミップレベルを入れます.
+//
+// 簡単のため, 画像は正方形で, 1 辺のタイル数が 2 の累乗のものに限ります.
+
+// タイルを表すキー. ミップレベルとミップ内のタイル位置を詰めたもの.
+const uint32_t InvalidTileKey = 0xFFFFFFFF;
+
+inline uint32_t MakeTileKey(int mip, int x, int y)
+{
+    return (uint32_t(mip) << 28) | (uint32_t(y) << 14) | uint32_t(x);
+}
+inline int GetTileMip(uint32_t key) { return int(key >> 28); }
+inline int GetTileX(uint32_t key) { return int(key & 0x3FFF); }
+inline int GetTileY(uint32_t key) { return int((key >> 14) & 0x3FFF); }
+
+// タイルに分けた画像ファイル.
+// ヘッダの後ろに mip 0 から順に, 各ミップのタイルを行順に並べます.
+class VirtualTextureFile
+{
+public:
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t size;          // mip 0 の 1 辺のピクセル数.
+        uint32_t tileSize;
+        uint32_t border;
+        uint32_t mipCount;
+    };
+
+    // RGBA の画像からファイルを作ります. 画像の大きさが条件に合わなければ false を返します.
+    static bool Build(const char* fileName, const uint8_t* rgba, int size, int tileSize, int border);
+
+    VirtualTextureFile() : m_header() {}
+    bool Open(const char* fileName);
+    // ファイルからタイルを読み込みます. dst には GetTileBytes() バイトの RGBA を書き込みます.
+    // ファイルはメモリへマップしてあるので, 複数のスレッドから同時に呼び出せます.
+    bool ReadTile(uint32_t key, uint8_t* dst) const;
+
+    const Header& GetHeader() const { return m_header; }
+    int GetTileCount(int mip) const { return int(m_header.size / m_header.tileSize) >> mip; }
+    // 余白を含むタイルの 1 辺のピクセル数.
+    int GetPageSize() const { return int(m_header.tileSize + m_header.border * 2); }
+    size_t GetTileBytes() const { return size_t(GetPageSize()) * GetPageSize() * 4; }
+
+private:
+    Header m_header;
+    MappedFile m_file;
+};
+
+// 物理テクスチャのスロットの割り当て. 最も長く使われていないスロットから再利用します (LRU).
+class PageCache
+{
+public:
+    PageCache() : m_head(-1), m_tail(-1) {}
+    explicit PageCache(int slotCount);
+
+    int GetSlotCount() const { return int(m_slots.size()); }
+    // key のタイルを持つスロットを返します. 無ければ -1.
+    int Find(uint32_t key) const;
+    uint32_t GetKey(int slot) const { return m_slots[slot].key; }
+    // スロットを frame で使ったことにします.
+    void Touch(int slot, uint32_t frame);
+    // スロットを key に割り当てます. 追い出したタイルを evicted に返します (無ければ InvalidTileKey).
+    // 空きが無く, 全てのスロットを frame で使っている場合は -1 を返します.
+    int Allocate(uint32_t key, uint32_t frame, uint32_t& evicted);
+    // スロットを追い出しの対象から外します.
+    void Pin(int slot);
+
+private:
+    struct Slot
+    {
+        uint32_t key;
+        uint32_t lastFrame;
+        int prev, next;     // LRU リスト. 先頭が最も新しい.
+        bool pinned;
+    };
+    void Unlink(int slot);
+    void PushFront(int slot);
+
+    std::vector<Slot> m_slots;
+    int m_head, m_tail;
+    std::unordered_map<uint32_t, int> m_lookup;
+};
+
+// mip 0 のタイルごとに, 読み込み済みの最も詳細なタイルを引く表.
+class PageTable
+{
+public:
+    PageTable() : m_tileCount(0), m_slotsPerSide(0) {}
+    PageTable(int tileCount, int mipCount, int slotsPerSide);
+
+    // タイルの読み込み状態を設定します. slot が負なら読み込まれていないものとします.
+    void SetResident(uint32_t key, int slot);
+    int GetResident(uint32_t key) const;
+    // 変更のあった範囲の内容を作り直し, 変更があれば true を返します.
+    bool Update();
+
+    int GetTileCount() const { return m_tileCount; }
+    // A8R8G8B8 のテクスチャとして使う内容. B = スロットの x, G = スロットの y, R = ミップレベル.
+    const std::vector<uint32_t>& GetEntries() const { return m_entries; }
+
+private:
+    int m_tileCount;
+    int m_slotsPerSide;
+    std::vector<std::vector<int>> m_levels;     // ミップごとの各タイルのスロット.
+    std::vector<uint32_t> m_entries;
+    int m_dirtyMin[2], m_dirtyMax[2];           // 作り直す範囲 (mip 0 のタイル, 両端を含む).
+};
+
+// ファイル, キャッシュ, ページテーブルと読み込みスレッドをまとめたもの.
+class VirtualTexture
+{
+public:
+    struct Stats
+    {
+        uint32_t requests;      // 読み込みを要求したタイル数.
+        uint32_t loads;         // ファイルから読み込んだタイル数.
+        uint32_t uploads;       // 物理テクスチャへ書き込んだタイル数.
+        uint32_t evictions;
+        uint32_t dropped;       // 空きスロットが無く捨てたタイル数.
+    };
+
+    VirtualTexture();
+    ~VirtualTexture();
+
+    // slotsPerSide * slotsPerSide 個のスロットを持つ物理テクスチャを使います.
+    bool Open(const char* fileName, int slotsPerSide);
+    void Close();
+
+    const VirtualTextureFile::Header& GetHeader() const { return m_file.GetHeader(); }
+    int GetSlotsPerSide() const { return m_slotsPerSide; }
+    int GetPageSize() const { return m_file.GetPageSize(); }
+    const PageTable& GetPageTable() const { return m_pageTable; }
+    const Stats& GetStats() const { return m_stats; }
+
+    // フレームの開始時に呼び出します. 前のフレームの要求のうち, 読み込みを始めていないものは取り消します.
+    void BeginFrame();
+    // 見えている UV の範囲と, 1 画素あたりの mip 0 のテクセル数から必要なタイルを要求します.
+    // 読み込み済みのタイルは使用中として扱い, 追い出されないようにします.
+    void RequestRegion(float u0, float v0, float u1, float v1, float texelsPerPixel);
+    // 読み込みの終わったタイルを最大 maxUploads 個スロットに割り当て, upload(slot, pixels) を呼び出します.
+    // 書き込んだタイル数を返します.
+    int Update(int maxUploads, const std::function<void(int slot, const uint8_t* pixels)>& upload);
+
+private:
+    struct LoadedTile
+    {
+        uint32_t key;
+        std::vector<uint8_t> pixels;
+    };
+
+    void Request(uint32_t key);
+    void StreamingThread();
+
+    VirtualTextureFile m_file;
+    int m_slotsPerSide;
+    uint32_t m_frame;
+    PageCache m_cache;
+    PageTable m_pageTable;
+    Stats m_stats;
+
+    // 読み込みスレッドとの受け渡し. m_mutex で保護する.
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_wakeup;
+    bool m_quit;
+    std::deque<uint32_t> m_queue;
+    std::unordered_set<uint32_t> m_pending;     // 要求中, 読み込み中, 読み込み済みで未割り当てのタイル.
+    std::vector<LoadedTile> m_loaded;
+};
@@ -0,0 +1,27 @@
+struct VS_OUTPUT {
+    float4 Pos : POSITION;
+    float2 UV: TEXCOORD0;
+};
+
+sampler2D physicalTex : register(s1);   // 読み込んだタイルを並べたテクスチャ.
+sampler2D pageTableTex : register(s2);  // mip 0 のタイルごとのスロットとミップレベル.
+
+// x: mip 0 の 1 辺のタイル数, y: タイルの大きさ, z: 余白の大きさ, w: 余白を含むタイルの大きさ.
+float4 vtParams : register(c0);
+// x: 物理テクスチャの大きさの逆数.
+float4 vtPhysical : register(c1);
+
+float4 main(VS_OUTPUT _In) : COLOR
+{
+    // 右端と下端で隣のタイルを引かないよう, 範囲の内側に収める.
+    float2 uv = clamp(_In.UV.xy, 0.0, 0.99999);
+
+    // ページテーブルから, このタイルを含む読み込み済みのタイルのスロットとミップレベルを引く.
+    float4 entry = tex2Dlod(pageTableTex, float4(uv, 0, 0));
+    float3 page = floor(entry.bgr * 255.0 + 0.5);
+
+    float tiles = vtParams.x * exp2(-page.z);
+    float2 inTile = frac(uv * tiles) * vtParams.y;
+    float2 texel = page.xy * vtParams.w + vtParams.z + inTile;
+    return tex2Dlod(physicalTex, float4(texel * vtPhysical.x, 0, 0));
+}
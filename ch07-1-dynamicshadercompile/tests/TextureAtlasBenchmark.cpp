@@ -0,0 +1,80 @@
+﻿// TextureAtlas の詰め込みの計測. tests/run_tests.sh で最適化してビルドし, 実行します.
+//
+// 大きさの異なる画像を乱数で作って Build() を繰り返し, 1 回あたりの時間とページ数, 占有率を表示します.
+// 最初の行は App::SetupAtlas と同じ設定です. Build() が失敗した設定があれば 1 を返します.
+#include "TextureAtlas.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace
+{
+struct Config
+{
+    int imageCount;
+    int minSize, maxSize;
+    int pageSize;
+    int padding;
+};
+
+const Config Configs[] = {
+    { 1000, 8, 64, 1024, 2 },
+    { 4000, 8, 64, 1024, 2 },
+    { 1000, 16, 128, 1024, 2 },
+    { 1000, 8, 64, 2048, 2 },
+    { 1000, 8, 64, 1024, 0 },
+    { 200, 32, 256, 2048, 4 },
+};
+
+const double MinSeconds = 0.2;  // 各設定を少なくともこの時間だけ繰り返す.
+const int MinIterations = 5;
+
+bool Run(const Config& config)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    TextureAtlas atlas(config.pageSize, config.pageSize, config.padding);
+    std::mt19937 random(0);
+    std::vector<uint8_t> pixels(size_t(config.maxSize) * config.maxSize * 4, 0x80);
+    for (int i = 0; i < config.imageCount; ++i)
+    {
+        const int width = config.minSize + int(random() % (config.maxSize - config.minSize + 1));
+        const int height = config.minSize + int(random() % (config.maxSize - config.minSize + 1));
+        atlas.AddImage(width, height, pixels.data(), width * 4);
+    }
+
+    int iterations = 0;
+    double total = 0.0, best = 1e30;
+    while (iterations < MinIterations || total < MinSeconds)
+    {
+        const auto begin = Clock::now();
+        if (!atlas.Build())
+        {
+            printf("%5d images %3d-%3d px, page %4d, padding %d: Build() failed\n",
+                config.imageCount, config.minSize, config.maxSize, config.pageSize, config.padding);
+            return false;
+        }
+        const double seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+        total += seconds;
+        best = std::min(best, seconds);
+        ++iterations;
+    }
+    printf("%5d images %3d-%3d px, page %4d, padding %d: %2d pages, occupancy %5.1f%%, %8.3f ms/pack (min %8.3f ms, %d packs)\n",
+        config.imageCount, config.minSize, config.maxSize, config.pageSize, config.padding,
+        atlas.GetPageCount(), atlas.GetOccupancy() * 100.0f, total / iterations * 1000.0, best * 1000.0, iterations);
+    return true;
+}
+}
+
+int main()
+{
+    int failed = 0;
+    for (const Config& config : Configs)
+    {
+        failed |= Run(config) ? 0 : 1;
+    }
+    return failed;
+}
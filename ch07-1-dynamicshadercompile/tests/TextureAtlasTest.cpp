@@ -0,0 +1,235 @@
+﻿// TextureAtlas のテスト. tests/run_tests.sh でビルドして実行します.
+//
+// 画素に画像の番号と座標を書き込んだ合成画像を詰め, 余白を含めた矩形が重ならずにページに収まること,
+// 余白に端のピクセルが複製されていること, ページに入らない画像を拒否することを確かめます.
+#include "TextureAtlas.h"
+#include "Test.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace
+{
+// 画像 image の (x, y) の画素. 番号と座標から決まる.
+void GetPixel(int image, int x, int y, uint8_t* rgba)
+{
+    rgba[0] = uint8_t(x);
+    rgba[1] = uint8_t(y);
+    rgba[2] = uint8_t(image);
+    rgba[3] = uint8_t(image >> 8);
+}
+
+// 画像を追加する. 行の間に隙間のある pitch で渡し, 余分な画素を読まないことも確かめる.
+int AddTestImage(TextureAtlas& atlas, int width, int height)
+{
+    const int image = atlas.GetImageCount();
+    const int pitch = width * 4 + 12;
+    std::vector<uint8_t> pixels(size_t(pitch) * height, 0xCD);
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            GetPixel(image, x, y, &pixels[size_t(y) * pitch + size_t(x) * 4]);
+        }
+    }
+    TEST_CHECK(atlas.AddImage(width, height, pixels.data(), pitch) == image);
+    return image;
+}
+
+// App::SetupAtlas と同じく, 大きさの異なる画像を count 個追加する.
+void AddRandomImages(TextureAtlas& atlas, int count, int minSize, int maxSize, uint32_t seed)
+{
+    std::mt19937 random(seed);
+    for (int i = 0; i < count; ++i)
+    {
+        const int width = minSize + int(random() % (maxSize - minSize + 1));
+        const int height = minSize + int(random() % (maxSize - minSize + 1));
+        AddTestImage(atlas, width, height);
+    }
+}
+
+// 全ての画像について, 余白を含めた矩形がページに収まって他の画像と重ならないこと,
+// 画像と余白の画素, テクスチャ座標が正しいことを確かめる. 間違っていた画像の数を返す.
+int CheckLayout(const TextureAtlas& atlas, int padding)
+{
+    const int pageWidth = atlas.GetPageWidth();
+    const int pageHeight = atlas.GetPageHeight();
+    // ページの各画素を使っている画像の番号. -1 は空き.
+    std::vector<std::vector<int>> owners(atlas.GetPageCount(), std::vector<int>(size_t(pageWidth) * pageHeight, -1));
+    int wrong = 0;
+    for (int image = 0; image < atlas.GetImageCount(); ++image)
+    {
+        const TextureAtlas::Region& region = atlas.GetRegion(image);
+        bool valid = region.page >= 0 && region.page < atlas.GetPageCount()
+            && region.x - padding >= 0 && region.y - padding >= 0
+            && region.x + region.width + padding <= pageWidth
+            && region.y + region.height + padding <= pageHeight;
+        if (!valid)
+        {
+            ++wrong;
+            continue;
+        }
+        valid = region.u0 == float(region.x) / pageWidth && region.v0 == float(region.y) / pageHeight
+            && region.u1 == float(region.x + region.width) / pageWidth
+            && region.v1 == float(region.y + region.height) / pageHeight;
+
+        const std::vector<uint8_t>& page = atlas.GetPage(region.page);
+        for (int y = -padding; y < region.height + padding; ++y)
+        {
+            for (int x = -padding; x < region.width + padding; ++x)
+            {
+                const size_t offset = size_t(region.y + y) * pageWidth + size_t(region.x + x);
+                int& owner = owners[region.page][offset];
+                valid = valid && owner < 0;
+                owner = image;
+
+                // 余白は最も近い端の画素と同じ.
+                const int srcX = x < 0 ? 0 : (x < region.width ? x : region.width - 1);
+                const int srcY = y < 0 ? 0 : (y < region.height ? y : region.height - 1);
+                uint8_t expected[4];
+                GetPixel(image, srcX, srcY, expected);
+                const uint8_t* actual = &page[offset * 4];
+                valid = valid && actual[0] == expected[0] && actual[1] == expected[1]
+                    && actual[2] == expected[2] && actual[3] == expected[3];
+            }
+        }
+        wrong += valid ? 0 : 1;
+    }
+    return wrong;
+}
+
+// 余白を含めて重ならず, 余白に端の画素が複製される.
+void TestLayout()
+{
+    const int paddings[] = { 0, 1, 2, 4 };
+    for (int padding : paddings)
+    {
+        for (uint32_t seed = 0; seed < 4; ++seed)
+        {
+            TextureAtlas atlas(256, 256, padding);
+            AddRandomImages(atlas, 200, 1, 40, seed);
+            if (!TEST_CHECK(atlas.Build()))
+            {
+                continue;
+            }
+            TEST_CHECK(atlas.GetPageCount() >= 2);
+            TEST_CHECK(CheckLayout(atlas, padding) == 0);
+        }
+    }
+
+    // ページの幅と高さにちょうど収まる画像と, 縦長, 横長の画像.
+    TextureAtlas atlas(128, 64, 3);
+    AddTestImage(atlas, 128 - 6, 64 - 6);
+    AddTestImage(atlas, 1, 58);
+    AddTestImage(atlas, 100, 1);
+    AddTestImage(atlas, 1, 1);
+    TEST_CHECK(atlas.Build());
+    TEST_CHECK(atlas.GetPageCount() == 2);
+    TEST_CHECK(atlas.GetRegion(0).page == 0);
+    TEST_CHECK(atlas.GetRegion(0).x == 3 && atlas.GetRegion(0).y == 3);
+    TEST_CHECK(CheckLayout(atlas, 3) == 0);
+
+    // 作り直しても同じ配置になる.
+    const TextureAtlas::Region before = atlas.GetRegion(3);
+    TEST_CHECK(atlas.Build());
+    TEST_CHECK(atlas.GetPageCount() == 2);
+    TEST_CHECK(atlas.GetRegion(3).page == before.page && atlas.GetRegion(3).x == before.x && atlas.GetRegion(3).y == before.y);
+    TEST_CHECK(CheckLayout(atlas, 3) == 0);
+}
+
+// App と同じ設定で詰める. 最後以外のページは余白を含めて面積の 9 割以上を使う.
+// GetOccupancy() は余白を含まない画像の面積を全てのページの面積で割った値.
+void TestOccupancy()
+{
+    const int PageSize = 1024;
+    const int Padding = 2;
+    TextureAtlas atlas(PageSize, PageSize, Padding);
+    AddRandomImages(atlas, 1000, 8, 64, 0);
+    if (!TEST_CHECK(atlas.Build()))
+    {
+        return;
+    }
+    TEST_CHECK(CheckLayout(atlas, Padding) == 0);
+    std::vector<double> paddedArea(atlas.GetPageCount(), 0.0);
+    double imageArea = 0.0;
+    for (int image = 0; image < atlas.GetImageCount(); ++image)
+    {
+        const TextureAtlas::Region& region = atlas.GetRegion(image);
+        paddedArea[region.page] += double(region.width + Padding * 2) * (region.height + Padding * 2);
+        imageArea += double(region.width) * region.height;
+    }
+    const double pageArea = double(PageSize) * PageSize;
+    for (int page = 0; page + 1 < atlas.GetPageCount(); ++page)
+    {
+        TEST_CHECK(paddedArea[page] / pageArea > 0.9);
+    }
+    TEST_CHECK(fabs(atlas.GetOccupancy() - imageArea / (pageArea * atlas.GetPageCount())) < 1e-6);
+
+    TextureAtlas empty(1024, 1024, 2);
+    TEST_CHECK(empty.Build());
+    TEST_CHECK(empty.GetPageCount() == 0);
+    TEST_CHECK(empty.GetOccupancy() == 0.0f);
+}
+
+// 余白を含めてページより大きな画像があれば Build() は false を返す.
+void TestOversized()
+{
+    const int Padding = 2;
+    const struct
+    {
+        int width, height;
+    } sizes[] = { { 61, 10 }, { 10, 61 }, { 100, 100 } };
+    for (const auto& size : sizes)
+    {
+        TextureAtlas atlas(64, 64, Padding);
+        AddTestImage(atlas, 8, 8);
+        AddTestImage(atlas, size.width, size.height);
+        TEST_CHECK(!atlas.Build());
+    }
+
+    // 余白を含めてちょうどページの大きさなら置ける.
+    TextureAtlas atlas(64, 64, Padding);
+    AddTestImage(atlas, 60, 60);
+    TEST_CHECK(atlas.Build());
+    TEST_CHECK(atlas.GetPageCount() == 1);
+    TEST_CHECK(CheckLayout(atlas, Padding) == 0);
+}
+
+// テクスチャ座標は, 元の画像の 0 から 1 がアトラス上の画像の範囲になる.
+void TestRemapTexCoords()
+{
+    TextureAtlas atlas(64, 32, 1);
+    AddTestImage(atlas, 30, 30);
+    const int image = AddTestImage(atlas, 10, 20);
+    TEST_CHECK(atlas.Build());
+    const TextureAtlas::Region& region = atlas.GetRegion(image);
+
+    // 位置 (12 バイト) の後にテクスチャ座標を持つ頂点.
+    struct Vertex
+    {
+        float position[3];
+        float uv[2];
+    };
+    Vertex vertices[3] = {
+        { { 1.0f, 2.0f, 3.0f }, { 0.0f, 0.0f } },
+        { { 4.0f, 5.0f, 6.0f }, { 1.0f, 1.0f } },
+        { { 7.0f, 8.0f, 9.0f }, { 0.5f, 0.25f } },
+    };
+    atlas.RemapTexCoords(image, vertices, 3, sizeof(Vertex), sizeof(float) * 3);
+    TEST_CHECK(vertices[0].uv[0] == region.u0 && vertices[0].uv[1] == region.v0);
+    TEST_CHECK(vertices[1].uv[0] == region.u1 && vertices[1].uv[1] == region.v1);
+    TEST_CHECK(vertices[2].uv[0] == region.u0 + 0.5f * (region.u1 - region.u0));
+    TEST_CHECK(vertices[2].uv[1] == region.v0 + 0.25f * (region.v1 - region.v0));
+    TEST_CHECK(vertices[2].position[0] == 7.0f && vertices[2].position[2] == 9.0f);
+}
+}
+
+int main()
+{
+    Test::Run("layout", TestLayout);
+    Test::Run("occupancy", TestOccupancy);
+    Test::Run("oversized", TestOversized);
+    Test::Run("remap texcoords", TestRemapTexCoords);
+    return Test::Finish();
+}
@@ -0,0 +1,370 @@
+﻿// VirtualTexture のテスト. tests/run_tests.sh でビルドして実行します.
+//
+// 画素に座標を書き込んだ合成画像からタイルのファイルを作り, 読み込み, スロットの割り当てと追い出し,
+// ページテーブルの更新を確かめます.
+#include "VirtualTexture.h"
+#include "Test.h"
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+const int ImageSize = 256;
+const int TileSize = 32;
+const int Border = 2;
+const int TileCount = ImageSize / TileSize;     // mip 0 の 1 辺のタイル数 (8).
+const int MipCount = 4;                         // 8, 4, 2, 1 タイル.
+
+// R, G が座標の下位 8 ビット, B が上位のビットの画像.
+std::vector<uint8_t> MakeImage()
+{
+    std::vector<uint8_t> image(size_t(ImageSize) * ImageSize * 4);
+    for (int y = 0; y < ImageSize; ++y)
+    {
+        for (int x = 0; x < ImageSize; ++x)
+        {
+            uint8_t* p = &image[(size_t(y) * ImageSize + x) * 4];
+            p[0] = uint8_t(x);
+            p[1] = uint8_t(y);
+            p[2] = uint8_t((x >> 8) | ((y >> 8) << 4));
+            p[3] = 255;
+        }
+    }
+    return image;
+}
+
+std::string GetTestFileName()
+{
+    return (std::filesystem::temp_directory_path() / "VirtualTextureTest.vtex").string();
+}
+
+bool BuildTestFile()
+{
+    const std::vector<uint8_t> image = MakeImage();
+    return VirtualTextureFile::Build(GetTestFileName().c_str(), image.data(), ImageSize, TileSize, Border);
+}
+
+// ページテーブルの値の各要素.
+int EntryMip(uint32_t entry) { return int((entry >> 16) & 0xFF); }
+int EntrySlot(uint32_t entry, int slotsPerSide) { return int((entry >> 8) & 0xFF) * slotsPerSide + int(entry & 0xFF); }
+
+void TestFile()
+{
+    VirtualTextureFile file;
+    if (!TEST_CHECK(file.Open(GetTestFileName().c_str())))
+    {
+        return;
+    }
+    const VirtualTextureFile::Header& header = file.GetHeader();
+    TEST_CHECK(header.mipCount == MipCount);
+    TEST_CHECK(file.GetTileCount(0) == TileCount);
+    TEST_CHECK(file.GetTileCount(MipCount - 1) == 1);
+    TEST_CHECK(file.GetPageSize() == TileSize + Border * 2);
+
+    // mip 0 のタイルの内側は元の画像と同じで, 余白は隣のタイルの画素 (画像の端では端の画素).
+    const int pageSize = file.GetPageSize();
+    std::vector<uint8_t> page(file.GetTileBytes());
+    const int tiles[][2] = { { 0, 0 }, { 3, 5 }, { TileCount - 1, TileCount - 1 } };
+    for (const auto& tile : tiles)
+    {
+        TEST_CHECK(file.ReadTile(MakeTileKey(0, tile[0], tile[1]), page.data()));
+        bool matched = true;
+        for (int py = 0; py < pageSize; ++py)
+        {
+            for (int px = 0; px < pageSize; ++px)
+            {
+                const int sx = std::min(std::max(tile[0] * TileSize - Border + px, 0), ImageSize - 1);
+                const int sy = std::min(std::max(tile[1] * TileSize - Border + py, 0), ImageSize - 1);
+                const uint8_t* p = &page[(size_t(py) * pageSize + px) * 4];
+                matched = matched && p[0] == uint8_t(sx) && p[1] == uint8_t(sy) && p[3] == 255;
+            }
+        }
+        TEST_CHECK(matched);
+    }
+
+    // 最上位のミップは画像全体の縮小. 左上の画素は左上 8x8 画素の平均に近い.
+    TEST_CHECK(file.ReadTile(MakeTileKey(MipCount - 1, 0, 0), page.data()));
+    const uint8_t* center = &page[(size_t(Border) * pageSize + Border) * 4];
+    TEST_CHECK(center[0] >= 2 && center[0] <= 5);
+    TEST_CHECK(center[1] >= 2 && center[1] <= 5);
+
+    // 範囲外のタイルは読まない.
+    TEST_CHECK(!file.ReadTile(MakeTileKey(0, TileCount, 0), page.data()));
+    TEST_CHECK(!file.ReadTile(MakeTileKey(1, 0, TileCount / 2), page.data()));
+    TEST_CHECK(!file.ReadTile(MakeTileKey(MipCount, 0, 0), page.data()));
+}
+
+// 途中で切れたファイルや, 条件に合わない大きさの画像は受け付けない.
+void TestInvalidFile()
+{
+    const std::string fileName = GetTestFileName() + ".truncated";
+    {
+        const std::vector<uint8_t> image = MakeImage();
+        TEST_CHECK(!VirtualTextureFile::Build(fileName.c_str(), image.data(), ImageSize, 48, Border));
+        TEST_CHECK(!VirtualTextureFile::Build(fileName.c_str(), image.data(), 192, TileSize, Border));
+        TEST_CHECK(!VirtualTextureFile::Build(fileName.c_str(), image.data(), ImageSize, TileSize, TileSize));
+        TEST_CHECK(VirtualTextureFile::Build(fileName.c_str(), image.data(), ImageSize, TileSize, Border));
+    }
+    std::filesystem::resize_file(fileName, std::filesystem::file_size(fileName) - 1);
+    VirtualTextureFile file;
+    TEST_CHECK(!file.Open(fileName.c_str()));
+    std::filesystem::remove(fileName);
+}
+
+// スロットは最も長く使われていないものから再利用され, 同じフレームで使ったものと固定したものは追い出さない.
+void TestPageCache()
+{
+    PageCache cache(4);
+    uint32_t evicted;
+    const uint32_t keys[] = { MakeTileKey(0, 0, 0), MakeTileKey(0, 1, 0), MakeTileKey(0, 2, 0), MakeTileKey(0, 3, 0) };
+    for (int i = 0; i < 4; ++i)
+    {
+        // 空きスロットは 0 番から順に使う.
+        TEST_CHECK(cache.Allocate(keys[i], 1, evicted) == i);
+        TEST_CHECK(evicted == InvalidTileKey);
+    }
+    for (int i = 0; i < 4; ++i)
+    {
+        TEST_CHECK(cache.Find(keys[i]) == i);
+    }
+    // 全てのスロットをフレーム 1 で使っているので, 同じフレームではこれ以上割り当てられない.
+    const uint32_t extra = MakeTileKey(1, 0, 0);
+    TEST_CHECK(cache.Allocate(extra, 1, evicted) == -1);
+    TEST_CHECK(cache.Find(extra) == -1);
+
+    // 次のフレームで 0 番を使うと, 追い出されるのは次に古い 1 番.
+    cache.Touch(0, 2);
+    TEST_CHECK(cache.Allocate(extra, 2, evicted) == 1);
+    TEST_CHECK(evicted == keys[1]);
+    TEST_CHECK(cache.Find(keys[1]) == -1);
+    TEST_CHECK(cache.Find(extra) == 1);
+    TEST_CHECK(cache.GetKey(1) == extra);
+
+    // 固定したスロット (2 番) は飛ばして 3 番を追い出す.
+    cache.Pin(2);
+    const uint32_t another = MakeTileKey(1, 1, 0);
+    TEST_CHECK(cache.Allocate(another, 3, evicted) == 3);
+    TEST_CHECK(evicted == keys[3]);
+    // 残りの 0 番, 1 番を使い切ると, 固定したスロットしか残らない.
+    TEST_CHECK(cache.Allocate(MakeTileKey(1, 0, 1), 3, evicted) == 0);
+    TEST_CHECK(cache.Allocate(MakeTileKey(1, 1, 1), 3, evicted) == 1);
+    TEST_CHECK(cache.Allocate(MakeTileKey(2, 0, 0), 3, evicted) == -1);
+    TEST_CHECK(cache.Find(keys[2]) == 2);
+}
+
+void TestPageTable()
+{
+    const int tileCount = 4, mipCount = 3, slotsPerSide = 4;
+    PageTable table(tileCount, mipCount, slotsPerSide);
+    const std::vector<uint32_t>& entries = table.GetEntries();
+    TEST_CHECK(entries.size() == size_t(tileCount) * tileCount);
+    TEST_CHECK(!table.Update());
+    for (uint32_t entry : entries)
+    {
+        TEST_CHECK(EntryMip(entry) == mipCount - 1 && EntrySlot(entry, slotsPerSide) == 0);
+    }
+
+    // 最上位のミップをスロット 5 (x = 1, y = 1) に置くと, 全体がそれを指す.
+    table.SetResident(MakeTileKey(mipCount - 1, 0, 0), 5);
+    TEST_CHECK(table.Update());
+    TEST_CHECK(!table.Update());
+    for (uint32_t entry : entries)
+    {
+        TEST_CHECK(EntryMip(entry) == mipCount - 1 && EntrySlot(entry, slotsPerSide) == 5);
+        TEST_CHECK((entry >> 8 & 0xFF) == 1 && (entry & 0xFF) == 1);
+    }
+
+    // mip 1 のタイル (1, 0) は mip 0 の 2x2 タイルを覆う.
+    table.SetResident(MakeTileKey(1, 1, 0), 9);
+    // mip 0 のタイル (3, 1) はそれより詳細なので優先する.
+    table.SetResident(MakeTileKey(0, 3, 1), 14);
+    TEST_CHECK(table.GetResident(MakeTileKey(1, 1, 0)) == 9);
+    TEST_CHECK(table.GetResident(MakeTileKey(0, 3, 1)) == 14);
+    TEST_CHECK(table.GetResident(MakeTileKey(0, 0, 0)) == -1);
+    TEST_CHECK(table.Update());
+    for (int y = 0; y < tileCount; ++y)
+    {
+        for (int x = 0; x < tileCount; ++x)
+        {
+            const uint32_t entry = entries[size_t(y) * tileCount + x];
+            int mip = mipCount - 1, slot = 5;
+            if (x == 3 && y == 1)
+            {
+                mip = 0, slot = 14;
+            }
+            else if (x >= 2 && y <= 1)
+            {
+                mip = 1, slot = 9;
+            }
+            TEST_CHECK(EntryMip(entry) == mip && EntrySlot(entry, slotsPerSide) == slot);
+        }
+    }
+
+    // 追い出すと, 覆っている粗いミップへ戻る.
+    table.SetResident(MakeTileKey(0, 3, 1), -1);
+    TEST_CHECK(table.Update());
+    TEST_CHECK(EntryMip(entries[1 * tileCount + 3]) == 1 && EntrySlot(entries[1 * tileCount + 3], slotsPerSide) == 9);
+    table.SetResident(MakeTileKey(1, 1, 0), -1);
+    TEST_CHECK(table.Update());
+    TEST_CHECK(EntryMip(entries[1 * tileCount + 3]) == mipCount - 1 && EntrySlot(entries[1 * tileCount + 3], slotsPerSide) == 5);
+}
+
+// 読み込みスレッドが loads 枚のタイルを読み終えるまで Update を呼び, 書き込んだタイルを slots に記録する.
+// 書き込んだタイル数を返す. 5 秒待っても読み終わらなければ, そこまでの数を返す.
+int Pump(VirtualTexture& texture, int maxUploads, uint32_t loads, std::map<int, std::vector<uint8_t>>& slots)
+{
+    const uint32_t target = texture.GetStats().loads + loads;
+    int total = 0;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (texture.GetStats().loads < target && std::chrono::steady_clock::now() < deadline)
+    {
+        const int uploads = texture.Update(maxUploads, [&](int slot, const uint8_t* pixels) {
+            slots[slot].assign(pixels, pixels + size_t(texture.GetPageSize()) * texture.GetPageSize() * 4);
+        });
+        TEST_CHECK(uploads <= maxUploads);
+        total += uploads;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return total;
+}
+
+// 書き込んだスロットの内容が, ページテーブルが示すタイルと一致するか.
+bool CheckResidentTiles(const VirtualTexture& texture, const VirtualTextureFile& file,
+    const std::map<int, std::vector<uint8_t>>& slots)
+{
+    const PageTable& table = texture.GetPageTable();
+    std::vector<uint8_t> page(file.GetTileBytes());
+    bool matched = true;
+    for (int mip = 0; mip < MipCount; ++mip)
+    {
+        const int tiles = file.GetTileCount(mip);
+        for (int y = 0; y < tiles; ++y)
+        {
+            for (int x = 0; x < tiles; ++x)
+            {
+                const uint32_t key = MakeTileKey(mip, x, y);
+                const int slot = table.GetResident(key);
+                if (slot < 0)
+                {
+                    continue;
+                }
+                auto it = slots.find(slot);
+                matched = matched && it != slots.end() && file.ReadTile(key, page.data()) && it->second == page;
+            }
+        }
+    }
+    return matched;
+}
+
+void TestStreaming()
+{
+    VirtualTextureFile file;
+    VirtualTexture texture;
+    if (!TEST_CHECK(file.Open(GetTestFileName().c_str())) || !TEST_CHECK(texture.Open(GetTestFileName().c_str(), 2)))
+    {
+        return;
+    }
+    TEST_CHECK(texture.GetSlotsPerSide() == 2);
+    std::map<int, std::vector<uint8_t>> slots;
+
+    // Open で要求した最上位のミップがスロット 0 に入り, ページテーブル全体がそれを指す.
+    // (BeginFrame は読み込みを始めていない要求を取り消すので, ここでは呼ばない.)
+    TEST_CHECK(Pump(texture, 8, 1, slots) == 1);
+    const PageTable& table = texture.GetPageTable();
+    TEST_CHECK(table.GetResident(MakeTileKey(MipCount - 1, 0, 0)) == 0);
+    for (uint32_t entry : table.GetEntries())
+    {
+        TEST_CHECK(EntryMip(entry) == MipCount - 1 && EntrySlot(entry, 2) == 0);
+    }
+
+    // 左上の mip 0 のタイル 1 枚分の範囲. 粗いミップから順に mip 2, 1, 0 の各 1 枚を要求する.
+    texture.BeginFrame();
+    texture.RequestRegion(0.0f, 0.0f, 0.1f, 0.1f, 1.0f);
+    TEST_CHECK(Pump(texture, 8, 3, slots) == 3);
+    const uint32_t corner = MakeTileKey(0, 0, 0);
+    TEST_CHECK(table.GetResident(corner) >= 0);
+    TEST_CHECK(table.GetResident(MakeTileKey(1, 0, 0)) >= 0);
+    TEST_CHECK(table.GetResident(MakeTileKey(2, 0, 0)) >= 0);
+    TEST_CHECK(EntryMip(table.GetEntries()[0]) == 0);
+    TEST_CHECK(EntrySlot(table.GetEntries()[0], 2) == table.GetResident(corner));
+    // 隣の mip 0 のタイルは mip 1 のタイルを使い, 覆っていない遠くのタイルは mip 2 を使う.
+    TEST_CHECK(EntryMip(table.GetEntries()[1]) == 1);
+    TEST_CHECK(EntryMip(table.GetEntries()[2 * TileCount + 2]) == 2);
+    TEST_CHECK(EntryMip(table.GetEntries()[TileCount * TileCount - 1]) == MipCount - 1);
+    TEST_CHECK(CheckResidentTiles(texture, file, slots));
+    TEST_CHECK(texture.GetStats().evictions == 0);
+
+    // 右下へ移ると, スロットが足りないので左上のタイルが追い出され, ページテーブルは最上位のミップへ戻る.
+    texture.BeginFrame();
+    texture.RequestRegion(0.9f, 0.9f, 1.0f, 1.0f, 1.0f);
+    TEST_CHECK(Pump(texture, 8, 3, slots) == 3);
+    const uint32_t far = MakeTileKey(0, TileCount - 1, TileCount - 1);
+    TEST_CHECK(table.GetResident(far) >= 0);
+    TEST_CHECK(table.GetResident(corner) == -1);
+    TEST_CHECK(texture.GetStats().evictions == 3);
+    TEST_CHECK(EntryMip(table.GetEntries()[0]) == MipCount - 1);
+    TEST_CHECK(EntryMip(table.GetEntries()[TileCount * TileCount - 1]) == 0);
+    TEST_CHECK(CheckResidentTiles(texture, file, slots));
+
+    // 最上位のミップは固定されているので, 何度移っても追い出されない.
+    TEST_CHECK(table.GetResident(MakeTileKey(MipCount - 1, 0, 0)) == 0);
+
+    // mip 2 の 4 枚のうち, 右下の 1 枚は読み込み済み. 残りの 3 枚に対して空いているスロットは 2 つ.
+    // 同じフレームで使ったスロットは追い出さないので, 1 枚は捨てる.
+    texture.BeginFrame();
+    const VirtualTexture::Stats before = texture.GetStats();
+    texture.RequestRegion(0.0f, 0.0f, 1.0f, 1.0f, 4.0f);
+    TEST_CHECK(Pump(texture, 8, 3, slots) == 2);
+    const VirtualTexture::Stats& after = texture.GetStats();
+    TEST_CHECK(after.requests - before.requests == 3);
+    TEST_CHECK(after.dropped - before.dropped == 1);
+    TEST_CHECK(after.evictions - before.evictions == 2);
+    TEST_CHECK(table.GetResident(far) == -1);
+    TEST_CHECK(CheckResidentTiles(texture, file, slots));
+    texture.Close();
+}
+
+// 1 回の Update で書き込むタイル数の上限.
+void TestUploadLimit()
+{
+    VirtualTextureFile file;
+    VirtualTexture texture;
+    if (!TEST_CHECK(file.Open(GetTestFileName().c_str())) || !TEST_CHECK(texture.Open(GetTestFileName().c_str(), 4)))
+    {
+        return;
+    }
+    std::map<int, std::vector<uint8_t>> slots;
+    TEST_CHECK(Pump(texture, 1, 1, slots) == 1);
+
+    // 中央の 2x2 タイルの範囲. mip 2, 1, 0 で 4 枚ずつ要求する.
+    texture.BeginFrame();
+    texture.RequestRegion(0.375f, 0.375f, 0.625f, 0.625f, 1.0f);
+    TEST_CHECK(texture.GetStats().requests == 1 + 12);
+    TEST_CHECK(Pump(texture, 1, 12, slots) == 12);
+    TEST_CHECK(texture.GetStats().dropped == 0);
+    TEST_CHECK(texture.GetStats().evictions == 0);
+    TEST_CHECK(CheckResidentTiles(texture, file, slots));
+}
+}
+
+int main()
+{
+    if (!TEST_CHECK(BuildTestFile()))
+    {
+        return Test::Finish();
+    }
+    Test::Run("file", TestFile);
+    Test::Run("invalid file", TestInvalidFile);
+    Test::Run("page cache", TestPageCache);
+    Test::Run("page table", TestPageTable);
+    Test::Run("streaming", TestStreaming);
+    Test::Run("upload limit", TestUploadLimit);
+    std::filesystem::remove(GetTestFileName());
+    return Test::Finish();
+}
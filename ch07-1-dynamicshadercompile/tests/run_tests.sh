@@ -0,0 +1,48 @@
+#!/bin/sh
+# D3D に依存しないモジュールのテストを Linux でビルドして実行します.
+#
+#   tests/run_tests.sh [出力ディレクトリ]
+#
+# 環境変数 CXX でコンパイラを, SANITIZE でサニタイザー (既定は address,undefined) を変えられます.
+# テストの後, 計測 (tests/*Benchmark.cpp) をサニタイザー無しで最適化してビルドし, 結果を表示します.
+# 失敗したテストがあれば 1 を返します.
+cd "$(dirname "$0")/.." || exit 1
+OUT=${1:-${TMPDIR:-/tmp}/ch07-1-tests}
+CXX=${CXX:-g++}
+SANITIZE=${SANITIZE:-address,undefined}
+mkdir -p "$OUT" || exit 1
+
+failed=0
+run()
+{
+    name=$1
+    shift
+    echo "== $name"
+    if $CXX -std=c++17 -g -O1 -pthread -fsanitize=$SANITIZE -fno-sanitize-recover=all -I. "$@" -o "$OUT/$name" && "$OUT/$name"; then
+        :
+    else
+        echo "$name: FAILED"
+        failed=1
+    fi
+}
+
+# 計測は時間を見るだけなので, 失敗するのはビルドできないか異常終了した場合だけ.
+bench()
+{
+    name=$1
+    shift
+    echo "== $name"
+    if $CXX -std=c++17 -O2 -DNDEBUG -pthread -I. "$@" -o "$OUT/$name" && "$OUT/$name"; then
+        :
+    else
+        echo "$name: FAILED"
+        failed=1
+    fi
+}
+
+run VirtualTextureTest tests/VirtualTextureTest.cpp VirtualTexture.cpp MappedFile.cpp
+run TextureAtlasTest tests/TextureAtlasTest.cpp TextureAtlas.cpp
+
+bench TextureAtlasBenchmark tests/TextureAtlasBenchmark.cpp TextureAtlas.cpp
+
+exit $failed
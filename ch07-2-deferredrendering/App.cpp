@@ -1,80 +1,99 @@
 ﻿#include "App.h"
 #include <stdexcept>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
-#include <fstream>
 #include <vector>
 #include <string>
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#include <mmsystem.h>
 
-#include "TeapotModel.h"
+#include "DeferredScene.h"
+#include "MeshCodec.h"
+#include "MeshImporter.h"
+#include "GeometryProcessing.h"
 
 // D3D9 ライブラリのリンク.
 #pragma comment(lib, "d3d9.lib")
+// timeBeginPeriod (フレームの制限で短く眠るため).
+#pragma comment(lib, "winmm.lib")
 
 using namespace DirectX;
 using namespace DirectX::PackedVector;
 
 namespace
 {
+// ティーポットの LOD の作成と選択のパラメータ.
+const int MaxLodLevels = 5;
+const float MaxLodError = 0.2f;         // 最も粗いレベルで許容する誤差 (モデル空間).
+const float MaxLodPixelError = 1.0f;    // 描画時に許容する画面上の誤差 (ピクセル).
+
+// 読み込んだモデルはティーポットと同程度の大きさにそろえる.
+const float ImportedMeshRadius = 1.0f;
+const float ImportedMeshWeldEpsilon = 1e-5f;    // 大きさをそろえた後の溶接の許容誤差.
+
 // 実行体のあるファイルパスを返却する.
-std::wstring GetExecutionDirectory()
+std::string GetExecutionDirectory()
 {
-    wchar_t filePath[MAX_PATH];
-    GetModuleFileNameW(NULL, filePath, sizeof(filePath));
-    wchar_t* p = wcsrchr(filePath, L'\\');
+    char filePath[MAX_PATH];
+    GetModuleFileNameA(NULL, filePath, sizeof(filePath));
+    char* p = strrchr(filePath, '\\');
 
-    std::wstring strPath(filePath, p);
+    std::string strPath(filePath, p);
     return strPath;
 }
 
-bool LoadBinaryFile(const std::wstring& fileName, std::vector<uint8_t>& loadBuf)
-{
-    loadBuf.clear();
-    std::wstring path = GetExecutionDirectory();
-    path += std::wstring(L"\\");
-    path += fileName;
+// 実行体と同じディレクトリに置くアーカイブ. 無ければ個別のファイルを読み込む.
+const char* AssetArchiveFileName = "Assets.pak";
 
-    std::ifstream infile(path, std::ifstream::binary);
-    if (!infile)
-    {
-        return false;
-    }
+// 画面の保存. GPU のコピーが終わるのを見込んで読み戻しを遅らせるフレーム数と,
+// 読み戻し先のサーフェイス (G-Buffer も保存すると 1 フレームで 4 つ使う) と書き出し待ちのバッファの数.
+const int CaptureLatency = 2;
+const int CaptureSlotCount = 8;
+const int CaptureQueueSize = 8;
 
-    int size = static_cast<int>(infile.seekg(0, std::ifstream::end).tellg());
-    loadBuf.resize(size);
-    infile.seekg(0, std::ifstream::beg);
-    infile.read(reinterpret_cast<char*>(loadBuf.data()), size);
-    return true;
-}
+// 動的頂点バッファのサイズ.
+const UINT DynamicVertexBufferSize = 256 * 1024;
+const UINT DynamicIndexBufferSize = 512 * 1024;
 
-template<class T>
-void CopyToBuffer(T* resource, const void* src, size_t length)
-{
-    void* dst;
-    HRESULT hr = resource->Lock(0, 0, &dst, 0);
-    if (SUCCEEDED(hr))
-    {
-        memcpy_s(dst, length, src, length);
-        resource->Unlock();
-    }
-    if (FAILED(hr))
-        throw std::runtime_error("Failed Lock");
-}
+// 垂直帰線期間を含めた走査線の数の, 表示する走査線の数に対する比 (目安).
+const double VerticalTotalRatio = 1.04;
+
+// 動的解像度で描画範囲を丸める単位 (画素). 大きさが毎フレーム揺れないようにする.
+const int RenderSizeAlign = 8;
+// GPU のフレーム時間の計測結果が届くまで, 最大何フレーム待てるか.
+const int GpuTimerSlotCount = 5;
 
 }
 
 
 App::App()
     : m_d3d9(nullptr), m_d3dDev(nullptr),
+    m_hWnd(nullptr), m_screenMode(WindowMode), m_traceDevice(nullptr), m_deviceLost(false),
+    m_pacer(FramePacer::GetSystemClock()), m_displayHeight(0), m_timerResolutionRaised(false),
+    m_resources(nullptr),
     m_DeclarationPT(nullptr), m_DeclarationPN(nullptr),
-    m_renderWorldPos(nullptr),
-    m_renderWorldNormal(nullptr),
-    m_renderDiffuse(nullptr)
-
+    m_rtAllocator(nullptr), m_rtPool(nullptr),
+    m_frameGraph(nullptr),
+    m_lightingFactor(1),
+    m_dynamicResolution(false), m_resolutionBudgetMsec(0.0), m_gpuTimer(nullptr),
+    m_renderScale(1.0), m_renderWidth(0), m_renderHeight(0),
+    m_dynamicVB(nullptr), m_dynamicIB(nullptr),
+    m_captureQueue(nullptr), m_frameCapture(nullptr),
+    m_captureRequest(0), m_captureInterval(0), m_captureIndex(0), m_frameIndex(0)
 {
     ZeroMemory(&m_d3dpp, sizeof(m_d3dpp));
+    ZeroMemory(&m_meshletStats, sizeof(m_meshletStats));
+    ZeroMemory(&m_fileLoadStats, sizeof(m_fileLoadStats));
+    m_camera = DeferredScene::GetCamera();
+    m_presentSettings.vsync = true;
+    m_presentSettings.maxFrameLatency = 0;
+    m_presentSettings.backBufferCount = 2;
+    m_presentSettings.frameLimiter = false;
+    m_upsampleParams = LightingReference::GetDefaultUpsampleParams(m_lightingFactor);
 }
 
 App::~App()
@@ -86,71 +105,50 @@ bool App::Initialize(HWND hWnd, int width, int height, ScreenMode mode)
     try
     {
         HRESULT hr;
-        hr = Direct3DCreate9Ex(D3D_SDK_VERSION, &m_d3d9);
-        if (FAILED(hr))
-            throw std::runtime_error("failed Direct3DCreate9Ex");
+        if (mode != App::HeadlessMode)
+        {
+            hr = Direct3DCreate9Ex(D3D_SDK_VERSION, &m_d3d9);
+            if (FAILED(hr))
+                throw std::runtime_error("failed Direct3DCreate9Ex");
+        }
 
         // D3DPRESENT_PARAMETERS のセット.
-        m_d3dpp.BackBufferCount = 2;
+        m_d3dpp.BackBufferCount = m_presentSettings.backBufferCount;
         m_d3dpp.BackBufferWidth = width;
         m_d3dpp.BackBufferHeight = height;
         m_d3dpp.BackBufferFormat = D3DFMT_A8R8G8B8;
         m_d3dpp.SwapEffect = D3DSWAPEFFECT_DISCARD;
         m_d3dpp.AutoDepthStencilFormat = D3DFMT_D24S8;
         m_d3dpp.EnableAutoDepthStencil = TRUE;
-        m_d3dpp.PresentationInterval = D3DPRESENT_INTERVAL_ONE;
+        m_d3dpp.PresentationInterval = m_presentSettings.vsync ? D3DPRESENT_INTERVAL_ONE : D3DPRESENT_INTERVAL_IMMEDIATE;
         m_d3dpp.hDeviceWindow = hWnd;
 
-        // ディスプレイモード.
-        D3DDISPLAYMODEEX dm;
-        ZeroMemory(&dm, sizeof(dm));
-        dm.Size = sizeof(dm);
-        dm.Format = m_d3dpp.BackBufferFormat;
-        dm.Width = m_d3dpp.BackBufferWidth;
-        dm.Height = m_d3dpp.BackBufferHeight;
-        dm.ScanLineOrdering = D3DSCANLINEORDERING_UNKNOWN;
-
-        // 描画デバイスの作成.
-        DWORD flag = D3DCREATE_HARDWARE_VERTEXPROCESSING | D3DCREATE_FPU_PRESERVE;
-        switch (mode)
-        {
-        case App::WindowMode:
-        case App::VirtualFullScreenMode:
-            // ウィンドウモード もしくは 仮想フルスクリーンモード.
-            m_d3dpp.Windowed = TRUE;
-            hr = m_d3d9->CreateDeviceEx(
-                D3DADAPTER_DEFAULT,
-                D3DDEVTYPE_HAL,
-                hWnd,
-                flag,
-                &m_d3dpp,
-                nullptr,    // 指定しない！
-                &m_d3dDev);
-            break;
-
-        case App::FullScreenMode:
-            // フルスクリーンモード.
-            // リフレッシュレートは 60Hz を期待.
-            m_d3dpp.Windowed = FALSE;
-            m_d3dpp.FullScreen_RefreshRateInHz = 60;
-            dm.RefreshRate = m_d3dpp.FullScreen_RefreshRateInHz;
-            hr = m_d3d9->CreateDeviceEx(
-                D3DADAPTER_DEFAULT,
-                D3DDEVTYPE_HAL,
-                hWnd,
-                flag,
-                &m_d3dpp,
-                &dm,    // 指定する！
-                &m_d3dDev);
-            break;
-
-        default:
-            throw std::runtime_error("Not found ScreenType");
-        }
+        // デバイスの作り直しで使うため保持しておく.
+        m_hWnd = hWnd;
+        m_screenMode = mode;
 
+        hr = CreateDevice();
         if (FAILED(hr))
             throw std::runtime_error("failed CreateDeviceEx");
 
+        // 垂直同期の間隔でフレームの開始を制限する. リフレッシュレートが分からなければ 60Hz とする.
+        D3DDISPLAYMODE displayMode;
+        ZeroMemory(&displayMode, sizeof(displayMode));
+        m_d3dDev->GetDisplayMode(0, &displayMode);
+        m_displayHeight = displayMode.Height;
+        const UINT refreshRate = displayMode.RefreshRate > 0 ? displayMode.RefreshRate : 60;
+        m_pacer.Configure(m_presentSettings.vsync, 1.0 / refreshRate);
+        m_pacer.SetEnabled(m_presentSettings.frameLimiter);
+        if (m_presentSettings.frameLimiter)
+        {
+            // 既定のタイマーの分解能 (15.6ms) では, 締め切りの直前に起きられない.
+            m_timerResolutionRaised = timeBeginPeriod(1) == TIMERR_NOERROR;
+        }
+
+        // デバイスの作り直しに備えて, 作成したリソースを登録しておく.
+        m_resources = new DeviceResourceRegistry(m_d3dDev);
+
+        MountAssets();
         SetupVertexDeclarations();
         SetupBuffers();
         LoadShader();
@@ -158,56 +156,88 @@ bool App::Initialize(HWND hWnd, int width, int height, ScreenMode mode)
         SetupGBuffers(width, height);
 
         // ビュー行列とプロジェクション行列をセットアップ.
-
-        // カメラ（視点）の情報.
-        XMFLOAT3 eyePos(0.0f, 4.0f, -10.0f);
-        XMFLOAT3 eyeTarget(0.0f, 0.0f, 0.0f);
-        XMFLOAT3 eyeUp(0.0f, 1.0f, 0.0f);
-        m_mtxView = XMMatrixLookAtLH(
-            XMLoadFloat3(&eyePos),
-            XMLoadFloat3(&eyeTarget),
-            XMLoadFloat3(&eyeUp)
-        );
-
-        // プロジェクション行列.
-        float fov = XMConvertToRadians(45.f);
-        float aspect = float(width) / float(height);
-        float nearZ = 0.1f;
-        float farZ = 100.0f;
-        m_mtxProj = XMMatrixPerspectiveFovLH(
-            fov,
-            aspect,
-            nearZ,
-            farZ
-        );
+        DeferredScene::BuildCameraMatrices(m_camera, width, height, m_mtxView, m_mtxProj);
 
         // ビューポートの設定.
-        D3DVIEWPORT9 vp;
-        vp.X = 0;
-        vp.Y = 0;
-        vp.Width = width;
-        vp.Height = height;
-        vp.MinZ = 0.0f;
-        vp.MaxZ = 1.0f;
-        m_d3dDev->SetViewport(&vp);
+        SetupViewport(width, height);
+
+        m_captureQueue = new CaptureQueue(0, CaptureQueueSize);
+        m_frameCapture = new FrameCapture(m_captureQueue, CaptureLatency, CaptureSlotCount);
+        m_frameCapture->SetDevice(m_d3dDev);
 
+        // 予算を決めていなければ, 垂直同期の間隔に収める.
+        const double budgetSec = m_resolutionBudgetMsec > 0.0 ? m_resolutionBudgetMsec / 1000.0 : 1.0 / refreshRate;
+        m_resolution.Configure(ResolutionController::GetDefaultSettings(budgetSec));
+        m_gpuTimer = new GpuFrameTimer(GpuTimerSlotCount);
+        if (m_dynamicResolution)
+        {
+            m_gpuTimer->SetDevice(m_d3dDev);
+        }
 
   
 
+        if (!m_meshFile.empty())
+        {
+            LoadImportedMesh(m_meshFile.c_str());
+        }
+        else
         {
-            size_t lengthVB = sizeof(TeapotModel::TeapotVerticesPN);
-            size_t lengthIB = sizeof(TeapotModel::TeapotIndices);
-            m_teapot.indexCount = lengthIB / sizeof(TeapotModel::TeapotIndices[0]);
-            m_teapot.vertexCount = lengthVB / sizeof(TeapotModel::Vertex);
-            m_d3dDev->CreateVertexBuffer(lengthVB, 0, 0, D3DPOOL_DEFAULT, &m_teapot.vb, nullptr);
-            m_d3dDev->CreateIndexBuffer(lengthIB, 0, D3DFMT_INDEX16, D3DPOOL_DEFAULT, &m_teapot.ib, nullptr);
-
-            CopyToBuffer(m_teapot.vb, TeapotModel::TeapotVerticesPN, lengthVB);
-            CopyToBuffer(m_teapot.ib, TeapotModel::TeapotIndices, lengthIB);
+            size_t lengthVB, strideVB, lengthIB;
+            const void* vertices = DeferredScene::GetTeapotVertices(lengthVB, strideVB);
+            const uint16_t* indices = DeferredScene::GetTeapotIndices(lengthIB);
+            m_teapot.indexCount = lengthIB / sizeof(indices[0]);
+            m_teapot.vertexCount = lengthVB / strideVB;
+
+            // 詳細度の異なるインデックスを作り, 1 つのインデックスバッファへ連結して持つ.
+            std::vector<uint16_t> lodIndices;
+            MeshSimplifier::BuildLodChain(
+                vertices, m_teapot.vertexCount, strideVB,
+                indices, m_teapot.indexCount,
+                MaxLodLevels, 0.5f, MaxLodError,
+                lodIndices, m_teapot.lods);
+            OutputDebugStringA(MeshSimplifier::Report(m_teapot.lods).c_str());
+
+            // LOD 0 はクラスタ単位でカリングするため, クラスタ順に並べ替えておく.
+            std::vector<Meshlet> meshlets;
+            std::vector<uint16_t> meshletIndices;
+            BuildMeshlets(
+                vertices, m_teapot.vertexCount, strideVB,
+                lodIndices.data(), m_teapot.lods[0].indexCount,
+                MaxMeshletVertices, MaxMeshletTriangles,
+                meshlets, meshletIndices);
+            std::copy(meshletIndices.begin(), meshletIndices.end(), lodIndices.begin());
+            m_teapot.meshlets.Setup(meshlets, meshletIndices);
+
+            m_teapot.radius = 0.0f;
+            for (int i = 0; i < m_teapot.vertexCount; ++i)
+            {
+                const XMFLOAT3* pos = reinterpret_cast<const XMFLOAT3*>(static_cast<const uint8_t*>(vertices) + i * strideVB);
+                float length = XMVectorGetX(XMVector3Length(XMLoadFloat3(pos)));
+                if (m_teapot.radius < length)
+                {
+                    m_teapot.radius = length;
+                }
+            }
+
+            CreateEncodedBuffers(m_teapot,
+                vertices, m_teapot.vertexCount, strideVB,
+                lodIndices.data(), lodIndices.size(), D3DFMT_INDEX16);
         }
+
+        char buf[128];
+        snprintf(buf, sizeof(buf), "Startup I/O: %d files (%d from archive), %d KB, %.2f ms\n",
+            m_fileLoadStats.count, m_fileLoadStats.archiveCount, int(m_fileLoadStats.bytes / 1024), m_fileLoadStats.msec);
+        OutputDebugStringA(buf);
     }
     catch (std::runtime_error e)
     {
+        if (mode == App::HeadlessMode)
+        {
+            // ダイアログで止まらないようにする.
+            OutputDebugStringA(e.what());
+            OutputDebugStringA("\n");
+            return false;
+        }
         MessageBoxA(hWnd, e.what(), "初期化失敗", MB_OK);
         return false;
     }
@@ -215,69 +245,554 @@ bool App::Initialize(HWND hWnd, int width, int height, ScreenMode mode)
     return true;
 }
 
-void App::SetupGBuffers(int width, int height)
+// m_d3dpp と m_screenMode の設定で描画デバイスを作成します.
+HRESULT App::CreateDevice()
 {
-    // ワールド位置出力用.
-    IDirect3DTexture9* renderTexture;
-    renderTexture = CreateDeferredTarget(width, height, D3DFMT_A32B32G32R32F);
-    if (!renderTexture)
-        throw std::runtime_error("Failed CreateDeferredTarget(worldPos)");
+    HRESULT hr;
 
-    m_renderWorldPos = new RenderTarget(m_d3dDev, renderTexture);
-    renderTexture->Release();
+    // ディスプレイモード.
+    D3DDISPLAYMODEEX dm;
+    ZeroMemory(&dm, sizeof(dm));
+    dm.Size = sizeof(dm);
+    dm.Format = m_d3dpp.BackBufferFormat;
+    dm.Width = m_d3dpp.BackBufferWidth;
+    dm.Height = m_d3dpp.BackBufferHeight;
+    dm.ScanLineOrdering = D3DSCANLINEORDERING_UNKNOWN;
+
+    // 描画デバイスの作成.
+    DWORD flag = D3DCREATE_HARDWARE_VERTEXPROCESSING | D3DCREATE_FPU_PRESERVE;
+    switch (m_screenMode)
+    {
+    case App::WindowMode:
+    case App::VirtualFullScreenMode:
+        // ウィンドウモード もしくは 仮想フルスクリーンモード.
+        m_d3dpp.Windowed = TRUE;
+        hr = m_d3d9->CreateDeviceEx(
+            D3DADAPTER_DEFAULT,
+            D3DDEVTYPE_HAL,
+            m_hWnd,
+            flag,
+            &m_d3dpp,
+            nullptr,    // 指定しない！
+            &m_d3dDev);
+        break;
+
+    case App::FullScreenMode:
+        // フルスクリーンモード.
+        // リフレッシュレートは 60Hz を期待.
+        m_d3dpp.Windowed = FALSE;
+        m_d3dpp.FullScreen_RefreshRateInHz = 60;
+        dm.RefreshRate = m_d3dpp.FullScreen_RefreshRateInHz;
+        hr = m_d3d9->CreateDeviceEx(
+            D3DADAPTER_DEFAULT,
+            D3DDEVTYPE_HAL,
+            m_hWnd,
+            flag,
+            &m_d3dpp,
+            &dm,    // 指定する！
+            &m_d3dDev);
+        break;
+
+    case App::HeadlessMode:
+        // 描画を行わないヌルデバイス.
+        m_d3dpp.Windowed = TRUE;
+        m_d3dDev = new NullDevice(m_d3dpp);
+        hr = S_OK;
+        break;
+
+    default:
+        throw std::runtime_error("Not found ScreenType");
+    }
 
-    // 法線出力用.
-    renderTexture = CreateDeferredTarget(width, height, D3DFMT_A16B16G16R16F);
-    if (!renderTexture)
-        throw std::runtime_error("Failed CreateDeferredTarget(worldNormal)");
+    // 先行して積めるフレームの数を制限して, 入力から表示までの遅延を減らす.
+    if (SUCCEEDED(hr) && m_presentSettings.maxFrameLatency > 0)
+    {
+        m_d3dDev->SetMaximumFrameLatency(m_presentSettings.maxFrameLatency);
+    }
 
-    m_renderWorldNormal = new RenderTarget(m_d3dDev, renderTexture);
-    renderTexture->Release();
+    // 記録する場合は, 作成したデバイスを包んで以降の呼び出しを全て通す.
+    if (SUCCEEDED(hr) && !m_traceFile.empty())
+    {
+        m_traceDevice = new TraceDevice(m_d3dDev);
+        m_d3dDev->Release();
+        m_d3dDev = m_traceDevice;
+    }
+    return hr;
+}
 
-    // Diffuse 出力用.
-    renderTexture = CreateDeferredTarget(width, height, D3DFMT_A8R8G8B8);
-    if (!renderTexture)
-        throw std::runtime_error("Failed CreateDeferredTarget(diffuse)");
+void App::SetupViewport(int width, int height)
+{
+    D3DVIEWPORT9 vp;
+    vp.X = 0;
+    vp.Y = 0;
+    vp.Width = width;
+    vp.Height = height;
+    vp.MinZ = 0.0f;
+    vp.MaxZ = 1.0f;
+    m_d3dDev->SetViewport(&vp);
+}
+
+// デバイスに依存するオブジェクトを全て解放します.
+// 登録済みのリソースは元データが残っているため RecoverDevice で作り直せます.
+void App::ReleaseDeviceObjects()
+{
+    delete m_frameGraph;
+    m_frameGraph = nullptr;
+
+    delete m_rtPool;
+    delete m_rtAllocator;
+    m_rtPool = nullptr;
+    m_rtAllocator = nullptr;
+
+    delete m_dynamicVB;
+    delete m_dynamicIB;
+    m_dynamicVB = nullptr;
+    m_dynamicIB = nullptr;
+
+    if (m_frameCapture)
+    {
+        m_frameCapture->ReleaseDeviceObjects();
+    }
+    if (m_gpuTimer)
+    {
+        m_gpuTimer->ReleaseDeviceObjects();
+    }
 
-    m_renderDiffuse = new RenderTarget(m_d3dDev, renderTexture);
-    renderTexture->Release();
+    if (m_resources)
+    {
+        m_resources->ReleaseAll();
+    }
 }
 
-IDirect3DTexture9* App::CreateDeferredTarget(int width, int height, D3DFORMAT format)
+// D3DERR_DEVICEHUNG / D3DERR_DEVICEREMOVED の後にデバイスを作り直し,
+// 登録済みのリソースを元データから再作成します. 描画スレッドは止まっています.
+bool App::RecoverDevice()
 {
-    HRESULT hr;
-    IDirect3DTexture9* renderTexture = nullptr;
-    hr = m_d3dDev->CreateTexture(
-        width, 
-        height, 
-        1, 
-        D3DUSAGE_RENDERTARGET, 
-        format,
-        D3DPOOL_DEFAULT, 
-        &renderTexture, 
-        nullptr);
-    if (FAILED(hr))
+    LARGE_INTEGER freq, begin, end;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&begin);
+
+    ReleaseDeviceObjects();
+    StopTrace();
+    SafeRelease(m_d3dDev);
+
+    // アダプタが変わっている可能性があるため, IDirect3D9Ex から作り直す.
+    SafeRelease(m_d3d9);
+    try
+    {
+        HRESULT hr;
+        if (m_screenMode != App::HeadlessMode)
+        {
+            hr = Direct3DCreate9Ex(D3D_SDK_VERSION, &m_d3d9);
+            if (FAILED(hr))
+                throw std::runtime_error("failed Direct3DCreate9Ex");
+        }
+
+        hr = CreateDevice();
+        if (FAILED(hr))
+            throw std::runtime_error("failed CreateDeviceEx");
+
+        hr = m_resources->RecreateAll(m_d3dDev);
+        if (FAILED(hr))
+            throw std::runtime_error("failed RecreateAll");
+
+        m_dynamicVB = new DynamicBuffer(m_d3dDev, DynamicBuffer::VertexBuffer, DynamicVertexBufferSize);
+        m_dynamicIB = new DynamicBuffer(m_d3dDev, DynamicBuffer::IndexBuffer, DynamicIndexBufferSize);
+        SetupGBuffers(m_d3dpp.BackBufferWidth, m_d3dpp.BackBufferHeight);
+        SetupViewport(m_d3dpp.BackBufferWidth, m_d3dpp.BackBufferHeight);
+        m_frameCapture->SetDevice(m_d3dDev);
+        if (m_dynamicResolution)
+        {
+            m_gpuTimer->SetDevice(m_d3dDev);
+        }
+    }
+    catch (const std::runtime_error& e)
+    {
+        // 呼び出し側が後で再試行する.
+        OutputDebugStringA("RecoverDevice: ");
+        OutputDebugStringA(e.what());
+        OutputDebugStringA("\n");
+        return false;
+    }
+
+    QueryPerformanceCounter(&end);
+    double msec = double(end.QuadPart - begin.QuadPart) * 1000.0 / double(freq.QuadPart);
+    char buf[128];
+    snprintf(buf, sizeof(buf), "Device recovered: %d resources (%d KB) in %.2f ms\n",
+        int(m_resources->GetCount()), int(m_resources->GetSourceBytes() / 1024), msec);
+    OutputDebugStringA(buf);
+    m_deviceLost = false;
+    return true;
+}
+
+void App::SimulateDeviceLost()
+{
+    m_deviceLost = true;
+}
+
+void App::SetCamera(const DeferredScene::Camera& camera)
+{
+    m_camera = camera;
+    DeferredScene::BuildCameraMatrices(m_camera, int(m_d3dpp.BackBufferWidth), int(m_d3dpp.BackBufferHeight), m_mtxView, m_mtxProj);
+}
+
+void App::SetPresentSettings(const PresentSettings& settings)
+{
+    m_presentSettings = settings;
+}
+
+void App::WaitForNextFrame()
+{
+    m_pacer.WaitForFrameStart();
+}
+
+std::string App::GetPacingReport() const
+{
+    return m_pacer.Report();
+}
+
+void App::SetLightingResolution(int factor)
+{
+    m_lightingFactor = factor > 1 ? factor : 1;
+    m_upsampleParams = LightingReference::GetDefaultUpsampleParams(m_lightingFactor);
+}
+
+void App::SetDynamicResolution(bool enabled, double budgetMsec)
+{
+    m_dynamicResolution = enabled;
+    m_resolutionBudgetMsec = budgetMsec;
+}
+
+std::string App::GetResolutionReport() const
+{
+    if (!m_dynamicResolution)
+    {
+        return std::string();
+    }
+    std::string report = m_resolution.Report();
+    if (!m_gpuTimer || !m_gpuTimer->IsSupported())
+    {
+        report += "Dynamic resolution: timestamp queries unavailable, using CPU frame time\n";
+    }
+    return report;
+}
+
+void App::SetMeshFile(const std::string& fileName)
+{
+    m_meshFile = fileName;
+}
+
+NullDevice* App::GetNullDevice()
+{
+    if (m_screenMode != App::HeadlessMode)
     {
         return nullptr;
     }
-    return renderTexture;
+    if (m_traceDevice)
+    {
+        return static_cast<NullDevice*>(m_traceDevice->GetInner());
+    }
+    return static_cast<NullDevice*>(m_d3dDev);
+}
+
+void App::SetTraceFile(const std::string& fileName)
+{
+    m_traceFile = fileName;
+}
+
+// 記録したトレースを保存します. 記録はデバイスを解放するまで続きますが, 以降は保存しません.
+void App::StopTrace()
+{
+    if (!m_traceDevice)
+    {
+        return;
+    }
+    const CommandTraceWriter& writer = m_traceDevice->GetWriter();
+    const bool saved = m_traceDevice->Save(m_traceFile.c_str());
+    char buf[512];
+    snprintf(buf, sizeof(buf), "%s trace: %s (%llu calls, %d KB)\n",
+        saved ? "Saved" : "Failed to save", m_traceFile.c_str(),
+        (unsigned long long)writer.GetCommandCount(), int(writer.GetData().size() / 1024));
+    OutputDebugStringA(buf);
+
+    // 作り直したデバイスは記録しない.
+    m_traceDevice = nullptr;
+    m_traceFile.clear();
+}
+
+void App::RequestCapture(bool includeGBuffer)
+{
+    m_captureRequest |= CaptureScreen;
+    if (includeGBuffer)
+    {
+        m_captureRequest |= CaptureGBufferTargets;
+    }
+}
+
+void App::SetCaptureInterval(int frames)
+{
+    m_captureInterval = frames;
+}
+
+std::string App::GetCaptureReport() const
+{
+    if (!m_frameCapture)
+    {
+        return std::string();
+    }
+    // 書き出し待ちの画像があれば集計が揃うまで待つ.
+    m_captureQueue->Flush();
+    return m_frameCapture->Report() + m_captureQueue->Report();
+}
+
+// 保存するファイル名. 計測用の保存ではファイルに書き出さないため空にする.
+std::string App::GetCaptureFileName(const char* suffix) const
+{
+    if (m_captureInterval > 0)
+    {
+        return std::string();
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "\\capture_%04d%s", m_captureIndex, suffix);
+    return GetExecutionDirectory() + name;
+}
+
+void App::SetupGBuffers(int width, int height)
+{
+    m_rtAllocator = new DeviceRenderTargetAllocator(m_d3dDev);
+    m_rtPool = new RenderTargetPool(m_rtAllocator);
+
+    // ワールド位置出力用.
+    m_descWorldPos.width = width;
+    m_descWorldPos.height = height;
+    m_descWorldPos.format = D3DFMT_A32B32G32R32F;
+    m_descWorldPos.usage = D3DUSAGE_RENDERTARGET;
+
+    // 法線出力用.
+    m_descWorldNormal = m_descWorldPos;
+    m_descWorldNormal.format = D3DFMT_A16B16G16R16F;
+
+    // Diffuse 出力用.
+    m_descDiffuse = m_descWorldPos;
+    m_descDiffuse.format = D3DFMT_A8R8G8B8;
+
+    // 低い解像度の光の寄与. 1 を超える値もあるので浮動小数点数で持つ.
+    m_descLightAccum = m_descWorldPos;
+    m_descLightAccum.width = (width + m_lightingFactor - 1) / m_lightingFactor;
+    m_descLightAccum.height = (height + m_lightingFactor - 1) / m_lightingFactor;
+    m_descLightAccum.format = D3DFMT_A16B16G16R16F;
+
+    // 起動時に一度確保して作成できることを確認しておく.
+    // 返却したターゲットはプールに残り, 以降のフレームで再利用される.
+    const RenderTargetDesc* descs[] = {
+        &m_descWorldPos, &m_descWorldNormal, &m_descDiffuse, &m_descLightAccum,
+    };
+    const int descCount = m_lightingFactor > 1 ? _countof(descs) : _countof(descs) - 1;
+    RenderTarget* targets[_countof(descs)] = {};
+    for (int i = 0; i < descCount; ++i)
+    {
+        targets[i] = m_rtPool->Acquire(*descs[i]);
+    }
+    for (int i = 0; i < descCount; ++i)
+    {
+        if (!targets[i])
+            throw std::runtime_error("Failed Acquire GBuffers");
+        m_rtPool->Release(targets[i]);
+    }
+
+    m_frameGraph = new FrameGraph(m_d3dDev, m_rtPool);
 }
 
 void App::Render()
 {
+    // デバイスの作り直しは呼び出し側が描画スレッドを止めてから行う.
+    if (m_deviceLost)
+    {
+        return;
+    }
+
     IDirect3DSurface9* primaryColor;
 
     m_d3dDev->GetRenderTarget(0, &primaryColor);
 
-    m_d3dDev->SetRenderTarget(0, m_renderWorldPos->GetTargetSurface());
-    m_d3dDev->SetRenderTarget(1, m_renderWorldNormal->GetTargetSurface());
-    m_d3dDev->SetRenderTarget(2, m_renderDiffuse->GetTargetSurface());
+    if (m_captureInterval > 0 && m_frameIndex % m_captureInterval == 0)
+    {
+        m_captureRequest |= CaptureScreen;
+    }
+    const int captureRequest = m_captureRequest;
+    m_captureRequest = 0;
+
+    // このフレームの描画範囲を決める.
+    LARGE_INTEGER frameBegin;
+    QueryPerformanceCounter(&frameBegin);
+    m_renderScale = m_dynamicResolution ? m_resolution.GetScale() : 1.0;
+    ResolutionController::GetScaledSize(int(m_d3dpp.BackBufferWidth), int(m_d3dpp.BackBufferHeight),
+        m_renderScale, RenderSizeAlign, m_renderWidth, m_renderHeight);
+
+    // フレームグラフでパスと使用するレンダーターゲットを宣言する.
+    FrameGraph& graph = *m_frameGraph;
+    graph.Reset();
+    FrameGraph::Handle backBuffer = graph.ImportTarget("BackBuffer", primaryColor);
+    FrameGraph::Handle worldPos = graph.CreateTarget("WorldPos", m_descWorldPos);
+    FrameGraph::Handle worldNormal = graph.CreateTarget("WorldNormal", m_descWorldNormal);
+    FrameGraph::Handle diffuse = graph.CreateTarget("Diffuse", m_descDiffuse);
+
+    // G-Buffer への書き込みパス.
+    int gbufferPass = graph.AddPass("GBuffer", [this](FrameGraph&) {
+        DrawGBufferPass();
+    });
+    graph.Write(gbufferPass, worldPos, 0);
+    graph.Write(gbufferPass, worldNormal, 1);
+    graph.Write(gbufferPass, diffuse, 2);
+
+    if (m_lightingFactor > 1)
+    {
+        // 光の寄与を低い解像度で計算するパス.
+        FrameGraph::Handle lightAccum = graph.CreateTarget("LightAccum", m_descLightAccum);
+        int accumPass = graph.AddPass("LightAccum", [this, worldPos, worldNormal](FrameGraph& fg) {
+            DrawLightAccumPass(fg.GetTexture(worldPos), fg.GetTexture(worldNormal));
+        });
+        graph.Read(accumPass, worldPos);
+        graph.Read(accumPass, worldNormal);
+        graph.Write(accumPass, lightAccum, 0);
+
+        // 光の寄与を元の解像度へ補間してアルベドを掛けるパス.
+        int upsamplePass = graph.AddPass("Upsample", [this, worldPos, worldNormal, diffuse, lightAccum](FrameGraph& fg) {
+            DrawUpsamplePass(fg.GetTexture(worldPos), fg.GetTexture(worldNormal), fg.GetTexture(diffuse), fg.GetTexture(lightAccum));
+        });
+        graph.Read(upsamplePass, worldPos);
+        graph.Read(upsamplePass, worldNormal);
+        graph.Read(upsamplePass, diffuse);
+        graph.Read(upsamplePass, lightAccum);
+        graph.Write(upsamplePass, backBuffer, 0);
+    }
+    else
+    {
+        // G-Buffer を参照してライティングを行うパス.
+        int lightingPass = graph.AddPass("Lighting", [this, worldPos, worldNormal, diffuse](FrameGraph& fg) {
+            DrawLightingPass(fg.GetTexture(worldPos), fg.GetTexture(worldNormal), fg.GetTexture(diffuse));
+        });
+        graph.Read(lightingPass, worldPos);
+        graph.Read(lightingPass, worldNormal);
+        graph.Read(lightingPass, diffuse);
+        graph.Write(lightingPass, backBuffer, 0);
+    }
+
+    // G-Buffer の保存. 読み戻しのコピーを積むだけなので, 出力が無くても除去されないようにする.
+    if (captureRequest & CaptureGBufferTargets)
+    {
+        int capturePass = graph.AddPass("Capture", [this, worldPos, worldNormal, diffuse](FrameGraph& fg) {
+            CaptureGBuffer(fg, worldPos, worldNormal, diffuse);
+        }, true);
+        graph.Read(capturePass, worldPos);
+        graph.Read(capturePass, worldNormal);
+        graph.Read(capturePass, diffuse);
+    }
+
+    if (m_dynamicResolution)
+    {
+        m_gpuTimer->BeginFrame(m_renderScale);
+    }
+    m_d3dDev->BeginScene();
+    if (graph.Compile())
+    {
+        graph.Execute();
+    }
+    m_d3dDev->EndScene();
+    if (m_dynamicResolution)
+    {
+        m_gpuTimer->EndFrame();
+    }
+
+    // 画面の保存. バックバッファはマルチサンプルを使っていないため, そのまま読み戻せる.
+    if (captureRequest & CaptureScreen)
+    {
+        m_frameCapture->Capture(primaryColor, GetCaptureFileName(".png").c_str(), CaptureQueue::Png);
+    }
+    if (captureRequest != 0)
+    {
+        m_captureIndex++;
+    }
+    primaryColor->Release();
+
+    // このフレームで書き込んだ領域にフェンスを設定.
+    m_dynamicVB->EndFrame();
+    m_dynamicIB->EndFrame();
+
+    // 数フレーム前に保存を指示したものを読み戻し, 書き出しをワーカースレッドに任せる.
+    m_frameCapture->EndFrame();
+    m_frameIndex++;
+
+    // しばらく使われていないレンダーターゲットを破棄.
+    m_rtPool->EndFrame();
+
+    // 次のフレームの倍率を決める. Present で待つ時間は含めない.
+    if (m_dynamicResolution)
+    {
+        LARGE_INTEGER frameEnd, freq;
+        QueryPerformanceCounter(&frameEnd);
+        QueryPerformanceFrequency(&freq);
+        UpdateRenderScale(double(frameEnd.QuadPart - frameBegin.QuadPart) / double(freq.QuadPart));
+    }
+
+    HRESULT hr;
+    m_pacer.BeginPresent();
+    hr = m_d3dDev->PresentEx(nullptr, nullptr, nullptr, nullptr, 0);
+    m_pacer.EndPresent();
+
+    // Present が待たなかったフレームでも垂直同期の位相を追えるよう, 走査線の位置から直前の垂直同期の時刻を求める.
+    D3DRASTER_STATUS raster;
+    if (m_pacer.IsEnabled() && m_presentSettings.vsync && m_displayHeight > 0
+        && SUCCEEDED(m_d3dDev->GetRasterStatus(0, &raster)))
+    {
+        const double line = raster.InVBlank ? 0.0 : double(raster.ScanLine);
+        const double elapsed = line / (m_displayHeight * VerticalTotalRatio) * m_pacer.GetInterval();
+        m_pacer.AddVBlankSample(FramePacer::GetSystemClock().Now() - elapsed);
+    }
+    if (FAILED(hr))
+    {
+        // どちらもデバイスを作り直して復帰する.
+        if (hr == D3DERR_DEVICEREMOVED)
+        {
+            OutputDebugStringA("D3DERR_DEVICEREMOVED\n");
+            m_deviceLost = true;
+        }
+        if (hr == D3DERR_DEVICEHUNG)
+        {
+            OutputDebugStringA("D3DERR_DEVICEHUNG\n");
+            m_deviceLost = true;
+        }
+        if (hr == D3DERR_DEVICELOST)
+        {
+            OutputDebugStringA("DeviceLost\n");
+        }
+    }
+}
+
+// 届いた GPU のフレーム時間を全て制御に渡します. タイムスタンプクエリが使えなければ CPU の時間で代用します.
+void App::UpdateRenderScale(double cpuFrameSec)
+{
+    if (!m_gpuTimer->IsSupported())
+    {
+        m_resolution.Update(cpuFrameSec, m_renderScale);
+        return;
+    }
+    double seconds, scale;
+    while (m_gpuTimer->GetResult(seconds, scale))
+    {
+        m_resolution.Update(seconds, scale);
+    }
+}
+
+// G-Buffer へワールド位置, 法線, Diffuse を書き込みます.
+void App::DrawGBufferPass()
+{
+    // レンダーターゲットを設定するとビューポートはターゲット全体に戻るため, ここで描画範囲に絞る.
+    SetupViewport(m_renderWidth, m_renderHeight);
 
     // 画面を塗りつぶす.
     DWORD dwClearFlags = D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER | D3DCLEAR_STENCIL;
-    DWORD dwClearColor = D3DCOLOR_RGBA(0x40, 0x80, 0xFF, 0x00);
     m_d3dDev->Clear(0, nullptr, dwClearFlags, 0, 1.0f, 0);
-    m_d3dDev->BeginScene();
 
     // ワールド行列は単位行列.
     XMMATRIX world = XMMatrixIdentity();
@@ -299,21 +814,9 @@ void App::Render()
     m_d3dDev->SetRenderState(D3DRS_ZENABLE, TRUE);
 
     // モデルを描画する
-    XMFLOAT3 modelPos[] = {
-        XMFLOAT3(0.0f, 0.85f, 0.0f),
-        XMFLOAT3(-3.0f, 0.85f, -2.0f),
-        XMFLOAT3(+3.0f, 0.85f, -2.0f),
-        XMFLOAT3(-3.0f, 0.85f,  2.0f),
-        XMFLOAT3(+3.0f, 0.85f,  2.0f),
-    };
-    XMFLOAT4 teapotColor[] = {
-        XMFLOAT4(0.8f, 1.0f,0.8f, 1.0f),
-        XMFLOAT4(0.8f, 0.7f,0.6f, 1.0f),
-        XMFLOAT4(0.3f, 0.5f,0.4f, 1.0f),
-        XMFLOAT4(0.3f, 0.5f,0.7f, 1.0f),
-        XMFLOAT4(0.8f, 0.8f,0.8f, 1.0f),
-    };
-    for (int i = 0; i < _countof(modelPos); ++i)
+    const XMFLOAT3* modelPos = DeferredScene::GetModelPositions();
+    const XMFLOAT4* teapotColor = DeferredScene::GetModelColors();
+    for (int i = 0; i < DeferredScene::ModelCount; ++i)
     {
         XMFLOAT4X4 world;
         XMStoreFloat4x4( 
@@ -327,57 +830,100 @@ void App::Render()
     XMFLOAT4X4 identity;
     XMStoreFloat4x4(&identity, XMMatrixIdentity());
     DrawModel(m_floor, identity, XMFLOAT4(1,1,1,1));
+}
 
-#if 01
-    // プライマリのバッファに戻す.
-    m_d3dDev->SetRenderTarget(0, primaryColor);
-    m_d3dDev->SetRenderTarget(1, nullptr);
-    m_d3dDev->SetRenderTarget(2, nullptr);
-    m_d3dDev->SetRenderTarget(3, nullptr);
+// G-Buffer を参照してライティング結果をバックバッファへ書き込みます.
+void App::DrawLightingPass(IDirect3DTexture9* texWorldPos, IDirect3DTexture9* texWorldNormal, IDirect3DTexture9* texDiffuse)
+{
+    DWORD dwClearFlags = D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER | D3DCLEAR_STENCIL;
     m_d3dDev->Clear(D3DADAPTER_DEFAULT, NULL, dwClearFlags, D3DCOLOR_XRGB(0,192,64), 1.0f, 0);
 
-    m_d3dDev->SetVertexDeclaration(m_DeclarationPT);
-
-    m_d3dDev->SetVertexShader(m_mapVS[L"Deferred_LightingPass"]);
     m_d3dDev->SetPixelShader(m_mapPS[L"Deferred_LightingPass"]);
 
-    m_d3dDev->SetTexture(0, m_renderWorldPos->GetTexture());
-    m_d3dDev->SetTexture(1, m_renderWorldNormal->GetTexture());
-    m_d3dDev->SetTexture(2, m_renderDiffuse->GetTexture());
+    m_d3dDev->SetTexture(0, texWorldPos);
+    m_d3dDev->SetTexture(1, texWorldNormal);
+    m_d3dDev->SetTexture(2, texDiffuse);
 
-    m_d3dDev->SetRenderState(D3DRS_ZENABLE, FALSE);
+    int lightCount;
+    const DeferredScene::LightInfo* lightInfo = DeferredScene::GetLights(lightCount);
+    m_d3dDev->SetPixelShaderConstantF(0, &lightInfo[0].Pos.x, lightCount*2);
 
-    struct LightInfo
-    {
-        XMFLOAT4 Pos;
-        XMFLOAT4 Color;
-    };
+    DrawFullScreenQuad();
+}
+
+// アルベドを掛ける前の光の寄与を, 縦横 1/m_lightingFactor の解像度で書き込みます.
+// 各画素は対応する範囲の中央の G-Buffer の値で計算します.
+void App::DrawLightAccumPass(IDirect3DTexture9* texWorldPos, IDirect3DTexture9* texWorldNormal)
+{
+    // レンダーターゲットを設定するとビューポートはターゲット全体に戻るため, G-Buffer の描画範囲に合わせて絞る.
+    SetupViewport((m_renderWidth + m_lightingFactor - 1) / m_lightingFactor,
+        (m_renderHeight + m_lightingFactor - 1) / m_lightingFactor);
 
-    LightInfo lightInfo[] = {
-        { XMFLOAT4(0.0f, 8.0f,-4.0f, 10.0f), XMFLOAT4(1.0f,1.0f,1.0f,1) }, // Amb
-        // 各 teapot 照らし用
-        { XMFLOAT4( 0.0f, 2.3f,-1.0f, 2.0f), XMFLOAT4(1.0f,1.0f,1.0f,1) },
-        { XMFLOAT4(-3.5f, 2.3f,-3.0f, 2.0f), XMFLOAT4(0.6f,0.1f,1.0f,1) },
-        { XMFLOAT4(+3.5f, 2.3f,-3.0f, 2.0f), XMFLOAT4(0.0f,1.0f,0.0f,1) },
-        { XMFLOAT4(-3.5f, 2.3f,+1.0f, 2.0f), XMFLOAT4(0.0f,0.0f,1.0f,1) },
-        { XMFLOAT4(+3.5f, 2.3f,+1.0f, 2.0f), XMFLOAT4(1.0f,0.0f,0.0f,1) },
+    m_d3dDev->SetPixelShader(m_mapPS[L"Deferred_LightAccumPass"]);
 
-        { XMFLOAT4(-1.5f, 1.0f, -3.5f, 3.0f), XMFLOAT4(0.0f,0.8f,0.0f,1) },
-        { XMFLOAT4(+1.5f, 1.0f, -3.5f, 3.0f), XMFLOAT4(0.3f,0.6f,1.0f,1) },
-        { XMFLOAT4(-1.5f, 1.0f,  0.5f, 3.0f), XMFLOAT4(1.0f,0.9f,0.1f,1) },
-        { XMFLOAT4(+1.5f, 1.0f,  0.5f, 3.0f), XMFLOAT4(1.0f,0.4f,0.9f,1) },
+    m_d3dDev->SetTexture(0, texWorldPos);
+    m_d3dDev->SetTexture(1, texWorldNormal);
 
-        { XMFLOAT4( 0.0f, 1.5, -1.5f, 2.0f), XMFLOAT4(0.3f,0.1f,0.9f,1) }, 
-        { XMFLOAT4(-2.5f, 3.0f,  -.5f, 4.0f), XMFLOAT4(0.3f,1.0f,0.9f,1) },
-        { XMFLOAT4( 2.75f,0.85f, 1.0f, 3.0f), XMFLOAT4(0.3f,1.0f,0.9f,1) },
+    SetLightingConstants();
+    DrawFullScreenQuad();
+}
+
+// 低い解像度の光の寄与を, 周りの 4 つから法線と位置の近いものを重く見て補間し, アルベドを掛けてバックバッファへ書き込みます.
+// 同じ面の標本が無い画素 (輪郭など) は, その画素だけ全ての光を計算し直します.
+void App::DrawUpsamplePass(IDirect3DTexture9* texWorldPos, IDirect3DTexture9* texWorldNormal, IDirect3DTexture9* texDiffuse,
+    IDirect3DTexture9* texLight)
+{
+    DWORD dwClearFlags = D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER | D3DCLEAR_STENCIL;
+    m_d3dDev->Clear(D3DADAPTER_DEFAULT, NULL, dwClearFlags, D3DCOLOR_XRGB(0,192,64), 1.0f, 0);
+
+    m_d3dDev->SetPixelShader(m_mapPS[L"Deferred_UpsamplePass"]);
 
-        { XMFLOAT4(-3.0f, 1.5f,-4.0f, 2.5f), XMFLOAT4(0.3f,0.8f,1.0f,1) },
-        { XMFLOAT4(+3.0f, 1.5f,-4.0f, 2.5f), XMFLOAT4(0.8f,0.1f,1.0f,1) },
-        { XMFLOAT4(+2.5f, 0.5f, 1.0f, 2.5f), XMFLOAT4(1.0f,0.7f,0.1f,1) },
+    m_d3dDev->SetTexture(0, texWorldPos);
+    m_d3dDev->SetTexture(1, texWorldNormal);
+    m_d3dDev->SetTexture(2, texDiffuse);
+    m_d3dDev->SetTexture(3, texLight);
 
+    SetLightingConstants();
+    DrawFullScreenQuad();
+}
+
+// 光の情報と, 低い解像度の標本の位置を求めるための定数を設定します.
+// 並びは Deferred_LightAccumPass_PS.hlsl と Deferred_UpsamplePass_PS.hlsl に合わせます.
+void App::SetLightingConstants()
+{
+    int lightCount;
+    const DeferredScene::LightInfo* lightInfo = DeferredScene::GetLights(lightCount);
+    m_d3dDev->SetPixelShaderConstantF(0, &lightInfo[0].Pos.x, lightCount*2);
+
+    const int factor = m_lightingFactor;
+    const int lowWidth = (m_renderWidth + factor - 1) / factor;
+    const int lowHeight = (m_renderHeight + factor - 1) / factor;
+    const float constants[4][4] = {
+        // 標本の間隔, 範囲の中央までの画素数, G-Buffer の描画範囲の最後の画素.
+        { float(factor), float(factor / 2), float(m_renderWidth - 1), float(m_renderHeight - 1) },
+        // G-Buffer の大きさとその逆数.
+        { float(m_descWorldPos.width), float(m_descWorldPos.height), 1.0f / float(m_descWorldPos.width), 1.0f / float(m_descWorldPos.height) },
+        // 光の寄与の描画範囲の最後の画素と, ターゲットの大きさの逆数.
+        { float(lowWidth - 1), float(lowHeight - 1), 1.0f / float(m_descLightAccum.width), 1.0f / float(m_descLightAccum.height) },
+        { m_upsampleParams.normalPower, m_upsampleParams.planeSharpness, m_upsampleParams.minWeight, 0.0f },
     };
-    const int lightCount = _countof(lightInfo);
-    m_d3dDev->SetPixelShaderConstantF(0, (float*)(&lightInfo[0]), lightCount*2);
+    m_d3dDev->SetPixelShaderConstantF(32, &constants[0][0], 4);
+}
+
+// 今のレンダーターゲットのビューポート全体を覆う矩形を描画します.
+// 頂点シェーダーは UV を G-Buffer の描画範囲に合わせます.
+void App::DrawFullScreenQuad()
+{
+    m_d3dDev->SetVertexDeclaration(m_DeclarationPT);
+    m_d3dDev->SetVertexShader(m_mapVS[L"Deferred_LightingPass"]);
+
+    // G-Buffer の描画範囲だけを画面全体に引き延ばす.
+    const float uvScale[4] = {
+        float(m_renderWidth) / float(m_d3dpp.BackBufferWidth), float(m_renderHeight) / float(m_d3dpp.BackBufferHeight), 0.0f, 0.0f,
+    };
+    m_d3dDev->SetVertexShaderConstantF(0, uvScale, 1);
+
+    m_d3dDev->SetRenderState(D3DRS_ZENABLE, FALSE);
 
     struct VertexPT
     {
@@ -390,52 +936,64 @@ void App::Render()
         { XMFLOAT3( 1.0f,-1.0f,0.0f), XMFLOAT2(1.0f,1.0f) },
     };
     
-    m_d3dDev->DrawPrimitiveUP(D3DPT_TRIANGLESTRIP, 2, verticesFullScreenQuad, sizeof(VertexPT) );
-#endif
-    m_d3dDev->EndScene();
-    primaryColor->Release();
-
-    HRESULT hr;
-    hr = m_d3dDev->PresentEx(nullptr, nullptr, nullptr, nullptr, 0);
-    if (FAILED(hr))
-    {
-        if (hr == D3DERR_DEVICEREMOVED)
-        {
-            OutputDebugStringA("D3DERR_DEVICEREMOVED\n");
-            hr = m_d3dDev->ResetEx(&m_d3dpp, nullptr);
-        }
-        if (hr == D3DERR_DEVICEHUNG)
-        {
-            OutputDebugStringA("D3DERR_DEVICEHUNG\n");
+    // リングバッファへ書き込んで描画する.
+    UINT startVertex = m_dynamicVB->Write(verticesFullScreenQuad, sizeof(verticesFullScreenQuad), sizeof(VertexPT));
+    m_d3dDev->SetStreamSource(0, m_dynamicVB->GetVertexBuffer(), 0, sizeof(VertexPT));
+    m_d3dDev->DrawPrimitive(D3DPT_TRIANGLESTRIP, startVertex, 2);
+}
 
-        }
-        if (hr == D3DERR_DEVICELOST)
-        {
-            OutputDebugStringA("DeviceLost\n");
-        }
-    }
+// G-Buffer を変換せずに DDS で保存する. ライティングの確認用.
+// 動的解像度で描画範囲を狭めている場合, 有効なのは左上の m_renderWidth x m_renderHeight だけ.
+void App::CaptureGBuffer(FrameGraph& graph, FrameGraph::Handle worldPos, FrameGraph::Handle worldNormal, FrameGraph::Handle diffuse)
+{
+    m_frameCapture->Capture(graph.GetSurface(worldPos), GetCaptureFileName("_worldpos.dds").c_str(), CaptureQueue::Dds);
+    m_frameCapture->Capture(graph.GetSurface(worldNormal), GetCaptureFileName("_normal.dds").c_str(), CaptureQueue::Dds);
+    m_frameCapture->Capture(graph.GetSurface(diffuse), GetCaptureFileName("_diffuse.dds").c_str(), CaptureQueue::Dds);
 }
 
 void App::Terminate()
 {
-    delete m_renderWorldPos;
-    delete m_renderWorldNormal;
-    delete m_renderDiffuse;
-    m_renderWorldPos = nullptr;
-    m_renderWorldNormal = nullptr;
-    m_renderDiffuse = nullptr;
-
-    SafeRelease(m_DeclarationPN);
-    SafeRelease(m_DeclarationPT);
+    if (m_rtPool)
+    {
+        OutputDebugStringA(m_rtPool->Report().c_str());
+    }
+    if (m_frameCapture)
+    {
+        OutputDebugStringA(GetCaptureReport().c_str());
+    }
+    OutputDebugStringA(MeshletCuller::Report(m_meshletStats).c_str());
+    OutputDebugStringA(GetPacingReport().c_str());
+    OutputDebugStringA(GetResolutionReport().c_str());
+    ReleaseDeviceObjects();
+
+    // 頂点宣言, シェーダー, 静的なバッファはレジストリが解放する.
+    delete m_resources;
+    m_resources = nullptr;
+
+    // 書き出し待ちの画像はデストラクタで全て書き出す.
+    delete m_frameCapture;
+    delete m_captureQueue;
+    m_frameCapture = nullptr;
+    m_captureQueue = nullptr;
+    delete m_gpuTimer;
+    m_gpuTimer = nullptr;
+
+    StopTrace();
     SafeRelease(m_d3dDev);
     SafeRelease(m_d3d9);
+    m_assets.UnmountAll();
+
+    if (m_timerResolutionRaised)
+    {
+        timeEndPeriod(1);
+        m_timerResolutionRaised = false;
+    }
 }
 
 void App::DrawModel(const Model& model, const DirectX::XMFLOAT4X4& world, const DirectX::XMFLOAT4& color)
 {
     m_d3dDev->SetVertexDeclaration(m_DeclarationPN);
     m_d3dDev->SetStreamSource(0, model.vb, 0, sizeof(MyVertexPN));
-    m_d3dDev->SetIndices(model.ib);
 
     XMFLOAT4X4 transposed;
     XMStoreFloat4x4(
@@ -446,14 +1004,75 @@ void App::DrawModel(const Model& model, const DirectX::XMFLOAT4X4& world, const
     m_d3dDev->SetVertexShaderConstantF(0, &transposed.m[0][0], 4);
     m_d3dDev->SetVertexShaderConstantF(8, &color.x, 1);
 
+    if (model.subMeshes.size() > 1)
+    {
+        m_d3dDev->SetIndices(model.ib);
+        for (const auto& sub : model.subMeshes)
+        {
+            m_d3dDev->DrawIndexedPrimitive(
+                D3DPT_TRIANGLELIST,
+                sub.baseVertex,
+                0,
+                sub.vertexCount,
+                sub.startIndex,
+                sub.triangleCount);
+        }
+        return;
+    }
+
+    IDirect3DIndexBuffer9* ib = model.ib;
+    UINT startIndex = 0;
+    UINT indexCount = model.indexCount;
+    int lod = model.lods.empty() ? 0 : SelectLod(model, world);
+    if (lod > 0)
+    {
+        startIndex = model.lods[lod].indexOffset;
+        indexCount = model.lods[lod].indexCount;
+    }
+    else if (!model.meshlets.IsEmpty())
+    {
+        // 視錐台の外と裏向きのクラスタを除き, 残りのインデックスを詰めて描画する.
+        indexCount = model.meshlets.Cull(
+            XMLoadFloat4x4(&world), m_mtxView * m_mtxProj, m_camera.eyePos,
+            m_visibleMeshlets, &m_meshletStats);
+        if (indexCount == 0)
+        {
+            return;
+        }
+        UINT offset;
+        void* p = m_dynamicIB->Lock(indexCount * sizeof(uint16_t), sizeof(uint16_t), offset);
+        model.meshlets.WriteIndices(m_visibleMeshlets, static_cast<uint16_t*>(p));
+        m_dynamicIB->Unlock();
+        ib = m_dynamicIB->GetIndexBuffer();
+        startIndex = offset / sizeof(uint16_t);
+    }
+    m_d3dDev->SetIndices(ib);
+
     m_d3dDev->DrawIndexedPrimitive(
         D3DPT_TRIANGLELIST, 
         0, 
         0, 
         model.vertexCount, 
-        0, 
-        model.indexCount / 3);
+        startIndex, 
+        indexCount / 3);
+
+}
+
+// 画面上の誤差が許容範囲に収まる最も粗い LOD を選びます.
+int App::SelectLod(const Model& model, const DirectX::XMFLOAT4X4& world) const
+{
+    // 境界球の手前側までの距離で判定する.
+    const DeferredScene::Camera& camera = m_camera;
+    XMVECTOR center = XMVectorSet(world._41, world._42, world._43, 1.0f);
+    float distance = XMVectorGetX(XMVector3Length(center - XMLoadFloat3(&camera.eyePos))) - model.radius;
+    if (distance < camera.nearZ)
+    {
+        distance = camera.nearZ;
+    }
 
+    return MeshSimplifier::SelectLod(
+        model.lods.data(), int(model.lods.size()),
+        distance, camera.fovY, float(m_renderHeight), MaxLodPixelError);
 }
 
 // 頂点宣言の作成・準備を行います.
@@ -472,10 +1091,10 @@ void App::SetupVertexDeclarations()
         D3DDECL_END(),
     };
     
-    if (FAILED(m_d3dDev->CreateVertexDeclaration(declsPT, &m_DeclarationPT)))
+    if (FAILED(m_resources->CreateVertexDeclaration(&m_DeclarationPT, declsPT)))
         throw std::runtime_error("Failed CreateVertexDeclaration");
 
-    if (FAILED(m_d3dDev->CreateVertexDeclaration(declsPN, &m_DeclarationPN)))
+    if (FAILED(m_resources->CreateVertexDeclaration(&m_DeclarationPN, declsPN)))
         throw std::runtime_error("Failed CreateVertexDeclaration");
 }
 
@@ -488,86 +1107,202 @@ void App::SetupBuffers()
         { XMFLOAT3(-5,0,-5), XMFLOAT3(0,1,0) },
         { XMFLOAT3(5,0,-5), XMFLOAT3(0,1,0) },
     };
-    uint16_t floorIndices[] = {
+    uint32_t floorIndices[] = {
         0, 1, 2,
         2, 1, 3,
     };
 
-    UINT lengthVB = sizeof(floorVertices);
-    UINT lengthIB = sizeof(floorIndices);
-    m_floor.vertexCount = lengthVB / sizeof(floorVertices[0]);
-    m_floor.indexCount = lengthIB / sizeof(floorIndices[0]);
+    // 事前に用意した頂点/インデックスデータをコピーしたバッファを作成する.
+    CreateModel(m_floor,
+        floorVertices, _countof(floorVertices), sizeof(floorVertices[0]),
+        floorIndices, _countof(floorIndices));
+    m_floor.radius = 0.0f;
 
-    HRESULT hr;
-    hr = m_d3dDev->CreateVertexBuffer(
-        lengthVB,
-        0,
-        0,
-        D3DPOOL_DEFAULT,
-        &m_floor.vb,
-        nullptr);
-    if (FAILED(hr))
-        throw std::runtime_error("Failed CreateVertexBuffer");
+    // 毎フレーム更新する頂点/インデックスデータ用のリングバッファ.
+    m_dynamicVB = new DynamicBuffer(m_d3dDev, DynamicBuffer::VertexBuffer, DynamicVertexBufferSize);
+    m_dynamicIB = new DynamicBuffer(m_d3dDev, DynamicBuffer::IndexBuffer, DynamicIndexBufferSize);
 
-    hr = m_d3dDev->CreateIndexBuffer(
-        lengthIB,
-        0,
-        D3DFMT_INDEX16,
-        D3DPOOL_DEFAULT,
-        &m_floor.ib,
-        nullptr);
-    if (FAILED(hr))
-        throw std::runtime_error("Failed CreateIndexBuffer");
+}
 
-    // 事前に用意した頂点データをコピーする.
-    CopyToBuffer(m_floor.vb, floorVertices, lengthVB);
+// 頂点数に応じたインデックス形式でモデルのバッファを作成します.
+// 16 ビットで参照できない頂点数の場合はサブメッシュに分割します.
+void App::CreateModel(Model& model, const void* vertices, size_t vertexCount, size_t stride,
+    const uint32_t* indices, size_t indexCount)
+{
+    D3DCAPS9 caps;
+    m_d3dDev->GetDeviceCaps(&caps);
+
+    MeshData mesh;
+    BuildMesh(vertices, vertexCount, stride, indices, indexCount, SplitToIndex16, caps.MaxVertexIndex, mesh);
+    model.vertexCount = int(mesh.GetVertexCount());
+    model.indexCount = int(mesh.GetIndexCount());
+    model.subMeshes = mesh.subMeshes;
+
+    CreateEncodedBuffers(model,
+        mesh.vertices.data(), mesh.GetVertexCount(), stride,
+        mesh.indices.data(), mesh.GetIndexCount(), mesh.index32 ? D3DFMT_INDEX32 : D3DFMT_INDEX16);
+}
 
-    // 事前に用意したインデックスデータをコピーする.
-    CopyToBuffer(m_floor.ib, floorIndices, lengthIB);
+// アーカイブがあれば登録し, 無ければ実行体のディレクトリのファイルを使います.
+// -mesh で指定したモデルのために, 最後にカレントディレクトリ (または絶対パス) も探します.
+void App::MountAssets()
+{
+    const std::string directory = GetExecutionDirectory();
+    const std::string archivePath = directory + "\\" + AssetArchiveFileName;
+    if (m_assets.MountArchive(archivePath.c_str()))
+    {
+        OutputDebugStringA(("Mounted " + archivePath + "\n").c_str());
+    }
+    m_assets.MountDirectory(directory.c_str());
+    m_assets.MountDirectory("");
+}
 
+// ファイルを開き, 起動時の読み込みの集計に加えます.
+bool App::OpenAsset(const char* name, AssetFile& file, MappedFile::AccessHint hint)
+{
+    LARGE_INTEGER freq, begin, end;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&begin);
+    bool result = m_assets.Open(name, file, hint);
+    QueryPerformanceCounter(&end);
+
+    m_fileLoadStats.msec += double(end.QuadPart - begin.QuadPart) * 1000.0 / double(freq.QuadPart);
+    if (result)
+    {
+        ++m_fileLoadStats.count;
+        m_fileLoadStats.archiveCount += file.IsFromArchive() ? 1 : 0;
+        m_fileLoadStats.bytes += file.GetSize();
+    }
+    return result;
+}
+
+// OBJ / PLY ファイルを読み込み, ティーポットの代わりに描画するモデルを作成します.
+// ティーポットと同じ大きさになるよう, 中心を原点へ移して拡大縮小します.
+void App::LoadImportedMesh(const char* fileName)
+{
+    // OBJ は複数のスレッドが別々の位置から読むので, 全体を先読みさせる.
+    AssetFile file;
+    if (!OpenAsset(fileName, file, MappedFile::WillNeed))
+        throw std::runtime_error("Failed LoadMeshFile");
+    MeshImporter::ImportedMesh imported;
+    if (!MeshImporter::LoadMeshFromMemory(fileName, reinterpret_cast<const char*>(file.GetData()), file.GetSize(), 0, imported) ||
+        imported.corners.empty())
+        throw std::runtime_error("Failed LoadMeshFile");
+
+    std::vector<uint8_t> vertexData;
+    std::vector<uint32_t> indices;
+    MeshImporter::WeldVertices(imported, MeshImporter::PositionNormal, vertexData, indices);
+    MyVertexPN* vertices = reinterpret_cast<MyVertexPN*>(vertexData.data());
+    size_t vertexCount = vertexData.size() / sizeof(MyVertexPN);
+
+    XMVECTOR minPos = XMLoadFloat3(&vertices[0].Pos);
+    XMVECTOR maxPos = minPos;
+    for (size_t i = 1; i < vertexCount; ++i)
+    {
+        XMVECTOR pos = XMLoadFloat3(&vertices[i].Pos);
+        minPos = XMVectorMin(minPos, pos);
+        maxPos = XMVectorMax(maxPos, pos);
+    }
+    XMVECTOR center = XMVectorScale(XMVectorAdd(minPos, maxPos), 0.5f);
+    float radius = XMVectorGetX(XMVector3Length(XMVectorSubtract(maxPos, center)));
+    float scale = (radius > 0.0f) ? ImportedMeshRadius / radius : 1.0f;
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        XMVECTOR pos = XMLoadFloat3(&vertices[i].Pos);
+        XMStoreFloat3(&vertices[i].Pos, XMVectorScale(XMVectorSubtract(pos, center), scale));
+    }
+
+    // 法線の無いファイルは, 同じ位置の頂点をまとめてから滑らかな法線を作る.
+    if (imported.normals.empty())
+    {
+        std::vector<uint8_t> welded;
+        vertexCount = GeometryProcessing::WeldVertices(vertices, vertexCount, sizeof(MyVertexPN),
+            indices.data(), indices.size(), ImportedMeshWeldEpsilon, welded);
+        vertexData.swap(welded);
+        vertices = reinterpret_cast<MyVertexPN*>(vertexData.data());
+
+        std::vector<XMFLOAT3> normals(vertexCount);
+        GeometryProcessing::ComputeNormals(vertices, vertexCount, sizeof(MyVertexPN),
+            indices.data(), indices.size(), GeometryProcessing::AngleWeighted, normals.data());
+        for (size_t i = 0; i < vertexCount; ++i)
+        {
+            vertices[i].Normal = normals[i];
+        }
+    }
 
+    CreateModel(m_teapot, vertices, vertexCount, sizeof(MyVertexPN), indices.data(), indices.size());
+    m_teapot.radius = ImportedMeshRadius;
+
+    char buf[160];
+    snprintf(buf, sizeof(buf), "LoadImportedMesh: %u triangles, %u vertices\n",
+        unsigned(indices.size() / 3), unsigned(vertexCount));
+    OutputDebugStringA(buf);
+}
+
+// 頂点/インデックスを圧縮してレジストリへ登録します.
+// レジストリは圧縮したデータだけを保持し, バッファ作成時にロックしたメモリへ直接展開します.
+void App::CreateEncodedBuffers(Model& model, const void* vertices, size_t vertexCount, size_t stride,
+    const void* indices, size_t indexCount, D3DFORMAT indexFormat)
+{
+    const size_t indexSize = (indexFormat == D3DFMT_INDEX32) ? sizeof(uint32_t) : sizeof(uint16_t);
+    std::vector<uint8_t> encodedVB, encodedIB;
+    MeshCodec::EncodeVertices(vertices, vertexCount, stride, encodedVB);
+    MeshCodec::EncodeIndices(indices, indexCount, indexSize, encodedIB);
+
+    char buf[160];
+    snprintf(buf, sizeof(buf), "MeshCodec: vertices %u -> %u bytes, indices %u -> %u bytes\n",
+        unsigned(vertexCount * stride), unsigned(encodedVB.size()),
+        unsigned(indexCount * indexSize), unsigned(encodedIB.size()));
+    OutputDebugStringA(buf);
+
+    HRESULT hr;
+    hr = m_resources->CreateEncodedVertexBuffer(&model.vb, encodedVB.data(), encodedVB.size(), UINT(vertexCount), UINT(stride));
+    if (FAILED(hr))
+        throw std::runtime_error("Failed CreateVertexBuffer");
+    hr = m_resources->CreateEncodedIndexBuffer(&model.ib, encodedIB.data(), encodedIB.size(), UINT(indexCount), indexFormat);
+    if (FAILED(hr))
+        throw std::runtime_error("Failed CreateIndexBuffer");
 }
 
 void App::LoadShader()
 {
     HRESULT hr;
-    std::vector<uint8_t> buf;
 
-    wchar_t fileName[128];
-    const wchar_t* shaderPass[] = {
-        L"Deferred_FirstPass",
-        L"Deferred_LightingPass",
+    char fileName[128];
+    // 光の寄与を低い解像度で計算するパスは, ライティングパスの頂点シェーダーを使う.
+    const struct
+    {
+        const wchar_t* name;
+        bool hasVertexShader;
+    } shaderPass[] = {
+        { L"Deferred_FirstPass", true },
+        { L"Deferred_LightingPass", true },
+        { L"Deferred_LightAccumPass", false },
+        { L"Deferred_UpsamplePass", false },
     };
     const int count = _countof(shaderPass);
     for (int i = 0; i < count; ++i)
     {
-        for (int type = 0; type < 2; ++type)
+        for (int type = shaderPass[i].hasVertexShader ? 0 : 1; type < 2; ++type)
         {
-            const wchar_t* shaderType = type == 0 ? L"VS" : L"PS";
-            wsprintf(fileName, L"%s_%s.cso", shaderPass[i], shaderType);
+            const char* shaderType = type == 0 ? "VS" : "PS";
+            snprintf(fileName, sizeof(fileName), "%ls_%s.cso", shaderPass[i].name, shaderType);
 
-            if (!LoadBinaryFile(fileName, buf))
+            // レジストリが作り直し用に内容を保持するので, 読み込んだメモリから直接渡す.
+            AssetFile file;
+            if (!OpenAsset(fileName, file, MappedFile::Sequential))
                 throw std::runtime_error("Failed load shader file");
 
-            DWORD* code = reinterpret_cast<DWORD*>(buf.data());
-            size_t size = buf.size();
+            const uint8_t* code = file.GetData();
+            size_t size = file.GetSize();
+            // マップの要素はデバイスの作り直し時にレジストリが更新する.
             if (type == 0)
             {
-                IDirect3DVertexShader9* vs;
-                hr = m_d3dDev->CreateVertexShader(code, &vs);
-                if (vs)
-                {
-                    m_mapVS[shaderPass[i]] = vs;
-                }
+                hr = m_resources->CreateVertexShader(&m_mapVS[shaderPass[i].name], code, size);
             }
             else
             {
-                IDirect3DPixelShader9* ps;
-                hr = m_d3dDev->CreatePixelShader(code, &ps);
-                if (ps)
-                {
-                    m_mapPS[shaderPass[i]] = ps;
-                }
+                hr = m_resources->CreatePixelShader(&m_mapPS[shaderPass[i].name], code, size);
             }
             if (FAILED(hr))
                 throw std::runtime_error("Failed CreateVertex/PixelShader");
@@ -575,37 +1310,3 @@ void App::LoadShader()
     }
 }
 
-
-RenderTarget::RenderTarget(IDirect3DDevice9Ex* d3dDev, IDirect3DTexture9* texture)
-    : m_d3dDev(d3dDev), m_texture(texture)
-{
-    if (m_d3dDev)
-    {
-        m_d3dDev->AddRef();
-    }
-    if (m_texture)
-    {
-        m_d3dDev->AddRef();
-    }
-
-    m_texture->GetSurfaceLevel(0, &m_surface);
-}
-RenderTarget::~RenderTarget()
-{
-    if (m_d3dDev)
-    {
-        m_d3dDev->Release();
-    }
-    if (m_surface)
-    {
-        m_surface->Release();
-    }
-    if (m_texture)
-    {
-        m_texture->Release();
-    }
-    m_d3dDev = nullptr;
-    m_texture = nullptr;
-    m_surface = nullptr;
-}
-
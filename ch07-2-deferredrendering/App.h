@@ -4,24 +4,30 @@
 #include <DirectXMath.h>
 #include <DirectXPackedVector.h>
 
+#include <atomic>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
+#include "AssetFileSystem.h"
+#include "CaptureQueue.h"
+#include "DeferredScene.h"
+#include "DeviceRenderTargetAllocator.h"
+#include "DeviceResourceRegistry.h"
+#include "DynamicBuffer.h"
+#include "FramePacer.h"
+#include "FrameCapture.h"
+#include "RenderTargetPool.h"
+#include "FrameGraph.h"
+#include "GpuFrameTimer.h"
+#include "LightingReference.h"
+#include "MeshSimplifier.h"
+#include "Meshlet.h"
+#include "MeshBuilder.h"
+#include "NullDevice.h"
+#include "ResolutionController.h"
+#include "TraceDevice.h"
 
-class RenderTarget
-{
-public:
-    RenderTarget(IDirect3DDevice9Ex* d3dDev, IDirect3DTexture9* texture);
-    ~RenderTarget();
-
-    IDirect3DSurface9* GetTargetSurface() { return m_surface; }
-    IDirect3DTexture9* GetTexture() { return m_texture; }
-
-private:
-    IDirect3DTexture9 * m_texture;
-    IDirect3DSurface9 * m_surface;
-    IDirect3DDevice9Ex* m_d3dDev;
-};
 
 class App
 {
@@ -34,12 +40,69 @@ public:
         WindowMode,
         FullScreenMode,
         VirtualFullScreenMode,
+        HeadlessMode,   // ウィンドウを使わずヌルデバイスで動作 (計測用).
+    };
+
+    // 表示の遅延に関する設定.
+    struct PresentSettings
+    {
+        bool vsync;             // false なら垂直同期を待たない (D3DPRESENT_INTERVAL_IMMEDIATE).
+        UINT maxFrameLatency;   // 先行して積めるフレームの数. 0 ならドライバーの既定 (3).
+        UINT backBufferCount;
+        bool frameLimiter;      // 次の表示の締め切りの直前まで, フレームの開始を遅らせる.
     };
 
     bool Initialize(HWND hWnd, int width, int height, ScreenMode mode);
     void Render();
     void Terminate();
 
+    // Initialize() の前に呼び出します. 既定は垂直同期あり, ドライバーの既定の遅延, バックバッファ 2 枚です.
+    void SetPresentSettings(const PresentSettings& settings);
+    // 入力を読む前に呼び出します. frameLimiter なら次の表示に間に合う最も遅い時刻まで眠ります.
+    void WaitForNextFrame();
+    std::string GetPacingReport() const;
+
+    // Initialize() の前に呼び出すと, GPU のフレーム時間が budgetMsec に収まるよう G-Buffer の描画解像度を下げます.
+    // budgetMsec が 0 以下なら垂直同期の間隔を予算にします.
+    void SetDynamicResolution(bool enabled, double budgetMsec);
+    std::string GetResolutionReport() const;
+
+    // Initialize() の前に呼び出すと, 光の寄与を縦横 1/factor (2 か 4) の解像度で計算し,
+    // G-Buffer の法線と位置を見て補間してから元の解像度でアルベドを掛けます. 1 なら全ての画素で計算します.
+    void SetLightingResolution(int factor);
+
+    // デバイスが取り外された, または応答しなくなったことにします (復帰処理の動作確認用).
+    void SimulateDeviceLost();
+    // デバイスを作り直す必要があれば true を返します. その間 Render() は何も描画しません.
+    // どのスレッドから呼んでも構いません.
+    bool IsDeviceLost() const { return m_deviceLost.load(); }
+    // デバイスを作り直し, 登録済みのリソースを元データから再作成します. 失敗すれば false を返すので, 後で再試行してください.
+    // Render() を呼ぶスレッドを止めてから, Initialize() を呼んだスレッドで呼び出してください.
+    // (D3D9 はデバイスの作成中にウィンドウのスレッドへメッセージを送るため)
+    bool RecoverDevice();
+
+    // Initialize() の後に呼び出すと, 次のフレームから camera の視点で描画します.
+    void SetCamera(const DeferredScene::Camera& camera);
+
+    // Initialize() の前に呼び出すと, ティーポットの代わりに OBJ / PLY ファイルのモデルを描画します.
+    void SetMeshFile(const std::string& fileName);
+
+    // HeadlessMode の場合のみ有効です.
+    NullDevice* GetNullDevice();
+    // デバイスの作り直しで再作成するリソースの登録. 復帰処理の確認用です.
+    const DeviceResourceRegistry* GetResourceRegistry() const { return m_resources; }
+
+    // Initialize() の前に呼び出すと, デバイスの呼び出しを記録して Terminate() でファイルに保存します.
+    // デバイスを作り直した場合は, その時点までを保存して記録をやめます.
+    void SetTraceFile(const std::string& fileName);
+
+    // 次のフレームの画面を実行体のディレクトリに PNG で保存します. includeGBuffer なら G-Buffer も DDS で保存します.
+    // 読み戻しと書き出しは数フレーム後に別スレッドで行うため, 描画は止まりません.
+    void RequestCapture(bool includeGBuffer);
+    // 計測用. frames フレームごとに画面を読み戻して PNG に符号化します (ファイルには書き出しません).
+    void SetCaptureInterval(int frames);
+    std::string GetCaptureReport() const;
+
 private:
     template<class T>
     void SafeRelease(T*& v)
@@ -57,14 +120,47 @@ private:
 
         int indexCount;
         int vertexCount;
+
+        // 詳細度 (LOD) ごとのインデックスの範囲. 空なら indexCount 全体を描画する.
+        std::vector<MeshSimplifier::LodLevel> lods;
+        float radius;   // モデル原点からの境界球の半径.
+
+        // LOD 0 をクラスタ単位でカリングする場合に設定する.
+        MeshletCuller meshlets;
+
+        // 16 ビットインデックスに収まるよう分割した場合の描画範囲.
+        std::vector<SubMesh> subMeshes;
     };
 
+    HRESULT CreateDevice();
+    void SetupViewport(int width, int height);
+    void ReleaseDeviceObjects();
+    void StopTrace();
+
     void SetupBuffers();
+    void CreateModel(Model& model, const void* vertices, size_t vertexCount, size_t stride,
+        const uint32_t* indices, size_t indexCount);
+    void LoadImportedMesh(const char* fileName);
+    void CreateEncodedBuffers(Model& model, const void* vertices, size_t vertexCount, size_t stride,
+        const void* indices, size_t indexCount, D3DFORMAT indexFormat);
     void SetupGBuffers(int width, int height);
     void SetupVertexDeclarations();
     void LoadShader();
+    void MountAssets();
+    bool OpenAsset(const char* name, AssetFile& file, MappedFile::AccessHint hint);
 
+    void UpdateRenderScale(double cpuFrameSec);
+    void DrawGBufferPass();
+    void CaptureGBuffer(FrameGraph& graph, FrameGraph::Handle worldPos, FrameGraph::Handle worldNormal, FrameGraph::Handle diffuse);
+    std::string GetCaptureFileName(const char* suffix) const;
+    void DrawLightingPass(IDirect3DTexture9* texWorldPos, IDirect3DTexture9* texWorldNormal, IDirect3DTexture9* texDiffuse);
+    void DrawLightAccumPass(IDirect3DTexture9* texWorldPos, IDirect3DTexture9* texWorldNormal);
+    void DrawUpsamplePass(IDirect3DTexture9* texWorldPos, IDirect3DTexture9* texWorldNormal, IDirect3DTexture9* texDiffuse,
+        IDirect3DTexture9* texLight);
+    void SetLightingConstants();
+    void DrawFullScreenQuad();
     void DrawModel(const Model& model, const DirectX::XMFLOAT4X4& world, const DirectX::XMFLOAT4& color);
+    int SelectLod(const Model& model, const DirectX::XMFLOAT4X4& world) const;
 
     struct MyVertex
     {
@@ -80,21 +176,86 @@ private:
     IDirect3D9Ex*   m_d3d9;
     IDirect3DDevice9Ex* m_d3dDev;
     D3DPRESENT_PARAMETERS m_d3dpp;
+    HWND m_hWnd;
+    ScreenMode m_screenMode;
+    std::string m_meshFile;     // 空でなければティーポットの代わりに読み込む.
+    std::string m_traceFile;    // 空でなければデバイスの呼び出しを記録する.
+    TraceDevice* m_traceDevice; // 記録中は m_d3dDev と同じもの (参照は m_d3dDev が持つ).
+
+    // シェーダーやモデルはアーカイブ, 実行体のディレクトリの順に探す.
+    AssetFileSystem m_assets;
+    // 起動時に読み込んだファイルの集計.
+    struct FileLoadStats
+    {
+        int count;
+        int archiveCount;   // そのうちアーカイブから読み込んだ数.
+        uint64_t bytes;
+        double msec;    // ファイルを開いてメモリに割り当てるまで (圧縮したファイルは展開まで) の時間.
+    };
+    FileLoadStats m_fileLoadStats;
+    std::atomic<bool> m_deviceLost;     // 描画スレッドが設定し, RecoverDevice() が解除する.
+
+    PresentSettings m_presentSettings;
+    FramePacer m_pacer;
+    UINT m_displayHeight;           // 走査線の位置から垂直同期の時刻を求めるため.
+    bool m_timerResolutionRaised;   // timeBeginPeriod() を呼んだ.
+
+    // 作り直しに備えて作成パラメータと元データを保持する.
+    DeviceResourceRegistry* m_resources;
 
     IDirect3DVertexDeclaration9* m_DeclarationPT;
     IDirect3DVertexDeclaration9* m_DeclarationPN;
 
+    DeferredScene::Camera m_camera;
     DirectX::XMMATRIX m_mtxView; // ビュー行列.
     DirectX::XMMATRIX m_mtxProj; // プロジェクション行列.
 
-    IDirect3DTexture9* CreateDeferredTarget(int width, int height, D3DFORMAT format);
-    RenderTarget* m_renderWorldPos;
-    RenderTarget* m_renderWorldNormal;
-    RenderTarget* m_renderDiffuse;
+    // G-Buffer はフレームグラフがプールから借りて使う.
+    DeviceRenderTargetAllocator* m_rtAllocator;
+    RenderTargetPool* m_rtPool;
+    FrameGraph* m_frameGraph;
+    RenderTargetDesc m_descWorldPos;
+    RenderTargetDesc m_descWorldNormal;
+    RenderTargetDesc m_descDiffuse;
+
+    // 光の寄与を低い解像度で計算する場合の設定と, その結果 (アルベドを掛ける前) を書き込むターゲット.
+    int m_lightingFactor;
+    LightingReference::UpsampleParams m_upsampleParams;
+    RenderTargetDesc m_descLightAccum;
+
+    // 動的解像度. G-Buffer は画面の大きさで確保し, その左上の m_renderWidth x m_renderHeight だけに描く.
+    // ライティングのパスが画面の大きさに引き延ばす.
+    bool m_dynamicResolution;
+    double m_resolutionBudgetMsec;
+    ResolutionController m_resolution;
+    GpuFrameTimer* m_gpuTimer;
+    double m_renderScale;   // このフレームの倍率.
+    int m_renderWidth;
+    int m_renderHeight;
 
     std::unordered_map<std::wstring, IDirect3DVertexShader9*> m_mapVS;
     std::unordered_map<std::wstring, IDirect3DPixelShader9*> m_mapPS;
 
+    // 毎フレーム書き換える頂点データ用 (フルスクリーン矩形など).
+    DynamicBuffer* m_dynamicVB;
+    // カリングで残ったクラスタのインデックス用.
+    DynamicBuffer* m_dynamicIB;
+    std::vector<uint32_t> m_visibleMeshlets;
+    MeshletCuller::Stats m_meshletStats;
+
+    // 画面の保存. キューはデバイスを作り直しても残す.
+    enum CaptureRequest
+    {
+        CaptureScreen = 1 << 0,
+        CaptureGBufferTargets = 1 << 1,
+    };
+    CaptureQueue* m_captureQueue;
+    FrameCapture* m_frameCapture;
+    int m_captureRequest;   // 次のフレームで保存するもの (CaptureRequest の組み合わせ).
+    int m_captureInterval;  // 0 より大きければ計測用に一定間隔で保存する.
+    int m_captureIndex;     // 保存するファイルの番号.
+    int m_frameIndex;
+
     Model m_teapot;
     Model m_floor;
 };
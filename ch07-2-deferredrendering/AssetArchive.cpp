@@ -0,0 +1,439 @@
+﻿#include "AssetArchive.h"
+#include "Lz4Codec.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+const uint32_t ArchiveMagic = 'A' | ('P' << 8) | ('A' << 16) | ('K' << 24);
+const uint32_t ArchiveVersion = 1;
+const uint32_t BlockSize = 64 * 1024;
+const uint32_t MaxBlockSize = 16 * 1024 * 1024;
+const uint32_t MaxBucketBits = 16;
+const uint32_t StoredBlockFlag = 0x80000000u;
+// 圧縮しないファイルを置く境界. メモリに割り当てたときのページの大きさ.
+const uint64_t PageSize = 4096;
+// 1 つのスレッドで展開するブロックの最小数. これより少なければスレッドを作らない.
+const size_t MinBlocksPerThread = 4;
+
+char NormalizeChar(char c)
+{
+    if (c == '\\')
+    {
+        return '/';
+    }
+    if (c >= 'A' && c <= 'Z')
+    {
+        return char(c - 'A' + 'a');
+    }
+    return c;
+}
+
+// 格納している名前 (そろえたもの) と name が同じか.
+bool NameEquals(const char* stored, size_t length, const char* name)
+{
+    for (size_t i = 0; i < length; ++i)
+    {
+        if (name[i] == '\0' || stored[i] != NormalizeChar(name[i]))
+        {
+            return false;
+        }
+    }
+    return name[length] == '\0';
+}
+
+uint32_t GetBucket(uint64_t hash, uint32_t bucketBits)
+{
+    return bucketBits == 0 ? 0 : uint32_t(hash >> (64 - bucketBits));
+}
+
+uint32_t GetBlockCount(uint64_t size, uint32_t blockSize)
+{
+    return uint32_t((size + blockSize - 1) / blockSize);
+}
+
+void WritePadding(std::ofstream& outfile, uint64_t& position, uint64_t alignment)
+{
+    static const char zeros[PageSize] = {};
+    const uint64_t padding = (alignment - position % alignment) % alignment;
+    outfile.write(zeros, std::streamsize(padding));
+    position += padding;
+}
+
+// data を BlockSize ごとに圧縮し, 続けて stored へ書き込む. blocks には各ブロックのブロック表の値を入れる.
+void CompressBlocks(const std::vector<uint8_t>& data, int threadCount,
+    std::vector<uint8_t>& stored, std::vector<uint32_t>& blocks)
+{
+    const uint32_t blockCount = GetBlockCount(data.size(), BlockSize);
+    std::vector<std::vector<uint8_t>> compressed(blockCount);
+    ParallelRange(blockCount, threadCount, 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const size_t offset = i * BlockSize;
+            const size_t size = std::min<size_t>(BlockSize, data.size() - offset);
+            std::vector<uint8_t>& block = compressed[i];
+            block.resize(Lz4Codec::GetMaxCompressedSize(size));
+            block.resize(Lz4Codec::Compress(data.data() + offset, size, block.data()));
+            if (block.size() >= size)
+            {
+                block.assign(data.data() + offset, data.data() + offset + size);
+            }
+        }
+    });
+
+    stored.clear();
+    blocks.clear();
+    for (uint32_t i = 0; i < blockCount; ++i)
+    {
+        const size_t size = std::min<size_t>(BlockSize, data.size() - size_t(i) * BlockSize);
+        const bool isStored = compressed[i].size() == size;
+        blocks.push_back(uint32_t(compressed[i].size()) | (isStored ? StoredBlockFlag : 0));
+        stored.insert(stored.end(), compressed[i].begin(), compressed[i].end());
+    }
+}
+}
+
+uint64_t AssetArchive::HashName(const char* name)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (const char* p = name; *p != '\0'; ++p)
+    {
+        hash ^= uint8_t(NormalizeChar(*p));
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::string AssetArchive::NormalizeName(const char* name)
+{
+    std::string result(name);
+    for (auto& c : result)
+    {
+        c = NormalizeChar(c);
+    }
+    return result;
+}
+
+AssetArchive::AssetArchive()
+    : m_header(), m_entries(nullptr), m_buckets(nullptr), m_blocks(nullptr), m_names(nullptr), m_namesSize(0)
+{
+}
+
+bool AssetArchive::Open(const char* fileName)
+{
+    Close();
+    if (!m_file.Open(fileName) || m_file.GetSize() < sizeof(Header))
+    {
+        Close();
+        return false;
+    }
+    memcpy(&m_header, m_file.GetData(), sizeof(Header));
+
+    const uint64_t fileSize = m_file.GetSize();
+    const Header& header = m_header;
+    if (header.magic != ArchiveMagic || header.version != ArchiveVersion ||
+        header.blockSize == 0 || header.blockSize > MaxBlockSize || header.bucketBits > MaxBucketBits ||
+        header.indexOffset < sizeof(Header) || header.indexOffset % 8 != 0 ||
+        header.indexOffset > fileSize || header.indexSize > fileSize - header.indexOffset)
+    {
+        Close();
+        return false;
+    }
+    const uint64_t entriesBytes = uint64_t(header.entryCount) * sizeof(Entry);
+    const uint64_t bucketsBytes = ((uint64_t(1) << header.bucketBits) + 1) * sizeof(uint32_t);
+    const uint64_t blocksBytes = uint64_t(header.blockCount) * sizeof(uint32_t);
+    if (entriesBytes + bucketsBytes + blocksBytes > header.indexSize)
+    {
+        Close();
+        return false;
+    }
+
+    const uint8_t* index = m_file.GetData() + header.indexOffset;
+    m_entries = reinterpret_cast<const Entry*>(index);
+    m_buckets = reinterpret_cast<const uint32_t*>(index + entriesBytes);
+    m_blocks = reinterpret_cast<const uint32_t*>(index + entriesBytes + bucketsBytes);
+    m_names = reinterpret_cast<const char*>(index + entriesBytes + bucketsBytes + blocksBytes);
+    m_namesSize = size_t(header.indexSize - entriesBytes - bucketsBytes - blocksBytes);
+    if (!Validate())
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void AssetArchive::Close()
+{
+    m_file.Close();
+    m_header = Header();
+    m_entries = nullptr;
+    m_buckets = nullptr;
+    m_blocks = nullptr;
+    m_names = nullptr;
+    m_namesSize = 0;
+}
+
+// 索引の範囲を確かめておき, 以降の読み込みでは範囲の確認を省きます.
+bool AssetArchive::Validate() const
+{
+    const uint32_t bucketCount = uint32_t(1) << m_header.bucketBits;
+    if (m_buckets[0] != 0 || m_buckets[bucketCount] != m_header.entryCount)
+    {
+        return false;
+    }
+    for (uint32_t b = 0; b < bucketCount; ++b)
+    {
+        if (m_buckets[b] > m_buckets[b + 1])
+        {
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < m_header.entryCount; ++i)
+    {
+        const Entry& entry = m_entries[i];
+        const uint32_t bucket = GetBucket(entry.hash, m_header.bucketBits);
+        if (i < m_buckets[bucket] || i >= m_buckets[bucket + 1])
+        {
+            return false;
+        }
+        if (entry.nameOffset > m_namesSize || entry.nameLength > m_namesSize - entry.nameOffset)
+        {
+            return false;
+        }
+        if (entry.offset > m_header.indexOffset || entry.storedSize > m_header.indexOffset - entry.offset)
+        {
+            return false;
+        }
+        if (entry.blockCount == 0)
+        {
+            if (entry.storedSize != entry.size)
+            {
+                return false;
+            }
+            continue;
+        }
+        // 最後のブロックだけが blockSize より小さい.
+        if (entry.size <= uint64_t(entry.blockCount - 1) * m_header.blockSize ||
+            entry.size > uint64_t(entry.blockCount) * m_header.blockSize ||
+            uint64_t(entry.firstBlock) + entry.blockCount > m_header.blockCount)
+        {
+            return false;
+        }
+        uint64_t storedSize = 0;
+        for (uint32_t block = 0; block < entry.blockCount; ++block)
+        {
+            storedSize += m_blocks[entry.firstBlock + block] & ~StoredBlockFlag;
+        }
+        if (storedSize != entry.storedSize)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+const AssetArchive::Entry* AssetArchive::Find(const char* name) const
+{
+    if (!IsOpen())
+    {
+        return nullptr;
+    }
+    const uint64_t hash = HashName(name);
+    const uint32_t bucket = GetBucket(hash, m_header.bucketBits);
+    for (uint32_t i = m_buckets[bucket]; i < m_buckets[bucket + 1]; ++i)
+    {
+        const Entry& entry = m_entries[i];
+        if (entry.hash == hash && NameEquals(m_names + entry.nameOffset, entry.nameLength, name))
+        {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+const uint8_t* AssetArchive::GetView(const Entry& entry) const
+{
+    if (entry.blockCount != 0)
+    {
+        return nullptr;
+    }
+    return m_file.GetData() + entry.offset;
+}
+
+bool AssetArchive::Read(const Entry& entry, uint8_t* dst, int threadCount) const
+{
+    if (entry.blockCount == 0)
+    {
+        if (entry.size > 0)
+        {
+            memcpy(dst, GetView(entry), size_t(entry.size));
+        }
+        return true;
+    }
+
+    // 各ブロックの位置を先に求めておき, ブロックごとに別々に展開する.
+    std::vector<uint64_t> offsets(entry.blockCount);
+    uint64_t offset = entry.offset;
+    for (uint32_t block = 0; block < entry.blockCount; ++block)
+    {
+        offsets[block] = offset;
+        offset += m_blocks[entry.firstBlock + block] & ~StoredBlockFlag;
+    }
+    std::atomic<bool> failed(false);
+    ParallelRange(entry.blockCount, threadCount, MinBlocksPerThread, [&](size_t begin, size_t end) {
+        for (size_t block = begin; block < end && !failed; ++block)
+        {
+            if (!ReadBlock(entry, uint32_t(block), offsets[block], dst + block * m_header.blockSize))
+            {
+                failed = true;
+            }
+        }
+    });
+    return !failed;
+}
+
+bool AssetArchive::ReadBlock(const Entry& entry, uint32_t block, uint64_t offset, uint8_t* dst) const
+{
+    const uint32_t value = m_blocks[entry.firstBlock + block];
+    const size_t storedSize = value & ~StoredBlockFlag;
+    const size_t size = size_t(std::min<uint64_t>(m_header.blockSize, entry.size - uint64_t(block) * m_header.blockSize));
+    const uint8_t* src = m_file.GetData() + offset;
+    if (value & StoredBlockFlag)
+    {
+        if (storedSize != size)
+        {
+            return false;
+        }
+        memcpy(dst, src, size);
+        return true;
+    }
+    return Lz4Codec::Decompress(src, storedSize, dst, size);
+}
+
+std::string AssetArchive::GetName(const Entry& entry) const
+{
+    return std::string(m_names + entry.nameOffset, entry.nameLength);
+}
+
+bool AssetArchiveWriter::AddFile(const char* name, const void* data, size_t size, bool compress)
+{
+    Source source;
+    source.name = AssetArchive::NormalizeName(name);
+    source.hash = AssetArchive::HashName(name);
+    if (source.name.empty())
+    {
+        return false;
+    }
+    for (const auto& other : m_sources)
+    {
+        if (other.hash == source.hash && other.name == source.name)
+        {
+            return false;
+        }
+    }
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    source.data.assign(bytes, bytes + size);
+    source.compress = compress;
+    m_sources.push_back(std::move(source));
+    return true;
+}
+
+bool AssetArchiveWriter::Write(const char* fileName, int threadCount)
+{
+    std::sort(m_sources.begin(), m_sources.end(), [](const Source& a, const Source& b) {
+        return a.hash != b.hash ? a.hash < b.hash : a.name < b.name;
+    });
+
+    std::ofstream outfile(fileName, std::ofstream::binary);
+    if (!outfile)
+    {
+        return false;
+    }
+    AssetArchive::Header header = {};
+    header.magic = ArchiveMagic;
+    header.version = ArchiveVersion;
+    header.entryCount = uint32_t(m_sources.size());
+    header.blockSize = BlockSize;
+    while ((size_t(1) << header.bucketBits) < m_sources.size() && header.bucketBits < MaxBucketBits)
+    {
+        ++header.bucketBits;
+    }
+    outfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    uint64_t position = sizeof(header);
+
+    std::vector<AssetArchive::Entry> entries;
+    std::vector<uint32_t> blocks;
+    std::string names;
+    std::vector<uint8_t> stored;
+    std::vector<uint32_t> entryBlocks;
+    for (const auto& source : m_sources)
+    {
+        AssetArchive::Entry entry = {};
+        entry.hash = source.hash;
+        entry.size = source.data.size();
+        entry.nameOffset = uint32_t(names.size());
+        entry.nameLength = uint32_t(source.name.size());
+        names += source.name;
+
+        bool compressed = false;
+        if (source.compress && !source.data.empty())
+        {
+            CompressBlocks(source.data, threadCount, stored, entryBlocks);
+            compressed = stored.size() <= source.data.size() - source.data.size() / 8;
+        }
+        if (compressed)
+        {
+            entry.firstBlock = uint32_t(blocks.size());
+            entry.blockCount = uint32_t(entryBlocks.size());
+            entry.storedSize = stored.size();
+            blocks.insert(blocks.end(), entryBlocks.begin(), entryBlocks.end());
+            entry.offset = position;
+            outfile.write(reinterpret_cast<const char*>(stored.data()), stored.size());
+        }
+        else
+        {
+            if (!source.data.empty())
+            {
+                WritePadding(outfile, position, PageSize);
+            }
+            entry.storedSize = entry.size;
+            entry.offset = position;
+            outfile.write(reinterpret_cast<const char*>(source.data.data()), source.data.size());
+        }
+        position += entry.storedSize;
+        entries.push_back(entry);
+    }
+
+    WritePadding(outfile, position, 8);
+    header.blockCount = uint32_t(blocks.size());
+    header.indexOffset = position;
+
+    // バケットには, そのバケット以降に入る最初のエントリの番号を入れる.
+    const uint32_t bucketCount = uint32_t(1) << header.bucketBits;
+    std::vector<uint32_t> buckets(bucketCount + 1);
+    uint32_t index = 0;
+    for (uint32_t b = 0; b <= bucketCount; ++b)
+    {
+        while (index < entries.size() && GetBucket(entries[index].hash, header.bucketBits) < b)
+        {
+            ++index;
+        }
+        buckets[b] = index;
+    }
+    buckets[bucketCount] = uint32_t(entries.size());
+
+    outfile.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(entries[0]));
+    outfile.write(reinterpret_cast<const char*>(buckets.data()), buckets.size() * sizeof(buckets[0]));
+    outfile.write(reinterpret_cast<const char*>(blocks.data()), blocks.size() * sizeof(blocks[0]));
+    outfile.write(names.data(), names.size());
+    header.indexSize = entries.size() * sizeof(entries[0]) + buckets.size() * sizeof(buckets[0]) +
+        blocks.size() * sizeof(blocks[0]) + names.size();
+
+    outfile.seekp(0, std::ofstream::beg);
+    outfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    return bool(outfile);
+}
@@ -0,0 +1,112 @@
+﻿#pragma once
+#include "MappedFile.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 複数のファイルを 1 つにまとめたアーカイブ. D3D には依存しません.
+//
+// ファイルの構成は次の通りです. 数値はリトルエンディアンです.
+//   Header, 各ファイルの内容, 索引 (Entry の配列, バケット, ブロック表, 名前).
+//
+// Entry は名前のハッシュ順に並んでいます. ハッシュの上位 bucketBits ビットをバケットの番号とし,
+// バケットにはそのバケットに入る最初の Entry の番号を入れておきます.
+// 探すときは 1 つのバケットの範囲だけを調べるので, ファイル数によらずほぼ一定の手間で見つかります.
+//
+// 圧縮するファイルは 64 KB ごとのブロックに分けて Lz4Codec で圧縮します.
+// ブロック表には各ブロックの圧縮後の大きさを入れ, ブロックごとに別々のスレッドで展開できます.
+// 圧縮しても小さくならなかったブロックは, 最上位ビットを立ててそのまま置きます.
+// 圧縮しないファイルはページの境界にそろえて置き, アーカイブを割り当てたメモリをそのまま参照します.
+//
+// 名前は '/' 区切りの相対パスで, 大文字小文字と区切り文字 ('\\' と '/') は区別しません.
+class AssetArchive
+{
+public:
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t entryCount;
+        uint32_t blockCount;    // ブロック表の要素数.
+        uint32_t blockSize;     // 圧縮する単位 (最後のブロック以外の展開後の大きさ).
+        uint32_t bucketBits;
+        uint64_t indexOffset;
+        uint64_t indexSize;
+    };
+    struct Entry
+    {
+        uint64_t hash;
+        uint64_t offset;        // 内容の先頭のファイル内の位置.
+        uint64_t size;          // 展開後の大きさ.
+        uint64_t storedSize;    // アーカイブ内の大きさ.
+        uint32_t firstBlock;
+        uint32_t blockCount;    // 0 なら圧縮していない.
+        uint32_t nameOffset;
+        uint32_t nameLength;
+    };
+
+    // 区切り文字と大文字小文字をそろえた名前のハッシュ (FNV-1a).
+    static uint64_t HashName(const char* name);
+    // 区切り文字を '/' に, 英字を小文字にそろえます.
+    static std::string NormalizeName(const char* name);
+
+    AssetArchive();
+    bool Open(const char* fileName);
+    void Close();
+    bool IsOpen() const { return m_file.IsOpen(); }
+
+    // 見つからなければ nullptr を返します.
+    const Entry* Find(const char* name) const;
+
+    // 圧縮していなければ, 割り当てたメモリ上の内容を返します. 圧縮していれば nullptr を返します.
+    const uint8_t* GetView(const Entry& entry) const;
+    // 内容を dst (entry.size バイト) へ展開します. 圧縮したブロックは threadCount 個のスレッドで展開します.
+    // threadCount が 0 以下ならハードウェアのスレッド数を使います. 内容が壊れていれば false を返します.
+    bool Read(const Entry& entry, uint8_t* dst, int threadCount = 0) const;
+
+    size_t GetEntryCount() const { return m_header.entryCount; }
+    const Entry& GetEntry(size_t index) const { return m_entries[index]; }
+    std::string GetName(const Entry& entry) const;
+
+private:
+    AssetArchive(const AssetArchive&);
+    AssetArchive& operator=(const AssetArchive&);
+
+    bool Validate() const;
+    bool ReadBlock(const Entry& entry, uint32_t block, uint64_t offset, uint8_t* dst) const;
+
+    MappedFile m_file;
+    Header m_header;
+    const Entry* m_entries;
+    const uint32_t* m_buckets;
+    const uint32_t* m_blocks;
+    const char* m_names;
+    size_t m_namesSize;
+};
+
+// アーカイブを作るクラス. 追加したファイルの内容は Write() までコピーして保持します.
+class AssetArchiveWriter
+{
+public:
+    AssetArchiveWriter() {}
+
+    // 同じ名前のファイルが既にあれば false を返します.
+    // compress が true でも, 圧縮して 1/8 以上小さくならなければ圧縮せずに置きます.
+    bool AddFile(const char* name, const void* data, size_t size, bool compress);
+    // ブロックの圧縮は threadCount 個のスレッドで行います.
+    bool Write(const char* fileName, int threadCount = 0);
+
+    size_t GetCount() const { return m_sources.size(); }
+
+private:
+    struct Source
+    {
+        std::string name;
+        uint64_t hash;
+        std::vector<uint8_t> data;
+        bool compress;
+    };
+
+    std::vector<Source> m_sources;
+};
@@ -0,0 +1,105 @@
+﻿#include "AssetFileSystem.h"
+
+AssetFile::AssetFile()
+    : m_data(nullptr), m_size(0), m_isOpen(false), m_isFromArchive(false)
+{
+}
+
+void AssetFile::Close()
+{
+    m_mapped.Close();
+    std::vector<uint8_t>().swap(m_buffer);
+    m_data = nullptr;
+    m_size = 0;
+    m_isOpen = false;
+    m_isFromArchive = false;
+}
+
+AssetFileSystem::AssetFileSystem()
+    : m_threadCount(0)
+{
+}
+
+AssetFileSystem::~AssetFileSystem()
+{
+    UnmountAll();
+}
+
+bool AssetFileSystem::MountArchive(const char* fileName)
+{
+    AssetArchive* archive = new AssetArchive();
+    if (!archive->Open(fileName))
+    {
+        delete archive;
+        return false;
+    }
+    Mount mount;
+    mount.archive = archive;
+    m_mounts.push_back(mount);
+    return true;
+}
+
+void AssetFileSystem::MountDirectory(const char* path)
+{
+    Mount mount;
+    mount.archive = nullptr;
+    mount.directory = path;
+    // Windows でも '/' を区切りとして使える.
+    if (!mount.directory.empty() && mount.directory.back() != '/' && mount.directory.back() != '\\')
+    {
+        mount.directory += '/';
+    }
+    m_mounts.push_back(mount);
+}
+
+void AssetFileSystem::UnmountAll()
+{
+    for (auto& mount : m_mounts)
+    {
+        delete mount.archive;
+    }
+    m_mounts.clear();
+}
+
+bool AssetFileSystem::Open(const char* name, AssetFile& file, MappedFile::AccessHint hint) const
+{
+    file.Close();
+    for (const auto& mount : m_mounts)
+    {
+        if (!mount.archive)
+        {
+            const std::string path = mount.directory + name;
+            if (!file.m_mapped.Open(path.c_str(), hint))
+            {
+                continue;
+            }
+            file.m_data = file.m_mapped.GetData();
+            file.m_size = file.m_mapped.GetSize();
+            file.m_isOpen = true;
+            return true;
+        }
+
+        const AssetArchive::Entry* entry = mount.archive->Find(name);
+        if (!entry)
+        {
+            continue;
+        }
+        file.m_data = mount.archive->GetView(*entry);
+        if (!file.m_data)
+        {
+            file.m_buffer.resize(size_t(entry->size));
+            if (!mount.archive->Read(*entry, file.m_buffer.data(), m_threadCount))
+            {
+                // 壊れたアーカイブの内容は使わず, 後に登録したものを探す.
+                file.Close();
+                continue;
+            }
+            file.m_data = file.m_buffer.data();
+        }
+        file.m_size = size_t(entry->size);
+        file.m_isOpen = true;
+        file.m_isFromArchive = true;
+        return true;
+    }
+    return false;
+}
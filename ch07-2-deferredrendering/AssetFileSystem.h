@@ -0,0 +1,74 @@
+﻿#pragma once
+#include "AssetArchive.h"
+#include "MappedFile.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// AssetFileSystem::Open() で開いたファイルの内容.
+// アーカイブの圧縮していないファイルやディレクトリのファイルはメモリに割り当てたまま参照し,
+// 圧縮したファイルだけをヒープへ展開します.
+// アーカイブのメモリを参照するため, 開いた AssetFileSystem より先に閉じる必要があります.
+class AssetFile
+{
+public:
+    AssetFile();
+
+    void Close();
+
+    bool IsOpen() const { return m_isOpen; }
+    // 空のファイルでは nullptr.
+    const uint8_t* GetData() const { return m_data; }
+    size_t GetSize() const { return m_size; }
+    // アーカイブから読み込んだか.
+    bool IsFromArchive() const { return m_isFromArchive; }
+
+private:
+    friend class AssetFileSystem;
+
+    AssetFile(const AssetFile&);
+    AssetFile& operator=(const AssetFile&);
+
+    MappedFile m_mapped;
+    std::vector<uint8_t> m_buffer;
+    const uint8_t* m_data;
+    size_t m_size;
+    bool m_isOpen;
+    bool m_isFromArchive;
+};
+
+// アーカイブとディレクトリを重ねて 1 つのファイルシステムとして扱うクラス. D3D には依存しません.
+// ファイルは登録した順にアーカイブやディレクトリを探し, 最初に見つかったものを開きます.
+// 開発中はディレクトリのファイルを, 配布時はアーカイブを使うといった切り替えを読み込む側で意識しなくて済みます.
+class AssetFileSystem
+{
+public:
+    AssetFileSystem();
+    ~AssetFileSystem();
+
+    // 開けなかった場合は false を返し, 登録しません.
+    bool MountArchive(const char* fileName);
+    // 空文字列を指定すると, 名前をそのままパスとして開きます (カレントディレクトリまたは絶対パス).
+    void MountDirectory(const char* path);
+    void UnmountAll();
+
+    // 圧縮したファイルの展開に使うスレッド数. 0 以下ならハードウェアのスレッド数.
+    void SetThreadCount(int threadCount) { m_threadCount = threadCount; }
+
+    // hint はディレクトリのファイルをメモリに割り当てるときに使います.
+    bool Open(const char* name, AssetFile& file, MappedFile::AccessHint hint = MappedFile::Normal) const;
+
+private:
+    AssetFileSystem(const AssetFileSystem&);
+    AssetFileSystem& operator=(const AssetFileSystem&);
+
+    struct Mount
+    {
+        AssetArchive* archive;      // nullptr ならディレクトリ.
+        std::string directory;
+    };
+
+    std::vector<Mount> m_mounts;
+    int m_threadCount;
+};
@@ -0,0 +1,212 @@
+﻿#include "Benchmark.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+// "key": の後ろの位置を返す. 見つからなければ std::string::npos.
+size_t FindValue(const std::string& json, const char* key, size_t begin, size_t end)
+{
+    std::string pattern = std::string("\"") + key + "\"";
+    size_t pos = json.find(pattern, begin);
+    if (pos == std::string::npos || pos >= end)
+    {
+        return std::string::npos;
+    }
+    pos = json.find(':', pos + pattern.size());
+    if (pos == std::string::npos || pos >= end)
+    {
+        return std::string::npos;
+    }
+    return pos + 1;
+}
+
+bool ReadNumber(const std::string& json, const char* key, size_t begin, size_t end, double& value)
+{
+    size_t pos = FindValue(json, key, begin, end);
+    if (pos == std::string::npos)
+    {
+        return false;
+    }
+    char* last = nullptr;
+    value = strtod(json.c_str() + pos, &last);
+    return last != json.c_str() + pos;
+}
+
+bool ReadString(const std::string& json, const char* key, size_t begin, size_t end, std::string& value)
+{
+    size_t pos = FindValue(json, key, begin, end);
+    if (pos == std::string::npos)
+    {
+        return false;
+    }
+    size_t open = json.find('"', pos);
+    size_t close = (open == std::string::npos) ? open : json.find('"', open + 1);
+    if (close == std::string::npos || close >= end)
+    {
+        return false;
+    }
+    value = json.substr(open + 1, close - open - 1);
+    return true;
+}
+}
+
+namespace Benchmark
+{
+Result Run(const std::string& name, int iterations, const std::function<void()>& func, int warmup)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    for (int i = 0; i < warmup; ++i)
+    {
+        func();
+    }
+
+    std::vector<double> samples;
+    samples.reserve(iterations);
+    for (int i = 0; i < iterations; ++i)
+    {
+        Clock::time_point begin = Clock::now();
+        func();
+        Clock::time_point end = Clock::now();
+        samples.push_back(std::chrono::duration<double, std::nano>(end - begin).count());
+    }
+
+    Result result;
+    result.name = name;
+    result.iterations = iterations;
+    result.medianNs = result.minNs = result.maxNs = 0.0;
+    if (!samples.empty())
+    {
+        std::sort(samples.begin(), samples.end());
+        size_t mid = samples.size() / 2;
+        result.medianNs = (samples.size() % 2) ? samples[mid] : (samples[mid - 1] + samples[mid]) * 0.5;
+        result.minNs = samples.front();
+        result.maxNs = samples.back();
+    }
+    return result;
+}
+
+std::string ToJson(const std::vector<Result>& results)
+{
+    std::string json = "{\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const Result& r = results[i];
+        char buf[512];
+        snprintf(buf, sizeof(buf),
+            "    { \"name\": \"%s\", \"iterations\": %d, \"median_ns\": %.1f, \"min_ns\": %.1f, \"max_ns\": %.1f }%s\n",
+            r.name.c_str(), r.iterations, r.medianNs, r.minNs, r.maxNs,
+            (i + 1 < results.size()) ? "," : "");
+        json += buf;
+    }
+    json += "  ]\n}\n";
+    return json;
+}
+
+bool ParseJson(const std::string& json, std::vector<Result>& results)
+{
+    results.clear();
+    size_t pos = json.find("\"benchmarks\"");
+    if (pos == std::string::npos)
+    {
+        return false;
+    }
+    // 1 項目ずつ { ... } の範囲から値を取り出す.
+    while ((pos = json.find('{', pos + 1)) != std::string::npos)
+    {
+        size_t end = json.find('}', pos);
+        if (end == std::string::npos)
+        {
+            return false;
+        }
+        Result r;
+        double iterations = 0.0;
+        if (!ReadString(json, "name", pos, end, r.name) ||
+            !ReadNumber(json, "iterations", pos, end, iterations) ||
+            !ReadNumber(json, "median_ns", pos, end, r.medianNs) ||
+            !ReadNumber(json, "min_ns", pos, end, r.minNs) ||
+            !ReadNumber(json, "max_ns", pos, end, r.maxNs))
+        {
+            return false;
+        }
+        r.iterations = int(iterations);
+        results.push_back(r);
+        pos = end;
+    }
+    return true;
+}
+
+int Compare(const std::vector<Result>& results, const std::vector<Result>& baseline,
+    double threshold, std::string& report)
+{
+    int regressions = 0;
+    report.clear();
+    for (const auto& r : results)
+    {
+        auto base = std::find_if(baseline.begin(), baseline.end(),
+            [&](const Result& b) { return b.name == r.name; });
+
+        char buf[256];
+        if (base == baseline.end() || base->medianNs <= 0.0)
+        {
+            snprintf(buf, sizeof(buf), "%-28s %12.1f ns  (no baseline)\n", r.name.c_str(), r.medianNs);
+        }
+        else
+        {
+            double ratio = r.medianNs / base->medianNs;
+            bool regressed = ratio > 1.0 + threshold;
+            if (regressed)
+            {
+                ++regressions;
+            }
+            snprintf(buf, sizeof(buf), "%-28s %12.1f ns  baseline %12.1f ns  %+6.1f%%%s\n",
+                r.name.c_str(), r.medianNs, base->medianNs, (ratio - 1.0) * 100.0,
+                regressed ? "  REGRESSION" : "");
+        }
+        report += buf;
+    }
+    return regressions;
+}
+
+int WriteAndCompare(const std::vector<Result>& results, const char* outFile, const char* baselineFile,
+    double threshold, std::string& report)
+{
+    report.clear();
+    std::string json = ToJson(results);
+    if (outFile)
+    {
+        std::ofstream outfile(outFile, std::ios::binary);
+        outfile << json;
+    }
+    else
+    {
+        fputs(json.c_str(), stdout);
+    }
+
+    if (!baselineFile)
+    {
+        return 0;
+    }
+    std::ifstream infile(baselineFile, std::ios::binary);
+    std::stringstream ss;
+    ss << infile.rdbuf();
+    std::vector<Result> baseline;
+    if (!infile || !ParseJson(ss.str(), baseline))
+    {
+        report = std::string("Benchmark: failed to read baseline ") + baselineFile + "\n";
+        return -1;
+    }
+
+    int regressions = Compare(results, baseline, threshold, report);
+    char buf[128];
+    snprintf(buf, sizeof(buf), "Benchmark: %d regression(s), threshold %.0f%%\n", regressions, threshold * 100.0);
+    report += buf;
+    return regressions;
+}
+}
@@ -0,0 +1,39 @@
+﻿#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+
+// 処理時間の計測と, 保存した基準値 (ベースライン) との比較を行います.
+// D3D には依存しません.
+//
+// 結果は次の形式の JSON で読み書きします.
+//  { "benchmarks": [ { "name": "...", "iterations": N, "median_ns": ..., "min_ns": ..., "max_ns": ... }, ... ] }
+namespace Benchmark
+{
+    struct Result
+    {
+        std::string name;
+        int iterations;
+        double medianNs;    // 1 回あたりの処理時間の中央値.
+        double minNs;
+        double maxNs;
+    };
+
+    // func を warmup 回実行した後, iterations 回の実行時間を計測します.
+    Result Run(const std::string& name, int iterations, const std::function<void()>& func, int warmup = 3);
+
+    std::string ToJson(const std::vector<Result>& results);
+    // ToJson() で出力した形式のみ解釈します. 解釈できなければ false を返します.
+    bool ParseJson(const std::string& json, std::vector<Result>& results);
+
+    // 中央値がベースラインより threshold (0.1 で 10%) を超えて遅くなった項目の数を返します.
+    // report には各項目の比較結果を書き込みます.
+    int Compare(const std::vector<Result>& results, const std::vector<Result>& baseline,
+        double threshold, std::string& report);
+
+    // results を JSON で outFile (nullptr なら標準出力) へ書き出し, baselineFile が指定されればその値と比較します.
+    // ベースラインより遅くなった項目の数を返し, 読めなかった場合は -1 を返します.
+    // report には比較結果 (またはエラー) を書き込みます.
+    int WriteAndCompare(const std::vector<Result>& results, const char* outFile, const char* baselineFile,
+        double threshold, std::string& report);
+}
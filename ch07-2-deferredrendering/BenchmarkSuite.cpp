@@ -0,0 +1,231 @@
+﻿#include "BenchmarkSuite.h"
+#include "Benchmark.h"
+#include "App.h"
+#include "CaptureQueue.h"
+#include "CpuBenchmarks.h"
+#include "DeferredScene.h"
+#include "DeviceResourceRegistry.h"
+#include "FrameCapture.h"
+#include "ImageWriter.h"
+#include "MappedFile.h"
+#include "NullDevice.h"
+#include "TraceReplayer.h"
+
+#include <Windows.h>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb/stb_image.h"
+
+namespace
+{
+const int ScreenWidth = 1280;
+const int ScreenHeight = 720;
+
+D3DPRESENT_PARAMETERS MakePresentParameters()
+{
+    D3DPRESENT_PARAMETERS pp;
+    ZeroMemory(&pp, sizeof(pp));
+    pp.BackBufferWidth = ScreenWidth;
+    pp.BackBufferHeight = ScreenHeight;
+    pp.BackBufferFormat = D3DFMT_A8R8G8B8;
+    pp.BackBufferCount = 1;
+    pp.SwapEffect = D3DSWAPEFFECT_FLIPEX;
+    pp.Windowed = TRUE;
+    return pp;
+}
+
+// ティーポットの頂点/インデックスバッファの作成と転送.
+Benchmark::Result BenchTeapotBuffers(NullDevice* device)
+{
+    size_t lengthVB, strideVB, lengthIB;
+    const void* vertices = DeferredScene::GetTeapotVertices(lengthVB, strideVB);
+    const uint16_t* indices = DeferredScene::GetTeapotIndices(lengthIB);
+
+    IDirect3DVertexBuffer9* vb = nullptr;
+    IDirect3DIndexBuffer9* ib = nullptr;
+    DeviceResourceRegistry registry(device);
+    return Benchmark::Run("teapot_buffers", 200, [&]() {
+        registry.CreateVertexBuffer(&vb, vertices, UINT(lengthVB));
+        registry.CreateIndexBuffer(&ib, indices, UINT(lengthIB), D3DFMT_INDEX16);
+        registry.Clear();
+    });
+}
+
+// 画面の保存を毎フレーム指示した場合の描画スレッドの負荷.
+// ヌルデバイスの読み戻しは内容が空なので, PNG の符号化は CpuBenchmarks で合成した画像を使って計測する.
+void BenchFrameCapture(NullDevice* device, std::vector<Benchmark::Result>& results)
+{
+    const int width = 1280;
+    const int height = 720;
+    IDirect3DSurface9* target = nullptr;
+    if (FAILED(device->CreateRenderTarget(width, height, D3DFMT_A8R8G8B8, D3DMULTISAMPLE_NONE, 0, FALSE, &target, nullptr)))
+    {
+        return;
+    }
+    std::string report;
+    {
+        CaptureQueue queue(0, 4);
+        FrameCapture capture(&queue, 2, 4);
+        capture.SetDevice(device);
+        results.push_back(Benchmark::Run("frame_capture_render_thread_720p", 100, [&]() {
+            capture.Capture(target, "", CaptureQueue::Png);
+            capture.EndFrame();
+        }));
+        queue.Flush();
+        report = capture.Report() + queue.Report();
+    }
+    target->Release();
+    OutputDebugStringA(report.c_str());
+    fputs(report.c_str(), stderr);
+}
+
+// CreateTextureFromFile と同じ, stb_image による PNG の展開と,
+// RGBA -> A8R8G8B8 の入れ替えをしながらのステージングテクスチャへの書き込み.
+// このサンプルは画像ファイルを持たないため, 合成した画像を ImageWriter で PNG にしたものを使う.
+Benchmark::Result BenchTextureLoad(NullDevice* device)
+{
+    const int width = 256, height = 256;
+    std::vector<uint8_t> image(width * height * 4);
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            uint8_t* p = &image[(y * width + x) * 4];
+            p[0] = uint8_t(x);
+            p[1] = uint8_t(y);
+            p[2] = uint8_t((x * y) >> 6);
+            p[3] = uint8_t(255 - ((x ^ y) & 0x3f));
+        }
+    }
+    std::vector<uint8_t> png;
+    ImageWriter::EncodePng(image.data(), width * 4, width, height, false, png);
+
+    IDirect3DTexture9* staging = nullptr;
+    device->CreateTexture(width, height, 1, 0, D3DFMT_A8R8G8B8, D3DPOOL_SYSTEMMEM, &staging, nullptr);
+    Benchmark::Result result = Benchmark::Run("texture_load_png_256", 200, [&]() {
+        int loadWidth = 0, loadHeight = 0, component = 0;
+        uint8_t* pLoad = stbi_load_from_memory(png.data(), int(png.size()), &loadWidth, &loadHeight, &component, 4);
+        if (!pLoad)
+        {
+            return;
+        }
+        D3DLOCKED_RECT locked;
+        if (SUCCEEDED(staging->LockRect(0, &locked, nullptr, 0)))
+        {
+            const int lineBytes = loadWidth * sizeof(uint32_t);
+            for (int y = 0; y < loadHeight; ++y)
+            {
+                const uint8_t* src = &pLoad[y * lineBytes];
+                uint32_t* dst = reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(locked.pBits) + y * locked.Pitch);
+                for (int x = 0; x < loadWidth; ++x)
+                {
+                    const uint8_t* p = &src[4 * x];
+                    dst[x] = D3DCOLOR_ARGB(p[3], p[0], p[1], p[2]);
+                }
+            }
+            staging->UnlockRect(0);
+        }
+        stbi_image_free(pLoad);
+    });
+    staging->Release();
+    return result;
+}
+
+// ヌルデバイスでの App::Render 1 フレーム.
+bool BenchHeadlessFrame(Benchmark::Result& result)
+{
+    App app;
+    if (!app.Initialize(nullptr, ScreenWidth, ScreenHeight, App::HeadlessMode))
+    {
+        return false;
+    }
+    result = Benchmark::Run("headless_frame", 500, [&]() { app.Render(); });
+    app.Terminate();
+    return true;
+}
+
+// ヌルデバイスで記録した App::Render 20 フレームのトレースの再生.
+// 同じ呼び出しの列で, 同じ値のステート設定を省いた場合と比べる.
+void BenchTraceReplay(std::vector<Benchmark::Result>& results)
+{
+    const int frameCount = 20;
+    char tempPath[MAX_PATH];
+    GetTempPathA(MAX_PATH, tempPath);
+    const std::string path = std::string(tempPath) + "benchmark_trace.d9tr";
+    {
+        App app;
+        app.SetTraceFile(path);
+        if (!app.Initialize(nullptr, ScreenWidth, ScreenHeight, App::HeadlessMode))
+        {
+            return;
+        }
+        for (int i = 0; i < frameCount; ++i)
+        {
+            app.Render();
+        }
+        app.Terminate();
+    }
+
+    MappedFile file;
+    if (!file.Open(path.c_str(), MappedFile::Sequential))
+    {
+        return;
+    }
+    // App と同じく深度バッファを持つスワップチェイン.
+    D3DPRESENT_PARAMETERS pp = MakePresentParameters();
+    pp.EnableAutoDepthStencil = TRUE;
+    pp.AutoDepthStencilFormat = D3DFMT_D24S8;
+
+    TraceReplayer replayer;
+    std::string report;
+    const bool filters[] = { false, true };
+    for (bool filter : filters)
+    {
+        bool replayed = true;
+        results.push_back(Benchmark::Run(filter ? "trace_replay_20frames_filtered" : "trace_replay_20frames", 50, [&]() {
+            NullDevice* device = new NullDevice(pp);
+            replayed = replayer.Replay(device, file.GetData(), file.GetSize(), filter) && replayed;
+            device->Release();
+        }));
+        report += replayed ? replayer.Report() : "Trace replay: broken trace\n";
+    }
+    file.Close();
+    DeleteFileA(path.c_str());
+    OutputDebugStringA(report.c_str());
+    fputs(report.c_str(), stderr);
+}
+
+void Print(const std::string& text)
+{
+    OutputDebugStringA(text.c_str());
+    fputs(text.c_str(), stdout);
+}
+}
+
+int RunBenchmarkSuite(const char* outFile, const char* baselineFile, double threshold)
+{
+    std::vector<Benchmark::Result> results;
+
+    NullDevice* device = new NullDevice(MakePresentParameters());
+    results.push_back(BenchTeapotBuffers(device));
+    results.push_back(BenchTextureLoad(device));
+    BenchFrameCapture(device, results);
+    device->Release();
+
+    RunCpuBenchmarks(results);
+
+    Benchmark::Result frame;
+    if (BenchHeadlessFrame(frame))
+    {
+        results.push_back(frame);
+    }
+    BenchTraceReplay(results);
+
+    std::string report;
+    int regressions = Benchmark::WriteAndCompare(results, outFile, baselineFile, threshold, report);
+    Print(report);
+    return regressions;
+}
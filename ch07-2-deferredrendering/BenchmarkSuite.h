@@ -0,0 +1,9 @@
+﻿#pragma once
+
+// サンプルの CPU 側の処理を計測するベンチマーク.
+// 結果を JSON で標準出力 (outFile が指定されればそのファイル) へ出力し,
+// baselineFile が指定されればその値と比較します.
+// threshold はベースラインに対して許容する遅延の割合 (0.1 で 10%) です.
+//
+// ベースラインより遅くなった項目の数を返します. 実行できなかった場合は -1 を返します.
+int RunBenchmarkSuite(const char* outFile, const char* baselineFile, double threshold);
@@ -0,0 +1,181 @@
+﻿#include "CaptureQueue.h"
+#include "ImageWriter.h"
+#include "ParallelFor.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+CaptureQueue::CaptureQueue(int threadCount, int maxFrames)
+    : m_busyCount(0), m_quit(false)
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+    for (int i = 0; i < maxFrames; ++i)
+    {
+        m_frames.push_back(new Frame());
+    }
+    m_free = m_frames;
+
+    // 描画や読み込みの並列処理の邪魔にならないよう, 既定では少なめにする.
+    if (threadCount <= 0)
+    {
+        threadCount = std::max(1, GetThreadCount(0) / 4);
+    }
+    for (int i = 0; i < threadCount; ++i)
+    {
+        m_threads.push_back(std::thread(&CaptureQueue::WorkerMain, this));
+    }
+}
+
+CaptureQueue::~CaptureQueue()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_workAvailable.notify_all();
+    for (auto& thread : m_threads)
+    {
+        thread.join();
+    }
+    for (auto frame : m_frames)
+    {
+        delete frame;
+    }
+}
+
+CaptureQueue::Frame* CaptureQueue::Acquire(int width, int height, PixelConvert::Format format)
+{
+    Frame* frame = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_free.empty())
+        {
+            m_stats.dropped++;
+            return nullptr;
+        }
+        frame = m_free.back();
+        m_free.pop_back();
+    }
+
+    frame->fileName.clear();
+    frame->encoding = Png;
+    frame->convertFlags = 0;
+    frame->opaque = false;
+    frame->format = format;
+    frame->width = width;
+    frame->height = height;
+    frame->pitch = size_t(width) * PixelConvert::GetBytesPerPixel(format);
+    // 同じ大きさの画像が続けば, 確保済みのメモリをそのまま使う.
+    frame->pixels.resize(frame->pitch * height);
+    return frame;
+}
+
+void CaptureQueue::Submit(Frame* frame)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.push_back(frame);
+        m_stats.submitted++;
+    }
+    m_workAvailable.notify_one();
+}
+
+void CaptureQueue::Cancel(Frame* frame)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_free.push_back(frame);
+}
+
+void CaptureQueue::Flush()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this]() { return m_pending.empty() && m_busyCount == 0; });
+}
+
+CaptureQueue::Stats CaptureQueue::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+std::string CaptureQueue::Report() const
+{
+    const Stats stats = GetStats();
+    const int encoded = stats.written + stats.failed;
+    char buf[256];
+    snprintf(buf, sizeof(buf),
+        "Capture: %d submitted, %d written (%.1f MB), %d dropped, %d failed, encode %.2f ms/image (max %.2f ms, %d threads)\n",
+        stats.submitted, stats.written, stats.bytesWritten / (1024.0 * 1024.0), stats.dropped, stats.failed,
+        encoded > 0 ? stats.encodeMsec / encoded : 0.0, stats.maxEncodeMsec, int(m_threads.size()));
+    return buf;
+}
+
+bool CaptureQueue::Encode(const Frame& frame, std::vector<uint8_t>& out)
+{
+    if (frame.encoding == Dds)
+    {
+        return ImageWriter::EncodeDds(frame.pixels.data(), frame.pitch, frame.format, frame.width, frame.height, out);
+    }
+
+    if (frame.format == PixelConvert::R8G8B8A8)
+    {
+        return ImageWriter::EncodePng(frame.pixels.data(), frame.pitch, frame.width, frame.height, frame.opaque, out);
+    }
+    const size_t pitch = size_t(frame.width) * 4;
+    std::vector<uint8_t> rgba(pitch * frame.height);
+    PixelConvert::ConvertImage(frame.pixels.data(), frame.pitch, frame.format,
+        rgba.data(), pitch, PixelConvert::R8G8B8A8, frame.width, frame.height, frame.convertFlags);
+    return ImageWriter::EncodePng(rgba.data(), pitch, frame.width, frame.height, frame.opaque, out);
+}
+
+void CaptureQueue::WorkerMain()
+{
+    std::vector<uint8_t> encoded;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        // 終了の指示があっても, 残っている画像は書き出してから抜ける.
+        m_workAvailable.wait(lock, [this]() { return m_quit || !m_pending.empty(); });
+        if (m_pending.empty())
+        {
+            break;
+        }
+        Frame* frame = m_pending.front();
+        m_pending.pop_front();
+        m_busyCount++;
+        lock.unlock();
+
+        auto begin = std::chrono::steady_clock::now();
+        bool succeeded = Encode(*frame, encoded);
+        if (succeeded && m_writer)
+        {
+            succeeded = m_writer(*frame, encoded);
+        }
+        else if (succeeded && !frame->fileName.empty())
+        {
+            succeeded = ImageWriter::WriteFile(frame->fileName.c_str(), encoded);
+        }
+        auto end = std::chrono::steady_clock::now();
+        const double msec = std::chrono::duration<double, std::milli>(end - begin).count();
+
+        lock.lock();
+        if (succeeded)
+        {
+            m_stats.written++;
+            m_stats.bytesWritten += encoded.size();
+        }
+        else
+        {
+            m_stats.failed++;
+        }
+        m_stats.encodeMsec += msec;
+        m_stats.maxEncodeMsec = std::max(m_stats.maxEncodeMsec, msec);
+        m_free.push_back(frame);
+        m_busyCount--;
+        if (m_pending.empty() && m_busyCount == 0)
+        {
+            m_idle.notify_all();
+        }
+    }
+}
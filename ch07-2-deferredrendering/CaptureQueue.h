@@ -0,0 +1,97 @@
+﻿#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "PixelConvert.h"
+
+// 読み戻した画像の形式変換とファイルへの書き出しを, ワーカースレッドで行うキュー. D3D には依存しません.
+//
+// 描画スレッドは Acquire() で画像用のバッファを借り, 画素をコピーして Submit() します.
+// バッファは最初に maxFrames 個だけ用意し, 全て使用中なら Acquire() は待たずに nullptr を返します
+// (その画像は捨てて dropped に数える). そのため書き出しが追いつかなくても描画スレッドは止まりません.
+// ロックはバッファの受け渡しの間だけ保持します.
+class CaptureQueue
+{
+public:
+    enum Encoding
+    {
+        Png,    // 8 ビットの RGB(A) へ変換して PNG にする.
+        Dds,    // 変換せずにそのまま DDS にする (浮動小数点数の G-Buffer など).
+    };
+
+    struct Frame
+    {
+        std::string fileName;   // 空なら符号化だけ行い, 書き出さない (計測用).
+        Encoding encoding;
+        int convertFlags;       // PNG へ変換する際の PixelConvert::ConvertImage() の flags.
+        bool opaque;            // PNG にアルファを含めない (X8R8G8B8 のバックバッファなど).
+
+        // Acquire() で設定される. pixels は行の間を詰めた pitch * height バイト.
+        PixelConvert::Format format;
+        int width;
+        int height;
+        size_t pitch;
+        std::vector<uint8_t> pixels;
+    };
+
+    struct Stats
+    {
+        int submitted;
+        int written;
+        int dropped;        // バッファが足りずに捨てた数.
+        int failed;         // 符号化または書き出しに失敗した数.
+        uint64_t bytesWritten;
+        double encodeMsec;  // ワーカースレッドでの変換と符号化, 書き出しの合計時間.
+        double maxEncodeMsec;
+    };
+
+    // 符号化した内容を書き出す関数. 成功すれば true を返します. ワーカースレッドから呼ばれます.
+    typedef std::function<bool(const Frame& frame, const std::vector<uint8_t>& encoded)> Writer;
+
+    // threadCount が 0 以下ならハードウェアのスレッド数の 1/4 (最低 1) にします.
+    CaptureQueue(int threadCount, int maxFrames);
+    // 残っている画像を全て書き出してからスレッドを終了します.
+    ~CaptureQueue();
+
+    Frame* Acquire(int width, int height, PixelConvert::Format format);
+    void Submit(Frame* frame);
+    // Acquire() したバッファを書き出さずに返します.
+    void Cancel(Frame* frame);
+    // 投入済みの画像を全て書き出すまで待ちます. 描画中には呼ばないでください.
+    void Flush();
+
+    // 書き出し先を差し替えます (動画のエンコーダーへ渡す場合やテストなど). 最初の Submit() より前に呼んでください.
+    // 設定しなければ fileName のファイルへ書き出します.
+    void SetWriter(const Writer& writer) { m_writer = writer; }
+
+    Stats GetStats() const;
+    std::string Report() const;
+
+    // 変換と符号化を行います. 成功すれば out に書き出す内容を返します.
+    static bool Encode(const Frame& frame, std::vector<uint8_t>& out);
+
+private:
+    CaptureQueue(const CaptureQueue&);
+    CaptureQueue& operator=(const CaptureQueue&);
+
+    void WorkerMain();
+
+    std::vector<Frame*> m_frames;
+    std::vector<Frame*> m_free;
+    std::deque<Frame*> m_pending;
+    int m_busyCount;    // ワーカーが処理中の数.
+    bool m_quit;
+    Stats m_stats;
+    Writer m_writer;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_workAvailable;
+    std::condition_variable m_idle;
+    std::vector<std::thread> m_threads;
+};
@@ -0,0 +1,293 @@
+﻿#include "CommandTrace.h"
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+const uint8_t Magic[4] = { 'D', '9', 'T', 'R' };
+
+const char* const OpcodeNames[CommandTrace::OpcodeCount] = {
+    "Present",
+    "BeginScene",
+    "EndScene",
+    "Clear",
+    "CreateVertexBuffer",
+    "CreateIndexBuffer",
+    "CreateTexture",
+    "CreateRenderTarget",
+    "CreateDepthStencilSurface",
+    "CreateOffscreenPlainSurface",
+    "CreateVertexDeclaration",
+    "CreateVertexShader",
+    "CreatePixelShader",
+    "GetSurfaceLevel",
+    "GetRenderTarget",
+    "GetDepthStencilSurface",
+    "GetBackBuffer",
+    "UpdateBuffer",
+    "UpdateTextureLevel",
+    "UpdateTexture",
+    "StretchRect",
+    "GetRenderTargetData",
+    "ColorFill",
+    "SetRenderTarget",
+    "SetDepthStencilSurface",
+    "SetViewport",
+    "SetScissorRect",
+    "SetRenderState",
+    "SetSamplerState",
+    "SetTextureStageState",
+    "SetTexture",
+    "SetTransform",
+    "SetVertexDeclaration",
+    "SetFVF",
+    "SetVertexShader",
+    "SetPixelShader",
+    "SetVertexShaderConstantF",
+    "SetVertexShaderConstantI",
+    "SetVertexShaderConstantB",
+    "SetPixelShaderConstantF",
+    "SetPixelShaderConstantI",
+    "SetPixelShaderConstantB",
+    "SetStreamSource",
+    "SetStreamSourceFreq",
+    "SetIndices",
+    "DrawPrimitive",
+    "DrawIndexedPrimitive",
+    "DrawPrimitiveUP",
+    "DrawIndexedPrimitiveUP",
+};
+}
+
+namespace CommandTrace
+{
+const char* GetOpcodeName(int opcode)
+{
+    if (opcode < 0 || opcode >= OpcodeCount)
+    {
+        return "Unknown";
+    }
+    return OpcodeNames[opcode];
+}
+}
+
+CommandTraceWriter::CommandTraceWriter()
+    : m_commandCount(0)
+{
+    m_data.insert(m_data.end(), Magic, Magic + sizeof(Magic));
+    WriteUInt(CommandTrace::Version);
+}
+
+void CommandTraceWriter::WriteOpcode(CommandTrace::Opcode opcode)
+{
+    m_data.push_back(uint8_t(opcode));
+    m_commandCount++;
+}
+
+void CommandTraceWriter::WriteUInt(uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        m_data.push_back(uint8_t(value | 0x80));
+        value >>= 7;
+    }
+    m_data.push_back(uint8_t(value));
+}
+
+void CommandTraceWriter::WriteInt(int32_t value)
+{
+    // 絶対値の小さい負の数も短くなるよう, 符号を最下位ビットへ移す.
+    WriteUInt((uint32_t(value) << 1) ^ uint32_t(value >> 31));
+}
+
+void CommandTraceWriter::WriteFloat(float value)
+{
+    uint8_t bytes[4];
+    memcpy(bytes, &value, sizeof(bytes));
+    m_data.insert(m_data.end(), bytes, bytes + sizeof(bytes));
+}
+
+void CommandTraceWriter::WriteBytes(const void* data, size_t size)
+{
+    WriteUInt(uint32_t(size));
+    if (size > 0)
+    {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        m_data.insert(m_data.end(), p, p + size);
+    }
+}
+
+bool CommandTraceWriter::Save(const char* fileName) const
+{
+    FILE* fp = fopen(fileName, "wb");
+    if (!fp)
+    {
+        return false;
+    }
+    const bool written = fwrite(m_data.data(), m_data.size(), 1, fp) == 1;
+    return fclose(fp) == 0 && written;
+}
+
+CommandTraceReader::CommandTraceReader(const uint8_t* data, size_t size)
+    : m_p(data), m_end(data + size), m_error(false)
+{
+    if (size < sizeof(Magic) || memcmp(data, Magic, sizeof(Magic)) != 0)
+    {
+        m_error = true;
+        return;
+    }
+    m_p += sizeof(Magic);
+    if (ReadUInt() != CommandTrace::Version)
+    {
+        m_error = true;
+    }
+}
+
+bool CommandTraceReader::ReadOpcode(int& opcode)
+{
+    if (m_error || m_p == m_end)
+    {
+        return false;
+    }
+    opcode = *m_p++;
+    if (opcode >= CommandTrace::OpcodeCount)
+    {
+        m_error = true;
+        return false;
+    }
+    return true;
+}
+
+uint32_t CommandTraceReader::ReadUInt()
+{
+    uint32_t value = 0;
+    for (int shift = 0; shift < 35; shift += 7)
+    {
+        if (m_error || m_p == m_end)
+        {
+            m_error = true;
+            return 0;
+        }
+        const uint8_t b = *m_p++;
+        value |= uint32_t(b & 0x7F) << shift;
+        if ((b & 0x80) == 0)
+        {
+            return value;
+        }
+    }
+    m_error = true;
+    return 0;
+}
+
+int32_t CommandTraceReader::ReadInt()
+{
+    const uint32_t value = ReadUInt();
+    return int32_t((value >> 1) ^ (0u - (value & 1)));
+}
+
+float CommandTraceReader::ReadFloat()
+{
+    float value = 0.0f;
+    if (m_error || m_end - m_p < 4)
+    {
+        m_error = true;
+        return value;
+    }
+    memcpy(&value, m_p, sizeof(value));
+    m_p += sizeof(value);
+    return value;
+}
+
+const uint8_t* CommandTraceReader::ReadBytes(size_t& size)
+{
+    size = ReadUInt();
+    if (m_error || size_t(m_end - m_p) < size)
+    {
+        m_error = true;
+        size = 0;
+        return nullptr;
+    }
+    const uint8_t* p = m_p;
+    m_p += size;
+    return p;
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+    Clear();
+}
+
+void LatencyHistogram::Add(double ns)
+{
+    int bucket = 0;
+    for (double upper = 2.0; bucket + 1 < BucketCount && ns >= upper; upper *= 2.0)
+    {
+        ++bucket;
+    }
+    m_buckets[bucket]++;
+    m_count++;
+    m_totalNs += ns;
+    if (ns > m_maxNs)
+    {
+        m_maxNs = ns;
+    }
+}
+
+void LatencyHistogram::Clear()
+{
+    memset(m_buckets, 0, sizeof(m_buckets));
+    m_count = 0;
+    m_totalNs = 0.0;
+    m_maxNs = 0.0;
+}
+
+double LatencyHistogram::GetPercentileNs(double p) const
+{
+    if (m_count == 0)
+    {
+        return 0.0;
+    }
+    const double target = p * m_count;
+    uint64_t sum = 0;
+    double upper = 2.0;
+    for (int i = 0; i < BucketCount; ++i, upper *= 2.0)
+    {
+        sum += m_buckets[i];
+        if (sum >= target && m_buckets[i] > 0)
+        {
+            // 最大値を超える値は返さない.
+            return upper < m_maxNs ? upper : m_maxNs;
+        }
+    }
+    return m_maxNs;
+}
+
+std::string LatencyHistogram::Format() const
+{
+    std::string text = "[";
+    char buf[64];
+    double upper = 2.0;
+    for (int i = 0; i < BucketCount; ++i, upper *= 2.0)
+    {
+        if (m_buckets[i] == 0)
+        {
+            continue;
+        }
+        // 区間の下限を単位付きで表す.
+        const double lower = upper * 0.5;
+        if (lower < 1000.0)
+        {
+            snprintf(buf, sizeof(buf), "%s%.0fns:%llu", text.size() > 1 ? " " : "", lower, (unsigned long long)m_buckets[i]);
+        }
+        else if (lower < 1000000.0)
+        {
+            snprintf(buf, sizeof(buf), "%s%.0fus:%llu", text.size() > 1 ? " " : "", lower / 1000.0, (unsigned long long)m_buckets[i]);
+        }
+        else
+        {
+            snprintf(buf, sizeof(buf), "%s%.0fms:%llu", text.size() > 1 ? " " : "", lower / 1000000.0, (unsigned long long)m_buckets[i]);
+        }
+        text += buf;
+    }
+    return text + "]";
+}
@@ -0,0 +1,156 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// デバイスの呼び出しを記録したトレースの形式. D3D には依存しません.
+// 記録は TraceDevice, 再生は TraceReplayer が行います.
+//
+// ファイルは "D9TR" とバージョンの後に, 呼び出しごとのオペコード (1 バイト) と引数が並びます.
+// 整数は LEB128 の可変長 (符号付きは zigzag), float はそのままの 4 バイト,
+// バイト列は長さ (可変長) と内容で表します. 各呼び出しの引数は CommandTrace::Opcode のコメントの順です.
+// オブジェクトは作成順に 1 から振った番号で表し, 0 は nullptr です.
+namespace CommandTrace
+{
+    const uint32_t Version = 1;
+
+    enum Opcode
+    {
+        // フレームとシーン.
+        Present,                    // flags.
+        BeginScene,
+        EndScene,
+        Clear,                      // flags, color, z (float), stencil. 矩形の指定は記録しない (全体).
+
+        // オブジェクトの作成と取得.
+        CreateVertexBuffer,         // id, length, usage, fvf, pool.
+        CreateIndexBuffer,          // id, length, usage, format, pool.
+        CreateTexture,              // id, width, height, levels, usage, format, pool.
+        CreateRenderTarget,         // id, width, height, format, multiSample, quality, lockable.
+        CreateDepthStencilSurface,  // id, width, height, format, multiSample, quality, discard.
+        CreateOffscreenPlainSurface,// id, width, height, format, pool.
+        CreateVertexDeclaration,    // id, D3DVERTEXELEMENT9 の配列 (D3DDECL_END を含む).
+        CreateVertexShader,         // id, バイトコード.
+        CreatePixelShader,          // id, バイトコード.
+        GetSurfaceLevel,            // id, テクスチャの id, level.
+        GetRenderTarget,            // id, index. 作成していないサーフェイス (バックバッファ) の取得.
+        GetDepthStencilSurface,     // id.
+        GetBackBuffer,              // id, swapChain, backBuffer.
+
+        // 内容の転送.
+        UpdateBuffer,               // バッファの id, offset, Lock の flags, Unlock 時の内容.
+        UpdateTextureLevel,         // テクスチャの id, level, 1 行のバイト数, 行数, 内容 (行の間を詰める).
+        UpdateTexture,              // 転送元の id, 転送先の id.
+        StretchRect,                // 転送元の id, 転送先の id, filter. 矩形の指定は記録しない (全体).
+        GetRenderTargetData,        // 転送元の id, 転送先の id.
+        ColorFill,                  // サーフェイスの id, color.
+
+        // ステート.
+        SetRenderTarget,            // index, サーフェイスの id.
+        SetDepthStencilSurface,     // id.
+        SetViewport,                // x, y, width, height, minZ (float), maxZ (float).
+        SetScissorRect,             // left, top, right, bottom (符号付き).
+        SetRenderState,             // state, value.
+        SetSamplerState,            // sampler, type, value.
+        SetTextureStageState,       // stage, type, value.
+        SetTexture,                 // stage, id.
+        SetTransform,               // state, 行列 (float x 16).
+        SetVertexDeclaration,       // id.
+        SetFVF,                     // fvf.
+        SetVertexShader,            // id.
+        SetPixelShader,             // id.
+        SetVertexShaderConstantF,   // start, 内容 (float4 の配列).
+        SetVertexShaderConstantI,   // start, 内容 (int4 の配列).
+        SetVertexShaderConstantB,   // start, 内容 (BOOL の配列).
+        SetPixelShaderConstantF,
+        SetPixelShaderConstantI,
+        SetPixelShaderConstantB,
+        SetStreamSource,            // stream, id, offset, stride.
+        SetStreamSourceFreq,        // stream, setting.
+        SetIndices,                 // id.
+
+        // 描画.
+        DrawPrimitive,              // type, startVertex, primitiveCount.
+        DrawIndexedPrimitive,       // type, baseVertex (符号付き), minIndex, numVertices, startIndex, primitiveCount.
+        DrawPrimitiveUP,            // type, primitiveCount, stride, 頂点.
+        DrawIndexedPrimitiveUP,     // type, minIndex, numVertices, primitiveCount, indexFormat, stride, インデックス, 頂点.
+
+        OpcodeCount,
+    };
+
+    const char* GetOpcodeName(int opcode);
+}
+
+// トレースを書き込むクラス. 先頭にヘッダを書き込んだ状態で作成されます.
+class CommandTraceWriter
+{
+public:
+    CommandTraceWriter();
+
+    void WriteOpcode(CommandTrace::Opcode opcode);
+    void WriteUInt(uint32_t value);
+    void WriteInt(int32_t value);
+    void WriteFloat(float value);
+    void WriteBytes(const void* data, size_t size);
+
+    const std::vector<uint8_t>& GetData() const { return m_data; }
+    uint64_t GetCommandCount() const { return m_commandCount; }
+    bool Save(const char* fileName) const;
+
+private:
+    std::vector<uint8_t> m_data;
+    uint64_t m_commandCount;
+};
+
+// トレースを先頭から読み込むクラス.
+// 途中で終わっているなど読めない場合は, 以降の読み込みが 0 を返し HasError() が true になります.
+class CommandTraceReader
+{
+public:
+    CommandTraceReader(const uint8_t* data, size_t size);
+
+    // 最後まで読んだか, エラーがあれば false を返します.
+    bool ReadOpcode(int& opcode);
+    uint32_t ReadUInt();
+    int32_t ReadInt();
+    float ReadFloat();
+    // 内容はトレースのメモリを直接指します.
+    const uint8_t* ReadBytes(size_t& size);
+
+    bool HasError() const { return m_error; }
+    // 読み込んだ値が不正な場合に, 呼び出し側からトレースが壊れていることを伝えます.
+    void SetError() { m_error = true; }
+
+private:
+    const uint8_t* m_p;
+    const uint8_t* m_end;
+    bool m_error;
+};
+
+// 処理時間の分布. 2 のべき乗 (ナノ秒) ごとの区間で数えます.
+class LatencyHistogram
+{
+public:
+    static const int BucketCount = 40;
+
+    LatencyHistogram();
+
+    void Add(double ns);
+    void Clear();
+
+    uint64_t GetCount() const { return m_count; }
+    double GetTotalNs() const { return m_totalNs; }
+    double GetMaxNs() const { return m_maxNs; }
+    // p (0 - 1) 番目の値が入る区間の上限. 区間の幅の分だけ大きめの値になります.
+    double GetPercentileNs(double p) const;
+
+    // 区間ごとの数を 1 行で表します. 例: "[256ns:12 512ns:40 1us:3]".
+    std::string Format() const;
+
+private:
+    uint64_t m_buckets[BucketCount];
+    uint64_t m_count;
+    double m_totalNs;
+    double m_maxNs;
+};
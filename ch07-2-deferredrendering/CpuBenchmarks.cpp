@@ -0,0 +1,915 @@
+﻿#include "CpuBenchmarks.h"
+#include "AssetArchive.h"
+#include "CaptureQueue.h"
+#include "DeferredScene.h"
+#include "FrameGraphCompiler.h"
+#include "GeometryProcessing.h"
+#include "JobSystem.h"
+#include "LightingReference.h"
+#include "MappedFile.h"
+#include "MeshSimplifier.h"
+#include "Meshlet.h"
+#include "MeshBuilder.h"
+#include "MeshCodec.h"
+#include "MeshImporter.h"
+#include "PixelConvert.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+using namespace DirectX;
+
+namespace
+{
+const int ScreenWidth = 1280;
+const int ScreenHeight = 720;
+
+// 計測結果が最適化で消されないように書き込む先.
+volatile float g_sink;
+
+// 各項目の補足 (圧縮率や一致の確認など) はデバッガと標準エラー出力へ書く.
+void Log(const char* text)
+{
+#ifdef _WIN32
+    OutputDebugStringA(text);
+#endif
+    fputs(text, stderr);
+}
+
+std::string TempFilePath(const char* name)
+{
+    return (std::filesystem::temp_directory_path() / name).string();
+}
+
+// ティーポットの LOD の作成. 各レベルの三角形数と誤差も出力する.
+Benchmark::Result BenchTeapotLodChain()
+{
+    size_t lengthVB, strideVB, lengthIB;
+    const void* vertices = DeferredScene::GetTeapotVertices(lengthVB, strideVB);
+    const uint16_t* indices = DeferredScene::GetTeapotIndices(lengthIB);
+
+    std::vector<uint16_t> lodIndices;
+    std::vector<MeshSimplifier::LodLevel> levels;
+    Benchmark::Result result = Benchmark::Run("teapot_lod_chain", 20, [&]() {
+        MeshSimplifier::BuildLodChain(
+            vertices, lengthVB / strideVB, strideVB,
+            indices, lengthIB / sizeof(uint16_t),
+            5, 0.5f, 0.2f, lodIndices, levels);
+    });
+
+    std::string report = MeshSimplifier::Report(levels);
+    Log(report.c_str());
+    return result;
+}
+
+// ティーポットのクラスタのカリングとインデックスの詰め直し.
+// シーンのカメラに加えて, 周囲を回る 8 方向から見た場合の除外率も出力する.
+Benchmark::Result BenchMeshletCull()
+{
+    size_t lengthVB, strideVB, lengthIB;
+    const void* vertices = DeferredScene::GetTeapotVertices(lengthVB, strideVB);
+    const uint16_t* indices = DeferredScene::GetTeapotIndices(lengthIB);
+
+    std::vector<Meshlet> meshlets;
+    std::vector<uint16_t> meshletIndices;
+    BuildMeshlets(vertices, lengthVB / strideVB, strideVB, indices, lengthIB / sizeof(uint16_t),
+        MaxMeshletVertices, MaxMeshletTriangles, meshlets, meshletIndices);
+    MeshletCuller culler;
+    culler.Setup(meshlets, meshletIndices);
+
+    const DeferredScene::Camera& camera = DeferredScene::GetCamera();
+    XMMATRIX view, proj;
+    DeferredScene::BuildCameraMatrices(ScreenWidth, ScreenHeight, view, proj);
+    const XMMATRIX viewProj = view * proj;
+    const XMFLOAT3* modelPos = DeferredScene::GetModelPositions();
+
+    std::vector<uint32_t> visible;
+    std::vector<uint16_t> compacted(meshletIndices.size());
+    MeshletCuller::Stats sceneStats = {};
+    Benchmark::Result result = Benchmark::Run("meshlet_cull_5", 1000, [&]() {
+        for (int i = 0; i < DeferredScene::ModelCount; ++i)
+        {
+            XMMATRIX world = XMMatrixTranslation(modelPos[i].x, modelPos[i].y, modelPos[i].z);
+            culler.Cull(world, viewProj, camera.eyePos, visible, &sceneStats);
+            culler.WriteIndices(visible, compacted.data());
+        }
+    });
+
+    MeshletCuller::Stats orbitStats = {};
+    for (int i = 0; i < 8; ++i)
+    {
+        float angle = XM_2PI * i / 8.0f;
+        XMFLOAT3 eye(10.0f * std::sin(angle), 4.0f, -10.0f * std::cos(angle));
+        XMMATRIX orbitView = XMMatrixLookAtLH(XMLoadFloat3(&eye), XMLoadFloat3(&camera.eyeTarget), XMLoadFloat3(&camera.eyeUp));
+        for (int j = 0; j < DeferredScene::ModelCount; ++j)
+        {
+            XMMATRIX world = XMMatrixTranslation(modelPos[j].x, modelPos[j].y, modelPos[j].z);
+            culler.Cull(world, orbitView * proj, eye, visible, &orbitStats);
+        }
+    }
+
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%u meshlets, scene camera: ", uint32_t(meshlets.size()));
+    std::string report = buf + MeshletCuller::Report(sceneStats) + "orbit cameras: " + MeshletCuller::Report(orbitStats);
+    Log(report.c_str());
+    return result;
+}
+
+// gridSize x gridSize 頂点の格子メッシュ.
+void MakeGridMesh(uint32_t gridSize, std::vector<XMFLOAT3>& vertices, std::vector<uint32_t>& indices)
+{
+    vertices.clear();
+    vertices.reserve(gridSize * gridSize);
+    for (uint32_t y = 0; y < gridSize; ++y)
+    {
+        for (uint32_t x = 0; x < gridSize; ++x)
+        {
+            vertices.push_back(XMFLOAT3(float(x), 0.0f, float(y)));
+        }
+    }
+    indices.clear();
+    indices.reserve((gridSize - 1) * (gridSize - 1) * 6);
+    for (uint32_t y = 0; y + 1 < gridSize; ++y)
+    {
+        for (uint32_t x = 0; x + 1 < gridSize; ++x)
+        {
+            uint32_t v = y * gridSize + x;
+            uint32_t quad[6] = { v, v + 1, v + gridSize, v + gridSize, v + 1, v + gridSize + 1 };
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    }
+}
+
+// 約 100 万三角形の格子メッシュの 16 ビット分割と 32 ビットインデックス化.
+// 分割結果が元の三角形と一致するかも確認する.
+void BenchMeshBuilder(std::vector<Benchmark::Result>& results)
+{
+    std::vector<XMFLOAT3> vertices;
+    std::vector<uint32_t> indices;
+    MakeGridMesh(708, vertices, indices);
+
+    MeshData mesh;
+    results.push_back(Benchmark::Run("mesh_build_1m_split16", 10, [&]() {
+        BuildMesh(vertices.data(), vertices.size(), sizeof(XMFLOAT3), indices.data(), indices.size(),
+            SplitToIndex16, 0xFFFFFF, mesh);
+    }, 1));
+
+    size_t mismatches = 0;
+    const uint16_t* local = reinterpret_cast<const uint16_t*>(mesh.indices.data());
+    const XMFLOAT3* built = reinterpret_cast<const XMFLOAT3*>(mesh.vertices.data());
+    for (const auto& sub : mesh.subMeshes)
+    {
+        for (uint32_t i = sub.startIndex; i < sub.startIndex + sub.triangleCount * 3; ++i)
+        {
+            const XMFLOAT3& a = built[sub.baseVertex + local[i]];
+            const XMFLOAT3& b = vertices[indices[i]];
+            if (local[i] >= sub.vertexCount || a.x != b.x || a.y != b.y || a.z != b.z)
+            {
+                ++mismatches;
+            }
+        }
+    }
+    char buf[160];
+    snprintf(buf, sizeof(buf), "Mesh builder: %u triangles, %u sub meshes, %u -> %u vertices, %u mismatches\n",
+        uint32_t(indices.size() / 3), uint32_t(mesh.subMeshes.size()),
+        uint32_t(vertices.size()), uint32_t(mesh.GetVertexCount()), uint32_t(mismatches));
+    Log(buf);
+
+    results.push_back(Benchmark::Run("mesh_build_1m_index32", 10, [&]() {
+        BuildMesh(vertices.data(), vertices.size(), sizeof(XMFLOAT3), indices.data(), indices.size(),
+            AllowIndex32, 0xFFFFFF, mesh);
+    }, 1));
+}
+
+// 圧縮したデータの展開. 圧縮率と展開速度 (GB/s) を出力し, 元のデータと一致するかも確認する.
+Benchmark::Result BenchDecode(const char* name, int iterations,
+    const void* data, size_t count, size_t elementSize, bool indices)
+{
+    std::vector<uint8_t> encoded;
+    if (indices)
+    {
+        MeshCodec::EncodeIndices(data, count, elementSize, encoded);
+    }
+    else
+    {
+        MeshCodec::EncodeVertices(data, count, elementSize, encoded);
+    }
+
+    const size_t length = count * elementSize;
+    std::vector<uint8_t> decoded(length);
+    bool valid = true;
+    Benchmark::Result result = Benchmark::Run(name, iterations, [&]() {
+        valid &= indices
+            ? MeshCodec::DecodeIndices(decoded.data(), count, elementSize, encoded.data(), encoded.size())
+            : MeshCodec::DecodeVertices(decoded.data(), count, elementSize, encoded.data(), encoded.size());
+    });
+    valid &= memcmp(decoded.data(), data, length) == 0;
+
+    char buf[160];
+    snprintf(buf, sizeof(buf), "Mesh codec: %s %u -> %u bytes (%.1f%%), %.2f GB/s%s\n",
+        name, uint32_t(length), uint32_t(encoded.size()), 100.0 * encoded.size() / length,
+        double(length) / result.medianNs, valid ? "" : ", MISMATCH");
+    Log(buf);
+    return result;
+}
+
+// ティーポットと格子メッシュの圧縮データの展開.
+void BenchMeshCodec(std::vector<Benchmark::Result>& results)
+{
+    size_t lengthVB, strideVB, lengthIB;
+    const void* vertices = DeferredScene::GetTeapotVertices(lengthVB, strideVB);
+    const uint16_t* indices = DeferredScene::GetTeapotIndices(lengthIB);
+    results.push_back(BenchDecode("decode_teapot_vertices", 200, vertices, lengthVB / strideVB, strideVB, false));
+    results.push_back(BenchDecode("decode_teapot_indices", 200, indices, lengthIB / sizeof(uint16_t), sizeof(uint16_t), true));
+
+    std::vector<XMFLOAT3> gridVertices;
+    std::vector<uint32_t> gridIndices;
+    MakeGridMesh(708, gridVertices, gridIndices);
+    results.push_back(BenchDecode("decode_grid_vertices_500k", 10,
+        gridVertices.data(), gridVertices.size(), sizeof(XMFLOAT3), false));
+    results.push_back(BenchDecode("decode_grid_indices_1m", 10,
+        gridIndices.data(), gridIndices.size(), sizeof(uint32_t), true));
+}
+
+// ティーポットの法線の再計算と, 格子メッシュの頂点の溶接・法線・接線の生成.
+// ティーポットは事前に計算された法線との角度の差を出力する.
+void BenchGeometryProcessing(std::vector<Benchmark::Result>& results)
+{
+    size_t lengthVB, strideVB, lengthIB;
+    const uint8_t* teapot = static_cast<const uint8_t*>(DeferredScene::GetTeapotVertices(lengthVB, strideVB));
+    const uint16_t* teapotIndices16 = DeferredScene::GetTeapotIndices(lengthIB);
+    const size_t teapotVertexCount = lengthVB / strideVB;
+    std::vector<uint32_t> teapotIndices(teapotIndices16, teapotIndices16 + lengthIB / sizeof(uint16_t));
+
+    std::vector<XMFLOAT3> normals(teapotVertexCount);
+    results.push_back(Benchmark::Run("normals_teapot", 200, [&]() {
+        GeometryProcessing::ComputeNormals(teapot, teapotVertexCount, strideVB,
+            teapotIndices.data(), teapotIndices.size(), GeometryProcessing::AngleWeighted, normals.data());
+    }));
+    float meanDegrees = 0.0f, maxDegrees = 0.0f;
+    for (size_t i = 0; i < teapotVertexCount; ++i)
+    {
+        const XMFLOAT3* baked = reinterpret_cast<const XMFLOAT3*>(teapot + i * strideVB + sizeof(XMFLOAT3));
+        float degrees = XMConvertToDegrees(XMVectorGetX(
+            XMVector3AngleBetweenNormals(XMLoadFloat3(&normals[i]), XMVector3Normalize(XMLoadFloat3(baked)))));
+        meanDegrees += degrees / teapotVertexCount;
+        maxDegrees = (maxDegrees < degrees) ? degrees : maxDegrees;
+    }
+
+    // 格子メッシュを三角形ごとに頂点を持つ形に展開し, 起伏を付ける.
+    const uint32_t gridSize = 708;
+    std::vector<XMFLOAT3> gridVertices;
+    std::vector<uint32_t> gridIndices;
+    MakeGridMesh(gridSize, gridVertices, gridIndices);
+    struct VertexPT
+    {
+        XMFLOAT3 pos;
+        XMFLOAT2 uv;
+    };
+    std::vector<VertexPT> soup(gridIndices.size());
+    std::vector<uint32_t> soupIndices(gridIndices.size());
+    for (size_t i = 0; i < gridIndices.size(); ++i)
+    {
+        const XMFLOAT3& v = gridVertices[gridIndices[i]];
+        soup[i].pos = XMFLOAT3(v.x * 0.01f, std::sin(v.x * 0.05f) * std::cos(v.z * 0.05f), v.z * 0.01f);
+        soup[i].uv = XMFLOAT2(v.x / gridSize, v.z / gridSize);
+    }
+
+    std::vector<uint8_t> welded;
+    std::vector<uint32_t> weldedIndices;
+    size_t weldedCount = 0;
+    results.push_back(Benchmark::Run("weld_soup_1m", 3, [&]() {
+        for (size_t i = 0; i < soupIndices.size(); ++i)
+        {
+            soupIndices[i] = uint32_t(i);
+        }
+        weldedIndices = soupIndices;
+        weldedCount = GeometryProcessing::WeldVertices(soup.data(), soup.size(), sizeof(VertexPT),
+            weldedIndices.data(), weldedIndices.size(), 1e-6f, welded);
+    }, 1));
+
+    std::vector<XMFLOAT3> gridNormals(weldedCount);
+    results.push_back(Benchmark::Run("normals_grid_1m", 5, [&]() {
+        GeometryProcessing::ComputeNormals(welded.data(), weldedCount, sizeof(VertexPT),
+            weldedIndices.data(), weldedIndices.size(), GeometryProcessing::AngleWeighted, gridNormals.data());
+    }, 1));
+    std::vector<XMFLOAT4> gridTangents(weldedCount);
+    results.push_back(Benchmark::Run("tangents_grid_1m", 5, [&]() {
+        GeometryProcessing::ComputeTangents(welded.data(), weldedCount, sizeof(VertexPT), sizeof(XMFLOAT3),
+            gridNormals.data(), weldedIndices.data(), weldedIndices.size(), gridTangents.data());
+    }, 1));
+
+    char buf[200];
+    snprintf(buf, sizeof(buf),
+        "Geometry: teapot normals differ by %.2f deg (mean), %.2f deg (max); grid weld %u -> %u vertices\n",
+        meanDegrees, maxDegrees, uint32_t(soup.size()), uint32_t(weldedCount));
+    Log(buf);
+}
+
+// 比較用の iostream による単純な OBJ の読み込み. 正の番号のみ扱う.
+void ParseObjIostream(const std::string& text, MeshImporter::ImportedMesh& mesh)
+{
+    mesh = MeshImporter::ImportedMesh();
+    std::istringstream stream(text);
+    std::string line;
+    while (std::getline(stream, line))
+    {
+        std::istringstream tokens(line);
+        std::string tag;
+        tokens >> tag;
+        if (tag == "v")
+        {
+            XMFLOAT3 v;
+            tokens >> v.x >> v.y >> v.z;
+            mesh.positions.push_back(v);
+        }
+        else if (tag == "vn")
+        {
+            XMFLOAT3 v;
+            tokens >> v.x >> v.y >> v.z;
+            mesh.normals.push_back(v);
+        }
+        else if (tag == "vt")
+        {
+            XMFLOAT2 v;
+            tokens >> v.x >> v.y;
+            mesh.texcoords.push_back(v);
+        }
+        else if (tag == "f")
+        {
+            std::vector<MeshImporter::Corner> polygon;
+            std::string token;
+            while (tokens >> token)
+            {
+                MeshImporter::Corner corner = { -1, -1, -1 };
+                char slash;
+                std::istringstream parts(token);
+                parts >> corner.position >> slash >> corner.texcoord >> slash >> corner.normal;
+                corner.position -= 1;
+                corner.texcoord -= 1;
+                corner.normal -= 1;
+                polygon.push_back(corner);
+            }
+            for (size_t i = 1; i + 1 < polygon.size(); ++i)
+            {
+                mesh.corners.push_back(polygon[0]);
+                mesh.corners.push_back(polygon[i]);
+                mesh.corners.push_back(polygon[i + 1]);
+            }
+        }
+    }
+}
+
+// 格子メッシュを OBJ のテキストにしたものの読み込みと溶接.
+// 読み込み速度 (MB/s) と, iostream 版と結果が一致するかも出力する.
+void BenchMeshImporter(std::vector<Benchmark::Result>& results)
+{
+    const uint32_t gridSize = 500;
+    std::vector<XMFLOAT3> vertices;
+    std::vector<uint32_t> indices;
+    MakeGridMesh(gridSize, vertices, indices);
+
+    std::string text;
+    char buf[160];
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+        const XMFLOAT3& v = vertices[i];
+        snprintf(buf, sizeof(buf), "v %.6f %.6f %.6f\nvn 0 1 0\nvt %.6f %.6f\n",
+            v.x * 0.01f, v.y, v.z * 0.01f, v.x / gridSize, v.z / gridSize);
+        text += buf;
+    }
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        const uint32_t a = indices[i] + 1, b = indices[i + 1] + 1, c = indices[i + 2] + 1;
+        snprintf(buf, sizeof(buf), "f %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, b, b, b, c, c, c);
+        text += buf;
+    }
+
+    MeshImporter::ImportedMesh mesh, reference;
+    results.push_back(Benchmark::Run("import_obj_500k_threads", 10, [&]() {
+        MeshImporter::ParseObj(text.data(), text.size(), 0, mesh);
+    }, 1));
+    const double threadsNs = results.back().medianNs;
+    results.push_back(Benchmark::Run("import_obj_500k_1thread", 5, [&]() {
+        MeshImporter::ParseObj(text.data(), text.size(), 1, mesh);
+    }, 1));
+    const double singleNs = results.back().medianNs;
+    results.push_back(Benchmark::Run("import_obj_500k_iostream", 3, [&]() {
+        ParseObjIostream(text, reference);
+    }, 0));
+    const double iostreamNs = results.back().medianNs;
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < mesh.corners.size() && i < reference.corners.size(); ++i)
+    {
+        const MeshImporter::Corner& a = mesh.corners[i];
+        const MeshImporter::Corner& b = reference.corners[i];
+        const XMFLOAT3& pa = mesh.positions[a.position];
+        const XMFLOAT3& pb = reference.positions[b.position];
+        if (a.position != b.position || a.texcoord != b.texcoord || a.normal != b.normal ||
+            pa.x != pb.x || pa.y != pb.y || pa.z != pb.z)
+        {
+            ++mismatches;
+        }
+    }
+    if (mesh.corners.size() != reference.corners.size())
+    {
+        ++mismatches;
+    }
+
+    std::vector<uint8_t> welded;
+    std::vector<uint32_t> weldedIndices;
+    results.push_back(Benchmark::Run("weld_obj_500k", 10, [&]() {
+        MeshImporter::WeldVertices(mesh, MeshImporter::PositionNormal, welded, weldedIndices);
+    }, 1));
+
+    const double megaBytes = text.size() / 1000000.0;
+    snprintf(buf, sizeof(buf),
+        "Mesh importer: %.1f MB, %u triangles, %.0f / %.0f / %.0f MB/s (threads / 1 thread / iostream), %u vertices, %u mismatches\n",
+        megaBytes, uint32_t(mesh.corners.size() / 3),
+        megaBytes / (threadsNs * 1e-9), megaBytes / (singleNs * 1e-9), megaBytes / (iostreamNs * 1e-9),
+        uint32_t(welded.size() / MeshImporter::GetVertexStride(MeshImporter::PositionNormal)), uint32_t(mismatches));
+    Log(buf);
+}
+
+// 読み込んだ内容を使う側の代わりに, キャッシュラインごとに 1 バイトずつ読んで合計する.
+uint32_t TouchBytes(const uint8_t* data, size_t size)
+{
+    uint32_t sum = 0;
+    for (size_t i = 0; i < size; i += 64)
+    {
+        sum += data[i];
+    }
+    return sum;
+}
+
+// 以前の LoadBinaryFile と同じ, ifstream でサイズを調べて vector へ読み込む方法.
+bool ReadWholeFile(const char* fileName, std::vector<uint8_t>& buf)
+{
+    std::ifstream infile(fileName, std::ifstream::binary);
+    if (!infile)
+    {
+        return false;
+    }
+    size_t size = size_t(infile.seekg(0, std::ifstream::end).tellg());
+    buf.resize(size);
+    infile.seekg(0, std::ifstream::beg);
+    infile.read(reinterpret_cast<char*>(buf.data()), size);
+    return bool(infile);
+}
+
+// 一時ファイルを vector へ読み込む場合と, メモリに割り当てる場合の比較.
+// 2 回目以降はファイルキャッシュに載っているため, ヒープへのコピーとページの割り当ての差を見ることになる.
+void BenchFileLoading(std::vector<Benchmark::Result>& results)
+{
+    const size_t size = 64 * 1024 * 1024;
+    const std::string path = TempFilePath("benchmark_file_loading.bin");
+    const char* fileName = path.c_str();
+    {
+        std::vector<uint8_t> data(size);
+        for (size_t i = 0; i < size; ++i)
+        {
+            data[i] = uint8_t(i * 31);
+        }
+        std::ofstream outfile(fileName, std::ios::binary);
+        outfile.write(reinterpret_cast<const char*>(data.data()), data.size());
+        if (!outfile)
+        {
+            return;
+        }
+    }
+
+    uint32_t sums[3] = {};
+    std::vector<uint8_t> buf;
+    results.push_back(Benchmark::Run("load_file_64mb_ifstream", 10, [&]() {
+        if (ReadWholeFile(fileName, buf))
+        {
+            sums[0] = TouchBytes(buf.data(), buf.size());
+        }
+        std::vector<uint8_t>().swap(buf);
+    }, 1));
+    const double ifstreamNs = results.back().medianNs;
+    results.push_back(Benchmark::Run("load_file_64mb_mapped", 10, [&]() {
+        MappedFile file;
+        if (file.Open(fileName, MappedFile::Sequential))
+        {
+            sums[1] = TouchBytes(file.GetData(), file.GetSize());
+        }
+    }, 1));
+    const double mappedNs = results.back().medianNs;
+    results.push_back(Benchmark::Run("load_file_64mb_mapped_willneed", 10, [&]() {
+        MappedFile file;
+        if (file.Open(fileName, MappedFile::WillNeed))
+        {
+            sums[2] = TouchBytes(file.GetData(), file.GetSize());
+        }
+    }, 1));
+    const double willNeedNs = results.back().medianNs;
+    std::remove(fileName);
+
+    const double megaBytes = size / 1000000.0;
+    char text[160];
+    snprintf(text, sizeof(text),
+        "File loading: %.0f MB, %.0f / %.0f / %.0f MB/s (ifstream / mapped / mapped + WillNeed)%s\n",
+        megaBytes, megaBytes / (ifstreamNs * 1e-9), megaBytes / (mappedNs * 1e-9), megaBytes / (willNeedNs * 1e-9),
+        (sums[0] == sums[1] && sums[1] == sums[2]) ? "" : ", mismatch");
+    Log(text);
+}
+
+// OBJ のテキストを詰めたアーカイブの索引の検索と, 圧縮したファイルの展開.
+// 展開は 64 KB のブロックごとに並列に行うので, 1 スレッドの場合と比べる.
+void BenchAssetArchive(std::vector<Benchmark::Result>& results)
+{
+    const int smallFileCount = 1000;
+    const size_t largeFileSize = 16 * 1024 * 1024;
+    const std::string path = TempFilePath("benchmark_asset_archive.pak");
+
+    std::string text;
+    char buf[160];
+    for (uint32_t i = 0; text.size() < largeFileSize; ++i)
+    {
+        snprintf(buf, sizeof(buf), "v %.6f %.6f %.6f\nf %u/%u/%u %u/%u/%u %u/%u/%u\n",
+            (i % 1000) * 0.001f, sinf(i * 0.01f), (i / 1000) * 0.001f, i + 1, i + 1, i + 1, i + 2, i + 2, i + 2, i + 3, i + 3, i + 3);
+        text += buf;
+    }
+    text.resize(largeFileSize);
+
+    AssetArchiveWriter writer;
+    std::vector<std::string> names;
+    for (int i = 0; i < smallFileCount; ++i)
+    {
+        snprintf(buf, sizeof(buf), "models/part%04d.obj", i);
+        names.push_back(buf);
+        writer.AddFile(buf, text.data() + i * 4096, 1024 + (i % 8) * 512, true);
+    }
+    writer.AddFile("models/large.obj", text.data(), text.size(), true);
+    AssetArchive archive;
+    if (!writer.Write(path.c_str()) || !archive.Open(path.c_str()))
+    {
+        return;
+    }
+    const AssetArchive::Entry* large = archive.Find("Models\\Large.obj");
+
+    int found = 0;
+    results.push_back(Benchmark::Run("asset_archive_find_1000", 20, [&]() {
+        found = 0;
+        for (const auto& name : names)
+        {
+            found += archive.Find(name.c_str()) ? 1 : 0;
+        }
+    }));
+    std::vector<uint8_t> data(largeFileSize);
+    bool succeeded = large != nullptr;
+    results.push_back(Benchmark::Run("asset_archive_read_16mb_1thread", 10, [&]() {
+        succeeded = succeeded && archive.Read(*large, data.data(), 1);
+    }, 1));
+    const double singleNs = results.back().medianNs;
+    results.push_back(Benchmark::Run("asset_archive_read_16mb_threads", 10, [&]() {
+        succeeded = succeeded && archive.Read(*large, data.data(), 0);
+    }, 1));
+    const double threadsNs = results.back().medianNs;
+    succeeded = succeeded && memcmp(data.data(), text.data(), text.size()) == 0;
+
+    const double megaBytes = largeFileSize / 1000000.0;
+    snprintf(buf, sizeof(buf),
+        "Asset archive: %d/%d found, %.1f MB -> %.1f MB, %.0f / %.0f MB/s (1 thread / threads)%s\n",
+        found, smallFileCount, megaBytes, large ? large->storedSize / 1000000.0 : 0.0,
+        megaBytes / (singleNs * 1e-9), megaBytes / (threadsNs * 1e-9), succeeded ? "" : ", mismatch");
+    Log(buf);
+
+    archive.Close();
+    std::remove(path.c_str());
+}
+
+// 画面の読み戻しを想定した 1920x1080 の画像の形式変換. 変換元の大きさを基準に GB/s を表示する.
+void BenchPixelConvert(std::vector<Benchmark::Result>& results)
+{
+    using namespace PixelConvert;
+    const int width = 1920;
+    const int height = 1080;
+    const size_t pixelCount = size_t(width) * height;
+    std::vector<float> linear(pixelCount * 4);
+    for (size_t i = 0; i < linear.size(); ++i)
+    {
+        linear[i] = (i % 1021) / 1020.0f;
+    }
+    std::vector<uint16_t> half(pixelCount * 4);
+    std::vector<float> linear2(pixelCount * 4);
+    std::vector<uint8_t> rgba(pixelCount * 4);
+    std::vector<uint8_t> bgra(pixelCount * 4);
+
+    struct Case
+    {
+        const char* name;
+        const void* src;
+        Format srcFormat;
+        void* dst;
+        Format dstFormat;
+        int flags;
+    };
+    const Case cases[] = {
+        { "pixel_convert_float_to_half", linear.data(), R32G32B32A32F, half.data(), R16G16B16A16F, 0 },
+        { "pixel_convert_half_to_float", half.data(), R16G16B16A16F, linear2.data(), R32G32B32A32F, 0 },
+        { "pixel_convert_float_to_unorm8", linear.data(), R32G32B32A32F, rgba.data(), R8G8B8A8, 0 },
+        { "pixel_convert_rgba8_to_bgra8", rgba.data(), R8G8B8A8, bgra.data(), B8G8R8A8, 0 },
+        { "pixel_convert_srgb_encode", linear.data(), R32G32B32A32F, rgba.data(), R8G8B8A8, Srgb },
+        { "pixel_convert_srgb_decode", rgba.data(), R8G8B8A8, linear2.data(), R32G32B32A32F, Srgb },
+    };
+    std::string text = std::string("Pixel convert (") + GetHalfImplementation() + "):";
+    char buf[128];
+    for (const auto& c : cases)
+    {
+        const size_t srcPitch = width * GetBytesPerPixel(c.srcFormat);
+        const size_t dstPitch = width * GetBytesPerPixel(c.dstFormat);
+        results.push_back(Benchmark::Run(c.name, 20, [&]() {
+            ConvertImage(c.src, srcPitch, c.srcFormat, c.dst, dstPitch, c.dstFormat, width, height, c.flags);
+        }, 2));
+        snprintf(buf, sizeof(buf), " %s %.2f GB/s", c.name + strlen("pixel_convert_"),
+            srcPitch * height / results.back().medianNs);
+        text += buf;
+    }
+    text += "\n";
+    Log(text.c_str());
+}
+
+// 画面の保存のワーカースレッドでの PNG の符号化. 読み戻した画像の代わりに合成した画像を使う.
+void BenchCaptureEncode(std::vector<Benchmark::Result>& results)
+{
+    const int width = 1280;
+    const int height = 720;
+    CaptureQueue::Frame frame;
+    frame.encoding = CaptureQueue::Png;
+    frame.convertFlags = 0;
+    frame.opaque = true;
+    frame.format = PixelConvert::B8G8R8A8;
+    frame.width = width;
+    frame.height = height;
+    frame.pitch = width * 4;
+    frame.pixels.resize(frame.pitch * height);
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            uint8_t* p = &frame.pixels[frame.pitch * y + x * 4];
+            p[0] = uint8_t(x * 255 / width);
+            p[1] = uint8_t(y * 255 / height);
+            p[2] = uint8_t(128 + 100 * sinf(x * 0.05f + y * 0.03f));
+            p[3] = 255;
+        }
+    }
+    std::vector<uint8_t> encoded;
+    results.push_back(Benchmark::Run("capture_encode_png_720p", 10, [&]() {
+        CaptureQueue::Encode(frame, encoded);
+    }, 1));
+
+    char buf[128];
+    snprintf(buf, sizeof(buf), "Capture PNG 720p: %.1f KB, %.2f ms\n",
+        encoded.size() / 1024.0, results.back().medianNs * 1e-6);
+    Log(buf);
+}
+
+// App::Initialize のカメラ行列と, 描画時のモデルごとの行列の計算.
+Benchmark::Result BenchCameraMatrices()
+{
+    return Benchmark::Run("camera_matrices", 10000, []() {
+        XMMATRIX view, proj;
+        DeferredScene::BuildCameraMatrices(ScreenWidth, ScreenHeight, view, proj);
+
+        XMFLOAT4X4 mtxViewProj;
+        XMStoreFloat4x4(&mtxViewProj, XMMatrixTranspose(view * proj));
+        float sum = mtxViewProj.m[0][0];
+
+        const XMFLOAT3* modelPos = DeferredScene::GetModelPositions();
+        for (int i = 0; i < DeferredScene::ModelCount; ++i)
+        {
+            XMFLOAT4X4 world;
+            XMStoreFloat4x4(&world, XMMatrixTranspose(
+                XMMatrixTranslation(modelPos[i].x, modelPos[i].y, modelPos[i].z)));
+            sum += world.m[0][3];
+        }
+        g_sink = sum;
+    });
+}
+
+// ライティングパスの CPU リファレンス.
+Benchmark::Result BenchLightingReference()
+{
+    LightingReference::GBuffer gbuffer;
+    LightingReference::BuildGBuffer(ScreenWidth / 4, ScreenHeight / 4, gbuffer);
+
+    int lightCount;
+    const DeferredScene::LightInfo* lights = DeferredScene::GetLights(lightCount);
+    std::vector<XMFLOAT4> output;
+    return Benchmark::Run("lighting_reference_320x180", 20, [&]() {
+        LightingReference::Shade(gbuffer, lights, lightCount, output);
+        g_sink = output[output.size() / 2].x;
+    });
+}
+
+// 光の寄与を 1/2, 1/4 の解像度で計算して補間するライティングの CPU リファレンス.
+// 全ての画素で計算した結果との誤差と, 見積もった GPU のコストの比を出力する.
+void BenchLightingReduced(std::vector<Benchmark::Result>& results)
+{
+    LightingReference::GBuffer gbuffer;
+    LightingReference::BuildGBuffer(ScreenWidth / 2, ScreenHeight / 2, gbuffer);
+
+    int lightCount;
+    const DeferredScene::LightInfo* lights = DeferredScene::GetLights(lightCount);
+    std::vector<XMFLOAT4> reference;
+    LightingReference::Shade(gbuffer, lights, lightCount, reference);
+    const LightingReference::Cost fullCost = LightingReference::EstimateCost(gbuffer.width, gbuffer.height, lightCount, 1, 0.0);
+
+    const struct
+    {
+        const char* name;
+        int factor;
+    } cases[] = {
+        { "lighting_reduced_half_640x360", 2 },
+        { "lighting_reduced_quarter_640x360", 4 },
+    };
+    for (const auto& c : cases)
+    {
+        const LightingReference::UpsampleParams params = LightingReference::GetDefaultUpsampleParams(c.factor);
+        std::vector<XMFLOAT4> output;
+        size_t fallbackCount = 0;
+        results.push_back(Benchmark::Run(c.name, 10, [&]() {
+            fallbackCount = LightingReference::ShadeReduced(gbuffer, lights, lightCount, params, output);
+            g_sink = output[output.size() / 2].x;
+        }));
+
+        const double fallbackRatio = double(fallbackCount) / double(output.size());
+        const LightingReference::ImageError error = LightingReference::CompareImages(reference, output);
+        const LightingReference::Cost cost = LightingReference::EstimateCost(gbuffer.width, gbuffer.height, lightCount, c.factor, fallbackRatio);
+
+        char buf[256];
+        snprintf(buf, sizeof(buf),
+            "Reduced lighting: %s PSNR %.1f dB, max error %.3f, %.2f%% bad, %.2f%% fallback, ALU x%.2f, fetches x%.2f\n",
+            c.name, error.psnr, error.maxError, 100.0 * error.badPixelRatio, 100.0 * fallbackRatio,
+            cost.aluInstructions / fullCost.aluInstructions, cost.textureFetches / fullCost.textureFetches);
+        Log(buf);
+    }
+}
+
+// パスが一列に並んだフレームグラフの解決.
+Benchmark::Result BenchFrameGraphCompile()
+{
+    const int passCount = 1000;
+    FrameGraphCompiler compiler;
+    return Benchmark::Run("framegraph_compile_1000", 100, [&]() {
+        compiler.Reset();
+        int backBuffer = compiler.AddResource(true);
+        int prev = -1;
+        for (int i = 0; i < passCount; ++i)
+        {
+            int pass = compiler.AddPass(false);
+            if (prev >= 0)
+            {
+                compiler.AddRead(pass, prev);
+            }
+            prev = compiler.AddResource(false);
+            compiler.AddWrite(pass, prev);
+        }
+        int present = compiler.AddPass(true);
+        compiler.AddRead(present, prev);
+        compiler.AddWrite(present, backBuffer);
+        compiler.Compile();
+    });
+}
+
+// 64K 個の物体の行列の更新と視錐台カリングを, スレッド数を 1 から 64 まで変えて実行する.
+// カリングのジョブは行列の更新のジョブの完了を待つ依存関係で追加する.
+// 細かいジョブの負荷を見るため, 何もしないジョブの ParallelFor も計る.
+void BenchJobSystem(std::vector<Benchmark::Result>& results)
+{
+    const size_t objectCount = 64 * 1024;
+    const size_t chunkSize = 512;
+    std::vector<XMFLOAT4> objects(objectCount);  // xyz が位置, w が回転.
+    for (size_t i = 0; i < objectCount; ++i)
+    {
+        objects[i] = XMFLOAT4(float(i % 256) - 128.0f, float(i / 256 % 16), float(i / 4096) * 16.0f, i * 0.01f);
+    }
+    std::vector<XMFLOAT4X4> worlds(objectCount);
+    std::vector<uint8_t> visible(objectCount);
+
+    const XMMATRIX viewProj = XMMatrixLookAtLH(XMVectorSet(0.0f, 8.0f, -50.0f, 1.0f), XMVectorSet(0.0f, 0.0f, 100.0f, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f))
+        * XMMatrixPerspectiveFovLH(XMConvertToRadians(60.0f), float(ScreenWidth) / ScreenHeight, 1.0f, 200.0f);
+    XMFLOAT4X4 m;
+    XMStoreFloat4x4(&m, XMMatrixTranspose(viewProj));
+    const XMVECTOR c0 = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(m.m[0]));
+    const XMVECTOR c1 = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(m.m[1]));
+    const XMVECTOR c2 = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(m.m[2]));
+    const XMVECTOR c3 = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(m.m[3]));
+    XMFLOAT4 planes[6];
+    XMStoreFloat4(&planes[0], XMPlaneNormalize(XMVectorAdd(c3, c0)));
+    XMStoreFloat4(&planes[1], XMPlaneNormalize(XMVectorSubtract(c3, c0)));
+    XMStoreFloat4(&planes[2], XMPlaneNormalize(XMVectorAdd(c3, c1)));
+    XMStoreFloat4(&planes[3], XMPlaneNormalize(XMVectorSubtract(c3, c1)));
+    XMStoreFloat4(&planes[4], XMPlaneNormalize(c2));
+    XMStoreFloat4(&planes[5], XMPlaneNormalize(XMVectorSubtract(c3, c2)));
+
+    auto updateTransforms = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const XMFLOAT4& object = objects[i];
+            XMStoreFloat4x4(&worlds[i], XMMatrixScaling(0.5f, 0.5f, 0.5f)
+                * XMMatrixRotationY(object.w) * XMMatrixTranslation(object.x, object.y, object.z));
+        }
+    };
+    auto cull = [&](size_t begin, size_t end) {
+        const XMVECTOR center = XMVectorSet(0.0f, 0.5f, 0.0f, 1.0f);
+        for (size_t i = begin; i < end; ++i)
+        {
+            const XMVECTOR position = XMVector3TransformCoord(center, XMLoadFloat4x4(&worlds[i]));
+            bool inside = true;
+            for (const auto& plane : planes)
+            {
+                inside = inside && XMVectorGetX(XMPlaneDotCoord(XMLoadFloat4(&plane), position)) > -1.0f;
+            }
+            visible[i] = inside ? 1 : 0;
+        }
+    };
+
+    const int threadCounts[] = { 1, 2, 4, 8, 16, 32, 64 };
+    std::string report = "Job system scaling (cull_64k):";
+    double singleNs = 0.0;
+    int visibleCount = 0;
+    char name[64];
+    for (int threadCount : threadCounts)
+    {
+        JobSystem jobs(threadCount);
+        snprintf(name, sizeof(name), "job_system_cull_64k_%dthreads", threadCount);
+        results.push_back(Benchmark::Run(name, 50, [&]() {
+            JobCounter transformed;
+            JobCounter culled;
+            for (size_t begin = 0; begin < objectCount; begin += chunkSize)
+            {
+                jobs.Run([&, begin]() { updateTransforms(begin, begin + chunkSize); }, &transformed);
+            }
+            for (size_t begin = 0; begin < objectCount; begin += chunkSize)
+            {
+                jobs.Run([&, begin]() { cull(begin, begin + chunkSize); }, &culled, &transformed);
+            }
+            jobs.Wait(culled);
+        }));
+        const double ns = results.back().medianNs;
+        if (threadCount == 1)
+        {
+            singleNs = ns;
+            visibleCount = 0;
+            for (uint8_t v : visible)
+            {
+                visibleCount += v;
+            }
+        }
+        char buf[64];
+        snprintf(buf, sizeof(buf), " %d:%.2fx", threadCount, ns > 0.0 ? singleNs / ns : 0.0);
+        report += buf;
+
+        snprintf(name, sizeof(name), "job_system_empty_64k_%dthreads", threadCount);
+        std::atomic<int> executed(0);
+        results.push_back(Benchmark::Run(name, 20, [&]() {
+            jobs.ParallelFor(objectCount, 1, [&](size_t begin, size_t end) {
+                executed.fetch_add(int(end - begin), std::memory_order_relaxed);
+            });
+        }));
+        if (threadCount == threadCounts[sizeof(threadCounts) / sizeof(threadCounts[0]) - 1])
+        {
+            report += "\n" + jobs.Report();
+        }
+    }
+    char buf[64];
+    snprintf(buf, sizeof(buf), "Job system: %d/%d visible\n", visibleCount, int(objectCount));
+    report = buf + report;
+    Log(report.c_str());
+}
+}
+
+void RunCpuBenchmarks(std::vector<Benchmark::Result>& results)
+{
+    results.push_back(BenchTeapotLodChain());
+    results.push_back(BenchMeshletCull());
+    BenchMeshBuilder(results);
+    BenchMeshCodec(results);
+    BenchMeshImporter(results);
+    BenchFileLoading(results);
+    BenchAssetArchive(results);
+    BenchPixelConvert(results);
+    BenchCaptureEncode(results);
+    BenchGeometryProcessing(results);
+    results.push_back(BenchCameraMatrices());
+    results.push_back(BenchLightingReference());
+    BenchLightingReduced(results);
+    results.push_back(BenchFrameGraphCompile());
+    BenchJobSystem(results);
+}
@@ -0,0 +1,9 @@
+﻿#pragma once
+#include <vector>
+
+#include "Benchmark.h"
+
+// D3D を使わない CPU 側の処理のベンチマーク.
+// RunBenchmarkSuite から呼ぶほか, tools/CpuBenchmark.cpp で Linux 向けにもビルドします.
+// 各項目の補足 (圧縮率や結果の一致など) は標準エラー出力へ書きます.
+void RunCpuBenchmarks(std::vector<Benchmark::Result>& results);
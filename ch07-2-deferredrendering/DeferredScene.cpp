@@ -0,0 +1,119 @@
+﻿#include "DeferredScene.h"
+#include "TeapotModel.h"
+
+using namespace DirectX;
+
+namespace DeferredScene
+{
+const Camera& GetCamera()
+{
+    // カメラ（視点）の情報.
+    static const Camera camera = {
+        XMFLOAT3(0.0f, 4.0f, -10.0f),
+        XMFLOAT3(0.0f, 0.0f, 0.0f),
+        XMFLOAT3(0.0f, 1.0f, 0.0f),
+        XMConvertToRadians(45.f),
+        0.1f,
+        100.0f,
+    };
+    return camera;
+}
+
+Camera GetOrbitCamera(float yaw)
+{
+    Camera camera = GetCamera();
+    const XMVECTOR target = XMLoadFloat3(&camera.eyeTarget);
+    const XMVECTOR offset = XMVector3TransformNormal(XMLoadFloat3(&camera.eyePos) - target, XMMatrixRotationY(yaw));
+    XMStoreFloat3(&camera.eyePos, target + offset);
+    return camera;
+}
+
+void BuildCameraMatrices(int width, int height, XMMATRIX& view, XMMATRIX& proj)
+{
+    BuildCameraMatrices(GetCamera(), width, height, view, proj);
+}
+
+void BuildCameraMatrices(const Camera& camera, int width, int height, XMMATRIX& view, XMMATRIX& proj)
+{
+    view = XMMatrixLookAtLH(
+        XMLoadFloat3(&camera.eyePos),
+        XMLoadFloat3(&camera.eyeTarget),
+        XMLoadFloat3(&camera.eyeUp)
+    );
+
+    // プロジェクション行列.
+    float aspect = float(width) / float(height);
+    proj = XMMatrixPerspectiveFovLH(
+        camera.fovY,
+        aspect,
+        camera.nearZ,
+        camera.farZ
+    );
+}
+
+const XMFLOAT3* GetModelPositions()
+{
+    static const XMFLOAT3 modelPos[ModelCount] = {
+        XMFLOAT3(0.0f, 0.85f, 0.0f),
+        XMFLOAT3(-3.0f, 0.85f, -2.0f),
+        XMFLOAT3(+3.0f, 0.85f, -2.0f),
+        XMFLOAT3(-3.0f, 0.85f,  2.0f),
+        XMFLOAT3(+3.0f, 0.85f,  2.0f),
+    };
+    return modelPos;
+}
+
+const XMFLOAT4* GetModelColors()
+{
+    static const XMFLOAT4 teapotColor[ModelCount] = {
+        XMFLOAT4(0.8f, 1.0f,0.8f, 1.0f),
+        XMFLOAT4(0.8f, 0.7f,0.6f, 1.0f),
+        XMFLOAT4(0.3f, 0.5f,0.4f, 1.0f),
+        XMFLOAT4(0.3f, 0.5f,0.7f, 1.0f),
+        XMFLOAT4(0.8f, 0.8f,0.8f, 1.0f),
+    };
+    return teapotColor;
+}
+
+const LightInfo* GetLights(int& count)
+{
+    static const LightInfo lightInfo[] = {
+        { XMFLOAT4(0.0f, 8.0f,-4.0f, 10.0f), XMFLOAT4(1.0f,1.0f,1.0f,1) }, // Amb
+        // 各 teapot 照らし用
+        { XMFLOAT4( 0.0f, 2.3f,-1.0f, 2.0f), XMFLOAT4(1.0f,1.0f,1.0f,1) },
+        { XMFLOAT4(-3.5f, 2.3f,-3.0f, 2.0f), XMFLOAT4(0.6f,0.1f,1.0f,1) },
+        { XMFLOAT4(+3.5f, 2.3f,-3.0f, 2.0f), XMFLOAT4(0.0f,1.0f,0.0f,1) },
+        { XMFLOAT4(-3.5f, 2.3f,+1.0f, 2.0f), XMFLOAT4(0.0f,0.0f,1.0f,1) },
+        { XMFLOAT4(+3.5f, 2.3f,+1.0f, 2.0f), XMFLOAT4(1.0f,0.0f,0.0f,1) },
+
+        { XMFLOAT4(-1.5f, 1.0f, -3.5f, 3.0f), XMFLOAT4(0.0f,0.8f,0.0f,1) },
+        { XMFLOAT4(+1.5f, 1.0f, -3.5f, 3.0f), XMFLOAT4(0.3f,0.6f,1.0f,1) },
+        { XMFLOAT4(-1.5f, 1.0f,  0.5f, 3.0f), XMFLOAT4(1.0f,0.9f,0.1f,1) },
+        { XMFLOAT4(+1.5f, 1.0f,  0.5f, 3.0f), XMFLOAT4(1.0f,0.4f,0.9f,1) },
+
+        { XMFLOAT4( 0.0f, 1.5, -1.5f, 2.0f), XMFLOAT4(0.3f,0.1f,0.9f,1) }, 
+        { XMFLOAT4(-2.5f, 3.0f,  -.5f, 4.0f), XMFLOAT4(0.3f,1.0f,0.9f,1) },
+        { XMFLOAT4( 2.75f,0.85f, 1.0f, 3.0f), XMFLOAT4(0.3f,1.0f,0.9f,1) },
+
+        { XMFLOAT4(-3.0f, 1.5f,-4.0f, 2.5f), XMFLOAT4(0.3f,0.8f,1.0f,1) },
+        { XMFLOAT4(+3.0f, 1.5f,-4.0f, 2.5f), XMFLOAT4(0.8f,0.1f,1.0f,1) },
+        { XMFLOAT4(+2.5f, 0.5f, 1.0f, 2.5f), XMFLOAT4(1.0f,0.7f,0.1f,1) },
+
+    };
+    count = int(sizeof(lightInfo) / sizeof(lightInfo[0]));
+    return lightInfo;
+}
+
+const void* GetTeapotVertices(size_t& length, size_t& stride)
+{
+    length = sizeof(TeapotModel::TeapotVerticesPN);
+    stride = sizeof(TeapotModel::Vertex);
+    return TeapotModel::TeapotVerticesPN;
+}
+
+const uint16_t* GetTeapotIndices(size_t& length)
+{
+    length = sizeof(TeapotModel::TeapotIndices);
+    return TeapotModel::TeapotIndices;
+}
+}
@@ -0,0 +1,49 @@
+﻿#pragma once
+#include <DirectXMath.h>
+#include <cstddef>
+#include <cstdint>
+
+// サンプルで描画するシーン (カメラ, ティーポットの配置, ライト) の定義.
+// App の描画, ベンチマーク, CPU でのライティング計算から共有します.
+namespace DeferredScene
+{
+    struct Camera
+    {
+        DirectX::XMFLOAT3 eyePos;
+        DirectX::XMFLOAT3 eyeTarget;
+        DirectX::XMFLOAT3 eyeUp;
+        float fovY;     // ラジアン.
+        float nearZ;
+        float farZ;
+    };
+
+    // ライティングパスのシェーダー定数と同じ並び.
+    struct LightInfo
+    {
+        DirectX::XMFLOAT4 Pos;      // w は影響半径.
+        DirectX::XMFLOAT4 Color;
+    };
+
+    const int ModelCount = 5;
+
+    // シミュレーションのスレッドから描画スレッドへ渡す状態.
+    struct Snapshot
+    {
+        uint32_t tick;      // シミュレーションを進めた回数.
+        Camera camera;
+    };
+
+    const Camera& GetCamera();
+    // GetCamera() の視点を, 注視点を通る Y 軸の周りに yaw (ラジアン) だけ回したカメラを返します.
+    Camera GetOrbitCamera(float yaw);
+    void BuildCameraMatrices(int width, int height, DirectX::XMMATRIX& view, DirectX::XMMATRIX& proj);
+    void BuildCameraMatrices(const Camera& camera, int width, int height, DirectX::XMMATRIX& view, DirectX::XMMATRIX& proj);
+
+    const DirectX::XMFLOAT3* GetModelPositions();
+    const DirectX::XMFLOAT4* GetModelColors();
+    const LightInfo* GetLights(int& count);
+
+    // ティーポットの頂点 (位置, 法線) とインデックス.
+    const void* GetTeapotVertices(size_t& length, size_t& stride);
+    const uint16_t* GetTeapotIndices(size_t& length);
+}
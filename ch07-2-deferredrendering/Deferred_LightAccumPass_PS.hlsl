@@ -0,0 +1,49 @@
+sampler2D texWorldPos : register(s0);
+sampler2D texWorldNormal : register(s1);
+
+#define NUM_LIGHTS (16)
+
+struct LightInfo
+{
+    float4 PosAndRadius;
+    float4 Color;
+};
+
+LightInfo lightInfo[NUM_LIGHTS] : register(c0);
+
+float4 SampleParams : register(c32);
+float4 GBufferSize : register(c33);
+
+float Attenuation(float lightRadius, float distance)
+{
+    return 1.0 - smoothstep(lightRadius * 0.6, lightRadius, distance);
+}
+
+float4 main(float2 vpos : VPOS) : COLOR
+{
+    float2 texel = min(vpos * SampleParams.x + SampleParams.y, SampleParams.zw);
+    float2 uv = (texel + 0.5) * GBufferSize.zw;
+
+    float4 world = tex2D(texWorldPos, uv);
+    float4 rawNormal = tex2D(texWorldNormal, uv);
+    if (dot(rawNormal, rawNormal) == 0)
+    {
+        return float4(0,0,0,1);
+    }
+    float4 worldNormal = normalize(rawNormal);
+
+    float3 irradiance = 0;
+    for (int i = 0; i < NUM_LIGHTS; ++i)
+    {
+        LightInfo light = lightInfo[i];
+        float3 lpos = light.PosAndRadius.xyz;
+        float lr = light.PosAndRadius.w;
+
+        float3 L = lpos - world.xyz;
+        float3 lightDir = normalize(L);
+        float att = Attenuation(lr, length(L));
+
+        irradiance += max(0, dot(lightDir, worldNormal.xyz)) * light.Color.xyz * att;
+    }
+    return float4(irradiance, 1);
+}
\ No newline at end of file
@@ -10,6 +10,8 @@ struct VS_OUTPUT
     float2 UV : TEXCOORD0;
 };
 
+float4 UVScale : register(c0);
+
 //#@@range_begin(vertex_offset)
 VS_OUTPUT main(VS_INPUT _In)
 {
@@ -18,7 +20,7 @@ VS_OUTPUT main(VS_INPUT _In)
     vsOut.Pos = _In.Pos;
     vsOut.Pos.x -= 0.5 / 1280;
     vsOut.Pos.y += 0.5 / 720;
-    vsOut.UV = _In.UV;
+    vsOut.UV = _In.UV * UVScale.xy;
     return vsOut;
 }
 //#@@range_end(vertex_offset)
@@ -0,0 +1,103 @@
+struct VS_OUTPUT
+{
+    float4 Pos : POSITION;
+    float2 UV : TEXCOORD0;
+};
+
+sampler2D texWorldPos : register(s0);
+sampler2D texWorldNormal : register(s1);
+sampler2D texDiffuse : register(s2);
+sampler2D texLight : register(s3);
+
+#define NUM_LIGHTS (16)
+
+struct LightInfo
+{
+    float4 PosAndRadius;
+    float4 Color;
+};
+
+LightInfo lightInfo[NUM_LIGHTS] : register(c0);
+
+float4 SampleParams : register(c32);
+float4 GBufferSize : register(c33);
+float4 LightSize : register(c34);
+float4 UpsampleParams : register(c35);
+
+static const float2 TapOffsets[4] = {
+    float2(0, 0), float2(1, 0), float2(0, 1), float2(1, 1)
+};
+
+float Attenuation(float lightRadius, float distance)
+{
+    return 1.0 - smoothstep(lightRadius * 0.6, lightRadius, distance);
+}
+
+float4 main(VS_OUTPUT _In) : COLOR
+{
+    float2 uv = _In.UV.xy;
+
+    float4 diffuse = tex2Dlod(texDiffuse, float4(uv, 0, 0));
+    float4 world = tex2Dlod(texWorldPos, float4(uv, 0, 0));
+    float4 rawNormal = tex2Dlod(texWorldNormal, float4(uv, 0, 0));
+    float lenSq = dot(rawNormal.xyz, rawNormal.xyz);
+    if (lenSq == 0)
+    {
+        return float4(0,0,0,1);
+    }
+    float3 n = rawNormal.xyz * rsqrt(lenSq);
+
+//#@@range_begin(bilateral_upsample)
+    float2 g = uv * GBufferSize.xy - 0.5;
+    float2 l = (g - SampleParams.y) / SampleParams.x;
+    float2 l0 = floor(l);
+    float2 f = l - l0;
+
+    float3 sum = 0;
+    float totalWeight = 0;
+    [unroll]
+    for (int i = 0; i < 4; ++i)
+    {
+        float2 tap = clamp(l0 + TapOffsets[i], 0, LightSize.xy);
+        float2 texel = min(tap * SampleParams.x + SampleParams.y, SampleParams.zw);
+        float2 tapUV = (texel + 0.5) * GBufferSize.zw;
+
+        float3 pi = tex2Dlod(texWorldPos, float4(tapUV, 0, 0)).xyz;
+        float3 ni = tex2Dlod(texWorldNormal, float4(tapUV, 0, 0)).xyz;
+        ni *= rsqrt(max(dot(ni, ni), 1e-8));
+        float3 e = tex2Dlod(texLight, float4((tap + 0.5) * LightSize.zw, 0, 0)).xyz;
+
+        float2 bilinear = lerp(1 - f, f, TapOffsets[i]);
+        float normalWeight = pow(saturate(dot(n, ni)), UpsampleParams.x);
+        float plane = abs(dot(n, pi - world.xyz));
+        float weight = bilinear.x * bilinear.y * normalWeight / (1 + UpsampleParams.y * plane);
+
+        sum += e * weight;
+        totalWeight += weight;
+    }
+//#@@range_end(bilateral_upsample)
+
+    float3 irradiance;
+    if (totalWeight > 0 && totalWeight >= UpsampleParams.z)
+    {
+        irradiance = sum / totalWeight;
+    }
+    else
+    {
+        float4 worldNormal = normalize(rawNormal);
+        irradiance = 0;
+        for (int j = 0; j < NUM_LIGHTS; ++j)
+        {
+            LightInfo light = lightInfo[j];
+            float3 lpos = light.PosAndRadius.xyz;
+            float lr = light.PosAndRadius.w;
+
+            float3 L = lpos - world.xyz;
+            float3 lightDir = normalize(L);
+            float att = Attenuation(lr, length(L));
+
+            irradiance += max(0, dot(lightDir, worldNormal.xyz)) * light.Color.xyz * att;
+        }
+    }
+    return float4(irradiance * diffuse.xyz, 1);
+}
\ No newline at end of file
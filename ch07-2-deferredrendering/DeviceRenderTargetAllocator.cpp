@@ -0,0 +1,74 @@
+﻿#include "DeviceRenderTargetAllocator.h"
+#include "RenderTarget.h"
+
+DeviceRenderTargetAllocator::DeviceRenderTargetAllocator(IDirect3DDevice9Ex* d3dDev)
+    : m_d3dDev(d3dDev)
+{
+    if (m_d3dDev)
+    {
+        m_d3dDev->AddRef();
+    }
+}
+
+DeviceRenderTargetAllocator::~DeviceRenderTargetAllocator()
+{
+    if (m_d3dDev)
+    {
+        m_d3dDev->Release();
+    }
+    m_d3dDev = nullptr;
+}
+
+RenderTarget* DeviceRenderTargetAllocator::Create(const RenderTargetDesc& desc)
+{
+    HRESULT hr;
+    IDirect3DTexture9* renderTexture = nullptr;
+    hr = m_d3dDev->CreateTexture(
+        desc.width,
+        desc.height,
+        1,
+        desc.usage,
+        D3DFORMAT(desc.format),
+        D3DPOOL_DEFAULT,
+        &renderTexture,
+        nullptr);
+    if (FAILED(hr))
+    {
+        return nullptr;
+    }
+    RenderTarget* target = new RenderTarget(m_d3dDev, renderTexture);
+    renderTexture->Release();
+    return target;
+}
+
+void DeviceRenderTargetAllocator::Destroy(RenderTarget* target)
+{
+    delete target;
+}
+
+uint64_t DeviceRenderTargetAllocator::EstimateSize(const RenderTargetDesc& desc) const
+{
+    uint64_t bytesPerPixel;
+    switch (desc.format)
+    {
+    case D3DFMT_A32B32G32R32F:
+        bytesPerPixel = 16;
+        break;
+    case D3DFMT_A16B16G16R16F:
+    case D3DFMT_A16B16G16R16:
+    case D3DFMT_G32R32F:
+        bytesPerPixel = 8;
+        break;
+    case D3DFMT_R16F:
+    case D3DFMT_D16:
+        bytesPerPixel = 2;
+        break;
+    case D3DFMT_L8:
+        bytesPerPixel = 1;
+        break;
+    default:
+        bytesPerPixel = 4;
+        break;
+    }
+    return uint64_t(desc.width) * desc.height * bytesPerPixel;
+}
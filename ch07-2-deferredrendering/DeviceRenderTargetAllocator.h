@@ -0,0 +1,19 @@
+﻿#pragma once
+#include <d3d9.h>
+
+#include "RenderTargetPool.h"
+
+// D3D デバイスでテクスチャを作成するアロケータ.
+class DeviceRenderTargetAllocator : public RenderTargetAllocator
+{
+public:
+    explicit DeviceRenderTargetAllocator(IDirect3DDevice9Ex* d3dDev);
+    virtual ~DeviceRenderTargetAllocator();
+
+    virtual RenderTarget* Create(const RenderTargetDesc& desc);
+    virtual void Destroy(RenderTarget* target);
+    virtual uint64_t EstimateSize(const RenderTargetDesc& desc) const;
+
+private:
+    IDirect3DDevice9Ex* m_d3dDev;
+};
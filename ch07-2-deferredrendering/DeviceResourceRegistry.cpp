@@ -0,0 +1,333 @@
+﻿#include "DeviceResourceRegistry.h"
+#include "MeshCodec.h"
+#include <cstring>
+
+namespace
+{
+template<class T>
+HRESULT CopyToBuffer(T* resource, const void* src, size_t length)
+{
+    void* dst;
+    HRESULT hr = resource->Lock(0, 0, &dst, 0);
+    if (SUCCEEDED(hr))
+    {
+        memcpy(dst, src, length);
+        resource->Unlock();
+    }
+    return hr;
+}
+
+HRESULT DecodeToVertexBuffer(IDirect3DVertexBuffer9* vb, const std::vector<uint8_t>& encoded, UINT vertexCount, UINT stride)
+{
+    void* dst;
+    HRESULT hr = vb->Lock(0, 0, &dst, 0);
+    if (SUCCEEDED(hr))
+    {
+        if (!MeshCodec::DecodeVertices(dst, vertexCount, stride, encoded.data(), encoded.size()))
+        {
+            hr = E_FAIL;
+        }
+        vb->Unlock();
+    }
+    return hr;
+}
+
+HRESULT DecodeToIndexBuffer(IDirect3DIndexBuffer9* ib, const std::vector<uint8_t>& encoded, UINT indexCount, UINT indexSize)
+{
+    void* dst;
+    HRESULT hr = ib->Lock(0, 0, &dst, 0);
+    if (SUCCEEDED(hr))
+    {
+        if (!MeshCodec::DecodeIndices(dst, indexCount, indexSize, encoded.data(), encoded.size()))
+        {
+            hr = E_FAIL;
+        }
+        ib->Unlock();
+    }
+    return hr;
+}
+
+// D3DDECL_END() までの要素数 (終端を含む).
+size_t CountDeclElements(const D3DVERTEXELEMENT9* elements)
+{
+    size_t count = 0;
+    while (elements[count].Stream != 0xFF)
+    {
+        ++count;
+    }
+    return count + 1;
+}
+}
+
+DeviceResourceRegistry::DeviceResourceRegistry(IDirect3DDevice9Ex* d3dDev)
+    : m_d3dDev(d3dDev)
+{
+    if (m_d3dDev)
+    {
+        m_d3dDev->AddRef();
+    }
+}
+
+DeviceResourceRegistry::~DeviceResourceRegistry()
+{
+    Clear();
+    if (m_d3dDev)
+    {
+        m_d3dDev->Release();
+    }
+    m_d3dDev = nullptr;
+}
+
+HRESULT DeviceResourceRegistry::CreateVertexBuffer(IDirect3DVertexBuffer9** slot, const void* data, UINT length)
+{
+    return Register(VertexBuffer, reinterpret_cast<IUnknown**>(slot), data, length, D3DFMT_UNKNOWN);
+}
+
+HRESULT DeviceResourceRegistry::CreateIndexBuffer(IDirect3DIndexBuffer9** slot, const void* data, UINT length, D3DFORMAT format)
+{
+    return Register(IndexBuffer, reinterpret_cast<IUnknown**>(slot), data, length, format);
+}
+
+HRESULT DeviceResourceRegistry::CreateEncodedVertexBuffer(IDirect3DVertexBuffer9** slot, const void* encoded, size_t size, UINT vertexCount, UINT stride)
+{
+    return Register(EncodedVertexBuffer, reinterpret_cast<IUnknown**>(slot), encoded, size, D3DFMT_UNKNOWN, vertexCount, stride);
+}
+
+HRESULT DeviceResourceRegistry::CreateEncodedIndexBuffer(IDirect3DIndexBuffer9** slot, const void* encoded, size_t size, UINT indexCount, D3DFORMAT format)
+{
+    const UINT indexSize = (format == D3DFMT_INDEX32) ? sizeof(uint32_t) : sizeof(uint16_t);
+    return Register(EncodedIndexBuffer, reinterpret_cast<IUnknown**>(slot), encoded, size, format, indexCount, indexSize);
+}
+
+HRESULT DeviceResourceRegistry::CreateVertexDeclaration(IDirect3DVertexDeclaration9** slot, const D3DVERTEXELEMENT9* elements)
+{
+    size_t size = CountDeclElements(elements) * sizeof(D3DVERTEXELEMENT9);
+    return Register(VertexDeclaration, reinterpret_cast<IUnknown**>(slot), elements, size, D3DFMT_UNKNOWN);
+}
+
+HRESULT DeviceResourceRegistry::CreateVertexShader(IDirect3DVertexShader9** slot, const void* code, size_t size)
+{
+    return Register(VertexShader, reinterpret_cast<IUnknown**>(slot), code, size, D3DFMT_UNKNOWN);
+}
+
+HRESULT DeviceResourceRegistry::CreatePixelShader(IDirect3DPixelShader9** slot, const void* code, size_t size)
+{
+    return Register(PixelShader, reinterpret_cast<IUnknown**>(slot), code, size, D3DFMT_UNKNOWN);
+}
+
+HRESULT DeviceResourceRegistry::Register(Kind kind, IUnknown** slot, const void* data, size_t size, D3DFORMAT format,
+    UINT count, UINT stride)
+{
+    Entry entry;
+    entry.kind = kind;
+    entry.slot = slot;
+    entry.format = format;
+    entry.count = count;
+    entry.stride = stride;
+    const uint8_t* src = static_cast<const uint8_t*>(data);
+    entry.data.assign(src, src + size);
+
+    *slot = nullptr;
+    HRESULT hr = Create(entry);
+    if (SUCCEEDED(hr))
+    {
+        m_entries.push_back(std::move(entry));
+    }
+    else if (*slot)
+    {
+        (*slot)->Release();
+        *slot = nullptr;
+    }
+    return hr;
+}
+
+HRESULT DeviceResourceRegistry::Create(Entry& entry)
+{
+    HRESULT hr = E_FAIL;
+    const UINT length = static_cast<UINT>(entry.data.size());
+    switch (entry.kind)
+    {
+    case VertexBuffer:
+        {
+            IDirect3DVertexBuffer9* vb = nullptr;
+            hr = m_d3dDev->CreateVertexBuffer(length, 0, 0, D3DPOOL_DEFAULT, &vb, nullptr);
+            if (SUCCEEDED(hr))
+            {
+                hr = CopyToBuffer(vb, entry.data.data(), length);
+                *entry.slot = vb;
+            }
+        }
+        break;
+
+    case IndexBuffer:
+        {
+            IDirect3DIndexBuffer9* ib = nullptr;
+            hr = m_d3dDev->CreateIndexBuffer(length, 0, entry.format, D3DPOOL_DEFAULT, &ib, nullptr);
+            if (SUCCEEDED(hr))
+            {
+                hr = CopyToBuffer(ib, entry.data.data(), length);
+                *entry.slot = ib;
+            }
+        }
+        break;
+
+    case EncodedVertexBuffer:
+        {
+            IDirect3DVertexBuffer9* vb = nullptr;
+            hr = m_d3dDev->CreateVertexBuffer(entry.count * entry.stride, 0, 0, D3DPOOL_DEFAULT, &vb, nullptr);
+            if (SUCCEEDED(hr))
+            {
+                hr = DecodeToVertexBuffer(vb, entry.data, entry.count, entry.stride);
+                *entry.slot = vb;
+            }
+        }
+        break;
+
+    case EncodedIndexBuffer:
+        {
+            IDirect3DIndexBuffer9* ib = nullptr;
+            hr = m_d3dDev->CreateIndexBuffer(entry.count * entry.stride, 0, entry.format, D3DPOOL_DEFAULT, &ib, nullptr);
+            if (SUCCEEDED(hr))
+            {
+                hr = DecodeToIndexBuffer(ib, entry.data, entry.count, entry.stride);
+                *entry.slot = ib;
+            }
+        }
+        break;
+
+    case VertexDeclaration:
+        {
+            IDirect3DVertexDeclaration9* decl = nullptr;
+            hr = m_d3dDev->CreateVertexDeclaration(
+                reinterpret_cast<const D3DVERTEXELEMENT9*>(entry.data.data()), &decl);
+            *entry.slot = decl;
+        }
+        break;
+
+    case VertexShader:
+        {
+            IDirect3DVertexShader9* vs = nullptr;
+            hr = m_d3dDev->CreateVertexShader(reinterpret_cast<const DWORD*>(entry.data.data()), &vs);
+            *entry.slot = vs;
+        }
+        break;
+
+    case PixelShader:
+        {
+            IDirect3DPixelShader9* ps = nullptr;
+            hr = m_d3dDev->CreatePixelShader(reinterpret_cast<const DWORD*>(entry.data.data()), &ps);
+            *entry.slot = ps;
+        }
+        break;
+    }
+    return hr;
+}
+
+void DeviceResourceRegistry::ReleaseAll()
+{
+    for (auto& entry : m_entries)
+    {
+        if (*entry.slot)
+        {
+            (*entry.slot)->Release();
+        }
+        *entry.slot = nullptr;
+    }
+    if (m_d3dDev)
+    {
+        m_d3dDev->Release();
+    }
+    m_d3dDev = nullptr;
+}
+
+HRESULT DeviceResourceRegistry::RecreateAll(IDirect3DDevice9Ex* d3dDev)
+{
+    if (m_d3dDev)
+    {
+        m_d3dDev->Release();
+    }
+    m_d3dDev = d3dDev;
+    m_d3dDev->AddRef();
+
+    HRESULT result = S_OK;
+    for (auto& entry : m_entries)
+    {
+        if (*entry.slot)
+        {
+            (*entry.slot)->Release();
+            *entry.slot = nullptr;
+        }
+        HRESULT hr = Create(entry);
+        if (FAILED(hr) && SUCCEEDED(result))
+        {
+            result = hr;
+        }
+    }
+    return result;
+}
+
+void DeviceResourceRegistry::Clear()
+{
+    for (auto& entry : m_entries)
+    {
+        if (*entry.slot)
+        {
+            (*entry.slot)->Release();
+        }
+        *entry.slot = nullptr;
+    }
+    m_entries.clear();
+}
+
+size_t DeviceResourceRegistry::CountCreatedOn(IDirect3DDevice9* d3dDev) const
+{
+    size_t count = 0;
+    for (const auto& entry : m_entries)
+    {
+        IUnknown* object = *entry.slot;
+        if (!object)
+        {
+            continue;
+        }
+        IDirect3DDevice9* owner = nullptr;
+        switch (entry.kind)
+        {
+        case VertexBuffer:
+        case EncodedVertexBuffer:
+            static_cast<IDirect3DVertexBuffer9*>(object)->GetDevice(&owner);
+            break;
+        case IndexBuffer:
+        case EncodedIndexBuffer:
+            static_cast<IDirect3DIndexBuffer9*>(object)->GetDevice(&owner);
+            break;
+        case VertexDeclaration:
+            static_cast<IDirect3DVertexDeclaration9*>(object)->GetDevice(&owner);
+            break;
+        case VertexShader:
+            static_cast<IDirect3DVertexShader9*>(object)->GetDevice(&owner);
+            break;
+        case PixelShader:
+            static_cast<IDirect3DPixelShader9*>(object)->GetDevice(&owner);
+            break;
+        }
+        if (owner)
+        {
+            if (owner == d3dDev)
+            {
+                ++count;
+            }
+            owner->Release();
+        }
+    }
+    return count;
+}
+
+size_t DeviceResourceRegistry::GetSourceBytes() const
+{
+    size_t total = 0;
+    for (const auto& entry : m_entries)
+    {
+        total += entry.data.size();
+    }
+    return total;
+}
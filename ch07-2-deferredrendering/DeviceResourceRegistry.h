@@ -0,0 +1,68 @@
+﻿#pragma once
+#include <d3d9.h>
+#include <cstdint>
+#include <vector>
+
+// デバイスの作り直しに備えて, 作成したリソースの作成パラメータと元データを保持するクラス.
+// D3DERR_DEVICEHUNG / D3DERR_DEVICEREMOVED からの復帰時には
+// ReleaseAll() でオブジェクトを解放し, 新しいデバイスで RecreateAll() を呼び出します.
+//
+// 作成したオブジェクトは slot の指す変数へ書き込まれ, 再作成時にもそこが更新されます.
+// slot の指す変数はレジストリより長く生存している必要があります.
+class DeviceResourceRegistry
+{
+public:
+    explicit DeviceResourceRegistry(IDirect3DDevice9Ex* d3dDev);
+    ~DeviceResourceRegistry();
+
+    HRESULT CreateVertexBuffer(IDirect3DVertexBuffer9** slot, const void* data, UINT length);
+    HRESULT CreateIndexBuffer(IDirect3DIndexBuffer9** slot, const void* data, UINT length, D3DFORMAT format);
+    // MeshCodec で圧縮したデータを登録します. 圧縮したまま保持し, 作成時にロックしたバッファへ直接展開します.
+    HRESULT CreateEncodedVertexBuffer(IDirect3DVertexBuffer9** slot, const void* encoded, size_t size, UINT vertexCount, UINT stride);
+    HRESULT CreateEncodedIndexBuffer(IDirect3DIndexBuffer9** slot, const void* encoded, size_t size, UINT indexCount, D3DFORMAT format);
+    HRESULT CreateVertexDeclaration(IDirect3DVertexDeclaration9** slot, const D3DVERTEXELEMENT9* elements);
+    HRESULT CreateVertexShader(IDirect3DVertexShader9** slot, const void* code, size_t size);
+    HRESULT CreatePixelShader(IDirect3DPixelShader9** slot, const void* code, size_t size);
+
+    // 全てのオブジェクトとデバイスを解放します. 登録情報は残ります.
+    void ReleaseAll();
+    // 登録情報から全てのオブジェクトを作り直します.
+    // 失敗した場合も残りの作成を続け, 最初の失敗コードを返します.
+    HRESULT RecreateAll(IDirect3DDevice9Ex* d3dDev);
+    // 登録を全て解除します.
+    void Clear();
+
+    size_t GetCount() const { return m_entries.size(); }
+    // d3dDev で作成されたオブジェクトを持つ登録の数. 作り直しの確認用です.
+    size_t CountCreatedOn(IDirect3DDevice9* d3dDev) const;
+    // 保持している元データの総量.
+    size_t GetSourceBytes() const;
+
+private:
+    enum Kind {
+        VertexBuffer,
+        IndexBuffer,
+        EncodedVertexBuffer,
+        EncodedIndexBuffer,
+        VertexDeclaration,
+        VertexShader,
+        PixelShader,
+    };
+    struct Entry
+    {
+        Kind kind;
+        IUnknown** slot;
+        std::vector<uint8_t> data;
+        D3DFORMAT format;
+        // 圧縮データの要素数と要素サイズ.
+        UINT count;
+        UINT stride;
+    };
+
+    HRESULT Register(Kind kind, IUnknown** slot, const void* data, size_t size, D3DFORMAT format,
+        UINT count = 0, UINT stride = 0);
+    HRESULT Create(Entry& entry);
+
+    IDirect3DDevice9Ex* m_d3dDev;
+    std::vector<Entry> m_entries;
+};
@@ -0,0 +1,150 @@
+﻿#include "DynamicBuffer.h"
+#include <stdexcept>
+#include <cstring>
+
+DynamicBuffer::DynamicBuffer(IDirect3DDevice9Ex* d3dDev, Type type, UINT length, D3DFORMAT indexFormat)
+    : m_type(type), m_d3dDev(d3dDev), m_vb(nullptr), m_ib(nullptr), m_locked(false)
+{
+    for (int i = 0; i < RingAllocator::MaxFramesInFlight; ++i)
+    {
+        m_fences[i] = nullptr;
+    }
+
+    HRESULT hr;
+    DWORD usage = D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY;
+    if (m_type == VertexBuffer)
+    {
+        hr = m_d3dDev->CreateVertexBuffer(length, usage, 0, D3DPOOL_DEFAULT, &m_vb, nullptr);
+    }
+    else
+    {
+        hr = m_d3dDev->CreateIndexBuffer(length, usage, indexFormat, D3DPOOL_DEFAULT, &m_ib, nullptr);
+    }
+    if (FAILED(hr))
+        throw std::runtime_error("Failed Create DynamicBuffer");
+
+    // フェンスとして使うイベントクエリ.
+    // 作成できない環境では常に DISCARD で折り返す動作になります.
+    for (int i = 0; i < RingAllocator::MaxFramesInFlight; ++i)
+    {
+        if (FAILED(m_d3dDev->CreateQuery(D3DQUERYTYPE_EVENT, &m_fences[i])))
+        {
+            m_fences[i] = nullptr;
+        }
+    }
+
+    m_d3dDev->AddRef();
+    m_allocator.Reset(length);
+}
+
+DynamicBuffer::~DynamicBuffer()
+{
+    for (int i = 0; i < RingAllocator::MaxFramesInFlight; ++i)
+    {
+        if (m_fences[i])
+        {
+            m_fences[i]->Release();
+        }
+        m_fences[i] = nullptr;
+    }
+    if (m_vb)
+    {
+        m_vb->Release();
+    }
+    if (m_ib)
+    {
+        m_ib->Release();
+    }
+    if (m_d3dDev)
+    {
+        m_d3dDev->Release();
+    }
+    m_vb = nullptr;
+    m_ib = nullptr;
+    m_d3dDev = nullptr;
+}
+
+void* DynamicBuffer::Lock(UINT length, UINT stride, UINT& offset)
+{
+    RetireCompletedFrames();
+
+    bool discard = false;
+    offset = m_allocator.Allocate(length, stride, &discard);
+    if (offset == RingAllocator::InvalidOffset)
+        throw std::runtime_error("DynamicBuffer: request exceeds capacity");
+
+    DWORD flags = discard ? D3DLOCK_DISCARD : D3DLOCK_NOOVERWRITE;
+    void* p = nullptr;
+    HRESULT hr;
+    if (m_type == VertexBuffer)
+    {
+        hr = m_vb->Lock(offset, length, &p, flags);
+    }
+    else
+    {
+        hr = m_ib->Lock(offset, length, &p, flags);
+    }
+    if (FAILED(hr))
+        throw std::runtime_error("Failed Lock");
+
+    m_locked = true;
+    return p;
+}
+
+void DynamicBuffer::Unlock()
+{
+    if (!m_locked)
+    {
+        return;
+    }
+    if (m_type == VertexBuffer)
+    {
+        m_vb->Unlock();
+    }
+    else
+    {
+        m_ib->Unlock();
+    }
+    m_locked = false;
+}
+
+UINT DynamicBuffer::Write(const void* src, UINT length, UINT stride)
+{
+    UINT offset = 0;
+    void* dst = Lock(length, stride, offset);
+    memcpy(dst, src, length);
+    Unlock();
+    return offset / stride;
+}
+
+void DynamicBuffer::EndFrame()
+{
+    int slot = m_allocator.EndFrame();
+    if (slot < 0)
+    {
+        return;
+    }
+    if (m_fences[slot])
+    {
+        m_fences[slot]->Issue(D3DISSUE_END);
+    }
+}
+
+void DynamicBuffer::RetireCompletedFrames()
+{
+    // 古いフレームから順に GPU の完了を確認する.
+    // 待ち合わせはせず, 未完了のものが見つかった時点で打ち切る.
+    while (m_allocator.HasPendingFrame())
+    {
+        IDirect3DQuery9* fence = m_fences[m_allocator.GetOldestSlot()];
+        if (!fence)
+        {
+            break;
+        }
+        if (fence->GetData(nullptr, 0, 0) != S_OK)
+        {
+            break;
+        }
+        m_allocator.RetireOldest();
+    }
+}
@@ -0,0 +1,46 @@
+﻿#pragma once
+#include <d3d9.h>
+#include "RingAllocator.h"
+
+// 毎フレーム書き換える頂点/インデックスデータ用のリングバッファ.
+// D3DUSAGE_DYNAMIC のバッファに D3DLOCK_NOOVERWRITE で追記していき,
+// GPU が使い終わった領域(イベントクエリで判定)を再利用します.
+// 空きが無くなった場合のみ D3DLOCK_DISCARD でバッファを破棄します.
+class DynamicBuffer
+{
+public:
+    enum Type {
+        VertexBuffer,
+        IndexBuffer,
+    };
+
+    DynamicBuffer(IDirect3DDevice9Ex* d3dDev, Type type, UINT length, D3DFORMAT indexFormat = D3DFMT_INDEX16);
+    ~DynamicBuffer();
+
+    // length バイトの書き込み領域をロックします.
+    // offset には stride 単位に揃えたバッファ先頭からのバイト位置が返ります.
+    void* Lock(UINT length, UINT stride, UINT& offset);
+    void Unlock();
+
+    // データをコピーして書き込んだ位置(stride 単位の要素番号)を返します.
+    UINT Write(const void* src, UINT length, UINT stride);
+
+    // フレームの終了時に呼び出し, このフレームで書き込んだ領域にフェンスを設定します.
+    void EndFrame();
+
+    IDirect3DVertexBuffer9* GetVertexBuffer() { return m_vb; }
+    IDirect3DIndexBuffer9* GetIndexBuffer() { return m_ib; }
+
+    const RingAllocator& GetAllocator() const { return m_allocator; }
+
+private:
+    void RetireCompletedFrames();
+
+    Type m_type;
+    IDirect3DDevice9Ex* m_d3dDev;
+    IDirect3DVertexBuffer9* m_vb;
+    IDirect3DIndexBuffer9* m_ib;
+    IDirect3DQuery9* m_fences[RingAllocator::MaxFramesInFlight];
+    RingAllocator m_allocator;
+    bool m_locked;
+};
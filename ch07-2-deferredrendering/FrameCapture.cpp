@@ -0,0 +1,274 @@
+﻿#include "FrameCapture.h"
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+// D3DFORMAT に対応する PixelConvert の形式. 対応しなければ false を返す.
+bool GetPixelFormat(D3DFORMAT format, PixelConvert::Format& result, bool& opaque)
+{
+    opaque = false;
+    switch (format)
+    {
+    case D3DFMT_X8R8G8B8:
+        opaque = true;
+        // fall through
+    case D3DFMT_A8R8G8B8:
+        result = PixelConvert::B8G8R8A8;
+        return true;
+    case D3DFMT_X8B8G8R8:
+        opaque = true;
+        // fall through
+    case D3DFMT_A8B8G8R8:
+        result = PixelConvert::R8G8B8A8;
+        return true;
+    case D3DFMT_A16B16G16R16F:
+        result = PixelConvert::R16G16B16A16F;
+        return true;
+    case D3DFMT_A32B32G32R32F:
+        result = PixelConvert::R32G32B32A32F;
+        return true;
+    default:
+        return false;
+    }
+}
+}
+
+FrameCapture::FrameCapture(CaptureQueue* queue, int latency, int slotCount)
+    : m_queue(queue), m_d3dDev(nullptr), m_latency(latency), m_slots(slotCount), m_frame(0), m_frameMsec(0.0)
+{
+    for (auto& slot : m_slots)
+    {
+        slot.surface = nullptr;
+        slot.fence = nullptr;
+        ZeroMemory(&slot.desc, sizeof(slot.desc));
+        slot.pending = false;
+        slot.frame = 0;
+        slot.encoding = CaptureQueue::Png;
+    }
+    ZeroMemory(&m_stats, sizeof(m_stats));
+    QueryPerformanceFrequency(&m_frequency);
+}
+
+FrameCapture::~FrameCapture()
+{
+    ReleaseDeviceObjects();
+}
+
+void FrameCapture::SetDevice(IDirect3DDevice9Ex* d3dDev)
+{
+    ReleaseDeviceObjects();
+    m_d3dDev = d3dDev;
+    if (m_d3dDev)
+    {
+        m_d3dDev->AddRef();
+    }
+}
+
+void FrameCapture::ReleaseDeviceObjects()
+{
+    for (auto& slot : m_slots)
+    {
+        if (slot.pending)
+        {
+            m_stats.dropped++;
+        }
+        ReleaseSlot(slot);
+    }
+    if (m_d3dDev)
+    {
+        m_d3dDev->Release();
+    }
+    m_d3dDev = nullptr;
+}
+
+void FrameCapture::ReleaseSlot(Slot& slot)
+{
+    if (slot.surface)
+    {
+        slot.surface->Release();
+    }
+    if (slot.fence)
+    {
+        slot.fence->Release();
+    }
+    slot.surface = nullptr;
+    slot.fence = nullptr;
+    slot.pending = false;
+}
+
+bool FrameCapture::Capture(IDirect3DSurface9* source, const char* fileName, CaptureQueue::Encoding encoding)
+{
+    LARGE_INTEGER begin;
+    QueryPerformanceCounter(&begin);
+    m_stats.requested++;
+
+    D3DSURFACE_DESC desc;
+    PixelConvert::Format format;
+    bool opaque;
+    if (!m_d3dDev || !source || FAILED(source->GetDesc(&desc)) || desc.MultiSampleType != D3DMULTISAMPLE_NONE ||
+        !GetPixelFormat(desc.Format, format, opaque))
+    {
+        m_stats.failed++;
+        return false;
+    }
+
+    // 同じ大きさと形式のサーフェイスを持つ空きを優先して使う.
+    Slot* slot = nullptr;
+    for (auto& s : m_slots)
+    {
+        if (s.pending)
+        {
+            continue;
+        }
+        if (s.surface && s.desc.Width == desc.Width && s.desc.Height == desc.Height && s.desc.Format == desc.Format)
+        {
+            slot = &s;
+            break;
+        }
+        if (!slot)
+        {
+            slot = &s;
+        }
+    }
+    if (!slot)
+    {
+        m_stats.dropped++;
+        m_frameMsec += GetElapsedMsec(begin);
+        return false;
+    }
+
+    if (!slot->surface || slot->desc.Width != desc.Width || slot->desc.Height != desc.Height || slot->desc.Format != desc.Format)
+    {
+        ReleaseSlot(*slot);
+        if (FAILED(m_d3dDev->CreateOffscreenPlainSurface(desc.Width, desc.Height, desc.Format,
+            D3DPOOL_SYSTEMMEM, &slot->surface, nullptr)))
+        {
+            slot->surface = nullptr;
+            m_stats.failed++;
+            m_frameMsec += GetElapsedMsec(begin);
+            return false;
+        }
+        // 作成できない環境では, latency フレーム待った後のロックだけで完了を判定する.
+        if (FAILED(m_d3dDev->CreateQuery(D3DQUERYTYPE_EVENT, &slot->fence)))
+        {
+            slot->fence = nullptr;
+        }
+        slot->desc = desc;
+    }
+
+    // コピーを GPU のコマンドとして積むだけで, 完了は待たない.
+    if (FAILED(m_d3dDev->GetRenderTargetData(source, slot->surface)))
+    {
+        m_stats.failed++;
+        m_frameMsec += GetElapsedMsec(begin);
+        return false;
+    }
+    if (slot->fence)
+    {
+        slot->fence->Issue(D3DISSUE_END);
+    }
+    slot->pending = true;
+    slot->frame = m_frame;
+    slot->fileName = fileName;
+    slot->encoding = encoding;
+    m_frameMsec += GetElapsedMsec(begin);
+    return true;
+}
+
+void FrameCapture::EndFrame()
+{
+    LARGE_INTEGER begin;
+    QueryPerformanceCounter(&begin);
+
+    for (auto& slot : m_slots)
+    {
+        if (slot.pending && m_frame - slot.frame >= m_latency)
+        {
+            Readback(slot);
+        }
+    }
+
+    m_frameMsec += GetElapsedMsec(begin);
+    m_stats.renderThreadMsec += m_frameMsec;
+    if (m_frameMsec > m_stats.maxFrameMsec)
+    {
+        m_stats.maxFrameMsec = m_frameMsec;
+    }
+    m_frameMsec = 0.0;
+    m_stats.frames++;
+    m_frame++;
+}
+
+// GPU のコピーが終わっていれば内容をキューへ渡す. まだなら false を返し, 次のフレームで再び試す.
+bool FrameCapture::Readback(Slot& slot)
+{
+    // D3DGETDATA_FLUSH は付けない (コマンドの送出を強制すると描画が乱れる).
+    if (slot.fence && slot.fence->GetData(nullptr, 0, 0) == S_FALSE)
+    {
+        return false;
+    }
+
+    D3DLOCKED_RECT locked;
+    HRESULT hr = slot.surface->LockRect(&locked, nullptr, D3DLOCK_READONLY | D3DLOCK_DONOTWAIT);
+    if (hr == D3DERR_WASSTILLDRAWING)
+    {
+        return false;
+    }
+    slot.pending = false;
+    if (FAILED(hr))
+    {
+        m_stats.failed++;
+        return false;
+    }
+
+    PixelConvert::Format format;
+    bool opaque;
+    GetPixelFormat(slot.desc.Format, format, opaque);
+    CaptureQueue::Frame* frame = m_queue->Acquire(slot.desc.Width, slot.desc.Height, format);
+    if (!frame)
+    {
+        slot.surface->UnlockRect();
+        m_stats.dropped++;
+        return false;
+    }
+    for (UINT y = 0; y < slot.desc.Height; ++y)
+    {
+        memcpy(frame->pixels.data() + frame->pitch * y,
+            static_cast<const uint8_t*>(locked.pBits) + size_t(locked.Pitch) * y, frame->pitch);
+    }
+    slot.surface->UnlockRect();
+
+    frame->fileName = slot.fileName;
+    frame->encoding = slot.encoding;
+    frame->opaque = opaque;
+    if (format == PixelConvert::R16G16B16A16F || format == PixelConvert::R32G32B32A32F)
+    {
+        frame->convertFlags = PixelConvert::Srgb;
+    }
+    m_queue->Submit(frame);
+
+    m_stats.readback++;
+    m_stats.latencyFrames += m_frame - slot.frame;
+    return true;
+}
+
+double FrameCapture::GetElapsedMsec(const LARGE_INTEGER& begin) const
+{
+    LARGE_INTEGER end;
+    QueryPerformanceCounter(&end);
+    return double(end.QuadPart - begin.QuadPart) * 1000.0 / double(m_frequency.QuadPart);
+}
+
+std::string FrameCapture::Report() const
+{
+    char buf[256];
+    snprintf(buf, sizeof(buf),
+        "Frame capture: %d requested, %d read back (%.1f frames later), %d dropped, %d failed, "
+        "render thread %.3f ms/frame (max %.3f ms)\n",
+        m_stats.requested, m_stats.readback,
+        m_stats.readback > 0 ? double(m_stats.latencyFrames) / m_stats.readback : 0.0,
+        m_stats.dropped, m_stats.failed,
+        m_stats.frames > 0 ? m_stats.renderThreadMsec / m_stats.frames : 0.0, m_stats.maxFrameMsec);
+    return buf;
+}
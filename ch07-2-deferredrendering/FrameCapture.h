@@ -0,0 +1,78 @@
+﻿#pragma once
+#include <d3d9.h>
+#include <string>
+#include <vector>
+
+#include "CaptureQueue.h"
+
+// レンダーターゲットの内容を描画を止めずに読み戻すクラス.
+//
+// Capture() は D3DPOOL_SYSTEMMEM のサーフェイスへの GetRenderTargetData とイベントクエリを発行するだけで,
+// 読み戻しは latency フレーム後の EndFrame() で行います. その時点でも GPU のコピーが終わっていなければ
+// (クエリが未完了, または D3DLOCK_DONOTWAIT のロックが D3DERR_WASSTILLDRAWING) 次のフレームに回します.
+// ロックできた内容は CaptureQueue のバッファへコピーし, 変換と書き出しはワーカースレッドに任せます.
+//
+// 読み戻し先のサーフェイスは slotCount 個を使い回し, 空きが無い場合や
+// キューのバッファが足りない場合は, その画像を捨てて dropped に数えます.
+class FrameCapture
+{
+public:
+    struct Stats
+    {
+        int frames;
+        int requested;
+        int readback;       // キューへ渡した数.
+        int dropped;
+        int failed;         // 対応していない形式, サーフェイスの作成やコピーの失敗.
+        int latencyFrames;  // Capture() から読み戻しまでのフレーム数の合計.
+        double renderThreadMsec;    // Capture() と EndFrame() にかかった時間の合計.
+        double maxFrameMsec;
+    };
+
+    FrameCapture(CaptureQueue* queue, int latency, int slotCount);
+    ~FrameCapture();
+
+    // デバイスを作り直した後に設定します. 読み戻し先のサーフェイスは必要になった時に作成します.
+    void SetDevice(IDirect3DDevice9Ex* d3dDev);
+    // 読み戻し中のものは捨てて, デバイスに依存するオブジェクトを解放します.
+    void ReleaseDeviceObjects();
+
+    // source は マルチサンプルでないレンダーターゲットで, 形式は
+    // A8R8G8B8, X8R8G8B8, A8B8G8R8, X8B8G8R8, A16B16G16R16F, A32B32G32R32F のいずれかです.
+    // PNG にする場合, 浮動小数点数の形式は sRGB で符号化し, X8 の形式はアルファを含めません.
+    bool Capture(IDirect3DSurface9* source, const char* fileName, CaptureQueue::Encoding encoding);
+
+    // フレームの終わりに呼び出します.
+    void EndFrame();
+
+    const Stats& GetStats() const { return m_stats; }
+    std::string Report() const;
+
+private:
+    FrameCapture(const FrameCapture&);
+    FrameCapture& operator=(const FrameCapture&);
+
+    struct Slot
+    {
+        IDirect3DSurface9* surface;
+        IDirect3DQuery9* fence;
+        D3DSURFACE_DESC desc;
+        bool pending;
+        int frame;          // Capture() したフレーム.
+        std::string fileName;
+        CaptureQueue::Encoding encoding;
+    };
+
+    bool Readback(Slot& slot);
+    void ReleaseSlot(Slot& slot);
+    double GetElapsedMsec(const LARGE_INTEGER& begin) const;
+
+    CaptureQueue* m_queue;
+    IDirect3DDevice9Ex* m_d3dDev;
+    int m_latency;
+    std::vector<Slot> m_slots;
+    int m_frame;
+    double m_frameMsec;     // このフレームでの Capture() と EndFrame() の時間.
+    LARGE_INTEGER m_frequency;
+    Stats m_stats;
+};
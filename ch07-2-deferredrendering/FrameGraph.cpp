@@ -0,0 +1,203 @@
+﻿#include "FrameGraph.h"
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+FrameGraph::FrameGraph(IDirect3DDevice9Ex* d3dDev, RenderTargetPool* pool)
+    : m_d3dDev(d3dDev), m_pool(pool),
+    m_targetCount(0), m_passCount(0), m_compiled(false)
+{
+    if (m_d3dDev)
+    {
+        m_d3dDev->AddRef();
+    }
+}
+
+FrameGraph::~FrameGraph()
+{
+    ReleaseAll();
+    if (m_d3dDev)
+    {
+        m_d3dDev->Release();
+    }
+    m_d3dDev = nullptr;
+}
+
+void FrameGraph::Reset()
+{
+    ReleaseAll();
+    m_compiler.Reset();
+    m_targetCount = 0;
+    m_passCount = 0;
+    m_compiled = false;
+}
+
+FrameGraph::Handle FrameGraph::CreateTarget(const char* name, const RenderTargetDesc& desc)
+{
+    // 以前のフレームで確保した要素を使い回す.
+    if (int(m_targets.size()) <= m_targetCount)
+    {
+        m_targets.push_back(Target());
+    }
+    Target& target = m_targets[m_targetCount];
+    target.name = name;
+    target.desc = desc;
+    target.imported = nullptr;
+    target.acquired = nullptr;
+
+    int handle = m_compiler.AddResource(false);
+    m_targetCount++;
+    return handle;
+}
+
+FrameGraph::Handle FrameGraph::ImportTarget(const char* name, IDirect3DSurface9* surface)
+{
+    if (int(m_targets.size()) <= m_targetCount)
+    {
+        m_targets.push_back(Target());
+    }
+    Target& target = m_targets[m_targetCount];
+    target.name = name;
+    target.desc = RenderTargetDesc();
+    target.imported = surface;
+    target.acquired = nullptr;
+
+    int handle = m_compiler.AddResource(true);
+    m_targetCount++;
+    return handle;
+}
+
+int FrameGraph::AddPass(const char* name, ExecuteFunc func, bool sideEffect)
+{
+    if (int(m_passes.size()) <= m_passCount)
+    {
+        m_passes.push_back(Pass());
+    }
+    Pass& pass = m_passes[m_passCount];
+    pass.name = name;
+    pass.func = func;
+    for (int i = 0; i < MaxRenderTargets; ++i)
+    {
+        pass.colors[i] = -1;
+    }
+
+    int index = m_compiler.AddPass(sideEffect);
+    m_passCount++;
+    return index;
+}
+
+void FrameGraph::Read(int pass, Handle target)
+{
+    m_compiler.AddRead(pass, target);
+}
+
+void FrameGraph::Write(int pass, Handle target, int renderTargetIndex)
+{
+    m_compiler.AddWrite(pass, target);
+    if (0 <= renderTargetIndex && renderTargetIndex < MaxRenderTargets)
+    {
+        m_passes[pass].colors[renderTargetIndex] = target;
+    }
+}
+
+bool FrameGraph::Compile()
+{
+    m_compiled = m_compiler.Compile();
+    return m_compiled;
+}
+
+bool FrameGraph::Execute()
+{
+    if (!m_compiled)
+    {
+        return false;
+    }
+
+    const std::vector<int>& order = m_compiler.GetExecutionOrder();
+    for (int pos = 0; pos < int(order.size()); ++pos)
+    {
+        Pass& pass = m_passes[order[pos]];
+
+        // このパスから使い始めるターゲットをプールから借りる.
+        for (int i = 0; i < m_targetCount; ++i)
+        {
+            Target& target = m_targets[i];
+            if (target.imported || m_compiler.GetLifetime(i).first != pos)
+            {
+                continue;
+            }
+            target.acquired = m_pool->Acquire(target.desc);
+            if (!target.acquired)
+            {
+                OutputDebugStringA(("FrameGraph: failed to acquire " + target.name + "\n").c_str());
+                ReleaseAll();
+                return false;
+            }
+        }
+
+        // 書き込み先をレンダーターゲットに設定する.
+        if (pass.colors[0] >= 0)
+        {
+            for (int i = 0; i < MaxRenderTargets; ++i)
+            {
+                IDirect3DSurface9* surface = nullptr;
+                if (pass.colors[i] >= 0)
+                {
+                    surface = GetSurface(pass.colors[i]);
+                }
+                m_d3dDev->SetRenderTarget(i, surface);
+            }
+        }
+
+        pass.func(*this);
+
+        // このパスで使い終わるターゲットをプールへ返す.
+        // 以降のパスで同じ条件のターゲットが要求されれば, そのまま再利用される.
+        for (int i = 0; i < m_targetCount; ++i)
+        {
+            Target& target = m_targets[i];
+            if (target.acquired && m_compiler.GetLifetime(i).last == pos)
+            {
+                m_pool->Release(target.acquired);
+                target.acquired = nullptr;
+            }
+        }
+    }
+    return true;
+}
+
+IDirect3DTexture9* FrameGraph::GetTexture(Handle target)
+{
+    if (target < 0 || target >= m_targetCount || !m_targets[target].acquired)
+    {
+        return nullptr;
+    }
+    return m_targets[target].acquired->GetTexture();
+}
+
+IDirect3DSurface9* FrameGraph::GetSurface(Handle target)
+{
+    if (target < 0 || target >= m_targetCount)
+    {
+        return nullptr;
+    }
+    Target& t = m_targets[target];
+    if (t.imported)
+    {
+        return t.imported;
+    }
+    return t.acquired ? t.acquired->GetTargetSurface() : nullptr;
+}
+
+void FrameGraph::ReleaseAll()
+{
+    for (int i = 0; i < m_targetCount; ++i)
+    {
+        Target& target = m_targets[i];
+        if (target.acquired)
+        {
+            m_pool->Release(target.acquired);
+            target.acquired = nullptr;
+        }
+    }
+}
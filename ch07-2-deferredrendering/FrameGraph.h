@@ -0,0 +1,79 @@
+﻿#pragma once
+#include <d3d9.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "FrameGraphCompiler.h"
+#include "RenderTarget.h"
+#include "RenderTargetPool.h"
+
+// 描画パスと, パスが読み書きするレンダーターゲットを宣言して実行するクラス.
+// 依存関係の解決は FrameGraphCompiler が行い,
+// ここではレンダーターゲットの確保/返却と SetRenderTarget の発行を担当します.
+//
+// 使い方:
+//   Reset() -> CreateTarget/ImportTarget -> AddPass/Read/Write -> Compile() -> Execute()
+class FrameGraph
+{
+public:
+    typedef int Handle;
+    typedef std::function<void(FrameGraph&)> ExecuteFunc;
+
+    // 同時に設定できるレンダーターゲットの数.
+    static const int MaxRenderTargets = 4;
+
+    FrameGraph(IDirect3DDevice9Ex* d3dDev, RenderTargetPool* pool);
+    ~FrameGraph();
+
+    void Reset();
+
+    // プールから確保する一時的なレンダーターゲット.
+    Handle CreateTarget(const char* name, const RenderTargetDesc& desc);
+    // 外部で管理しているサーフェイス (バックバッファなど).
+    Handle ImportTarget(const char* name, IDirect3DSurface9* surface);
+
+    // sideEffect : 書き込むターゲットが無くても除去しないパス (読み戻しなど).
+    int AddPass(const char* name, ExecuteFunc func, bool sideEffect = false);
+    // テクスチャとして読み込む.
+    void Read(int pass, Handle target);
+    // renderTargetIndex 番のレンダーターゲットとして書き込む.
+    void Write(int pass, Handle target, int renderTargetIndex);
+
+    bool Compile();
+    // パスを実行順に呼び出します. BeginScene/EndScene の間で呼び出してください.
+    bool Execute();
+
+    // パスの実行中に, 確保されたリソースを取得します.
+    IDirect3DTexture9* GetTexture(Handle target);
+    IDirect3DSurface9* GetSurface(Handle target);
+
+    const FrameGraphCompiler& GetCompiler() const { return m_compiler; }
+
+private:
+    struct Target
+    {
+        std::string name;
+        RenderTargetDesc desc;
+        IDirect3DSurface9* imported;
+        RenderTarget* acquired;
+    };
+    struct Pass
+    {
+        std::string name;
+        ExecuteFunc func;
+        Handle colors[MaxRenderTargets];
+    };
+
+    void ReleaseAll();
+
+    IDirect3DDevice9Ex* m_d3dDev;
+    RenderTargetPool* m_pool;
+    FrameGraphCompiler m_compiler;
+
+    std::vector<Target> m_targets;
+    std::vector<Pass> m_passes;
+    int m_targetCount;
+    int m_passCount;
+    bool m_compiled;
+};
@@ -0,0 +1,225 @@
+﻿#include "FrameGraphCompiler.h"
+#include <cstddef>
+
+FrameGraphCompiler::FrameGraphCompiler()
+    : m_passCount(0), m_resourceCount(0)
+{
+    m_stats = Stats();
+}
+
+void FrameGraphCompiler::Reset()
+{
+    m_passCount = 0;
+    m_resourceCount = 0;
+    m_order.clear();
+    m_stats = Stats();
+}
+
+int FrameGraphCompiler::AddResource(bool imported)
+{
+    if (int(m_resources.size()) <= m_resourceCount)
+    {
+        m_resources.push_back(Resource());
+    }
+    Resource& res = m_resources[m_resourceCount];
+    res.imported = imported;
+    res.needed = false;
+    res.lastWriter = -1;
+    res.readers.clear();
+    res.lifetime.first = -1;
+    res.lifetime.last = -1;
+    return m_resourceCount++;
+}
+
+int FrameGraphCompiler::AddPass(bool sideEffect)
+{
+    if (int(m_passes.size()) <= m_passCount)
+    {
+        m_passes.push_back(Pass());
+    }
+    Pass& pass = m_passes[m_passCount];
+    pass.reads.clear();
+    pass.writes.clear();
+    pass.sideEffect = sideEffect;
+    pass.alive = false;
+    return m_passCount++;
+}
+
+void FrameGraphCompiler::AddRead(int pass, int resource)
+{
+    m_passes[pass].reads.push_back(resource);
+}
+
+void FrameGraphCompiler::AddWrite(int pass, int resource)
+{
+    m_passes[pass].writes.push_back(resource);
+}
+
+void FrameGraphCompiler::AddEdge(int from, int to)
+{
+    m_edgeFrom.push_back(from);
+    m_edgeTo.push_back(to);
+}
+
+bool FrameGraphCompiler::Compile()
+{
+    m_stats = Stats();
+    m_stats.passCount = m_passCount;
+    m_stats.resourceCount = m_resourceCount;
+
+    // 後ろのパスから辿り, 出力に寄与するパスだけを残す.
+    // 書き込みは部分的な更新(ブレンドなど)の可能性があるため,
+    // 必要とされたリソースはそれ以前の書き込みも全て必要とみなす.
+    for (int i = 0; i < m_resourceCount; ++i)
+    {
+        m_resources[i].needed = false;
+    }
+    for (int i = m_passCount - 1; i >= 0; --i)
+    {
+        Pass& pass = m_passes[i];
+        bool alive = pass.sideEffect;
+        for (int w : pass.writes)
+        {
+            const Resource& res = m_resources[w];
+            if (res.imported || res.needed)
+            {
+                alive = true;
+                break;
+            }
+        }
+        pass.alive = alive;
+        if (!alive)
+        {
+            m_stats.culledPassCount++;
+            continue;
+        }
+        for (int r : pass.reads)
+        {
+            m_resources[r].needed = true;
+        }
+    }
+
+    // 残ったパス間の依存関係を作る.
+    //  書き込み -> 読み込み, 読み込み -> 書き込み, 書き込み -> 書き込み.
+    m_edgeFrom.clear();
+    m_edgeTo.clear();
+    for (int i = 0; i < m_resourceCount; ++i)
+    {
+        m_resources[i].lastWriter = -1;
+        m_resources[i].readers.clear();
+    }
+    for (int i = 0; i < m_passCount; ++i)
+    {
+        const Pass& pass = m_passes[i];
+        if (!pass.alive)
+        {
+            continue;
+        }
+        for (int r : pass.reads)
+        {
+            Resource& res = m_resources[r];
+            if (res.lastWriter < 0 && !res.imported)
+            {
+                // 一度も書き込まれていないリソースの読み込み.
+                return false;
+            }
+            if (res.lastWriter >= 0)
+            {
+                AddEdge(res.lastWriter, i);
+            }
+            res.readers.push_back(i);
+        }
+        for (int w : pass.writes)
+        {
+            Resource& res = m_resources[w];
+            if (res.lastWriter >= 0 && res.lastWriter != i)
+            {
+                AddEdge(res.lastWriter, i);
+            }
+            for (int reader : res.readers)
+            {
+                if (reader != i)
+                {
+                    AddEdge(reader, i);
+                }
+            }
+            res.readers.clear();
+            res.lastWriter = i;
+        }
+    }
+    const int edgeCount = int(m_edgeFrom.size());
+    m_stats.edgeCount = edgeCount;
+
+    // 隣接リストを作成 (CSR 形式).
+    m_edgeOffset.assign(m_passCount + 1, 0);
+    m_inDegree.assign(m_passCount, 0);
+    for (int e = 0; e < edgeCount; ++e)
+    {
+        m_edgeOffset[m_edgeFrom[e] + 1]++;
+        m_inDegree[m_edgeTo[e]]++;
+    }
+    for (int i = 0; i < m_passCount; ++i)
+    {
+        m_edgeOffset[i + 1] += m_edgeOffset[i];
+    }
+    m_edgeList.resize(edgeCount);
+    m_queue.assign(m_edgeOffset.begin(), m_edgeOffset.end() - 1);
+    for (int e = 0; e < edgeCount; ++e)
+    {
+        m_edgeList[m_queue[m_edgeFrom[e]]++] = m_edgeTo[e];
+    }
+
+    // トポロジカルソートで実行順序を決める.
+    m_order.clear();
+    m_queue.clear();
+    for (int i = 0; i < m_passCount; ++i)
+    {
+        if (m_passes[i].alive && m_inDegree[i] == 0)
+        {
+            m_queue.push_back(i);
+        }
+    }
+    for (size_t head = 0; head < m_queue.size(); ++head)
+    {
+        int p = m_queue[head];
+        m_order.push_back(p);
+        for (int e = m_edgeOffset[p]; e < m_edgeOffset[p + 1]; ++e)
+        {
+            int to = m_edgeList[e];
+            if (--m_inDegree[to] == 0)
+            {
+                m_queue.push_back(to);
+            }
+        }
+    }
+    if (int(m_order.size()) != m_passCount - m_stats.culledPassCount)
+    {
+        // 循環がある.
+        return false;
+    }
+
+    // 各リソースの寿命を実行位置で求める.
+    for (int i = 0; i < m_resourceCount; ++i)
+    {
+        m_resources[i].lifetime.first = -1;
+        m_resources[i].lifetime.last = -1;
+    }
+    for (int pos = 0; pos < int(m_order.size()); ++pos)
+    {
+        const Pass& pass = m_passes[m_order[pos]];
+        for (int k = 0; k < 2; ++k)
+        {
+            const std::vector<int>& list = (k == 0) ? pass.reads : pass.writes;
+            for (int r : list)
+            {
+                Lifetime& lifetime = m_resources[r].lifetime;
+                if (lifetime.first < 0)
+                {
+                    lifetime.first = pos;
+                }
+                lifetime.last = pos;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,87 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+
+// フレームグラフの依存関係を解決するクラス.
+// D3D には依存せず, パスとリソースの読み書き関係だけを扱います.
+//
+// パスは宣言順に意味を持ち, あるパスの読み込みはそれより前に宣言された書き込みを参照します.
+// Compile() では次の処理を行います.
+//  - 出力(副作用を持つパス, 外部リソースへの書き込み)に寄与しないパスの除去.
+//  - 依存関係からの実行順序の決定.
+//  - 各リソースを最初/最後に使う実行位置(寿命)の計算.
+class FrameGraphCompiler
+{
+public:
+    struct Lifetime
+    {
+        int first;  // 最初に使う実行位置. 未使用なら -1.
+        int last;   // 最後に使う実行位置.
+    };
+
+    struct Stats
+    {
+        int passCount;
+        int culledPassCount;
+        int resourceCount;
+        int edgeCount;
+    };
+
+    FrameGraphCompiler();
+
+    void Reset();
+
+    // imported : 外部で管理されるリソース (バックバッファなど).
+    int AddResource(bool imported);
+    // sideEffect : 出力が参照されなくても除去しないパス.
+    int AddPass(bool sideEffect);
+    void AddRead(int pass, int resource);
+    void AddWrite(int pass, int resource);
+
+    // 未定義のリソースを読み込むなど, グラフが不正な場合は false を返します.
+    bool Compile();
+
+    const std::vector<int>& GetExecutionOrder() const { return m_order; }
+    bool IsCulled(int pass) const { return !m_passes[pass].alive; }
+    const Lifetime& GetLifetime(int resource) const { return m_resources[resource].lifetime; }
+    bool IsImported(int resource) const { return m_resources[resource].imported; }
+    int GetPassCount() const { return m_passCount; }
+    int GetResourceCount() const { return m_resourceCount; }
+    const Stats& GetStats() const { return m_stats; }
+
+private:
+    struct Pass
+    {
+        std::vector<int> reads;
+        std::vector<int> writes;
+        bool sideEffect;
+        bool alive;
+    };
+    struct Resource
+    {
+        bool imported;
+        bool needed;
+        int lastWriter;
+        std::vector<int> readers;   // 最後の書き込み以降に読み込んだパス.
+        Lifetime lifetime;
+    };
+
+    void AddEdge(int from, int to);
+
+    // Reset 後も確保済みのメモリを使い回すため, 有効な要素数を別に持つ.
+    std::vector<Pass> m_passes;
+    std::vector<Resource> m_resources;
+    int m_passCount;
+    int m_resourceCount;
+
+    // 依存関係 (from -> to) と作業領域.
+    std::vector<int> m_edgeFrom;
+    std::vector<int> m_edgeTo;
+    std::vector<int> m_edgeOffset;
+    std::vector<int> m_edgeList;
+    std::vector<int> m_inDegree;
+    std::vector<int> m_queue;
+    std::vector<int> m_order;
+
+    Stats m_stats;
+};
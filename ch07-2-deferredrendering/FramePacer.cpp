@@ -0,0 +1,210 @@
+﻿#include "FramePacer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+namespace
+{
+// 眠りは予定より遅れて戻ることがあるので, 最後のこの時間 (秒) は回って待つ.
+const double SpinThreshold = 0.002;
+// Present が間隔のこの割合より長く待てば, 垂直同期まで待たされたと見なす.
+const double BlockedPresentRatio = 0.1;
+// 垂直同期の時刻の予測との差を, 位相と間隔に反映する割合.
+const double PhaseGain = 0.2;
+const double IntervalGain = 0.05;
+// 推定した間隔は設定した値からこの割合までしか離さない.
+const double MaxIntervalDeviation = 0.05;
+
+class SystemClock : public FramePacer::Clock
+{
+public:
+    SystemClock()
+        : m_origin(std::chrono::steady_clock::now())
+    {
+    }
+
+    virtual double Now()
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_origin).count();
+    }
+
+    virtual void SleepUntil(double time)
+    {
+        for (;;)
+        {
+            const double remaining = time - Now();
+            if (remaining <= 0.0)
+            {
+                return;
+            }
+            if (remaining > SpinThreshold)
+            {
+                std::this_thread::sleep_for(std::chrono::duration<double>(remaining - SpinThreshold));
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+private:
+    std::chrono::steady_clock::time_point m_origin;
+};
+}
+
+FramePacer::Clock& FramePacer::GetSystemClock()
+{
+    static SystemClock clock;
+    return clock;
+}
+
+FramePacer::FramePacer(Clock& clock)
+    : m_clock(clock), m_vsync(true), m_enabled(true),
+    m_nominalInterval(1.0 / 60.0), m_interval(1.0 / 60.0), m_margin(0.001),
+    m_hasPhase(false), m_phase(0.0),
+    m_frameStart(0.0), m_scheduledStart(0.0), m_presentBegin(0.0), m_deadline(0.0), m_lastDeadline(0.0),
+    m_workCount(0), m_workIndex(0)
+{
+    memset(m_work, 0, sizeof(m_work));
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+void FramePacer::Configure(bool vsync, double interval)
+{
+    m_vsync = vsync;
+    m_nominalInterval = interval;
+    m_interval = interval;
+    m_hasPhase = false;
+    m_lastDeadline = 0.0;
+}
+
+void FramePacer::WaitForFrameStart()
+{
+    double now = m_clock.Now();
+    m_deadline = 0.0;
+    if (m_enabled)
+    {
+        const double lead = GetWorkEstimate() + m_margin;
+        double wake = now;
+        if (m_vsync)
+        {
+            // 位相が分かるまでは眠らない (Present がブロックして垂直同期の時刻が分かる).
+            if (m_hasPhase)
+            {
+                // 垂直同期 1 回に 1 フレームだけ表示するため, 前の締め切りより後の垂直同期を選ぶ.
+                const double earliest = std::max(now + lead, m_lastDeadline + m_interval * 0.5);
+                m_deadline = GetNextVBlank(earliest);
+                wake = m_deadline - lead;
+            }
+        }
+        else if (m_stats.frames > 0)
+        {
+            // 眠りの遅れが積もらないよう, 実際に起きた時刻ではなく前の予定から数える.
+            // 大きく遅れた場合は追いつこうとせず, 今から数え直す.
+            wake = m_scheduledStart + m_interval;
+            if (wake < now - m_interval)
+            {
+                wake = now;
+            }
+        }
+        m_scheduledStart = std::max(wake, now);
+
+        if (wake > now)
+        {
+            m_clock.SleepUntil(wake);
+            const double woken = m_clock.Now();
+            m_stats.sleepSec += woken - now;
+            now = woken;
+        }
+    }
+    m_frameStart = now;
+    if (m_deadline > 0.0)
+    {
+        m_lastDeadline = m_deadline;
+    }
+}
+
+void FramePacer::BeginPresent()
+{
+    m_presentBegin = m_clock.Now();
+    const double work = m_presentBegin - m_frameStart;
+    m_work[m_workIndex] = work;
+    m_workIndex = (m_workIndex + 1) % WorkHistorySize;
+    m_workCount = std::min(m_workCount + 1, int(WorkHistorySize));
+
+    m_stats.workSec += work;
+    m_stats.maxWorkSec = std::max(m_stats.maxWorkSec, work);
+    if (m_deadline > 0.0 && m_presentBegin > m_deadline)
+    {
+        m_stats.missed++;
+    }
+}
+
+void FramePacer::EndPresent()
+{
+    const double now = m_clock.Now();
+    const double blocked = now - m_presentBegin;
+    m_stats.presentSec += blocked;
+    m_stats.frames++;
+    if (m_vsync && blocked > m_interval * BlockedPresentRatio)
+    {
+        AddVBlankSample(now);
+    }
+}
+
+void FramePacer::AddVBlankSample(double time)
+{
+    m_stats.vblankSamples++;
+    if (!m_hasPhase)
+    {
+        m_phase = time;
+        m_hasPhase = true;
+        return;
+    }
+
+    // 最も近い予測との差で位相を補正し, 離れた垂直同期との差で間隔を補正する.
+    const double cycles = floor((time - m_phase) / m_interval + 0.5);
+    const double predicted = m_phase + cycles * m_interval;
+    const double error = time - predicted;
+    m_phase = predicted + error * PhaseGain;
+    if (cycles >= 1.0)
+    {
+        m_interval += error / cycles * IntervalGain;
+        m_interval = std::min(std::max(m_interval, m_nominalInterval * (1.0 - MaxIntervalDeviation)),
+            m_nominalInterval * (1.0 + MaxIntervalDeviation));
+    }
+}
+
+double FramePacer::GetWorkEstimate() const
+{
+    double estimate = 0.0;
+    for (int i = 0; i < m_workCount; ++i)
+    {
+        estimate = std::max(estimate, m_work[i]);
+    }
+    return estimate;
+}
+
+double FramePacer::GetNextVBlank(double time) const
+{
+    const double cycles = ceil((time - m_phase) / m_interval);
+    return m_phase + cycles * m_interval;
+}
+
+std::string FramePacer::Report() const
+{
+    const double frames = double(std::max<uint64_t>(m_stats.frames, 1));
+    char buf[256];
+    snprintf(buf, sizeof(buf),
+        "Frame pacing (%s, %s, %.3f ms): %llu frames, work %.3f ms (max %.3f ms), sleep %.3f ms, present wait %.3f ms, %llu missed, %llu vblank samples\n",
+        m_vsync ? "vsync" : "immediate", m_enabled ? "limiter on" : "limiter off", m_interval * 1000.0,
+        (unsigned long long)m_stats.frames, m_stats.workSec * 1000.0 / frames, m_stats.maxWorkSec * 1000.0,
+        m_stats.sleepSec * 1000.0 / frames, m_stats.presentSec * 1000.0 / frames,
+        (unsigned long long)m_stats.missed, (unsigned long long)m_stats.vblankSamples);
+    return buf;
+}
@@ -0,0 +1,93 @@
+﻿#pragma once
+#include <cstdint>
+#include <string>
+
+// フレームの開始を, 次の表示の締め切りに間に合う最も遅い時刻まで遅らせるクラス. D3D には依存しません.
+// 入力を読むのが表示の直前になるので, 入力から表示までの遅延が減ります.
+//
+// 垂直同期を待つ場合は, Present がブロックした時刻 (直前の垂直同期) と AddVBlankSample() で渡された時刻から
+// 垂直同期の位相と間隔を推定し, 次の垂直同期から処理時間の予測と余裕 (margin) を引いた時刻まで眠ります.
+// 処理時間は直近のフレームの最大値で予測します. 垂直同期を待たない場合は, フレームの開始を interval ごとに制限します.
+//
+// 時刻の取得と待機は Clock を通すので, 模擬した時計で垂直同期を再現して確かめられます.
+class FramePacer
+{
+public:
+    class Clock
+    {
+    public:
+        virtual ~Clock() {}
+        virtual double Now() = 0;   // 秒.
+        virtual void SleepUntil(double time) = 0;
+    };
+    // std::chrono::steady_clock による時計. 眠りの粒度が粗いので, 最後の少しは回って待ちます.
+    static Clock& GetSystemClock();
+
+    struct Stats
+    {
+        uint64_t frames;
+        uint64_t missed;        // 予測した締め切りまでに Present を呼べなかったフレーム.
+        uint64_t vblankSamples;
+        double sleepSec;        // 眠った時間の合計.
+        double workSec;         // フレームの開始から Present までの時間の合計.
+        double maxWorkSec;
+        double presentSec;      // Present の中で待った時間の合計.
+    };
+
+    explicit FramePacer(Clock& clock);
+
+    // vsync なら Present が垂直同期を待つ. interval は垂直同期 (または制限するフレーム) の間隔 (秒).
+    void Configure(bool vsync, double interval);
+    // false なら眠らずに計測だけ行います.
+    void SetEnabled(bool enabled) { m_enabled = enabled; }
+    bool IsEnabled() const { return m_enabled; }
+    // 予測した処理時間に加える余裕 (秒).
+    void SetMargin(double seconds) { m_margin = seconds; }
+
+    // フレームの処理 (入力の読み込みを含む) を始める前に呼び出します.
+    void WaitForFrameStart();
+    // Present の前後で呼び出します.
+    void BeginPresent();
+    void EndPresent();
+    // 垂直同期の時刻が分かれば渡します (走査線の位置から求めたものなど).
+    void AddVBlankSample(double time);
+
+    double GetWorkEstimate() const;
+    double GetInterval() const { return m_interval; }
+    // 今のフレームの締め切り. 予測していなければ 0.
+    double GetDeadline() const { return m_deadline; }
+
+    const Stats& GetStats() const { return m_stats; }
+    std::string Report() const;
+
+private:
+    FramePacer(const FramePacer&);
+    FramePacer& operator=(const FramePacer&);
+
+    static const int WorkHistorySize = 16;
+
+    // time 以降で最初の垂直同期の時刻.
+    double GetNextVBlank(double time) const;
+
+    Clock& m_clock;
+    bool m_vsync;
+    bool m_enabled;
+    double m_nominalInterval;   // Configure() で設定した間隔.
+    double m_interval;          // 推定した間隔.
+    double m_margin;
+
+    // 推定した垂直同期の 1 つの時刻. m_hasPhase が false の間は分からない.
+    bool m_hasPhase;
+    double m_phase;
+
+    double m_frameStart;
+    double m_scheduledStart;    // 垂直同期を待たない場合に, このフレームを始める予定だった時刻.
+    double m_presentBegin;
+    double m_deadline;
+    double m_lastDeadline;
+    double m_work[WorkHistorySize];
+    int m_workCount;
+    int m_workIndex;
+
+    Stats m_stats;
+};
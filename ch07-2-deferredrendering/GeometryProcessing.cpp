@@ -0,0 +1,385 @@
+﻿#include "GeometryProcessing.h"
+#include "ParallelFor.h"
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX;
+
+namespace
+{
+// 1 スレッドが担当する要素数の下限.
+const size_t MinParallelSize = 16 * 1024;
+
+const XMFLOAT3& GetPosition(const uint8_t* vertices, size_t stride, size_t i)
+{
+    return *reinterpret_cast<const XMFLOAT3*>(vertices + i * stride);
+}
+
+// 頂点から, その頂点を参照する角 (インデックスの位置) の一覧を引けるようにする.
+struct VertexCorners
+{
+    std::vector<uint32_t> offsets;  // 頂点ごとの corners の開始位置 (頂点数 + 1 個).
+    std::vector<uint32_t> corners;
+
+    void Build(const uint32_t* indices, size_t indexCount, size_t vertexCount)
+    {
+        offsets.assign(vertexCount + 1, 0);
+        for (size_t i = 0; i < indexCount; ++i)
+        {
+            ++offsets[indices[i] + 1];
+        }
+        for (size_t v = 0; v < vertexCount; ++v)
+        {
+            offsets[v + 1] += offsets[v];
+        }
+        corners.resize(indexCount);
+        std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indexCount; ++i)
+        {
+            corners[cursor[indices[i]]++] = uint32_t(i);
+        }
+    }
+};
+
+const uint32_t EmptyHead = 0xFFFFFFFF;
+
+// 溶接用に, 位置を epsilon の 2 倍の格子で区切ったセルから頂点の一覧を引くハッシュ表.
+class CellTable
+{
+public:
+    CellTable(size_t expected, float cellSize)
+        : m_invCellSize(1.0f / cellSize)
+    {
+        size_t size = 16;
+        while (size < expected * 2)
+        {
+            size *= 2;
+        }
+        m_keys.resize(size);
+        m_heads.assign(size, EmptyHead);
+    }
+
+    int64_t GetCell(float x) const
+    {
+        return int64_t(std::floor(x * m_invCellSize));
+    }
+
+    // セルの最初の頂点を返す. 無ければ EmptyHead.
+    uint32_t Find(int64_t x, int64_t y, int64_t z) const
+    {
+        const uint64_t key = MakeKey(x, y, z);
+        const size_t mask = m_heads.size() - 1;
+        for (size_t slot = Hash(key) & mask; m_heads[slot] != EmptyHead; slot = (slot + 1) & mask)
+        {
+            if (m_keys[slot] == key)
+            {
+                return m_heads[slot];
+            }
+        }
+        return EmptyHead;
+    }
+
+    // セルの先頭に頂点を加え, それまでの先頭を返す.
+    uint32_t Push(int64_t x, int64_t y, int64_t z, uint32_t vertex)
+    {
+        if ((m_count + 1) * 2 > m_heads.size())
+        {
+            Grow();
+        }
+        const uint64_t key = MakeKey(x, y, z);
+        const size_t mask = m_heads.size() - 1;
+        size_t slot = Hash(key) & mask;
+        for (; m_heads[slot] != EmptyHead; slot = (slot + 1) & mask)
+        {
+            if (m_keys[slot] == key)
+            {
+                uint32_t next = m_heads[slot];
+                m_heads[slot] = vertex;
+                return next;
+            }
+        }
+        m_keys[slot] = key;
+        m_heads[slot] = vertex;
+        ++m_count;
+        return EmptyHead;
+    }
+
+private:
+    // 21 ビットずつに詰める. 離れたセルが同じキーになっても, 位置を比べるので結果は変わらない.
+    static uint64_t MakeKey(int64_t x, int64_t y, int64_t z)
+    {
+        return (uint64_t(x) & 0x1FFFFF) | ((uint64_t(y) & 0x1FFFFF) << 21) | ((uint64_t(z) & 0x1FFFFF) << 42);
+    }
+
+    static size_t Hash(uint64_t key)
+    {
+        key *= 0x9E3779B97F4A7C15ull;
+        return size_t(key ^ (key >> 29));
+    }
+
+    void Grow()
+    {
+        std::vector<uint64_t> keys(m_keys.size() * 2);
+        std::vector<uint32_t> heads(m_heads.size() * 2, EmptyHead);
+        const size_t mask = heads.size() - 1;
+        for (size_t i = 0; i < m_heads.size(); ++i)
+        {
+            if (m_heads[i] == EmptyHead)
+            {
+                continue;
+            }
+            size_t slot = Hash(m_keys[i]) & mask;
+            while (heads[slot] != EmptyHead)
+            {
+                slot = (slot + 1) & mask;
+            }
+            keys[slot] = m_keys[i];
+            heads[slot] = m_heads[i];
+        }
+        m_keys.swap(keys);
+        m_heads.swap(heads);
+    }
+
+    float m_invCellSize;
+    size_t m_count = 0;
+    std::vector<uint64_t> m_keys;
+    std::vector<uint32_t> m_heads;
+};
+
+bool IsNear(const uint8_t* a, const uint8_t* b, size_t stride, float epsilon)
+{
+    for (size_t offset = 0; offset + sizeof(float) <= stride; offset += sizeof(float))
+    {
+        float x, y;
+        memcpy(&x, a + offset, sizeof(float));
+        memcpy(&y, b + offset, sizeof(float));
+        if (!(std::fabs(x - y) <= epsilon))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// セル (x, y, z) から vertex に近い頂点を探す.
+uint32_t FindNear(const CellTable& table, const std::vector<uint32_t>& next, const std::vector<uint8_t>& welded,
+    const uint8_t* vertex, size_t stride, float epsilon, int64_t x, int64_t y, int64_t z)
+{
+    for (uint32_t v = table.Find(x, y, z); v != EmptyHead; v = next[v])
+    {
+        if (IsNear(vertex, &welded[v * stride], stride, epsilon))
+        {
+            return v;
+        }
+    }
+    return EmptyHead;
+}
+
+// 長さが 0 に近い場合は false を返す.
+bool Normalize(XMVECTOR v, XMVECTOR& result)
+{
+    float length = XMVectorGetX(XMVector3Length(v));
+    if (!(length > 1e-20f))
+    {
+        return false;
+    }
+    result = XMVectorScale(v, 1.0f / length);
+    return true;
+}
+}
+
+namespace GeometryProcessing
+{
+size_t WeldVertices(const void* vertices, size_t vertexCount, size_t stride,
+    uint32_t* indices, size_t indexCount, float epsilon,
+    std::vector<uint8_t>& result)
+{
+    const uint8_t* src = static_cast<const uint8_t*>(vertices);
+    // epsilon 以内の頂点は, 各軸で隣り合う 2 つのセルのどちらかに入る.
+    // 重複が多い場合に表が大きくなり過ぎないよう, 小さめに作って必要に応じて広げる.
+    CellTable table(vertexCount / 4, epsilon > 0.0f ? epsilon * 2.0f : 1e-30f);
+    std::vector<uint32_t> next;     // 同じセルに入っている次の頂点.
+    std::vector<uint32_t> remap(vertexCount);
+    result.clear();
+    result.reserve(vertexCount * stride);
+
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        const uint8_t* vertex = src + i * stride;
+        const XMFLOAT3& pos = GetPosition(src, stride, i);
+        const int64_t lo[3] = { table.GetCell(pos.x - epsilon), table.GetCell(pos.y - epsilon), table.GetCell(pos.z - epsilon) };
+        const int64_t hi[3] = { table.GetCell(pos.x + epsilon), table.GetCell(pos.y + epsilon), table.GetCell(pos.z + epsilon) };
+
+        // 同じ位置の頂点が多いので, 自分のセルを先に調べる.
+        const int64_t cell[3] = { table.GetCell(pos.x), table.GetCell(pos.y), table.GetCell(pos.z) };
+        uint32_t found = FindNear(table, next, result, vertex, stride, epsilon, cell[0], cell[1], cell[2]);
+        for (int64_t z = lo[2]; z <= hi[2] && found == EmptyHead; ++z)
+        {
+            for (int64_t y = lo[1]; y <= hi[1] && found == EmptyHead; ++y)
+            {
+                for (int64_t x = lo[0]; x <= hi[0] && found == EmptyHead; ++x)
+                {
+                    if (x != cell[0] || y != cell[1] || z != cell[2])
+                    {
+                        found = FindNear(table, next, result, vertex, stride, epsilon, x, y, z);
+                    }
+                }
+            }
+        }
+
+        if (found == EmptyHead)
+        {
+            found = uint32_t(next.size());
+            next.push_back(table.Push(cell[0], cell[1], cell[2], found));
+            result.insert(result.end(), vertex, vertex + stride);
+        }
+        remap[i] = found;
+    }
+
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        indices[i] = remap[indices[i]];
+    }
+    return next.size();
+}
+
+void ComputeNormals(const void* vertices, size_t vertexCount, size_t stride,
+    const uint32_t* indices, size_t indexCount, NormalWeighting weighting,
+    XMFLOAT3* normals, int threadCount)
+{
+    const uint8_t* src = static_cast<const uint8_t*>(vertices);
+    const size_t triangleCount = indexCount / 3;
+
+    // 三角形ごとに, 3 つの角それぞれの寄与を求める.
+    std::vector<XMFLOAT3> contributions(triangleCount * 3);
+    ParallelRange(triangleCount, threadCount, MinParallelSize, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; ++t)
+        {
+            XMVECTOR p[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                p[k] = XMLoadFloat3(&GetPosition(src, stride, indices[t * 3 + k]));
+            }
+            // 外積の長さは面積の 2 倍.
+            XMVECTOR cross = XMVector3Cross(XMVectorSubtract(p[1], p[0]), XMVectorSubtract(p[2], p[0]));
+            if (weighting == AreaWeighted)
+            {
+                for (int k = 0; k < 3; ++k)
+                {
+                    XMStoreFloat3(&contributions[t * 3 + k], cross);
+                }
+                continue;
+            }
+
+            XMVECTOR faceNormal;
+            if (!Normalize(cross, faceNormal))
+            {
+                faceNormal = XMVectorZero();
+            }
+            for (int k = 0; k < 3; ++k)
+            {
+                XMVECTOR e0, e1;
+                float angle = 0.0f;
+                if (Normalize(XMVectorSubtract(p[(k + 1) % 3], p[k]), e0) &&
+                    Normalize(XMVectorSubtract(p[(k + 2) % 3], p[k]), e1))
+                {
+                    float cosine = XMVectorGetX(XMVector3Dot(e0, e1));
+                    angle = std::acos(cosine < -1.0f ? -1.0f : cosine > 1.0f ? 1.0f : cosine);
+                }
+                XMStoreFloat3(&contributions[t * 3 + k], XMVectorScale(faceNormal, angle));
+            }
+        }
+    });
+
+    // 頂点ごとに寄与を集める.
+    VertexCorners adjacency;
+    adjacency.Build(indices, triangleCount * 3, vertexCount);
+    ParallelRange(vertexCount, threadCount, MinParallelSize, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; ++v)
+        {
+            XMVECTOR sum = XMVectorZero();
+            for (uint32_t i = adjacency.offsets[v]; i < adjacency.offsets[v + 1]; ++i)
+            {
+                sum = XMVectorAdd(sum, XMLoadFloat3(&contributions[adjacency.corners[i]]));
+            }
+            XMVECTOR normal;
+            if (!Normalize(sum, normal))
+            {
+                normal = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+            }
+            XMStoreFloat3(&normals[v], normal);
+        }
+    });
+}
+
+void ComputeTangents(const void* vertices, size_t vertexCount, size_t stride, size_t texcoordOffset,
+    const XMFLOAT3* normals, const uint32_t* indices, size_t indexCount,
+    XMFLOAT4* tangents, int threadCount)
+{
+    const uint8_t* src = static_cast<const uint8_t*>(vertices);
+    const size_t triangleCount = indexCount / 3;
+
+    // 三角形ごとに, テクスチャ座標の u, v が増える向きを求める.
+    std::vector<XMFLOAT3> triangleTangents(triangleCount);
+    std::vector<XMFLOAT3> triangleBitangents(triangleCount);
+    ParallelRange(triangleCount, threadCount, MinParallelSize, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; ++t)
+        {
+            XMVECTOR p[3];
+            XMFLOAT2 uv[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                const uint32_t index = indices[t * 3 + k];
+                p[k] = XMLoadFloat3(&GetPosition(src, stride, index));
+                memcpy(&uv[k], src + index * stride + texcoordOffset, sizeof(XMFLOAT2));
+            }
+            XMVECTOR e1 = XMVectorSubtract(p[1], p[0]);
+            XMVECTOR e2 = XMVectorSubtract(p[2], p[0]);
+            float du1 = uv[1].x - uv[0].x, dv1 = uv[1].y - uv[0].y;
+            float du2 = uv[2].x - uv[0].x, dv2 = uv[2].y - uv[0].y;
+            float det = du1 * dv2 - du2 * dv1;
+            XMVECTOR tangent = XMVectorZero();
+            XMVECTOR bitangent = XMVectorZero();
+            if (std::fabs(det) > 1e-20f)
+            {
+                // 面積で重み付けされるよう, 行列式の大きさではなく符号だけを掛ける.
+                float sign = det < 0.0f ? -1.0f : 1.0f;
+                tangent = XMVectorScale(XMVectorSubtract(XMVectorScale(e1, dv2), XMVectorScale(e2, dv1)), sign);
+                bitangent = XMVectorScale(XMVectorSubtract(XMVectorScale(e2, du1), XMVectorScale(e1, du2)), sign);
+            }
+            XMStoreFloat3(&triangleTangents[t], tangent);
+            XMStoreFloat3(&triangleBitangents[t], bitangent);
+        }
+    });
+
+    VertexCorners adjacency;
+    adjacency.Build(indices, triangleCount * 3, vertexCount);
+    ParallelRange(vertexCount, threadCount, MinParallelSize, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; ++v)
+        {
+            XMVECTOR tangent = XMVectorZero();
+            XMVECTOR bitangent = XMVectorZero();
+            for (uint32_t i = adjacency.offsets[v]; i < adjacency.offsets[v + 1]; ++i)
+            {
+                const uint32_t t = adjacency.corners[i] / 3;
+                tangent = XMVectorAdd(tangent, XMLoadFloat3(&triangleTangents[t]));
+                bitangent = XMVectorAdd(bitangent, XMLoadFloat3(&triangleBitangents[t]));
+            }
+
+            // 法線と直交化する. 縮退している場合は法線に直交する適当な向きにする.
+            XMVECTOR normal = XMLoadFloat3(&normals[v]);
+            XMVECTOR result;
+            if (!Normalize(XMVectorSubtract(tangent, XMVectorScale(normal, XMVectorGetX(XMVector3Dot(normal, tangent)))), result))
+            {
+                XMVECTOR axis = std::fabs(normals[v].x) < 0.9f ? XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f) : XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+                if (!Normalize(XMVector3Cross(normal, axis), result))
+                {
+                    result = XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f);
+                }
+            }
+            float handedness = XMVectorGetX(XMVector3Dot(XMVector3Cross(normal, result), bitangent)) < 0.0f ? -1.0f : 1.0f;
+            XMStoreFloat4(&tangents[v], XMVectorSetW(result, handedness));
+        }
+    });
+}
+}
@@ -0,0 +1,37 @@
+﻿#pragma once
+#include <DirectXMath.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 読み込んだメッシュの加工 (頂点の溶接, 法線と接線の生成). D3D には依存しません.
+//
+// 頂点は先頭に位置 (XMFLOAT3) を持ち, 残りも float が並んでいるものとします.
+// 法線と接線は三角形ごとの寄与を並列に求めた後, 頂点ごとに参照する三角形の寄与を集めます.
+// 頂点ごとに担当するスレッドが決まるため, 排他制御なしで並列に書き込めます.
+namespace GeometryProcessing
+{
+    enum NormalWeighting
+    {
+        AreaWeighted,   // 三角形の面積で重み付けする.
+        AngleWeighted,  // 頂点での三角形の角度で重み付けする.
+    };
+
+    // 全ての float 要素の差が epsilon 以内の頂点を 1 つにまとめ, 頂点数を返します.
+    // result には最初に現れた順で残った頂点を書き込み, indices を書き換えます.
+    size_t WeldVertices(const void* vertices, size_t vertexCount, size_t stride,
+        uint32_t* indices, size_t indexCount, float epsilon,
+        std::vector<uint8_t>& result);
+
+    // threadCount が 0 ならハードウェアのスレッド数を使います.
+    // どの三角形からも参照されない頂点の法線は (0, 1, 0) になります.
+    void ComputeNormals(const void* vertices, size_t vertexCount, size_t stride,
+        const uint32_t* indices, size_t indexCount, NormalWeighting weighting,
+        DirectX::XMFLOAT3* normals, int threadCount = 0);
+
+    // texcoordOffset は頂点内のテクスチャ座標 (XMFLOAT2) の位置です.
+    // 接線は法線と直交化し, w には従法線の向き (1 または -1) を入れます.
+    void ComputeTangents(const void* vertices, size_t vertexCount, size_t stride, size_t texcoordOffset,
+        const DirectX::XMFLOAT3* normals, const uint32_t* indices, size_t indexCount,
+        DirectX::XMFLOAT4* tangents, int threadCount = 0);
+}
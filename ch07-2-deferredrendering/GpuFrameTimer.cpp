@@ -0,0 +1,145 @@
+﻿#include "GpuFrameTimer.h"
+
+GpuFrameTimer::GpuFrameTimer(int slotCount)
+    : m_d3dDev(nullptr), m_supported(false), m_slots(slotCount), m_next(0), m_oldest(0), m_active(-1)
+{
+    for (auto& slot : m_slots)
+    {
+        slot.disjoint = nullptr;
+        slot.frequency = nullptr;
+        slot.begin = nullptr;
+        slot.end = nullptr;
+        slot.pending = false;
+        slot.tag = 0.0;
+    }
+}
+
+GpuFrameTimer::~GpuFrameTimer()
+{
+    ReleaseDeviceObjects();
+}
+
+void GpuFrameTimer::SetDevice(IDirect3DDevice9Ex* d3dDev)
+{
+    ReleaseDeviceObjects();
+    m_d3dDev = d3dDev;
+    if (!m_d3dDev)
+    {
+        return;
+    }
+    m_d3dDev->AddRef();
+
+    // クエリの種類ごとに対応しているか確かめてから, スロットの数だけ作成しておく.
+    const D3DQUERYTYPE types[] = {
+        D3DQUERYTYPE_TIMESTAMPDISJOINT, D3DQUERYTYPE_TIMESTAMPFREQ, D3DQUERYTYPE_TIMESTAMP,
+    };
+    for (auto type : types)
+    {
+        if (FAILED(m_d3dDev->CreateQuery(type, nullptr)))
+        {
+            return;
+        }
+    }
+    for (auto& slot : m_slots)
+    {
+        if (FAILED(m_d3dDev->CreateQuery(D3DQUERYTYPE_TIMESTAMPDISJOINT, &slot.disjoint)) ||
+            FAILED(m_d3dDev->CreateQuery(D3DQUERYTYPE_TIMESTAMPFREQ, &slot.frequency)) ||
+            FAILED(m_d3dDev->CreateQuery(D3DQUERYTYPE_TIMESTAMP, &slot.begin)) ||
+            FAILED(m_d3dDev->CreateQuery(D3DQUERYTYPE_TIMESTAMP, &slot.end)))
+        {
+            ReleaseDeviceObjects();
+            return;
+        }
+    }
+    m_supported = true;
+}
+
+void GpuFrameTimer::ReleaseDeviceObjects()
+{
+    for (auto& slot : m_slots)
+    {
+        ReleaseSlot(slot);
+    }
+    if (m_d3dDev)
+    {
+        m_d3dDev->Release();
+    }
+    m_d3dDev = nullptr;
+    m_supported = false;
+    m_next = 0;
+    m_oldest = 0;
+    m_active = -1;
+}
+
+void GpuFrameTimer::ReleaseSlot(Slot& slot)
+{
+    IDirect3DQuery9** queries[] = { &slot.disjoint, &slot.frequency, &slot.begin, &slot.end };
+    for (auto query : queries)
+    {
+        if (*query)
+        {
+            (*query)->Release();
+        }
+        *query = nullptr;
+    }
+    slot.pending = false;
+}
+
+void GpuFrameTimer::BeginFrame(double tag)
+{
+    m_active = -1;
+    if (!m_supported || m_slots[m_next].pending)
+    {
+        return;
+    }
+    Slot& slot = m_slots[m_next];
+    slot.disjoint->Issue(D3DISSUE_BEGIN);
+    slot.begin->Issue(D3DISSUE_END);
+    slot.tag = tag;
+    m_active = m_next;
+    m_next = (m_next + 1) % int(m_slots.size());
+}
+
+void GpuFrameTimer::EndFrame()
+{
+    if (m_active < 0)
+    {
+        return;
+    }
+    Slot& slot = m_slots[m_active];
+    slot.end->Issue(D3DISSUE_END);
+    slot.frequency->Issue(D3DISSUE_END);
+    slot.disjoint->Issue(D3DISSUE_END);
+    slot.pending = true;
+    m_active = -1;
+}
+
+bool GpuFrameTimer::GetResult(double& seconds, double& tag)
+{
+    while (m_supported && m_slots[m_oldest].pending)
+    {
+        Slot& slot = m_slots[m_oldest];
+
+        // D3DGETDATA_FLUSH は付けない. 最後に発行した disjoint が完了していれば他も完了している.
+        BOOL disjoint = FALSE;
+        if (slot.disjoint->GetData(&disjoint, sizeof(disjoint), 0) != S_OK)
+        {
+            return false;
+        }
+        UINT64 frequency = 0, begin = 0, end = 0;
+        const bool valid = !disjoint &&
+            slot.frequency->GetData(&frequency, sizeof(frequency), 0) == S_OK &&
+            slot.begin->GetData(&begin, sizeof(begin), 0) == S_OK &&
+            slot.end->GetData(&end, sizeof(end), 0) == S_OK &&
+            frequency > 0 && end >= begin;
+        slot.pending = false;
+        m_oldest = (m_oldest + 1) % int(m_slots.size());
+        if (valid)
+        {
+            seconds = double(end - begin) / double(frequency);
+            tag = slot.tag;
+            return true;
+        }
+    }
+    return false;
+}
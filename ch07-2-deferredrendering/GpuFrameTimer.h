@@ -0,0 +1,53 @@
+﻿#pragma once
+#include <d3d9.h>
+#include <vector>
+
+// タイムスタンプクエリで GPU がフレームの描画にかかった時間を計るクラス.
+//
+// BeginFrame() と EndFrame() の間のコマンドの時間を計ります. 結果は GPU が追いついた数フレーム後に
+// GetResult() で取り出します. 描画を止めないよう, 結果を待つことはありません.
+// 計測中にクロックが変わった (D3DQUERYTYPE_TIMESTAMPDISJOINT) フレームの結果は捨てます.
+// 空きのスロットが無ければ, そのフレームは計りません.
+//
+// タイムスタンプクエリに対応していないデバイスでは IsSupported() が false になり, 何も計りません.
+class GpuFrameTimer
+{
+public:
+    explicit GpuFrameTimer(int slotCount);
+    ~GpuFrameTimer();
+
+    // デバイスを作り直した後に設定します.
+    void SetDevice(IDirect3DDevice9Ex* d3dDev);
+    // 計測中のものは捨てて, クエリを解放します.
+    void ReleaseDeviceObjects();
+    bool IsSupported() const { return m_supported; }
+
+    // tag は結果と一緒に返す値です (そのフレームの描画の設定など).
+    void BeginFrame(double tag);
+    void EndFrame();
+    // 古いものから順に, 完了した計測の結果を取り出します. 無ければ false を返します.
+    bool GetResult(double& seconds, double& tag);
+
+private:
+    GpuFrameTimer(const GpuFrameTimer&);
+    GpuFrameTimer& operator=(const GpuFrameTimer&);
+
+    struct Slot
+    {
+        IDirect3DQuery9* disjoint;
+        IDirect3DQuery9* frequency;
+        IDirect3DQuery9* begin;
+        IDirect3DQuery9* end;
+        bool pending;
+        double tag;
+    };
+
+    void ReleaseSlot(Slot& slot);
+
+    IDirect3DDevice9Ex* m_d3dDev;
+    bool m_supported;
+    std::vector<Slot> m_slots;
+    int m_next;         // 次に BeginFrame() で使うスロット.
+    int m_oldest;       // 次に GetResult() で調べるスロット.
+    int m_active;       // BeginFrame() から EndFrame() までの間のスロット. 無ければ -1.
+};
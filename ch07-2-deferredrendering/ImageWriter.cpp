@@ -0,0 +1,540 @@
+﻿#include "ImageWriter.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+// Deflate の制約.
+const size_t MinMatch = 4;      // 4 バイトのハッシュで探すため, 規格の最小値 3 より長い一致だけを使う.
+const size_t MaxMatch = 258;
+const size_t WindowSize = 32768;
+const size_t MaxStoredBlock = 65535;
+
+const int HashBits = 15;
+const size_t HashTableSize = size_t(1) << HashBits;
+
+uint32_t Read32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint32_t Hash(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - HashBits);
+}
+
+void PutBE32(std::vector<uint8_t>& out, uint32_t v)
+{
+    out.push_back(uint8_t(v >> 24));
+    out.push_back(uint8_t(v >> 16));
+    out.push_back(uint8_t(v >> 8));
+    out.push_back(uint8_t(v));
+}
+
+void PutLE32(uint8_t* p, uint32_t v)
+{
+    p[0] = uint8_t(v);
+    p[1] = uint8_t(v >> 8);
+    p[2] = uint8_t(v >> 16);
+    p[3] = uint8_t(v >> 24);
+}
+
+// ビットを下位から詰めて書き込む.
+class BitWriter
+{
+public:
+    explicit BitWriter(std::vector<uint8_t>& out)
+        : m_out(out), m_bits(0), m_count(0)
+    {
+    }
+
+    // count は 32 以下.
+    void Write(uint32_t value, int count)
+    {
+        m_bits |= uint64_t(value) << m_count;
+        m_count += count;
+        if (m_count >= 32)
+        {
+            uint8_t bytes[4];
+            PutLE32(bytes, uint32_t(m_bits));
+            m_out.insert(m_out.end(), bytes, bytes + 4);
+            m_bits >>= 32;
+            m_count -= 32;
+        }
+    }
+
+    // 残りのビットをバイト境界まで 0 で埋めて書き出す.
+    void Flush()
+    {
+        while (m_count > 0)
+        {
+            m_out.push_back(uint8_t(m_bits));
+            m_bits >>= 8;
+            m_count -= 8;
+        }
+        m_bits = 0;
+        m_count = 0;
+    }
+
+private:
+    std::vector<uint8_t>& m_out;
+    uint64_t m_bits;
+    int m_count;
+};
+
+uint32_t ReverseBits(uint32_t code, int length)
+{
+    uint32_t result = 0;
+    for (int i = 0; i < length; ++i)
+    {
+        result = (result << 1) | ((code >> i) & 1);
+    }
+    return result;
+}
+
+// 固定ハフマン符号 (RFC 1951 3.2.6) の表. 符号は書き込む順にビットを反転しておく.
+struct FixedHuffman
+{
+    uint16_t literalCode[288];
+    uint8_t literalLength[288];
+    uint8_t distanceCode[30];
+
+    // 一致長 (3..258) と距離 (1..32768) の符号番号.
+    uint8_t lengthSymbol[MaxMatch + 1];
+    uint8_t distanceSymbol[512];    // 距離 - 1 が 256 未満ならそのまま, それ以外は 256 + ((距離 - 1) >> 7).
+
+    static const uint16_t LengthBase[29];
+    static const uint8_t LengthExtra[29];
+    static const uint16_t DistanceBase[30];
+    static const uint8_t DistanceExtra[30];
+
+    FixedHuffman()
+    {
+        for (int s = 0; s < 288; ++s)
+        {
+            uint32_t code;
+            int length;
+            if (s < 144)
+            {
+                code = 0x30 + s;
+                length = 8;
+            }
+            else if (s < 256)
+            {
+                code = 0x190 + (s - 144);
+                length = 9;
+            }
+            else if (s < 280)
+            {
+                code = s - 256;
+                length = 7;
+            }
+            else
+            {
+                code = 0xC0 + (s - 280);
+                length = 8;
+            }
+            literalCode[s] = uint16_t(ReverseBits(code, length));
+            literalLength[s] = uint8_t(length);
+        }
+        for (int s = 0; s < 30; ++s)
+        {
+            distanceCode[s] = uint8_t(ReverseBits(s, 5));
+        }
+
+        int s = 0;
+        for (size_t length = 3; length <= MaxMatch; ++length)
+        {
+            while (s + 1 < 29 && length >= LengthBase[s + 1])
+            {
+                ++s;
+            }
+            lengthSymbol[length] = uint8_t(s);
+        }
+        lengthSymbol[0] = lengthSymbol[1] = lengthSymbol[2] = 0;
+
+        for (s = 0; s < 30; ++s)
+        {
+            const uint32_t first = DistanceBase[s] - 1;
+            const uint32_t last = first + (1u << DistanceExtra[s]);
+            for (uint32_t d = first; d < last; ++d)
+            {
+                if (d < 256)
+                {
+                    distanceSymbol[d] = uint8_t(s);
+                }
+                else
+                {
+                    distanceSymbol[256 + (d >> 7)] = uint8_t(s);
+                }
+            }
+        }
+    }
+
+    void WriteLiteral(BitWriter& writer, uint32_t symbol) const
+    {
+        writer.Write(literalCode[symbol], literalLength[symbol]);
+    }
+
+    void WriteMatch(BitWriter& writer, size_t length, size_t distance) const
+    {
+        const int ls = lengthSymbol[length];
+        WriteLiteral(writer, 257 + ls);
+        writer.Write(uint32_t(length - LengthBase[ls]), LengthExtra[ls]);
+
+        const size_t d = distance - 1;
+        const int ds = distanceSymbol[d < 256 ? d : 256 + (d >> 7)];
+        writer.Write(distanceCode[ds], 5);
+        writer.Write(uint32_t(distance - DistanceBase[ds]), DistanceExtra[ds]);
+    }
+};
+
+const uint16_t FixedHuffman::LengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+const uint8_t FixedHuffman::LengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+const uint16_t FixedHuffman::DistanceBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577,
+};
+const uint8_t FixedHuffman::DistanceExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+};
+
+const FixedHuffman& GetFixedHuffman()
+{
+    static const FixedHuffman huffman;
+    return huffman;
+}
+
+// 固定ハフマン符号の 1 ブロックで圧縮する.
+void DeflateFixed(const uint8_t* src, size_t size, std::vector<uint8_t>& out)
+{
+    const FixedHuffman& huffman = GetFixedHuffman();
+    BitWriter writer(out);
+    writer.Write(1, 1);     // BFINAL.
+    writer.Write(1, 2);     // BTYPE = 01 (固定ハフマン符号).
+
+    // 位置 + 1 を記録する. 0 は未登録.
+    std::vector<uint32_t> table(HashTableSize, 0);
+    size_t i = 0;
+    while (i + MinMatch <= size)
+    {
+        const uint32_t sequence = Read32(src + i);
+        uint32_t& entry = table[Hash(sequence)];
+        const size_t candidate = entry;
+        entry = uint32_t(i + 1);
+        if (candidate != 0 && i - (candidate - 1) <= WindowSize && Read32(src + candidate - 1) == sequence)
+        {
+            const uint8_t* match = src + candidate - 1;
+            const size_t limit = (size - i < MaxMatch) ? size - i : MaxMatch;
+            size_t length = MinMatch;
+            while (length < limit && match[length] == src[i + length])
+            {
+                ++length;
+            }
+            huffman.WriteMatch(writer, length, i - (candidate - 1));
+            i += length;
+        }
+        else
+        {
+            huffman.WriteLiteral(writer, src[i]);
+            ++i;
+        }
+    }
+    for (; i < size; ++i)
+    {
+        huffman.WriteLiteral(writer, src[i]);
+    }
+    huffman.WriteLiteral(writer, 256);  // ブロックの終わり.
+    writer.Flush();
+}
+
+// 圧縮しないブロックで格納する.
+void DeflateStored(const uint8_t* src, size_t size, std::vector<uint8_t>& out)
+{
+    size_t offset = 0;
+    do
+    {
+        const size_t length = (size - offset < MaxStoredBlock) ? size - offset : MaxStoredBlock;
+        const bool last = offset + length == size;
+        out.push_back(last ? 1 : 0);    // BFINAL, BTYPE = 00.
+        out.push_back(uint8_t(length));
+        out.push_back(uint8_t(length >> 8));
+        out.push_back(uint8_t(~length));
+        out.push_back(uint8_t(~length >> 8));
+        out.insert(out.end(), src + offset, src + offset + length);
+        offset += length;
+    } while (offset < size);
+}
+
+struct Crc32Table
+{
+    uint32_t table[256];
+
+    Crc32Table()
+    {
+        for (uint32_t n = 0; n < 256; ++n)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k)
+            {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[n] = c;
+        }
+    }
+};
+
+const Crc32Table& GetCrc32Table()
+{
+    static const Crc32Table table;
+    return table;
+}
+
+// PNG のチャンク (長さ, 種類, データ, CRC) を追加する.
+void PutChunk(std::vector<uint8_t>& out, const char* type, const uint8_t* data, size_t size)
+{
+    PutBE32(out, uint32_t(size));
+    const size_t begin = out.size();
+    out.insert(out.end(), type, type + 4);
+    if (size > 0)
+    {
+        out.insert(out.end(), data, data + size);
+    }
+    PutBE32(out, ImageWriter::Crc32(out.data() + begin, out.size() - begin));
+}
+
+// フィルタ後の値を符号付きとみなした絶対値の和. 小さいほど圧縮しやすい.
+uint32_t FilterCost(const uint8_t* row, size_t size)
+{
+    uint32_t cost = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        cost += uint32_t(abs(int(int8_t(row[i]))));
+    }
+    return cost;
+}
+
+// DDS のヘッダ (DDS_HEADER, DDS_PIXELFORMAT) で使う値.
+const uint32_t DdsMagic = 0x20534444;   // "DDS ".
+const uint32_t DdsHeaderSize = 124;
+const uint32_t DdsPixelFormatSize = 32;
+const uint32_t DdsdCaps = 0x1;
+const uint32_t DdsdHeight = 0x2;
+const uint32_t DdsdWidth = 0x4;
+const uint32_t DdsdPitch = 0x8;
+const uint32_t DdsdPixelFormat = 0x1000;
+const uint32_t DdpfAlphaPixels = 0x1;
+const uint32_t DdpfFourCC = 0x4;
+const uint32_t DdpfRgb = 0x40;
+const uint32_t DdsCapsTexture = 0x1000;
+// 浮動小数点数の形式は D3DFORMAT の値を FourCC に入れる.
+const uint32_t FourCCA16B16G16R16F = 113;
+const uint32_t FourCCA32B32G32R32F = 116;
+}
+
+namespace ImageWriter
+{
+bool EncodePng(const uint8_t* src, size_t pitch, int width, int height, bool opaque, std::vector<uint8_t>& out)
+{
+    out.clear();
+    if (width <= 0 || height <= 0)
+    {
+        return false;
+    }
+    const size_t channels = opaque ? 3 : 4;
+    const size_t rowSize = size_t(width) * channels;
+
+    // 行ごとにフィルタの種類 1 バイトとフィルタ後の値を並べる.
+    // Sub と Up を試し, 値が小さくなるものを選ぶ (Paeth などは速さを優先して使わない).
+    std::vector<uint8_t> filtered((rowSize + 1) * height);
+    std::vector<uint8_t> rows[2] = { std::vector<uint8_t>(rowSize), std::vector<uint8_t>(rowSize) };
+    std::vector<uint8_t> sub(rowSize);
+    std::vector<uint8_t> up(rowSize);
+    for (int y = 0; y < height; ++y)
+    {
+        const uint8_t* s = src + pitch * y;
+        std::vector<uint8_t>& row = rows[y & 1];
+        const std::vector<uint8_t>& prev = rows[(y + 1) & 1];
+        if (opaque)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                row[x * 3 + 0] = s[x * 4 + 0];
+                row[x * 3 + 1] = s[x * 4 + 1];
+                row[x * 3 + 2] = s[x * 4 + 2];
+            }
+        }
+        else
+        {
+            memcpy(row.data(), s, rowSize);
+        }
+
+        for (size_t i = 0; i < rowSize; ++i)
+        {
+            sub[i] = uint8_t(row[i] - (i >= channels ? row[i - channels] : 0));
+            up[i] = uint8_t(row[i] - (y > 0 ? prev[i] : 0));
+        }
+        uint8_t* d = filtered.data() + (rowSize + 1) * y;
+        const bool useUp = y > 0 && FilterCost(up.data(), rowSize) < FilterCost(sub.data(), rowSize);
+        d[0] = useUp ? 2 : 1;
+        memcpy(d + 1, useUp ? up.data() : sub.data(), rowSize);
+    }
+
+    static const uint8_t Signature[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+    out.insert(out.end(), Signature, Signature + 8);
+
+    uint8_t header[13];
+    const uint32_t size[2] = { uint32_t(width), uint32_t(height) };
+    for (int i = 0; i < 2; ++i)
+    {
+        header[i * 4 + 0] = uint8_t(size[i] >> 24);
+        header[i * 4 + 1] = uint8_t(size[i] >> 16);
+        header[i * 4 + 2] = uint8_t(size[i] >> 8);
+        header[i * 4 + 3] = uint8_t(size[i]);
+    }
+    header[8] = 8;                  // ビット深度.
+    header[9] = opaque ? 2 : 6;     // RGB / RGBA.
+    header[10] = 0;                 // 圧縮方式.
+    header[11] = 0;                 // フィルタ方式.
+    header[12] = 0;                 // インターレース無し.
+    PutChunk(out, "IHDR", header, sizeof(header));
+
+    std::vector<uint8_t> compressed;
+    compressed.reserve(filtered.size() / 2);
+    CompressZlib(filtered.data(), filtered.size(), compressed);
+    PutChunk(out, "IDAT", compressed.data(), compressed.size());
+    PutChunk(out, "IEND", nullptr, 0);
+    return true;
+}
+
+bool EncodeDds(const void* src, size_t pitch, PixelConvert::Format format, int width, int height, std::vector<uint8_t>& out)
+{
+    out.clear();
+    if (width <= 0 || height <= 0)
+    {
+        return false;
+    }
+    const size_t rowSize = size_t(width) * PixelConvert::GetBytesPerPixel(format);
+
+    uint8_t header[4 + DdsHeaderSize] = {};
+    uint32_t* h = reinterpret_cast<uint32_t*>(header);
+    // リトルエンディアンを前提とする.
+    h[0] = DdsMagic;
+    h[1] = DdsHeaderSize;
+    h[2] = DdsdCaps | DdsdHeight | DdsdWidth | DdsdPitch | DdsdPixelFormat;
+    h[3] = uint32_t(height);
+    h[4] = uint32_t(width);
+    h[5] = uint32_t(rowSize);
+    // h[6] 深さ, h[7] ミップマップ数, h[8..18] 予約.
+    uint32_t* pf = h + 19;
+    pf[0] = DdsPixelFormatSize;
+    switch (format)
+    {
+    case PixelConvert::R8G8B8A8:
+        pf[1] = DdpfRgb | DdpfAlphaPixels;
+        pf[3] = 32;
+        pf[4] = 0x000000FF;
+        pf[5] = 0x0000FF00;
+        pf[6] = 0x00FF0000;
+        pf[7] = 0xFF000000;
+        break;
+    case PixelConvert::B8G8R8A8:
+        pf[1] = DdpfRgb | DdpfAlphaPixels;
+        pf[3] = 32;
+        pf[4] = 0x00FF0000;
+        pf[5] = 0x0000FF00;
+        pf[6] = 0x000000FF;
+        pf[7] = 0xFF000000;
+        break;
+    case PixelConvert::R16G16B16A16F:
+        pf[1] = DdpfFourCC;
+        pf[2] = FourCCA16B16G16R16F;
+        break;
+    case PixelConvert::R32G32B32A32F:
+        pf[1] = DdpfFourCC;
+        pf[2] = FourCCA32B32G32R32F;
+        break;
+    default:
+        return false;
+    }
+    h[27] = DdsCapsTexture;
+
+    out.resize(sizeof(header) + rowSize * height);
+    memcpy(out.data(), header, sizeof(header));
+    for (int y = 0; y < height; ++y)
+    {
+        memcpy(out.data() + sizeof(header) + rowSize * y, static_cast<const uint8_t*>(src) + pitch * y, rowSize);
+    }
+    return true;
+}
+
+bool WriteFile(const char* fileName, const std::vector<uint8_t>& data)
+{
+    FILE* fp = fopen(fileName, "wb");
+    if (!fp)
+    {
+        return false;
+    }
+    const bool written = data.empty() || fwrite(data.data(), data.size(), 1, fp) == 1;
+    return fclose(fp) == 0 && written;
+}
+
+void CompressZlib(const uint8_t* src, size_t size, std::vector<uint8_t>& out)
+{
+    // CMF: Deflate, 32 KB の窓. FLG: 最速の圧縮, (CMF * 256 + FLG) が 31 の倍数.
+    out.push_back(0x78);
+    out.push_back(0x01);
+    const size_t begin = out.size();
+    DeflateFixed(src, size, out);
+    if (out.size() - begin > size + size / 16 + 64)
+    {
+        // 圧縮できないデータは格納するだけにする.
+        out.resize(begin);
+        DeflateStored(src, size, out);
+    }
+    PutBE32(out, Adler32(src, size));
+}
+
+uint32_t Crc32(const uint8_t* data, size_t size, uint32_t crc)
+{
+    const uint32_t* table = GetCrc32Table().table;
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i)
+    {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+uint32_t Adler32(const uint8_t* data, size_t size, uint32_t adler)
+{
+    // 5552 バイトまでなら 32 ビットで桁あふれしないため, まとめて剰余を取る.
+    const size_t MaxRun = 5552;
+    uint32_t a = adler & 0xFFFF;
+    uint32_t b = adler >> 16;
+    while (size > 0)
+    {
+        const size_t run = size < MaxRun ? size : MaxRun;
+        for (size_t i = 0; i < run; ++i)
+        {
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        data += run;
+        size -= run;
+    }
+    return (b << 16) | a;
+}
+}
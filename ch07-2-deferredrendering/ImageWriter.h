@@ -0,0 +1,29 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "PixelConvert.h"
+
+// 画像をファイル形式へ符号化します. D3D には依存しません.
+//
+// PNG は 8 ビットの RGB / RGBA のみ扱います. 行ごとにフィルタ (None, Sub, Up) を選び,
+// 固定ハフマン符号の Deflate で圧縮します. 圧縮率より速さを優先し, 一致の探索は直前の出現位置だけです.
+// 浮動小数点数の G-Buffer などは DDS にそのまま書き出します (D3DFMT の FourCC で形式を表す).
+namespace ImageWriter
+{
+    // src は R8G8B8A8 で, 行ピッチ pitch バイトの画像です.
+    // opaque なら RGB として書き出し, アルファは捨てます.
+    bool EncodePng(const uint8_t* src, size_t pitch, int width, int height, bool opaque, std::vector<uint8_t>& out);
+
+    // 行ピッチ pitch バイトの画像を, 行の間を詰めてミップマップ無しの DDS にします.
+    bool EncodeDds(const void* src, size_t pitch, PixelConvert::Format format, int width, int height, std::vector<uint8_t>& out);
+
+    bool WriteFile(const char* fileName, const std::vector<uint8_t>& data);
+
+    // Deflate (RFC 1951) の圧縮データを zlib (RFC 1950) の形式で out の末尾へ追加します.
+    void CompressZlib(const uint8_t* src, size_t size, std::vector<uint8_t>& out);
+
+    uint32_t Crc32(const uint8_t* data, size_t size, uint32_t crc = 0);
+    uint32_t Adler32(const uint8_t* data, size_t size, uint32_t adler = 1);
+}
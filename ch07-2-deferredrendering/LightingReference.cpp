@@ -0,0 +1,411 @@
+﻿#include "LightingReference.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+// ティーポットを近似する球の半径と床の広さ.
+const float TeapotRadius = 0.85f;
+const float FloorHalfSize = 5.0f;
+
+float SmoothStep(float edge0, float edge1, float x)
+{
+    float t = std::min(std::max((x - edge0) / (edge1 - edge0), 0.0f), 1.0f);
+    return t * t * (3.0f - 2.0f * t);
+}
+
+float Attenuation(float lightRadius, float distance)
+{
+    return 1.0f - SmoothStep(lightRadius * 0.6f, lightRadius, distance);
+}
+
+
+// ShadeReduced() の 1 画素あたりの目安の命令数 (Deferred_*Pass_PS.hlsl の実装に合わせる).
+const double AluPerLight = 15.0;        // 距離, 減衰, N.L, 色の加算.
+const double AluPerPixel = 4.0;         // 法線の正規化と出力.
+const double AluPerUpsampleTap = 10.0;  // 法線と平面の距離の重み, 加算.
+const double AluPerUpsamplePixel = 12.0; // 補間の位置と重みの正規化, アルベドを掛ける.
+
+// シェーダーと同じく, w (= 1) も含めて正規化した法線の xyz. 法線が無ければ false を返す.
+bool GetShadingNormal(const XMFLOAT4& normal, XMFLOAT3& result)
+{
+    float lenSq = normal.x * normal.x + normal.y * normal.y + normal.z * normal.z + normal.w * normal.w;
+    if (lenSq <= 0.0f)
+    {
+        return false;
+    }
+    float invLen = 1.0f / std::sqrt(lenSq);
+    result = XMFLOAT3(normal.x * invLen, normal.y * invLen, normal.z * invLen);
+    return true;
+}
+
+// 法線の向きだけを比べるための単位ベクトル. 法線が無ければ 0.
+XMFLOAT3 GetUnitNormal(const XMFLOAT4& normal)
+{
+    float lenSq = normal.x * normal.x + normal.y * normal.y + normal.z * normal.z;
+    if (lenSq <= 0.0f)
+    {
+        return XMFLOAT3(0.0f, 0.0f, 0.0f);
+    }
+    float invLen = 1.0f / std::sqrt(lenSq);
+    return XMFLOAT3(normal.x * invLen, normal.y * invLen, normal.z * invLen);
+}
+
+// アルベドを掛ける前の光の寄与の合計.
+XMFLOAT3 AccumulateLights(const XMFLOAT4& world, const XMFLOAT3& n, const DeferredScene::LightInfo* lights, int lightCount)
+{
+    XMFLOAT3 sum(0.0f, 0.0f, 0.0f);
+    for (int j = 0; j < lightCount; ++j)
+    {
+        const DeferredScene::LightInfo& light = lights[j];
+        float lx = light.Pos.x - world.x;
+        float ly = light.Pos.y - world.y;
+        float lz = light.Pos.z - world.z;
+        float distance = std::sqrt(lx * lx + ly * ly + lz * lz);
+        if (distance <= 0.0f)
+        {
+            continue;
+        }
+        float att = Attenuation(light.Pos.w, distance);
+        float ndotl = (lx * n.x + ly * n.y + lz * n.z) / distance;
+        float lighting = std::max(0.0f, ndotl) * att;
+
+        sum.x += lighting * light.Color.x;
+        sum.y += lighting * light.Color.y;
+        sum.z += lighting * light.Color.z;
+    }
+    return sum;
+}
+
+float Saturate(float value)
+{
+    return std::min(std::max(value, 0.0f), 1.0f);
+}
+
+// 球との交差. 当たらなければ負の値を返す.
+float IntersectSphere(const XMFLOAT3& origin, const XMFLOAT3& dir, const XMFLOAT3& center, float radius)
+{
+    float ox = origin.x - center.x;
+    float oy = origin.y - center.y;
+    float oz = origin.z - center.z;
+    float b = ox * dir.x + oy * dir.y + oz * dir.z;
+    float c = ox * ox + oy * oy + oz * oz - radius * radius;
+    float d = b * b - c;
+    if (d < 0.0f)
+    {
+        return -1.0f;
+    }
+    return -b - std::sqrt(d);
+}
+}
+
+namespace LightingReference
+{
+void BuildGBuffer(int width, int height, GBuffer& gbuffer)
+{
+    gbuffer.width = width;
+    gbuffer.height = height;
+    const size_t pixelCount = size_t(width) * size_t(height);
+    gbuffer.worldPos.assign(pixelCount, XMFLOAT4(0, 0, 0, 0));
+    gbuffer.worldNormal.assign(pixelCount, XMFLOAT4(0, 0, 0, 0));
+    gbuffer.diffuse.assign(pixelCount, XMFLOAT4(0, 0, 0, 0));
+
+    XMMATRIX view, proj;
+    DeferredScene::BuildCameraMatrices(width, height, view, proj);
+    XMMATRIX invViewProj = XMMatrixInverse(nullptr, view * proj);
+
+    const XMFLOAT3& eye = DeferredScene::GetCamera().eyePos;
+    const XMFLOAT3* modelPos = DeferredScene::GetModelPositions();
+    const XMFLOAT4* modelColor = DeferredScene::GetModelColors();
+
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            // ピクセル中心を通るレイを求める.
+            float ndcX = (float(x) + 0.5f) / float(width) * 2.0f - 1.0f;
+            float ndcY = 1.0f - (float(y) + 0.5f) / float(height) * 2.0f;
+            XMVECTOR farPos = XMVector3TransformCoord(XMVectorSet(ndcX, ndcY, 1.0f, 1.0f), invViewProj);
+            XMFLOAT3 dir;
+            XMStoreFloat3(&dir, XMVector3Normalize(farPos - XMLoadFloat3(&eye)));
+
+            float nearest = FLT_MAX;
+            int hitModel = -1;
+            for (int i = 0; i < DeferredScene::ModelCount; ++i)
+            {
+                float t = IntersectSphere(eye, dir, modelPos[i], TeapotRadius);
+                if (t > 0.0f && t < nearest)
+                {
+                    nearest = t;
+                    hitModel = i;
+                }
+            }
+
+            XMFLOAT3 normal(0.0f, 1.0f, 0.0f);
+            XMFLOAT4 color(1.0f, 1.0f, 1.0f, 1.0f);
+            if (hitModel < 0)
+            {
+                // 床との交差.
+                if (dir.y >= 0.0f)
+                {
+                    continue;
+                }
+                float t = -eye.y / dir.y;
+                float px = eye.x + dir.x * t;
+                float pz = eye.z + dir.z * t;
+                if (std::fabs(px) > FloorHalfSize || std::fabs(pz) > FloorHalfSize)
+                {
+                    continue;
+                }
+                nearest = t;
+            }
+
+            XMFLOAT4 world(
+                eye.x + dir.x * nearest,
+                eye.y + dir.y * nearest,
+                eye.z + dir.z * nearest,
+                1.0f);
+            if (hitModel >= 0)
+            {
+                const XMFLOAT3& center = modelPos[hitModel];
+                normal = XMFLOAT3(
+                    (world.x - center.x) / TeapotRadius,
+                    (world.y - center.y) / TeapotRadius,
+                    (world.z - center.z) / TeapotRadius);
+                color = modelColor[hitModel];
+            }
+
+            // G-Buffer 作成パスのピクセルシェーダーと同じく法線の w は 1 とする.
+            const size_t index = size_t(y) * size_t(width) + size_t(x);
+            gbuffer.worldPos[index] = world;
+            gbuffer.worldNormal[index] = XMFLOAT4(normal.x, normal.y, normal.z, 1.0f);
+            gbuffer.diffuse[index] = color;
+        }
+    }
+}
+
+void Shade(const GBuffer& gbuffer, const DeferredScene::LightInfo* lights, int lightCount,
+    std::vector<XMFLOAT4>& output)
+{
+    const size_t pixelCount = size_t(gbuffer.width) * size_t(gbuffer.height);
+    output.resize(pixelCount);
+    for (size_t i = 0; i < pixelCount; ++i)
+    {
+        const XMFLOAT4& diffuse = gbuffer.diffuse[i];
+        const XMFLOAT4& world = gbuffer.worldPos[i];
+        XMFLOAT4 n = gbuffer.worldNormal[i];
+
+        // シェーダーでは float4 のまま normalize しているので w も含めて正規化する.
+        float lenSq = n.x * n.x + n.y * n.y + n.z * n.z + n.w * n.w;
+        XMFLOAT4 color(0.0f, 0.0f, 0.0f, 1.0f);
+        if (lenSq > 0.0f)
+        {
+            float invLen = 1.0f / std::sqrt(lenSq);
+            n.x *= invLen;
+            n.y *= invLen;
+            n.z *= invLen;
+
+            for (int j = 0; j < lightCount; ++j)
+            {
+                const DeferredScene::LightInfo& light = lights[j];
+                float lx = light.Pos.x - world.x;
+                float ly = light.Pos.y - world.y;
+                float lz = light.Pos.z - world.z;
+                float distance = std::sqrt(lx * lx + ly * ly + lz * lz);
+                if (distance <= 0.0f)
+                {
+                    continue;
+                }
+                float att = Attenuation(light.Pos.w, distance);
+                float ndotl = (lx * n.x + ly * n.y + lz * n.z) / distance;
+                float lighting = std::max(0.0f, ndotl) * att;
+
+                color.x += lighting * light.Color.x * diffuse.x;
+                color.y += lighting * light.Color.y * diffuse.y;
+                color.z += lighting * light.Color.z * diffuse.z;
+            }
+        }
+        output[i] = color;
+    }
+}
+
+UpsampleParams GetDefaultUpsampleParams(int factor)
+{
+    UpsampleParams params;
+    params.factor = factor;
+    params.normalPower = 16.0f;
+    params.planeSharpness = 50.0f;
+    params.minWeight = 0.5f;
+    return params;
+}
+
+size_t ShadeReduced(const GBuffer& gbuffer, const DeferredScene::LightInfo* lights, int lightCount,
+    const UpsampleParams& params, std::vector<XMFLOAT4>& output)
+{
+    size_t fallbackCount = 0;
+    const int width = gbuffer.width;
+    const int height = gbuffer.height;
+    const int factor = std::max(params.factor, 1);
+    const int half = factor / 2;
+    const int lowWidth = (width + factor - 1) / factor;
+    const int lowHeight = (height + factor - 1) / factor;
+
+    // 低い解像度の各画素は, 対応する factor x factor の範囲の中央の G-Buffer の値で光を計算する.
+    std::vector<XMFLOAT3> irradiance(size_t(lowWidth) * size_t(lowHeight));
+    std::vector<int> sampleIndex(irradiance.size());
+    for (int y = 0; y < lowHeight; ++y)
+    {
+        for (int x = 0; x < lowWidth; ++x)
+        {
+            const int gx = std::min(x * factor + half, width - 1);
+            const int gy = std::min(y * factor + half, height - 1);
+            const size_t source = size_t(gy) * size_t(width) + size_t(gx);
+            const size_t index = size_t(y) * size_t(lowWidth) + size_t(x);
+            sampleIndex[index] = int(source);
+
+            XMFLOAT3 n;
+            irradiance[index] = GetShadingNormal(gbuffer.worldNormal[source], n)
+                ? AccumulateLights(gbuffer.worldPos[source], n, lights, lightCount)
+                : XMFLOAT3(0.0f, 0.0f, 0.0f);
+        }
+    }
+
+    const size_t pixelCount = size_t(width) * size_t(height);
+    output.resize(pixelCount);
+    for (int y = 0; y < height; ++y)
+    {
+        // 周りの 4 つの標本の位置とバイリニアの重み.
+        const float ly = float(y - half) / float(factor);
+        const int y0 = int(std::floor(ly));
+        const float fy = ly - float(y0);
+        const int rows[2] = { std::min(std::max(y0, 0), lowHeight - 1), std::min(std::max(y0 + 1, 0), lowHeight - 1) };
+        for (int x = 0; x < width; ++x)
+        {
+            const float lx = float(x - half) / float(factor);
+            const int x0 = int(std::floor(lx));
+            const float fx = lx - float(x0);
+            const int cols[2] = { std::min(std::max(x0, 0), lowWidth - 1), std::min(std::max(x0 + 1, 0), lowWidth - 1) };
+            const float bilinear[4] = { (1.0f - fx) * (1.0f - fy), fx * (1.0f - fy), (1.0f - fx) * fy, fx * fy };
+
+            const size_t index = size_t(y) * size_t(width) + size_t(x);
+            const XMFLOAT4& p = gbuffer.worldPos[index];
+            const XMFLOAT3 n = GetUnitNormal(gbuffer.worldNormal[index]);
+            if (n.x == 0.0f && n.y == 0.0f && n.z == 0.0f)
+            {
+                // 何も無い画素.
+                output[index] = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+                continue;
+            }
+
+            XMFLOAT3 sum(0.0f, 0.0f, 0.0f);
+            float totalWeight = 0.0f;
+            for (int i = 0; i < 4; ++i)
+            {
+                const size_t low = size_t(rows[i / 2]) * size_t(lowWidth) + size_t(cols[i % 2]);
+                const int source = sampleIndex[low];
+                const XMFLOAT4& pi = gbuffer.worldPos[source];
+                const XMFLOAT3 ni = GetUnitNormal(gbuffer.worldNormal[source]);
+
+                // 向きの違う面や, 自分の面から離れた標本の重みを下げる.
+                const float normalWeight = std::pow(Saturate(n.x * ni.x + n.y * ni.y + n.z * ni.z), params.normalPower);
+                const float plane = std::fabs(n.x * (pi.x - p.x) + n.y * (pi.y - p.y) + n.z * (pi.z - p.z));
+                const float geometryWeight = normalWeight / (1.0f + params.planeSharpness * plane);
+                const float weight = bilinear[i] * geometryWeight;
+
+                const XMFLOAT3& e = irradiance[low];
+                sum.x += e.x * weight;
+                sum.y += e.y * weight;
+                sum.z += e.z * weight;
+                totalWeight += weight;
+            }
+            if (totalWeight > 0.0f && totalWeight >= params.minWeight)
+            {
+                const float inv = 1.0f / totalWeight;
+                sum = XMFLOAT3(sum.x * inv, sum.y * inv, sum.z * inv);
+            }
+            else
+            {
+                // 同じ面の標本が無い (輪郭など) ので, この画素だけ元の解像度で計算する.
+                XMFLOAT3 shadingNormal;
+                GetShadingNormal(gbuffer.worldNormal[index], shadingNormal);
+                sum = AccumulateLights(p, shadingNormal, lights, lightCount);
+                fallbackCount++;
+            }
+
+            const XMFLOAT4& diffuse = gbuffer.diffuse[index];
+            output[index] = XMFLOAT4(sum.x * diffuse.x, sum.y * diffuse.y, sum.z * diffuse.z, 1.0f);
+        }
+    }
+    return fallbackCount;
+}
+
+ImageError CompareImages(const std::vector<XMFLOAT4>& reference, const std::vector<XMFLOAT4>& image)
+{
+    ImageError error;
+    error.rmse = 0.0;
+    error.psnr = 0.0;
+    error.maxError = 0.0;
+    error.badPixelRatio = 0.0;
+    const size_t count = std::min(reference.size(), image.size());
+    if (count == 0)
+    {
+        return error;
+    }
+
+    double sumSq = 0.0;
+    size_t badPixels = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const float a[3] = { reference[i].x, reference[i].y, reference[i].z };
+        const float b[3] = { image[i].x, image[i].y, image[i].z };
+        double pixelMax = 0.0;
+        for (int c = 0; c < 3; ++c)
+        {
+            const double diff = std::fabs(double(Saturate(a[c])) - double(Saturate(b[c])));
+            sumSq += diff * diff;
+            pixelMax = std::max(pixelMax, diff);
+        }
+        error.maxError = std::max(error.maxError, pixelMax);
+        if (pixelMax > 1.0 / 64.0)
+        {
+            badPixels++;
+        }
+    }
+    error.rmse = std::sqrt(sumSq / double(count * 3));
+    error.psnr = error.rmse > 0.0 ? -20.0 * std::log10(error.rmse) : HUGE_VAL;
+    error.badPixelRatio = double(badPixels) / double(count);
+    return error;
+}
+
+Cost EstimateCost(int width, int height, int lightCount, int factor, double fallbackRatio)
+{
+    Cost cost;
+    const double pixels = double(width) * double(height);
+    if (factor <= 1)
+    {
+        // G-Buffer 3 枚を読み, 全ての光を計算してアルベドを掛ける.
+        cost.lightEvaluations = pixels * lightCount;
+        cost.textureFetches = pixels * 3.0;
+        cost.aluInstructions = pixels * (AluPerPixel + AluPerLight * lightCount);
+        return cost;
+    }
+
+    // 光の計算: 低い解像度の画素ごとに位置と法線を読む.
+    const double lowPixels = double((width + factor - 1) / factor) * double((height + factor - 1) / factor);
+    cost.lightEvaluations = lowPixels * lightCount;
+    cost.textureFetches = lowPixels * 2.0;
+    cost.aluInstructions = lowPixels * (AluPerPixel + AluPerLight * lightCount);
+
+    // 補間: 自分の位置, 法線, アルベドと, 4 つの標本の光の寄与, 位置, 法線を読む.
+    cost.textureFetches += pixels * (3.0 + 4.0 * 3.0);
+    cost.aluInstructions += pixels * (AluPerUpsamplePixel + AluPerUpsampleTap * 4.0);
+
+    // 元の解像度で計算し直す画素. G-Buffer は読んであるので光の計算だけが増える.
+    cost.lightEvaluations += pixels * fallbackRatio * lightCount;
+    cost.aluInstructions += pixels * fallbackRatio * AluPerLight * lightCount;
+    return cost;
+}
+}
@@ -0,0 +1,65 @@
+﻿#pragma once
+#include "DeferredScene.h"
+#include <vector>
+
+// ライティングパス (Deferred_LightingPass_PS.hlsl) を CPU で計算するリファレンス実装.
+// GPU を使わずにライティングの計算コストを計測したり,
+// 近似した描画結果の誤差を求めるための基準として使います.
+namespace LightingReference
+{
+    // G-Buffer の内容. レンダーターゲットと同じく D3DFMT_A32B32G32R32F 相当で持つ.
+    struct GBuffer
+    {
+        int width;
+        int height;
+        std::vector<DirectX::XMFLOAT4> worldPos;
+        std::vector<DirectX::XMFLOAT4> worldNormal;
+        std::vector<DirectX::XMFLOAT4> diffuse;
+    };
+
+    // DeferredScene のカメラからレイを飛ばして G-Buffer を作ります.
+    // ティーポットは球で, 床は y=0 の平面で近似します.
+    // 何も無いピクセルは法線が 0 となり, ライティング結果は黒になります.
+    void BuildGBuffer(int width, int height, GBuffer& gbuffer);
+
+    // ピクセルシェーダーと同じ計算で G-Buffer をライティングします.
+    void Shade(const GBuffer& gbuffer, const DeferredScene::LightInfo* lights, int lightCount,
+        std::vector<DirectX::XMFLOAT4>& output);
+
+    // 光の寄与を低い解像度で計算する場合の設定.
+    struct UpsampleParams
+    {
+        int factor;             // 2 なら縦横半分, 4 なら 1/4 の解像度で光の寄与を計算する.
+        float normalPower;      // 法線の向きの差による重み pow(saturate(dot(n, ni)), normalPower).
+        float planeSharpness;   // 自分の面からの距離による重み 1 / (1 + planeSharpness * |dot(n, pi - p)|).
+        float minWeight;        // 重みの合計がこれより小さい画素は, 元の解像度で光を計算する.
+    };
+    UpsampleParams GetDefaultUpsampleParams(int factor);
+
+    // 光の寄与 (アルベドを掛ける前) を 1/factor の解像度で計算し, 周りの 4 つをバイリニアの重みに
+    // 法線と位置の重みを掛けて補間 (バイラテラルアップサンプリング) してから, 元の解像度でアルベドを掛けます.
+    // 輪郭などで同じ面の標本が無い画素は, 元の解像度で光を計算します. その画素の数を返します.
+    // Deferred_LightAccumPass_PS.hlsl と Deferred_UpsamplePass_PS.hlsl と同じ計算です.
+    size_t ShadeReduced(const GBuffer& gbuffer, const DeferredScene::LightInfo* lights, int lightCount,
+        const UpsampleParams& params, std::vector<DirectX::XMFLOAT4>& output);
+
+    // 表示と同じく各チャンネルを [0, 1] に丸めてから比べた誤差.
+    struct ImageError
+    {
+        double rmse;
+        double psnr;            // dB. 一致していれば 0 ではなく無限大.
+        double maxError;
+        double badPixelRatio;   // いずれかのチャンネルの差が 1/64 を超える画素の割合.
+    };
+    ImageError CompareImages(const std::vector<DirectX::XMFLOAT4>& reference, const std::vector<DirectX::XMFLOAT4>& image);
+
+    // ライティングの GPU のコストの目安. シェーダーの命令を数えたもので, 実際の時間ではありません.
+    struct Cost
+    {
+        double lightEvaluations;    // 画素と光の組み合わせの数.
+        double textureFetches;
+        double aluInstructions;
+    };
+    // factor が 1 なら全ての画素で光を計算する場合. fallbackRatio は元の解像度で計算し直す画素の割合.
+    Cost EstimateCost(int width, int height, int lightCount, int factor, double fallbackRatio);
+}
@@ -0,0 +1,240 @@
+﻿#include "Lz4Codec.h"
+#include <cstring>
+
+namespace
+{
+// LZ4 のブロック形式の制約.
+const size_t MinMatch = 4;
+const size_t LastLiterals = 5;      // 最後の 5 バイトは必ずリテラルにする.
+const size_t MatchFindLimit = 12;   // 末尾 12 バイト以内からは一致を始めない.
+const size_t MaxDistance = 65535;
+
+const int HashBits = 13;
+const size_t HashTableSize = size_t(1) << HashBits;
+// 一致が見つからない間は, 64 回ごとに探す間隔を 1 バイトずつ広げる.
+const int SkipTrigger = 6;
+
+uint32_t Read32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint32_t Hash(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - HashBits);
+}
+
+uint8_t* WriteLength(uint8_t* op, size_t length)
+{
+    while (length >= 255)
+    {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = uint8_t(length);
+    return op;
+}
+
+// リテラルと一致を 1 つのシーケンスとして書き込む. matchLength が 0 なら最後のシーケンス.
+uint8_t* WriteSequence(uint8_t* op, const uint8_t* literals, size_t literalLength, size_t distance, size_t matchLength)
+{
+    uint8_t* token = op++;
+    const size_t matchCode = matchLength ? matchLength - MinMatch : 0;
+    *token = uint8_t(((literalLength < 15 ? literalLength : 15) << 4) | (matchCode < 15 ? matchCode : 15));
+    if (literalLength >= 15)
+    {
+        op = WriteLength(op, literalLength - 15);
+    }
+    if (literalLength > 0)
+    {
+        memcpy(op, literals, literalLength);
+        op += literalLength;
+    }
+    if (matchLength == 0)
+    {
+        return op;
+    }
+    *op++ = uint8_t(distance);
+    *op++ = uint8_t(distance >> 8);
+    if (matchCode >= 15)
+    {
+        op = WriteLength(op, matchCode - 15);
+    }
+    return op;
+}
+
+// 15 を超える長さの続きを読む.
+bool ReadLength(const uint8_t*& ip, const uint8_t* iend, size_t limit, size_t& length)
+{
+    uint8_t b;
+    do
+    {
+        if (ip == iend)
+        {
+            return false;
+        }
+        b = *ip++;
+        length += b;
+        if (length > limit)
+        {
+            return false;
+        }
+    } while (b == 255);
+    return true;
+}
+}
+
+namespace Lz4Codec
+{
+size_t GetMaxCompressedSize(size_t srcSize)
+{
+    return srcSize + srcSize / 255 + 16;
+}
+
+size_t Compress(const uint8_t* src, size_t srcSize, uint8_t* dst)
+{
+    uint8_t* op = dst;
+    size_t anchor = 0;
+    if (srcSize > MatchFindLimit)
+    {
+        uint32_t table[HashTableSize];
+        memset(table, 0, sizeof(table));
+
+        const size_t matchLimit = srcSize - LastLiterals;
+        const size_t searchLimit = srcSize - MatchFindLimit;
+        size_t ip = 1;
+        unsigned misses = 0;
+        while (ip <= searchLimit)
+        {
+            const uint32_t sequence = Read32(src + ip);
+            uint32_t& slot = table[Hash(sequence)];
+            size_t candidate = slot;
+            slot = uint32_t(ip);
+            if (candidate >= ip || ip - candidate > MaxDistance || Read32(src + candidate) != sequence)
+            {
+                ip += 1 + (misses++ >> SkipTrigger);
+                continue;
+            }
+            misses = 0;
+
+            // 一致を前後に伸ばす.
+            while (ip > anchor && candidate > 0 && src[ip - 1] == src[candidate - 1])
+            {
+                --ip;
+                --candidate;
+            }
+            size_t length = MinMatch;
+            while (ip + length < matchLimit && src[ip + length] == src[candidate + length])
+            {
+                ++length;
+            }
+
+            op = WriteSequence(op, src + anchor, ip - anchor, ip - candidate, length);
+            ip += length;
+            anchor = ip;
+            // 一致の途中の位置も登録しておくと, 繰り返しの多いデータで次の一致が見つかりやすい.
+            if (ip <= searchLimit)
+            {
+                table[Hash(Read32(src + ip - 2))] = uint32_t(ip - 2);
+            }
+        }
+    }
+    op = WriteSequence(op, src + anchor, srcSize - anchor, 0, 0);
+    return size_t(op - dst);
+}
+
+bool Decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize)
+{
+    const uint8_t* ip = src;
+    const uint8_t* const iend = src + srcSize;
+    uint8_t* op = dst;
+    uint8_t* const oend = dst + dstSize;
+    for (;;)
+    {
+        if (ip == iend)
+        {
+            return false;
+        }
+        const unsigned token = *ip++;
+
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !ReadLength(ip, iend, dstSize, literalLength))
+        {
+            return false;
+        }
+        if (size_t(iend - ip) < literalLength || size_t(oend - op) < literalLength)
+        {
+            return false;
+        }
+        // 短いリテラルは余裕があれば 16 バイト単位で写す. 写し過ぎた分は後で上書きされる.
+        if (literalLength <= 16 && iend - ip >= 16 && oend - op >= 16)
+        {
+            memcpy(op, ip, 16);
+        }
+        else
+        {
+            memcpy(op, ip, literalLength);
+        }
+        op += literalLength;
+        ip += literalLength;
+        if (ip == iend)
+        {
+            break;
+        }
+
+        if (iend - ip < 2)
+        {
+            return false;
+        }
+        const size_t distance = size_t(ip[0]) | (size_t(ip[1]) << 8);
+        ip += 2;
+        if (distance == 0 || distance > size_t(op - dst))
+        {
+            return false;
+        }
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !ReadLength(ip, iend, dstSize, matchLength))
+        {
+            return false;
+        }
+        matchLength += MinMatch;
+        if (size_t(oend - op) < matchLength)
+        {
+            return false;
+        }
+
+        const uint8_t* match = op - distance;
+        if (distance >= 16 && size_t(oend - op) >= matchLength + 16)
+        {
+            // 16 バイト以上離れていれば, 前から 16 バイトずつ写しても重ならない.
+            for (size_t i = 0; i < matchLength; i += 16)
+            {
+                memcpy(op + i, match + i, 16);
+            }
+        }
+        else if (distance >= 8 && size_t(oend - op) >= matchLength + 8)
+        {
+            for (size_t i = 0; i < matchLength; i += 8)
+            {
+                memcpy(op + i, match + i, 8);
+            }
+        }
+        else if (distance >= matchLength)
+        {
+            memcpy(op, match, matchLength);
+        }
+        else
+        {
+            // 直前の数バイトの繰り返し.
+            for (size_t i = 0; i < matchLength; ++i)
+            {
+                op[i] = match[i];
+            }
+        }
+        op += matchLength;
+    }
+    return op == oend;
+}
+}
@@ -2,8 +2,18 @@
 #include <Windows.h>
 #include <tchar.h>
 #include "App.h"
+#include "BenchmarkSuite.h"
+#include "MappedFile.h"
+#include "RenderThread.h"
+#include "SelfTest.h"
+#include "TraceReplayer.h"
+#include "TripleBuffer.h"
 
 #include <DirectXMath.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
 namespace
 {
@@ -16,6 +26,105 @@ namespace
     // ウィンドウのサイズ.
     const int WindowWidth = 1280;
     const int WindowHeight = 720;
+
+    // 描画スレッドへ渡すイベントのキューの大きさ.
+    const int RenderEventQueueSize = 256;
+
+    // シミュレーションを進める間隔 (秒). 止まっていた場合も, まとめて進めるのは MaxSimulationLag 秒までにする.
+    const double SimulationStep = 1.0 / 60.0;
+    const double MaxSimulationLag = 0.25;
+    // 矢印キーでカメラを回す速さ (ラジアン/秒).
+    const float CameraTurnSpeed = 1.0f;
+
+    // 描画スレッドがデバイスの消失を知らせるメッセージ.
+    const UINT WM_DEVICELOST = WM_APP + 1;
+    // デバイスの作り直しに失敗した場合に再試行するタイマー.
+    const UINT_PTR RecoverTimerId = 1;
+    const UINT RecoverRetryMsec = 500;
+
+    // ウィンドウを破棄する前に描画を止めるため, WndProc から参照する.
+    RenderThread* g_renderThread = nullptr;
+
+    // 描画スレッドで App を動かす.
+    class AppRenderClient : public RenderThread::Client
+    {
+    public:
+        AppRenderClient(App& app, TripleBuffer<DeferredScene::Snapshot>& snapshots, HWND hWnd)
+            : m_app(app), m_snapshots(snapshots), m_hWnd(hWnd), m_lostPosted(false)
+        {
+        }
+
+        // 描画スレッドを止めている間に呼び出す. 再びデバイスが失われれば知らせる.
+        void ResetDeviceLost()
+        {
+            m_lostPosted = false;
+        }
+
+        virtual void WaitForFrame()
+        {
+            m_app.WaitForNextFrame();
+        }
+
+        virtual void HandleEvent(const RenderEvent& event)
+        {
+            if (event.type != RenderEvent::KeyDown)
+            {
+                return;
+            }
+            // F9 キーでデバイスの消失を模擬し, 復帰処理を確認する.
+            if (event.key == VK_F9)
+            {
+                m_app.SimulateDeviceLost();
+            }
+            // F12 キーで画面を保存する. Shift を押していれば G-Buffer も保存する.
+            if (event.key == VK_F12)
+            {
+                m_app.RequestCapture((event.modifiers & RenderEvent::Shift) != 0);
+            }
+        }
+
+        virtual void RenderFrame()
+        {
+            // シミュレーションの最新の状態で描画する.
+            if (m_snapshots.Update())
+            {
+                m_app.SetCamera(m_snapshots.GetReadBuffer().camera);
+            }
+            m_app.Render();
+
+            // デバイスの作り直しはウィンドウのスレッドに任せ, それまでの Render() は何も描画しない.
+            // ウィンドウのスレッドは WM_CLOSE で描画スレッドの終了を待つので, 送ったメッセージの処理は待たない.
+            if (m_app.IsDeviceLost() && !m_lostPosted)
+            {
+                m_lostPosted = true;
+                PostMessage(m_hWnd, WM_DEVICELOST, 0, 0);
+            }
+        }
+
+    private:
+        AppRenderClient(const AppRenderClient&);
+        AppRenderClient& operator=(const AppRenderClient&);
+
+        App& m_app;
+        TripleBuffer<DeferredScene::Snapshot>& m_snapshots;
+        HWND m_hWnd;
+        bool m_lostPosted;  // 描画スレッドだけが書き換える.
+    };
+
+    // デバイスはこのスレッドで作成したので, 作り直しもこのスレッドで行う.
+    // 描画スレッドを止めてから作り直し, 成功すれば再開する. 失敗すれば止めたまま, 少し待って再試行する.
+    void RecoverDevice(HWND hWnd, App& app, RenderThread& renderThread, AppRenderClient& client)
+    {
+        KillTimer(hWnd, RecoverTimerId);
+        renderThread.Stop();
+        if (!app.RecoverDevice())
+        {
+            SetTimer(hWnd, RecoverTimerId, RecoverRetryMsec, nullptr);
+            return;
+        }
+        client.ResetDeviceLost();
+        renderThread.Start(&client);
+    }
 }
 
 LRESULT CALLBACK WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
@@ -30,6 +139,14 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
             PostMessage(hWnd, WM_CLOSE, 0, 0);
         }
         break;
+    case WM_CLOSE:
+        // 描画スレッドを止めてからウィンドウを破棄する.
+        if (g_renderThread)
+        {
+            g_renderThread->Stop();
+        }
+        DestroyWindow(hWnd);
+        break;
     case WM_PAINT:
         hdc = BeginPaint(hWnd, &ps);
         EndPaint(hWnd, &ps);
@@ -106,8 +223,168 @@ HWND SetupWindow(HINSTANCE hInstance, int width, int height)
     return hWnd;
 }
 
+// ウィンドウを作らず, ヌルデバイスで指定フレーム数だけ描画処理を実行する.
+// GPU の無い環境で CPU 側の処理時間を計測するために使う.
+// captureInterval が 0 より大きければ, そのフレームごとに画面を読み戻して保存の負荷を計測する.
+// traceFile が空でなければ, デバイスの呼び出しを記録して保存する.
+int RunHeadless(int frameCount, int captureInterval, const std::string& traceFile)
+{
+    App app;
+    app.SetCaptureInterval(captureInterval);
+    app.SetTraceFile(traceFile);
+    if (!app.Initialize(nullptr, WindowWidth, WindowHeight, App::HeadlessMode))
+    {
+        return -1;
+    }
+
+    LARGE_INTEGER freq, begin, end;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&begin);
+    for (int i = 0; i < frameCount; ++i)
+    {
+        // 描画スレッドは無いので, そのまま作り直す.
+        if (app.IsDeviceLost())
+        {
+            app.RecoverDevice();
+        }
+        app.Render();
+    }
+    QueryPerformanceCounter(&end);
+
+    double msec = double(end.QuadPart - begin.QuadPart) * 1000.0 / double(freq.QuadPart);
+    char buf[128];
+    snprintf(buf, sizeof(buf), "Headless: %d frames, %.3f ms/frame (CPU)\n",
+        frameCount, frameCount > 0 ? msec / frameCount : 0.0);
+    std::string report = buf;
+    report += app.GetNullDevice()->Report();
+    if (captureInterval > 0)
+    {
+        report += app.GetCaptureReport();
+    }
+    OutputDebugStringA(report.c_str());
+    fputs(report.c_str(), stdout);
+
+    app.Terminate();
+    return 0;
+}
+
+// コマンドラインから name の次の単語を取り出す. 無ければ空文字列を返す.
+std::string GetOption(const char* cmdLine, const char* name)
+{
+    const char* p = strstr(cmdLine, name);
+    if (!p)
+    {
+        return std::string();
+    }
+    p += strlen(name);
+    while (*p == ' ')
+    {
+        ++p;
+    }
+    const char* end = p;
+    while (*end != '\0' && *end != ' ')
+    {
+        ++end;
+    }
+    return std::string(p, end);
+}
+
+// 記録したトレースをヌルデバイスに count 回再生し, 呼び出しごとの処理時間を表示する.
+// filter なら同じ値を設定するステートの呼び出しを省いて再生する.
+int RunReplay(const std::string& fileName, int count, bool filter)
+{
+    MappedFile file;
+    if (!file.Open(fileName.c_str(), MappedFile::Sequential))
+    {
+        fprintf(stderr, "Failed to open %s\n", fileName.c_str());
+        return -1;
+    }
+
+    // App と同じバックバッファと深度バッファ.
+    D3DPRESENT_PARAMETERS pp;
+    ZeroMemory(&pp, sizeof(pp));
+    pp.BackBufferWidth = WindowWidth;
+    pp.BackBufferHeight = WindowHeight;
+    pp.BackBufferFormat = D3DFMT_A8R8G8B8;
+    pp.BackBufferCount = 2;
+    pp.SwapEffect = D3DSWAPEFFECT_DISCARD;
+    pp.AutoDepthStencilFormat = D3DFMT_D24S8;
+    pp.EnableAutoDepthStencil = TRUE;
+    pp.Windowed = TRUE;
+
+    TraceReplayer replayer;
+    double msec = 0.0;
+    int frames = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        NullDevice* device = new NullDevice(pp);
+        const bool replayed = replayer.Replay(device, file.GetData(), file.GetSize(), filter);
+        device->Release();
+        if (!replayed)
+        {
+            fprintf(stderr, "Broken trace: %s\n", fileName.c_str());
+            return -1;
+        }
+        msec += replayer.GetStats().totalMsec;
+        frames += replayer.GetStats().frames;
+    }
+
+    // 呼び出しごとの内訳は最後の再生のもの.
+    char buf[128];
+    snprintf(buf, sizeof(buf), "Replay: %d runs%s, %.3f ms/frame\n",
+        count, filter ? " (filtered)" : "", frames > 0 ? msec / frames : 0.0);
+    std::string report = buf;
+    report += replayer.Report();
+    OutputDebugStringA(report.c_str());
+    fputs(report.c_str(), stdout);
+    return 0;
+}
+
+int RunBenchmark(const char* cmdLine)
+{
+    std::string outFile = GetOption(cmdLine, "-out");
+    std::string baselineFile = GetOption(cmdLine, "-baseline");
+    std::string threshold = GetOption(cmdLine, "-threshold");
+    int regressions = RunBenchmarkSuite(
+        outFile.empty() ? nullptr : outFile.c_str(),
+        baselineFile.empty() ? nullptr : baselineFile.c_str(),
+        threshold.empty() ? 0.1 : atof(threshold.c_str()) / 100.0);
+    return regressions != 0 ? 1 : 0;
+}
+
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrev, LPSTR lpCmdLine, int nCmdShow)
 {
+    // -benchmark [-out ファイル] [-baseline ファイル] [-threshold パーセント]
+    //  : ベンチマークを実行し, ベースラインより遅くなった項目があれば 0 以外を返す.
+    if (strstr(lpCmdLine, "-benchmark"))
+    {
+        return RunBenchmark(lpCmdLine);
+    }
+
+    // -selftest : ヌルデバイスで D3D を使う処理のテストを実行し, 失敗があれば 0 以外を返す.
+    if (strstr(lpCmdLine, "-selftest"))
+    {
+        return RunSelfTests();
+    }
+
+    // -replay ファイル [-count 回数] [-filter]
+    //  : 記録したトレースをヌルデバイスに再生し, 呼び出しごとの処理時間を表示する.
+    std::string replayFile = GetOption(lpCmdLine, "-replay");
+    if (!replayFile.empty())
+    {
+        int count = atoi(GetOption(lpCmdLine, "-count").c_str());
+        return RunReplay(replayFile, count > 0 ? count : 1, strstr(lpCmdLine, "-filter") != nullptr);
+    }
+
+    // -headless [フレーム数] [-capture 間隔] [-trace ファイル] : ウィンドウを作らずに実行する.
+    const char* headless = strstr(lpCmdLine, "-headless");
+    if (headless)
+    {
+        int frameCount = atoi(headless + strlen("-headless"));
+        int captureInterval = atoi(GetOption(lpCmdLine, "-capture").c_str());
+        return RunHeadless(frameCount > 0 ? frameCount : 1000, captureInterval, GetOption(lpCmdLine, "-trace"));
+    }
+
     // ウィンドウクラスの準備.
     WNDCLASSEX wc;
     ZeroMemory(&wc, sizeof(wc));
@@ -142,9 +419,43 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrev, LPSTR lpCmdLine, int nC
     ShowWindow(hWnd, nCmdShow);
 
     // DirectX の初期化処理.
+    // -mesh ファイル : ティーポットの代わりに OBJ / PLY ファイルのモデルを描画する.
+    // -trace ファイル : デバイスの呼び出しを記録し, 終了時に保存する.
+    // -immediate : 垂直同期を待たずに表示する.
+    // -latency フレーム数 : 先行して積めるフレームの数を制限する (1 で最小の遅延).
+    // -limiter : 次の表示に間に合う最も遅い時刻までフレームの開始 (入力の読み込み) を遅らせる.
+    // -dynres [ミリ秒] : GPU のフレーム時間が予算 (省略時は垂直同期の間隔) に収まるよう描画解像度を下げる.
+    // -lightres 2|4 : 光の寄与を縦横 1/2 か 1/4 の解像度で計算し, 法線と位置を見て補間する.
     App app;
+    app.SetMeshFile(GetOption(lpCmdLine, "-mesh"));
+    app.SetTraceFile(GetOption(lpCmdLine, "-trace"));
+    App::PresentSettings presentSettings;
+    presentSettings.vsync = strstr(lpCmdLine, "-immediate") == nullptr;
+    const int latency = atoi(GetOption(lpCmdLine, "-latency").c_str());
+    presentSettings.maxFrameLatency = latency > 0 ? UINT(latency) : 0;
+    presentSettings.backBufferCount = presentSettings.maxFrameLatency == 1 ? 1 : 2;
+    presentSettings.frameLimiter = strstr(lpCmdLine, "-limiter") != nullptr;
+    app.SetPresentSettings(presentSettings);
+    const char* dynres = strstr(lpCmdLine, "-dynres");
+    app.SetDynamicResolution(dynres != nullptr, dynres ? atof(dynres + strlen("-dynres")) : 0.0);
+    app.SetLightingResolution(atoi(GetOption(lpCmdLine, "-lightres").c_str()));
     app.Initialize(hWnd, WindowWidth, WindowHeight, screenMode);
 
+    // 描画は専用のスレッドで行い, このスレッドではメッセージの処理とシミュレーションを行う.
+    DeferredScene::Snapshot initial = { 0, DeferredScene::GetCamera() };
+    TripleBuffer<DeferredScene::Snapshot> snapshots(initial);
+    AppRenderClient client(app, snapshots, hWnd);
+    RenderThread renderThread(RenderEventQueueSize);
+    g_renderThread = &renderThread;
+    renderThread.Start(&client);
+
+    LARGE_INTEGER freq, last, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&last);
+    double lag = 0.0;
+    uint32_t tick = 0;
+    float yaw = 0.0f;
+
     // Windows のメッセージループを回す.
     bool finished = false;
     MSG msg;
@@ -159,14 +470,59 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrev, LPSTR lpCmdLine, int nC
             {
                 finished = true;
             }
+            // 描画スレッドからデバイスの消失が届いた. ウィンドウを破棄した後なら何もしない.
+            if ((msg.message == WM_DEVICELOST || (msg.message == WM_TIMER && msg.wParam == RecoverTimerId))
+                && !finished && IsWindow(hWnd))
+            {
+                RecoverDevice(hWnd, app, renderThread, client);
+            }
+            // キー入力は描画スレッドへ渡す.
+            if (msg.message == WM_KEYDOWN || msg.message == WM_KEYUP)
+            {
+                RenderEvent event;
+                event.type = msg.message == WM_KEYDOWN ? RenderEvent::KeyDown : RenderEvent::KeyUp;
+                event.key = uint32_t(msg.wParam);
+                event.modifiers = (GetKeyState(VK_SHIFT) < 0 ? RenderEvent::Shift : 0)
+                    | (GetKeyState(VK_CONTROL) < 0 ? RenderEvent::Control : 0)
+                    | (GetKeyState(VK_MENU) < 0 ? RenderEvent::Alt : 0);
+                renderThread.Post(event);
+            }
         }
-        if (!finished)
+        if (finished)
         {
-            // DirectX による描画.
-            app.Render();
+            break;
         }
+
+        // 一定の間隔でシミュレーションを進め, 進めた結果を描画スレッドへ渡す.
+        QueryPerformanceCounter(&now);
+        lag = (std::min)(lag + double(now.QuadPart - last.QuadPart) / double(freq.QuadPart), MaxSimulationLag);
+        last = now;
+        bool stepped = false;
+        while (lag >= SimulationStep)
+        {
+            // 左右の矢印キーでカメラを回す.
+            const float turn = (GetKeyState(VK_LEFT) < 0 ? 1.0f : 0.0f) - (GetKeyState(VK_RIGHT) < 0 ? 1.0f : 0.0f);
+            yaw += turn * CameraTurnSpeed * float(SimulationStep);
+            tick++;
+            lag -= SimulationStep;
+            stepped = true;
+        }
+        if (stepped)
+        {
+            DeferredScene::Snapshot& snapshot = snapshots.GetWriteBuffer();
+            snapshot.tick = tick;
+            snapshot.camera = DeferredScene::GetOrbitCamera(yaw);
+            snapshots.Publish();
+        }
+
+        // 次のメッセージが届くか, 次にシミュレーションを進める時刻まで待つ.
+        MsgWaitForMultipleObjects(0, nullptr, FALSE, DWORD((SimulationStep - lag) * 1000.0), QS_ALLINPUT);
     } while (!finished);
 
+    renderThread.Stop();
+    g_renderThread = nullptr;
+    OutputDebugStringA(renderThread.Report().c_str());
+
     // DirectX の終了処理.
     app.Terminate();
 
@@ -0,0 +1,203 @@
+﻿#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#ifdef _WIN32
+// Windows では CreateFile のフラグでキャッシュマネージャにヒントを渡す.
+DWORD GetFileFlags(MappedFile::AccessHint hint)
+{
+    switch (hint)
+    {
+    case MappedFile::Sequential:
+    case MappedFile::WillNeed:
+        return FILE_FLAG_SEQUENTIAL_SCAN;
+    case MappedFile::Random:
+        return FILE_FLAG_RANDOM_ACCESS;
+    default:
+        return FILE_ATTRIBUTE_NORMAL;
+    }
+}
+#endif
+}
+
+MappedFile::MappedFile()
+    : m_data(nullptr), m_size(0), m_isOpen(false)
+#ifdef _WIN32
+    , m_file(INVALID_HANDLE_VALUE), m_mapping(nullptr)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+#ifdef _WIN32
+bool MappedFile::Open(const char* fileName, AccessHint hint)
+{
+    Close();
+    m_file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, GetFileFlags(hint), nullptr);
+    return Map(hint);
+}
+
+bool MappedFile::Open(const wchar_t* fileName, AccessHint hint)
+{
+    Close();
+    m_file = CreateFileW(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, GetFileFlags(hint), nullptr);
+    return Map(hint);
+}
+
+bool MappedFile::Map(AccessHint hint)
+{
+    if (m_file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size) || uint64_t(size.QuadPart) > uint64_t(SIZE_MAX))
+    {
+        Close();
+        return false;
+    }
+    m_size = size_t(size.QuadPart);
+    m_isOpen = true;
+    if (m_size == 0)
+    {
+        // 空のファイルはマッピングを作れない.
+        return true;
+    }
+
+    m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mapping)
+    {
+        Close();
+        return false;
+    }
+    m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!m_data)
+    {
+        Close();
+        return false;
+    }
+    Advise(hint);
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (m_data)
+    {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping)
+    {
+        CloseHandle(m_mapping);
+    }
+    if (m_file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_file);
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_isOpen = false;
+    m_mapping = nullptr;
+    m_file = INVALID_HANDLE_VALUE;
+}
+
+void MappedFile::Advise(AccessHint hint)
+{
+#if _WIN32_WINNT >= 0x0602
+    // Windows 8 以降ではまとめて読み込ませておく.
+    if (hint == WillNeed)
+    {
+        WIN32_MEMORY_RANGE_ENTRY range;
+        range.VirtualAddress = const_cast<uint8_t*>(m_data);
+        range.NumberOfBytes = m_size;
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    }
+#else
+    (void)hint;
+#endif
+}
+
+#else
+
+bool MappedFile::Open(const char* fileName, AccessHint hint)
+{
+    Close();
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return false;
+    }
+    m_size = size_t(st.st_size);
+    if (m_size > 0)
+    {
+        void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            close(fd);
+            m_size = 0;
+            return false;
+        }
+        m_data = static_cast<const uint8_t*>(data);
+    }
+    // マッピングはファイルを閉じても残る.
+    close(fd);
+    m_isOpen = true;
+    if (m_data)
+    {
+        Advise(hint);
+    }
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (m_data)
+    {
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_isOpen = false;
+}
+
+void MappedFile::Advise(AccessHint hint)
+{
+    int advice = MADV_NORMAL;
+    switch (hint)
+    {
+    case Sequential:
+        advice = MADV_SEQUENTIAL;
+        break;
+    case Random:
+        advice = MADV_RANDOM;
+        break;
+    case WillNeed:
+        advice = MADV_WILLNEED;
+        break;
+    default:
+        break;
+    }
+    madvise(const_cast<uint8_t*>(m_data), m_size, advice);
+}
+
+#endif
@@ -0,0 +1,124 @@
+﻿#include "MeshBuilder.h"
+#include <cstring>
+
+namespace
+{
+void CopyWhole(const void* vertices, size_t vertexCount, size_t stride,
+    const uint32_t* indices, size_t indexCount, bool index32, MeshData& mesh)
+{
+    const uint8_t* src = static_cast<const uint8_t*>(vertices);
+    mesh.index32 = index32;
+    mesh.vertexStride = stride;
+    mesh.vertices.assign(src, src + vertexCount * stride);
+    mesh.indices.resize(indexCount * mesh.GetIndexSize());
+    if (index32)
+    {
+        memcpy(mesh.indices.data(), indices, indexCount * sizeof(uint32_t));
+    }
+    else
+    {
+        uint16_t* dst = reinterpret_cast<uint16_t*>(mesh.indices.data());
+        for (size_t i = 0; i < indexCount; ++i)
+        {
+            dst[i] = uint16_t(indices[i]);
+        }
+    }
+
+    // 三角形が無ければ, SplitMesh() と同じくサブメッシュを作らない (0 個の描画は呼べない).
+    mesh.subMeshes.clear();
+    if (indexCount >= 3)
+    {
+        SubMesh sub = { 0, uint32_t(vertexCount), 0, uint32_t(indexCount / 3) };
+        mesh.subMeshes.push_back(sub);
+    }
+}
+}
+
+void BuildMesh(const void* vertices, size_t vertexCount, size_t stride,
+    const uint32_t* indices, size_t indexCount,
+    IndexFormatPolicy policy, uint32_t maxVertexIndex,
+    MeshData& mesh)
+{
+    // デバイスが参照できるインデックスの上限も考慮する.
+    uint32_t limit = MaxIndex16Vertices;
+    if (maxVertexIndex >= 2 && maxVertexIndex < limit - 1)
+    {
+        limit = maxVertexIndex + 1;
+    }
+
+    if (vertexCount <= limit)
+    {
+        CopyWhole(vertices, vertexCount, stride, indices, indexCount, false, mesh);
+    }
+    else if (policy == AllowIndex32 && vertexCount - 1 <= maxVertexIndex)
+    {
+        CopyWhole(vertices, vertexCount, stride, indices, indexCount, true, mesh);
+    }
+    else
+    {
+        SplitMesh(vertices, vertexCount, stride, indices, indexCount, limit, mesh);
+    }
+}
+
+void SplitMesh(const void* vertices, size_t vertexCount, size_t stride,
+    const uint32_t* indices, size_t indexCount,
+    uint32_t maxVertices, MeshData& mesh)
+{
+    const uint8_t* src = static_cast<const uint8_t*>(vertices);
+    const size_t triangleCount = indexCount / 3;
+
+    mesh.index32 = false;
+    mesh.vertexStride = stride;
+    mesh.vertices.clear();
+    mesh.vertices.reserve(vertexCount * stride);
+    mesh.indices.resize(triangleCount * 3 * sizeof(uint16_t));
+    mesh.subMeshes.clear();
+    uint16_t* dst = reinterpret_cast<uint16_t*>(mesh.indices.data());
+
+    // 頂点が現在のサブメッシュに含まれるかを, サブメッシュ番号 + 1 で記録する.
+    std::vector<uint32_t> owner(vertexCount, 0);
+    std::vector<uint16_t> local(vertexCount);
+
+    SubMesh sub = {};
+    uint32_t id = 1;
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        const uint32_t* tri = &indices[t * 3];
+        uint32_t newVertices = 0;
+        for (int k = 0; k < 3; ++k)
+        {
+            // 同じ三角形内での重複を数えないように前の頂点と比べる.
+            bool duplicate = (k >= 1 && tri[k] == tri[0]) || (k == 2 && tri[k] == tri[1]);
+            if (owner[tri[k]] != id && !duplicate)
+            {
+                ++newVertices;
+            }
+        }
+        if (sub.vertexCount + newVertices > maxVertices)
+        {
+            mesh.subMeshes.push_back(sub);
+            sub.baseVertex += sub.vertexCount;
+            sub.vertexCount = 0;
+            sub.startIndex += sub.triangleCount * 3;
+            sub.triangleCount = 0;
+            ++id;
+        }
+
+        for (int k = 0; k < 3; ++k)
+        {
+            const uint32_t v = tri[k];
+            if (owner[v] != id)
+            {
+                owner[v] = id;
+                local[v] = uint16_t(sub.vertexCount++);
+                mesh.vertices.insert(mesh.vertices.end(), src + v * stride, src + (v + 1) * stride);
+            }
+            *dst++ = local[v];
+        }
+        ++sub.triangleCount;
+    }
+    if (sub.triangleCount > 0)
+    {
+        mesh.subMeshes.push_back(sub);
+    }
+}
@@ -0,0 +1,54 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 頂点数に応じてインデックスの形式を選び, 描画用の頂点/インデックスデータを作ります.
+// D3D には依存しません.
+//
+// 65536 頂点以下のメッシュはそのまま 16 ビットインデックスにします.
+// それを超える場合は, 三角形の順に 16 ビットで参照できる範囲ずつ頂点を集めてサブメッシュに分割するか,
+// 32 ビットインデックスを使います. 分割したサブメッシュの頂点は最初に参照された順に並べ直すので,
+// 元の三角形の並びが頂点キャッシュに適していれば, 頂点の読み込みも連続します.
+struct SubMesh
+{
+    uint32_t baseVertex;    // DrawIndexedPrimitive の BaseVertexIndex.
+    uint32_t vertexCount;
+    uint32_t startIndex;
+    uint32_t triangleCount;
+};
+
+struct MeshData
+{
+    bool index32;                   // true なら D3DFMT_INDEX32, false なら D3DFMT_INDEX16.
+    size_t vertexStride;
+    std::vector<uint8_t> vertices;
+    std::vector<uint8_t> indices;   // index32 に応じて uint32_t または uint16_t の配列.
+    std::vector<SubMesh> subMeshes;
+
+    size_t GetIndexSize() const { return index32 ? sizeof(uint32_t) : sizeof(uint16_t); }
+    size_t GetVertexCount() const { return vertexStride ? vertices.size() / vertexStride : 0; }
+    size_t GetIndexCount() const { return indices.size() / GetIndexSize(); }
+};
+
+enum IndexFormatPolicy
+{
+    SplitToIndex16,     // 頂点を複製してでも 16 ビットインデックスを使う.
+    AllowIndex32,       // 65536 頂点を超えるメッシュは 32 ビットインデックスを使う.
+};
+
+// 16 ビットインデックスで参照できる頂点数.
+const uint32_t MaxIndex16Vertices = 0x10000;
+
+// maxVertexIndex には D3DCAPS9::MaxVertexIndex を渡します.
+// 32 ビットインデックスを扱えないデバイスでは policy に関わらず分割します.
+// 頂点数が maxVertexIndex を超える場合も同様です.
+void BuildMesh(const void* vertices, size_t vertexCount, size_t stride,
+    const uint32_t* indices, size_t indexCount,
+    IndexFormatPolicy policy, uint32_t maxVertexIndex,
+    MeshData& mesh);
+
+// maxVertices 頂点ずつのサブメッシュに分割します. 通常は BuildMesh() を使います.
+void SplitMesh(const void* vertices, size_t vertexCount, size_t stride,
+    const uint32_t* indices, size_t indexCount,
+    uint32_t maxVertices, MeshData& mesh);
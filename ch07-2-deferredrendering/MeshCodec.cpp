@@ -0,0 +1,273 @@
+﻿#include "MeshCodec.h"
+#include <cstring>
+
+namespace
+{
+// 頂点の符号化の単位.
+const size_t VertexBlockSize = 256;
+const size_t GroupSize = 16;
+const size_t GroupsPerBlock = VertexBlockSize / GroupSize;
+// 1 バイト位置あたりのヘッダ (2 ビット x 16 グループ).
+const size_t HeaderBytes = GroupsPerBlock / 4;
+
+// 0/2/4/8 ビットのどれで詰めたかを 2 ビットで表す.
+const int GroupBits[4] = { 0, 2, 4, 8 };
+
+uint32_t ReadIndex(const void* indices, size_t indexSize, size_t i)
+{
+    return indexSize == sizeof(uint16_t)
+        ? static_cast<const uint16_t*>(indices)[i]
+        : static_cast<const uint32_t*>(indices)[i];
+}
+
+uint8_t ZigZag8(uint8_t delta)
+{
+    return uint8_t((delta << 1) ^ (int8_t(delta) >> 7));
+}
+
+uint8_t UnZigZag8(uint8_t v)
+{
+    return uint8_t((v >> 1) ^ -(v & 1));
+}
+
+void EncodeGroup(const uint8_t* values, int bits, std::vector<uint8_t>& result)
+{
+    if (bits == 0)
+    {
+        return;
+    }
+    if (bits == 8)
+    {
+        result.insert(result.end(), values, values + GroupSize);
+        return;
+    }
+    const int perByte = 8 / bits;
+    for (size_t i = 0; i < GroupSize; i += perByte)
+    {
+        uint8_t packed = 0;
+        for (int k = 0; k < perByte; ++k)
+        {
+            packed |= uint8_t(values[i + k] << (k * bits));
+        }
+        result.push_back(packed);
+    }
+}
+
+const uint8_t* DecodeGroup(const uint8_t* src, const uint8_t* end, int bits, uint8_t* values)
+{
+    const size_t bytes = GroupSize * bits / 8;
+    if (size_t(end - src) < bytes)
+    {
+        return nullptr;
+    }
+    switch (bits)
+    {
+    case 0:
+        memset(values, 0, GroupSize);
+        break;
+    case 2:
+        for (size_t i = 0; i < 4; ++i)
+        {
+            uint8_t b = src[i];
+            values[i * 4 + 0] = b & 3;
+            values[i * 4 + 1] = (b >> 2) & 3;
+            values[i * 4 + 2] = (b >> 4) & 3;
+            values[i * 4 + 3] = b >> 6;
+        }
+        break;
+    case 4:
+        for (size_t i = 0; i < 8; ++i)
+        {
+            uint8_t b = src[i];
+            values[i * 2 + 0] = b & 15;
+            values[i * 2 + 1] = b >> 4;
+        }
+        break;
+    default:
+        memcpy(values, src, GroupSize);
+        break;
+    }
+    return src + bytes;
+}
+}
+
+namespace MeshCodec
+{
+void EncodeIndices(const void* indices, size_t indexCount, size_t indexSize, std::vector<uint8_t>& result)
+{
+    result.clear();
+    result.reserve(indexCount);
+    uint32_t last = 0;
+    uint32_t next = 0;
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        const uint32_t index = ReadIndex(indices, indexSize, i);
+        uint32_t code = 0;
+        if (index != next)
+        {
+            int32_t delta = int32_t(index - last);
+            code = ((uint32_t(delta) << 1) ^ uint32_t(delta >> 31)) + 1;
+        }
+        // 7 ビットずつ, 続きがあれば最上位ビットを立てる.
+        while (code >= 0x80)
+        {
+            result.push_back(uint8_t(code | 0x80));
+            code >>= 7;
+        }
+        result.push_back(uint8_t(code));
+
+        last = index;
+        if (index >= next)
+        {
+            next = index + 1;
+        }
+    }
+}
+
+bool DecodeIndices(void* dst, size_t indexCount, size_t indexSize, const uint8_t* src, size_t srcSize)
+{
+    const uint8_t* end = src + srcSize;
+    uint16_t* dst16 = static_cast<uint16_t*>(dst);
+    uint32_t* dst32 = static_cast<uint32_t*>(dst);
+    uint32_t last = 0;
+    uint32_t next = 0;
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        if (src == end)
+        {
+            return false;
+        }
+        uint32_t code = *src++;
+        if (code >= 0x80)
+        {
+            code &= 0x7F;
+            int shift = 7;
+            for (;;)
+            {
+                if (src == end || shift > 28)
+                {
+                    return false;
+                }
+                uint32_t b = *src++;
+                code |= (b & 0x7F) << shift;
+                if (b < 0x80)
+                {
+                    break;
+                }
+                shift += 7;
+            }
+        }
+
+        uint32_t index = next;
+        if (code != 0)
+        {
+            code -= 1;
+            index = last + ((code >> 1) ^ (0u - (code & 1)));
+        }
+        if (indexSize == sizeof(uint16_t))
+        {
+            dst16[i] = uint16_t(index);
+        }
+        else
+        {
+            dst32[i] = index;
+        }
+
+        last = index;
+        if (index >= next)
+        {
+            next = index + 1;
+        }
+    }
+    return src == end;
+}
+
+void EncodeVertices(const void* vertices, size_t vertexCount, size_t stride, std::vector<uint8_t>& result)
+{
+    const uint8_t* src = static_cast<const uint8_t*>(vertices);
+    result.clear();
+    result.reserve(vertexCount * stride);
+
+    std::vector<uint8_t> prev(stride, 0);
+    uint8_t values[VertexBlockSize];
+    for (size_t base = 0; base < vertexCount; base += VertexBlockSize)
+    {
+        const size_t count = (vertexCount - base < VertexBlockSize) ? vertexCount - base : VertexBlockSize;
+        for (size_t k = 0; k < stride; ++k)
+        {
+            // 前の頂点の同じバイトとの差分.
+            uint8_t p = prev[k];
+            for (size_t i = 0; i < VertexBlockSize; ++i)
+            {
+                if (i < count)
+                {
+                    uint8_t b = src[(base + i) * stride + k];
+                    values[i] = ZigZag8(uint8_t(b - p));
+                    p = b;
+                }
+                else
+                {
+                    values[i] = 0;
+                }
+            }
+            prev[k] = p;
+
+            // 各グループの幅をヘッダに書き, その後ろへ詰めたデータを続ける.
+            const size_t headerPos = result.size();
+            result.resize(headerPos + HeaderBytes, 0);
+            for (size_t g = 0; g < GroupsPerBlock; ++g)
+            {
+                uint8_t maxValue = 0;
+                for (size_t i = 0; i < GroupSize; ++i)
+                {
+                    maxValue |= values[g * GroupSize + i];
+                }
+                int mode = (maxValue == 0) ? 0 : (maxValue < 4) ? 1 : (maxValue < 16) ? 2 : 3;
+                result[headerPos + g / 4] |= uint8_t(mode << ((g % 4) * 2));
+                EncodeGroup(&values[g * GroupSize], GroupBits[mode], result);
+            }
+        }
+    }
+}
+
+bool DecodeVertices(void* dst, size_t vertexCount, size_t stride, const uint8_t* src, size_t srcSize)
+{
+    uint8_t* out = static_cast<uint8_t*>(dst);
+    const uint8_t* end = src + srcSize;
+
+    std::vector<uint8_t> prev(stride, 0);
+    uint8_t values[VertexBlockSize];
+    for (size_t base = 0; base < vertexCount; base += VertexBlockSize)
+    {
+        const size_t count = (vertexCount - base < VertexBlockSize) ? vertexCount - base : VertexBlockSize;
+        for (size_t k = 0; k < stride; ++k)
+        {
+            if (size_t(end - src) < HeaderBytes)
+            {
+                return false;
+            }
+            const uint8_t* header = src;
+            src += HeaderBytes;
+            for (size_t g = 0; g < GroupsPerBlock; ++g)
+            {
+                int mode = (header[g / 4] >> ((g % 4) * 2)) & 3;
+                src = DecodeGroup(src, end, GroupBits[mode], &values[g * GroupSize]);
+                if (!src)
+                {
+                    return false;
+                }
+            }
+
+            uint8_t p = prev[k];
+            uint8_t* column = out + base * stride + k;
+            for (size_t i = 0; i < count; ++i)
+            {
+                p = uint8_t(p + UnZigZag8(values[i]));
+                column[i * stride] = p;
+            }
+            prev[k] = p;
+        }
+    }
+    return src == end;
+}
+}
@@ -0,0 +1,22 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 頂点/インデックスバッファの可逆圧縮. D3D には依存しません.
+//
+// インデックス : 直前のインデックスとの差分を符号なしに変換して可変長で書き込みます.
+//   まだ使われていない次の頂点 (それまでの最大値 + 1) は 1 バイトの 0 で表します.
+// 頂点 : 頂点を 256 個ずつに区切り, バイト位置ごとに前の頂点との差分を取ります.
+//   差分は 16 個ずつ 0/2/4/8 ビットの最小の幅に詰めます.
+//
+// 復号はロックしたバッファへ直接書き込めるように, 出力先のポインタを受け取ります.
+// 入力が壊れている場合は false を返します.
+namespace MeshCodec
+{
+    void EncodeIndices(const void* indices, size_t indexCount, size_t indexSize, std::vector<uint8_t>& result);
+    bool DecodeIndices(void* dst, size_t indexCount, size_t indexSize, const uint8_t* src, size_t srcSize);
+
+    void EncodeVertices(const void* vertices, size_t vertexCount, size_t stride, std::vector<uint8_t>& result);
+    bool DecodeVertices(void* dst, size_t vertexCount, size_t stride, const uint8_t* src, size_t srcSize);
+}
@@ -0,0 +1,914 @@
+﻿#include "MeshImporter.h"
+#include "MappedFile.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <string>
+
+using namespace DirectX;
+
+namespace
+{
+// これより小さいファイルは分割せずに解析する.
+const size_t MinChunkSize = 1 << 20;
+
+// Corner の各要素が, チャンク内の相対位置で記録されていることを示すフラグ.
+const uint8_t RelativePosition = 1;
+const uint8_t RelativeTexCoord = 2;
+const uint8_t RelativeNormal = 4;
+
+double Pow10(int exponent)
+{
+    static const double table[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+    if (exponent < int(sizeof(table) / sizeof(table[0])))
+    {
+        return table[exponent];
+    }
+    return std::pow(10.0, exponent);
+}
+
+bool IsDigit(char c)
+{
+    return unsigned(c - '0') < 10;
+}
+
+const char* SkipSpaces(const char* p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+    {
+        ++p;
+    }
+    return p;
+}
+
+// 符号付きの整数を解析する.
+const char* ParseInteger(const char* p, const char* end, int64_t& value)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = (*p == '-');
+        ++p;
+    }
+    if (p == end || !IsDigit(*p))
+    {
+        return nullptr;
+    }
+    int64_t result = 0;
+    while (p < end && IsDigit(*p))
+    {
+        if (result < (int64_t(1) << 40))
+        {
+            result = result * 10 + (*p - '0');
+        }
+        ++p;
+    }
+    value = negative ? -result : result;
+    return p;
+}
+
+// OBJ のチャンクごとの解析結果.
+struct ObjChunk
+{
+    const char* begin;
+    const char* end;
+    bool valid;
+    std::vector<XMFLOAT3> positions;
+    std::vector<XMFLOAT3> normals;
+    std::vector<XMFLOAT2> texcoords;
+    std::vector<MeshImporter::Corner> corners;
+    std::vector<uint8_t> relative;  // corners ごとの Relative* フラグ.
+
+    std::vector<MeshImporter::Corner> polygon;
+    std::vector<uint8_t> polygonRelative;
+};
+
+// OBJ の番号 (1 始まり, 負なら直前からの相対) を 0 始まりに変換する.
+// 相対の場合はチャンク内の位置になるので, 連結時に先行するチャンクの個数を足す.
+bool ConvertIndex(int64_t index, size_t count, uint8_t flag, int32_t& result, uint8_t& relative)
+{
+    if (index > 0)
+    {
+        result = int32_t(index - 1);
+        return index <= INT32_MAX;
+    }
+    if (index < 0)
+    {
+        result = int32_t(int64_t(count) + index);
+        relative |= flag;
+        return true;
+    }
+    return false;
+}
+
+bool ParseFace(const char* p, const char* end, ObjChunk& chunk)
+{
+    chunk.polygon.clear();
+    chunk.polygonRelative.clear();
+    for (;;)
+    {
+        p = SkipSpaces(p, end);
+        if (p == end)
+        {
+            break;
+        }
+        MeshImporter::Corner corner = { -1, -1, -1 };
+        uint8_t relative = 0;
+        int64_t index;
+        p = ParseInteger(p, end, index);
+        if (!p || !ConvertIndex(index, chunk.positions.size(), RelativePosition, corner.position, relative))
+        {
+            return false;
+        }
+        if (p < end && *p == '/')
+        {
+            ++p;
+            if (p < end && *p != '/')
+            {
+                p = ParseInteger(p, end, index);
+                if (!p || !ConvertIndex(index, chunk.texcoords.size(), RelativeTexCoord, corner.texcoord, relative))
+                {
+                    return false;
+                }
+            }
+            if (p < end && *p == '/')
+            {
+                ++p;
+                p = ParseInteger(p, end, index);
+                if (!p || !ConvertIndex(index, chunk.normals.size(), RelativeNormal, corner.normal, relative))
+                {
+                    return false;
+                }
+            }
+        }
+        chunk.polygon.push_back(corner);
+        chunk.polygonRelative.push_back(relative);
+    }
+    if (chunk.polygon.size() < 3)
+    {
+        return false;
+    }
+
+    for (size_t i = 1; i + 1 < chunk.polygon.size(); ++i)
+    {
+        const size_t order[3] = { 0, i, i + 1 };
+        for (size_t k : order)
+        {
+            chunk.corners.push_back(chunk.polygon[k]);
+            chunk.relative.push_back(chunk.polygonRelative[k]);
+        }
+    }
+    return true;
+}
+
+// n 個の数値を読む. required 個より少なければ失敗.
+const char* ParseFloats(const char* p, const char* end, float* values, int n, int required)
+{
+    for (int i = 0; i < n; ++i)
+    {
+        p = SkipSpaces(p, end);
+        if (p == end || *p == '#')
+        {
+            if (i < required)
+            {
+                return nullptr;
+            }
+            values[i] = 0.0f;
+            continue;
+        }
+        p = MeshImporter::ParseFloat(p, end, values[i]);
+        if (!p)
+        {
+            return nullptr;
+        }
+    }
+    return p;
+}
+
+bool ParseObjLine(const char* p, const char* end, ObjChunk& chunk)
+{
+    p = SkipSpaces(p, end);
+    if (p == end || *p == '#')
+    {
+        return true;
+    }
+    const char* tag = p;
+    while (p < end && *p != ' ' && *p != '\t')
+    {
+        ++p;
+    }
+    const size_t tagLength = p - tag;
+    float values[3];
+    if (tagLength == 1 && tag[0] == 'v')
+    {
+        if (!ParseFloats(p, end, values, 3, 3))
+            return false;
+        chunk.positions.push_back(XMFLOAT3(values[0], values[1], values[2]));
+    }
+    else if (tagLength == 2 && tag[0] == 'v' && tag[1] == 'n')
+    {
+        if (!ParseFloats(p, end, values, 3, 3))
+            return false;
+        chunk.normals.push_back(XMFLOAT3(values[0], values[1], values[2]));
+    }
+    else if (tagLength == 2 && tag[0] == 'v' && tag[1] == 't')
+    {
+        if (!ParseFloats(p, end, values, 2, 1))
+            return false;
+        chunk.texcoords.push_back(XMFLOAT2(values[0], values[1]));
+    }
+    else if (tagLength == 1 && tag[0] == 'f')
+    {
+        return ParseFace(p, end, chunk);
+    }
+    // それ以外 (o, g, s, usemtl, mtllib など) は無視する.
+    return true;
+}
+
+void ParseObjChunk(ObjChunk& chunk)
+{
+    chunk.valid = true;
+    const char* p = chunk.begin;
+    while (p < chunk.end)
+    {
+        const char* lineEnd = static_cast<const char*>(memchr(p, '\n', chunk.end - p));
+        if (!lineEnd)
+        {
+            lineEnd = chunk.end;
+        }
+        const char* contentEnd = lineEnd;
+        if (contentEnd > p && contentEnd[-1] == '\r')
+        {
+            --contentEnd;
+        }
+        if (!ParseObjLine(p, contentEnd, chunk))
+        {
+            chunk.valid = false;
+            return;
+        }
+        p = lineEnd + 1;
+    }
+}
+
+bool InRange(int32_t index, size_t count, bool optional)
+{
+    return (optional && index == -1) || (index >= 0 && size_t(index) < count);
+}
+
+// PLY のプロパティの型.
+enum PlyType
+{
+    PlyInt8, PlyUInt8, PlyInt16, PlyUInt16, PlyInt32, PlyUInt32, PlyFloat32, PlyFloat64, PlyUnknown,
+};
+
+struct PlyProperty
+{
+    std::string name;
+    PlyType type;
+    bool list;
+    PlyType countType;
+};
+
+struct PlyElement
+{
+    std::string name;
+    size_t count;
+    std::vector<PlyProperty> properties;
+};
+
+PlyType GetPlyType(const std::string& name)
+{
+    static const char* names[][2] = {
+        { "char", "int8" }, { "uchar", "uint8" }, { "short", "int16" }, { "ushort", "uint16" },
+        { "int", "int32" }, { "uint", "uint32" }, { "float", "float32" }, { "double", "float64" },
+    };
+    for (int i = 0; i < PlyUnknown; ++i)
+    {
+        if (name == names[i][0] || name == names[i][1])
+        {
+            return PlyType(i);
+        }
+    }
+    return PlyUnknown;
+}
+
+size_t GetPlyTypeSize(PlyType type)
+{
+    static const size_t sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+    return sizes[type];
+}
+
+// PLY の本体から値を 1 つずつ読む.
+class PlyReader
+{
+public:
+    PlyReader(const char* p, const char* end, bool binary)
+        : m_p(p), m_end(end), m_binary(binary)
+    {
+    }
+
+    bool Read(PlyType type, double& value)
+    {
+        return m_binary ? ReadBinary(type, value) : ReadAscii(type, value);
+    }
+
+    // 本体の残りのバイト数. 要素や一覧の個数が残りに収まるかの確認に使う.
+    size_t GetRemaining() const
+    {
+        return size_t(m_end - m_p);
+    }
+
+private:
+    bool ReadAscii(PlyType type, double& value)
+    {
+        while (m_p < m_end && (*m_p == ' ' || *m_p == '\t' || *m_p == '\r' || *m_p == '\n'))
+        {
+            ++m_p;
+        }
+        if (type == PlyFloat32 || type == PlyFloat64)
+        {
+            float f;
+            m_p = MeshImporter::ParseFloat(m_p, m_end, f);
+            value = f;
+        }
+        else
+        {
+            int64_t i;
+            m_p = ParseInteger(m_p, m_end, i);
+            value = double(i);
+        }
+        if (!m_p)
+        {
+            m_p = m_end;
+            return false;
+        }
+        return true;
+    }
+
+    bool ReadBinary(PlyType type, double& value)
+    {
+        const size_t size = GetPlyTypeSize(type);
+        if (size_t(m_end - m_p) < size)
+        {
+            return false;
+        }
+        union
+        {
+            int8_t i8; uint8_t u8; int16_t i16; uint16_t u16;
+            int32_t i32; uint32_t u32; float f32; double f64;
+        } v;
+        memcpy(&v, m_p, size);
+        m_p += size;
+        switch (type)
+        {
+        case PlyInt8: value = v.i8; break;
+        case PlyUInt8: value = v.u8; break;
+        case PlyInt16: value = v.i16; break;
+        case PlyUInt16: value = v.u16; break;
+        case PlyInt32: value = v.i32; break;
+        case PlyUInt32: value = v.u32; break;
+        case PlyFloat32: value = v.f32; break;
+        default: value = v.f64; break;
+        }
+        return true;
+    }
+
+    const char* m_p;
+    const char* m_end;
+    bool m_binary;
+};
+
+// ヘッダを解析し, 本体の開始位置を返す.
+const char* ParsePlyHeader(const char* data, size_t length, bool& binary, std::vector<PlyElement>& elements)
+{
+    const char* marker = "end_header";
+    const char* header = std::search(data, data + length, marker, marker + strlen(marker));
+    const char* body = static_cast<const char*>(memchr(header, '\n', data + length - header));
+    if (!body)
+    {
+        return nullptr;
+    }
+    ++body;
+
+    std::istringstream stream(std::string(data, header));
+    std::string line;
+    if (!std::getline(stream, line) || line.compare(0, 3, "ply") != 0)
+    {
+        return nullptr;
+    }
+    bool hasFormat = false;
+    while (std::getline(stream, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+        std::istringstream tokens(line);
+        std::string keyword;
+        tokens >> keyword;
+        if (keyword == "format")
+        {
+            std::string format;
+            tokens >> format;
+            if (format != "ascii" && format != "binary_little_endian")
+            {
+                return nullptr;
+            }
+            binary = (format != "ascii");
+            hasFormat = true;
+        }
+        else if (keyword == "element")
+        {
+            // size_t へ直接読むと "-1" も受け付けてしまうので, 符号付きで読んで確かめる.
+            PlyElement element;
+            int64_t count = -1;
+            tokens >> element.name >> count;
+            if (!tokens || count < 0)
+            {
+                return nullptr;
+            }
+            element.count = size_t(count);
+            elements.push_back(element);
+        }
+        else if (keyword == "property")
+        {
+            if (elements.empty())
+            {
+                return nullptr;
+            }
+            PlyProperty property;
+            std::string type;
+            tokens >> type;
+            property.list = (type == "list");
+            property.countType = PlyUnknown;
+            if (property.list)
+            {
+                std::string countType;
+                tokens >> countType >> type;
+                property.countType = GetPlyType(countType);
+                if (property.countType == PlyUnknown)
+                {
+                    return nullptr;
+                }
+            }
+            property.type = GetPlyType(type);
+            tokens >> property.name;
+            if (property.type == PlyUnknown || !tokens)
+            {
+                return nullptr;
+            }
+            elements.back().properties.push_back(property);
+        }
+        // comment, obj_info は無視する.
+    }
+    return hasFormat ? body : nullptr;
+}
+
+// 頂点のプロパティ名と格納先の対応.
+int GetVertexAttribute(const std::string& name)
+{
+    static const char* names[][3] = {
+        { "x", "x", "x" }, { "y", "y", "y" }, { "z", "z", "z" },
+        { "nx", "nx", "nx" }, { "ny", "ny", "ny" }, { "nz", "nz", "nz" },
+        { "u", "s", "texture_u" }, { "v", "t", "texture_v" },
+    };
+    for (int i = 0; i < 8; ++i)
+    {
+        if (name == names[i][0] || name == names[i][1] || name == names[i][2])
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const uint32_t EmptySlot = 0xFFFFFFFF;
+
+// 溶接用のハッシュ表. 位置の番号ともう 1 つの要素の番号の組を頂点番号に対応付ける.
+class WeldTable
+{
+public:
+    explicit WeldTable(size_t expected)
+    {
+        size_t size = 16;
+        while (size < expected * 2)
+        {
+            size *= 2;
+        }
+        m_slots.assign(size, EmptySlot);
+    }
+
+    uint32_t Insert(uint64_t key)
+    {
+        if ((m_keys.size() + 1) * 2 > m_slots.size())
+        {
+            Grow();
+        }
+        const size_t mask = m_slots.size() - 1;
+        size_t slot = Hash(key) & mask;
+        for (;;)
+        {
+            uint32_t vertex = m_slots[slot];
+            if (vertex == EmptySlot)
+            {
+                vertex = uint32_t(m_keys.size());
+                m_slots[slot] = vertex;
+                m_keys.push_back(key);
+                return vertex;
+            }
+            if (m_keys[vertex] == key)
+            {
+                return vertex;
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+
+    const std::vector<uint64_t>& GetKeys() const { return m_keys; }
+
+private:
+    static size_t Hash(uint64_t key)
+    {
+        key *= 0x9E3779B97F4A7C15ull;
+        return size_t(key ^ (key >> 32));
+    }
+
+    void Grow()
+    {
+        m_slots.assign(m_slots.size() * 2, EmptySlot);
+        const size_t mask = m_slots.size() - 1;
+        for (uint32_t vertex = 0; vertex < m_keys.size(); ++vertex)
+        {
+            size_t slot = Hash(m_keys[vertex]) & mask;
+            while (m_slots[slot] != EmptySlot)
+            {
+                slot = (slot + 1) & mask;
+            }
+            m_slots[slot] = vertex;
+        }
+    }
+
+    std::vector<uint32_t> m_slots;
+    std::vector<uint64_t> m_keys;
+};
+}
+
+namespace MeshImporter
+{
+size_t GetVertexStride(VertexLayout layout)
+{
+    return layout == PositionNormal
+        ? sizeof(XMFLOAT3) + sizeof(XMFLOAT3)
+        : sizeof(XMFLOAT3) + sizeof(XMFLOAT2);
+}
+
+const char* ParseFloat(const char* p, const char* end, float& value)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = (*p == '-');
+        ++p;
+    }
+
+    // 19 桁までを整数として集め, 最後に 10 の累乗を掛ける.
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    bool hasDigits = false;
+    while (p < end && IsDigit(*p))
+    {
+        if (mantissa < 1000000000000000000ull)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+        }
+        else
+        {
+            ++exponent;
+        }
+        hasDigits = true;
+        ++p;
+    }
+    if (p < end && *p == '.')
+    {
+        ++p;
+        while (p < end && IsDigit(*p))
+        {
+            if (mantissa < 1000000000000000000ull)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                --exponent;
+            }
+            hasDigits = true;
+            ++p;
+        }
+    }
+    if (!hasDigits)
+    {
+        return nullptr;
+    }
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        int64_t e;
+        p = ParseInteger(p + 1, end, e);
+        if (!p)
+        {
+            return nullptr;
+        }
+        exponent += int(std::max<int64_t>(-1000, std::min<int64_t>(1000, e)));
+    }
+
+    double result = double(mantissa);
+    if (mantissa != 0)
+    {
+        if (exponent < -300)
+        {
+            result = 0.0;
+        }
+        else if (exponent < 0)
+        {
+            result /= Pow10(-exponent);
+        }
+        else if (exponent > 0)
+        {
+            result *= Pow10(exponent);
+        }
+    }
+    value = float(negative ? -result : result);
+    return p;
+}
+
+bool ParseObj(const char* text, size_t length, int threadCount, ImportedMesh& mesh)
+{
+    threadCount = int(std::min<size_t>(GetThreadCount(threadCount), length / MinChunkSize + 1));
+
+    // 行の途中で分割しないよう, 境界を次の改行の後ろへずらす.
+    const char* end = text + length;
+    std::vector<ObjChunk> chunks(threadCount);
+    const char* p = text;
+    for (int i = 0; i < threadCount; ++i)
+    {
+        const char* chunkEnd = (i + 1 == threadCount) ? end : text + length * (i + 1) / threadCount;
+        if (chunkEnd < p)
+        {
+            chunkEnd = p;
+        }
+        const char* newline = static_cast<const char*>(memchr(chunkEnd, '\n', end - chunkEnd));
+        chunkEnd = newline ? newline + 1 : end;
+        chunks[i].begin = p;
+        chunks[i].end = chunkEnd;
+        p = chunkEnd;
+    }
+
+    ParallelFor(threadCount, [&](int i) { ParseObjChunk(chunks[i]); });
+
+    // 先行するチャンクの要素数を求める.
+    struct Offsets
+    {
+        size_t positions, normals, texcoords, corners;
+    };
+    std::vector<Offsets> offsets(threadCount + 1);
+    offsets[0] = Offsets{ 0, 0, 0, 0 };
+    for (int i = 0; i < threadCount; ++i)
+    {
+        if (!chunks[i].valid)
+        {
+            return false;
+        }
+        offsets[i + 1].positions = offsets[i].positions + chunks[i].positions.size();
+        offsets[i + 1].normals = offsets[i].normals + chunks[i].normals.size();
+        offsets[i + 1].texcoords = offsets[i].texcoords + chunks[i].texcoords.size();
+        offsets[i + 1].corners = offsets[i].corners + chunks[i].corners.size();
+    }
+    const Offsets& total = offsets[threadCount];
+    if (total.positions > INT32_MAX || total.normals > INT32_MAX || total.texcoords > INT32_MAX)
+    {
+        return false;
+    }
+    mesh.positions.resize(total.positions);
+    mesh.normals.resize(total.normals);
+    mesh.texcoords.resize(total.texcoords);
+    mesh.corners.resize(total.corners);
+
+    // 連結と相対番号の補正もチャンクごとに並列に行う.
+    std::vector<uint8_t> valid(threadCount, 1);
+    ParallelFor(threadCount, [&](int i) {
+        const ObjChunk& chunk = chunks[i];
+        const Offsets& offset = offsets[i];
+        std::copy(chunk.positions.begin(), chunk.positions.end(), mesh.positions.begin() + offset.positions);
+        std::copy(chunk.normals.begin(), chunk.normals.end(), mesh.normals.begin() + offset.normals);
+        std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), mesh.texcoords.begin() + offset.texcoords);
+        Corner* dst = mesh.corners.data() + offset.corners;
+        for (size_t k = 0; k < chunk.corners.size(); ++k)
+        {
+            Corner corner = chunk.corners[k];
+            const uint8_t relative = chunk.relative[k];
+            if (relative & RelativePosition)
+                corner.position += int32_t(offset.positions);
+            if (relative & RelativeTexCoord)
+                corner.texcoord += int32_t(offset.texcoords);
+            if (relative & RelativeNormal)
+                corner.normal += int32_t(offset.normals);
+            if (!InRange(corner.position, total.positions, false) ||
+                !InRange(corner.texcoord, total.texcoords, true) ||
+                !InRange(corner.normal, total.normals, true))
+            {
+                valid[i] = 0;
+            }
+            dst[k] = corner;
+        }
+    });
+    return std::find(valid.begin(), valid.end(), 0) == valid.end();
+}
+
+bool ParsePly(const char* data, size_t length, ImportedMesh& mesh)
+{
+    bool binary = false;
+    std::vector<PlyElement> elements;
+    const char* body = ParsePlyHeader(data, length, binary, elements);
+    if (!body)
+    {
+        return false;
+    }
+
+    mesh.positions.clear();
+    mesh.normals.clear();
+    mesh.texcoords.clear();
+    mesh.corners.clear();
+
+    PlyReader reader(body, data + length, binary);
+    bool hasNormals = false, hasTexCoords = false;
+    std::vector<int32_t> polygon;
+    for (const auto& element : elements)
+    {
+        const bool isVertex = (element.name == "vertex");
+        const bool isFace = (element.name == "face");
+        std::vector<int> attributes;
+        for (const auto& property : element.properties)
+        {
+            attributes.push_back(isVertex && !property.list ? GetVertexAttribute(property.name) : -1);
+            if (isVertex && (attributes.back() == 3))
+                hasNormals = true;
+            if (isVertex && (attributes.back() == 6))
+                hasTexCoords = true;
+        }
+        // 個数は信用できないので, 残りの本体に収まらない個数は壊れたファイルとして扱う.
+        // 各要素は少なくとも 1 バイト (バイナリでは各プロパティの型の大きさの合計) を使う.
+        size_t elementSize = 0;
+        for (const auto& property : element.properties)
+        {
+            elementSize += binary ? GetPlyTypeSize(property.list ? property.countType : property.type) : 1;
+        }
+        if (element.count > reader.GetRemaining() / std::max<size_t>(elementSize, 1))
+        {
+            return false;
+        }
+        if (isVertex)
+        {
+            mesh.positions.reserve(element.count);
+            if (hasNormals)
+                mesh.normals.reserve(element.count);
+            if (hasTexCoords)
+                mesh.texcoords.reserve(element.count);
+        }
+
+        for (size_t n = 0; n < element.count; ++n)
+        {
+            float vertex[8] = {};
+            for (size_t k = 0; k < element.properties.size(); ++k)
+            {
+                const PlyProperty& property = element.properties[k];
+                double value;
+                if (!property.list)
+                {
+                    if (!reader.Read(property.type, value))
+                        return false;
+                    if (attributes[k] >= 0)
+                        vertex[attributes[k]] = float(value);
+                    continue;
+                }
+
+                // 一覧の個数と番号は double で読むので, 範囲を確かめてから整数にする (NaN も弾く).
+                double count;
+                if (!reader.Read(property.countType, count) || !(count >= 0.0 && count <= double(reader.GetRemaining())))
+                    return false;
+                const bool isIndices = isFace && (property.name == "vertex_indices" || property.name == "vertex_index");
+                polygon.clear();
+                for (size_t i = 0; i < size_t(count); ++i)
+                {
+                    if (!reader.Read(property.type, value))
+                        return false;
+                    if (!isIndices)
+                        continue;
+                    if (!(value >= double(INT32_MIN) && value <= double(INT32_MAX)))
+                        return false;
+                    polygon.push_back(int32_t(value));
+                }
+                if (!isIndices)
+                {
+                    continue;
+                }
+                for (size_t i = 1; i + 1 < polygon.size(); ++i)
+                {
+                    const int32_t triangle[3] = { polygon[0], polygon[i], polygon[i + 1] };
+                    for (int32_t index : triangle)
+                    {
+                        Corner corner = { index, hasTexCoords ? index : -1, hasNormals ? index : -1 };
+                        mesh.corners.push_back(corner);
+                    }
+                }
+            }
+            if (isVertex)
+            {
+                mesh.positions.push_back(XMFLOAT3(vertex[0], vertex[1], vertex[2]));
+                if (hasNormals)
+                    mesh.normals.push_back(XMFLOAT3(vertex[3], vertex[4], vertex[5]));
+                if (hasTexCoords)
+                    mesh.texcoords.push_back(XMFLOAT2(vertex[6], vertex[7]));
+            }
+        }
+    }
+
+    for (const auto& corner : mesh.corners)
+    {
+        if (!InRange(corner.position, mesh.positions.size(), false))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool LoadMeshFile(const char* fileName, int threadCount, ImportedMesh& mesh)
+{
+    // OBJ は複数のスレッドが別々の位置から読むので, 全体を先読みさせる.
+    MappedFile file;
+    if (!file.Open(fileName, MappedFile::WillNeed))
+    {
+        return false;
+    }
+    return LoadMeshFromMemory(fileName, reinterpret_cast<const char*>(file.GetData()), file.GetSize(), threadCount, mesh);
+}
+
+bool LoadMeshFromMemory(const char* fileName, const char* data, size_t length, int threadCount, ImportedMesh& mesh)
+{
+    std::string extension = fileName;
+    extension = extension.substr(extension.find_last_of('.') + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    if (extension == "obj")
+    {
+        return ParseObj(data, length, threadCount, mesh);
+    }
+    if (extension == "ply")
+    {
+        return ParsePly(data, length, mesh);
+    }
+    return false;
+}
+
+void WeldVertices(const ImportedMesh& mesh, VertexLayout layout,
+    std::vector<uint8_t>& vertices, std::vector<uint32_t>& indices)
+{
+    const bool useNormal = (layout == PositionNormal);
+
+    // 位置の番号ともう 1 つの要素の番号を 64 ビットのキーにまとめる.
+    WeldTable table(mesh.positions.size());
+    indices.resize(mesh.corners.size());
+    for (size_t i = 0; i < mesh.corners.size(); ++i)
+    {
+        const Corner& corner = mesh.corners[i];
+        const int32_t attribute = useNormal ? corner.normal : corner.texcoord;
+        const uint64_t key = (uint64_t(uint32_t(corner.position)) << 32) | uint32_t(attribute);
+        indices[i] = table.Insert(key);
+    }
+
+    const std::vector<uint64_t>& keys = table.GetKeys();
+    const size_t stride = GetVertexStride(layout);
+    vertices.assign(keys.size() * stride, 0);
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        uint8_t* dst = &vertices[i * stride];
+        const int32_t position = int32_t(keys[i] >> 32);
+        const int32_t attribute = int32_t(uint32_t(keys[i]));
+        memcpy(dst, &mesh.positions[position], sizeof(XMFLOAT3));
+        if (attribute < 0)
+        {
+            continue;
+        }
+        if (useNormal)
+        {
+            memcpy(dst + sizeof(XMFLOAT3), &mesh.normals[attribute], sizeof(XMFLOAT3));
+        }
+        else
+        {
+            memcpy(dst + sizeof(XMFLOAT3), &mesh.texcoords[attribute], sizeof(XMFLOAT2));
+        }
+    }
+}
+}
@@ -0,0 +1,58 @@
+﻿#pragma once
+#include <DirectXMath.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// テキスト形式のメッシュ (OBJ / PLY) の読み込み. D3D には依存しません.
+//
+// OBJ は改行の位置で分割して複数のスレッドで解析し, 最後に連結します.
+// 面は 3 角形に分割します (凸多角形を仮定した扇形分割).
+// 読み込んだ結果は位置/法線/テクスチャ座標ごとの配列と, それらを参照する角 (コーナー) の配列になります.
+// WeldVertices() で App の頂点形式にまとめ, 32 ビットのインデックスを作ります.
+namespace MeshImporter
+{
+    // 三角形の頂点が参照する各要素の番号 (0 始まり). 無い要素は -1.
+    struct Corner
+    {
+        int32_t position;
+        int32_t texcoord;
+        int32_t normal;
+    };
+
+    struct ImportedMesh
+    {
+        std::vector<DirectX::XMFLOAT3> positions;
+        std::vector<DirectX::XMFLOAT3> normals;
+        std::vector<DirectX::XMFLOAT2> texcoords;
+        std::vector<Corner> corners;    // 3 つで 1 つの三角形.
+    };
+
+    // 出力する頂点形式.
+    enum VertexLayout
+    {
+        PositionNormal,     // App::MyVertexPN と同じ並び.
+        PositionTexCoord,   // App::MyVertex と同じ並び.
+    };
+
+    size_t GetVertexStride(VertexLayout layout);
+
+    // threadCount が 0 ならハードウェアのスレッド数を使います.
+    // 解釈できない行や範囲外の番号があれば false を返します.
+    bool ParseObj(const char* text, size_t length, int threadCount, ImportedMesh& mesh);
+    // ascii と binary_little_endian に対応します.
+    bool ParsePly(const char* data, size_t length, ImportedMesh& mesh);
+    // 拡張子 (.obj / .ply) で形式を選んで読み込みます.
+    // ファイルはメモリに割り当て, コピーせずにそのまま解析します.
+    bool LoadMeshFile(const char* fileName, int threadCount, ImportedMesh& mesh);
+    // 読み込み済みのデータを, fileName の拡張子で形式を選んで解析します.
+    bool LoadMeshFromMemory(const char* fileName, const char* data, size_t length, int threadCount, ImportedMesh& mesh);
+
+    // 同じ要素を参照する角を 1 つの頂点にまとめます. layout に含まれない要素の違いは無視します.
+    // 参照していない要素はゼロで埋めます.
+    void WeldVertices(const ImportedMesh& mesh, VertexLayout layout,
+        std::vector<uint8_t>& vertices, std::vector<uint32_t>& indices);
+
+    // 浮動小数点数の文字列を解析し, 解析を終えた位置を返します. 解析できなければ nullptr.
+    const char* ParseFloat(const char* p, const char* end, float& value);
+}
@@ -0,0 +1,417 @@
+﻿#include "MeshSimplifier.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+namespace
+{
+struct Position
+{
+    float x, y, z;
+};
+
+// 4x4 の対称行列を上三角の 10 要素で持つ.
+struct Quadric
+{
+    double xx, xy, xz, xw, yy, yz, yw, zz, zw, ww;
+};
+
+void AddPlane(Quadric& q, double a, double b, double c, double d)
+{
+    q.xx += a * a; q.xy += a * b; q.xz += a * c; q.xw += a * d;
+    q.yy += b * b; q.yz += b * c; q.yw += b * d;
+    q.zz += c * c; q.zw += c * d;
+    q.ww += d * d;
+}
+
+void AddQuadric(Quadric& q, const Quadric& r)
+{
+    q.xx += r.xx; q.xy += r.xy; q.xz += r.xz; q.xw += r.xw;
+    q.yy += r.yy; q.yz += r.yz; q.yw += r.yw;
+    q.zz += r.zz; q.zw += r.zw;
+    q.ww += r.ww;
+}
+
+// 点から各平面までの距離の二乗和.
+double Evaluate(const Quadric& q, const Quadric& r, const Position& p)
+{
+    double x = p.x, y = p.y, z = p.z;
+    double xx = q.xx + r.xx, xy = q.xy + r.xy, xz = q.xz + r.xz, xw = q.xw + r.xw;
+    double yy = q.yy + r.yy, yz = q.yz + r.yz, yw = q.yw + r.yw;
+    double zz = q.zz + r.zz, zw = q.zw + r.zw;
+    double ww = q.ww + r.ww;
+    double e = x * x * xx + y * y * yy + z * z * zz
+        + 2.0 * (x * y * xy + x * z * xz + y * z * yz)
+        + 2.0 * (x * xw + y * yw + z * zw)
+        + ww;
+    return std::max(e, 0.0);
+}
+
+void TriangleNormal(const Position& a, const Position& b, const Position& c, double n[3])
+{
+    double ux = b.x - a.x, uy = b.y - a.y, uz = b.z - a.z;
+    double vx = c.x - a.x, vy = c.y - a.y, vz = c.z - a.z;
+    n[0] = uy * vz - uz * vy;
+    n[1] = uz * vx - ux * vz;
+    n[2] = ux * vy - uy * vx;
+}
+
+uint64_t EdgeKey(uint32_t a, uint32_t b)
+{
+    return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+}
+
+struct Collapse
+{
+    uint32_t from;
+    uint32_t to;
+    double cost;
+};
+
+// 簡略化の作業データ.
+class Simplifier
+{
+public:
+    Simplifier(const void* vertices, size_t vertexCount, size_t stride,
+        const uint16_t* indices, size_t indexCount);
+
+    float Run(size_t targetIndexCount, float maxError, std::vector<uint16_t>& result);
+
+private:
+    void Weld();
+    void BuildAdjacency();
+    bool Flips(uint32_t from, uint32_t to) const;
+
+    std::vector<Position> m_positions;
+    std::vector<uint32_t> m_remap;      // 同じ位置の頂点を代表の頂点へ対応付ける.
+    std::vector<uint32_t> m_triangles;  // 代表の頂点によるインデックス.
+    std::vector<bool> m_locked;
+    std::vector<Quadric> m_quadrics;
+
+    // 頂点から三角形への参照.
+    std::vector<uint32_t> m_adjacencyOffset;
+    std::vector<uint32_t> m_adjacency;
+};
+
+Simplifier::Simplifier(const void* vertices, size_t vertexCount, size_t stride,
+    const uint16_t* indices, size_t indexCount)
+{
+    const uint8_t* src = static_cast<const uint8_t*>(vertices);
+    m_positions.resize(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        memcpy(&m_positions[i], src + i * stride, sizeof(Position));
+    }
+
+    Weld();
+
+    // 縮退した三角形を除いて代表の頂点で置き換える.
+    m_triangles.reserve(indexCount);
+    for (size_t i = 0; i + 2 < indexCount; i += 3)
+    {
+        uint32_t a = m_remap[indices[i + 0]];
+        uint32_t b = m_remap[indices[i + 1]];
+        uint32_t c = m_remap[indices[i + 2]];
+        if (a != b && b != c && c != a)
+        {
+            m_triangles.push_back(a);
+            m_triangles.push_back(b);
+            m_triangles.push_back(c);
+        }
+    }
+
+    // 1 つの三角形にしか使われない辺 (境界) と 3 つ以上で共有される辺の頂点は固定する.
+    std::unordered_map<uint64_t, int> edgeUse;
+    for (size_t i = 0; i < m_triangles.size(); i += 3)
+    {
+        for (int e = 0; e < 3; ++e)
+        {
+            ++edgeUse[EdgeKey(m_triangles[i + e], m_triangles[i + (e + 1) % 3])];
+        }
+    }
+    m_locked.assign(vertexCount, false);
+    for (const auto& edge : edgeUse)
+    {
+        if (edge.second != 2)
+        {
+            m_locked[uint32_t(edge.first >> 32)] = true;
+            m_locked[uint32_t(edge.first & 0xFFFFFFFFu)] = true;
+        }
+    }
+
+    // 三角形の平面を各頂点の二次誤差へ加える.
+    Quadric zero = {};
+    m_quadrics.assign(vertexCount, zero);
+    for (size_t i = 0; i < m_triangles.size(); i += 3)
+    {
+        const Position& p0 = m_positions[m_triangles[i + 0]];
+        double n[3];
+        TriangleNormal(p0, m_positions[m_triangles[i + 1]], m_positions[m_triangles[i + 2]], n);
+        double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length <= 0.0)
+        {
+            continue;
+        }
+        n[0] /= length;
+        n[1] /= length;
+        n[2] /= length;
+        double d = -(n[0] * p0.x + n[1] * p0.y + n[2] * p0.z);
+        for (int k = 0; k < 3; ++k)
+        {
+            AddPlane(m_quadrics[m_triangles[i + k]], n[0], n[1], n[2], d);
+        }
+    }
+}
+
+void Simplifier::Weld()
+{
+    const uint32_t count = uint32_t(m_positions.size());
+    std::vector<uint32_t> order(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        order[i] = i;
+    }
+    auto less = [&](uint32_t a, uint32_t b) {
+        const Position& pa = m_positions[a];
+        const Position& pb = m_positions[b];
+        if (pa.x != pb.x) return pa.x < pb.x;
+        if (pa.y != pb.y) return pa.y < pb.y;
+        if (pa.z != pb.z) return pa.z < pb.z;
+        return a < b;
+    };
+    std::sort(order.begin(), order.end(), less);
+
+    m_remap.resize(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const uint32_t v = order[i];
+        const uint32_t prev = (i > 0) ? order[i - 1] : v;
+        bool same = i > 0 && memcmp(&m_positions[v], &m_positions[prev], sizeof(Position)) == 0;
+        m_remap[v] = same ? m_remap[prev] : v;
+    }
+}
+
+void Simplifier::BuildAdjacency()
+{
+    m_adjacencyOffset.assign(m_positions.size() + 1, 0);
+    for (uint32_t v : m_triangles)
+    {
+        ++m_adjacencyOffset[v + 1];
+    }
+    for (size_t i = 1; i < m_adjacencyOffset.size(); ++i)
+    {
+        m_adjacencyOffset[i] += m_adjacencyOffset[i - 1];
+    }
+    m_adjacency.resize(m_triangles.size());
+    std::vector<uint32_t> fill(m_adjacencyOffset.begin(), m_adjacencyOffset.end() - 1);
+    for (size_t i = 0; i < m_triangles.size(); ++i)
+    {
+        m_adjacency[fill[m_triangles[i]]++] = uint32_t(i / 3);
+    }
+}
+
+// from を to へ移したときに, 向きが反転する三角形があれば true.
+bool Simplifier::Flips(uint32_t from, uint32_t to) const
+{
+    for (uint32_t i = m_adjacencyOffset[from]; i < m_adjacencyOffset[from + 1]; ++i)
+    {
+        const uint32_t* tri = &m_triangles[m_adjacency[i] * 3];
+        if (tri[0] == to || tri[1] == to || tri[2] == to)
+        {
+            continue;   // 縮約で消える三角形.
+        }
+        Position before[3], after[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            before[k] = m_positions[tri[k]];
+            after[k] = m_positions[tri[k] == from ? to : tri[k]];
+        }
+        double n0[3], n1[3];
+        TriangleNormal(before[0], before[1], before[2], n0);
+        TriangleNormal(after[0], after[1], after[2], n1);
+        if (n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] <= 0.0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+float Simplifier::Run(size_t targetIndexCount, float maxError, std::vector<uint16_t>& result)
+{
+    const double maxCost = double(maxError) * double(maxError);
+    double resultCost = 0.0;
+    std::vector<Quadric> quadrics = m_quadrics;
+    std::vector<uint32_t> triangles = m_triangles;
+    std::swap(triangles, m_triangles);
+
+    std::vector<Collapse> collapses;
+    std::vector<uint32_t> collapseTo(m_positions.size());
+    std::vector<bool> touched(m_positions.size());
+    while (m_triangles.size() > targetIndexCount)
+    {
+        // 辺ごとに, コストの小さい向きの縮約を候補にする.
+        collapses.clear();
+        for (size_t i = 0; i < m_triangles.size(); i += 3)
+        {
+            for (int e = 0; e < 3; ++e)
+            {
+                uint32_t a = m_triangles[i + e];
+                uint32_t b = m_triangles[i + (e + 1) % 3];
+                if (a > b && !m_locked[a] && !m_locked[b])
+                {
+                    continue;   // 両方向とも候補になる辺は片側からだけ登録する.
+                }
+                double costAB = m_locked[a] ? -1.0 : Evaluate(quadrics[a], quadrics[b], m_positions[b]);
+                double costBA = m_locked[b] ? -1.0 : Evaluate(quadrics[a], quadrics[b], m_positions[a]);
+                if (costAB >= 0.0 && (costBA < 0.0 || costAB <= costBA))
+                {
+                    collapses.push_back(Collapse{ a, b, costAB });
+                }
+                else if (costBA >= 0.0)
+                {
+                    collapses.push_back(Collapse{ b, a, costBA });
+                }
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(),
+            [](const Collapse& l, const Collapse& r) { return l.cost < r.cost; });
+
+        BuildAdjacency();
+        for (uint32_t v = 0; v < collapseTo.size(); ++v)
+        {
+            collapseTo[v] = v;
+        }
+        std::fill(touched.begin(), touched.end(), false);
+
+        // 周囲の頂点が動いていない縮約だけを, コストの小さい順に適用する.
+        // 1 回の走査で高コストの縮約まで進まないよう, 安い方から 1/4 までに制限する.
+        const double passCost = collapses.empty() ? 0.0 : std::min(maxCost, collapses[collapses.size() / 4].cost);
+        size_t indexCount = m_triangles.size();
+        int applied = 0;
+        for (const auto& c : collapses)
+        {
+            if (indexCount <= targetIndexCount || c.cost > passCost)
+            {
+                break;
+            }
+            if (touched[c.from] || touched[c.to] || Flips(c.from, c.to))
+            {
+                continue;
+            }
+            for (uint32_t i = m_adjacencyOffset[c.from]; i < m_adjacencyOffset[c.from + 1]; ++i)
+            {
+                const uint32_t* tri = &m_triangles[m_adjacency[i] * 3];
+                touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = true;
+                if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to)
+                {
+                    indexCount -= 3;
+                }
+            }
+            collapseTo[c.from] = c.to;
+            AddQuadric(quadrics[c.to], quadrics[c.from]);
+            resultCost = std::max(resultCost, c.cost);
+            ++applied;
+        }
+        if (applied == 0)
+        {
+            break;
+        }
+
+        // 縮約を反映し, 消えた三角形を取り除く.
+        size_t write = 0;
+        for (size_t i = 0; i < m_triangles.size(); i += 3)
+        {
+            uint32_t a = collapseTo[m_triangles[i + 0]];
+            uint32_t b = collapseTo[m_triangles[i + 1]];
+            uint32_t c = collapseTo[m_triangles[i + 2]];
+            if (a != b && b != c && c != a)
+            {
+                m_triangles[write++] = a;
+                m_triangles[write++] = b;
+                m_triangles[write++] = c;
+            }
+        }
+        m_triangles.resize(write);
+    }
+
+    result.assign(m_triangles.begin(), m_triangles.end());
+    std::swap(triangles, m_triangles);
+    return float(std::sqrt(resultCost));
+}
+}
+
+namespace MeshSimplifier
+{
+void Simplify(const void* vertices, size_t vertexCount, size_t stride,
+    const uint16_t* indices, size_t indexCount,
+    size_t targetIndexCount, float maxError,
+    std::vector<uint16_t>& result, float* error)
+{
+    Simplifier simplifier(vertices, vertexCount, stride, indices, indexCount);
+    float e = simplifier.Run(targetIndexCount, maxError, result);
+    if (error)
+    {
+        *error = e;
+    }
+}
+
+void BuildLodChain(const void* vertices, size_t vertexCount, size_t stride,
+    const uint16_t* indices, size_t indexCount,
+    int maxLevels, float ratio, float maxError,
+    std::vector<uint16_t>& result, std::vector<LodLevel>& levels)
+{
+    result.assign(indices, indices + indexCount);
+    levels.clear();
+    levels.push_back(LodLevel{ 0, uint32_t(indexCount), 0.0f });
+
+    Simplifier simplifier(vertices, vertexCount, stride, indices, indexCount);
+    std::vector<uint16_t> lod;
+    while (int(levels.size()) < maxLevels)
+    {
+        const LodLevel& prev = levels.back();
+        size_t target = size_t(prev.indexCount * ratio) / 3 * 3;
+        float error = simplifier.Run(target, maxError, lod);
+
+        // 前のレベルから 1 割も減らなければ打ち切る.
+        if (lod.empty() || lod.size() * 10 > size_t(prev.indexCount) * 9)
+        {
+            break;
+        }
+        levels.push_back(LodLevel{ uint32_t(result.size()), uint32_t(lod.size()), error });
+        result.insert(result.end(), lod.begin(), lod.end());
+    }
+}
+
+int SelectLod(const LodLevel* levels, int levelCount,
+    float distance, float fovY, float screenHeight, float threshold)
+{
+    // 距離 distance での 1 単位の長さが画面上で何ピクセルになるか.
+    const float pixelsPerUnit = screenHeight / (2.0f * std::tan(fovY * 0.5f) * std::max(distance, 1e-4f));
+    for (int i = levelCount - 1; i > 0; --i)
+    {
+        if (levels[i].error * pixelsPerUnit <= threshold)
+        {
+            return i;
+        }
+    }
+    return 0;
+}
+
+std::string Report(const std::vector<LodLevel>& levels)
+{
+    std::string report;
+    const uint32_t baseTriangles = levels.empty() ? 0 : levels[0].indexCount / 3;
+    for (size_t i = 0; i < levels.size(); ++i)
+    {
+        const uint32_t triangles = levels[i].indexCount / 3;
+        char buf[128];
+        snprintf(buf, sizeof(buf), "LOD %d: %6u triangles (%5.1f%%), error %.5f\n",
+            int(i), triangles, baseTriangles ? 100.0 * triangles / baseTriangles : 0.0, levels[i].error);
+        report += buf;
+    }
+    return report;
+}
+}
@@ -0,0 +1,47 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 二次誤差 (Quadric Error Metrics) による辺の縮約でメッシュを簡略化します.
+// D3D には依存しません.
+//
+// 頂点の移動は行わず, 縮約した頂点を残す側の頂点へ置き換えるだけなので,
+// 簡略化したメッシュは元の頂点バッファをそのまま使えます.
+// 誤差は各頂点に集めた元の面への距離の二乗和の平方根で, 元の形状からのずれの上限になります.
+// 穴の縁など境界上の頂点は動かしません.
+namespace MeshSimplifier
+{
+    struct LodLevel
+    {
+        uint32_t indexOffset;   // 連結したインデックス配列での開始位置.
+        uint32_t indexCount;
+        float error;            // 元のメッシュからの誤差 (モデル空間での距離).
+    };
+
+    // vertices の各頂点の先頭 12 バイトを位置として扱います. stride はバイト単位です.
+    // インデックス数が targetIndexCount 以下になるか, 誤差が maxError を超える直前まで簡略化し,
+    // 結果を result に書き込みます. error には結果の誤差を返します.
+    void Simplify(const void* vertices, size_t vertexCount, size_t stride,
+        const uint16_t* indices, size_t indexCount,
+        size_t targetIndexCount, float maxError,
+        std::vector<uint16_t>& result, float* error);
+
+    // 元のメッシュを LOD 0 とし, 前のレベルの ratio 倍のインデックス数を目標に簡略化を繰り返します.
+    // 各レベルは元のメッシュから作るので, 誤差は常に元の形状に対する値です.
+    // 全レベルのインデックスを連結して result に書き込み, 各レベルの範囲を levels に返します.
+    // インデックス数が十分に減らなくなった時点で打ち切ります.
+    void BuildLodChain(const void* vertices, size_t vertexCount, size_t stride,
+        const uint16_t* indices, size_t indexCount,
+        int maxLevels, float ratio, float maxError,
+        std::vector<uint16_t>& result, std::vector<LodLevel>& levels);
+
+    // distance だけ離れた位置に描画したとき, 画面上の誤差が threshold ピクセル以下となる
+    // 最も粗いレベルを返します. fovY は縦の視野角 (ラジアン), screenHeight は画面の高さ (ピクセル) です.
+    int SelectLod(const LodLevel* levels, int levelCount,
+        float distance, float fovY, float screenHeight, float threshold);
+
+    // 各レベルの三角形数と誤差の一覧.
+    std::string Report(const std::vector<LodLevel>& levels);
+}
@@ -0,0 +1,420 @@
+﻿#include "Meshlet.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+using namespace DirectX;
+
+namespace
+{
+// クラスタへ加える三角形を選ぶときの, 法線の向きの違いに対する重み (頂点 1 つの増加を 1 とする).
+const float MeshletConeWeight = 32.0f;
+
+XMFLOAT3 LoadPosition(const uint8_t* vertices, size_t stride, uint32_t index)
+{
+    XMFLOAT3 p;
+    memcpy(&p, vertices + index * stride, sizeof(p));
+    return p;
+}
+
+// クラスタの境界球と法線のコーンを求める.
+void ComputeBounds(const uint8_t* vertices, size_t stride, const uint16_t* indices, Meshlet& meshlet)
+{
+    const uint16_t* tri = indices + meshlet.indexOffset;
+    const size_t indexCount = meshlet.triangleCount * 3;
+
+    // 境界球は AABB の中心から最も遠い頂点までの距離とする.
+    XMVECTOR vmin = XMVectorReplicate(FLT_MAX);
+    XMVECTOR vmax = XMVectorReplicate(-FLT_MAX);
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        XMFLOAT3 p = LoadPosition(vertices, stride, tri[i]);
+        XMVECTOR v = XMLoadFloat3(&p);
+        vmin = XMVectorMin(vmin, v);
+        vmax = XMVectorMax(vmax, v);
+    }
+    XMVECTOR center = XMVectorScale(XMVectorAdd(vmin, vmax), 0.5f);
+    float radius = 0.0f;
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        XMFLOAT3 p = LoadPosition(vertices, stride, tri[i]);
+        radius = std::max(radius, XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&p), center))));
+    }
+    XMStoreFloat4(&meshlet.bounds, XMVectorSetW(center, radius));
+
+    // 面法線の平均をコーンの軸とし, 軸から最も離れた法線までの角度を求める.
+    std::vector<XMVECTOR> normals;
+    normals.reserve(meshlet.triangleCount);
+    XMVECTOR axis = XMVectorZero();
+    for (size_t i = 0; i < indexCount; i += 3)
+    {
+        XMFLOAT3 p0 = LoadPosition(vertices, stride, tri[i + 0]);
+        XMFLOAT3 p1 = LoadPosition(vertices, stride, tri[i + 1]);
+        XMFLOAT3 p2 = LoadPosition(vertices, stride, tri[i + 2]);
+        XMVECTOR v0 = XMLoadFloat3(&p0);
+        XMVECTOR n = XMVector3Cross(XMVectorSubtract(XMLoadFloat3(&p1), v0), XMVectorSubtract(XMLoadFloat3(&p2), v0));
+        if (XMVectorGetX(XMVector3LengthSq(n)) <= 0.0f)
+        {
+            continue;   // 縮退した三角形.
+        }
+        n = XMVector3Normalize(n);
+        normals.push_back(n);
+        axis = XMVectorAdd(axis, n);
+    }
+
+    float cutoff = 1.0f;
+    XMVECTOR apex = center;
+    if (!normals.empty() && XMVectorGetX(XMVector3LengthSq(axis)) > 1e-8f)
+    {
+        axis = XMVector3Normalize(axis);
+        float minDot = 1.0f;
+        for (const auto& n : normals)
+        {
+            minDot = std::min(minDot, XMVectorGetX(XMVector3Dot(axis, n)));
+        }
+        // 半球を超えて広がっている場合は裏面判定できない.
+        if (minDot > 0.0f)
+        {
+            cutoff = std::sqrt(1.0f - minDot * minDot);
+
+            // 中心から軸の逆向きに, 全ての三角形の平面の裏側へ入るまで下がった点をコーンの頂点とする.
+            float maxT = 0.0f;
+            size_t n = 0;
+            for (size_t i = 0; i < indexCount; i += 3)
+            {
+                XMFLOAT3 p0 = LoadPosition(vertices, stride, tri[i + 0]);
+                XMFLOAT3 p1 = LoadPosition(vertices, stride, tri[i + 1]);
+                XMFLOAT3 p2 = LoadPosition(vertices, stride, tri[i + 2]);
+                XMVECTOR v0 = XMLoadFloat3(&p0);
+                XMVECTOR normal = XMVector3Cross(XMVectorSubtract(XMLoadFloat3(&p1), v0), XMVectorSubtract(XMLoadFloat3(&p2), v0));
+                if (XMVectorGetX(XMVector3LengthSq(normal)) <= 0.0f)
+                {
+                    continue;
+                }
+                const XMVECTOR& unit = normals[n++];
+                float dc = XMVectorGetX(XMVector3Dot(XMVectorSubtract(center, v0), unit));
+                float dn = XMVectorGetX(XMVector3Dot(axis, unit));
+                maxT = std::max(maxT, dc / dn);
+            }
+            apex = XMVectorSubtract(center, XMVectorScale(axis, maxT));
+        }
+    }
+    XMStoreFloat4(&meshlet.cone, XMVectorSetW(axis, cutoff));
+    XMStoreFloat3(&meshlet.coneApex, apex);
+}
+}
+
+void BuildMeshlets(const void* vertices, size_t vertexCount, size_t stride,
+    const uint16_t* indices, size_t indexCount,
+    size_t maxVertices, size_t maxTriangles,
+    std::vector<Meshlet>& meshlets, std::vector<uint16_t>& result)
+{
+    const size_t triangleCount = indexCount / 3;
+    meshlets.clear();
+    result.clear();
+    result.reserve(triangleCount * 3);
+
+    // 頂点から三角形への参照.
+    std::vector<uint32_t> adjacencyOffset(vertexCount + 1, 0);
+    for (size_t i = 0; i < triangleCount * 3; ++i)
+    {
+        ++adjacencyOffset[indices[i] + 1];
+    }
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        adjacencyOffset[v + 1] += adjacencyOffset[v];
+    }
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    std::vector<uint32_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+    for (size_t i = 0; i < triangleCount * 3; ++i)
+    {
+        adjacency[fill[indices[i]]++] = uint32_t(i / 3);
+    }
+
+    // 面法線. 法線の向きが揃ったクラスタほど裏面で除外しやすくなる.
+    std::vector<XMFLOAT3> normals(triangleCount);
+    const uint8_t* src = static_cast<const uint8_t*>(vertices);
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        XMFLOAT3 p0 = LoadPosition(src, stride, indices[t * 3 + 0]);
+        XMFLOAT3 p1 = LoadPosition(src, stride, indices[t * 3 + 1]);
+        XMFLOAT3 p2 = LoadPosition(src, stride, indices[t * 3 + 2]);
+        XMVECTOR v0 = XMLoadFloat3(&p0);
+        XMVECTOR n = XMVector3Cross(XMVectorSubtract(XMLoadFloat3(&p1), v0), XMVectorSubtract(XMLoadFloat3(&p2), v0));
+        XMStoreFloat3(&normals[t], XMVector3Normalize(n));
+    }
+
+    std::vector<bool> used(triangleCount, false);
+    // 頂点が現在のクラスタに含まれるかを, クラスタ番号 + 1 で記録する.
+    std::vector<uint32_t> owner(vertexCount, 0);
+    std::vector<uint16_t> meshletVertices;
+    meshletVertices.reserve(maxVertices);
+
+    size_t seed = 0;
+    for (;;)
+    {
+        while (seed < triangleCount && used[seed])
+        {
+            ++seed;
+        }
+        if (seed == triangleCount)
+        {
+            break;
+        }
+
+        Meshlet meshlet = {};
+        meshlet.indexOffset = uint32_t(result.size());
+        const uint32_t id = uint32_t(meshlets.size()) + 1;
+        meshletVertices.clear();
+        XMVECTOR normalSum = XMVectorZero();
+
+        size_t next = seed;
+        while (next != SIZE_MAX)
+        {
+            // 三角形を追加する.
+            used[next] = true;
+            for (int k = 0; k < 3; ++k)
+            {
+                uint16_t v = indices[next * 3 + k];
+                if (owner[v] != id)
+                {
+                    owner[v] = id;
+                    meshletVertices.push_back(v);
+                }
+                result.push_back(v);
+            }
+            ++meshlet.triangleCount;
+            normalSum = XMVectorAdd(normalSum, XMLoadFloat3(&normals[next]));
+            if (meshlet.triangleCount >= maxTriangles)
+            {
+                break;
+            }
+
+            // クラスタの頂点に隣接する三角形から, 増える頂点が少なく法線の向きが近いものを選ぶ.
+            XMFLOAT3 axis;
+            XMStoreFloat3(&axis, XMVector3Normalize(normalSum));
+            next = SIZE_MAX;
+            float bestScore = FLT_MAX;
+            for (uint16_t v : meshletVertices)
+            {
+                for (uint32_t a = adjacencyOffset[v]; a < adjacencyOffset[v + 1]; ++a)
+                {
+                    const uint32_t t = adjacency[a];
+                    if (used[t])
+                    {
+                        continue;
+                    }
+                    int newVertices = 0;
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        newVertices += (owner[indices[t * 3 + k]] != id) ? 1 : 0;
+                    }
+                    if (meshletVertices.size() + newVertices > maxVertices)
+                    {
+                        continue;
+                    }
+                    const XMFLOAT3& n = normals[t];
+                    float spread = 1.0f - (n.x * axis.x + n.y * axis.y + n.z * axis.z);
+                    float score = float(newVertices) + MeshletConeWeight * spread;
+                    if (score < bestScore || (score == bestScore && t < next))
+                    {
+                        bestScore = score;
+                        next = t;
+                    }
+                }
+            }
+        }
+
+        meshlet.vertexCount = uint32_t(meshletVertices.size());
+        ComputeBounds(static_cast<const uint8_t*>(vertices), stride, result.data(), meshlet);
+        meshlets.push_back(meshlet);
+    }
+}
+
+MeshletCuller::MeshletCuller()
+{
+}
+
+void MeshletCuller::Setup(const std::vector<Meshlet>& meshlets, const std::vector<uint16_t>& indices)
+{
+    m_meshlets = meshlets;
+    m_indices = indices;
+
+    // 半端な要素は半径 -1 の視錐台の外に置き, 必ず除外されるようにする.
+    m_blocks.resize((meshlets.size() + 3) / 4);
+    for (size_t b = 0; b < m_blocks.size(); ++b)
+    {
+        float* fields[11] = {
+            &m_blocks[b].centerX.x, &m_blocks[b].centerY.x, &m_blocks[b].centerZ.x, &m_blocks[b].radius.x,
+            &m_blocks[b].axisX.x, &m_blocks[b].axisY.x, &m_blocks[b].axisZ.x, &m_blocks[b].cutoff.x,
+            &m_blocks[b].apexX.x, &m_blocks[b].apexY.x, &m_blocks[b].apexZ.x,
+        };
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            const size_t i = b * 4 + lane;
+            const Meshlet* m = (i < meshlets.size()) ? &meshlets[i] : nullptr;
+            fields[0][lane] = m ? m->bounds.x : 0.0f;
+            fields[1][lane] = m ? m->bounds.y : 0.0f;
+            fields[2][lane] = m ? m->bounds.z : 0.0f;
+            fields[3][lane] = m ? m->bounds.w : -1.0f;
+            fields[4][lane] = m ? m->cone.x : 0.0f;
+            fields[5][lane] = m ? m->cone.y : 0.0f;
+            fields[6][lane] = m ? m->cone.z : 0.0f;
+            fields[7][lane] = m ? m->cone.w : 1.0f;
+            fields[8][lane] = m ? m->coneApex.x : 0.0f;
+            fields[9][lane] = m ? m->coneApex.y : 0.0f;
+            fields[10][lane] = m ? m->coneApex.z : 0.0f;
+        }
+    }
+}
+
+uint32_t MeshletCuller::Cull(const XMMATRIX& world, const XMMATRIX& viewProj,
+    const XMFLOAT3& eyePos, std::vector<uint32_t>& visible, Stats* stats) const
+{
+    visible.clear();
+
+    // モデル空間での視錐台の平面 (ワールド * ビュー * プロジェクション行列の列から求める).
+    XMFLOAT4X4 m;
+    XMStoreFloat4x4(&m, world * viewProj);
+    const XMFLOAT4 column[4] = {
+        XMFLOAT4(m._11, m._21, m._31, m._41),
+        XMFLOAT4(m._12, m._22, m._32, m._42),
+        XMFLOAT4(m._13, m._23, m._33, m._43),
+        XMFLOAT4(m._14, m._24, m._34, m._44),
+    };
+    const XMVECTOR c0 = XMLoadFloat4(&column[0]);
+    const XMVECTOR c1 = XMLoadFloat4(&column[1]);
+    const XMVECTOR c2 = XMLoadFloat4(&column[2]);
+    const XMVECTOR c3 = XMLoadFloat4(&column[3]);
+    const XMVECTOR planes[6] = {
+        XMPlaneNormalize(XMVectorAdd(c3, c0)),       // 左.
+        XMPlaneNormalize(XMVectorSubtract(c3, c0)),  // 右.
+        XMPlaneNormalize(XMVectorAdd(c3, c1)),       // 下.
+        XMPlaneNormalize(XMVectorSubtract(c3, c1)),  // 上.
+        XMPlaneNormalize(c2),                        // 手前.
+        XMPlaneNormalize(XMVectorSubtract(c3, c2)),  // 奥.
+    };
+    XMVECTOR planeX[6], planeY[6], planeZ[6], planeW[6];
+    for (int i = 0; i < 6; ++i)
+    {
+        planeX[i] = XMVectorSplatX(planes[i]);
+        planeY[i] = XMVectorSplatY(planes[i]);
+        planeZ[i] = XMVectorSplatZ(planes[i]);
+        planeW[i] = XMVectorSplatW(planes[i]);
+    }
+
+    // モデル空間での視点.
+    XMVECTOR eye = XMVector3TransformCoord(XMLoadFloat3(&eyePos), XMMatrixInverse(nullptr, world));
+    const XMVECTOR eyeX = XMVectorSplatX(eye);
+    const XMVECTOR eyeY = XMVectorSplatY(eye);
+    const XMVECTOR eyeZ = XMVectorSplatZ(eye);
+
+    Stats result = {};
+    uint32_t indexCount = 0;
+    for (size_t b = 0; b < m_blocks.size(); ++b)
+    {
+        const Block& block = m_blocks[b];
+        const XMVECTOR cx = XMLoadFloat4(&block.centerX);
+        const XMVECTOR cy = XMLoadFloat4(&block.centerY);
+        const XMVECTOR cz = XMLoadFloat4(&block.centerZ);
+        const XMVECTOR r = XMLoadFloat4(&block.radius);
+
+        // いずれかの平面の外側に境界球全体がある.
+        const XMVECTOR negR = XMVectorNegate(r);
+        XMVECTOR outside = XMVectorFalseInt();
+        for (int i = 0; i < 6; ++i)
+        {
+            XMVECTOR d = XMVectorMultiplyAdd(cx, planeX[i],
+                XMVectorMultiplyAdd(cy, planeY[i],
+                XMVectorMultiplyAdd(cz, planeZ[i], planeW[i])));
+            outside = XMVectorOrInt(outside, XMVectorLess(d, negR));
+        }
+
+        // 視点がコーンの頂点から見て軸の逆側の円錐内にあれば, 全ての三角形が裏を向いている.
+        // dot(apex - eye, axis) >= cutoff * |apex - eye|
+        const XMVECTOR vx = XMVectorSubtract(XMLoadFloat4(&block.apexX), eyeX);
+        const XMVECTOR vy = XMVectorSubtract(XMLoadFloat4(&block.apexY), eyeY);
+        const XMVECTOR vz = XMVectorSubtract(XMLoadFloat4(&block.apexZ), eyeZ);
+        const XMVECTOR distance = XMVectorSqrt(
+            XMVectorMultiplyAdd(vx, vx, XMVectorMultiplyAdd(vy, vy, XMVectorMultiply(vz, vz))));
+        const XMVECTOR dot = XMVectorMultiplyAdd(vx, XMLoadFloat4(&block.axisX),
+            XMVectorMultiplyAdd(vy, XMLoadFloat4(&block.axisY),
+            XMVectorMultiply(vz, XMLoadFloat4(&block.axisZ))));
+        const XMVECTOR backface = XMVectorGreaterOrEqual(dot,
+            XMVectorMultiply(XMLoadFloat4(&block.cutoff), distance));
+
+        uint32_t outsideMask[4], backfaceMask[4];
+        XMStoreInt4(outsideMask, outside);
+        XMStoreInt4(backfaceMask, backface);
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            const size_t i = b * 4 + lane;
+            if (i >= m_meshlets.size())
+            {
+                break;
+            }
+            const uint32_t triangles = m_meshlets[i].triangleCount;
+            ++result.meshlets;
+            result.triangles += triangles;
+            if (outsideMask[lane])
+            {
+                ++result.frustumCulled;
+            }
+            else if (backfaceMask[lane])
+            {
+                ++result.backfaceCulled;
+            }
+            else
+            {
+                visible.push_back(uint32_t(i));
+                indexCount += triangles * 3;
+            }
+        }
+    }
+    result.trianglesSubmitted = indexCount / 3;
+
+    if (stats)
+    {
+        stats->meshlets += result.meshlets;
+        stats->frustumCulled += result.frustumCulled;
+        stats->backfaceCulled += result.backfaceCulled;
+        stats->triangles += result.triangles;
+        stats->trianglesSubmitted += result.trianglesSubmitted;
+    }
+    return indexCount;
+}
+
+void MeshletCuller::WriteIndices(const std::vector<uint32_t>& visible, uint16_t* dst) const
+{
+    // インデックスはクラスタ順に並んでいるので, 連続するクラスタはまとめてコピーする.
+    size_t i = 0;
+    while (i < visible.size())
+    {
+        const Meshlet& first = m_meshlets[visible[i]];
+        uint32_t count = first.triangleCount * 3;
+        size_t j = i + 1;
+        while (j < visible.size() && visible[j] == visible[j - 1] + 1)
+        {
+            count += m_meshlets[visible[j]].triangleCount * 3;
+            ++j;
+        }
+        memcpy(dst, &m_indices[first.indexOffset], count * sizeof(uint16_t));
+        dst += count;
+        i = j;
+    }
+}
+
+std::string MeshletCuller::Report(const Stats& stats)
+{
+    char buf[256];
+    snprintf(buf, sizeof(buf),
+        "Meshlets: %u tested, %u frustum culled (%.1f%%), %u backface culled (%.1f%%), triangles %llu -> %llu (%.1f%%)\n",
+        stats.meshlets,
+        stats.frustumCulled, stats.meshlets ? 100.0 * stats.frustumCulled / stats.meshlets : 0.0,
+        stats.backfaceCulled, stats.meshlets ? 100.0 * stats.backfaceCulled / stats.meshlets : 0.0,
+        (unsigned long long)stats.triangles, (unsigned long long)stats.trianglesSubmitted,
+        stats.triangles ? 100.0 * stats.trianglesSubmitted / stats.triangles : 0.0);
+    return buf;
+}
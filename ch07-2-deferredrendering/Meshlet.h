@@ -0,0 +1,84 @@
+﻿#pragma once
+#include <DirectXMath.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 三角形を少数の頂点を共有するまとまり (クラスタ) に分けたもの.
+// クラスタごとの境界球と法線の範囲 (コーン) から, 視錐台の外にあるものと
+// 全ての三角形が裏を向いているものを CPU で取り除きます.
+struct Meshlet
+{
+    uint32_t indexOffset;       // 並べ替えたインデックス配列での開始位置.
+    uint32_t triangleCount;
+    uint32_t vertexCount;
+    DirectX::XMFLOAT4 bounds;   // 境界球 (xyz : 中心, w : 半径).
+    DirectX::XMFLOAT4 cone;     // xyz : 法線の平均の向き, w : 判定に使う角度の正弦. 1 なら裏面判定しない.
+    DirectX::XMFLOAT3 coneApex; // 全ての三角形の平面の裏側となる領域の頂点.
+};
+
+// 1 クラスタの頂点数と三角形数の上限.
+const size_t MaxMeshletVertices = 64;
+const size_t MaxMeshletTriangles = 124;
+
+// vertices の各頂点の先頭 12 バイトを位置として扱います. stride はバイト単位です.
+// 三角形は時計回りを表面とします (D3DCULL_CCW で描画するモデル).
+// 隣接する三角形を順に集めてクラスタを作り, クラスタ順に並べ替えたインデックスを result に書き込みます.
+void BuildMeshlets(const void* vertices, size_t vertexCount, size_t stride,
+    const uint16_t* indices, size_t indexCount,
+    size_t maxVertices, size_t maxTriangles,
+    std::vector<Meshlet>& meshlets, std::vector<uint16_t>& result);
+
+// クラスタ単位のカリングを行うクラス.
+// 境界情報を 4 クラスタずつ要素ごとの配列に並べ替えて持ち, まとめて判定します.
+//
+// 判定はモデル空間で行うため, ワールド行列は回転, 平行移動と均一なスケールのみを想定しています.
+class MeshletCuller
+{
+public:
+    struct Stats
+    {
+        uint32_t meshlets;          // 判定したクラスタ数.
+        uint32_t frustumCulled;
+        uint32_t backfaceCulled;
+        uint64_t triangles;         // 判定したクラスタの三角形数.
+        uint64_t trianglesSubmitted;
+    };
+
+    MeshletCuller();
+
+    void Setup(const std::vector<Meshlet>& meshlets, const std::vector<uint16_t>& indices);
+    bool IsEmpty() const { return m_meshlets.empty(); }
+
+    // 見えるクラスタの番号を visible に書き込み, その合計のインデックス数を返します.
+    // stats が指定されていれば結果を加算します.
+    uint32_t Cull(const DirectX::XMMATRIX& world, const DirectX::XMMATRIX& viewProj,
+        const DirectX::XMFLOAT3& eyePos, std::vector<uint32_t>& visible, Stats* stats) const;
+
+    // visible のクラスタのインデックスを dst へ詰めて書き込みます.
+    void WriteIndices(const std::vector<uint32_t>& visible, uint16_t* dst) const;
+
+    static std::string Report(const Stats& stats);
+
+private:
+    // 4 クラスタ分の境界情報.
+    struct Block
+    {
+        DirectX::XMFLOAT4 centerX;
+        DirectX::XMFLOAT4 centerY;
+        DirectX::XMFLOAT4 centerZ;
+        DirectX::XMFLOAT4 radius;
+        DirectX::XMFLOAT4 axisX;
+        DirectX::XMFLOAT4 axisY;
+        DirectX::XMFLOAT4 axisZ;
+        DirectX::XMFLOAT4 cutoff;
+        DirectX::XMFLOAT4 apexX;
+        DirectX::XMFLOAT4 apexY;
+        DirectX::XMFLOAT4 apexZ;
+    };
+
+    std::vector<Meshlet> m_meshlets;
+    std::vector<uint16_t> m_indices;
+    std::vector<Block> m_blocks;
+};
@@ -0,0 +1,1973 @@
+﻿#include "NullDevice.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+// 1 ピクセルあたりのバイト数.
+UINT GetBytesPerPixel(D3DFORMAT format)
+{
+    switch (format)
+    {
+    case D3DFMT_A32B32G32R32F:
+        return 16;
+    case D3DFMT_A16B16G16R16F:
+    case D3DFMT_A16B16G16R16:
+    case D3DFMT_G32R32F:
+        return 8;
+    case D3DFMT_R16F:
+    case D3DFMT_D16:
+        return 2;
+    case D3DFMT_L8:
+        return 1;
+    default:
+        return 4;
+    }
+}
+
+// プリミティブ数から頂点(インデックス)数を求める.
+UINT GetVertexCount(D3DPRIMITIVETYPE type, UINT primitiveCount)
+{
+    switch (type)
+    {
+    case D3DPT_POINTLIST:     return primitiveCount;
+    case D3DPT_LINELIST:      return primitiveCount * 2;
+    case D3DPT_LINESTRIP:     return primitiveCount + 1;
+    case D3DPT_TRIANGLELIST:  return primitiveCount * 3;
+    case D3DPT_TRIANGLESTRIP:
+    case D3DPT_TRIANGLEFAN:   return primitiveCount + 2;
+    default:                  return 0;
+    }
+}
+
+void AddStats(NullDevice::Stats& dst, const NullDevice::Stats& src)
+{
+    dst.calls += src.calls;
+    dst.drawCalls += src.drawCalls;
+    dst.primitives += src.primitives;
+    dst.stateChanges += src.stateChanges;
+    dst.redundantStateChanges += src.redundantStateChanges;
+    dst.locks += src.locks;
+    dst.bytesUploaded += src.bytesUploaded;
+    dst.resourcesCreated += src.resourcesCreated;
+}
+
+// 参照カウントを持つオブジェクトの基本部分.
+// デバイスへの参照は保持しません (デバイスが設定中のオブジェクトを保持するため).
+template<class Interface>
+class NullObject : public Interface
+{
+public:
+    NullObject(NullDevice* device, REFIID iid)
+        : m_refCount(1), m_device(device), m_iid(&iid)
+    {
+    }
+    virtual ~NullObject() {}
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObj) override
+    {
+        if (!ppvObj)
+        {
+            return E_POINTER;
+        }
+        if (riid == __uuidof(IUnknown) || riid == *m_iid)
+        {
+            this->AddRef();
+            *ppvObj = this;
+            return S_OK;
+        }
+        *ppvObj = nullptr;
+        return E_NOINTERFACE;
+    }
+    ULONG STDMETHODCALLTYPE AddRef() override
+    {
+        return ++m_refCount;
+    }
+    ULONG STDMETHODCALLTYPE Release() override
+    {
+        ULONG count = --m_refCount;
+        if (count == 0)
+        {
+            delete this;
+        }
+        return count;
+    }
+
+protected:
+    HRESULT GetDeviceImpl(IDirect3DDevice9** ppDevice)
+    {
+        if (!ppDevice)
+        {
+            return D3DERR_INVALIDCALL;
+        }
+        m_device->AddRef();
+        *ppDevice = m_device;
+        return S_OK;
+    }
+
+    ULONG m_refCount;
+    NullDevice* m_device;
+    const GUID* m_iid;
+};
+
+// IDirect3DResource9 の共通部分.
+template<class Interface>
+class NullResource : public NullObject<Interface>
+{
+public:
+    NullResource(NullDevice* device, REFIID iid, D3DRESOURCETYPE type, DWORD usage, D3DPOOL pool)
+        : NullObject<Interface>(device, iid), m_type(type), m_usage(usage), m_pool(pool), m_priority(0)
+    {
+    }
+
+    HRESULT STDMETHODCALLTYPE GetDevice(IDirect3DDevice9** ppDevice) override { return this->GetDeviceImpl(ppDevice); }
+    HRESULT STDMETHODCALLTYPE SetPrivateData(REFGUID, CONST void*, DWORD, DWORD) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetPrivateData(REFGUID, void*, DWORD*) override { return D3DERR_NOTFOUND; }
+    HRESULT STDMETHODCALLTYPE FreePrivateData(REFGUID) override { return D3DERR_NOTFOUND; }
+    DWORD STDMETHODCALLTYPE SetPriority(DWORD priority) override
+    {
+        DWORD old = m_priority;
+        m_priority = priority;
+        return old;
+    }
+    DWORD STDMETHODCALLTYPE GetPriority() override { return m_priority; }
+    void STDMETHODCALLTYPE PreLoad() override {}
+    D3DRESOURCETYPE STDMETHODCALLTYPE GetType() override { return m_type; }
+
+protected:
+    D3DRESOURCETYPE m_type;
+    DWORD m_usage;
+    D3DPOOL m_pool;
+    DWORD m_priority;
+};
+
+void SetFVF(D3DVERTEXBUFFER_DESC* desc, DWORD fvf) { desc->FVF = fvf; }
+void SetFVF(D3DINDEXBUFFER_DESC*, DWORD) {}
+
+// 頂点バッファ/インデックスバッファ. 内容はシステムメモリに保持する.
+template<class Interface, class Desc>
+class NullBuffer : public NullResource<Interface>
+{
+public:
+    NullBuffer(NullDevice* device, REFIID iid, D3DRESOURCETYPE type, UINT length, DWORD usage, D3DFORMAT format, DWORD fvf, D3DPOOL pool)
+        : NullResource<Interface>(device, iid, type, usage, pool), m_data(length), m_format(format), m_fvf(fvf)
+    {
+    }
+
+    HRESULT STDMETHODCALLTYPE Lock(UINT offsetToLock, UINT sizeToLock, void** ppbData, DWORD flags) override
+    {
+        const UINT length = static_cast<UINT>(m_data.size());
+        if (!ppbData || offsetToLock > length)
+        {
+            return D3DERR_INVALIDCALL;
+        }
+        if (sizeToLock == 0 || offsetToLock + sizeToLock > length)
+        {
+            sizeToLock = length - offsetToLock;
+        }
+        *ppbData = m_data.data() + offsetToLock;
+        this->m_device->RecordLock((flags & D3DLOCK_READONLY) ? 0 : sizeToLock);
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE Unlock() override { return S_OK; }
+    HRESULT STDMETHODCALLTYPE GetDesc(Desc* pDesc) override
+    {
+        if (!pDesc)
+        {
+            return D3DERR_INVALIDCALL;
+        }
+        ZeroMemory(pDesc, sizeof(Desc));
+        pDesc->Format = m_format;
+        pDesc->Type = this->m_type;
+        pDesc->Usage = this->m_usage;
+        pDesc->Pool = this->m_pool;
+        pDesc->Size = static_cast<UINT>(m_data.size());
+        SetFVF(pDesc, m_fvf);
+        return S_OK;
+    }
+
+private:
+    std::vector<uint8_t> m_data;
+    D3DFORMAT m_format;
+    DWORD m_fvf;
+};
+
+typedef NullBuffer<IDirect3DVertexBuffer9, D3DVERTEXBUFFER_DESC> NullVertexBuffer;
+typedef NullBuffer<IDirect3DIndexBuffer9, D3DINDEXBUFFER_DESC> NullIndexBuffer;
+
+// サーフェイス. テクスチャのレベルとして作られた場合, 参照カウントはテクスチャと共有する.
+// 内容のメモリは最初に LockRect された時に確保する.
+class NullSurface : public NullResource<IDirect3DSurface9>
+{
+public:
+    NullSurface(NullDevice* device, UINT width, UINT height, D3DFORMAT format, DWORD usage, D3DPOOL pool, IUnknown* container)
+        : NullResource<IDirect3DSurface9>(device, __uuidof(IDirect3DSurface9), D3DRTYPE_SURFACE, usage, pool),
+        m_width(width), m_height(height), m_format(format), m_container(container)
+    {
+    }
+
+    ULONG STDMETHODCALLTYPE AddRef() override
+    {
+        return m_container ? m_container->AddRef() : NullResource<IDirect3DSurface9>::AddRef();
+    }
+    ULONG STDMETHODCALLTYPE Release() override
+    {
+        return m_container ? m_container->Release() : NullResource<IDirect3DSurface9>::Release();
+    }
+
+    HRESULT STDMETHODCALLTYPE GetContainer(REFIID riid, void** ppContainer) override
+    {
+        if (m_container)
+        {
+            return m_container->QueryInterface(riid, ppContainer);
+        }
+        return m_device->QueryInterface(riid, ppContainer);
+    }
+    HRESULT STDMETHODCALLTYPE GetDesc(D3DSURFACE_DESC* pDesc) override
+    {
+        if (!pDesc)
+        {
+            return D3DERR_INVALIDCALL;
+        }
+        ZeroMemory(pDesc, sizeof(D3DSURFACE_DESC));
+        pDesc->Format = m_format;
+        pDesc->Type = D3DRTYPE_SURFACE;
+        pDesc->Usage = m_usage;
+        pDesc->Pool = m_pool;
+        pDesc->MultiSampleType = D3DMULTISAMPLE_NONE;
+        pDesc->Width = m_width;
+        pDesc->Height = m_height;
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE LockRect(D3DLOCKED_RECT* pLockedRect, CONST RECT* pRect, DWORD flags) override
+    {
+        if (!pLockedRect)
+        {
+            return D3DERR_INVALIDCALL;
+        }
+        const UINT pitch = m_width * GetBytesPerPixel(m_format);
+        if (m_data.empty())
+        {
+            m_data.resize(size_t(pitch) * m_height);
+        }
+        UINT x = 0, y = 0, w = m_width, h = m_height;
+        if (pRect)
+        {
+            x = pRect->left;
+            y = pRect->top;
+            w = pRect->right - pRect->left;
+            h = pRect->bottom - pRect->top;
+        }
+        pLockedRect->Pitch = pitch;
+        pLockedRect->pBits = m_data.data() + size_t(y) * pitch + x * GetBytesPerPixel(m_format);
+        m_device->RecordLock((flags & D3DLOCK_READONLY) ? 0 : uint64_t(w) * h * GetBytesPerPixel(m_format));
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE UnlockRect() override { return S_OK; }
+    HRESULT STDMETHODCALLTYPE GetDC(HDC*) override { return D3DERR_INVALIDCALL; }
+
+    // GetRenderTargetData の読み戻し. 大きさと形式が同じでなければ失敗する.
+    HRESULT CopyFrom(const NullSurface& source)
+    {
+        if (source.m_width != m_width || source.m_height != m_height || source.m_format != m_format)
+        {
+            return D3DERR_INVALIDCALL;
+        }
+        // 一度もロックされていないサーフェイスの内容は 0 とみなす.
+        m_data = source.m_data;
+        m_data.resize(size_t(m_width) * GetBytesPerPixel(m_format) * m_height);
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE ReleaseDC(HDC) override { return D3DERR_INVALIDCALL; }
+
+private:
+    UINT m_width;
+    UINT m_height;
+    D3DFORMAT m_format;
+    IUnknown* m_container;
+    std::vector<uint8_t> m_data;
+};
+
+class NullTexture : public NullResource<IDirect3DTexture9>
+{
+public:
+    NullTexture(NullDevice* device, UINT width, UINT height, UINT levels, DWORD usage, D3DFORMAT format, D3DPOOL pool)
+        : NullResource<IDirect3DTexture9>(device, __uuidof(IDirect3DTexture9), D3DRTYPE_TEXTURE, usage, pool),
+        m_lod(0), m_filter(D3DTEXF_LINEAR)
+    {
+        // 0 は 1x1 までの全レベル.
+        UINT maxLevels = 1;
+        for (UINT w = width, h = height; w > 1 || h > 1; w /= 2, h /= 2)
+        {
+            ++maxLevels;
+        }
+        if (levels == 0 || levels > maxLevels)
+        {
+            levels = maxLevels;
+        }
+        for (UINT i = 0; i < levels; ++i)
+        {
+            UINT w = (width >> i) > 0 ? (width >> i) : 1;
+            UINT h = (height >> i) > 0 ? (height >> i) : 1;
+            m_levels.push_back(new NullSurface(device, w, h, format, usage, pool, this));
+        }
+    }
+    ~NullTexture()
+    {
+        for (auto level : m_levels)
+        {
+            delete level;
+        }
+    }
+
+    DWORD STDMETHODCALLTYPE SetLOD(DWORD lod) override
+    {
+        DWORD old = m_lod;
+        m_lod = lod;
+        return old;
+    }
+    DWORD STDMETHODCALLTYPE GetLOD() override { return m_lod; }
+    DWORD STDMETHODCALLTYPE GetLevelCount() override { return static_cast<DWORD>(m_levels.size()); }
+    HRESULT STDMETHODCALLTYPE SetAutoGenFilterType(D3DTEXTUREFILTERTYPE filter) override
+    {
+        m_filter = filter;
+        return S_OK;
+    }
+    D3DTEXTUREFILTERTYPE STDMETHODCALLTYPE GetAutoGenFilterType() override { return m_filter; }
+    void STDMETHODCALLTYPE GenerateMipSubLevels() override {}
+
+    HRESULT STDMETHODCALLTYPE GetLevelDesc(UINT level, D3DSURFACE_DESC* pDesc) override
+    {
+        if (level >= m_levels.size())
+        {
+            return D3DERR_INVALIDCALL;
+        }
+        return m_levels[level]->GetDesc(pDesc);
+    }
+    HRESULT STDMETHODCALLTYPE GetSurfaceLevel(UINT level, IDirect3DSurface9** ppSurfaceLevel) override
+    {
+        if (level >= m_levels.size() || !ppSurfaceLevel)
+        {
+            return D3DERR_INVALIDCALL;
+        }
+        m_levels[level]->AddRef();
+        *ppSurfaceLevel = m_levels[level];
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE LockRect(UINT level, D3DLOCKED_RECT* pLockedRect, CONST RECT* pRect, DWORD flags) override
+    {
+        if (level >= m_levels.size())
+        {
+            return D3DERR_INVALIDCALL;
+        }
+        return m_levels[level]->LockRect(pLockedRect, pRect, flags);
+    }
+    HRESULT STDMETHODCALLTYPE UnlockRect(UINT level) override
+    {
+        return level < m_levels.size() ? S_OK : D3DERR_INVALIDCALL;
+    }
+    HRESULT STDMETHODCALLTYPE AddDirtyRect(CONST RECT*) override { return S_OK; }
+
+private:
+    std::vector<NullSurface*> m_levels;
+    DWORD m_lod;
+    D3DTEXTUREFILTERTYPE m_filter;
+};
+
+class NullVertexDeclaration : public NullObject<IDirect3DVertexDeclaration9>
+{
+public:
+    NullVertexDeclaration(NullDevice* device, const D3DVERTEXELEMENT9* elements)
+        : NullObject<IDirect3DVertexDeclaration9>(device, __uuidof(IDirect3DVertexDeclaration9))
+    {
+        // D3DDECL_END() まで含めて保持する.
+        do
+        {
+            m_elements.push_back(*elements);
+        } while ((elements++)->Stream != 0xFF);
+    }
+
+    HRESULT STDMETHODCALLTYPE GetDevice(IDirect3DDevice9** ppDevice) override { return GetDeviceImpl(ppDevice); }
+    HRESULT STDMETHODCALLTYPE GetDeclaration(D3DVERTEXELEMENT9* pElement, UINT* pNumElements) override
+    {
+        if (!pNumElements)
+        {
+            return D3DERR_INVALIDCALL;
+        }
+        if (pElement)
+        {
+            memcpy(pElement, m_elements.data(), m_elements.size() * sizeof(D3DVERTEXELEMENT9));
+        }
+        *pNumElements = static_cast<UINT>(m_elements.size());
+        return S_OK;
+    }
+
+private:
+    std::vector<D3DVERTEXELEMENT9> m_elements;
+};
+
+template<class Interface>
+class NullShader : public NullObject<Interface>
+{
+public:
+    NullShader(NullDevice* device, REFIID iid)
+        : NullObject<Interface>(device, iid)
+    {
+    }
+
+    HRESULT STDMETHODCALLTYPE GetDevice(IDirect3DDevice9** ppDevice) override { return this->GetDeviceImpl(ppDevice); }
+    // バイトコードは保持しない.
+    HRESULT STDMETHODCALLTYPE GetFunction(void*, UINT*) override { return E_NOTIMPL; }
+};
+
+// クエリは発行した時点で完了している扱いにする.
+class NullQuery : public NullObject<IDirect3DQuery9>
+{
+public:
+    NullQuery(NullDevice* device, D3DQUERYTYPE type)
+        : NullObject<IDirect3DQuery9>(device, __uuidof(IDirect3DQuery9)), m_type(type), m_timestamp(0)
+    {
+    }
+
+    HRESULT STDMETHODCALLTYPE GetDevice(IDirect3DDevice9** ppDevice) override { return GetDeviceImpl(ppDevice); }
+    D3DQUERYTYPE STDMETHODCALLTYPE GetType() override { return m_type; }
+    DWORD STDMETHODCALLTYPE GetDataSize() override
+    {
+        switch (m_type)
+        {
+        case D3DQUERYTYPE_TIMESTAMP:
+        case D3DQUERYTYPE_TIMESTAMPFREQ:
+            return sizeof(UINT64);
+        case D3DQUERYTYPE_OCCLUSION:
+            return sizeof(DWORD);
+        default:
+            return sizeof(BOOL);
+        }
+    }
+    HRESULT STDMETHODCALLTYPE Issue(DWORD flags) override
+    {
+        if (flags & D3DISSUE_END)
+        {
+            ++m_timestamp;
+        }
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE GetData(void* pData, DWORD size, DWORD) override
+    {
+        if (!pData || size == 0)
+        {
+            return S_OK;
+        }
+        if (size < GetDataSize())
+        {
+            return D3DERR_INVALIDCALL;
+        }
+        memset(pData, 0, size);
+        switch (m_type)
+        {
+        case D3DQUERYTYPE_EVENT:
+            *static_cast<BOOL*>(pData) = TRUE;
+            break;
+        case D3DQUERYTYPE_TIMESTAMP:
+            *static_cast<UINT64*>(pData) = m_timestamp;
+            break;
+        case D3DQUERYTYPE_TIMESTAMPFREQ:
+            *static_cast<UINT64*>(pData) = 1000000000;
+            break;
+        default:
+            break;
+        }
+        return S_OK;
+    }
+
+private:
+    D3DQUERYTYPE m_type;
+    UINT64 m_timestamp;
+};
+
+// SetTexture のステージ番号を配列の位置に変換する. 範囲外なら -1.
+int GetSamplerIndex(DWORD stage)
+{
+    if (stage < 16)
+    {
+        return static_cast<int>(stage);
+    }
+    if (stage >= D3DVERTEXTEXTURESAMPLER0 && stage < D3DVERTEXTEXTURESAMPLER0 + 4)
+    {
+        return static_cast<int>(16 + stage - D3DVERTEXTEXTURESAMPLER0);
+    }
+    return -1;
+}
+}
+
+
+NullDevice::NullDevice(const D3DPRESENT_PARAMETERS& pp)
+    : m_refCount(1), m_pp(pp), m_maxFrameLatency(3),
+    m_frameCount(0), m_injectedError(S_OK), m_injectedErrorFrame(0),
+    m_backBuffer(nullptr), m_autoDepthStencil(nullptr), m_depthStencil(nullptr),
+    m_indices(nullptr), m_decl(nullptr), m_vs(nullptr), m_ps(nullptr), m_fvf(0),
+    m_inScene(false)
+{
+    m_current = Stats();
+    m_frameStats = Stats();
+    m_totalStats = Stats();
+    for (int i = 0; i < MaxRenderTargets; ++i)
+    {
+        m_renderTargets[i] = nullptr;
+    }
+    for (int i = 0; i < MaxSamplers; ++i)
+    {
+        m_textures[i] = nullptr;
+    }
+    for (int i = 0; i < MaxStreams; ++i)
+    {
+        m_streams[i] = nullptr;
+    }
+    SetupSwapChain();
+}
+
+NullDevice::~NullDevice()
+{
+    ReleaseBindings();
+}
+
+// バックバッファと深度バッファを作り, ステートを初期値に戻す.
+void NullDevice::SetupSwapChain()
+{
+    if (m_pp.BackBufferWidth == 0 || m_pp.BackBufferHeight == 0)
+    {
+        m_pp.BackBufferWidth = 640;
+        m_pp.BackBufferHeight = 480;
+    }
+    if (m_pp.BackBufferFormat == D3DFMT_UNKNOWN)
+    {
+        m_pp.BackBufferFormat = D3DFMT_X8R8G8B8;
+    }
+
+    m_backBuffer = new NullSurface(this, m_pp.BackBufferWidth, m_pp.BackBufferHeight,
+        m_pp.BackBufferFormat, D3DUSAGE_RENDERTARGET, D3DPOOL_DEFAULT, nullptr);
+    Bind(m_renderTargets[0], m_backBuffer);
+    if (m_pp.EnableAutoDepthStencil)
+    {
+        m_autoDepthStencil = new NullSurface(this, m_pp.BackBufferWidth, m_pp.BackBufferHeight,
+            m_pp.AutoDepthStencilFormat, D3DUSAGE_DEPTHSTENCIL, D3DPOOL_DEFAULT, nullptr);
+        Bind(m_depthStencil, m_autoDepthStencil);
+    }
+
+    m_viewport.X = 0;
+    m_viewport.Y = 0;
+    m_viewport.Width = m_pp.BackBufferWidth;
+    m_viewport.Height = m_pp.BackBufferHeight;
+    m_viewport.MinZ = 0.0f;
+    m_viewport.MaxZ = 1.0f;
+    m_scissorRect.left = 0;
+    m_scissorRect.top = 0;
+    m_scissorRect.right = m_pp.BackBufferWidth;
+    m_scissorRect.bottom = m_pp.BackBufferHeight;
+
+    memset(m_renderStates, 0, sizeof(m_renderStates));
+    m_renderStates[D3DRS_ZENABLE] = m_pp.EnableAutoDepthStencil ? TRUE : FALSE;
+    m_renderStates[D3DRS_CULLMODE] = D3DCULL_CCW;
+    memset(m_samplerStates, 0, sizeof(m_samplerStates));
+    for (int i = 0; i < MaxSamplers; ++i)
+    {
+        m_samplerStates[i][D3DSAMP_ADDRESSU] = D3DTADDRESS_WRAP;
+        m_samplerStates[i][D3DSAMP_ADDRESSV] = D3DTADDRESS_WRAP;
+        m_samplerStates[i][D3DSAMP_ADDRESSW] = D3DTADDRESS_WRAP;
+        m_samplerStates[i][D3DSAMP_MAGFILTER] = D3DTEXF_POINT;
+        m_samplerStates[i][D3DSAMP_MINFILTER] = D3DTEXF_POINT;
+        m_samplerStates[i][D3DSAMP_MIPFILTER] = D3DTEXF_NONE;
+        m_samplerStates[i][D3DSAMP_MAXANISOTROPY] = 1;
+    }
+    for (int i = 0; i < MaxStreams; ++i)
+    {
+        m_streamOffsets[i] = 0;
+        m_streamStrides[i] = 0;
+        m_streamFreqs[i] = 1;
+    }
+}
+
+void NullDevice::ReleaseBindings()
+{
+    for (int i = 0; i < MaxRenderTargets; ++i)
+    {
+        Bind(m_renderTargets[i], static_cast<IDirect3DSurface9*>(nullptr));
+    }
+    for (int i = 0; i < MaxSamplers; ++i)
+    {
+        Bind(m_textures[i], static_cast<IDirect3DBaseTexture9*>(nullptr));
+    }
+    for (int i = 0; i < MaxStreams; ++i)
+    {
+        Bind(m_streams[i], static_cast<IDirect3DVertexBuffer9*>(nullptr));
+    }
+    Bind(m_depthStencil, static_cast<IDirect3DSurface9*>(nullptr));
+    Bind(m_indices, static_cast<IDirect3DIndexBuffer9*>(nullptr));
+    Bind(m_decl, static_cast<IDirect3DVertexDeclaration9*>(nullptr));
+    Bind(m_vs, static_cast<IDirect3DVertexShader9*>(nullptr));
+    Bind(m_ps, static_cast<IDirect3DPixelShader9*>(nullptr));
+    if (m_backBuffer)
+    {
+        m_backBuffer->Release();
+    }
+    if (m_autoDepthStencil)
+    {
+        m_autoDepthStencil->Release();
+    }
+    m_backBuffer = nullptr;
+    m_autoDepthStencil = nullptr;
+}
+
+void NullDevice::CountState(bool redundant)
+{
+    m_current.stateChanges++;
+    if (redundant)
+    {
+        m_current.redundantStateChanges++;
+    }
+}
+
+void NullDevice::RecordLock(uint64_t bytes)
+{
+    m_current.locks++;
+    m_current.bytesUploaded += bytes;
+}
+
+void NullDevice::EndFrame()
+{
+    m_frameStats = m_current;
+    AddStats(m_totalStats, m_current);
+    m_current = Stats();
+    m_frameCount++;
+}
+
+void NullDevice::InjectDeviceError(HRESULT hr, uint32_t frame)
+{
+    m_injectedError = hr;
+    m_injectedErrorFrame = frame;
+}
+
+HRESULT NullDevice::GetInjectedError() const
+{
+    if (FAILED(m_injectedError) && m_frameCount >= m_injectedErrorFrame)
+    {
+        return m_injectedError;
+    }
+    return S_OK;
+}
+
+std::string NullDevice::Report() const
+{
+    const Stats& f = m_frameStats;
+    const Stats& t = m_totalStats;
+    const double frames = m_frameCount > 0 ? double(m_frameCount) : 1.0;
+    char buf[1024];
+    snprintf(buf, sizeof(buf),
+        "NullDevice: %u frames\n"
+        "  last frame : calls %u, draws %u, primitives %u, state changes %u (redundant %u), locks %u, uploaded %llu bytes\n"
+        "  per frame  : calls %.1f, draws %.1f, primitives %.1f, state changes %.1f (redundant %.1f), locks %.1f, uploaded %.1f bytes\n"
+        "  resources created : %u\n",
+        m_frameCount,
+        f.calls, f.drawCalls, f.primitives, f.stateChanges, f.redundantStateChanges, f.locks,
+        (unsigned long long)f.bytesUploaded,
+        t.calls / frames, t.drawCalls / frames, t.primitives / frames,
+        t.stateChanges / frames, t.redundantStateChanges / frames, t.locks / frames,
+        double(t.bytesUploaded) / frames,
+        t.resourcesCreated + m_current.resourcesCreated);
+    return buf;
+}
+
+HRESULT NullDevice::CreateSurface(UINT width, UINT height, D3DFORMAT format, DWORD usage, D3DPOOL pool, IDirect3DSurface9** ppSurface)
+{
+    CountCall();
+    if (!ppSurface || width == 0 || height == 0)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    *ppSurface = new NullSurface(this, width, height, format, usage, pool, nullptr);
+    m_current.resourcesCreated++;
+    return S_OK;
+}
+
+// IUnknown
+
+HRESULT NullDevice::QueryInterface(REFIID riid, void** ppvObj)
+{
+    if (!ppvObj)
+    {
+        return E_POINTER;
+    }
+    if (riid == __uuidof(IUnknown) || riid == __uuidof(IDirect3DDevice9) || riid == __uuidof(IDirect3DDevice9Ex))
+    {
+        AddRef();
+        *ppvObj = this;
+        return S_OK;
+    }
+    *ppvObj = nullptr;
+    return E_NOINTERFACE;
+}
+
+ULONG NullDevice::AddRef()
+{
+    return ++m_refCount;
+}
+
+ULONG NullDevice::Release()
+{
+    ULONG count = --m_refCount;
+    if (count == 0)
+    {
+        delete this;
+    }
+    return count;
+}
+
+// IDirect3DDevice9
+
+HRESULT NullDevice::TestCooperativeLevel()
+{
+    CountCall();
+    return GetInjectedError();
+}
+
+UINT NullDevice::GetAvailableTextureMem()
+{
+    CountCall();
+    return 512u * 1024 * 1024;
+}
+
+HRESULT NullDevice::EvictManagedResources()
+{
+    CountCall();
+    return S_OK;
+}
+
+HRESULT NullDevice::GetDirect3D(IDirect3D9** ppD3D9)
+{
+    CountCall();
+    if (ppD3D9)
+    {
+        *ppD3D9 = nullptr;
+    }
+    return D3DERR_NOTAVAILABLE;
+}
+
+HRESULT NullDevice::GetDeviceCaps(D3DCAPS9* pCaps)
+{
+    CountCall();
+    if (!pCaps)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    ZeroMemory(pCaps, sizeof(D3DCAPS9));
+    pCaps->MaxPrimitiveCount = 0xFFFFFF;
+    pCaps->MaxVertexIndex = 0xFFFFFF;
+    pCaps->NumSimultaneousRTs = MaxRenderTargets;
+    pCaps->MaxTextureWidth = 8192;
+    pCaps->MaxTextureHeight = 8192;
+    pCaps->VertexShaderVersion = D3DVS_VERSION(3, 0);
+    pCaps->PixelShaderVersion = D3DPS_VERSION(3, 0);
+    return S_OK;
+}
+
+HRESULT NullDevice::GetDisplayMode(UINT, D3DDISPLAYMODE* pMode)
+{
+    CountCall();
+    if (!pMode)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    pMode->Width = m_pp.BackBufferWidth;
+    pMode->Height = m_pp.BackBufferHeight;
+    pMode->RefreshRate = 60;
+    pMode->Format = m_pp.BackBufferFormat;
+    return S_OK;
+}
+
+HRESULT NullDevice::GetCreationParameters(D3DDEVICE_CREATION_PARAMETERS* pParameters)
+{
+    CountCall();
+    if (!pParameters)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    ZeroMemory(pParameters, sizeof(D3DDEVICE_CREATION_PARAMETERS));
+    pParameters->AdapterOrdinal = D3DADAPTER_DEFAULT;
+    pParameters->DeviceType = D3DDEVTYPE_NULLREF;
+    pParameters->hFocusWindow = m_pp.hDeviceWindow;
+    return S_OK;
+}
+
+HRESULT NullDevice::SetCursorProperties(UINT, UINT, IDirect3DSurface9*)
+{
+    CountCall();
+    return S_OK;
+}
+
+void NullDevice::SetCursorPosition(int, int, DWORD)
+{
+    CountCall();
+}
+
+BOOL NullDevice::ShowCursor(BOOL)
+{
+    CountCall();
+    return FALSE;
+}
+
+HRESULT NullDevice::CreateAdditionalSwapChain(D3DPRESENT_PARAMETERS*, IDirect3DSwapChain9** pSwapChain)
+{
+    CountCall();
+    if (pSwapChain)
+    {
+        *pSwapChain = nullptr;
+    }
+    return D3DERR_NOTAVAILABLE;
+}
+
+HRESULT NullDevice::GetSwapChain(UINT, IDirect3DSwapChain9** pSwapChain)
+{
+    CountCall();
+    if (pSwapChain)
+    {
+        *pSwapChain = nullptr;
+    }
+    return D3DERR_NOTAVAILABLE;
+}
+
+UINT NullDevice::GetNumberOfSwapChains()
+{
+    CountCall();
+    return 1;
+}
+
+HRESULT NullDevice::Reset(D3DPRESENT_PARAMETERS* pPresentationParameters)
+{
+    return ResetEx(pPresentationParameters, nullptr);
+}
+
+HRESULT NullDevice::Present(CONST RECT* pSourceRect, CONST RECT* pDestRect, HWND hDestWindowOverride, CONST RGNDATA* pDirtyRegion)
+{
+    return PresentEx(pSourceRect, pDestRect, hDestWindowOverride, pDirtyRegion, 0);
+}
+
+HRESULT NullDevice::GetBackBuffer(UINT, UINT, D3DBACKBUFFER_TYPE, IDirect3DSurface9** ppBackBuffer)
+{
+    CountCall();
+    if (!ppBackBuffer || !m_backBuffer)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    m_backBuffer->AddRef();
+    *ppBackBuffer = m_backBuffer;
+    return S_OK;
+}
+
+HRESULT NullDevice::GetRasterStatus(UINT, D3DRASTER_STATUS* pRasterStatus)
+{
+    CountCall();
+    if (!pRasterStatus)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    ZeroMemory(pRasterStatus, sizeof(D3DRASTER_STATUS));
+    return S_OK;
+}
+
+HRESULT NullDevice::SetDialogBoxMode(BOOL)
+{
+    CountCall();
+    return S_OK;
+}
+
+void NullDevice::SetGammaRamp(UINT, DWORD, CONST D3DGAMMARAMP*)
+{
+    CountCall();
+}
+
+void NullDevice::GetGammaRamp(UINT, D3DGAMMARAMP* pRamp)
+{
+    CountCall();
+    if (pRamp)
+    {
+        ZeroMemory(pRamp, sizeof(D3DGAMMARAMP));
+    }
+}
+
+HRESULT NullDevice::CreateTexture(UINT Width, UINT Height, UINT Levels, DWORD Usage, D3DFORMAT Format, D3DPOOL Pool, IDirect3DTexture9** ppTexture, HANDLE*)
+{
+    CountCall();
+    if (!ppTexture || Width == 0 || Height == 0)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    *ppTexture = new NullTexture(this, Width, Height, Levels, Usage, Format, Pool);
+    m_current.resourcesCreated++;
+    return S_OK;
+}
+
+HRESULT NullDevice::CreateVolumeTexture(UINT, UINT, UINT, UINT, DWORD, D3DFORMAT, D3DPOOL, IDirect3DVolumeTexture9** ppVolumeTexture, HANDLE*)
+{
+    CountCall();
+    if (ppVolumeTexture)
+    {
+        *ppVolumeTexture = nullptr;
+    }
+    return D3DERR_NOTAVAILABLE;
+}
+
+HRESULT NullDevice::CreateCubeTexture(UINT, UINT, DWORD, D3DFORMAT, D3DPOOL, IDirect3DCubeTexture9** ppCubeTexture, HANDLE*)
+{
+    CountCall();
+    if (ppCubeTexture)
+    {
+        *ppCubeTexture = nullptr;
+    }
+    return D3DERR_NOTAVAILABLE;
+}
+
+HRESULT NullDevice::CreateVertexBuffer(UINT Length, DWORD Usage, DWORD FVF, D3DPOOL Pool, IDirect3DVertexBuffer9** ppVertexBuffer, HANDLE*)
+{
+    CountCall();
+    if (!ppVertexBuffer || Length == 0)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    *ppVertexBuffer = new NullVertexBuffer(this, __uuidof(IDirect3DVertexBuffer9), D3DRTYPE_VERTEXBUFFER,
+        Length, Usage, D3DFMT_UNKNOWN, FVF, Pool);
+    m_current.resourcesCreated++;
+    return S_OK;
+}
+
+HRESULT NullDevice::CreateIndexBuffer(UINT Length, DWORD Usage, D3DFORMAT Format, D3DPOOL Pool, IDirect3DIndexBuffer9** ppIndexBuffer, HANDLE*)
+{
+    CountCall();
+    if (!ppIndexBuffer || Length == 0)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    *ppIndexBuffer = new NullIndexBuffer(this, __uuidof(IDirect3DIndexBuffer9), D3DRTYPE_INDEXBUFFER,
+        Length, Usage, Format, 0, Pool);
+    m_current.resourcesCreated++;
+    return S_OK;
+}
+
+HRESULT NullDevice::CreateRenderTarget(UINT Width, UINT Height, D3DFORMAT Format, D3DMULTISAMPLE_TYPE, DWORD, BOOL, IDirect3DSurface9** ppSurface, HANDLE*)
+{
+    return CreateSurface(Width, Height, Format, D3DUSAGE_RENDERTARGET, D3DPOOL_DEFAULT, ppSurface);
+}
+
+HRESULT NullDevice::CreateDepthStencilSurface(UINT Width, UINT Height, D3DFORMAT Format, D3DMULTISAMPLE_TYPE, DWORD, BOOL, IDirect3DSurface9** ppSurface, HANDLE*)
+{
+    return CreateSurface(Width, Height, Format, D3DUSAGE_DEPTHSTENCIL, D3DPOOL_DEFAULT, ppSurface);
+}
+
+HRESULT NullDevice::UpdateSurface(IDirect3DSurface9*, CONST RECT*, IDirect3DSurface9*, CONST POINT*)
+{
+    CountCall();
+    return S_OK;
+}
+
+HRESULT NullDevice::UpdateTexture(IDirect3DBaseTexture9*, IDirect3DBaseTexture9*)
+{
+    CountCall();
+    return S_OK;
+}
+
+HRESULT NullDevice::GetRenderTargetData(IDirect3DSurface9* pRenderTarget, IDirect3DSurface9* pDestSurface)
+{
+    CountCall();
+    if (!pRenderTarget || !pDestSurface)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    // FrameCapture のテストで読み戻した内容を確かめられるよう, 内容をコピーする.
+    return static_cast<NullSurface*>(pDestSurface)->CopyFrom(*static_cast<NullSurface*>(pRenderTarget));
+}
+
+HRESULT NullDevice::GetFrontBufferData(UINT, IDirect3DSurface9*)
+{
+    CountCall();
+    return S_OK;
+}
+
+HRESULT NullDevice::StretchRect(IDirect3DSurface9*, CONST RECT*, IDirect3DSurface9*, CONST RECT*, D3DTEXTUREFILTERTYPE)
+{
+    CountCall();
+    return S_OK;
+}
+
+HRESULT NullDevice::ColorFill(IDirect3DSurface9*, CONST RECT*, D3DCOLOR)
+{
+    CountCall();
+    return S_OK;
+}
+
+HRESULT NullDevice::CreateOffscreenPlainSurface(UINT Width, UINT Height, D3DFORMAT Format, D3DPOOL Pool, IDirect3DSurface9** ppSurface, HANDLE*)
+{
+    return CreateSurface(Width, Height, Format, 0, Pool, ppSurface);
+}
+
+HRESULT NullDevice::SetRenderTarget(DWORD RenderTargetIndex, IDirect3DSurface9* pRenderTarget)
+{
+    CountCall();
+    if (RenderTargetIndex >= MaxRenderTargets || (RenderTargetIndex == 0 && !pRenderTarget))
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    CountState(!Bind(m_renderTargets[RenderTargetIndex], pRenderTarget));
+
+    // 0 番の設定ではビューポートがターゲット全体に戻る.
+    if (RenderTargetIndex == 0)
+    {
+        D3DSURFACE_DESC desc;
+        pRenderTarget->GetDesc(&desc);
+        m_viewport.X = 0;
+        m_viewport.Y = 0;
+        m_viewport.Width = desc.Width;
+        m_viewport.Height = desc.Height;
+        m_viewport.MinZ = 0.0f;
+        m_viewport.MaxZ = 1.0f;
+    }
+    return S_OK;
+}
+
+HRESULT NullDevice::GetRenderTarget(DWORD RenderTargetIndex, IDirect3DSurface9** ppRenderTarget)
+{
+    CountCall();
+    if (RenderTargetIndex >= MaxRenderTargets || !ppRenderTarget)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    *ppRenderTarget = m_renderTargets[RenderTargetIndex];
+    if (!*ppRenderTarget)
+    {
+        return D3DERR_NOTFOUND;
+    }
+    (*ppRenderTarget)->AddRef();
+    return S_OK;
+}
+
+HRESULT NullDevice::SetDepthStencilSurface(IDirect3DSurface9* pNewZStencil)
+{
+    CountCall();
+    CountState(!Bind(m_depthStencil, pNewZStencil));
+    return S_OK;
+}
+
+HRESULT NullDevice::GetDepthStencilSurface(IDirect3DSurface9** ppZStencilSurface)
+{
+    CountCall();
+    if (!ppZStencilSurface)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    *ppZStencilSurface = m_depthStencil;
+    if (!m_depthStencil)
+    {
+        return D3DERR_NOTFOUND;
+    }
+    m_depthStencil->AddRef();
+    return S_OK;
+}
+
+HRESULT NullDevice::BeginScene()
+{
+    CountCall();
+    if (m_inScene)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    m_inScene = true;
+    return S_OK;
+}
+
+HRESULT NullDevice::EndScene()
+{
+    CountCall();
+    if (!m_inScene)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    m_inScene = false;
+    return S_OK;
+}
+
+HRESULT NullDevice::Clear(DWORD, CONST D3DRECT*, DWORD, D3DCOLOR, float, DWORD)
+{
+    CountCall();
+    return S_OK;
+}
+
+HRESULT NullDevice::SetTransform(D3DTRANSFORMSTATETYPE, CONST D3DMATRIX*)
+{
+    CountCall();
+    CountState(false);
+    return S_OK;
+}
+
+HRESULT NullDevice::GetTransform(D3DTRANSFORMSTATETYPE, D3DMATRIX* pMatrix)
+{
+    CountCall();
+    if (!pMatrix)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    ZeroMemory(pMatrix, sizeof(D3DMATRIX));
+    return S_OK;
+}
+
+HRESULT NullDevice::MultiplyTransform(D3DTRANSFORMSTATETYPE, CONST D3DMATRIX*)
+{
+    CountCall();
+    CountState(false);
+    return S_OK;
+}
+
+HRESULT NullDevice::SetViewport(CONST D3DVIEWPORT9* pViewport)
+{
+    CountCall();
+    if (!pViewport)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    CountState(memcmp(&m_viewport, pViewport, sizeof(D3DVIEWPORT9)) == 0);
+    m_viewport = *pViewport;
+    return S_OK;
+}
+
+HRESULT NullDevice::GetViewport(D3DVIEWPORT9* pViewport)
+{
+    CountCall();
+    if (!pViewport)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    *pViewport = m_viewport;
+    return S_OK;
+}
+
+HRESULT NullDevice::SetMaterial(CONST D3DMATERIAL9*)
+{
+    CountCall();
+    CountState(false);
+    return S_OK;
+}
+
+HRESULT NullDevice::GetMaterial(D3DMATERIAL9* pMaterial)
+{
+    CountCall();
+    if (!pMaterial)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    ZeroMemory(pMaterial, sizeof(D3DMATERIAL9));
+    return S_OK;
+}
+
+HRESULT NullDevice::SetLight(DWORD, CONST D3DLIGHT9*)
+{
+    CountCall();
+    CountState(false);
+    return S_OK;
+}
+
+HRESULT NullDevice::GetLight(DWORD, D3DLIGHT9* pLight)
+{
+    CountCall();
+    if (!pLight)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    ZeroMemory(pLight, sizeof(D3DLIGHT9));
+    return S_OK;
+}
+
+HRESULT NullDevice::LightEnable(DWORD, BOOL)
+{
+    CountCall();
+    CountState(false);
+    return S_OK;
+}
+
+HRESULT NullDevice::GetLightEnable(DWORD, BOOL* pEnable)
+{
+    CountCall();
+    if (!pEnable)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    *pEnable = FALSE;
+    return S_OK;
+}
+
+HRESULT NullDevice::SetClipPlane(DWORD, CONST float*)
+{
+    CountCall();
+    CountState(false);
+    return S_OK;
+}
+
+HRESULT NullDevice::GetClipPlane(DWORD, float* pPlane)
+{
+    CountCall();
+    if (!pPlane)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    memset(pPlane, 0, sizeof(float) * 4);
+    return S_OK;
+}
+
+HRESULT NullDevice::SetRenderState(D3DRENDERSTATETYPE State, DWORD Value)
+{
+    CountCall();
+    if (State >= MaxRenderStates)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    CountState(m_renderStates[State] == Value);
+    m_renderStates[State] = Value;
+    return S_OK;
+}
+
+HRESULT NullDevice::GetRenderState(D3DRENDERSTATETYPE State, DWORD* pValue)
+{
+    CountCall();
+    if (State >= MaxRenderStates || !pValue)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    *pValue = m_renderStates[State];
+    return S_OK;
+}
+
+HRESULT NullDevice::CreateStateBlock(D3DSTATEBLOCKTYPE, IDirect3DStateBlock9** ppSB)
+{
+    CountCall();
+    if (ppSB)
+    {
+        *ppSB = nullptr;
+    }
+    return D3DERR_NOTAVAILABLE;
+}
+
+HRESULT NullDevice::BeginStateBlock()
+{
+    CountCall();
+    return D3DERR_NOTAVAILABLE;
+}
+
+HRESULT NullDevice::EndStateBlock(IDirect3DStateBlock9** ppSB)
+{
+    CountCall();
+    if (ppSB)
+    {
+        *ppSB = nullptr;
+    }
+    return D3DERR_NOTAVAILABLE;
+}
+
+HRESULT NullDevice::SetClipStatus(CONST D3DCLIPSTATUS9*)
+{
+    CountCall();
+    return S_OK;
+}
+
+HRESULT NullDevice::GetClipStatus(D3DCLIPSTATUS9* pClipStatus)
+{
+    CountCall();
+    if (!pClipStatus)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    ZeroMemory(pClipStatus, sizeof(D3DCLIPSTATUS9));
+    return S_OK;
+}
+
+HRESULT NullDevice::GetTexture(DWORD Stage, IDirect3DBaseTexture9** ppTexture)
+{
+    CountCall();
+    int index = GetSamplerIndex(Stage);
+    if (index < 0 || !ppTexture)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    *ppTexture = m_textures[index];
+    if (*ppTexture)
+    {
+        (*ppTexture)->AddRef();
+    }
+    return S_OK;
+}
+
+HRESULT NullDevice::SetTexture(DWORD Stage, IDirect3DBaseTexture9* pTexture)
+{
+    CountCall();
+    int index = GetSamplerIndex(Stage);
+    if (index < 0)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    CountState(!Bind(m_textures[index], pTexture));
+    return S_OK;
+}
+
+HRESULT NullDevice::GetTextureStageState(DWORD, D3DTEXTURESTAGESTATETYPE, DWORD* pValue)
+{
+    CountCall();
+    if (!pValue)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    *pValue = 0;
+    return S_OK;
+}
+
+HRESULT NullDevice::SetTextureStageState(DWORD, D3DTEXTURESTAGESTATETYPE, DWORD)
+{
+    CountCall();
+    CountState(false);
+    return S_OK;
+}
+
+HRESULT NullDevice::GetSamplerState(DWORD Sampler, D3DSAMPLERSTATETYPE Type, DWORD* pValue)
+{
+    CountCall();
+    int index = GetSamplerIndex(Sampler);
+    if (index < 0 || Type >= MaxSamplerStates || !pValue)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    *pValue = m_samplerStates[index][Type];
+    return S_OK;
+}
+
+HRESULT NullDevice::SetSamplerState(DWORD Sampler, D3DSAMPLERSTATETYPE Type, DWORD Value)
+{
+    CountCall();
+    int index = GetSamplerIndex(Sampler);
+    if (index < 0 || Type >= MaxSamplerStates)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    CountState(m_samplerStates[index][Type] == Value);
+    m_samplerStates[index][Type] = Value;
+    return S_OK;
+}
+
+HRESULT NullDevice::ValidateDevice(DWORD* pNumPasses)
+{
+    CountCall();
+    if (pNumPasses)
+    {
+        *pNumPasses = 1;
+    }
+    return S_OK;
+}
+
+HRESULT NullDevice::SetPaletteEntries(UINT, CONST PALETTEENTRY*)
+{
+    CountCall();
+    return S_OK;
+}
+
+HRESULT NullDevice::GetPaletteEntries(UINT, PALETTEENTRY*)
+{
+    CountCall();
+    return D3DERR_NOTAVAILABLE;
+}
+
+HRESULT NullDevice::SetCurrentTexturePalette(UINT)
+{
+    CountCall();
+    return S_OK;
+}
+
+HRESULT NullDevice::GetCurrentTexturePalette(UINT* PaletteNumber)
+{
+    CountCall();
+    if (PaletteNumber)
+    {
+        *PaletteNumber = 0;
+    }
+    return S_OK;
+}
+
+HRESULT NullDevice::SetScissorRect(CONST RECT* pRect)
+{
+    CountCall();
+    if (!pRect)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    CountState(memcmp(&m_scissorRect, pRect, sizeof(RECT)) == 0);
+    m_scissorRect = *pRect;
+    return S_OK;
+}
+
+HRESULT NullDevice::GetScissorRect(RECT* pRect)
+{
+    CountCall();
+    if (!pRect)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    *pRect = m_scissorRect;
+    return S_OK;
+}
+
+HRESULT NullDevice::SetSoftwareVertexProcessing(BOOL)
+{
+    CountCall();
+    return S_OK;
+}
+
+BOOL NullDevice::GetSoftwareVertexProcessing()
+{
+    CountCall();
+    return FALSE;
+}
+
+HRESULT NullDevice::SetNPatchMode(float)
+{
+    CountCall();
+    return S_OK;
+}
+
+float NullDevice::GetNPatchMode()
+{
+    CountCall();
+    return 0.0f;
+}
+
+HRESULT NullDevice::DrawPrimitive(D3DPRIMITIVETYPE, UINT, UINT PrimitiveCount)
+{
+    CountCall();
+    m_current.drawCalls++;
+    m_current.primitives += PrimitiveCount;
+    return S_OK;
+}
+
+HRESULT NullDevice::DrawIndexedPrimitive(D3DPRIMITIVETYPE, INT, UINT, UINT, UINT, UINT primCount)
+{
+    CountCall();
+    m_current.drawCalls++;
+    m_current.primitives += primCount;
+    return S_OK;
+}
+
+HRESULT NullDevice::DrawPrimitiveUP(D3DPRIMITIVETYPE PrimitiveType, UINT PrimitiveCount, CONST void*, UINT VertexStreamZeroStride)
+{
+    CountCall();
+    m_current.drawCalls++;
+    m_current.primitives += PrimitiveCount;
+    m_current.bytesUploaded += uint64_t(GetVertexCount(PrimitiveType, PrimitiveCount)) * VertexStreamZeroStride;
+
+    // UP 系の描画はストリーム 0 の設定を解除する.
+    Bind(m_streams[0], static_cast<IDirect3DVertexBuffer9*>(nullptr));
+    m_streamOffsets[0] = 0;
+    m_streamStrides[0] = 0;
+    return S_OK;
+}
+
+HRESULT NullDevice::DrawIndexedPrimitiveUP(D3DPRIMITIVETYPE PrimitiveType, UINT, UINT NumVertices, UINT PrimitiveCount, CONST void*, D3DFORMAT IndexDataFormat, CONST void*, UINT VertexStreamZeroStride)
+{
+    CountCall();
+    m_current.drawCalls++;
+    m_current.primitives += PrimitiveCount;
+    UINT indexSize = (IndexDataFormat == D3DFMT_INDEX32) ? 4 : 2;
+    m_current.bytesUploaded += uint64_t(NumVertices) * VertexStreamZeroStride;
+    m_current.bytesUploaded += uint64_t(GetVertexCount(PrimitiveType, PrimitiveCount)) * indexSize;
+
+    Bind(m_streams[0], static_cast<IDirect3DVertexBuffer9*>(nullptr));
+    Bind(m_indices, static_cast<IDirect3DIndexBuffer9*>(nullptr));
+    m_streamOffsets[0] = 0;
+    m_streamStrides[0] = 0;
+    return S_OK;
+}
+
+HRESULT NullDevice::ProcessVertices(UINT, UINT, UINT, IDirect3DVertexBuffer9*, IDirect3DVertexDeclaration9*, DWORD)
+{
+    CountCall();
+    return S_OK;
+}
+
+HRESULT NullDevice::CreateVertexDeclaration(CONST D3DVERTEXELEMENT9* pVertexElements, IDirect3DVertexDeclaration9** ppDecl)
+{
+    CountCall();
+    if (!pVertexElements || !ppDecl)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    *ppDecl = new NullVertexDeclaration(this, pVertexElements);
+    m_current.resourcesCreated++;
+    return S_OK;
+}
+
+HRESULT NullDevice::SetVertexDeclaration(IDirect3DVertexDeclaration9* pDecl)
+{
+    CountCall();
+    CountState(!Bind(m_decl, pDecl));
+    return S_OK;
+}
+
+HRESULT NullDevice::GetVertexDeclaration(IDirect3DVertexDeclaration9** ppDecl)
+{
+    CountCall();
+    if (!ppDecl)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    *ppDecl = m_decl;
+    if (m_decl)
+    {
+        m_decl->AddRef();
+    }
+    return S_OK;
+}
+
+HRESULT NullDevice::SetFVF(DWORD FVF)
+{
+    CountCall();
+    CountState(m_fvf == FVF);
+    m_fvf = FVF;
+    return S_OK;
+}
+
+HRESULT NullDevice::GetFVF(DWORD* pFVF)
+{
+    CountCall();
+    if (!pFVF)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    *pFVF = m_fvf;
+    return S_OK;
+}
+
+HRESULT NullDevice::CreateVertexShader(CONST DWORD* pFunction, IDirect3DVertexShader9** ppShader)
+{
+    CountCall();
+    if (!pFunction || !ppShader)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    *ppShader = new NullShader<IDirect3DVertexShader9>(this, __uuidof(IDirect3DVertexShader9));
+    m_current.resourcesCreated++;
+    return S_OK;
+}
+
+HRESULT NullDevice::SetVertexShader(IDirect3DVertexShader9* pShader)
+{
+    CountCall();
+    CountState(!Bind(m_vs, pShader));
+    return S_OK;
+}
+
+HRESULT NullDevice::GetVertexShader(IDirect3DVertexShader9** ppShader)
+{
+    CountCall();
+    if (!ppShader)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    *ppShader = m_vs;
+    if (m_vs)
+    {
+        m_vs->AddRef();
+    }
+    return S_OK;
+}
+
+// シェーダー定数は値を保持せず, 設定回数だけ数える.
+HRESULT NullDevice::SetVertexShaderConstantF(UINT, CONST float* pConstantData, UINT)
+{
+    CountCall();
+    CountState(false);
+    return pConstantData ? S_OK : D3DERR_INVALIDCALL;
+}
+
+HRESULT NullDevice::GetVertexShaderConstantF(UINT, float* pConstantData, UINT Vector4fCount)
+{
+    CountCall();
+    if (!pConstantData)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    memset(pConstantData, 0, sizeof(float) * 4 * Vector4fCount);
+    return S_OK;
+}
+
+HRESULT NullDevice::SetVertexShaderConstantI(UINT, CONST int* pConstantData, UINT)
+{
+    CountCall();
+    CountState(false);
+    return pConstantData ? S_OK : D3DERR_INVALIDCALL;
+}
+
+HRESULT NullDevice::GetVertexShaderConstantI(UINT, int* pConstantData, UINT Vector4iCount)
+{
+    CountCall();
+    if (!pConstantData)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    memset(pConstantData, 0, sizeof(int) * 4 * Vector4iCount);
+    return S_OK;
+}
+
+HRESULT NullDevice::SetVertexShaderConstantB(UINT, CONST BOOL* pConstantData, UINT)
+{
+    CountCall();
+    CountState(false);
+    return pConstantData ? S_OK : D3DERR_INVALIDCALL;
+}
+
+HRESULT NullDevice::GetVertexShaderConstantB(UINT, BOOL* pConstantData, UINT BoolCount)
+{
+    CountCall();
+    if (!pConstantData)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    memset(pConstantData, 0, sizeof(BOOL) * BoolCount);
+    return S_OK;
+}
+
+HRESULT NullDevice::SetStreamSource(UINT StreamNumber, IDirect3DVertexBuffer9* pStreamData, UINT OffsetInBytes, UINT Stride)
+{
+    CountCall();
+    if (StreamNumber >= MaxStreams)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    bool changed = Bind(m_streams[StreamNumber], pStreamData);
+    changed |= m_streamOffsets[StreamNumber] != OffsetInBytes || m_streamStrides[StreamNumber] != Stride;
+    CountState(!changed);
+    m_streamOffsets[StreamNumber] = OffsetInBytes;
+    m_streamStrides[StreamNumber] = Stride;
+    return S_OK;
+}
+
+HRESULT NullDevice::GetStreamSource(UINT StreamNumber, IDirect3DVertexBuffer9** ppStreamData, UINT* pOffsetInBytes, UINT* pStride)
+{
+    CountCall();
+    if (StreamNumber >= MaxStreams || !ppStreamData || !pOffsetInBytes || !pStride)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    *ppStreamData = m_streams[StreamNumber];
+    if (*ppStreamData)
+    {
+        (*ppStreamData)->AddRef();
+    }
+    *pOffsetInBytes = m_streamOffsets[StreamNumber];
+    *pStride = m_streamStrides[StreamNumber];
+    return S_OK;
+}
+
+HRESULT NullDevice::SetStreamSourceFreq(UINT StreamNumber, UINT Setting)
+{
+    CountCall();
+    if (StreamNumber >= MaxStreams)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    CountState(m_streamFreqs[StreamNumber] == Setting);
+    m_streamFreqs[StreamNumber] = Setting;
+    return S_OK;
+}
+
+HRESULT NullDevice::GetStreamSourceFreq(UINT StreamNumber, UINT* pSetting)
+{
+    CountCall();
+    if (StreamNumber >= MaxStreams || !pSetting)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    *pSetting = m_streamFreqs[StreamNumber];
+    return S_OK;
+}
+
+HRESULT NullDevice::SetIndices(IDirect3DIndexBuffer9* pIndexData)
+{
+    CountCall();
+    CountState(!Bind(m_indices, pIndexData));
+    return S_OK;
+}
+
+HRESULT NullDevice::GetIndices(IDirect3DIndexBuffer9** ppIndexData)
+{
+    CountCall();
+    if (!ppIndexData)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    *ppIndexData = m_indices;
+    if (m_indices)
+    {
+        m_indices->AddRef();
+    }
+    return S_OK;
+}
+
+HRESULT NullDevice::CreatePixelShader(CONST DWORD* pFunction, IDirect3DPixelShader9** ppShader)
+{
+    CountCall();
+    if (!pFunction || !ppShader)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    *ppShader = new NullShader<IDirect3DPixelShader9>(this, __uuidof(IDirect3DPixelShader9));
+    m_current.resourcesCreated++;
+    return S_OK;
+}
+
+HRESULT NullDevice::SetPixelShader(IDirect3DPixelShader9* pShader)
+{
+    CountCall();
+    CountState(!Bind(m_ps, pShader));
+    return S_OK;
+}
+
+HRESULT NullDevice::GetPixelShader(IDirect3DPixelShader9** ppShader)
+{
+    CountCall();
+    if (!ppShader)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    *ppShader = m_ps;
+    if (m_ps)
+    {
+        m_ps->AddRef();
+    }
+    return S_OK;
+}
+
+HRESULT NullDevice::SetPixelShaderConstantF(UINT, CONST float* pConstantData, UINT)
+{
+    CountCall();
+    CountState(false);
+    return pConstantData ? S_OK : D3DERR_INVALIDCALL;
+}
+
+HRESULT NullDevice::GetPixelShaderConstantF(UINT, float* pConstantData, UINT Vector4fCount)
+{
+    CountCall();
+    if (!pConstantData)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    memset(pConstantData, 0, sizeof(float) * 4 * Vector4fCount);
+    return S_OK;
+}
+
+HRESULT NullDevice::SetPixelShaderConstantI(UINT, CONST int* pConstantData, UINT)
+{
+    CountCall();
+    CountState(false);
+    return pConstantData ? S_OK : D3DERR_INVALIDCALL;
+}
+
+HRESULT NullDevice::GetPixelShaderConstantI(UINT, int* pConstantData, UINT Vector4iCount)
+{
+    CountCall();
+    if (!pConstantData)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    memset(pConstantData, 0, sizeof(int) * 4 * Vector4iCount);
+    return S_OK;
+}
+
+HRESULT NullDevice::SetPixelShaderConstantB(UINT, CONST BOOL* pConstantData, UINT)
+{
+    CountCall();
+    CountState(false);
+    return pConstantData ? S_OK : D3DERR_INVALIDCALL;
+}
+
+HRESULT NullDevice::GetPixelShaderConstantB(UINT, BOOL* pConstantData, UINT BoolCount)
+{
+    CountCall();
+    if (!pConstantData)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    memset(pConstantData, 0, sizeof(BOOL) * BoolCount);
+    return S_OK;
+}
+
+HRESULT NullDevice::DrawRectPatch(UINT, CONST float*, CONST D3DRECTPATCH_INFO*)
+{
+    CountCall();
+    return D3DERR_NOTAVAILABLE;
+}
+
+HRESULT NullDevice::DrawTriPatch(UINT, CONST float*, CONST D3DTRIPATCH_INFO*)
+{
+    CountCall();
+    return D3DERR_NOTAVAILABLE;
+}
+
+HRESULT NullDevice::DeletePatch(UINT)
+{
+    CountCall();
+    return S_OK;
+}
+
+HRESULT NullDevice::CreateQuery(D3DQUERYTYPE Type, IDirect3DQuery9** ppQuery)
+{
+    CountCall();
+    switch (Type)
+    {
+    case D3DQUERYTYPE_EVENT:
+    case D3DQUERYTYPE_OCCLUSION:
+    case D3DQUERYTYPE_TIMESTAMP:
+    case D3DQUERYTYPE_TIMESTAMPDISJOINT:
+    case D3DQUERYTYPE_TIMESTAMPFREQ:
+        break;
+    default:
+        return D3DERR_NOTAVAILABLE;
+    }
+    // ppQuery が nullptr の場合はサポートの有無だけを返す.
+    if (ppQuery)
+    {
+        *ppQuery = new NullQuery(this, Type);
+        m_current.resourcesCreated++;
+    }
+    return S_OK;
+}
+
+// IDirect3DDevice9Ex
+
+HRESULT NullDevice::SetConvolutionMonoKernel(UINT, UINT, float*, float*)
+{
+    CountCall();
+    return S_OK;
+}
+
+HRESULT NullDevice::ComposeRects(IDirect3DSurface9*, IDirect3DSurface9*, IDirect3DVertexBuffer9*, UINT, IDirect3DVertexBuffer9*, D3DCOMPOSERECTSOP, int, int)
+{
+    CountCall();
+    return S_OK;
+}
+
+HRESULT NullDevice::PresentEx(CONST RECT*, CONST RECT*, HWND, CONST RGNDATA*, DWORD)
+{
+    CountCall();
+    HRESULT hr = GetInjectedError();
+    EndFrame();
+    return hr;
+}
+
+HRESULT NullDevice::GetGPUThreadPriority(INT* pPriority)
+{
+    CountCall();
+    if (!pPriority)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    *pPriority = 0;
+    return S_OK;
+}
+
+HRESULT NullDevice::SetGPUThreadPriority(INT)
+{
+    CountCall();
+    return S_OK;
+}
+
+HRESULT NullDevice::WaitForVBlank(UINT)
+{
+    CountCall();
+    return S_OK;
+}
+
+HRESULT NullDevice::CheckResourceResidency(IDirect3DResource9**, UINT32)
+{
+    CountCall();
+    return S_OK;
+}
+
+HRESULT NullDevice::SetMaximumFrameLatency(UINT MaxLatency)
+{
+    CountCall();
+    m_maxFrameLatency = MaxLatency;
+    return S_OK;
+}
+
+HRESULT NullDevice::GetMaximumFrameLatency(UINT* pMaxLatency)
+{
+    CountCall();
+    if (!pMaxLatency)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    *pMaxLatency = m_maxFrameLatency;
+    return S_OK;
+}
+
+HRESULT NullDevice::CheckDeviceState(HWND)
+{
+    CountCall();
+    return GetInjectedError();
+}
+
+HRESULT NullDevice::CreateRenderTargetEx(UINT Width, UINT Height, D3DFORMAT Format, D3DMULTISAMPLE_TYPE, DWORD, BOOL, IDirect3DSurface9** ppSurface, HANDLE*, DWORD Usage)
+{
+    return CreateSurface(Width, Height, Format, Usage | D3DUSAGE_RENDERTARGET, D3DPOOL_DEFAULT, ppSurface);
+}
+
+HRESULT NullDevice::CreateOffscreenPlainSurfaceEx(UINT Width, UINT Height, D3DFORMAT Format, D3DPOOL Pool, IDirect3DSurface9** ppSurface, HANDLE*, DWORD Usage)
+{
+    return CreateSurface(Width, Height, Format, Usage, Pool, ppSurface);
+}
+
+HRESULT NullDevice::CreateDepthStencilSurfaceEx(UINT Width, UINT Height, D3DFORMAT Format, D3DMULTISAMPLE_TYPE, DWORD, BOOL, IDirect3DSurface9** ppSurface, HANDLE*, DWORD Usage)
+{
+    return CreateSurface(Width, Height, Format, Usage | D3DUSAGE_DEPTHSTENCIL, D3DPOOL_DEFAULT, ppSurface);
+}
+
+HRESULT NullDevice::ResetEx(D3DPRESENT_PARAMETERS* pPresentationParameters, D3DDISPLAYMODEEX*)
+{
+    CountCall();
+    if (!pPresentationParameters)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    // 取り外されたデバイスは Reset では復帰できない.
+    if (GetInjectedError() == D3DERR_DEVICEREMOVED)
+    {
+        return D3DERR_DEVICEREMOVED;
+    }
+    m_injectedError = S_OK;
+
+    ReleaseBindings();
+    m_pp = *pPresentationParameters;
+    SetupSwapChain();
+    *pPresentationParameters = m_pp;
+    m_inScene = false;
+    return S_OK;
+}
+
+HRESULT NullDevice::GetDisplayModeEx(UINT, D3DDISPLAYMODEEX* pMode, D3DDISPLAYROTATION* pRotation)
+{
+    CountCall();
+    if (pMode)
+    {
+        pMode->Width = m_pp.BackBufferWidth;
+        pMode->Height = m_pp.BackBufferHeight;
+        pMode->RefreshRate = 60;
+        pMode->Format = m_pp.BackBufferFormat;
+        pMode->ScanLineOrdering = D3DSCANLINEORDERING_PROGRESSIVE;
+    }
+    if (pRotation)
+    {
+        *pRotation = D3DDISPLAYROTATION_IDENTITY;
+    }
+    return S_OK;
+}
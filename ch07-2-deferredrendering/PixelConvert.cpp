@@ -0,0 +1,603 @@
+﻿#include "PixelConvert.h"
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PIXELCONVERT_SSE2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define PIXELCONVERT_TARGET_F16C
+#else
+#include <cpuid.h>
+#define PIXELCONVERT_TARGET_F16C __attribute__((target("avx,f16c")))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define PIXELCONVERT_NEON
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+uint32_t FloatBits(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+float BitsToFloat(uint32_t bits)
+{
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// 半精度の変換で使うビット表現.
+const uint32_t HalfOverflow = (127 + 16) << 23;         // 65536.0f. これ以上は無限大になる.
+const uint32_t HalfDenormalLimit = (127 - 14) << 23;    // 半精度の正規化数の最小値.
+const uint32_t HalfDenormalMagic = (127 - 1) << 23;     // 0.5f. 加算で仮数部の下位に半精度の非正規化数を作る.
+const uint32_t HalfRebias = 0xC8000FFFu;   // ((15 - 127) << 23) + 0xFFF. 指数部の付け替えと丸めの加算.
+const uint32_t HalfToFloatMagic = (254 - 15) << 23;     // 2^112. 指数部の付け替えを乗算で行う.
+
+uint16_t FloatToHalfScalar(float value)
+{
+    uint32_t f = FloatBits(value);
+    const uint32_t sign = f & 0x80000000u;
+    f ^= sign;
+    uint32_t result;
+    if (f >= HalfOverflow)
+    {
+        result = (f > 0x7F800000u) ? 0x7E00 : 0x7C00;
+    }
+    else if (f < HalfDenormalLimit)
+    {
+        // 浮動小数点数の加算で, 仮数部を偶数丸めしながら桁をそろえる.
+        result = FloatBits(BitsToFloat(f) + BitsToFloat(HalfDenormalMagic)) - HalfDenormalMagic;
+    }
+    else
+    {
+        const uint32_t mantissaOdd = (f >> 13) & 1;
+        result = (f + HalfRebias + mantissaOdd) >> 13;
+    }
+    return uint16_t(result | (sign >> 16));
+}
+
+float HalfToFloatScalar(uint16_t half)
+{
+    const uint32_t expMantissa = half & 0x7FFFu;
+    uint32_t bits = FloatBits(BitsToFloat(expMantissa << 13) * BitsToFloat(HalfToFloatMagic));
+    if (expMantissa > 0x7BFFu)
+    {
+        bits |= 0x7F800000u;
+    }
+    return BitsToFloat(bits | (uint32_t(half & 0x8000u) << 16));
+}
+
+uint8_t FloatToUnorm8Scalar(float value)
+{
+    // NaN は比較が偽になるので 0 になる.
+    const float v = value > 0.0f ? (value < 1.0f ? value : 1.0f) : 0.0f;
+    return uint8_t(int(v * 255.0f + 0.5f));
+}
+
+const float Unorm8Scale = 1.0f / 255.0f;
+
+// sRGB の変換表.
+struct SrgbTables
+{
+    // 最上位 16 ビットが同じ浮動小数点数 ([0, 1)) の最小値を符号化した値.
+    static const uint32_t CoarseShift = 16;
+    static const uint32_t CoarseCount = (0x3F800000u >> CoarseShift) + 1;
+
+    float toLinear[256];
+    // thresholds[k] 以上の線形の値は, 符号化すると k 以上になる.
+    float thresholds[257];
+    uint8_t coarse[CoarseCount];
+
+    SrgbTables()
+    {
+        for (int k = 0; k < 256; ++k)
+        {
+            toLinear[k] = float(DecodeDouble(k / 255.0));
+        }
+        thresholds[0] = 0.0f;
+        for (int k = 1; k < 256; ++k)
+        {
+            // 境界の値以上の最小の float にしておけば, float 同士の比較で正しく丸められる.
+            const double t = DecodeDouble((k - 0.5) / 255.0);
+            float f = float(t);
+            if (double(f) < t)
+            {
+                f = nextafterf(f, 2.0f);
+            }
+            thresholds[k] = f;
+        }
+        thresholds[256] = 2.0f;
+
+        int code = 0;
+        for (uint32_t i = 0; i < CoarseCount; ++i)
+        {
+            const float x = BitsToFloat(i << CoarseShift);
+            while (code < 255 && x >= thresholds[code + 1])
+            {
+                ++code;
+            }
+            coarse[i] = uint8_t(code);
+        }
+    }
+
+    static double DecodeDouble(double c)
+    {
+        return c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4);
+    }
+
+    uint8_t Encode(float x) const
+    {
+        if (!(x > 0.0f))
+        {
+            return 0;
+        }
+        if (x >= 1.0f)
+        {
+            return 255;
+        }
+        // 表で近い値を求め, 境界を越えていれば進める (多くても数回).
+        uint32_t code = coarse[FloatBits(x) >> CoarseShift];
+        while (x >= thresholds[code + 1])
+        {
+            ++code;
+        }
+        return uint8_t(code);
+    }
+};
+
+const SrgbTables& GetSrgbTables()
+{
+    static const SrgbTables tables;
+    return tables;
+}
+
+#ifdef PIXELCONVERT_SSE2
+__m128i Select(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// 4 つの float を半精度へ変換する. 結果は 32 ビットの各要素の下位 16 ビット.
+__m128i FloatToHalfSse2(__m128 value)
+{
+    __m128i f = _mm_castps_si128(value);
+    const __m128i sign = _mm_and_si128(f, _mm_set1_epi32(int(0x80000000u)));
+    f = _mm_xor_si128(f, sign);
+
+    // 符号を除けば整数として比較できる.
+    const __m128i isOverflow = _mm_cmpgt_epi32(f, _mm_set1_epi32(int(HalfOverflow - 1)));
+    const __m128i isNaN = _mm_cmpgt_epi32(f, _mm_set1_epi32(0x7F800000));
+    const __m128i overflow = _mm_or_si128(_mm_set1_epi32(0x7C00), _mm_and_si128(isNaN, _mm_set1_epi32(0x0200)));
+
+    const __m128i isDenormal = _mm_cmplt_epi32(f, _mm_set1_epi32(int(HalfDenormalLimit)));
+    const __m128i magic = _mm_set1_epi32(int(HalfDenormalMagic));
+    const __m128i denormal = _mm_sub_epi32(
+        _mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(f), _mm_castsi128_ps(magic))), magic);
+
+    const __m128i mantissaOdd = _mm_and_si128(_mm_srli_epi32(f, 13), _mm_set1_epi32(1));
+    const __m128i normal = _mm_srli_epi32(
+        _mm_add_epi32(_mm_add_epi32(f, _mm_set1_epi32(int(HalfRebias))), mantissaOdd), 13);
+
+    __m128i result = Select(isDenormal, denormal, normal);
+    result = Select(isOverflow, overflow, result);
+    return _mm_or_si128(result, _mm_srli_epi32(sign, 16));
+}
+
+// 32 ビットの各要素の下位 16 ビットを並べる. _mm_packs_epi32 の飽和を避けるため符号拡張しておく.
+__m128i PackLow16(__m128i lo, __m128i hi)
+{
+    lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+    hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+    return _mm_packs_epi32(lo, hi);
+}
+
+// 32 ビットの各要素の下位 16 ビットの半精度を float へ変換する.
+__m128 HalfToFloatSse2(__m128i half)
+{
+    const __m128i expMantissa = _mm_and_si128(half, _mm_set1_epi32(0x7FFF));
+    const __m128i sign = _mm_slli_epi32(_mm_xor_si128(half, expMantissa), 16);
+    const __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expMantissa, 13)),
+        _mm_castsi128_ps(_mm_set1_epi32(int(HalfToFloatMagic))));
+    const __m128i infNaN = _mm_and_si128(_mm_cmpgt_epi32(expMantissa, _mm_set1_epi32(0x7BFF)),
+        _mm_set1_epi32(0x7F800000));
+    return _mm_castsi128_ps(_mm_or_si128(_mm_or_si128(_mm_castps_si128(scaled), infNaN), sign));
+}
+
+void FloatToHalfSse2(const float* src, uint16_t* dst, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m128i lo = FloatToHalfSse2(_mm_loadu_ps(src + i));
+        const __m128i hi = FloatToHalfSse2(_mm_loadu_ps(src + i + 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), PackLow16(lo, hi));
+    }
+    for (; i < count; ++i)
+    {
+        dst[i] = FloatToHalfScalar(src[i]);
+    }
+}
+
+void HalfToFloatSse2(const uint16_t* src, float* dst, size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m128i half = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_ps(dst + i, HalfToFloatSse2(_mm_unpacklo_epi16(half, zero)));
+        _mm_storeu_ps(dst + i + 4, HalfToFloatSse2(_mm_unpackhi_epi16(half, zero)));
+    }
+    for (; i < count; ++i)
+    {
+        dst[i] = HalfToFloatScalar(src[i]);
+    }
+}
+
+PIXELCONVERT_TARGET_F16C
+void FloatToHalfF16C(const float* src, uint16_t* dst, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m128i lo = _mm_cvtps_ph(_mm_loadu_ps(src + i), 0);
+        const __m128i hi = _mm_cvtps_ph(_mm_loadu_ps(src + i + 4), 0);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_unpacklo_epi64(lo, hi));
+    }
+    for (; i < count; ++i)
+    {
+        dst[i] = FloatToHalfScalar(src[i]);
+    }
+}
+
+PIXELCONVERT_TARGET_F16C
+void HalfToFloatF16C(const uint16_t* src, float* dst, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m128i half = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_ps(dst + i, _mm_cvtph_ps(half));
+        _mm_storeu_ps(dst + i + 4, _mm_cvtph_ps(_mm_unpackhi_epi64(half, half)));
+    }
+    for (; i < count; ++i)
+    {
+        dst[i] = HalfToFloatScalar(src[i]);
+    }
+}
+
+// F16C は VEX 命令なので, OS が AVX のレジスタを保存するかも確かめる.
+bool DetectF16C()
+{
+    unsigned ecx;
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    ecx = unsigned(info[2]);
+#else
+    unsigned eax, ebx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    {
+        return false;
+    }
+#endif
+    const unsigned required = (1u << 27) | (1u << 28) | (1u << 29);     // OSXSAVE, AVX, F16C.
+    if ((ecx & required) != required)
+    {
+        return false;
+    }
+#ifdef _MSC_VER
+    const unsigned long long xcr0 = _xgetbv(0);
+#else
+    unsigned xcr0Low, xcr0High;
+    __asm__("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+    const unsigned long long xcr0 = xcr0Low;
+#endif
+    return (xcr0 & 6) == 6;
+}
+
+bool HasF16C()
+{
+    static const bool hasF16C = DetectF16C();
+    return hasF16C;
+}
+#endif
+}
+
+namespace PixelConvert
+{
+size_t GetBytesPerPixel(Format format)
+{
+    switch (format)
+    {
+    case R8G8B8A8:
+    case B8G8R8A8:
+        return 4;
+    case R16G16B16A16F:
+        return 8;
+    case R32G32B32A32F:
+        return 16;
+    }
+    return 0;
+}
+
+void FloatToHalf(const float* src, uint16_t* dst, size_t count)
+{
+#if defined(PIXELCONVERT_SSE2)
+    if (HasF16C())
+    {
+        FloatToHalfF16C(src, dst, count);
+    }
+    else
+    {
+        FloatToHalfSse2(src, dst, count);
+    }
+#else
+    size_t i = 0;
+#if defined(PIXELCONVERT_NEON)
+    for (; i + 4 <= count; i += 4)
+    {
+        vst1_u16(dst + i, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(src + i))));
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        dst[i] = FloatToHalfScalar(src[i]);
+    }
+#endif
+}
+
+void HalfToFloat(const uint16_t* src, float* dst, size_t count)
+{
+#if defined(PIXELCONVERT_SSE2)
+    if (HasF16C())
+    {
+        HalfToFloatF16C(src, dst, count);
+    }
+    else
+    {
+        HalfToFloatSse2(src, dst, count);
+    }
+#else
+    size_t i = 0;
+#if defined(PIXELCONVERT_NEON)
+    for (; i + 4 <= count; i += 4)
+    {
+        vst1q_f32(dst + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(src + i))));
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        dst[i] = HalfToFloatScalar(src[i]);
+    }
+#endif
+}
+
+void FloatToUnorm8(const float* src, uint8_t* dst, size_t count)
+{
+    size_t i = 0;
+#if defined(PIXELCONVERT_SSE2)
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(255.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i n[4];
+        for (int k = 0; k < 4; ++k)
+        {
+            // _mm_max_ps は NaN のとき 2 番目の引数を返すので, NaN は 0 になる.
+            __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + k * 4), zero), one);
+            n[k] = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scale), half));
+        }
+        const __m128i packed = _mm_packus_epi16(_mm_packs_epi32(n[0], n[1]), _mm_packs_epi32(n[2], n[3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), packed);
+    }
+#elif defined(PIXELCONVERT_NEON)
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    for (; i + 8 <= count; i += 8)
+    {
+        // vmaxnmq_f32 は NaN と数値なら数値を返すので, NaN は 0 になる.
+        float32x4_t lo = vminq_f32(vmaxnmq_f32(vld1q_f32(src + i), zero), one);
+        float32x4_t hi = vminq_f32(vmaxnmq_f32(vld1q_f32(src + i + 4), zero), one);
+        lo = vaddq_f32(vmulq_n_f32(lo, 255.0f), vdupq_n_f32(0.5f));
+        hi = vaddq_f32(vmulq_n_f32(hi, 255.0f), vdupq_n_f32(0.5f));
+        const uint16x8_t n = vcombine_u16(vmovn_u32(vcvtq_u32_f32(lo)), vmovn_u32(vcvtq_u32_f32(hi)));
+        vst1_u8(dst + i, vmovn_u16(n));
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        dst[i] = FloatToUnorm8Scalar(src[i]);
+    }
+}
+
+void Unorm8ToFloat(const uint8_t* src, float* dst, size_t count)
+{
+    size_t i = 0;
+#if defined(PIXELCONVERT_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 scale = _mm_set1_ps(Unorm8Scale);
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        const __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+        const __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale));
+        _mm_storeu_ps(dst + i + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale));
+        _mm_storeu_ps(dst + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale));
+    }
+#elif defined(PIXELCONVERT_NEON)
+    for (; i + 8 <= count; i += 8)
+    {
+        const uint16x8_t n = vmovl_u8(vld1_u8(src + i));
+        vst1q_f32(dst + i, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(n))), Unorm8Scale));
+        vst1q_f32(dst + i + 4, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(n))), Unorm8Scale));
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        dst[i] = src[i] * Unorm8Scale;
+    }
+}
+
+void SwapRedBlue(const uint8_t* src, uint8_t* dst, size_t pixelCount)
+{
+    size_t i = 0;
+#if defined(PIXELCONVERT_SSE2)
+    const __m128i alphaGreen = _mm_set1_epi32(int(0xFF00FF00u));
+    for (; i + 4 <= pixelCount; i += 4)
+    {
+        const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        const __m128i redBlue = _mm_andnot_si128(alphaGreen, p);
+        const __m128i swapped = _mm_or_si128(_mm_slli_epi32(redBlue, 16), _mm_srli_epi32(redBlue, 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_or_si128(_mm_and_si128(p, alphaGreen), swapped));
+    }
+#elif defined(PIXELCONVERT_NEON)
+    for (; i + 16 <= pixelCount; i += 16)
+    {
+        uint8x16x4_t p = vld4q_u8(src + i * 4);
+        const uint8x16_t red = p.val[0];
+        p.val[0] = p.val[2];
+        p.val[2] = red;
+        vst4q_u8(dst + i * 4, p);
+    }
+#endif
+    for (; i < pixelCount; ++i)
+    {
+        const uint8_t red = src[i * 4 + 0];
+        dst[i * 4 + 0] = src[i * 4 + 2];
+        dst[i * 4 + 1] = src[i * 4 + 1];
+        dst[i * 4 + 2] = red;
+        dst[i * 4 + 3] = src[i * 4 + 3];
+    }
+}
+
+void EncodeSrgb(const float* src, uint8_t* dst, size_t pixelCount)
+{
+    const SrgbTables& tables = GetSrgbTables();
+    for (size_t i = 0; i < pixelCount; ++i)
+    {
+        dst[i * 4 + 0] = tables.Encode(src[i * 4 + 0]);
+        dst[i * 4 + 1] = tables.Encode(src[i * 4 + 1]);
+        dst[i * 4 + 2] = tables.Encode(src[i * 4 + 2]);
+        dst[i * 4 + 3] = FloatToUnorm8Scalar(src[i * 4 + 3]);
+    }
+}
+
+void DecodeSrgb(const uint8_t* src, float* dst, size_t pixelCount)
+{
+    const SrgbTables& tables = GetSrgbTables();
+    for (size_t i = 0; i < pixelCount; ++i)
+    {
+        dst[i * 4 + 0] = tables.toLinear[src[i * 4 + 0]];
+        dst[i * 4 + 1] = tables.toLinear[src[i * 4 + 1]];
+        dst[i * 4 + 2] = tables.toLinear[src[i * 4 + 2]];
+        dst[i * 4 + 3] = src[i * 4 + 3] * Unorm8Scale;
+    }
+}
+
+void ConvertImage(const void* src, size_t srcPitch, Format srcFormat,
+    void* dst, size_t dstPitch, Format dstFormat, int width, int height, int flags)
+{
+    const bool srcIs8Bit = srcFormat == R8G8B8A8 || srcFormat == B8G8R8A8;
+    const bool dstIs8Bit = dstFormat == R8G8B8A8 || dstFormat == B8G8R8A8;
+    const size_t count = size_t(width) * 4;
+    // 8 ビットと浮動小数点数の間の変換は, RGBA の 8 ビットと float の 1 行を経由する.
+    std::vector<uint8_t> bytes;
+    std::vector<float> floats;
+    for (int y = 0; y < height; ++y)
+    {
+        const uint8_t* srcRow = static_cast<const uint8_t*>(src) + y * srcPitch;
+        uint8_t* dstRow = static_cast<uint8_t*>(dst) + y * dstPitch;
+        if (srcFormat == dstFormat)
+        {
+            memcpy(dstRow, srcRow, width * GetBytesPerPixel(srcFormat));
+            continue;
+        }
+        if (srcIs8Bit && dstIs8Bit)
+        {
+            SwapRedBlue(srcRow, dstRow, width);
+            continue;
+        }
+        if (srcFormat == R16G16B16A16F && dstFormat == R32G32B32A32F)
+        {
+            HalfToFloat(reinterpret_cast<const uint16_t*>(srcRow), reinterpret_cast<float*>(dstRow), count);
+            continue;
+        }
+
+        const float* row = reinterpret_cast<const float*>(srcRow);
+        if (srcFormat == R16G16B16A16F)
+        {
+            floats.resize(count);
+            HalfToFloat(reinterpret_cast<const uint16_t*>(srcRow), floats.data(), count);
+            row = floats.data();
+        }
+        else if (srcIs8Bit)
+        {
+            if (srcFormat == B8G8R8A8)
+            {
+                bytes.resize(count);
+                SwapRedBlue(srcRow, bytes.data(), width);
+                srcRow = bytes.data();
+            }
+            floats.resize(count);
+            if (flags & Srgb)
+            {
+                DecodeSrgb(srcRow, floats.data(), width);
+            }
+            else
+            {
+                Unorm8ToFloat(srcRow, floats.data(), count);
+            }
+            row = floats.data();
+        }
+
+        switch (dstFormat)
+        {
+        case R8G8B8A8:
+        case B8G8R8A8:
+            if (flags & Srgb)
+            {
+                EncodeSrgb(row, dstRow, width);
+            }
+            else
+            {
+                FloatToUnorm8(row, dstRow, count);
+            }
+            if (dstFormat == B8G8R8A8)
+            {
+                SwapRedBlue(dstRow, dstRow, width);
+            }
+            break;
+        case R16G16B16A16F:
+            FloatToHalf(row, reinterpret_cast<uint16_t*>(dstRow), count);
+            break;
+        case R32G32B32A32F:
+            memcpy(dstRow, row, count * sizeof(float));
+            break;
+        }
+    }
+}
+
+const char* GetHalfImplementation()
+{
+#if defined(PIXELCONVERT_SSE2)
+    return HasF16C() ? "F16C" : "SSE2";
+#elif defined(PIXELCONVERT_NEON)
+    return "NEON";
+#else
+    return "C++";
+#endif
+}
+}
@@ -0,0 +1,52 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// CPU でのピクセル形式の変換. D3D には依存しません.
+// レンダーターゲットの読み戻しや画面の保存, CPU で描画する処理で使います.
+//
+// x86 では SSE2 を使い, 半精度浮動小数点数の変換は F16C があれば実行時に切り替えます.
+// ARM64 では NEON を使います. それ以外では同じ結果になる C++ の処理を使います.
+// 半精度への変換は最も近い値への丸め (偶数丸め) で, 非正規化数, 無限大, NaN も扱います.
+namespace PixelConvert
+{
+    // メモリ上の並び順で表した形式. 括弧内は対応する D3DFORMAT.
+    enum Format
+    {
+        R8G8B8A8,           // stb_image の出力 (D3DFMT_A8B8G8R8).
+        B8G8R8A8,           // D3DFMT_A8R8G8B8.
+        R16G16B16A16F,      // D3DFMT_A16B16G16R16F.
+        R32G32B32A32F,      // D3DFMT_A32B32G32R32F.
+    };
+
+    // ConvertImage() の flags.
+    enum Flags
+    {
+        // 8 ビットの形式を sRGB として扱い, 浮動小数点数との変換で sRGB の符号化/復号を行います.
+        // アルファは変換しません.
+        Srgb = 1 << 0,
+    };
+
+    size_t GetBytesPerPixel(Format format);
+
+    // 要素単位の変換. count は要素 (チャンネル) の数です.
+    void FloatToHalf(const float* src, uint16_t* dst, size_t count);
+    void HalfToFloat(const uint16_t* src, float* dst, size_t count);
+    // [0, 1] に収めて 255 倍し, 四捨五入します. NaN は 0 になります.
+    void FloatToUnorm8(const float* src, uint8_t* dst, size_t count);
+    void Unorm8ToFloat(const uint8_t* src, float* dst, size_t count);
+
+    // ピクセル単位の変換. pixelCount はピクセルの数です.
+    // RGBA と BGRA の入れ替え. src と dst は同じでも構いません.
+    void SwapRedBlue(const uint8_t* src, uint8_t* dst, size_t pixelCount);
+    // RGBA の浮動小数点数 (線形) と 8 ビットの sRGB の変換. アルファは線形のまま変換します.
+    void EncodeSrgb(const float* src, uint8_t* dst, size_t pixelCount);
+    void DecodeSrgb(const uint8_t* src, float* dst, size_t pixelCount);
+
+    // 行ピッチ (バイト数) を指定した画像の変換. 同じ形式ならそのままコピーします.
+    void ConvertImage(const void* src, size_t srcPitch, Format srcFormat,
+        void* dst, size_t dstPitch, Format dstFormat, int width, int height, int flags = 0);
+
+    // 実行時に選ばれた半精度の変換の実装 ("F16C", "SSE2", "NEON", "C++").
+    const char* GetHalfImplementation();
+}
@@ -0,0 +1,33 @@
+﻿#include "RenderTarget.h"
+
+RenderTarget::RenderTarget(IDirect3DDevice9Ex* d3dDev, IDirect3DTexture9* texture)
+    : m_texture(texture), m_surface(nullptr), m_d3dDev(d3dDev)
+{
+    if (m_d3dDev)
+    {
+        m_d3dDev->AddRef();
+    }
+    if (m_texture)
+    {
+        m_texture->AddRef();
+        m_texture->GetSurfaceLevel(0, &m_surface);
+    }
+}
+RenderTarget::~RenderTarget()
+{
+    if (m_d3dDev)
+    {
+        m_d3dDev->Release();
+    }
+    if (m_surface)
+    {
+        m_surface->Release();
+    }
+    if (m_texture)
+    {
+        m_texture->Release();
+    }
+    m_d3dDev = nullptr;
+    m_texture = nullptr;
+    m_surface = nullptr;
+}
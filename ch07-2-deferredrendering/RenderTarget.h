@@ -0,0 +1,18 @@
+﻿#pragma once
+#include <d3d9.h>
+
+// 描画先として使うテクスチャとそのサーフェイスをまとめたクラス.
+class RenderTarget
+{
+public:
+    RenderTarget(IDirect3DDevice9Ex* d3dDev, IDirect3DTexture9* texture);
+    ~RenderTarget();
+
+    IDirect3DSurface9* GetTargetSurface() { return m_surface; }
+    IDirect3DTexture9* GetTexture() { return m_texture; }
+
+private:
+    IDirect3DTexture9 * m_texture;
+    IDirect3DSurface9 * m_surface;
+    IDirect3DDevice9Ex* m_d3dDev;
+};
@@ -0,0 +1,123 @@
+﻿#include "RenderTargetPool.h"
+#include <cstdio>
+
+RenderTargetPool::RenderTargetPool(RenderTargetAllocator* allocator)
+    : m_allocator(allocator), m_frame(0)
+{
+    m_stats = Stats();
+}
+
+RenderTargetPool::~RenderTargetPool()
+{
+    Clear();
+}
+
+bool RenderTargetPool::IsSameDesc(const RenderTargetDesc& a, const RenderTargetDesc& b)
+{
+    return a.width == b.width && a.height == b.height &&
+        a.format == b.format && a.usage == b.usage;
+}
+
+RenderTarget* RenderTargetPool::Acquire(const RenderTargetDesc& desc)
+{
+    // 返却済みのターゲットから探す.
+    for (auto& entry : m_entries)
+    {
+        if (!entry.inUse && IsSameDesc(entry.desc, desc))
+        {
+            entry.inUse = true;
+            entry.lastUsedFrame = m_frame;
+            m_stats.reuseCount++;
+            m_stats.inUseBytes += entry.size;
+            if (m_stats.peakInUseBytes < m_stats.inUseBytes)
+                m_stats.peakInUseBytes = m_stats.inUseBytes;
+            return entry.target;
+        }
+    }
+
+    // 見つからなければ新規に作成.
+    RenderTarget* target = m_allocator->Create(desc);
+    if (!target)
+    {
+        return nullptr;
+    }
+    Entry entry;
+    entry.desc = desc;
+    entry.target = target;
+    entry.size = m_allocator->EstimateSize(desc);
+    entry.lastUsedFrame = m_frame;
+    entry.inUse = true;
+    m_entries.push_back(entry);
+
+    m_stats.createCount++;
+    m_stats.targetCount = uint32_t(m_entries.size());
+    if (m_stats.peakTargetCount < m_stats.targetCount)
+        m_stats.peakTargetCount = m_stats.targetCount;
+    m_stats.allocatedBytes += entry.size;
+    m_stats.inUseBytes += entry.size;
+    if (m_stats.peakAllocatedBytes < m_stats.allocatedBytes)
+        m_stats.peakAllocatedBytes = m_stats.allocatedBytes;
+    if (m_stats.peakInUseBytes < m_stats.inUseBytes)
+        m_stats.peakInUseBytes = m_stats.inUseBytes;
+    return target;
+}
+
+void RenderTargetPool::Release(RenderTarget* target)
+{
+    for (auto& entry : m_entries)
+    {
+        if (entry.target == target && entry.inUse)
+        {
+            entry.inUse = false;
+            entry.lastUsedFrame = m_frame;
+            m_stats.inUseBytes -= entry.size;
+            return;
+        }
+    }
+}
+
+void RenderTargetPool::EndFrame()
+{
+    // しばらく使われていないターゲットを破棄する.
+    for (size_t i = 0; i < m_entries.size(); )
+    {
+        Entry& entry = m_entries[i];
+        if (!entry.inUse && m_frame - entry.lastUsedFrame > MaxUnusedFrames)
+        {
+            m_stats.allocatedBytes -= entry.size;
+            m_allocator->Destroy(entry.target);
+            m_entries[i] = m_entries.back();
+            m_entries.pop_back();
+            continue;
+        }
+        ++i;
+    }
+    m_stats.targetCount = uint32_t(m_entries.size());
+    m_frame++;
+}
+
+void RenderTargetPool::Clear()
+{
+    for (auto& entry : m_entries)
+    {
+        m_allocator->Destroy(entry.target);
+    }
+    m_entries.clear();
+    m_stats.targetCount = 0;
+    m_stats.allocatedBytes = 0;
+    m_stats.inUseBytes = 0;
+}
+
+std::string RenderTargetPool::Report() const
+{
+    char buf[256];
+    snprintf(buf, sizeof(buf),
+        "RenderTargetPool: targets=%u (peak %u) created=%u reused=%u "
+        "allocated=%.2fMB (peak %.2fMB) inUse=%.2fMB (peak %.2fMB)\n",
+        m_stats.targetCount, m_stats.peakTargetCount, m_stats.createCount, m_stats.reuseCount,
+        m_stats.allocatedBytes / (1024.0 * 1024.0),
+        m_stats.peakAllocatedBytes / (1024.0 * 1024.0),
+        m_stats.inUseBytes / (1024.0 * 1024.0),
+        m_stats.peakInUseBytes / (1024.0 * 1024.0));
+    return buf;
+}
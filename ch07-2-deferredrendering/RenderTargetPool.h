@@ -0,0 +1,81 @@
+﻿#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class RenderTarget;
+
+// レンダーターゲットの作成パラメータ. プールの検索キーになります.
+// プールは D3D に依存しないので, フォーマットと用途は D3DFORMAT と D3DUSAGE_* の値をそのまま持ちます.
+struct RenderTargetDesc
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;
+    uint32_t usage;
+};
+
+// プールが実際のレンダーターゲットを作成・破棄するためのインタフェース.
+// D3D デバイスで作成する実装は DeviceRenderTargetAllocator です.
+class RenderTargetAllocator
+{
+public:
+    virtual ~RenderTargetAllocator() {}
+    virtual RenderTarget* Create(const RenderTargetDesc& desc) = 0;
+    virtual void Destroy(RenderTarget* target) = 0;
+    // フォーマットからおおよそのメモリ量を求めます.
+    virtual uint64_t EstimateSize(const RenderTargetDesc& desc) const = 0;
+};
+
+// フレーム内で一時的に使うレンダーターゲットを貸し出すプール.
+// Release されたターゲットは同じ (幅, 高さ, フォーマット, 用途) の要求に再利用されるため,
+// 使用期間が重ならないパス同士は同じメモリを共有します.
+// 一定フレーム使われなかったターゲットは EndFrame で破棄します.
+class RenderTargetPool
+{
+public:
+    // 未使用のまま保持しておくフレーム数.
+    static const uint32_t MaxUnusedFrames = 60;
+
+    explicit RenderTargetPool(RenderTargetAllocator* allocator);
+    ~RenderTargetPool();
+
+    // 条件に合うターゲットを貸し出す. 作成に失敗した場合は nullptr を返します.
+    RenderTarget* Acquire(const RenderTargetDesc& desc);
+    // 貸し出したターゲットを返却します.
+    void Release(RenderTarget* target);
+
+    void EndFrame();
+    // 全てのターゲットを破棄します.
+    void Clear();
+
+    struct Stats
+    {
+        uint32_t targetCount;     // 保持しているターゲット数.
+        uint32_t peakTargetCount; // 同時に保持したターゲット数の最大.
+        uint32_t createCount;     // 作成した回数.
+        uint32_t reuseCount;      // 再利用で済んだ回数.
+        uint64_t allocatedBytes;  // 保持しているメモリ量(推定).
+        uint64_t inUseBytes;      // 貸し出し中のメモリ量(推定).
+        uint64_t peakAllocatedBytes;
+        uint64_t peakInUseBytes;
+    };
+    const Stats& GetStats() const { return m_stats; }
+    std::string Report() const;
+
+private:
+    struct Entry
+    {
+        RenderTargetDesc desc;
+        RenderTarget* target;
+        uint64_t size;
+        uint32_t lastUsedFrame;
+        bool inUse;
+    };
+    static bool IsSameDesc(const RenderTargetDesc& a, const RenderTargetDesc& b);
+
+    RenderTargetAllocator* m_allocator;
+    std::vector<Entry> m_entries;
+    uint32_t m_frame;
+    Stats m_stats;
+};
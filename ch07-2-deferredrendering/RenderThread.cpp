@@ -0,0 +1,107 @@
+﻿#include "RenderThread.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+RenderThread::RenderThread(int queueCapacity)
+    : m_client(nullptr), m_queue(queueCapacity), m_quit(false), m_frameCount(0), m_dropped(0)
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+RenderThread::~RenderThread()
+{
+    Stop();
+}
+
+void RenderThread::Start(Client* client)
+{
+    if (IsRunning())
+    {
+        return;
+    }
+    m_client = client;
+    m_quit.store(false);
+    m_thread = std::thread(&RenderThread::ThreadMain, this);
+}
+
+void RenderThread::Stop()
+{
+    if (!IsRunning())
+    {
+        return;
+    }
+    m_quit.store(true);
+    m_thread.join();
+    m_client = nullptr;
+}
+
+bool RenderThread::Post(const RenderEvent& event)
+{
+    QueuedEvent queued;
+    queued.event = event;
+    queued.postTime = std::chrono::steady_clock::now();
+    if (!m_queue.TryPush(queued))
+    {
+        m_dropped++;
+        return false;
+    }
+    return true;
+}
+
+RenderThread::Stats RenderThread::GetStats() const
+{
+    Stats stats = m_stats;
+    stats.frames = GetFrameCount();
+    stats.dropped = m_dropped;
+    return stats;
+}
+
+std::string RenderThread::Report() const
+{
+    const Stats stats = GetStats();
+    char buf[256];
+    snprintf(buf, sizeof(buf),
+        "Render thread: %llu frames, %llu events (%llu dropped), event latency avg %.3f ms, max %.3f ms, input to present avg %.3f ms, max %.3f ms\n",
+        (unsigned long long)stats.frames, (unsigned long long)stats.events, (unsigned long long)stats.dropped,
+        stats.events > 0 ? stats.totalEventMsec / stats.events : 0.0, stats.maxEventMsec,
+        stats.events > 0 ? stats.totalPresentMsec / stats.events : 0.0, stats.maxPresentMsec);
+    return buf;
+}
+
+void RenderThread::ThreadMain()
+{
+    std::vector<std::chrono::steady_clock::time_point> postTimes;
+    while (!m_quit.load())
+    {
+        m_client->WaitForFrame();
+
+        // フレームの途中で届いたイベントは次のフレームで処理する.
+        postTimes.clear();
+        QueuedEvent queued;
+        while (m_queue.TryPop(queued))
+        {
+            const auto now = std::chrono::steady_clock::now();
+            const double msec = std::chrono::duration<double, std::milli>(now - queued.postTime).count();
+            m_stats.events++;
+            m_stats.totalEventMsec += msec;
+            m_stats.maxEventMsec = std::max(m_stats.maxEventMsec, msec);
+            postTimes.push_back(queued.postTime);
+            m_client->HandleEvent(queued.event);
+        }
+
+        m_client->RenderFrame();
+        m_frameCount.fetch_add(1, std::memory_order_relaxed);
+
+        // このフレームで処理したイベントが Present に渡るまでの時間.
+        const auto presented = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < postTimes.size(); ++i)
+        {
+            const double msec = std::chrono::duration<double, std::milli>(presented - postTimes[i]).count();
+            m_stats.totalPresentMsec += msec;
+            m_stats.maxPresentMsec = std::max(m_stats.maxPresentMsec, msec);
+        }
+    }
+}
@@ -0,0 +1,101 @@
+﻿#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "SpscQueue.h"
+
+// 入力やウィンドウのイベント. key はプラットフォームのキーコード (Windows なら仮想キーコード) です.
+struct RenderEvent
+{
+    enum Type
+    {
+        KeyDown,
+        KeyUp,
+    };
+    enum Modifier
+    {
+        Shift = 1 << 0,
+        Control = 1 << 1,
+        Alt = 1 << 2,
+    };
+
+    Type type;
+    uint32_t key;
+    uint32_t modifiers;     // Modifier の組み合わせ.
+};
+
+// 描画ループを専用のスレッドで回すクラス. D3D と Win32 には依存しません.
+//
+// メッセージを処理するスレッドは Post() でイベントを渡し, 描画スレッドはフレームの始めに
+// 届いたイベントを全て Client::HandleEvent() に渡してから Client::RenderFrame() を呼びます.
+// イベントはロックを使わないキュー (SpscQueue) で渡すので, Post() を呼べるのは 1 つのスレッドだけです.
+// ウィンドウのドラッグなどでメッセージの処理が止まっても, 描画は止まりません.
+//
+// Client のデバイスの作成と破棄は, Start() の前と Stop() の後に呼び出し側のスレッドで行ってください.
+// (D3D9 はウィンドウのスレッドにメッセージを送ることがあり, そのスレッドで待つと止まるため)
+class RenderThread
+{
+public:
+    class Client
+    {
+    public:
+        virtual ~Client() {}
+        // 以下は描画スレッドから呼ばれます.
+        // イベントを読む前に呼ばれます. 入力を読むのを遅らせたい場合は, ここで待ちます.
+        virtual void WaitForFrame() {}
+        virtual void HandleEvent(const RenderEvent& event) = 0;
+        virtual void RenderFrame() = 0;
+    };
+
+    struct Stats
+    {
+        uint64_t frames;
+        uint64_t events;
+        uint64_t dropped;       // キューが一杯で捨てたイベント.
+        double maxEventMsec;    // Post() から HandleEvent() までの最大の時間.
+        double totalEventMsec;
+        double maxPresentMsec;  // Post() からそのイベントを処理したフレームの RenderFrame() (Present を含む) が戻るまでの最大の時間.
+        double totalPresentMsec;
+    };
+
+    explicit RenderThread(int queueCapacity);
+    // 動いていれば Stop() します.
+    ~RenderThread();
+
+    void Start(Client* client);
+    // 今のフレームを描き終えたらスレッドを終了し, それを待ちます. 何度呼んでも構いません.
+    void Stop();
+    bool IsRunning() const { return m_thread.joinable(); }
+
+    // キューが一杯なら捨てて false を返します.
+    bool Post(const RenderEvent& event);
+
+    // 描画したフレームの数. どのスレッドから呼んでも構いません.
+    uint64_t GetFrameCount() const { return m_frameCount.load(std::memory_order_relaxed); }
+    // Stop() の後に呼び出してください.
+    Stats GetStats() const;
+    std::string Report() const;
+
+private:
+    RenderThread(const RenderThread&);
+    RenderThread& operator=(const RenderThread&);
+
+    struct QueuedEvent
+    {
+        RenderEvent event;
+        std::chrono::steady_clock::time_point postTime;
+    };
+
+    void ThreadMain();
+
+    Client* m_client;
+    SpscQueue<QueuedEvent> m_queue;
+    std::thread m_thread;
+    std::atomic<bool> m_quit;
+    std::atomic<uint64_t> m_frameCount;
+    uint64_t m_dropped;     // Post() を呼ぶスレッドだけが書き換える.
+    Stats m_stats;          // 描画スレッドだけが書き換える.
+};
@@ -0,0 +1,95 @@
+﻿#include "ResolutionController.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+ResolutionController::ResolutionController()
+    : m_scale(1.0), m_logArea(0.0), m_error1(0.0), m_error2(0.0), m_updateCount(0)
+{
+    Configure(GetDefaultSettings(1.0 / 60.0));
+}
+
+ResolutionController::Settings ResolutionController::GetDefaultSettings(double budgetSec)
+{
+    Settings settings;
+    settings.budgetSec = budgetSec;
+    settings.headroom = 0.1;
+    settings.minScale = 0.5;
+    settings.maxScale = 1.0;
+    settings.kp = 0.1;
+    settings.ki = 0.3;
+    settings.kd = 0.02;
+    return settings;
+}
+
+void ResolutionController::Configure(const Settings& settings)
+{
+    m_settings = settings;
+    m_scale = settings.maxScale;
+    m_logArea = 2.0 * log(m_scale);
+    m_error1 = 0.0;
+    m_error2 = 0.0;
+    m_updateCount = 0;
+    memset(&m_stats, 0, sizeof(m_stats));
+    m_stats.lowestScale = m_scale;
+}
+
+double ResolutionController::Update(double frameSec, double frameScale)
+{
+    m_stats.frames++;
+    m_stats.scaleSum += frameScale;
+    m_stats.lowestScale = std::min(m_stats.lowestScale, frameScale);
+    m_stats.maxFrameSec = std::max(m_stats.maxFrameSec, frameSec);
+    if (frameSec > m_settings.budgetSec)
+    {
+        m_stats.overBudget++;
+    }
+    if (frameSec <= 0.0 || frameScale <= 0.0)
+    {
+        return m_scale;
+    }
+
+    // 計測したフレームと今の倍率の画素数の比で, 今の倍率で描いた場合の時間を予測する.
+    const double predictedLog = log(frameSec) + (m_logArea - 2.0 * log(frameScale));
+    const double error = log(m_settings.budgetSec * (1.0 - m_settings.headroom)) - predictedLog;
+    if (m_updateCount == 0)
+    {
+        m_error1 = error;
+        m_error2 = error;
+    }
+    else if (m_updateCount == 1)
+    {
+        m_error2 = m_error1;
+    }
+    m_updateCount = std::min(m_updateCount + 1, 2);
+
+    m_logArea += m_settings.kp * (error - m_error1)
+        + m_settings.ki * error
+        + m_settings.kd * (error - 2.0 * m_error1 + m_error2);
+    m_logArea = std::min(std::max(m_logArea, 2.0 * log(m_settings.minScale)), 2.0 * log(m_settings.maxScale));
+    m_error2 = m_error1;
+    m_error1 = error;
+
+    m_scale = exp(m_logArea * 0.5);
+    return m_scale;
+}
+
+void ResolutionController::GetScaledSize(int width, int height, double scale, int align, int& scaledWidth, int& scaledHeight)
+{
+    // 元の大きさを超えず, 1 単位より小さくならないように丸める.
+    scaledWidth = std::min(std::max(int(floor(width * scale / align + 0.5)) * align, align), width);
+    scaledHeight = std::min(std::max(int(floor(height * scale / align + 0.5)) * align, align), height);
+}
+
+std::string ResolutionController::Report() const
+{
+    char buf[256];
+    snprintf(buf, sizeof(buf),
+        "Dynamic resolution (budget %.3f ms): %llu frames, scale avg %.3f (lowest %.3f), %llu over budget, max %.3f ms\n",
+        m_settings.budgetSec * 1000.0, (unsigned long long)m_stats.frames,
+        m_stats.frames > 0 ? m_stats.scaleSum / m_stats.frames : m_scale, m_stats.lowestScale,
+        (unsigned long long)m_stats.overBudget, m_stats.maxFrameSec * 1000.0);
+    return buf;
+}
@@ -0,0 +1,62 @@
+﻿#pragma once
+#include <cstdint>
+#include <string>
+
+// 計測したフレーム時間が予算に収まるよう, 描画解像度の倍率を決めるクラス. D3D には依存しません.
+//
+// 描画の負荷は画素数 (倍率の 2 乗) にほぼ比例するので, 画素数の対数を PID の速度形で操作します.
+//   e = log(目標 / 予測したフレーム時間)     目標 = 予算 * (1 - headroom)
+//   log(画素数) += kp * (e - e1) + ki * e + kd * (e - 2 * e1 + e2)
+// GPU の計測結果は数フレーム遅れて届くため, Update() にはそのフレームを描いた倍率も渡します.
+// 計測した時間を今の倍率での時間に換算してから誤差を求めるので, 遅れがあっても振動しにくくなります.
+// 倍率を範囲に制限しても積分が溜まらないのは速度形のためです.
+class ResolutionController
+{
+public:
+    struct Settings
+    {
+        double budgetSec;   // フレーム時間の予算 (秒).
+        double headroom;    // 計測の揺れで予算を超えないよう, 予算からこの割合を引いた時間を目標にする.
+        double minScale;    // 一辺の倍率の範囲.
+        double maxScale;
+        double kp;
+        double ki;
+        double kd;
+    };
+
+    struct Stats
+    {
+        uint64_t frames;        // Update() の回数.
+        uint64_t overBudget;    // 予算を超えたフレーム.
+        double scaleSum;
+        double lowestScale;
+        double maxFrameSec;
+    };
+
+    ResolutionController();
+
+    // budgetSec に対して, 倍率 0.5 から 1.0 までを適度な速さで追う設定.
+    static Settings GetDefaultSettings(double budgetSec);
+    // 倍率を maxScale に戻します.
+    void Configure(const Settings& settings);
+
+    // frameSec は倍率 frameScale で描いたフレームの時間です. 次のフレームの倍率を返します.
+    double Update(double frameSec, double frameScale);
+    double GetScale() const { return m_scale; }
+
+    // 倍率を掛けた描画範囲. 大きさがフレームごとに揺れないよう align 画素単位に丸めます.
+    static void GetScaledSize(int width, int height, double scale, int align, int& scaledWidth, int& scaledHeight);
+
+    const Settings& GetSettings() const { return m_settings; }
+    const Stats& GetStats() const { return m_stats; }
+    std::string Report() const;
+
+private:
+    Settings m_settings;
+    double m_scale;
+    double m_logArea;   // log(scale * scale).
+    double m_error1;    // 1 つ前と 2 つ前の誤差.
+    double m_error2;
+    int m_updateCount;
+    Stats m_stats;
+};
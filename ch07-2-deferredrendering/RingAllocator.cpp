@@ -0,0 +1,147 @@
+﻿#include "RingAllocator.h"
+
+namespace
+{
+uint32_t AlignUp(uint32_t value, uint32_t alignment)
+{
+    if (alignment <= 1)
+    {
+        return value;
+    }
+    return ((value + alignment - 1) / alignment) * alignment;
+}
+}
+
+RingAllocator::RingAllocator()
+    : m_capacity(0), m_head(0), m_tail(0), m_dirty(false),
+    m_pendingHead(0), m_pendingCount(0)
+{
+    for (int i = 0; i < MaxFramesInFlight; ++i)
+    {
+        m_frameEnd[i] = 0;
+    }
+    ResetStats();
+}
+
+void RingAllocator::Reset(uint32_t capacity)
+{
+    m_capacity = capacity;
+    m_head = 0;
+    m_tail = 0;
+    m_dirty = false;
+    m_pendingHead = 0;
+    m_pendingCount = 0;
+}
+
+void RingAllocator::ResetStats()
+{
+    m_stats.allocations = 0;
+    m_stats.wraps = 0;
+    m_stats.discards = 0;
+    m_stats.bytes = 0;
+}
+
+uint32_t RingAllocator::Allocate(uint32_t size, uint32_t alignment, bool* discard)
+{
+    *discard = false;
+    if (size == 0 || size > m_capacity)
+    {
+        return InvalidOffset;
+    }
+
+    // GPU が全て使い終わっていれば先頭から使い直す.
+    if (m_pendingCount == 0 && !m_dirty)
+    {
+        m_head = 0;
+        m_tail = 0;
+    }
+
+    uint32_t offset = AlignUp(m_head, alignment);
+    bool found = false;
+    if (m_head >= m_tail)
+    {
+        // [head, capacity) の空きを確認.
+        if (uint64_t(offset) + size <= m_capacity)
+        {
+            found = true;
+        }
+        // 先頭へ折り返して [0, tail) の空きを確認.
+        // head == tail が「空」を意味するよう, tail へは到達させない.
+        else if (size < m_tail)
+        {
+            offset = 0;
+            found = true;
+            m_stats.wraps++;
+        }
+    }
+    else
+    {
+        // 折り返し済み. [head, tail) の空きを確認.
+        if (uint64_t(offset) + size < m_tail)
+        {
+            found = true;
+        }
+    }
+
+    if (!found)
+    {
+        // GPU 参照中の領域しか残っていない.
+        // DISCARD でバッファをリネームさせるので, 追跡中のフレームは全て破棄できる.
+        offset = 0;
+        m_tail = 0;
+        m_pendingHead = 0;
+        m_pendingCount = 0;
+        *discard = true;
+        m_stats.discards++;
+    }
+
+    m_head = offset + size;
+    m_dirty = true;
+    m_stats.allocations++;
+    m_stats.bytes += size;
+    return offset;
+}
+
+int RingAllocator::EndFrame()
+{
+    if (!m_dirty)
+    {
+        return -1;
+    }
+    m_dirty = false;
+
+    int slot;
+    if (m_pendingCount < MaxFramesInFlight)
+    {
+        slot = (m_pendingHead + m_pendingCount) % MaxFramesInFlight;
+        m_pendingCount++;
+    }
+    else
+    {
+        // 追跡しきれないので最新のフレームへ統合する.
+        // (より後のフェンスを待つことになるので安全側)
+        slot = (m_pendingHead + m_pendingCount - 1) % MaxFramesInFlight;
+    }
+    m_frameEnd[slot] = m_head;
+    return slot;
+}
+
+void RingAllocator::RetireOldest()
+{
+    if (m_pendingCount == 0)
+    {
+        return;
+    }
+    m_tail = m_frameEnd[m_pendingHead];
+    m_pendingHead = (m_pendingHead + 1) % MaxFramesInFlight;
+    m_pendingCount--;
+}
+
+uint32_t RingAllocator::GetUsedBytes() const
+{
+    if (m_head >= m_tail)
+    {
+        return m_head - m_tail;
+    }
+    return m_capacity - m_tail + m_head;
+}
@@ -0,0 +1,66 @@
+﻿#pragma once
+#include <cstdint>
+
+// リングバッファの確保位置を管理するクラス.
+// D3D に依存しない確保ロジックのみを持ち, GPU の完了待ち(フェンス)は
+// 呼び出し側がスロット単位で通知します.
+//
+// 使用中の領域は [tail, head) を循環的に表します.
+// フレーム終了時に head をフェンスとして記録し,
+// そのフェンスの完了通知で tail を進めます.
+class RingAllocator
+{
+public:
+    // 同時に追跡できるフレーム(フェンス)の数.
+    static const int MaxFramesInFlight = 4;
+    static const uint32_t InvalidOffset = 0xFFFFFFFFu;
+
+    RingAllocator();
+
+    void Reset(uint32_t capacity);
+
+    // size バイトを alignment 境界で確保してオフセットを返す.
+    // 空きが無い場合は全領域を破棄したものとして先頭から確保し, discard に true を返す.
+    // (呼び出し側は D3DLOCK_DISCARD でロックする必要があります)
+    // 容量を超えるサイズの場合は InvalidOffset を返す.
+    uint32_t Allocate(uint32_t size, uint32_t alignment, bool* discard);
+
+    // フレームの終了. 現在の書き込み位置をフェンスとして記録し, そのスロット番号を返す.
+    // このフレームで確保が無ければ -1 を返す.
+    // 追跡スロットが埋まっている場合は最新のスロットへ統合します.
+    int EndFrame();
+
+    // 完了待ちのフェンスがあるか.
+    bool HasPendingFrame() const { return m_pendingCount > 0; }
+    // 最も古いフェンスのスロット番号.
+    int GetOldestSlot() const { return m_pendingHead; }
+    // 最も古いフェンスの完了を通知して, その領域を解放します.
+    void RetireOldest();
+
+    uint32_t GetCapacity() const { return m_capacity; }
+    uint32_t GetUsedBytes() const;
+
+    // 統計情報.
+    struct Stats
+    {
+        uint32_t allocations;
+        uint32_t wraps;     // 先頭へ折り返した回数.
+        uint32_t discards;  // 空きが無く破棄が必要になった回数.
+        uint64_t bytes;
+    };
+    const Stats& GetStats() const { return m_stats; }
+    void ResetStats();
+
+private:
+    uint32_t m_capacity;
+    uint32_t m_head;
+    uint32_t m_tail;
+    bool m_dirty;   // 現在のフレームで確保があったか.
+
+    // 各フレームの終了位置.
+    uint32_t m_frameEnd[MaxFramesInFlight];
+    int m_pendingHead;
+    int m_pendingCount;
+
+    Stats m_stats;
+};
@@ -0,0 +1,434 @@
+﻿#include "SelfTest.h"
+#include "App.h"
+#include "DeviceResourceRegistry.h"
+#include "FrameCapture.h"
+#include "LightingReference.h"
+#include "NullDevice.h"
+#include "TraceReplayer.h"
+#include "tests/Test.h"
+
+#include <Windows.h>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace
+{
+const int ScreenWidth = 1280;
+const int ScreenHeight = 720;
+
+// デバイスが取り外された, または応答しなくなった後に,
+// 登録した全てのリソースが新しいデバイスで作り直され, 同じ描画ができること.
+void TestDeviceRecovery(HRESULT error)
+{
+    App app;
+    if (!TEST_CHECK(app.Initialize(nullptr, ScreenWidth, ScreenHeight, App::HeadlessMode)))
+    {
+        return;
+    }
+    app.Render();
+
+    NullDevice* device = app.GetNullDevice();
+    const DeviceResourceRegistry* registry = app.GetResourceRegistry();
+    const size_t count = registry->GetCount();
+    const uint32_t drawCalls = device->GetFrameStats().drawCalls;
+    TEST_CHECK(count > 0);
+    TEST_CHECK(registry->CountCreatedOn(device) == count);
+
+    // 次の PresentEx から失敗させる. Render() は失敗を記録するだけで, デバイスを作り直さない.
+    device->InjectDeviceError(error, device->GetFrameCount());
+    const uint32_t frameCount = device->GetFrameCount();
+    app.Render();
+    TEST_CHECK(app.IsDeviceLost());
+    TEST_CHECK(app.GetNullDevice() == device);
+
+    // 作り直すまでの Render() は何も描画しない.
+    app.Render();
+    TEST_CHECK(app.GetNullDevice() == device);
+    TEST_CHECK(device->GetFrameCount() == frameCount + 1);
+
+    // 描画を止めた状態で, 呼び出し側が作り直す.
+    TEST_CHECK(app.RecoverDevice());
+    TEST_CHECK(!app.IsDeviceLost());
+    app.Render();
+
+    // 作り直したデバイスは, 復帰後の 1 フレームだけを描いている.
+    device = app.GetNullDevice();
+    TEST_CHECK(device->GetFrameCount() == 1);
+    TEST_CHECK(registry->GetCount() == count);
+    TEST_CHECK(registry->CountCreatedOn(device) == count);
+    TEST_CHECK(device->GetTotalStats().resourcesCreated >= count);
+    TEST_CHECK(device->GetFrameStats().drawCalls == drawCalls);
+
+    // 復帰した後も描画を続けられる.
+    app.Render();
+    TEST_CHECK(app.GetNullDevice()->GetFrameCount() == 2);
+    app.Terminate();
+}
+
+// FrameCapture が読み戻した画像の記録. 書き出し先の関数はワーカースレッドから呼ばれる.
+struct CaptureRecord
+{
+    std::mutex mutex;
+    std::mutex gate;    // テストがロックしている間は書き出しが止まる.
+    std::vector<std::string> names;
+    int mismatches;
+
+    CaptureQueue::Writer GetWriter()
+    {
+        return [this](const CaptureQueue::Frame& frame, const std::vector<uint8_t>&)
+        {
+            std::lock_guard<std::mutex> wait(gate);
+            // 画素はファイル名の番号で塗ってある.
+            int index = -1;
+            sscanf(frame.fileName.c_str(), "frame%d", &index);
+            bool valid = index >= 0;
+            for (size_t i = 0; valid && i < frame.pixels.size(); ++i)
+            {
+                valid = frame.pixels[i] == uint8_t(index);
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            names.push_back(frame.fileName);
+            mismatches += valid ? 0 : 1;
+            return true;
+        };
+    }
+};
+
+// レンダーターゲットを index で塗ってから Capture() する.
+bool CaptureFrame(FrameCapture& capture, IDirect3DSurface9* target, int index)
+{
+    D3DSURFACE_DESC desc;
+    D3DLOCKED_RECT locked;
+    target->GetDesc(&desc);
+    target->LockRect(&locked, nullptr, 0);
+    memset(locked.pBits, index, size_t(locked.Pitch) * desc.Height);
+    target->UnlockRect();
+
+    char name[32];
+    snprintf(name, sizeof(name), "frame%02d", index);
+    return capture.Capture(target, name, CaptureQueue::Png);
+}
+
+// 読み戻しは latency フレーム後に Capture() した順で行い, 内容は Capture() した時点のもの.
+// 読み戻し先のサーフェイスが足りない場合と, キューのバッファが足りない場合はその画像を捨てる.
+void TestFrameCapture()
+{
+    D3DPRESENT_PARAMETERS pp = {};
+    pp.BackBufferWidth = ScreenWidth;
+    pp.BackBufferHeight = ScreenHeight;
+    pp.BackBufferFormat = D3DFMT_X8R8G8B8;
+    pp.Windowed = TRUE;
+    NullDevice* device = new NullDevice(pp);
+    IDirect3DSurface9* target = nullptr;
+    if (!TEST_CHECK(SUCCEEDED(device->CreateRenderTarget(16, 8, D3DFMT_A8R8G8B8, D3DMULTISAMPLE_NONE, 0, FALSE, &target, nullptr))))
+    {
+        device->Release();
+        return;
+    }
+
+    CaptureRecord record;
+    record.mismatches = 0;
+    {
+        CaptureQueue queue(1, 8);
+        queue.SetWriter(record.GetWriter());
+        FrameCapture capture(&queue, 2, 2);
+        capture.SetDevice(device);
+
+        // 2 フレーム後に読み戻すので, 3 フレーム目は 2 つのサーフェイスが共に使用中.
+        const bool expected[] = { true, true, false, true, true, false };
+        for (int i = 0; i < 6; ++i)
+        {
+            TEST_CHECK(CaptureFrame(capture, target, i) == expected[i]);
+            capture.EndFrame();
+        }
+        TEST_CHECK(capture.GetStats().readback == 3);
+        capture.EndFrame();
+        queue.Flush();
+
+        const FrameCapture::Stats& stats = capture.GetStats();
+        TEST_CHECK(stats.requested == 6);
+        TEST_CHECK(stats.readback == 4);
+        TEST_CHECK(stats.dropped == 2);
+        TEST_CHECK(stats.failed == 0);
+        TEST_CHECK(stats.latencyFrames == 4 * 2);
+        TEST_CHECK(queue.GetStats().written == 4);
+    }
+    TEST_CHECK(record.names == std::vector<std::string>({ "frame00", "frame01", "frame03", "frame04" }));
+    TEST_CHECK(record.mismatches == 0);
+
+    // キューのバッファが 1 つだけで, 書き出しが止まっていれば次の読み戻しは捨てる.
+    record.names.clear();
+    {
+        CaptureQueue queue(1, 1);
+        queue.SetWriter(record.GetWriter());
+        FrameCapture capture(&queue, 1, 2);
+        capture.SetDevice(device);
+
+        record.gate.lock();
+        TEST_CHECK(CaptureFrame(capture, target, 0));
+        capture.EndFrame();
+        TEST_CHECK(CaptureFrame(capture, target, 1));
+        capture.EndFrame();     // frame00 をキューへ渡す.
+        TEST_CHECK(CaptureFrame(capture, target, 2));
+        capture.EndFrame();     // frame01 はキューに空きが無いので捨てる.
+        TEST_CHECK(capture.GetStats().dropped == 1);
+        record.gate.unlock();
+
+        queue.Flush();
+        capture.EndFrame();     // frame02 をキューへ渡す.
+        queue.Flush();
+        TEST_CHECK(capture.GetStats().readback == 2);
+        TEST_CHECK(queue.GetStats().dropped == 1);
+
+        // デバイスを作り直す際は, 読み戻し中のものを捨てる.
+        TEST_CHECK(CaptureFrame(capture, target, 3));
+        capture.ReleaseDeviceObjects();
+        TEST_CHECK(capture.GetStats().dropped == 2);
+    }
+    TEST_CHECK(record.names == std::vector<std::string>({ "frame00", "frame02" }));
+    TEST_CHECK(record.mismatches == 0);
+
+    target->Release();
+    device->Release();
+}
+
+// トレースを再生し, 再生中にデバイスへ渡った呼び出しの集計を返す.
+bool ReplayTrace(const CommandTraceWriter& writer, NullDevice::Stats& stats)
+{
+    D3DPRESENT_PARAMETERS pp = {};
+    pp.BackBufferWidth = ScreenWidth;
+    pp.BackBufferHeight = ScreenHeight;
+    pp.BackBufferFormat = D3DFMT_X8R8G8B8;
+    pp.Windowed = TRUE;
+    NullDevice* device = new NullDevice(pp);
+    TraceReplayer replayer;
+    const bool result = replayer.Replay(device, writer.GetData().data(), writer.GetData().size(), false);
+    // 集計は PresentEx でまとめられる.
+    device->PresentEx(nullptr, nullptr, nullptr, nullptr, 0);
+    stats = device->GetFrameStats();
+    device->Release();
+    return result;
+}
+
+void WriteCreateVertexBuffer(CommandTraceWriter& writer, uint32_t id)
+{
+    writer.WriteOpcode(CommandTrace::CreateVertexBuffer);
+    writer.WriteUInt(id);
+    writer.WriteUInt(256);
+    writer.WriteUInt(D3DUSAGE_WRITEONLY);
+    writer.WriteUInt(0);
+    writer.WriteUInt(D3DPOOL_DEFAULT);
+}
+
+// 三角形リストの DrawPrimitiveUP. 頂点は 16 バイトで, vertexBytes バイトを記録する.
+void WriteDrawPrimitiveUP(CommandTraceWriter& writer, uint32_t primitiveCount, size_t vertexBytes)
+{
+    const std::vector<uint8_t> vertices(vertexBytes, 0);
+    writer.WriteOpcode(CommandTrace::DrawPrimitiveUP);
+    writer.WriteUInt(D3DPT_TRIANGLELIST);
+    writer.WriteUInt(primitiveCount);
+    writer.WriteUInt(16);
+    writer.WriteBytes(vertices.data(), vertices.size());
+}
+
+// 三角形リストの DrawIndexedPrimitiveUP. 16 ビットのインデックスと 16 バイトの頂点を vertexBytes バイト記録する.
+void WriteDrawIndexedPrimitiveUP(CommandTraceWriter& writer, uint32_t numVertices, const std::vector<uint16_t>& indices, size_t vertexBytes)
+{
+    const std::vector<uint8_t> vertices(vertexBytes, 0);
+    writer.WriteOpcode(CommandTrace::DrawIndexedPrimitiveUP);
+    writer.WriteUInt(D3DPT_TRIANGLELIST);
+    writer.WriteUInt(0);
+    writer.WriteUInt(numVertices);
+    writer.WriteUInt(uint32_t(indices.size() / 3));
+    writer.WriteUInt(D3DFMT_INDEX16);
+    writer.WriteUInt(16);
+    writer.WriteBytes(indices.data(), indices.size() * sizeof(uint16_t));
+    writer.WriteBytes(vertices.data(), vertices.size());
+}
+
+void WriteCreateVertexDeclaration(CommandTraceWriter& writer, const void* elements, size_t size)
+{
+    writer.WriteOpcode(CommandTrace::CreateVertexDeclaration);
+    writer.WriteUInt(1);
+    writer.WriteBytes(elements, size);
+}
+
+// 壊れたトレースは途中で止めて false を返し, 不正な引数や読めなかった引数でデバイスを呼び出さない.
+void TestCorruptTrace()
+{
+    NullDevice::Stats stats;
+    {
+        CommandTraceWriter writer;
+        WriteCreateVertexBuffer(writer, 1);
+        writer.WriteOpcode(CommandTrace::SetStreamSource);
+        writer.WriteUInt(0);
+        writer.WriteUInt(1);
+        writer.WriteUInt(0);
+        writer.WriteUInt(16);
+        writer.WriteOpcode(CommandTrace::DrawPrimitive);
+        writer.WriteUInt(D3DPT_TRIANGLELIST);
+        writer.WriteUInt(0);
+        writer.WriteUInt(1);
+        TEST_CHECK(ReplayTrace(writer, stats));
+        TEST_CHECK(stats.resourcesCreated == 1);
+        TEST_CHECK(stats.drawCalls == 1);
+    }
+
+    // 番号は作成する呼び出しの数を超えない. 0xFFFFFFFF は桁あふれし, 大きな番号は巨大な配列を確保する.
+    const uint32_t invalidIds[] = { 0, 3, 1000000, 0xFFFFFFFF };
+    for (uint32_t id : invalidIds)
+    {
+        CommandTraceWriter writer;
+        WriteCreateVertexBuffer(writer, 1);
+        WriteCreateVertexBuffer(writer, id);
+        TEST_CHECK(!ReplayTrace(writer, stats));
+        TEST_CHECK(stats.resourcesCreated == 1);
+    }
+
+    // 途中で終わっている呼び出しは実行しない.
+    {
+        CommandTraceWriter writer;
+        writer.WriteOpcode(CommandTrace::DrawPrimitive);
+        writer.WriteUInt(D3DPT_TRIANGLELIST);
+        writer.WriteUInt(0);
+        TEST_CHECK(!ReplayTrace(writer, stats));
+        TEST_CHECK(stats.drawCalls == 0);
+    }
+    {
+        CommandTraceWriter writer;
+        writer.WriteOpcode(CommandTrace::CreateTexture);
+        writer.WriteUInt(1);
+        writer.WriteUInt(64);
+        TEST_CHECK(!ReplayTrace(writer, stats));
+        TEST_CHECK(stats.resourcesCreated == 0);
+    }
+
+    // UP 系の描画は, 記録した頂点とインデックスの大きさが引数から求めた大きさと一致しなければ実行しない.
+    {
+        CommandTraceWriter writer;
+        WriteDrawPrimitiveUP(writer, 2, 6 * 16);
+        WriteDrawIndexedPrimitiveUP(writer, 4, { 0, 1, 2, 2, 1, 3 }, 4 * 16);
+        TEST_CHECK(ReplayTrace(writer, stats));
+        TEST_CHECK(stats.drawCalls == 2);
+    }
+    // 足りない頂点, 空の頂点, 3 倍すると 32 ビットで桁あふれするプリミティブ数.
+    const struct
+    {
+        uint32_t primitiveCount;
+        size_t vertexBytes;
+    } badDraws[] = { { 2, 6 * 16 - 1 }, { 2, 0 }, { 0x55555556, 2 * 16 } };
+    for (const auto& draw : badDraws)
+    {
+        CommandTraceWriter writer;
+        WriteDrawPrimitiveUP(writer, draw.primitiveCount, draw.vertexBytes);
+        TEST_CHECK(!ReplayTrace(writer, stats));
+        TEST_CHECK(stats.drawCalls == 0);
+    }
+    // 足りない頂点, 余分な頂点, 三角形に満たないインデックス, 記録した頂点の外を指すインデックス.
+    const struct
+    {
+        uint32_t numVertices;
+        std::vector<uint16_t> indices;
+        size_t vertexBytes;
+    } badIndexedDraws[] = {
+        { 4, { 0, 1, 2, 2, 1, 3 }, 3 * 16 },
+        { 4, { 0, 1, 2, 2, 1, 3 }, 5 * 16 },
+        { 4, { 0, 1, 2, 2, 1 }, 4 * 16 },
+        { 4, { 0, 1, 2, 2, 1, 4 }, 4 * 16 },
+    };
+    for (const auto& draw : badIndexedDraws)
+    {
+        CommandTraceWriter writer;
+        WriteDrawIndexedPrimitiveUP(writer, draw.numVertices, draw.indices, draw.vertexBytes);
+        TEST_CHECK(!ReplayTrace(writer, stats));
+        TEST_CHECK(stats.drawCalls == 0);
+    }
+
+    // 頂点宣言は D3DVERTEXELEMENT9 の配列で, D3DDECL_END() で終わる.
+    const D3DVERTEXELEMENT9 elements[] = {
+        { 0, 0, D3DDECLTYPE_FLOAT3, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_POSITION, 0 },
+        D3DDECL_END()
+    };
+    {
+        CommandTraceWriter writer;
+        WriteCreateVertexDeclaration(writer, elements, sizeof(elements));
+        TEST_CHECK(ReplayTrace(writer, stats));
+        TEST_CHECK(stats.resourcesCreated == 1);
+    }
+    // 要素の大きさの倍数でない, 終端が無い, 空.
+    const size_t badDeclSizes[] = { sizeof(elements) - 1, sizeof(elements[0]), 0 };
+    for (size_t size : badDeclSizes)
+    {
+        CommandTraceWriter writer;
+        WriteCreateVertexDeclaration(writer, elements, size);
+        TEST_CHECK(!ReplayTrace(writer, stats));
+        TEST_CHECK(stats.resourcesCreated == 0);
+    }
+}
+
+// 光を低い解像度で計算して補間した結果と, 全ての画素で計算した結果 (Shade()) との誤差が閾値に収まる.
+// GPU の Deferred_LightAccumPass_PS.hlsl と Deferred_UpsamplePass_PS.hlsl は ShadeReduced() と同じ計算です.
+void TestReducedLighting()
+{
+    struct Threshold
+    {
+        int factor;
+        double minPsnr;
+        double maxBadPixelRatio;
+        double maxFallbackRatio;
+    };
+    // 640x360 では 1/2 で 61.5 dB, 1/4 で 50.6 dB. 手を入れて悪くなった場合に気付ける程度の余裕を持たせる.
+    const Threshold thresholds[] = {
+        { 2, 55.0, 0.0025, 0.01 },
+        { 4, 45.0, 0.02, 0.02 },
+    };
+    const int Width = 640;
+    const int Height = 360;
+
+    LightingReference::GBuffer gbuffer;
+    LightingReference::BuildGBuffer(Width, Height, gbuffer);
+    int lightCount;
+    const DeferredScene::LightInfo* lights = DeferredScene::GetLights(lightCount);
+    std::vector<DirectX::XMFLOAT4> reference, image;
+    LightingReference::Shade(gbuffer, lights, lightCount, reference);
+
+    // 等倍なら補間せずに同じ結果になる.
+    TEST_CHECK(LightingReference::ShadeReduced(gbuffer, lights, lightCount, LightingReference::GetDefaultUpsampleParams(1), image) == 0);
+    TEST_CHECK(LightingReference::CompareImages(reference, image).maxError < 1e-5);
+
+    for (const Threshold& threshold : thresholds)
+    {
+        const size_t fallbackCount = LightingReference::ShadeReduced(gbuffer, lights, lightCount,
+            LightingReference::GetDefaultUpsampleParams(threshold.factor), image);
+        const LightingReference::ImageError error = LightingReference::CompareImages(reference, image);
+        char message[128];
+        snprintf(message, sizeof(message), "Reduced lighting 1/%d: PSNR %.1f dB, %.2f%% bad, %.2f%% fallback\n",
+            threshold.factor, error.psnr, error.badPixelRatio * 100.0, fallbackCount * 100.0 / (Width * Height));
+        OutputDebugStringA(message);
+        TEST_CHECK(error.psnr >= threshold.minPsnr);
+        TEST_CHECK(error.badPixelRatio <= threshold.maxBadPixelRatio);
+        TEST_CHECK(double(fallbackCount) / (Width * Height) <= threshold.maxFallbackRatio);
+
+        // 法線と位置の重みを外した単純なバイリニア補間より, 輪郭で滲まない分だけ誤差が小さい.
+        LightingReference::UpsampleParams bilinear = LightingReference::GetDefaultUpsampleParams(threshold.factor);
+        bilinear.normalPower = 0.0f;
+        bilinear.planeSharpness = 0.0f;
+        bilinear.minWeight = 0.0f;
+        LightingReference::ShadeReduced(gbuffer, lights, lightCount, bilinear, image);
+        TEST_CHECK(error.psnr >= LightingReference::CompareImages(reference, image).psnr + 10.0);
+    }
+}
+}
+
+int RunSelfTests()
+{
+    Test::Run("device recovery (DEVICEREMOVED)", [] { TestDeviceRecovery(D3DERR_DEVICEREMOVED); });
+    Test::Run("device recovery (DEVICEHUNG)", [] { TestDeviceRecovery(D3DERR_DEVICEHUNG); });
+    Test::Run("frame capture", TestFrameCapture);
+    Test::Run("corrupt trace", TestCorruptTrace);
+    Test::Run("reduced lighting", TestReducedLighting);
+    return Test::Finish();
+}
@@ -0,0 +1,7 @@
+﻿#pragma once
+
+// D3D を使う処理のテスト. ヌルデバイスで実行するので, GPU の無い環境でも動きます.
+// D3D に依存しない処理のテストは tests/ にあり, Linux でビルドして実行します.
+//
+// 結果を標準出力へ出力し, 全て成功すれば 0 を, 失敗があれば 1 を返します.
+int RunSelfTests();
@@ -0,0 +1,74 @@
+﻿#pragma once
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// 1 つのスレッドが追加し, 別の 1 つのスレッドが取り出す固定容量のキュー. D3D には依存しません.
+// ロックを使わないので, 追加する側も取り出す側も待たされません. 一杯なら TryPush() は false を返します.
+template<class T>
+class SpscQueue
+{
+public:
+    // 容量は capacity 以上の 2 のべき乗にします.
+    explicit SpscQueue(size_t capacity)
+        : m_mask(0), m_head(0), m_tail(0), m_cachedHead(0), m_cachedTail(0)
+    {
+        size_t size = 2;
+        while (size < capacity)
+        {
+            size *= 2;
+        }
+        m_items.resize(size);
+        m_mask = size - 1;
+    }
+
+    size_t GetCapacity() const { return m_items.size(); }
+
+    // 追加する側のスレッドだけが呼び出します.
+    bool TryPush(const T& value)
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_cachedHead >= m_items.size())
+        {
+            // 一杯に見えるときだけ, 取り出す側の位置を読み直す.
+            m_cachedHead = m_head.load(std::memory_order_acquire);
+            if (tail - m_cachedHead >= m_items.size())
+            {
+                return false;
+            }
+        }
+        m_items[tail & m_mask] = value;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 取り出す側のスレッドだけが呼び出します.
+    bool TryPop(T& value)
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_cachedTail)
+        {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+            if (head == m_cachedTail)
+            {
+                return false;
+            }
+        }
+        value = m_items[head & m_mask];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    SpscQueue(const SpscQueue&);
+    SpscQueue& operator=(const SpscQueue&);
+
+    std::vector<T> m_items;
+    size_t m_mask;
+    // 取り出す側が書き換える位置と, 追加する側が書き換える位置は別のキャッシュラインに置く.
+    alignas(64) std::atomic<size_t> m_head;
+    alignas(64) std::atomic<size_t> m_tail;
+    // 相手の位置の最後に読んだ値. それぞれの側だけが使う.
+    alignas(64) size_t m_cachedHead;    // 追加する側.
+    alignas(64) size_t m_cachedTail;    // 取り出す側.
+};
@@ -0,0 +1,1381 @@
+﻿#include "TraceDevice.h"
+#include <cstring>
+#include <vector>
+
+using CommandTrace::Opcode;
+
+namespace
+{
+// 1 ピクセルあたりのバイト数.
+UINT GetBytesPerPixel(D3DFORMAT format)
+{
+    switch (format)
+    {
+    case D3DFMT_A32B32G32R32F:
+        return 16;
+    case D3DFMT_A16B16G16R16F:
+    case D3DFMT_A16B16G16R16:
+    case D3DFMT_G32R32F:
+        return 8;
+    case D3DFMT_R16F:
+    case D3DFMT_D16:
+        return 2;
+    case D3DFMT_L8:
+        return 1;
+    default:
+        return 4;
+    }
+}
+
+// プリミティブ数から頂点(インデックス)数を求める.
+UINT GetVertexCount(D3DPRIMITIVETYPE type, UINT primitiveCount)
+{
+    switch (type)
+    {
+    case D3DPT_POINTLIST:     return primitiveCount;
+    case D3DPT_LINELIST:      return primitiveCount * 2;
+    case D3DPT_LINESTRIP:     return primitiveCount + 1;
+    case D3DPT_TRIANGLELIST:  return primitiveCount * 3;
+    case D3DPT_TRIANGLESTRIP:
+    case D3DPT_TRIANGLEFAN:   return primitiveCount + 2;
+    default:                  return 0;
+    }
+}
+
+// シェーダーのバイトコードの長さ (バイト) を終端のトークンまで読んで求める.
+// 先頭はバージョン, 続いて命令ごとに [31:24] が引数の数 (コメントは [30:16] が長さ) のトークンが並ぶ.
+size_t GetShaderSize(const DWORD* function)
+{
+    const DWORD* p = function + 1;
+    for (;;)
+    {
+        const DWORD token = *p++;
+        if (token == 0x0000FFFF)
+        {
+            break;
+        }
+        if ((token & 0xFFFF) == 0xFFFE)
+        {
+            p += (token >> 16) & 0x7FFF;
+        }
+        else
+        {
+            p += (token >> 24) & 0xF;
+        }
+    }
+    return size_t(p - function) * sizeof(DWORD);
+}
+
+// 頂点バッファ/インデックスバッファを包み, Lock で書き込んだ範囲を Unlock の時点で記録する.
+// NullDevice のリソースと同じく, デバイスへの参照は保持しない.
+template<class Interface, class Desc>
+class TraceBuffer : public Interface
+{
+public:
+    TraceBuffer(TraceDevice* device, REFIID iid, Interface* inner, uint32_t id, UINT length)
+        : m_refCount(1), m_device(device), m_iid(&iid), m_inner(inner), m_id(id), m_length(length),
+        m_lockOffset(0), m_lockSize(0), m_lockFlags(0), m_lockData(nullptr)
+    {
+    }
+    virtual ~TraceBuffer()
+    {
+        m_inner->Release();
+    }
+
+    Interface* GetInner() const { return m_inner; }
+    uint32_t GetId() const { return m_id; }
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObj) override
+    {
+        if (!ppvObj)
+        {
+            return E_POINTER;
+        }
+        if (riid == __uuidof(IUnknown) || riid == __uuidof(IDirect3DResource9) || riid == *m_iid)
+        {
+            this->AddRef();
+            *ppvObj = this;
+            return S_OK;
+        }
+        *ppvObj = nullptr;
+        return E_NOINTERFACE;
+    }
+    ULONG STDMETHODCALLTYPE AddRef() override
+    {
+        return ++m_refCount;
+    }
+    ULONG STDMETHODCALLTYPE Release() override
+    {
+        ULONG count = --m_refCount;
+        if (count == 0)
+        {
+            delete this;
+        }
+        return count;
+    }
+
+    HRESULT STDMETHODCALLTYPE GetDevice(IDirect3DDevice9** ppDevice) override
+    {
+        if (!ppDevice)
+        {
+            return D3DERR_INVALIDCALL;
+        }
+        m_device->AddRef();
+        *ppDevice = m_device;
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE SetPrivateData(REFGUID refguid, CONST void* pData, DWORD SizeOfData, DWORD Flags) override
+    {
+        return m_inner->SetPrivateData(refguid, pData, SizeOfData, Flags);
+    }
+    HRESULT STDMETHODCALLTYPE GetPrivateData(REFGUID refguid, void* pData, DWORD* pSizeOfData) override
+    {
+        return m_inner->GetPrivateData(refguid, pData, pSizeOfData);
+    }
+    HRESULT STDMETHODCALLTYPE FreePrivateData(REFGUID refguid) override { return m_inner->FreePrivateData(refguid); }
+    DWORD STDMETHODCALLTYPE SetPriority(DWORD PriorityNew) override { return m_inner->SetPriority(PriorityNew); }
+    DWORD STDMETHODCALLTYPE GetPriority() override { return m_inner->GetPriority(); }
+    void STDMETHODCALLTYPE PreLoad() override { m_inner->PreLoad(); }
+    D3DRESOURCETYPE STDMETHODCALLTYPE GetType() override { return m_inner->GetType(); }
+
+    HRESULT STDMETHODCALLTYPE Lock(UINT OffsetToLock, UINT SizeToLock, void** ppbData, DWORD Flags) override
+    {
+        HRESULT hr = m_inner->Lock(OffsetToLock, SizeToLock, ppbData, Flags);
+        if (SUCCEEDED(hr) && !(Flags & D3DLOCK_READONLY) && OffsetToLock <= m_length)
+        {
+            // 0 はバッファの終わりまで.
+            if (SizeToLock == 0 || OffsetToLock + SizeToLock > m_length)
+            {
+                SizeToLock = m_length - OffsetToLock;
+            }
+            m_lockOffset = OffsetToLock;
+            m_lockSize = SizeToLock;
+            m_lockFlags = Flags;
+            m_lockData = *ppbData;
+        }
+        return hr;
+    }
+    HRESULT STDMETHODCALLTYPE Unlock() override
+    {
+        if (m_lockData)
+        {
+            m_device->RecordBufferUpdate(m_id, m_lockOffset, m_lockFlags, m_lockData, m_lockSize);
+            m_lockData = nullptr;
+        }
+        return m_inner->Unlock();
+    }
+    HRESULT STDMETHODCALLTYPE GetDesc(Desc* pDesc) override { return m_inner->GetDesc(pDesc); }
+
+private:
+    ULONG m_refCount;
+    TraceDevice* m_device;
+    const GUID* m_iid;
+    Interface* m_inner;
+    uint32_t m_id;
+    UINT m_length;
+
+    // Unlock までの書き込み中の範囲.
+    UINT m_lockOffset;
+    UINT m_lockSize;
+    DWORD m_lockFlags;
+    void* m_lockData;
+};
+
+typedef TraceBuffer<IDirect3DVertexBuffer9, D3DVERTEXBUFFER_DESC> TraceVertexBuffer;
+typedef TraceBuffer<IDirect3DIndexBuffer9, D3DINDEXBUFFER_DESC> TraceIndexBuffer;
+
+// このデバイスで作成したバッファは全て TraceBuffer で包まれている.
+IDirect3DVertexBuffer9* Unwrap(IDirect3DVertexBuffer9* buffer)
+{
+    return buffer ? static_cast<TraceVertexBuffer*>(buffer)->GetInner() : nullptr;
+}
+
+IDirect3DIndexBuffer9* Unwrap(IDirect3DIndexBuffer9* buffer)
+{
+    return buffer ? static_cast<TraceIndexBuffer*>(buffer)->GetInner() : nullptr;
+}
+
+uint32_t GetBufferId(IDirect3DVertexBuffer9* buffer)
+{
+    return buffer ? static_cast<TraceVertexBuffer*>(buffer)->GetId() : 0;
+}
+
+uint32_t GetBufferId(IDirect3DIndexBuffer9* buffer)
+{
+    return buffer ? static_cast<TraceIndexBuffer*>(buffer)->GetId() : 0;
+}
+}
+
+TraceDevice::TraceDevice(IDirect3DDevice9Ex* inner)
+    : m_refCount(1), m_inner(inner), m_nextId(1), m_indices(nullptr)
+{
+    m_inner->AddRef();
+    for (int i = 0; i < MaxStreams; ++i)
+    {
+        m_streams[i] = nullptr;
+    }
+}
+
+TraceDevice::~TraceDevice()
+{
+    for (int i = 0; i < MaxStreams; ++i)
+    {
+        Bind(m_streams[i], static_cast<IDirect3DVertexBuffer9*>(nullptr));
+    }
+    Bind(m_indices, static_cast<IDirect3DIndexBuffer9*>(nullptr));
+    m_inner->Release();
+}
+
+void TraceDevice::RecordBufferUpdate(uint32_t id, UINT offset, DWORD flags, const void* data, UINT size)
+{
+    m_writer.WriteOpcode(CommandTrace::UpdateBuffer);
+    m_writer.WriteUInt(id);
+    m_writer.WriteUInt(offset);
+    m_writer.WriteUInt(flags);
+    m_writer.WriteBytes(data, size);
+}
+
+uint32_t TraceDevice::AddObject(IUnknown* object)
+{
+    // 解放されたオブジェクトと同じアドレスで作られた場合は新しい番号で上書きする.
+    const uint32_t id = m_nextId++;
+    m_ids[object] = id;
+    return id;
+}
+
+uint32_t TraceDevice::FindObject(IUnknown* object) const
+{
+    if (!object)
+    {
+        return 0;
+    }
+    auto it = m_ids.find(object);
+    return it != m_ids.end() ? it->second : 0;
+}
+
+// テクスチャのレベルは初めて使われた時に GetSurfaceLevel として記録する.
+// 記録していないサーフェイスは 0 (nullptr) になる.
+uint32_t TraceDevice::GetSurfaceId(IDirect3DSurface9* surface)
+{
+    if (!surface)
+    {
+        return 0;
+    }
+    IDirect3DTexture9* texture = nullptr;
+    if (FAILED(surface->GetContainer(__uuidof(IDirect3DTexture9), reinterpret_cast<void**>(&texture))) || !texture)
+    {
+        return FindObject(surface);
+    }
+
+    const uint32_t textureId = FindObject(texture);
+    UINT level = 0;
+    for (DWORD i = 0; i < texture->GetLevelCount(); ++i)
+    {
+        IDirect3DSurface9* levelSurface = nullptr;
+        if (SUCCEEDED(texture->GetSurfaceLevel(i, &levelSurface)))
+        {
+            levelSurface->Release();
+            if (levelSurface == surface)
+            {
+                level = i;
+                break;
+            }
+        }
+    }
+    texture->Release();
+    if (textureId == 0)
+    {
+        return 0;
+    }
+
+    const uint64_t key = (uint64_t(textureId) << 32) | level;
+    auto it = m_levelIds.find(key);
+    if (it != m_levelIds.end())
+    {
+        return it->second;
+    }
+    const uint32_t id = m_nextId++;
+    m_levelIds[key] = id;
+    m_writer.WriteOpcode(CommandTrace::GetSurfaceLevel);
+    m_writer.WriteUInt(id);
+    m_writer.WriteUInt(textureId);
+    m_writer.WriteUInt(level);
+    return id;
+}
+
+void TraceDevice::RecordCreateSurface(Opcode opcode, IDirect3DSurface9* surface, UINT width, UINT height, D3DFORMAT format)
+{
+    m_writer.WriteOpcode(opcode);
+    m_writer.WriteUInt(AddObject(surface));
+    m_writer.WriteUInt(width);
+    m_writer.WriteUInt(height);
+    m_writer.WriteUInt(format);
+}
+
+void TraceDevice::RecordShaderConstant(Opcode opcode, UINT startRegister, const void* data, size_t size)
+{
+    m_writer.WriteOpcode(opcode);
+    m_writer.WriteUInt(startRegister);
+    m_writer.WriteBytes(data, data ? size : 0);
+}
+
+// 全レベルの内容を, 行の間を詰めて記録する.
+void TraceDevice::RecordTextureContents(uint32_t id, IDirect3DTexture9* texture)
+{
+    std::vector<uint8_t> rows;
+    for (DWORD level = 0; level < texture->GetLevelCount(); ++level)
+    {
+        D3DSURFACE_DESC desc;
+        D3DLOCKED_RECT locked;
+        if (FAILED(texture->GetLevelDesc(level, &desc)) ||
+            FAILED(texture->LockRect(level, &locked, nullptr, D3DLOCK_READONLY)))
+        {
+            continue;
+        }
+        const UINT rowBytes = desc.Width * GetBytesPerPixel(desc.Format);
+        rows.resize(size_t(rowBytes) * desc.Height);
+        for (UINT y = 0; y < desc.Height; ++y)
+        {
+            memcpy(&rows[size_t(y) * rowBytes], static_cast<const uint8_t*>(locked.pBits) + size_t(y) * locked.Pitch, rowBytes);
+        }
+        texture->UnlockRect(level);
+
+        m_writer.WriteOpcode(CommandTrace::UpdateTextureLevel);
+        m_writer.WriteUInt(id);
+        m_writer.WriteUInt(level);
+        m_writer.WriteUInt(rowBytes);
+        m_writer.WriteUInt(desc.Height);
+        m_writer.WriteBytes(rows.data(), rows.size());
+    }
+}
+
+// IUnknown
+
+HRESULT TraceDevice::QueryInterface(REFIID riid, void** ppvObj)
+{
+    if (!ppvObj)
+    {
+        return E_POINTER;
+    }
+    if (riid == __uuidof(IUnknown) || riid == __uuidof(IDirect3DDevice9) || riid == __uuidof(IDirect3DDevice9Ex))
+    {
+        AddRef();
+        *ppvObj = this;
+        return S_OK;
+    }
+    return m_inner->QueryInterface(riid, ppvObj);
+}
+
+ULONG TraceDevice::AddRef()
+{
+    return ++m_refCount;
+}
+
+ULONG TraceDevice::Release()
+{
+    ULONG count = --m_refCount;
+    if (count == 0)
+    {
+        delete this;
+    }
+    return count;
+}
+
+// IDirect3DDevice9
+
+HRESULT TraceDevice::TestCooperativeLevel()
+{
+    return m_inner->TestCooperativeLevel();
+}
+
+UINT TraceDevice::GetAvailableTextureMem()
+{
+    return m_inner->GetAvailableTextureMem();
+}
+
+HRESULT TraceDevice::EvictManagedResources()
+{
+    return m_inner->EvictManagedResources();
+}
+
+HRESULT TraceDevice::GetDirect3D(IDirect3D9** ppD3D9)
+{
+    return m_inner->GetDirect3D(ppD3D9);
+}
+
+HRESULT TraceDevice::GetDeviceCaps(D3DCAPS9* pCaps)
+{
+    return m_inner->GetDeviceCaps(pCaps);
+}
+
+HRESULT TraceDevice::GetDisplayMode(UINT iSwapChain, D3DDISPLAYMODE* pMode)
+{
+    return m_inner->GetDisplayMode(iSwapChain, pMode);
+}
+
+HRESULT TraceDevice::GetCreationParameters(D3DDEVICE_CREATION_PARAMETERS* pParameters)
+{
+    return m_inner->GetCreationParameters(pParameters);
+}
+
+HRESULT TraceDevice::SetCursorProperties(UINT XHotSpot, UINT YHotSpot, IDirect3DSurface9* pCursorBitmap)
+{
+    return m_inner->SetCursorProperties(XHotSpot, YHotSpot, pCursorBitmap);
+}
+
+void TraceDevice::SetCursorPosition(int X, int Y, DWORD Flags)
+{
+    m_inner->SetCursorPosition(X, Y, Flags);
+}
+
+BOOL TraceDevice::ShowCursor(BOOL bShow)
+{
+    return m_inner->ShowCursor(bShow);
+}
+
+HRESULT TraceDevice::CreateAdditionalSwapChain(D3DPRESENT_PARAMETERS* pPresentationParameters, IDirect3DSwapChain9** pSwapChain)
+{
+    return m_inner->CreateAdditionalSwapChain(pPresentationParameters, pSwapChain);
+}
+
+HRESULT TraceDevice::GetSwapChain(UINT iSwapChain, IDirect3DSwapChain9** pSwapChain)
+{
+    return m_inner->GetSwapChain(iSwapChain, pSwapChain);
+}
+
+UINT TraceDevice::GetNumberOfSwapChains()
+{
+    return m_inner->GetNumberOfSwapChains();
+}
+
+HRESULT TraceDevice::Reset(D3DPRESENT_PARAMETERS* pPresentationParameters)
+{
+    return m_inner->Reset(pPresentationParameters);
+}
+
+HRESULT TraceDevice::Present(CONST RECT* pSourceRect, CONST RECT* pDestRect, HWND hDestWindowOverride, CONST RGNDATA* pDirtyRegion)
+{
+    m_writer.WriteOpcode(CommandTrace::Present);
+    m_writer.WriteUInt(0);
+    return m_inner->Present(pSourceRect, pDestRect, hDestWindowOverride, pDirtyRegion);
+}
+
+HRESULT TraceDevice::GetBackBuffer(UINT iSwapChain, UINT iBackBuffer, D3DBACKBUFFER_TYPE Type, IDirect3DSurface9** ppBackBuffer)
+{
+    HRESULT hr = m_inner->GetBackBuffer(iSwapChain, iBackBuffer, Type, ppBackBuffer);
+    if (SUCCEEDED(hr) && GetSurfaceId(*ppBackBuffer) == 0)
+    {
+        m_writer.WriteOpcode(CommandTrace::GetBackBuffer);
+        m_writer.WriteUInt(AddObject(*ppBackBuffer));
+        m_writer.WriteUInt(iSwapChain);
+        m_writer.WriteUInt(iBackBuffer);
+    }
+    return hr;
+}
+
+HRESULT TraceDevice::GetRasterStatus(UINT iSwapChain, D3DRASTER_STATUS* pRasterStatus)
+{
+    return m_inner->GetRasterStatus(iSwapChain, pRasterStatus);
+}
+
+HRESULT TraceDevice::SetDialogBoxMode(BOOL bEnableDialogs)
+{
+    return m_inner->SetDialogBoxMode(bEnableDialogs);
+}
+
+void TraceDevice::SetGammaRamp(UINT iSwapChain, DWORD Flags, CONST D3DGAMMARAMP* pRamp)
+{
+    m_inner->SetGammaRamp(iSwapChain, Flags, pRamp);
+}
+
+void TraceDevice::GetGammaRamp(UINT iSwapChain, D3DGAMMARAMP* pRamp)
+{
+    m_inner->GetGammaRamp(iSwapChain, pRamp);
+}
+
+HRESULT TraceDevice::CreateTexture(UINT Width, UINT Height, UINT Levels, DWORD Usage, D3DFORMAT Format, D3DPOOL Pool, IDirect3DTexture9** ppTexture, HANDLE* pSharedHandle)
+{
+    HRESULT hr = m_inner->CreateTexture(Width, Height, Levels, Usage, Format, Pool, ppTexture, pSharedHandle);
+    if (SUCCEEDED(hr))
+    {
+        m_writer.WriteOpcode(CommandTrace::CreateTexture);
+        m_writer.WriteUInt(AddObject(*ppTexture));
+        m_writer.WriteUInt(Width);
+        m_writer.WriteUInt(Height);
+        m_writer.WriteUInt(Levels);
+        m_writer.WriteUInt(Usage);
+        m_writer.WriteUInt(Format);
+        m_writer.WriteUInt(Pool);
+    }
+    return hr;
+}
+
+HRESULT TraceDevice::CreateVolumeTexture(UINT Width, UINT Height, UINT Depth, UINT Levels, DWORD Usage, D3DFORMAT Format, D3DPOOL Pool, IDirect3DVolumeTexture9** ppVolumeTexture, HANDLE* pSharedHandle)
+{
+    return m_inner->CreateVolumeTexture(Width, Height, Depth, Levels, Usage, Format, Pool, ppVolumeTexture, pSharedHandle);
+}
+
+HRESULT TraceDevice::CreateCubeTexture(UINT EdgeLength, UINT Levels, DWORD Usage, D3DFORMAT Format, D3DPOOL Pool, IDirect3DCubeTexture9** ppCubeTexture, HANDLE* pSharedHandle)
+{
+    return m_inner->CreateCubeTexture(EdgeLength, Levels, Usage, Format, Pool, ppCubeTexture, pSharedHandle);
+}
+
+HRESULT TraceDevice::CreateVertexBuffer(UINT Length, DWORD Usage, DWORD FVF, D3DPOOL Pool, IDirect3DVertexBuffer9** ppVertexBuffer, HANDLE* pSharedHandle)
+{
+    if (!ppVertexBuffer)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    IDirect3DVertexBuffer9* inner = nullptr;
+    HRESULT hr = m_inner->CreateVertexBuffer(Length, Usage, FVF, Pool, &inner, pSharedHandle);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    const uint32_t id = m_nextId++;
+    m_writer.WriteOpcode(CommandTrace::CreateVertexBuffer);
+    m_writer.WriteUInt(id);
+    m_writer.WriteUInt(Length);
+    m_writer.WriteUInt(Usage);
+    m_writer.WriteUInt(FVF);
+    m_writer.WriteUInt(Pool);
+    *ppVertexBuffer = new TraceVertexBuffer(this, __uuidof(IDirect3DVertexBuffer9), inner, id, Length);
+    return hr;
+}
+
+HRESULT TraceDevice::CreateIndexBuffer(UINT Length, DWORD Usage, D3DFORMAT Format, D3DPOOL Pool, IDirect3DIndexBuffer9** ppIndexBuffer, HANDLE* pSharedHandle)
+{
+    if (!ppIndexBuffer)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    IDirect3DIndexBuffer9* inner = nullptr;
+    HRESULT hr = m_inner->CreateIndexBuffer(Length, Usage, Format, Pool, &inner, pSharedHandle);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    const uint32_t id = m_nextId++;
+    m_writer.WriteOpcode(CommandTrace::CreateIndexBuffer);
+    m_writer.WriteUInt(id);
+    m_writer.WriteUInt(Length);
+    m_writer.WriteUInt(Usage);
+    m_writer.WriteUInt(Format);
+    m_writer.WriteUInt(Pool);
+    *ppIndexBuffer = new TraceIndexBuffer(this, __uuidof(IDirect3DIndexBuffer9), inner, id, Length);
+    return hr;
+}
+
+HRESULT TraceDevice::CreateRenderTarget(UINT Width, UINT Height, D3DFORMAT Format, D3DMULTISAMPLE_TYPE MultiSample, DWORD MultisampleQuality, BOOL Lockable, IDirect3DSurface9** ppSurface, HANDLE* pSharedHandle)
+{
+    HRESULT hr = m_inner->CreateRenderTarget(Width, Height, Format, MultiSample, MultisampleQuality, Lockable, ppSurface, pSharedHandle);
+    if (SUCCEEDED(hr))
+    {
+        RecordCreateSurface(CommandTrace::CreateRenderTarget, *ppSurface, Width, Height, Format);
+        m_writer.WriteUInt(MultiSample);
+        m_writer.WriteUInt(MultisampleQuality);
+        m_writer.WriteUInt(Lockable);
+    }
+    return hr;
+}
+
+HRESULT TraceDevice::CreateDepthStencilSurface(UINT Width, UINT Height, D3DFORMAT Format, D3DMULTISAMPLE_TYPE MultiSample, DWORD MultisampleQuality, BOOL Discard, IDirect3DSurface9** ppSurface, HANDLE* pSharedHandle)
+{
+    HRESULT hr = m_inner->CreateDepthStencilSurface(Width, Height, Format, MultiSample, MultisampleQuality, Discard, ppSurface, pSharedHandle);
+    if (SUCCEEDED(hr))
+    {
+        RecordCreateSurface(CommandTrace::CreateDepthStencilSurface, *ppSurface, Width, Height, Format);
+        m_writer.WriteUInt(MultiSample);
+        m_writer.WriteUInt(MultisampleQuality);
+        m_writer.WriteUInt(Discard);
+    }
+    return hr;
+}
+
+HRESULT TraceDevice::UpdateSurface(IDirect3DSurface9* pSourceSurface, CONST RECT* pSourceRect, IDirect3DSurface9* pDestinationSurface, CONST POINT* pDestPoint)
+{
+    return m_inner->UpdateSurface(pSourceSurface, pSourceRect, pDestinationSurface, pDestPoint);
+}
+
+HRESULT TraceDevice::UpdateTexture(IDirect3DBaseTexture9* pSourceTexture, IDirect3DBaseTexture9* pDestinationTexture)
+{
+    const uint32_t sourceId = FindObject(pSourceTexture);
+    if (sourceId != 0 && pSourceTexture->GetType() == D3DRTYPE_TEXTURE)
+    {
+        // システムメモリのテクスチャは LockRect で書き込まれているため, 転送する時点の内容を記録する.
+        IDirect3DTexture9* source = static_cast<IDirect3DTexture9*>(pSourceTexture);
+        D3DSURFACE_DESC desc;
+        if (SUCCEEDED(source->GetLevelDesc(0, &desc)) && desc.Pool == D3DPOOL_SYSTEMMEM)
+        {
+            RecordTextureContents(sourceId, source);
+        }
+    }
+    m_writer.WriteOpcode(CommandTrace::UpdateTexture);
+    m_writer.WriteUInt(sourceId);
+    m_writer.WriteUInt(FindObject(pDestinationTexture));
+    return m_inner->UpdateTexture(pSourceTexture, pDestinationTexture);
+}
+
+HRESULT TraceDevice::GetRenderTargetData(IDirect3DSurface9* pRenderTarget, IDirect3DSurface9* pDestSurface)
+{
+    const uint32_t sourceId = GetSurfaceId(pRenderTarget);
+    const uint32_t destId = GetSurfaceId(pDestSurface);
+    m_writer.WriteOpcode(CommandTrace::GetRenderTargetData);
+    m_writer.WriteUInt(sourceId);
+    m_writer.WriteUInt(destId);
+    return m_inner->GetRenderTargetData(pRenderTarget, pDestSurface);
+}
+
+HRESULT TraceDevice::GetFrontBufferData(UINT iSwapChain, IDirect3DSurface9* pDestSurface)
+{
+    return m_inner->GetFrontBufferData(iSwapChain, pDestSurface);
+}
+
+HRESULT TraceDevice::StretchRect(IDirect3DSurface9* pSourceSurface, CONST RECT* pSourceRect, IDirect3DSurface9* pDestSurface, CONST RECT* pDestRect, D3DTEXTUREFILTERTYPE Filter)
+{
+    const uint32_t sourceId = GetSurfaceId(pSourceSurface);
+    const uint32_t destId = GetSurfaceId(pDestSurface);
+    m_writer.WriteOpcode(CommandTrace::StretchRect);
+    m_writer.WriteUInt(sourceId);
+    m_writer.WriteUInt(destId);
+    m_writer.WriteUInt(Filter);
+    return m_inner->StretchRect(pSourceSurface, pSourceRect, pDestSurface, pDestRect, Filter);
+}
+
+HRESULT TraceDevice::ColorFill(IDirect3DSurface9* pSurface, CONST RECT* pRect, D3DCOLOR color)
+{
+    const uint32_t id = GetSurfaceId(pSurface);
+    m_writer.WriteOpcode(CommandTrace::ColorFill);
+    m_writer.WriteUInt(id);
+    m_writer.WriteUInt(color);
+    return m_inner->ColorFill(pSurface, pRect, color);
+}
+
+HRESULT TraceDevice::CreateOffscreenPlainSurface(UINT Width, UINT Height, D3DFORMAT Format, D3DPOOL Pool, IDirect3DSurface9** ppSurface, HANDLE* pSharedHandle)
+{
+    HRESULT hr = m_inner->CreateOffscreenPlainSurface(Width, Height, Format, Pool, ppSurface, pSharedHandle);
+    if (SUCCEEDED(hr))
+    {
+        RecordCreateSurface(CommandTrace::CreateOffscreenPlainSurface, *ppSurface, Width, Height, Format);
+        m_writer.WriteUInt(Pool);
+    }
+    return hr;
+}
+
+HRESULT TraceDevice::SetRenderTarget(DWORD RenderTargetIndex, IDirect3DSurface9* pRenderTarget)
+{
+    const uint32_t id = GetSurfaceId(pRenderTarget);
+    m_writer.WriteOpcode(CommandTrace::SetRenderTarget);
+    m_writer.WriteUInt(RenderTargetIndex);
+    m_writer.WriteUInt(id);
+    return m_inner->SetRenderTarget(RenderTargetIndex, pRenderTarget);
+}
+
+HRESULT TraceDevice::GetRenderTarget(DWORD RenderTargetIndex, IDirect3DSurface9** ppRenderTarget)
+{
+    HRESULT hr = m_inner->GetRenderTarget(RenderTargetIndex, ppRenderTarget);
+    if (SUCCEEDED(hr) && GetSurfaceId(*ppRenderTarget) == 0)
+    {
+        m_writer.WriteOpcode(CommandTrace::GetRenderTarget);
+        m_writer.WriteUInt(AddObject(*ppRenderTarget));
+        m_writer.WriteUInt(RenderTargetIndex);
+    }
+    return hr;
+}
+
+HRESULT TraceDevice::SetDepthStencilSurface(IDirect3DSurface9* pNewZStencil)
+{
+    const uint32_t id = GetSurfaceId(pNewZStencil);
+    m_writer.WriteOpcode(CommandTrace::SetDepthStencilSurface);
+    m_writer.WriteUInt(id);
+    return m_inner->SetDepthStencilSurface(pNewZStencil);
+}
+
+HRESULT TraceDevice::GetDepthStencilSurface(IDirect3DSurface9** ppZStencilSurface)
+{
+    HRESULT hr = m_inner->GetDepthStencilSurface(ppZStencilSurface);
+    if (SUCCEEDED(hr) && GetSurfaceId(*ppZStencilSurface) == 0)
+    {
+        m_writer.WriteOpcode(CommandTrace::GetDepthStencilSurface);
+        m_writer.WriteUInt(AddObject(*ppZStencilSurface));
+    }
+    return hr;
+}
+
+HRESULT TraceDevice::BeginScene()
+{
+    m_writer.WriteOpcode(CommandTrace::BeginScene);
+    return m_inner->BeginScene();
+}
+
+HRESULT TraceDevice::EndScene()
+{
+    m_writer.WriteOpcode(CommandTrace::EndScene);
+    return m_inner->EndScene();
+}
+
+HRESULT TraceDevice::Clear(DWORD Count, CONST D3DRECT* pRects, DWORD Flags, D3DCOLOR Color, float Z, DWORD Stencil)
+{
+    m_writer.WriteOpcode(CommandTrace::Clear);
+    m_writer.WriteUInt(Flags);
+    m_writer.WriteUInt(Color);
+    m_writer.WriteFloat(Z);
+    m_writer.WriteUInt(Stencil);
+    return m_inner->Clear(Count, pRects, Flags, Color, Z, Stencil);
+}
+
+HRESULT TraceDevice::SetTransform(D3DTRANSFORMSTATETYPE State, CONST D3DMATRIX* pMatrix)
+{
+    if (pMatrix)
+    {
+        m_writer.WriteOpcode(CommandTrace::SetTransform);
+        m_writer.WriteUInt(State);
+        for (int i = 0; i < 16; ++i)
+        {
+            m_writer.WriteFloat(pMatrix->m[i / 4][i % 4]);
+        }
+    }
+    return m_inner->SetTransform(State, pMatrix);
+}
+
+HRESULT TraceDevice::GetTransform(D3DTRANSFORMSTATETYPE State, D3DMATRIX* pMatrix)
+{
+    return m_inner->GetTransform(State, pMatrix);
+}
+
+HRESULT TraceDevice::MultiplyTransform(D3DTRANSFORMSTATETYPE State, CONST D3DMATRIX* pMatrix)
+{
+    return m_inner->MultiplyTransform(State, pMatrix);
+}
+
+HRESULT TraceDevice::SetViewport(CONST D3DVIEWPORT9* pViewport)
+{
+    if (pViewport)
+    {
+        m_writer.WriteOpcode(CommandTrace::SetViewport);
+        m_writer.WriteUInt(pViewport->X);
+        m_writer.WriteUInt(pViewport->Y);
+        m_writer.WriteUInt(pViewport->Width);
+        m_writer.WriteUInt(pViewport->Height);
+        m_writer.WriteFloat(pViewport->MinZ);
+        m_writer.WriteFloat(pViewport->MaxZ);
+    }
+    return m_inner->SetViewport(pViewport);
+}
+
+HRESULT TraceDevice::GetViewport(D3DVIEWPORT9* pViewport)
+{
+    return m_inner->GetViewport(pViewport);
+}
+
+HRESULT TraceDevice::SetMaterial(CONST D3DMATERIAL9* pMaterial)
+{
+    return m_inner->SetMaterial(pMaterial);
+}
+
+HRESULT TraceDevice::GetMaterial(D3DMATERIAL9* pMaterial)
+{
+    return m_inner->GetMaterial(pMaterial);
+}
+
+HRESULT TraceDevice::SetLight(DWORD Index, CONST D3DLIGHT9* pLight)
+{
+    return m_inner->SetLight(Index, pLight);
+}
+
+HRESULT TraceDevice::GetLight(DWORD Index, D3DLIGHT9* pLight)
+{
+    return m_inner->GetLight(Index, pLight);
+}
+
+HRESULT TraceDevice::LightEnable(DWORD Index, BOOL Enable)
+{
+    return m_inner->LightEnable(Index, Enable);
+}
+
+HRESULT TraceDevice::GetLightEnable(DWORD Index, BOOL* pEnable)
+{
+    return m_inner->GetLightEnable(Index, pEnable);
+}
+
+HRESULT TraceDevice::SetClipPlane(DWORD Index, CONST float* pPlane)
+{
+    return m_inner->SetClipPlane(Index, pPlane);
+}
+
+HRESULT TraceDevice::GetClipPlane(DWORD Index, float* pPlane)
+{
+    return m_inner->GetClipPlane(Index, pPlane);
+}
+
+HRESULT TraceDevice::SetRenderState(D3DRENDERSTATETYPE State, DWORD Value)
+{
+    m_writer.WriteOpcode(CommandTrace::SetRenderState);
+    m_writer.WriteUInt(State);
+    m_writer.WriteUInt(Value);
+    return m_inner->SetRenderState(State, Value);
+}
+
+HRESULT TraceDevice::GetRenderState(D3DRENDERSTATETYPE State, DWORD* pValue)
+{
+    return m_inner->GetRenderState(State, pValue);
+}
+
+HRESULT TraceDevice::CreateStateBlock(D3DSTATEBLOCKTYPE Type, IDirect3DStateBlock9** ppSB)
+{
+    return m_inner->CreateStateBlock(Type, ppSB);
+}
+
+HRESULT TraceDevice::BeginStateBlock()
+{
+    return m_inner->BeginStateBlock();
+}
+
+HRESULT TraceDevice::EndStateBlock(IDirect3DStateBlock9** ppSB)
+{
+    return m_inner->EndStateBlock(ppSB);
+}
+
+HRESULT TraceDevice::SetClipStatus(CONST D3DCLIPSTATUS9* pClipStatus)
+{
+    return m_inner->SetClipStatus(pClipStatus);
+}
+
+HRESULT TraceDevice::GetClipStatus(D3DCLIPSTATUS9* pClipStatus)
+{
+    return m_inner->GetClipStatus(pClipStatus);
+}
+
+HRESULT TraceDevice::GetTexture(DWORD Stage, IDirect3DBaseTexture9** ppTexture)
+{
+    return m_inner->GetTexture(Stage, ppTexture);
+}
+
+HRESULT TraceDevice::SetTexture(DWORD Stage, IDirect3DBaseTexture9* pTexture)
+{
+    m_writer.WriteOpcode(CommandTrace::SetTexture);
+    m_writer.WriteUInt(Stage);
+    m_writer.WriteUInt(FindObject(pTexture));
+    return m_inner->SetTexture(Stage, pTexture);
+}
+
+HRESULT TraceDevice::GetTextureStageState(DWORD Stage, D3DTEXTURESTAGESTATETYPE Type, DWORD* pValue)
+{
+    return m_inner->GetTextureStageState(Stage, Type, pValue);
+}
+
+HRESULT TraceDevice::SetTextureStageState(DWORD Stage, D3DTEXTURESTAGESTATETYPE Type, DWORD Value)
+{
+    m_writer.WriteOpcode(CommandTrace::SetTextureStageState);
+    m_writer.WriteUInt(Stage);
+    m_writer.WriteUInt(Type);
+    m_writer.WriteUInt(Value);
+    return m_inner->SetTextureStageState(Stage, Type, Value);
+}
+
+HRESULT TraceDevice::GetSamplerState(DWORD Sampler, D3DSAMPLERSTATETYPE Type, DWORD* pValue)
+{
+    return m_inner->GetSamplerState(Sampler, Type, pValue);
+}
+
+HRESULT TraceDevice::SetSamplerState(DWORD Sampler, D3DSAMPLERSTATETYPE Type, DWORD Value)
+{
+    m_writer.WriteOpcode(CommandTrace::SetSamplerState);
+    m_writer.WriteUInt(Sampler);
+    m_writer.WriteUInt(Type);
+    m_writer.WriteUInt(Value);
+    return m_inner->SetSamplerState(Sampler, Type, Value);
+}
+
+HRESULT TraceDevice::ValidateDevice(DWORD* pNumPasses)
+{
+    return m_inner->ValidateDevice(pNumPasses);
+}
+
+HRESULT TraceDevice::SetPaletteEntries(UINT PaletteNumber, CONST PALETTEENTRY* pEntries)
+{
+    return m_inner->SetPaletteEntries(PaletteNumber, pEntries);
+}
+
+HRESULT TraceDevice::GetPaletteEntries(UINT PaletteNumber, PALETTEENTRY* pEntries)
+{
+    return m_inner->GetPaletteEntries(PaletteNumber, pEntries);
+}
+
+HRESULT TraceDevice::SetCurrentTexturePalette(UINT PaletteNumber)
+{
+    return m_inner->SetCurrentTexturePalette(PaletteNumber);
+}
+
+HRESULT TraceDevice::GetCurrentTexturePalette(UINT* PaletteNumber)
+{
+    return m_inner->GetCurrentTexturePalette(PaletteNumber);
+}
+
+HRESULT TraceDevice::SetScissorRect(CONST RECT* pRect)
+{
+    if (pRect)
+    {
+        m_writer.WriteOpcode(CommandTrace::SetScissorRect);
+        m_writer.WriteInt(pRect->left);
+        m_writer.WriteInt(pRect->top);
+        m_writer.WriteInt(pRect->right);
+        m_writer.WriteInt(pRect->bottom);
+    }
+    return m_inner->SetScissorRect(pRect);
+}
+
+HRESULT TraceDevice::GetScissorRect(RECT* pRect)
+{
+    return m_inner->GetScissorRect(pRect);
+}
+
+HRESULT TraceDevice::SetSoftwareVertexProcessing(BOOL bSoftware)
+{
+    return m_inner->SetSoftwareVertexProcessing(bSoftware);
+}
+
+BOOL TraceDevice::GetSoftwareVertexProcessing()
+{
+    return m_inner->GetSoftwareVertexProcessing();
+}
+
+HRESULT TraceDevice::SetNPatchMode(float nSegments)
+{
+    return m_inner->SetNPatchMode(nSegments);
+}
+
+float TraceDevice::GetNPatchMode()
+{
+    return m_inner->GetNPatchMode();
+}
+
+HRESULT TraceDevice::DrawPrimitive(D3DPRIMITIVETYPE PrimitiveType, UINT StartVertex, UINT PrimitiveCount)
+{
+    m_writer.WriteOpcode(CommandTrace::DrawPrimitive);
+    m_writer.WriteUInt(PrimitiveType);
+    m_writer.WriteUInt(StartVertex);
+    m_writer.WriteUInt(PrimitiveCount);
+    return m_inner->DrawPrimitive(PrimitiveType, StartVertex, PrimitiveCount);
+}
+
+HRESULT TraceDevice::DrawIndexedPrimitive(D3DPRIMITIVETYPE PrimitiveType, INT BaseVertexIndex, UINT MinVertexIndex, UINT NumVertices, UINT startIndex, UINT primCount)
+{
+    m_writer.WriteOpcode(CommandTrace::DrawIndexedPrimitive);
+    m_writer.WriteUInt(PrimitiveType);
+    m_writer.WriteInt(BaseVertexIndex);
+    m_writer.WriteUInt(MinVertexIndex);
+    m_writer.WriteUInt(NumVertices);
+    m_writer.WriteUInt(startIndex);
+    m_writer.WriteUInt(primCount);
+    return m_inner->DrawIndexedPrimitive(PrimitiveType, BaseVertexIndex, MinVertexIndex, NumVertices, startIndex, primCount);
+}
+
+HRESULT TraceDevice::DrawPrimitiveUP(D3DPRIMITIVETYPE PrimitiveType, UINT PrimitiveCount, CONST void* pVertexStreamZeroData, UINT VertexStreamZeroStride)
+{
+    m_writer.WriteOpcode(CommandTrace::DrawPrimitiveUP);
+    m_writer.WriteUInt(PrimitiveType);
+    m_writer.WriteUInt(PrimitiveCount);
+    m_writer.WriteUInt(VertexStreamZeroStride);
+    m_writer.WriteBytes(pVertexStreamZeroData,
+        pVertexStreamZeroData ? size_t(GetVertexCount(PrimitiveType, PrimitiveCount)) * VertexStreamZeroStride : 0);
+    return m_inner->DrawPrimitiveUP(PrimitiveType, PrimitiveCount, pVertexStreamZeroData, VertexStreamZeroStride);
+}
+
+HRESULT TraceDevice::DrawIndexedPrimitiveUP(D3DPRIMITIVETYPE PrimitiveType, UINT MinVertexIndex, UINT NumVertices, UINT PrimitiveCount, CONST void* pIndexData, D3DFORMAT IndexDataFormat, CONST void* pVertexStreamZeroData, UINT VertexStreamZeroStride)
+{
+    // インデックスが指す頂点を含むよう, 頂点は先頭から MinVertexIndex + NumVertices 個を記録する.
+    const size_t indexSize = IndexDataFormat == D3DFMT_INDEX32 ? 4 : 2;
+    m_writer.WriteOpcode(CommandTrace::DrawIndexedPrimitiveUP);
+    m_writer.WriteUInt(PrimitiveType);
+    m_writer.WriteUInt(MinVertexIndex);
+    m_writer.WriteUInt(NumVertices);
+    m_writer.WriteUInt(PrimitiveCount);
+    m_writer.WriteUInt(IndexDataFormat);
+    m_writer.WriteUInt(VertexStreamZeroStride);
+    m_writer.WriteBytes(pIndexData, pIndexData ? GetVertexCount(PrimitiveType, PrimitiveCount) * indexSize : 0);
+    m_writer.WriteBytes(pVertexStreamZeroData,
+        pVertexStreamZeroData ? size_t(MinVertexIndex + NumVertices) * VertexStreamZeroStride : 0);
+    return m_inner->DrawIndexedPrimitiveUP(PrimitiveType, MinVertexIndex, NumVertices, PrimitiveCount, pIndexData, IndexDataFormat, pVertexStreamZeroData, VertexStreamZeroStride);
+}
+
+HRESULT TraceDevice::ProcessVertices(UINT SrcStartIndex, UINT DestIndex, UINT VertexCount, IDirect3DVertexBuffer9* pDestBuffer, IDirect3DVertexDeclaration9* pVertexDecl, DWORD Flags)
+{
+    return m_inner->ProcessVertices(SrcStartIndex, DestIndex, VertexCount, Unwrap(pDestBuffer), pVertexDecl, Flags);
+}
+
+HRESULT TraceDevice::CreateVertexDeclaration(CONST D3DVERTEXELEMENT9* pVertexElements, IDirect3DVertexDeclaration9** ppDecl)
+{
+    HRESULT hr = m_inner->CreateVertexDeclaration(pVertexElements, ppDecl);
+    if (SUCCEEDED(hr))
+    {
+        // D3DDECL_END() まで含めて記録する.
+        size_t count = 1;
+        while (pVertexElements[count - 1].Stream != 0xFF)
+        {
+            ++count;
+        }
+        m_writer.WriteOpcode(CommandTrace::CreateVertexDeclaration);
+        m_writer.WriteUInt(AddObject(*ppDecl));
+        m_writer.WriteBytes(pVertexElements, count * sizeof(D3DVERTEXELEMENT9));
+    }
+    return hr;
+}
+
+HRESULT TraceDevice::SetVertexDeclaration(IDirect3DVertexDeclaration9* pDecl)
+{
+    m_writer.WriteOpcode(CommandTrace::SetVertexDeclaration);
+    m_writer.WriteUInt(FindObject(pDecl));
+    return m_inner->SetVertexDeclaration(pDecl);
+}
+
+HRESULT TraceDevice::GetVertexDeclaration(IDirect3DVertexDeclaration9** ppDecl)
+{
+    return m_inner->GetVertexDeclaration(ppDecl);
+}
+
+HRESULT TraceDevice::SetFVF(DWORD FVF)
+{
+    m_writer.WriteOpcode(CommandTrace::SetFVF);
+    m_writer.WriteUInt(FVF);
+    return m_inner->SetFVF(FVF);
+}
+
+HRESULT TraceDevice::GetFVF(DWORD* pFVF)
+{
+    return m_inner->GetFVF(pFVF);
+}
+
+HRESULT TraceDevice::CreateVertexShader(CONST DWORD* pFunction, IDirect3DVertexShader9** ppShader)
+{
+    HRESULT hr = m_inner->CreateVertexShader(pFunction, ppShader);
+    if (SUCCEEDED(hr))
+    {
+        m_writer.WriteOpcode(CommandTrace::CreateVertexShader);
+        m_writer.WriteUInt(AddObject(*ppShader));
+        m_writer.WriteBytes(pFunction, GetShaderSize(pFunction));
+    }
+    return hr;
+}
+
+HRESULT TraceDevice::SetVertexShader(IDirect3DVertexShader9* pShader)
+{
+    m_writer.WriteOpcode(CommandTrace::SetVertexShader);
+    m_writer.WriteUInt(FindObject(pShader));
+    return m_inner->SetVertexShader(pShader);
+}
+
+HRESULT TraceDevice::GetVertexShader(IDirect3DVertexShader9** ppShader)
+{
+    return m_inner->GetVertexShader(ppShader);
+}
+
+HRESULT TraceDevice::SetVertexShaderConstantF(UINT StartRegister, CONST float* pConstantData, UINT Vector4fCount)
+{
+    RecordShaderConstant(CommandTrace::SetVertexShaderConstantF, StartRegister, pConstantData, Vector4fCount * sizeof(float) * 4);
+    return m_inner->SetVertexShaderConstantF(StartRegister, pConstantData, Vector4fCount);
+}
+
+HRESULT TraceDevice::GetVertexShaderConstantF(UINT StartRegister, float* pConstantData, UINT Vector4fCount)
+{
+    return m_inner->GetVertexShaderConstantF(StartRegister, pConstantData, Vector4fCount);
+}
+
+HRESULT TraceDevice::SetVertexShaderConstantI(UINT StartRegister, CONST int* pConstantData, UINT Vector4iCount)
+{
+    RecordShaderConstant(CommandTrace::SetVertexShaderConstantI, StartRegister, pConstantData, Vector4iCount * sizeof(int) * 4);
+    return m_inner->SetVertexShaderConstantI(StartRegister, pConstantData, Vector4iCount);
+}
+
+HRESULT TraceDevice::GetVertexShaderConstantI(UINT StartRegister, int* pConstantData, UINT Vector4iCount)
+{
+    return m_inner->GetVertexShaderConstantI(StartRegister, pConstantData, Vector4iCount);
+}
+
+HRESULT TraceDevice::SetVertexShaderConstantB(UINT StartRegister, CONST BOOL* pConstantData, UINT BoolCount)
+{
+    RecordShaderConstant(CommandTrace::SetVertexShaderConstantB, StartRegister, pConstantData, BoolCount * sizeof(BOOL));
+    return m_inner->SetVertexShaderConstantB(StartRegister, pConstantData, BoolCount);
+}
+
+HRESULT TraceDevice::GetVertexShaderConstantB(UINT StartRegister, BOOL* pConstantData, UINT BoolCount)
+{
+    return m_inner->GetVertexShaderConstantB(StartRegister, pConstantData, BoolCount);
+}
+
+HRESULT TraceDevice::SetStreamSource(UINT StreamNumber, IDirect3DVertexBuffer9* pStreamData, UINT OffsetInBytes, UINT Stride)
+{
+    m_writer.WriteOpcode(CommandTrace::SetStreamSource);
+    m_writer.WriteUInt(StreamNumber);
+    m_writer.WriteUInt(GetBufferId(pStreamData));
+    m_writer.WriteUInt(OffsetInBytes);
+    m_writer.WriteUInt(Stride);
+    HRESULT hr = m_inner->SetStreamSource(StreamNumber, Unwrap(pStreamData), OffsetInBytes, Stride);
+    if (SUCCEEDED(hr) && StreamNumber < MaxStreams)
+    {
+        Bind(m_streams[StreamNumber], pStreamData);
+    }
+    return hr;
+}
+
+HRESULT TraceDevice::GetStreamSource(UINT StreamNumber, IDirect3DVertexBuffer9** ppStreamData, UINT* pOffsetInBytes, UINT* pStride)
+{
+    IDirect3DVertexBuffer9* inner = nullptr;
+    HRESULT hr = m_inner->GetStreamSource(StreamNumber, &inner, pOffsetInBytes, pStride);
+    if (FAILED(hr) || !ppStreamData)
+    {
+        return FAILED(hr) ? hr : D3DERR_INVALIDCALL;
+    }
+    if (inner)
+    {
+        inner->Release();
+    }
+    // 転送先のバッファではなく, 包んだものを返す.
+    *ppStreamData = StreamNumber < MaxStreams ? m_streams[StreamNumber] : nullptr;
+    if (*ppStreamData)
+    {
+        (*ppStreamData)->AddRef();
+    }
+    return hr;
+}
+
+HRESULT TraceDevice::SetStreamSourceFreq(UINT StreamNumber, UINT Setting)
+{
+    m_writer.WriteOpcode(CommandTrace::SetStreamSourceFreq);
+    m_writer.WriteUInt(StreamNumber);
+    m_writer.WriteUInt(Setting);
+    return m_inner->SetStreamSourceFreq(StreamNumber, Setting);
+}
+
+HRESULT TraceDevice::GetStreamSourceFreq(UINT StreamNumber, UINT* pSetting)
+{
+    return m_inner->GetStreamSourceFreq(StreamNumber, pSetting);
+}
+
+HRESULT TraceDevice::SetIndices(IDirect3DIndexBuffer9* pIndexData)
+{
+    m_writer.WriteOpcode(CommandTrace::SetIndices);
+    m_writer.WriteUInt(GetBufferId(pIndexData));
+    HRESULT hr = m_inner->SetIndices(Unwrap(pIndexData));
+    if (SUCCEEDED(hr))
+    {
+        Bind(m_indices, pIndexData);
+    }
+    return hr;
+}
+
+HRESULT TraceDevice::GetIndices(IDirect3DIndexBuffer9** ppIndexData)
+{
+    if (!ppIndexData)
+    {
+        return D3DERR_INVALIDCALL;
+    }
+    *ppIndexData = m_indices;
+    if (m_indices)
+    {
+        m_indices->AddRef();
+    }
+    return S_OK;
+}
+
+HRESULT TraceDevice::CreatePixelShader(CONST DWORD* pFunction, IDirect3DPixelShader9** ppShader)
+{
+    HRESULT hr = m_inner->CreatePixelShader(pFunction, ppShader);
+    if (SUCCEEDED(hr))
+    {
+        m_writer.WriteOpcode(CommandTrace::CreatePixelShader);
+        m_writer.WriteUInt(AddObject(*ppShader));
+        m_writer.WriteBytes(pFunction, GetShaderSize(pFunction));
+    }
+    return hr;
+}
+
+HRESULT TraceDevice::SetPixelShader(IDirect3DPixelShader9* pShader)
+{
+    m_writer.WriteOpcode(CommandTrace::SetPixelShader);
+    m_writer.WriteUInt(FindObject(pShader));
+    return m_inner->SetPixelShader(pShader);
+}
+
+HRESULT TraceDevice::GetPixelShader(IDirect3DPixelShader9** ppShader)
+{
+    return m_inner->GetPixelShader(ppShader);
+}
+
+HRESULT TraceDevice::SetPixelShaderConstantF(UINT StartRegister, CONST float* pConstantData, UINT Vector4fCount)
+{
+    RecordShaderConstant(CommandTrace::SetPixelShaderConstantF, StartRegister, pConstantData, Vector4fCount * sizeof(float) * 4);
+    return m_inner->SetPixelShaderConstantF(StartRegister, pConstantData, Vector4fCount);
+}
+
+HRESULT TraceDevice::GetPixelShaderConstantF(UINT StartRegister, float* pConstantData, UINT Vector4fCount)
+{
+    return m_inner->GetPixelShaderConstantF(StartRegister, pConstantData, Vector4fCount);
+}
+
+HRESULT TraceDevice::SetPixelShaderConstantI(UINT StartRegister, CONST int* pConstantData, UINT Vector4iCount)
+{
+    RecordShaderConstant(CommandTrace::SetPixelShaderConstantI, StartRegister, pConstantData, Vector4iCount * sizeof(int) * 4);
+    return m_inner->SetPixelShaderConstantI(StartRegister, pConstantData, Vector4iCount);
+}
+
+HRESULT TraceDevice::GetPixelShaderConstantI(UINT StartRegister, int* pConstantData, UINT Vector4iCount)
+{
+    return m_inner->GetPixelShaderConstantI(StartRegister, pConstantData, Vector4iCount);
+}
+
+HRESULT TraceDevice::SetPixelShaderConstantB(UINT StartRegister, CONST BOOL* pConstantData, UINT BoolCount)
+{
+    RecordShaderConstant(CommandTrace::SetPixelShaderConstantB, StartRegister, pConstantData, BoolCount * sizeof(BOOL));
+    return m_inner->SetPixelShaderConstantB(StartRegister, pConstantData, BoolCount);
+}
+
+HRESULT TraceDevice::GetPixelShaderConstantB(UINT StartRegister, BOOL* pConstantData, UINT BoolCount)
+{
+    return m_inner->GetPixelShaderConstantB(StartRegister, pConstantData, BoolCount);
+}
+
+HRESULT TraceDevice::DrawRectPatch(UINT Handle, CONST float* pNumSegs, CONST D3DRECTPATCH_INFO* pRectPatchInfo)
+{
+    return m_inner->DrawRectPatch(Handle, pNumSegs, pRectPatchInfo);
+}
+
+HRESULT TraceDevice::DrawTriPatch(UINT Handle, CONST float* pNumSegs, CONST D3DTRIPATCH_INFO* pTriPatchInfo)
+{
+    return m_inner->DrawTriPatch(Handle, pNumSegs, pTriPatchInfo);
+}
+
+HRESULT TraceDevice::DeletePatch(UINT Handle)
+{
+    return m_inner->DeletePatch(Handle);
+}
+
+HRESULT TraceDevice::CreateQuery(D3DQUERYTYPE Type, IDirect3DQuery9** ppQuery)
+{
+    return m_inner->CreateQuery(Type, ppQuery);
+}
+
+// IDirect3DDevice9Ex
+
+HRESULT TraceDevice::SetConvolutionMonoKernel(UINT width, UINT height, float* rows, float* columns)
+{
+    return m_inner->SetConvolutionMonoKernel(width, height, rows, columns);
+}
+
+HRESULT TraceDevice::ComposeRects(IDirect3DSurface9* pSrc, IDirect3DSurface9* pDst, IDirect3DVertexBuffer9* pSrcRectDescs, UINT NumRects, IDirect3DVertexBuffer9* pDstRectDescs, D3DCOMPOSERECTSOP Operation, int Xoffset, int Yoffset)
+{
+    return m_inner->ComposeRects(pSrc, pDst, Unwrap(pSrcRectDescs), NumRects, Unwrap(pDstRectDescs), Operation, Xoffset, Yoffset);
+}
+
+HRESULT TraceDevice::PresentEx(CONST RECT* pSourceRect, CONST RECT* pDestRect, HWND hDestWindowOverride, CONST RGNDATA* pDirtyRegion, DWORD dwFlags)
+{
+    m_writer.WriteOpcode(CommandTrace::Present);
+    m_writer.WriteUInt(dwFlags);
+    return m_inner->PresentEx(pSourceRect, pDestRect, hDestWindowOverride, pDirtyRegion, dwFlags);
+}
+
+HRESULT TraceDevice::GetGPUThreadPriority(INT* pPriority)
+{
+    return m_inner->GetGPUThreadPriority(pPriority);
+}
+
+HRESULT TraceDevice::SetGPUThreadPriority(INT Priority)
+{
+    return m_inner->SetGPUThreadPriority(Priority);
+}
+
+HRESULT TraceDevice::WaitForVBlank(UINT iSwapChain)
+{
+    return m_inner->WaitForVBlank(iSwapChain);
+}
+
+HRESULT TraceDevice::CheckResourceResidency(IDirect3DResource9** pResourceArray, UINT32 NumResources)
+{
+    if (!pResourceArray)
+    {
+        return m_inner->CheckResourceResidency(pResourceArray, NumResources);
+    }
+    std::vector<IDirect3DResource9*> resources(pResourceArray, pResourceArray + NumResources);
+    for (auto& resource : resources)
+    {
+        if (!resource)
+        {
+            continue;
+        }
+        switch (resource->GetType())
+        {
+        case D3DRTYPE_VERTEXBUFFER:
+            resource = Unwrap(static_cast<IDirect3DVertexBuffer9*>(resource));
+            break;
+        case D3DRTYPE_INDEXBUFFER:
+            resource = Unwrap(static_cast<IDirect3DIndexBuffer9*>(resource));
+            break;
+        default:
+            break;
+        }
+    }
+    return m_inner->CheckResourceResidency(resources.data(), NumResources);
+}
+
+HRESULT TraceDevice::SetMaximumFrameLatency(UINT MaxLatency)
+{
+    return m_inner->SetMaximumFrameLatency(MaxLatency);
+}
+
+HRESULT TraceDevice::GetMaximumFrameLatency(UINT* pMaxLatency)
+{
+    return m_inner->GetMaximumFrameLatency(pMaxLatency);
+}
+
+HRESULT TraceDevice::CheckDeviceState(HWND hDestinationWindow)
+{
+    return m_inner->CheckDeviceState(hDestinationWindow);
+}
+
+HRESULT TraceDevice::CreateRenderTargetEx(UINT Width, UINT Height, D3DFORMAT Format, D3DMULTISAMPLE_TYPE MultiSample, DWORD MultisampleQuality, BOOL Lockable, IDirect3DSurface9** ppSurface, HANDLE* pSharedHandle, DWORD Usage)
+{
+    // Usage は再生に影響しないため記録しない.
+    HRESULT hr = m_inner->CreateRenderTargetEx(Width, Height, Format, MultiSample, MultisampleQuality, Lockable, ppSurface, pSharedHandle, Usage);
+    if (SUCCEEDED(hr))
+    {
+        RecordCreateSurface(CommandTrace::CreateRenderTarget, *ppSurface, Width, Height, Format);
+        m_writer.WriteUInt(MultiSample);
+        m_writer.WriteUInt(MultisampleQuality);
+        m_writer.WriteUInt(Lockable);
+    }
+    return hr;
+}
+
+HRESULT TraceDevice::CreateOffscreenPlainSurfaceEx(UINT Width, UINT Height, D3DFORMAT Format, D3DPOOL Pool, IDirect3DSurface9** ppSurface, HANDLE* pSharedHandle, DWORD Usage)
+{
+    HRESULT hr = m_inner->CreateOffscreenPlainSurfaceEx(Width, Height, Format, Pool, ppSurface, pSharedHandle, Usage);
+    if (SUCCEEDED(hr))
+    {
+        RecordCreateSurface(CommandTrace::CreateOffscreenPlainSurface, *ppSurface, Width, Height, Format);
+        m_writer.WriteUInt(Pool);
+    }
+    return hr;
+}
+
+HRESULT TraceDevice::CreateDepthStencilSurfaceEx(UINT Width, UINT Height, D3DFORMAT Format, D3DMULTISAMPLE_TYPE MultiSample, DWORD MultisampleQuality, BOOL Discard, IDirect3DSurface9** ppSurface, HANDLE* pSharedHandle, DWORD Usage)
+{
+    HRESULT hr = m_inner->CreateDepthStencilSurfaceEx(Width, Height, Format, MultiSample, MultisampleQuality, Discard, ppSurface, pSharedHandle, Usage);
+    if (SUCCEEDED(hr))
+    {
+        RecordCreateSurface(CommandTrace::CreateDepthStencilSurface, *ppSurface, Width, Height, Format);
+        m_writer.WriteUInt(MultiSample);
+        m_writer.WriteUInt(MultisampleQuality);
+        m_writer.WriteUInt(Discard);
+    }
+    return hr;
+}
+
+HRESULT TraceDevice::ResetEx(D3DPRESENT_PARAMETERS* pPresentationParameters, D3DDISPLAYMODEEX* pFullscreenDisplayMode)
+{
+    return m_inner->ResetEx(pPresentationParameters, pFullscreenDisplayMode);
+}
+
+HRESULT TraceDevice::GetDisplayModeEx(UINT iSwapChain, D3DDISPLAYMODEEX* pMode, D3DDISPLAYROTATION* pRotation)
+{
+    return m_inner->GetDisplayModeEx(iSwapChain, pMode, pRotation);
+}
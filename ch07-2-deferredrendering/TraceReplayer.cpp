@@ -0,0 +1,973 @@
+﻿#include "TraceReplayer.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+// SetTexture / SetSamplerState のサンプラー番号を配列の位置に変換する. 範囲外なら -1.
+int GetSamplerIndex(uint32_t sampler)
+{
+    if (sampler < 16)
+    {
+        return int(sampler);
+    }
+    if (sampler >= D3DVERTEXTEXTURESAMPLER0 && sampler < D3DVERTEXTEXTURESAMPLER0 + 4)
+    {
+        return 16 + int(sampler - D3DVERTEXTEXTURESAMPLER0);
+    }
+    return -1;
+}
+
+// プリミティブ数から頂点(インデックス)数を求める. TraceDevice が記録するときと同じ数え方で,
+// 壊れたトレースの大きな数でも桁あふれしないよう 64 ビットで数える.
+uint64_t GetVertexCount(D3DPRIMITIVETYPE type, uint32_t primitiveCount)
+{
+    switch (type)
+    {
+    case D3DPT_POINTLIST:     return primitiveCount;
+    case D3DPT_LINELIST:      return uint64_t(primitiveCount) * 2;
+    case D3DPT_LINESTRIP:     return uint64_t(primitiveCount) + 1;
+    case D3DPT_TRIANGLELIST:  return uint64_t(primitiveCount) * 3;
+    case D3DPT_TRIANGLESTRIP:
+    case D3DPT_TRIANGLEFAN:   return uint64_t(primitiveCount) + 2;
+    default:                  return 0;
+    }
+}
+
+// 記録したバイト列の大きさが count 個の elementSize バイトの要素と一致するか. 掛け算は桁あふれし得るので割って比べる.
+bool IsBlobSize(size_t size, uint64_t count, uint64_t elementSize)
+{
+    if (elementSize == 0)
+    {
+        return size == 0;
+    }
+    return size % elementSize == 0 && size / elementSize == count;
+}
+}
+
+TraceReplayer::TraceReplayer()
+    : m_device(nullptr), m_filter(false), m_objectCommands(0)
+{
+    memset(&m_shadow, 0, sizeof(m_shadow));
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+bool TraceReplayer::Replay(IDirect3DDevice9Ex* device, const uint8_t* data, size_t size, bool filterRedundantState)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    m_device = device;
+    m_filter = filterRedundantState;
+    m_objectCommands = 0;
+    memset(&m_shadow, 0, sizeof(m_shadow));
+    memset(&m_stats, 0, sizeof(m_stats));
+    for (auto& histogram : m_callHistograms)
+    {
+        histogram.Clear();
+    }
+    m_frameHistogram.Clear();
+
+    CommandTraceReader reader(data, size);
+    const auto begin = Clock::now();
+    auto frameBegin = begin;
+    int opcode;
+    while (reader.ReadOpcode(opcode))
+    {
+        const auto callBegin = Clock::now();
+        const bool executed = Execute(opcode, reader);
+        const auto callEnd = Clock::now();
+        if (reader.HasError())
+        {
+            break;
+        }
+
+        m_stats.calls++;
+        if (executed)
+        {
+            m_callHistograms[opcode].Add(std::chrono::duration<double, std::nano>(callEnd - callBegin).count());
+        }
+        else
+        {
+            m_stats.filtered++;
+        }
+        if (opcode == CommandTrace::Present)
+        {
+            m_stats.frames++;
+            m_frameHistogram.Add(std::chrono::duration<double, std::nano>(callEnd - frameBegin).count());
+            frameBegin = callEnd;
+        }
+    }
+    m_stats.totalMsec = std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+
+    ReleaseObjects();
+    m_device = nullptr;
+    return !reader.HasError();
+}
+
+// 番号は記録した順に 1 から振られ, オブジェクトを作成する呼び出しごとに高々 1 つずつ増える.
+// それまでの呼び出しの数を超える番号は壊れたトレースにしか現れず, そのまま配列を広げると
+// 0xFFFFFFFF で桁あふれしたり, 大きな番号で巨大なメモリを確保したりする.
+bool TraceReplayer::CheckNewObjectId(CommandTraceReader& reader, uint32_t id)
+{
+    ++m_objectCommands;
+    if (reader.HasError() || id == 0 || id > m_objectCommands)
+    {
+        reader.SetError();
+        return false;
+    }
+    return true;
+}
+
+void TraceReplayer::SetObject(uint32_t id, IUnknown* object)
+{
+    if (id >= m_objects.size())
+    {
+        m_objects.resize(id + 1, nullptr);
+    }
+    if (m_objects[id])
+    {
+        m_objects[id]->Release();
+    }
+    m_objects[id] = object;
+}
+
+void TraceReplayer::ReleaseObjects()
+{
+    for (auto object : m_objects)
+    {
+        if (object)
+        {
+            object->Release();
+        }
+    }
+    m_objects.clear();
+}
+
+void TraceReplayer::CheckResult(HRESULT hr)
+{
+    if (FAILED(hr))
+    {
+        m_stats.failed++;
+    }
+}
+
+bool TraceReplayer::IsRedundant(ShadowValue& shadow, uint32_t value)
+{
+    if (!m_filter)
+    {
+        return false;
+    }
+    if (shadow.known && shadow.value == value)
+    {
+        return true;
+    }
+    shadow.known = true;
+    shadow.value = value;
+    return false;
+}
+
+// 範囲の全てのレジスタが同じ値なら true. そうでなければ範囲全体を更新する.
+bool TraceReplayer::IsRedundantConstant(bool* known, float (*constants)[4], uint32_t start, const uint8_t* data, size_t size)
+{
+    const size_t count = size / sizeof(constants[0]);
+    if (!m_filter || start >= MaxShaderConstants || count > size_t(MaxShaderConstants - start))
+    {
+        return false;
+    }
+    bool redundant = true;
+    for (size_t i = 0; i < count && redundant; ++i)
+    {
+        redundant = known[start + i];
+    }
+    if (redundant && memcmp(constants[start], data, count * sizeof(constants[0])) == 0)
+    {
+        return true;
+    }
+    memcpy(constants[start], data, count * sizeof(constants[0]));
+    for (size_t i = 0; i < count; ++i)
+    {
+        known[start + i] = true;
+    }
+    return false;
+}
+
+bool TraceReplayer::Execute(int opcode, CommandTraceReader& reader)
+{
+    // 引数は記録した順に読み出す. 関数の引数の中で読むと評価順が決まらないため, 先に変数へ受ける.
+    switch (opcode)
+    {
+    case CommandTrace::Present:
+        {
+            const DWORD flags = reader.ReadUInt();
+            if (reader.HasError())
+            {
+                break;
+            }
+            CheckResult(m_device->PresentEx(nullptr, nullptr, nullptr, nullptr, flags));
+        }
+        break;
+
+    case CommandTrace::BeginScene:
+        CheckResult(m_device->BeginScene());
+        break;
+
+    case CommandTrace::EndScene:
+        CheckResult(m_device->EndScene());
+        break;
+
+    case CommandTrace::Clear:
+        {
+            const DWORD flags = reader.ReadUInt();
+            const D3DCOLOR color = reader.ReadUInt();
+            const float z = reader.ReadFloat();
+            const DWORD stencil = reader.ReadUInt();
+            if (reader.HasError())
+            {
+                break;
+            }
+            CheckResult(m_device->Clear(0, nullptr, flags, color, z, stencil));
+        }
+        break;
+
+    case CommandTrace::CreateVertexBuffer:
+        {
+            const uint32_t id = reader.ReadUInt();
+            const UINT length = reader.ReadUInt();
+            const DWORD usage = reader.ReadUInt();
+            const DWORD fvf = reader.ReadUInt();
+            const D3DPOOL pool = D3DPOOL(reader.ReadUInt());
+            if (!CheckNewObjectId(reader, id))
+            {
+                break;
+            }
+            IDirect3DVertexBuffer9* buffer = nullptr;
+            CheckResult(m_device->CreateVertexBuffer(length, usage, fvf, pool, &buffer, nullptr));
+            SetObject(id, buffer);
+        }
+        break;
+
+    case CommandTrace::CreateIndexBuffer:
+        {
+            const uint32_t id = reader.ReadUInt();
+            const UINT length = reader.ReadUInt();
+            const DWORD usage = reader.ReadUInt();
+            const D3DFORMAT format = D3DFORMAT(reader.ReadUInt());
+            const D3DPOOL pool = D3DPOOL(reader.ReadUInt());
+            if (!CheckNewObjectId(reader, id))
+            {
+                break;
+            }
+            IDirect3DIndexBuffer9* buffer = nullptr;
+            CheckResult(m_device->CreateIndexBuffer(length, usage, format, pool, &buffer, nullptr));
+            SetObject(id, buffer);
+        }
+        break;
+
+    case CommandTrace::CreateTexture:
+        {
+            const uint32_t id = reader.ReadUInt();
+            const UINT width = reader.ReadUInt();
+            const UINT height = reader.ReadUInt();
+            const UINT levels = reader.ReadUInt();
+            const DWORD usage = reader.ReadUInt();
+            const D3DFORMAT format = D3DFORMAT(reader.ReadUInt());
+            const D3DPOOL pool = D3DPOOL(reader.ReadUInt());
+            if (!CheckNewObjectId(reader, id))
+            {
+                break;
+            }
+            IDirect3DTexture9* texture = nullptr;
+            CheckResult(m_device->CreateTexture(width, height, levels, usage, format, pool, &texture, nullptr));
+            SetObject(id, texture);
+        }
+        break;
+
+    case CommandTrace::CreateRenderTarget:
+    case CommandTrace::CreateDepthStencilSurface:
+        {
+            const uint32_t id = reader.ReadUInt();
+            const UINT width = reader.ReadUInt();
+            const UINT height = reader.ReadUInt();
+            const D3DFORMAT format = D3DFORMAT(reader.ReadUInt());
+            const D3DMULTISAMPLE_TYPE multiSample = D3DMULTISAMPLE_TYPE(reader.ReadUInt());
+            const DWORD quality = reader.ReadUInt();
+            const BOOL flag = reader.ReadUInt();
+            if (!CheckNewObjectId(reader, id))
+            {
+                break;
+            }
+            IDirect3DSurface9* surface = nullptr;
+            if (opcode == CommandTrace::CreateRenderTarget)
+            {
+                CheckResult(m_device->CreateRenderTarget(width, height, format, multiSample, quality, flag, &surface, nullptr));
+            }
+            else
+            {
+                CheckResult(m_device->CreateDepthStencilSurface(width, height, format, multiSample, quality, flag, &surface, nullptr));
+            }
+            SetObject(id, surface);
+        }
+        break;
+
+    case CommandTrace::CreateOffscreenPlainSurface:
+        {
+            const uint32_t id = reader.ReadUInt();
+            const UINT width = reader.ReadUInt();
+            const UINT height = reader.ReadUInt();
+            const D3DFORMAT format = D3DFORMAT(reader.ReadUInt());
+            const D3DPOOL pool = D3DPOOL(reader.ReadUInt());
+            if (!CheckNewObjectId(reader, id))
+            {
+                break;
+            }
+            IDirect3DSurface9* surface = nullptr;
+            CheckResult(m_device->CreateOffscreenPlainSurface(width, height, format, pool, &surface, nullptr));
+            SetObject(id, surface);
+        }
+        break;
+
+    case CommandTrace::CreateVertexDeclaration:
+    case CommandTrace::CreateVertexShader:
+    case CommandTrace::CreatePixelShader:
+        {
+            const uint32_t id = reader.ReadUInt();
+            size_t size;
+            const uint8_t* bytes = reader.ReadBytes(size);
+            if (!CheckNewObjectId(reader, id))
+            {
+                break;
+            }
+            if (opcode == CommandTrace::CreateVertexDeclaration)
+            {
+                // D3DDECL_END() までの要素の配列で, デバイスは終端まで読み進める.
+                const size_t elementSize = sizeof(D3DVERTEXELEMENT9);
+                WORD lastStream = 0;
+                if (size != 0 && size % elementSize == 0)
+                {
+                    memcpy(&lastStream, bytes + size - elementSize, sizeof(lastStream));
+                }
+                if (lastStream != 0xFF)
+                {
+                    reader.SetError();
+                    break;
+                }
+            }
+            if (size == 0)
+            {
+                break;
+            }
+            m_scratch.resize((size + 3) / 4);
+            memcpy(m_scratch.data(), bytes, size);
+            if (opcode == CommandTrace::CreateVertexDeclaration)
+            {
+                IDirect3DVertexDeclaration9* decl = nullptr;
+                CheckResult(m_device->CreateVertexDeclaration(reinterpret_cast<const D3DVERTEXELEMENT9*>(m_scratch.data()), &decl));
+                SetObject(id, decl);
+            }
+            else if (opcode == CommandTrace::CreateVertexShader)
+            {
+                IDirect3DVertexShader9* shader = nullptr;
+                CheckResult(m_device->CreateVertexShader(reinterpret_cast<const DWORD*>(m_scratch.data()), &shader));
+                SetObject(id, shader);
+            }
+            else
+            {
+                IDirect3DPixelShader9* shader = nullptr;
+                CheckResult(m_device->CreatePixelShader(reinterpret_cast<const DWORD*>(m_scratch.data()), &shader));
+                SetObject(id, shader);
+            }
+        }
+        break;
+
+    case CommandTrace::GetSurfaceLevel:
+        {
+            const uint32_t id = reader.ReadUInt();
+            IDirect3DTexture9* texture = Find<IDirect3DTexture9>(reader.ReadUInt());
+            const UINT level = reader.ReadUInt();
+            if (!CheckNewObjectId(reader, id))
+            {
+                break;
+            }
+            IDirect3DSurface9* surface = nullptr;
+            CheckResult(texture ? texture->GetSurfaceLevel(level, &surface) : D3DERR_INVALIDCALL);
+            SetObject(id, surface);
+        }
+        break;
+
+    case CommandTrace::GetRenderTarget:
+        {
+            const uint32_t id = reader.ReadUInt();
+            const DWORD index = reader.ReadUInt();
+            if (!CheckNewObjectId(reader, id))
+            {
+                break;
+            }
+            IDirect3DSurface9* surface = nullptr;
+            CheckResult(m_device->GetRenderTarget(index, &surface));
+            SetObject(id, surface);
+        }
+        break;
+
+    case CommandTrace::GetDepthStencilSurface:
+        {
+            const uint32_t id = reader.ReadUInt();
+            if (!CheckNewObjectId(reader, id))
+            {
+                break;
+            }
+            IDirect3DSurface9* surface = nullptr;
+            CheckResult(m_device->GetDepthStencilSurface(&surface));
+            SetObject(id, surface);
+        }
+        break;
+
+    case CommandTrace::GetBackBuffer:
+        {
+            const uint32_t id = reader.ReadUInt();
+            const UINT swapChain = reader.ReadUInt();
+            const UINT backBuffer = reader.ReadUInt();
+            if (!CheckNewObjectId(reader, id))
+            {
+                break;
+            }
+            IDirect3DSurface9* surface = nullptr;
+            CheckResult(m_device->GetBackBuffer(swapChain, backBuffer, D3DBACKBUFFER_TYPE_MONO, &surface));
+            SetObject(id, surface);
+        }
+        break;
+
+    case CommandTrace::UpdateBuffer:
+        {
+            IDirect3DResource9* resource = Find<IDirect3DResource9>(reader.ReadUInt());
+            const UINT offset = reader.ReadUInt();
+            const DWORD flags = reader.ReadUInt();
+            size_t size;
+            const uint8_t* bytes = reader.ReadBytes(size);
+            if (reader.HasError() || !resource)
+            {
+                break;
+            }
+            void* p = nullptr;
+            HRESULT hr;
+            if (resource->GetType() == D3DRTYPE_VERTEXBUFFER)
+            {
+                IDirect3DVertexBuffer9* buffer = static_cast<IDirect3DVertexBuffer9*>(resource);
+                hr = buffer->Lock(offset, UINT(size), &p, flags);
+                if (SUCCEEDED(hr))
+                {
+                    memcpy(p, bytes, size);
+                    buffer->Unlock();
+                }
+            }
+            else
+            {
+                IDirect3DIndexBuffer9* buffer = static_cast<IDirect3DIndexBuffer9*>(resource);
+                hr = buffer->Lock(offset, UINT(size), &p, flags);
+                if (SUCCEEDED(hr))
+                {
+                    memcpy(p, bytes, size);
+                    buffer->Unlock();
+                }
+            }
+            CheckResult(hr);
+        }
+        break;
+
+    case CommandTrace::UpdateTextureLevel:
+        {
+            IDirect3DTexture9* texture = Find<IDirect3DTexture9>(reader.ReadUInt());
+            const UINT level = reader.ReadUInt();
+            const UINT rowBytes = reader.ReadUInt();
+            const UINT rows = reader.ReadUInt();
+            size_t size;
+            const uint8_t* bytes = reader.ReadBytes(size);
+            if (reader.HasError() || !texture || size < size_t(rowBytes) * rows)
+            {
+                break;
+            }
+            D3DLOCKED_RECT locked;
+            HRESULT hr = texture->LockRect(level, &locked, nullptr, 0);
+            if (SUCCEEDED(hr))
+            {
+                for (UINT y = 0; y < rows; ++y)
+                {
+                    memcpy(static_cast<uint8_t*>(locked.pBits) + size_t(y) * locked.Pitch, bytes + size_t(y) * rowBytes, rowBytes);
+                }
+                texture->UnlockRect(level);
+            }
+            CheckResult(hr);
+        }
+        break;
+
+    case CommandTrace::UpdateTexture:
+        {
+            IDirect3DBaseTexture9* source = Find<IDirect3DBaseTexture9>(reader.ReadUInt());
+            IDirect3DBaseTexture9* dest = Find<IDirect3DBaseTexture9>(reader.ReadUInt());
+            if (reader.HasError())
+            {
+                break;
+            }
+            CheckResult(m_device->UpdateTexture(source, dest));
+        }
+        break;
+
+    case CommandTrace::StretchRect:
+        {
+            IDirect3DSurface9* source = Find<IDirect3DSurface9>(reader.ReadUInt());
+            IDirect3DSurface9* dest = Find<IDirect3DSurface9>(reader.ReadUInt());
+            const D3DTEXTUREFILTERTYPE filter = D3DTEXTUREFILTERTYPE(reader.ReadUInt());
+            if (reader.HasError())
+            {
+                break;
+            }
+            CheckResult(m_device->StretchRect(source, nullptr, dest, nullptr, filter));
+        }
+        break;
+
+    case CommandTrace::GetRenderTargetData:
+        {
+            IDirect3DSurface9* source = Find<IDirect3DSurface9>(reader.ReadUInt());
+            IDirect3DSurface9* dest = Find<IDirect3DSurface9>(reader.ReadUInt());
+            if (reader.HasError())
+            {
+                break;
+            }
+            CheckResult(m_device->GetRenderTargetData(source, dest));
+        }
+        break;
+
+    case CommandTrace::ColorFill:
+        {
+            IDirect3DSurface9* surface = Find<IDirect3DSurface9>(reader.ReadUInt());
+            const D3DCOLOR color = reader.ReadUInt();
+            if (reader.HasError())
+            {
+                break;
+            }
+            CheckResult(m_device->ColorFill(surface, nullptr, color));
+        }
+        break;
+
+    case CommandTrace::SetRenderTarget:
+        {
+            const DWORD index = reader.ReadUInt();
+            IDirect3DSurface9* surface = Find<IDirect3DSurface9>(reader.ReadUInt());
+            if (reader.HasError())
+            {
+                break;
+            }
+            CheckResult(m_device->SetRenderTarget(index, surface));
+        }
+        break;
+
+    case CommandTrace::SetDepthStencilSurface:
+        {
+            IDirect3DSurface9* surface = Find<IDirect3DSurface9>(reader.ReadUInt());
+            if (reader.HasError())
+            {
+                break;
+            }
+            CheckResult(m_device->SetDepthStencilSurface(surface));
+        }
+        break;
+
+    case CommandTrace::SetViewport:
+        {
+            D3DVIEWPORT9 vp;
+            vp.X = reader.ReadUInt();
+            vp.Y = reader.ReadUInt();
+            vp.Width = reader.ReadUInt();
+            vp.Height = reader.ReadUInt();
+            vp.MinZ = reader.ReadFloat();
+            vp.MaxZ = reader.ReadFloat();
+            if (reader.HasError())
+            {
+                break;
+            }
+            CheckResult(m_device->SetViewport(&vp));
+        }
+        break;
+
+    case CommandTrace::SetScissorRect:
+        {
+            RECT rect;
+            rect.left = reader.ReadInt();
+            rect.top = reader.ReadInt();
+            rect.right = reader.ReadInt();
+            rect.bottom = reader.ReadInt();
+            if (reader.HasError())
+            {
+                break;
+            }
+            CheckResult(m_device->SetScissorRect(&rect));
+        }
+        break;
+
+    case CommandTrace::SetRenderState:
+        {
+            const uint32_t state = reader.ReadUInt();
+            const DWORD value = reader.ReadUInt();
+            if (reader.HasError())
+            {
+                break;
+            }
+            if (state < MaxRenderStates && IsRedundant(m_shadow.renderStates[state], value))
+            {
+                return false;
+            }
+            CheckResult(m_device->SetRenderState(D3DRENDERSTATETYPE(state), value));
+        }
+        break;
+
+    case CommandTrace::SetSamplerState:
+        {
+            const uint32_t sampler = reader.ReadUInt();
+            const uint32_t type = reader.ReadUInt();
+            const DWORD value = reader.ReadUInt();
+            if (reader.HasError())
+            {
+                break;
+            }
+            const int index = GetSamplerIndex(sampler);
+            if (index >= 0 && type < MaxSamplerStates && IsRedundant(m_shadow.samplerStates[index][type], value))
+            {
+                return false;
+            }
+            CheckResult(m_device->SetSamplerState(sampler, D3DSAMPLERSTATETYPE(type), value));
+        }
+        break;
+
+    case CommandTrace::SetTextureStageState:
+        {
+            const DWORD stage = reader.ReadUInt();
+            const D3DTEXTURESTAGESTATETYPE type = D3DTEXTURESTAGESTATETYPE(reader.ReadUInt());
+            const DWORD value = reader.ReadUInt();
+            if (reader.HasError())
+            {
+                break;
+            }
+            CheckResult(m_device->SetTextureStageState(stage, type, value));
+        }
+        break;
+
+    case CommandTrace::SetTexture:
+        {
+            const uint32_t stage = reader.ReadUInt();
+            const uint32_t id = reader.ReadUInt();
+            if (reader.HasError())
+            {
+                break;
+            }
+            const int index = GetSamplerIndex(stage);
+            if (index >= 0 && IsRedundant(m_shadow.textures[index], id))
+            {
+                return false;
+            }
+            CheckResult(m_device->SetTexture(stage, Find<IDirect3DBaseTexture9>(id)));
+        }
+        break;
+
+    case CommandTrace::SetTransform:
+        {
+            const D3DTRANSFORMSTATETYPE state = D3DTRANSFORMSTATETYPE(reader.ReadUInt());
+            D3DMATRIX matrix;
+            for (int i = 0; i < 16; ++i)
+            {
+                matrix.m[i / 4][i % 4] = reader.ReadFloat();
+            }
+            if (reader.HasError())
+            {
+                break;
+            }
+            CheckResult(m_device->SetTransform(state, &matrix));
+        }
+        break;
+
+    case CommandTrace::SetVertexDeclaration:
+        {
+            const uint32_t id = reader.ReadUInt();
+            if (reader.HasError())
+            {
+                break;
+            }
+            if (IsRedundant(m_shadow.decl, id))
+            {
+                return false;
+            }
+            // 頂点宣言を設定すると FVF も変わる.
+            m_shadow.fvf.known = false;
+            CheckResult(m_device->SetVertexDeclaration(Find<IDirect3DVertexDeclaration9>(id)));
+        }
+        break;
+
+    case CommandTrace::SetFVF:
+        {
+            const DWORD fvf = reader.ReadUInt();
+            if (reader.HasError())
+            {
+                break;
+            }
+            if (IsRedundant(m_shadow.fvf, fvf))
+            {
+                return false;
+            }
+            m_shadow.decl.known = false;
+            CheckResult(m_device->SetFVF(fvf));
+        }
+        break;
+
+    case CommandTrace::SetVertexShader:
+        {
+            const uint32_t id = reader.ReadUInt();
+            if (reader.HasError())
+            {
+                break;
+            }
+            if (IsRedundant(m_shadow.vs, id))
+            {
+                return false;
+            }
+            CheckResult(m_device->SetVertexShader(Find<IDirect3DVertexShader9>(id)));
+        }
+        break;
+
+    case CommandTrace::SetPixelShader:
+        {
+            const uint32_t id = reader.ReadUInt();
+            if (reader.HasError())
+            {
+                break;
+            }
+            if (IsRedundant(m_shadow.ps, id))
+            {
+                return false;
+            }
+            CheckResult(m_device->SetPixelShader(Find<IDirect3DPixelShader9>(id)));
+        }
+        break;
+
+    case CommandTrace::SetVertexShaderConstantF:
+    case CommandTrace::SetVertexShaderConstantI:
+    case CommandTrace::SetVertexShaderConstantB:
+    case CommandTrace::SetPixelShaderConstantF:
+    case CommandTrace::SetPixelShaderConstantI:
+    case CommandTrace::SetPixelShaderConstantB:
+        {
+            const UINT start = reader.ReadUInt();
+            size_t size;
+            const uint8_t* bytes = reader.ReadBytes(size);
+            if (reader.HasError())
+            {
+                break;
+            }
+            if (opcode == CommandTrace::SetVertexShaderConstantF &&
+                IsRedundantConstant(m_shadow.vsConstantKnown, m_shadow.vsConstants, start, bytes, size))
+            {
+                return false;
+            }
+            if (opcode == CommandTrace::SetPixelShaderConstantF &&
+                IsRedundantConstant(m_shadow.psConstantKnown, m_shadow.psConstants, start, bytes, size))
+            {
+                return false;
+            }
+            m_scratch.resize(size / 4 + 1);
+            memcpy(m_scratch.data(), bytes, size);
+            const void* p = m_scratch.data();
+            HRESULT hr;
+            switch (opcode)
+            {
+            case CommandTrace::SetVertexShaderConstantF:
+                hr = m_device->SetVertexShaderConstantF(start, static_cast<const float*>(p), UINT(size / 16));
+                break;
+            case CommandTrace::SetVertexShaderConstantI:
+                hr = m_device->SetVertexShaderConstantI(start, static_cast<const int*>(p), UINT(size / 16));
+                break;
+            case CommandTrace::SetVertexShaderConstantB:
+                hr = m_device->SetVertexShaderConstantB(start, static_cast<const BOOL*>(p), UINT(size / sizeof(BOOL)));
+                break;
+            case CommandTrace::SetPixelShaderConstantF:
+                hr = m_device->SetPixelShaderConstantF(start, static_cast<const float*>(p), UINT(size / 16));
+                break;
+            case CommandTrace::SetPixelShaderConstantI:
+                hr = m_device->SetPixelShaderConstantI(start, static_cast<const int*>(p), UINT(size / 16));
+                break;
+            default:
+                hr = m_device->SetPixelShaderConstantB(start, static_cast<const BOOL*>(p), UINT(size / sizeof(BOOL)));
+                break;
+            }
+            CheckResult(hr);
+        }
+        break;
+
+    case CommandTrace::SetStreamSource:
+        {
+            const UINT stream = reader.ReadUInt();
+            const uint32_t id = reader.ReadUInt();
+            const UINT offset = reader.ReadUInt();
+            const UINT stride = reader.ReadUInt();
+            if (reader.HasError())
+            {
+                break;
+            }
+            if (m_filter && stream < MaxStreams)
+            {
+                ShadowStream& shadow = m_shadow.streams[stream];
+                if (shadow.known && shadow.id == id && shadow.offset == offset && shadow.stride == stride)
+                {
+                    return false;
+                }
+                shadow.known = true;
+                shadow.id = id;
+                shadow.offset = offset;
+                shadow.stride = stride;
+            }
+            CheckResult(m_device->SetStreamSource(stream, Find<IDirect3DVertexBuffer9>(id), offset, stride));
+        }
+        break;
+
+    case CommandTrace::SetStreamSourceFreq:
+        {
+            const UINT stream = reader.ReadUInt();
+            const UINT setting = reader.ReadUInt();
+            if (reader.HasError())
+            {
+                break;
+            }
+            CheckResult(m_device->SetStreamSourceFreq(stream, setting));
+        }
+        break;
+
+    case CommandTrace::SetIndices:
+        {
+            const uint32_t id = reader.ReadUInt();
+            if (reader.HasError())
+            {
+                break;
+            }
+            if (IsRedundant(m_shadow.indices, id))
+            {
+                return false;
+            }
+            CheckResult(m_device->SetIndices(Find<IDirect3DIndexBuffer9>(id)));
+        }
+        break;
+
+    case CommandTrace::DrawPrimitive:
+        {
+            const D3DPRIMITIVETYPE type = D3DPRIMITIVETYPE(reader.ReadUInt());
+            const UINT startVertex = reader.ReadUInt();
+            const UINT primitiveCount = reader.ReadUInt();
+            if (reader.HasError())
+            {
+                break;
+            }
+            CheckResult(m_device->DrawPrimitive(type, startVertex, primitiveCount));
+        }
+        break;
+
+    case CommandTrace::DrawIndexedPrimitive:
+        {
+            const D3DPRIMITIVETYPE type = D3DPRIMITIVETYPE(reader.ReadUInt());
+            const INT baseVertex = reader.ReadInt();
+            const UINT minIndex = reader.ReadUInt();
+            const UINT numVertices = reader.ReadUInt();
+            const UINT startIndex = reader.ReadUInt();
+            const UINT primitiveCount = reader.ReadUInt();
+            if (reader.HasError())
+            {
+                break;
+            }
+            CheckResult(m_device->DrawIndexedPrimitive(type, baseVertex, minIndex, numVertices, startIndex, primitiveCount));
+        }
+        break;
+
+    case CommandTrace::DrawPrimitiveUP:
+        {
+            const D3DPRIMITIVETYPE type = D3DPRIMITIVETYPE(reader.ReadUInt());
+            const UINT primitiveCount = reader.ReadUInt();
+            const UINT stride = reader.ReadUInt();
+            size_t size;
+            const uint8_t* vertices = reader.ReadBytes(size);
+            // デバイスは引数から求めた大きさだけ読むので, 記録した頂点の大きさと一致しなければ実行しない.
+            if (!reader.HasError() && !IsBlobSize(size, GetVertexCount(type, primitiveCount), stride))
+            {
+                reader.SetError();
+            }
+            if (reader.HasError())
+            {
+                break;
+            }
+            CheckResult(m_device->DrawPrimitiveUP(type, primitiveCount, vertices, stride));
+        }
+        break;
+
+    case CommandTrace::DrawIndexedPrimitiveUP:
+        {
+            const D3DPRIMITIVETYPE type = D3DPRIMITIVETYPE(reader.ReadUInt());
+            const UINT minIndex = reader.ReadUInt();
+            const UINT numVertices = reader.ReadUInt();
+            const UINT primitiveCount = reader.ReadUInt();
+            const D3DFORMAT indexFormat = D3DFORMAT(reader.ReadUInt());
+            const UINT stride = reader.ReadUInt();
+            size_t indexSize, vertexSize;
+            const uint8_t* indices = reader.ReadBytes(indexSize);
+            const uint8_t* vertices = reader.ReadBytes(vertexSize);
+            // 頂点は先頭から minIndex + numVertices 個が記録されている.
+            const uint64_t vertexEnd = uint64_t(minIndex) + numVertices;
+            const uint64_t bytesPerIndex = indexFormat == D3DFMT_INDEX32 ? 4 : 2;
+            if (!reader.HasError()
+                && (!IsBlobSize(indexSize, GetVertexCount(type, primitiveCount), bytesPerIndex)
+                    || !IsBlobSize(vertexSize, vertexEnd, stride)))
+            {
+                reader.SetError();
+            }
+            // インデックスも記録した頂点の外を指してはいけない.
+            for (size_t offset = 0; !reader.HasError() && offset < indexSize; offset += size_t(bytesPerIndex))
+            {
+                uint32_t index = 0;
+                memcpy(&index, indices + offset, size_t(bytesPerIndex));
+                if (index >= vertexEnd)
+                {
+                    reader.SetError();
+                }
+            }
+            if (reader.HasError())
+            {
+                break;
+            }
+            CheckResult(m_device->DrawIndexedPrimitiveUP(type, minIndex, numVertices, primitiveCount, indices, indexFormat, vertices, stride));
+        }
+        break;
+
+    default:
+        break;
+    }
+    return true;
+}
+
+std::string TraceReplayer::Report() const
+{
+    char buf[256];
+    snprintf(buf, sizeof(buf),
+        "Trace replay: %d frames, %llu calls (%llu filtered, %llu failed), %.3f ms/frame (p50 %.3f ms, p99 %.3f ms)\n",
+        m_stats.frames, (unsigned long long)m_stats.calls, (unsigned long long)m_stats.filtered,
+        (unsigned long long)m_stats.failed, m_stats.frames > 0 ? m_stats.totalMsec / m_stats.frames : 0.0,
+        m_frameHistogram.GetPercentileNs(0.5) / 1000000.0, m_frameHistogram.GetPercentileNs(0.99) / 1000000.0);
+    std::string report = buf;
+    for (int i = 0; i < CommandTrace::OpcodeCount; ++i)
+    {
+        const LatencyHistogram& histogram = m_callHistograms[i];
+        if (histogram.GetCount() == 0)
+        {
+            continue;
+        }
+        snprintf(buf, sizeof(buf), "  %-28s %8llu calls %9.3f ms  p50 %8.0f ns  p99 %8.0f ns  max %8.0f ns  ",
+            CommandTrace::GetOpcodeName(i), (unsigned long long)histogram.GetCount(), histogram.GetTotalNs() / 1000000.0,
+            histogram.GetPercentileNs(0.5), histogram.GetPercentileNs(0.99), histogram.GetMaxNs());
+        report += buf;
+        report += histogram.Format();
+        report += "\n";
+    }
+    return report;
+}
@@ -0,0 +1,106 @@
+﻿#pragma once
+#include <d3d9.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "CommandTrace.h"
+
+// TraceDevice で記録したトレースを任意のデバイスに再生し, 呼び出しごとの処理時間を集計するクラス.
+// NullDevice に再生すれば, 同じ呼び出しの列でドライバーに渡す前の最適化を比べられます.
+//
+// filterRedundantState なら, 直前と同じ値を設定するステートの呼び出しを省きます.
+// 対象はレンダーステート, サンプラーステート, テクスチャ, ストリーム, インデックス, 頂点宣言, FVF,
+// シェーダー, float のシェーダー定数です. 再生の開始時の値は分からないため, 最初の設定は必ず行います.
+//
+// 処理時間は引数の読み込みを含めて計り, 省いた呼び出しは含めません.
+// フレームの時間は Present から次の Present までです.
+class TraceReplayer
+{
+public:
+    struct Stats
+    {
+        int frames;
+        uint64_t calls;         // 再生した呼び出し (省いたものを含む).
+        uint64_t filtered;      // 同じ値のため省いた呼び出し.
+        uint64_t failed;        // デバイスがエラーを返した呼び出し.
+        double totalMsec;
+    };
+
+    TraceReplayer();
+
+    // 作成したオブジェクトは最後に全て解放します. トレースが壊れていれば途中で止めて false を返します.
+    bool Replay(IDirect3DDevice9Ex* device, const uint8_t* data, size_t size, bool filterRedundantState);
+
+    const Stats& GetStats() const { return m_stats; }
+    const LatencyHistogram& GetCallHistogram(int opcode) const { return m_callHistograms[opcode]; }
+    const LatencyHistogram& GetFrameHistogram() const { return m_frameHistogram; }
+    std::string Report() const;
+
+private:
+    TraceReplayer(const TraceReplayer&);
+    TraceReplayer& operator=(const TraceReplayer&);
+
+    static const int MaxSamplers = 16 + 4;  // ピクセル 16 + 頂点テクスチャ 4.
+    static const int MaxSamplerStates = 14;
+    static const int MaxRenderStates = 256;
+    static const int MaxStreams = 16;
+    static const int MaxShaderConstants = 256;
+
+    // 設定済みの値. known が false の間は必ず設定する.
+    struct ShadowValue
+    {
+        bool known;
+        uint32_t value;
+    };
+    struct ShadowStream
+    {
+        bool known;
+        uint32_t id;
+        uint32_t offset;
+        uint32_t stride;
+    };
+    struct ShadowState
+    {
+        ShadowValue renderStates[MaxRenderStates];
+        ShadowValue samplerStates[MaxSamplers][MaxSamplerStates];
+        ShadowValue textures[MaxSamplers];
+        ShadowStream streams[MaxStreams];
+        ShadowValue indices;
+        ShadowValue decl;
+        ShadowValue fvf;
+        ShadowValue vs;
+        ShadowValue ps;
+        bool vsConstantKnown[MaxShaderConstants];
+        bool psConstantKnown[MaxShaderConstants];
+        float vsConstants[MaxShaderConstants][4];
+        float psConstants[MaxShaderConstants][4];
+    };
+
+    // 呼び出しを 1 つ実行する. 省いた場合は false を返す.
+    bool Execute(int opcode, CommandTraceReader& reader);
+    // 作成するオブジェクトの番号を確かめる. 不正ならトレースが壊れているとして reader をエラーにし, false を返す.
+    bool CheckNewObjectId(CommandTraceReader& reader, uint32_t id);
+    void SetObject(uint32_t id, IUnknown* object);
+    template<class T>
+    T* Find(uint32_t id) const
+    {
+        return id < m_objects.size() ? static_cast<T*>(m_objects[id]) : nullptr;
+    }
+    void ReleaseObjects();
+    void CheckResult(HRESULT hr);
+
+    bool IsRedundant(ShadowValue& shadow, uint32_t value);
+    bool IsRedundantConstant(bool* known, float (*constants)[4], uint32_t start, const uint8_t* data, size_t size);
+
+    IDirect3DDevice9Ex* m_device;
+    bool m_filter;
+    std::vector<IUnknown*> m_objects;   // 番号ごとのオブジェクト. 0 は nullptr.
+    uint32_t m_objectCommands;          // これまでに再生したオブジェクトを作成する呼び出しの数.
+    std::vector<uint32_t> m_scratch;    // 4 バイト境界にそろえる必要のある引数のコピー.
+    ShadowState m_shadow;
+
+    Stats m_stats;
+    LatencyHistogram m_callHistograms[CommandTrace::OpcodeCount];
+    LatencyHistogram m_frameHistogram;
+};
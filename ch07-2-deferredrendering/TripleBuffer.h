@@ -0,0 +1,58 @@
+﻿#pragma once
+#include <atomic>
+#include <cstdint>
+
+// 1 つのスレッドが書き込んだ最新の値を, 別の 1 つのスレッドが待たずに読むための 3 つのバッファ. D3D には依存しません.
+//
+// 書き込む側は GetWriteBuffer() に書いて Publish() し, 読む側は Update() で最新のものに切り替えてから
+// GetReadBuffer() を読みます. 3 つのバッファを書き込み用, 読み込み用, 受け渡し用で回すので,
+// どちらも相手を待たず, 読む側が途中まで書かれた値を見ることもありません.
+// 読む側が間に合わなかった値は捨てられ, 常に最新のものだけが渡ります.
+//
+// 書き込み用のバッファには数回前に渡した値が残っているので, Publish() の前に全体を書き直してください.
+template<class T>
+class TripleBuffer
+{
+public:
+    explicit TripleBuffer(const T& initial = T())
+        : m_writeIndex(0), m_shared(1), m_readIndex(2)
+    {
+        for (auto& buffer : m_buffers)
+        {
+            buffer = initial;
+        }
+    }
+
+    // 書き込む側のスレッドだけが呼び出します.
+    T& GetWriteBuffer() { return m_buffers[m_writeIndex]; }
+    void Publish()
+    {
+        const uint32_t previous = m_shared.exchange(m_writeIndex | FreshFlag, std::memory_order_acq_rel);
+        m_writeIndex = previous & IndexMask;
+    }
+
+    // 読む側のスレッドだけが呼び出します. 新しい値に切り替えれば true を返します.
+    bool Update()
+    {
+        if ((m_shared.load(std::memory_order_relaxed) & FreshFlag) == 0)
+        {
+            return false;
+        }
+        const uint32_t previous = m_shared.exchange(m_readIndex, std::memory_order_acq_rel);
+        m_readIndex = previous & IndexMask;
+        return true;
+    }
+    const T& GetReadBuffer() const { return m_buffers[m_readIndex]; }
+
+private:
+    TripleBuffer(const TripleBuffer&);
+    TripleBuffer& operator=(const TripleBuffer&);
+
+    static const uint32_t IndexMask = 3;
+    static const uint32_t FreshFlag = 4;    // 受け渡し用のバッファにまだ読んでいない値がある.
+
+    T m_buffers[3];
+    uint32_t m_writeIndex;              // 書き込む側だけが使う.
+    std::atomic<uint32_t> m_shared;     // 受け渡し用のバッファの番号と FreshFlag.
+    uint32_t m_readIndex;               // 読む側だけが使う.
+};
@@ -0,0 +1,260 @@
+﻿// CaptureQueue のテスト. tests/run_tests.sh でビルドして実行します.
+//
+// 合成した画像を投入し, 書き出し先を差し替えて書き出された順番と内容を記録します.
+// バッファが足りない場合の破棄, 書き出しの順番, 終了時に残りを書き出すことを確かめます.
+#include "CaptureQueue.h"
+#include "Test.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+const int Width = 16;
+const int Height = 8;
+
+// 書き出された画像の記録. 書き出し先の関数はワーカースレッドから呼ばれる.
+class Recorder
+{
+public:
+    Recorder()
+        : m_blocked(false), m_entered(0), m_delayMsec(0), m_mismatches(0)
+    {
+    }
+
+    CaptureQueue::Writer GetWriter()
+    {
+        return [this](const CaptureQueue::Frame& frame, const std::vector<uint8_t>& encoded)
+        {
+            return Write(frame, encoded);
+        };
+    }
+
+    // Open() するまで書き出しを止める.
+    void Block()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_blocked = true;
+    }
+
+    void Open()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_blocked = false;
+        }
+        m_changed.notify_all();
+    }
+
+    // count 個の画像の書き出しが始まるまで待つ.
+    void WaitEntered(int count)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_changed.wait(lock, [&]() { return m_entered >= count; });
+    }
+
+    std::vector<std::string> GetNames() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_names;
+    }
+
+    int GetMismatches() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_mismatches;
+    }
+
+    void SetDelay(int msec) { m_delayMsec = msec; }
+
+private:
+    bool Write(const CaptureQueue::Frame& frame, const std::vector<uint8_t>& encoded)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_entered++;
+            m_changed.notify_all();
+            m_changed.wait(lock, [this]() { return !m_blocked; });
+        }
+        if (m_delayMsec > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(m_delayMsec));
+        }
+
+        // 画素は名前の番号で塗ってあるので, 別の画像のバッファと取り違えていないかを確かめる.
+        int index = -1;
+        sscanf(frame.fileName.c_str(), "frame%d", &index);
+        bool valid = index >= 0 && frame.width == Width && frame.height == Height;
+        for (size_t i = 0; valid && i < frame.pixels.size(); ++i)
+        {
+            valid = frame.pixels[i] == uint8_t(index);
+        }
+        std::vector<uint8_t> expected;
+        valid = valid && CaptureQueue::Encode(frame, expected) && expected == encoded;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_names.push_back(frame.fileName);
+        m_mismatches += valid ? 0 : 1;
+        return true;
+    }
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_changed;
+    bool m_blocked;
+    int m_entered;
+    int m_delayMsec;
+    int m_mismatches;
+    std::vector<std::string> m_names;
+};
+
+std::string GetName(int index)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "frame%02d", index);
+    return name;
+}
+
+// 番号で塗った画像を投入する. バッファが無ければ false を返す.
+bool SubmitFrame(CaptureQueue& queue, int index, CaptureQueue::Encoding encoding = CaptureQueue::Png)
+{
+    CaptureQueue::Frame* frame = queue.Acquire(Width, Height, PixelConvert::B8G8R8A8);
+    if (!frame)
+    {
+        return false;
+    }
+    memset(frame->pixels.data(), index, frame->pixels.size());
+    frame->fileName = GetName(index);
+    frame->encoding = encoding;
+    queue.Submit(frame);
+    return true;
+}
+
+std::vector<std::string> GetNames(int count)
+{
+    std::vector<std::string> names;
+    for (int i = 0; i < count; ++i)
+    {
+        names.push_back(GetName(i));
+    }
+    return names;
+}
+
+// 全てのバッファが使用中なら Acquire() は待たずに失敗し, 書き出しが終われば再び使える.
+void TestDropWhenFull()
+{
+    Recorder recorder;
+    recorder.Block();
+    CaptureQueue queue(1, 2);
+    queue.SetWriter(recorder.GetWriter());
+
+    // 1 枚目はワーカーが書き出し中, 2 枚目は待ち行列にある.
+    TEST_CHECK(SubmitFrame(queue, 0));
+    recorder.WaitEntered(1);
+    TEST_CHECK(SubmitFrame(queue, 1));
+    TEST_CHECK(!SubmitFrame(queue, 2));
+    TEST_CHECK(!SubmitFrame(queue, 3));
+    TEST_CHECK(queue.GetStats().dropped == 2);
+    TEST_CHECK(queue.GetStats().written == 0);
+
+    // 借りたバッファを Cancel() すれば, 書き出さずに返せる.
+    recorder.Open();
+    queue.Flush();
+    CaptureQueue::Frame* frame = queue.Acquire(Width, Height, PixelConvert::B8G8R8A8);
+    TEST_CHECK(frame != nullptr);
+    queue.Cancel(frame);
+    TEST_CHECK(SubmitFrame(queue, 4));
+    queue.Flush();
+
+    const CaptureQueue::Stats stats = queue.GetStats();
+    TEST_CHECK(stats.submitted == 3);
+    TEST_CHECK(stats.written == 3);
+    TEST_CHECK(stats.dropped == 2);
+    TEST_CHECK(stats.failed == 0);
+    TEST_CHECK(recorder.GetNames() == std::vector<std::string>({ "frame00", "frame01", "frame04" }));
+    TEST_CHECK(recorder.GetMismatches() == 0);
+}
+
+// ワーカーが 1 つなら投入した順に書き出す. 複数なら順番は決まらないが, 全て 1 回ずつ書き出す.
+void TestOrder(int threadCount)
+{
+    const int FrameCount = 32;
+    Recorder recorder;
+    {
+        CaptureQueue queue(threadCount, FrameCount);
+        queue.SetWriter(recorder.GetWriter());
+        for (int i = 0; i < FrameCount; ++i)
+        {
+            // DDS は変換しないので, PNG に混ぜて両方を通す.
+            TEST_CHECK(SubmitFrame(queue, i, (i % 3 == 0) ? CaptureQueue::Dds : CaptureQueue::Png));
+        }
+        queue.Flush();
+
+        const CaptureQueue::Stats stats = queue.GetStats();
+        TEST_CHECK(stats.submitted == FrameCount);
+        TEST_CHECK(stats.written == FrameCount);
+        TEST_CHECK(stats.dropped == 0);
+        TEST_CHECK(stats.bytesWritten > 0);
+    }
+
+    std::vector<std::string> names = recorder.GetNames();
+    if (threadCount > 1)
+    {
+        std::sort(names.begin(), names.end());
+    }
+    TEST_CHECK(names == GetNames(FrameCount));
+    TEST_CHECK(recorder.GetMismatches() == 0);
+}
+
+// デストラクタは待ち行列に残っている画像を全て書き出してからスレッドを終了する.
+void TestDrainOnShutdown()
+{
+    const int FrameCount = 8;
+    Recorder recorder;
+    recorder.SetDelay(2);
+    CaptureQueue* queue = new CaptureQueue(2, FrameCount);
+    queue->SetWriter(recorder.GetWriter());
+    for (int i = 0; i < FrameCount; ++i)
+    {
+        TEST_CHECK(SubmitFrame(*queue, i));
+    }
+    delete queue;
+
+    std::vector<std::string> names = recorder.GetNames();
+    std::sort(names.begin(), names.end());
+    TEST_CHECK(names == GetNames(FrameCount));
+    TEST_CHECK(recorder.GetMismatches() == 0);
+}
+
+// 書き出しに失敗した画像は failed に数え, バッファは再び使える.
+void TestWriteFailure()
+{
+    CaptureQueue queue(1, 1);
+    queue.SetWriter([](const CaptureQueue::Frame&, const std::vector<uint8_t>&) { return false; });
+    TEST_CHECK(SubmitFrame(queue, 0));
+    queue.Flush();
+    TEST_CHECK(SubmitFrame(queue, 1));
+    queue.Flush();
+
+    const CaptureQueue::Stats stats = queue.GetStats();
+    TEST_CHECK(stats.written == 0);
+    TEST_CHECK(stats.failed == 2);
+    TEST_CHECK(stats.bytesWritten == 0);
+}
+}
+
+int main()
+{
+    Test::Run("drop when full", TestDropWhenFull);
+    Test::Run("order (1 thread)", [] { TestOrder(1); });
+    Test::Run("order (4 threads)", [] { TestOrder(4); });
+    Test::Run("drain on shutdown", TestDrainOnShutdown);
+    Test::Run("write failure", TestWriteFailure);
+    return Test::Finish();
+}
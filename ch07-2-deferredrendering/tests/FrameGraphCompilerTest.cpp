@@ -0,0 +1,346 @@
+﻿// FrameGraphCompiler のテスト. tests/run_tests.sh でビルドして実行します.
+#include "FrameGraphCompiler.h"
+#include "Test.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace
+{
+int PositionOf(const FrameGraphCompiler& compiler, int pass)
+{
+    const std::vector<int>& order = compiler.GetExecutionOrder();
+    auto it = std::find(order.begin(), order.end(), pass);
+    return it == order.end() ? -1 : int(it - order.begin());
+}
+
+// App::Render と同じ形. G-Buffer パスが 3 枚に書き込み, ライティングパスがそれを読んでバックバッファへ書く.
+void TestDeferredFrame()
+{
+    FrameGraphCompiler compiler;
+    int backBuffer = compiler.AddResource(true);
+    int pos = compiler.AddResource(false);
+    int normal = compiler.AddResource(false);
+    int diffuse = compiler.AddResource(false);
+
+    int gbuffer = compiler.AddPass(false);
+    compiler.AddWrite(gbuffer, pos);
+    compiler.AddWrite(gbuffer, normal);
+    compiler.AddWrite(gbuffer, diffuse);
+    int lighting = compiler.AddPass(false);
+    compiler.AddRead(lighting, pos);
+    compiler.AddRead(lighting, normal);
+    compiler.AddRead(lighting, diffuse);
+    compiler.AddWrite(lighting, backBuffer);
+
+    TEST_CHECK(compiler.Compile());
+    TEST_CHECK(compiler.GetExecutionOrder() == std::vector<int>({ gbuffer, lighting }));
+    TEST_CHECK(compiler.GetStats().culledPassCount == 0);
+    TEST_CHECK(compiler.GetStats().edgeCount == 3);
+    for (int res : { pos, normal, diffuse })
+    {
+        TEST_CHECK(compiler.GetLifetime(res).first == 0);
+        TEST_CHECK(compiler.GetLifetime(res).last == 1);
+    }
+    TEST_CHECK(compiler.GetLifetime(backBuffer).first == 1);
+}
+
+void TestDeadPassCulling()
+{
+    FrameGraphCompiler compiler;
+    int backBuffer = compiler.AddResource(true);
+    int a = compiler.AddResource(false);
+    int b = compiler.AddResource(false);
+    int unused = compiler.AddResource(false);
+    int debug = compiler.AddResource(false);
+
+    // 誰も読まない unused を作るパスと, そのために a を読むだけのパスは除かれる.
+    int writeA = compiler.AddPass(false);
+    compiler.AddWrite(writeA, a);
+    int writeUnused = compiler.AddPass(false);
+    compiler.AddRead(writeUnused, b);
+    compiler.AddWrite(writeUnused, unused);
+    int writeB = compiler.AddPass(false);
+    compiler.AddWrite(writeB, b);
+    // 出力を参照されなくても副作用のあるパスは残る.
+    int capture = compiler.AddPass(true);
+    compiler.AddWrite(capture, debug);
+    // 必要なリソースへの書き込みは, 前の書き込みも含めて全て残る (ブレンドなどの部分的な更新).
+    int blendA = compiler.AddPass(false);
+    compiler.AddRead(blendA, a);
+    compiler.AddWrite(blendA, a);
+    int present = compiler.AddPass(false);
+    compiler.AddRead(present, a);
+    compiler.AddWrite(present, backBuffer);
+
+    TEST_CHECK(compiler.Compile());
+    TEST_CHECK(!compiler.IsCulled(writeA));
+    TEST_CHECK(compiler.IsCulled(writeUnused));
+    TEST_CHECK(compiler.IsCulled(writeB));
+    TEST_CHECK(!compiler.IsCulled(capture));
+    TEST_CHECK(!compiler.IsCulled(blendA));
+    TEST_CHECK(!compiler.IsCulled(present));
+    TEST_CHECK(compiler.GetStats().culledPassCount == 2);
+    TEST_CHECK(compiler.GetExecutionOrder().size() == 4);
+    TEST_CHECK(PositionOf(compiler, writeA) < PositionOf(compiler, blendA));
+    TEST_CHECK(PositionOf(compiler, blendA) < PositionOf(compiler, present));
+
+    // 除かれたパスだけが使うリソースには寿命が無い.
+    TEST_CHECK(compiler.GetLifetime(b).first == -1);
+    TEST_CHECK(compiler.GetLifetime(unused).first == -1);
+}
+
+void TestReadBeforeWrite()
+{
+    // 書き込まれていないリソースの読み込み.
+    FrameGraphCompiler compiler;
+    int backBuffer = compiler.AddResource(true);
+    int a = compiler.AddResource(false);
+    int pass = compiler.AddPass(false);
+    compiler.AddRead(pass, a);
+    compiler.AddWrite(pass, backBuffer);
+    TEST_CHECK(!compiler.Compile());
+
+    // 後で宣言したパスの書き込みは, 前のパスの読み込みに届かない.
+    compiler.Reset();
+    backBuffer = compiler.AddResource(true);
+    a = compiler.AddResource(false);
+    int reader = compiler.AddPass(false);
+    compiler.AddRead(reader, a);
+    compiler.AddWrite(reader, backBuffer);
+    int writer = compiler.AddPass(true);
+    compiler.AddWrite(writer, a);
+    TEST_CHECK(!compiler.Compile());
+
+    // 外部のリソースは書き込まなくても読める.
+    compiler.Reset();
+    int imported = compiler.AddResource(true);
+    backBuffer = compiler.AddResource(true);
+    pass = compiler.AddPass(false);
+    compiler.AddRead(pass, imported);
+    compiler.AddWrite(pass, backBuffer);
+    TEST_CHECK(compiler.Compile());
+
+    // 除かれるパスの読み込みは調べない.
+    compiler.Reset();
+    backBuffer = compiler.AddResource(true);
+    a = compiler.AddResource(false);
+    int unused = compiler.AddResource(false);
+    pass = compiler.AddPass(false);
+    compiler.AddRead(pass, a);
+    compiler.AddWrite(pass, unused);
+    TEST_CHECK(compiler.Compile());
+    TEST_CHECK(compiler.IsCulled(pass));
+}
+
+void TestCycles()
+{
+    // 読み込みはそれより前に宣言された書き込みを参照するので, 互いに読み書きするパスも循環にはならない.
+    // 後のパスの書き込みは, 前のパスの読み込みが終わるまで待つ (読み込み -> 書き込みの依存).
+    FrameGraphCompiler compiler;
+    int backBuffer = compiler.AddResource(true);
+    int x = compiler.AddResource(false);
+    int y = compiler.AddResource(false);
+    int init = compiler.AddPass(false);
+    compiler.AddWrite(init, x);
+    compiler.AddWrite(init, y);
+    int first = compiler.AddPass(false);
+    compiler.AddRead(first, x);
+    compiler.AddWrite(first, y);
+    int second = compiler.AddPass(false);
+    compiler.AddRead(second, y);
+    compiler.AddWrite(second, x);
+    int present = compiler.AddPass(false);
+    compiler.AddRead(present, x);
+    compiler.AddRead(present, y);
+    compiler.AddWrite(present, backBuffer);
+
+    TEST_CHECK(compiler.Compile());
+    TEST_CHECK(compiler.GetExecutionOrder() == std::vector<int>({ init, first, second, present }));
+
+    // 同じリソースを読んで書き戻すパスの連続 (ピンポン) も一列に並ぶ.
+    compiler.Reset();
+    backBuffer = compiler.AddResource(true);
+    x = compiler.AddResource(false);
+    init = compiler.AddPass(false);
+    compiler.AddWrite(init, x);
+    for (int i = 0; i < 10; ++i)
+    {
+        int pass = compiler.AddPass(false);
+        compiler.AddRead(pass, x);
+        compiler.AddWrite(pass, x);
+    }
+    present = compiler.AddPass(false);
+    compiler.AddRead(present, x);
+    compiler.AddWrite(present, backBuffer);
+    TEST_CHECK(compiler.Compile());
+    for (int i = 0; i < int(compiler.GetExecutionOrder().size()); ++i)
+    {
+        TEST_CHECK(compiler.GetExecutionOrder()[i] == i);
+    }
+}
+
+void TestLifetimes()
+{
+    // 一列に並んだパス. t0 と t1 は寿命が重ならないので, 同じメモリを使い回せる.
+    FrameGraphCompiler compiler;
+    int backBuffer = compiler.AddResource(true);
+    int t0 = compiler.AddResource(false);
+    int t1 = compiler.AddResource(false);
+    int t2 = compiler.AddResource(false);
+    int p0 = compiler.AddPass(false);
+    compiler.AddWrite(p0, t0);
+    int p1 = compiler.AddPass(false);
+    compiler.AddRead(p1, t0);
+    compiler.AddWrite(p1, t2);
+    int p2 = compiler.AddPass(false);
+    compiler.AddRead(p2, t2);
+    compiler.AddWrite(p2, t1);
+    int p3 = compiler.AddPass(false);
+    compiler.AddRead(p3, t1);
+    compiler.AddWrite(p3, backBuffer);
+
+    TEST_CHECK(compiler.Compile());
+    TEST_CHECK(compiler.GetExecutionOrder() == std::vector<int>({ p0, p1, p2, p3 }));
+    const FrameGraphCompiler::Lifetime& l0 = compiler.GetLifetime(t0);
+    const FrameGraphCompiler::Lifetime& l1 = compiler.GetLifetime(t1);
+    const FrameGraphCompiler::Lifetime& l2 = compiler.GetLifetime(t2);
+    TEST_CHECK(l0.first == 0 && l0.last == 1);
+    TEST_CHECK(l2.first == 1 && l2.last == 2);
+    TEST_CHECK(l1.first == 2 && l1.last == 3);
+    TEST_CHECK(l0.last < l1.first);
+    TEST_CHECK(compiler.GetLifetime(backBuffer).first == 3);
+
+    // 依存の無いパスは先に実行されることがあり, 寿命はその実行順で求める.
+    compiler.Reset();
+    backBuffer = compiler.AddResource(true);
+    t0 = compiler.AddResource(false);
+    t1 = compiler.AddResource(false);
+    p0 = compiler.AddPass(false);
+    compiler.AddWrite(p0, t0);
+    p1 = compiler.AddPass(false);
+    compiler.AddRead(p1, t0);
+    compiler.AddWrite(p1, backBuffer);
+    p2 = compiler.AddPass(false);
+    compiler.AddWrite(p2, t1);
+    p3 = compiler.AddPass(false);
+    compiler.AddRead(p3, t1);
+    compiler.AddWrite(p3, backBuffer);
+
+    TEST_CHECK(compiler.Compile());
+    TEST_CHECK(compiler.GetLifetime(t0).first == PositionOf(compiler, p0));
+    TEST_CHECK(compiler.GetLifetime(t0).last == PositionOf(compiler, p1));
+    TEST_CHECK(compiler.GetLifetime(t1).first == PositionOf(compiler, p2));
+    TEST_CHECK(compiler.GetLifetime(t1).last == PositionOf(compiler, p3));
+    TEST_CHECK(PositionOf(compiler, p1) < PositionOf(compiler, p3));
+}
+
+void TestRandomGraphs()
+{
+    // 宣言順に実行した場合と, 読み込みごとに参照する書き込みが同じになることを確かめる.
+    std::mt19937 random(2024);
+    FrameGraphCompiler compiler;
+    for (int iteration = 0; iteration < 200; ++iteration)
+    {
+        compiler.Reset();
+        const int resourceCount = 2 + int(random() % 20);
+        const int passCount = 1 + int(random() % 60);
+        for (int i = 0; i < resourceCount; ++i)
+        {
+            compiler.AddResource(i == 0);
+        }
+
+        // 読み込みは書き込み済みのリソースからだけ選ぶ.
+        std::vector<std::vector<int>> reads(passCount), writes(passCount);
+        std::vector<bool> written(resourceCount, false);
+        written[0] = true;
+        for (int p = 0; p < passCount; ++p)
+        {
+            compiler.AddPass(random() % 10 == 0);
+            for (int k = int(random() % 3); k > 0; --k)
+            {
+                int r = int(random() % resourceCount);
+                if (written[r])
+                {
+                    reads[p].push_back(r);
+                    compiler.AddRead(p, r);
+                }
+            }
+            for (int k = 1 + int(random() % 2); k > 0; --k)
+            {
+                int r = int(random() % resourceCount);
+                writes[p].push_back(r);
+                compiler.AddWrite(p, r);
+                written[r] = true;
+            }
+        }
+        if (!TEST_CHECK(compiler.Compile()))
+        {
+            continue;
+        }
+
+        // 宣言順で, 残ったパスの読み込みが見る書き込み.
+        std::vector<std::vector<int>> expected(passCount);
+        std::vector<int> lastWriter(resourceCount, -1);
+        for (int p = 0; p < passCount; ++p)
+        {
+            if (compiler.IsCulled(p))
+            {
+                continue;
+            }
+            for (int r : reads[p])
+            {
+                expected[p].push_back(lastWriter[r]);
+            }
+            for (int r : writes[p])
+            {
+                lastWriter[r] = p;
+            }
+        }
+
+        // 実行順で同じことを行う.
+        std::fill(lastWriter.begin(), lastWriter.end(), -1);
+        for (int p : compiler.GetExecutionOrder())
+        {
+            TEST_CHECK(!compiler.IsCulled(p));
+            std::vector<int> seen;
+            for (int r : reads[p])
+            {
+                seen.push_back(lastWriter[r]);
+            }
+            TEST_CHECK(seen == expected[p]);
+            for (int r : writes[p])
+            {
+                lastWriter[r] = p;
+            }
+        }
+        TEST_CHECK(int(compiler.GetExecutionOrder().size()) == passCount - compiler.GetStats().culledPassCount);
+
+        // 書き込んだリソースの寿命は, そのパスの実行位置を含む.
+        for (int p = 0; p < passCount; ++p)
+        {
+            if (compiler.IsCulled(p))
+            {
+                continue;
+            }
+            for (int r : writes[p])
+            {
+                const FrameGraphCompiler::Lifetime& lifetime = compiler.GetLifetime(r);
+                TEST_CHECK(lifetime.first <= PositionOf(compiler, p) && PositionOf(compiler, p) <= lifetime.last);
+            }
+        }
+    }
+}
+}
+
+int main()
+{
+    Test::Run("deferred frame", TestDeferredFrame);
+    Test::Run("dead pass culling", TestDeadPassCulling);
+    Test::Run("read before write", TestReadBeforeWrite);
+    Test::Run("cycles", TestCycles);
+    Test::Run("lifetimes", TestLifetimes);
+    Test::Run("random graphs", TestRandomGraphs);
+    return Test::Finish();
+}
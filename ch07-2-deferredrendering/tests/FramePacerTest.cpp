@@ -0,0 +1,253 @@
+﻿// FramePacer のテスト. tests/run_tests.sh でビルドして実行します.
+//
+// 模擬した時計と垂直同期で, フレームの処理時間を決めて動かします. 眠りは時計を進めるだけなので結果は毎回同じです.
+// 予測した締め切りに間に合うよう起きること, 処理時間が跳ねて締め切りを逃した後に元の遅延へ戻ること,
+// 垂直同期を待たない場合に大きく遅れても追いつこうとしないことを確かめます.
+#include "FramePacer.h"
+#include "Test.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+const double Epsilon = 1e-9;
+
+// 眠ると指定した時刻 (と oversleep) まで進むだけの時計.
+class MockClock : public FramePacer::Clock
+{
+public:
+    MockClock()
+        : m_now(0.0), m_oversleep(0.0)
+    {
+    }
+
+    virtual double Now() { return m_now; }
+    virtual void SleepUntil(double time) { m_now = std::max(m_now, time + m_oversleep); }
+
+    void Advance(double seconds) { m_now += seconds; }
+    void Set(double time) { m_now = time; }
+    // 眠りが予定より遅れて戻る時間.
+    void SetOversleep(double seconds) { m_oversleep = seconds; }
+
+private:
+    double m_now;
+    double m_oversleep;
+};
+
+// 垂直同期を待つ表示. Present は呼んだ時刻より後の最初の垂直同期まで戻らない.
+struct Display
+{
+    double phase;
+    double period;
+
+    double GetNextVBlank(double time) const
+    {
+        return phase + (floor((time - phase) / period) + 1.0) * period;
+    }
+};
+
+struct Frame
+{
+    double start;       // 入力を読む時刻.
+    double deadline;
+    double present;
+    double shown;       // 表示された垂直同期 (垂直同期を待たなければ present と同じ).
+};
+
+Frame RunFrame(FramePacer& pacer, MockClock& clock, const Display* display, double work)
+{
+    Frame frame;
+    pacer.WaitForFrameStart();
+    frame.start = clock.Now();
+    frame.deadline = pacer.GetDeadline();
+    clock.Advance(work);
+    pacer.BeginPresent();
+    frame.present = clock.Now();
+    if (display)
+    {
+        clock.Set(display->GetNextVBlank(clock.Now()));
+    }
+    frame.shown = clock.Now();
+    pacer.EndPresent();
+    return frame;
+}
+
+std::vector<Frame> RunFrames(FramePacer& pacer, MockClock& clock, const Display* display, const std::vector<double>& work)
+{
+    std::vector<Frame> frames;
+    for (double seconds : work)
+    {
+        frames.push_back(RunFrame(pacer, clock, display, seconds));
+    }
+    return frames;
+}
+
+// 処理時間と余裕の分だけ表示の前に起き, 垂直同期ごとに 1 フレームずつ表示する.
+// 眠らなければ, 入力は直前の垂直同期の直後に読むので 1 間隔ぶん遅れる.
+void TestPredictiveSleep()
+{
+    const Display display = { 0.003, 1.0 / 60.0 };
+    const double Work = 0.004;
+    const double Margin = 0.001;
+    const std::vector<double> work(120, Work);
+
+    MockClock clock;
+    FramePacer pacer(clock);
+    pacer.Configure(true, display.period);
+    pacer.SetMargin(Margin);
+    const std::vector<Frame> frames = RunFrames(pacer, clock, &display, work);
+
+    // 最初のフレームは位相が分からないので眠らない.
+    TEST_CHECK(frames[0].deadline == 0.0);
+    int wrong = 0;
+    for (size_t i = 1; i < frames.size(); ++i)
+    {
+        const Frame& frame = frames[i];
+        const bool valid = fabs(frame.shown - frame.deadline) < Epsilon
+            && fabs(frame.shown - frame.start - (Work + Margin)) < Epsilon
+            && fabs(frame.shown - frames[i - 1].shown - display.period) < Epsilon;
+        wrong += valid ? 0 : 1;
+    }
+    TEST_CHECK(wrong == 0);
+    TEST_CHECK(pacer.GetStats().missed == 0);
+    TEST_CHECK(pacer.GetStats().frames == work.size());
+    TEST_CHECK(fabs(pacer.GetWorkEstimate() - Work) < Epsilon);
+
+    MockClock unpacedClock;
+    FramePacer unpaced(unpacedClock);
+    unpaced.Configure(true, display.period);
+    unpaced.SetEnabled(false);
+    const std::vector<Frame> unpacedFrames = RunFrames(unpaced, unpacedClock, &display, work);
+    const Frame& last = unpacedFrames.back();
+    TEST_CHECK(fabs(last.shown - last.start - display.period) < Epsilon);
+    TEST_CHECK(unpaced.GetStats().sleepSec == 0.0);
+}
+
+// 表示の間隔が設定とずれていても, 垂直同期の時刻から間隔を推定して締め切りを合わせる.
+void TestIntervalEstimate()
+{
+    const Display display = { 0.001, 1.0 / 59.8 };
+    MockClock clock;
+    FramePacer pacer(clock);
+    pacer.Configure(true, 1.0 / 60.0);
+    const std::vector<Frame> frames = RunFrames(pacer, clock, &display, std::vector<double>(600, 0.005));
+
+    TEST_CHECK(fabs(pacer.GetInterval() - display.period) < 1e-6);
+    int wrong = 0;
+    for (size_t i = frames.size() - 100; i < frames.size(); ++i)
+    {
+        const Frame& frame = frames[i];
+        const bool valid = frame.present <= frame.deadline
+            && fabs(frame.shown - frames[i - 1].shown - display.period) < Epsilon;
+        wrong += valid ? 0 : 1;
+    }
+    TEST_CHECK(wrong == 0);
+}
+
+// 1 フレームだけ処理時間が間隔を超えると, その締め切りは逃す. その後は長い処理時間を見込んで早めに起き,
+// 直近のフレームの記録から外れれば元の遅延に戻る. その間に他の締め切りは逃さない.
+void TestMissedFrameRecovery()
+{
+    const Display display = { 0.0, 1.0 / 60.0 };
+    const double Work = 0.004;
+    const double Spike = 0.030;
+    const double Margin = 0.001;
+    const size_t SpikeFrame = 40;
+    std::vector<double> work(120, Work);
+    work[SpikeFrame] = Spike;
+
+    MockClock clock;
+    FramePacer pacer(clock);
+    pacer.Configure(true, display.period);
+    pacer.SetMargin(Margin);
+    std::vector<Frame> frames;
+    for (size_t i = 0; i < work.size(); ++i)
+    {
+        frames.push_back(RunFrame(pacer, clock, &display, work[i]));
+        if (i == SpikeFrame)
+        {
+            TEST_CHECK(pacer.GetStats().missed == 1);
+            TEST_CHECK(fabs(pacer.GetWorkEstimate() - Spike) < Epsilon);
+        }
+    }
+
+    const Frame& spike = frames[SpikeFrame];
+    TEST_CHECK(spike.present > spike.deadline);
+    TEST_CHECK(pacer.GetStats().missed == 1);
+
+    // 記録に残っている間は, 長い処理時間に間に合うよう早めに起きる.
+    const Frame& after = frames[SpikeFrame + 1];
+    TEST_CHECK(fabs(after.deadline - after.start - (Spike + Margin)) < Epsilon);
+    TEST_CHECK(after.present <= after.deadline);
+
+    // 同じ垂直同期に 2 フレームを表示せず, 表示の間隔は空けても 2 間隔まで.
+    int wrong = 0;
+    for (size_t i = SpikeFrame + 1; i < frames.size(); ++i)
+    {
+        const double gap = frames[i].shown - frames[i - 1].shown;
+        wrong += (gap > display.period - Epsilon && gap < display.period * 2.0 + Epsilon) ? 0 : 1;
+    }
+    TEST_CHECK(wrong == 0);
+
+    // 記録から外れた後は, 元の遅延で垂直同期ごとに表示する.
+    TEST_CHECK(fabs(pacer.GetWorkEstimate() - Work) < Epsilon);
+    wrong = 0;
+    for (size_t i = SpikeFrame + 17 + 1; i < frames.size(); ++i)
+    {
+        const Frame& frame = frames[i];
+        const bool valid = fabs(frame.shown - frame.deadline) < Epsilon
+            && fabs(frame.shown - frame.start - (Work + Margin)) < Epsilon
+            && fabs(frame.shown - frames[i - 1].shown - display.period) < Epsilon;
+        wrong += valid ? 0 : 1;
+    }
+    TEST_CHECK(wrong == 0);
+}
+
+// 垂直同期を待たない場合は interval ごとにフレームを始める. 眠りの遅れは積もらず,
+// 大きく遅れた後はまとめて追いつこうとせずに, そこから数え直す.
+void TestImmediateLimiter()
+{
+    const double Interval = 0.010;
+    const double Oversleep = 0.0005;
+    const size_t StallFrame = 20;
+    std::vector<double> work(60, 0.002);
+    work[StallFrame] = 0.045;
+
+    MockClock clock;
+    clock.SetOversleep(Oversleep);
+    FramePacer pacer(clock);
+    pacer.Configure(false, Interval);
+    const std::vector<Frame> frames = RunFrames(pacer, clock, nullptr, work);
+
+    // 予定は前の予定から数えるので, 起きる時刻は毎回 oversleep だけ遅れるが, 間隔は変わらない.
+    int wrong = 0;
+    for (size_t i = 2; i <= StallFrame; ++i)
+    {
+        wrong += fabs(frames[i].start - frames[i - 1].start - Interval) < Epsilon ? 0 : 1;
+    }
+    TEST_CHECK(wrong == 0);
+    TEST_CHECK(fabs(frames[StallFrame].start - (frames[1].start + (StallFrame - 1) * Interval)) < Epsilon);
+
+    // 遅れたフレームの次は眠らずにすぐ始め, その後は間隔を詰めずにそこから数え直す.
+    TEST_CHECK(fabs(frames[StallFrame + 1].start - frames[StallFrame].present) < Epsilon);
+    TEST_CHECK(fabs(frames[StallFrame + 2].start - frames[StallFrame + 1].start - (Interval + Oversleep)) < Epsilon);
+    wrong = 0;
+    for (size_t i = StallFrame + 3; i < frames.size(); ++i)
+    {
+        wrong += fabs(frames[i].start - frames[i - 1].start - Interval) < Epsilon ? 0 : 1;
+    }
+    TEST_CHECK(wrong == 0);
+    TEST_CHECK(pacer.GetStats().missed == 0);
+}
+}
+
+int main()
+{
+    Test::Run("predictive sleep", TestPredictiveSleep);
+    Test::Run("interval estimate", TestIntervalEstimate);
+    Test::Run("missed frame recovery", TestMissedFrameRecovery);
+    Test::Run("immediate limiter", TestImmediateLimiter);
+    return Test::Finish();
+}
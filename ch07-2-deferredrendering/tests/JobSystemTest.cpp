@@ -0,0 +1,190 @@
+﻿// JobSystem のテスト. tests/run_tests.sh でビルドして実行します.
+//
+// 1 から 8 スレッドで, 大量のジョブの追加, ジョブの中からのジョブの追加と待機,
+// 依存関係のあるジョブの実行順を確かめます. SANITIZE=thread でも実行してください.
+#include "JobSystem.h"
+#include "Test.h"
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace
+{
+const int ThreadCounts[] = { 1, 2, 4, 8 };
+
+// 全てのジョブがちょうど 1 回ずつ実行される. ワーカーから追加するとデックの容量を超え, その場で実行される分もある.
+void TestFanOut(int threadCount)
+{
+    const int JobCount = 10000;
+    JobSystem system(threadCount);
+
+    // ワーカー以外のスレッドから追加する.
+    std::vector<int> hits(JobCount, 0);
+    {
+        JobCounter counter;
+        for (int i = 0; i < JobCount; ++i)
+        {
+            system.Run([&hits, i]() { hits[i]++; }, &counter);
+        }
+        system.Wait(counter);
+    }
+    int wrong = 0;
+    for (int i = 0; i < JobCount; ++i)
+    {
+        wrong += hits[i] == 1 ? 0 : 1;
+    }
+    TEST_CHECK(wrong == 0);
+    TEST_CHECK(system.GetStats().executed == uint64_t(JobCount));
+    TEST_CHECK(system.GetStats().injected == uint64_t(JobCount));
+
+    // ジョブの中から追加する.
+    system.ResetStats();
+    std::fill(hits.begin(), hits.end(), 0);
+    {
+        JobCounter outer;
+        system.Run([&system, &hits]() {
+            JobCounter inner;
+            for (int i = 0; i < JobCount; ++i)
+            {
+                system.Run([&hits, i]() { hits[i]++; }, &inner);
+            }
+            system.Wait(inner);
+        }, &outer);
+        system.Wait(outer);
+    }
+    wrong = 0;
+    for (int i = 0; i < JobCount; ++i)
+    {
+        wrong += hits[i] == 1 ? 0 : 1;
+    }
+    TEST_CHECK(wrong == 0);
+    TEST_CHECK(system.GetStats().executed == uint64_t(JobCount + 1));
+}
+
+// 2 分木の各ノードで子を 2 つ追加して待つ. 待つ間も他のジョブを実行するので, 深くしても止まらない.
+int CountLeaves(JobSystem& system, int depth)
+{
+    if (depth == 0)
+    {
+        return 1;
+    }
+    int left = 0, right = 0;
+    JobCounter counter;
+    system.Run([&]() { left = CountLeaves(system, depth - 1); }, &counter);
+    system.Run([&]() { right = CountLeaves(system, depth - 1); }, &counter);
+    system.Wait(counter);
+    return left + right;
+}
+
+void TestNesting(int threadCount)
+{
+    JobSystem system(threadCount);
+    const int Depth = 11;
+    TEST_CHECK(CountLeaves(system, Depth) == 1 << Depth);
+    TEST_CHECK(system.GetStats().executed == uint64_t((1 << (Depth + 1)) - 2));
+
+    // ParallelFor の中から ParallelFor を呼ぶ.
+    const size_t Outer = 64, Inner = 100;
+    std::vector<int> hits(Outer * Inner, 0);
+    system.ParallelFor(Outer, 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            system.ParallelFor(Inner, 7, [&](size_t innerBegin, size_t innerEnd) {
+                for (size_t j = innerBegin; j < innerEnd; ++j)
+                {
+                    hits[i * Inner + j]++;
+                }
+            });
+        }
+    });
+    int wrong = 0;
+    for (int hit : hits)
+    {
+        wrong += hit == 1 ? 0 : 1;
+    }
+    TEST_CHECK(wrong == 0);
+}
+
+// 各段のジョブは前の段のジョブが全て完了してから実行される.
+void TestDependencies(int threadCount)
+{
+    const int StageCount = 8;
+    const int JobsPerStage = 200;
+    JobSystem system(threadCount);
+    JobCounter counters[StageCount];
+    std::atomic<int> completed[StageCount];
+    std::atomic<int> violations(0);
+    for (auto& count : completed)
+    {
+        count.store(0);
+    }
+
+    for (int stage = 0; stage < StageCount; ++stage)
+    {
+        JobCounter* dependency = stage > 0 ? &counters[stage - 1] : nullptr;
+        for (int i = 0; i < JobsPerStage; ++i)
+        {
+            // 完了を数える子のジョブを同じカウンターで追加する. 後の段のジョブより後ろに並ぶので,
+            // 依存を無視して実行すると, 後の段が子の完了より先に実行される.
+            system.Run([&system, &counters, &completed, &violations, stage]() {
+                if (stage > 0 && completed[stage - 1].load() != JobsPerStage)
+                {
+                    violations++;
+                }
+                system.Run([&completed, &violations, stage]() {
+                    if (stage > 0 && completed[stage - 1].load() != JobsPerStage)
+                    {
+                        violations++;
+                    }
+                    completed[stage]++;
+                }, &counters[stage]);
+            }, &counters[stage], dependency);
+        }
+    }
+    system.Wait(counters[StageCount - 1]);
+    for (int stage = 0; stage < StageCount; ++stage)
+    {
+        system.Wait(counters[stage]);
+        TEST_CHECK(completed[stage].load() == JobsPerStage);
+    }
+    TEST_CHECK(violations.load() == 0);
+
+    // 完了済みのカウンターに依存するジョブはすぐに実行できる.
+    JobCounter counter;
+    bool ran = false;
+    system.Run([&ran]() { ran = true; }, &counter, &counters[0]);
+    system.Wait(counter);
+    TEST_CHECK(ran);
+}
+
+// デストラクタは残っているジョブを全て実行してから終了する.
+void TestShutdown(int threadCount)
+{
+    const int JobCount = 1000;
+    std::atomic<int> executed(0);
+    {
+        JobSystem system(threadCount);
+        for (int i = 0; i < JobCount; ++i)
+        {
+            system.Run([&executed]() { executed++; }, nullptr);
+        }
+    }
+    TEST_CHECK(executed.load() == JobCount);
+}
+}
+
+int main()
+{
+    for (int threadCount : ThreadCounts)
+    {
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), " (%d threads)", threadCount);
+        Test::Run(("fan-out" + std::string(suffix)).c_str(), [=] { TestFanOut(threadCount); });
+        Test::Run(("nesting" + std::string(suffix)).c_str(), [=] { TestNesting(threadCount); });
+        Test::Run(("dependencies" + std::string(suffix)).c_str(), [=] { TestDependencies(threadCount); });
+        Test::Run(("shutdown" + std::string(suffix)).c_str(), [=] { TestShutdown(threadCount); });
+    }
+    return Test::Finish();
+}
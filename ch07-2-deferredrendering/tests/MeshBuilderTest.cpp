@@ -0,0 +1,282 @@
+﻿// MeshBuilder のテスト. tests/run_tests.sh でビルドして実行します.
+//
+// 頂点に元の番号を書き込んだメッシュを変換し, インデックスの形式が頂点数とデバイスの上限で選ばれること,
+// 分割したサブメッシュが 16 ビットで参照できる範囲に収まること, 並べ直したインデックスと頂点から
+// 元の三角形がそのまま得られること, 空のメッシュや縮退した三角形を扱えることを確かめます.
+#include "MeshBuilder.h"
+#include "Test.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace
+{
+// 元の頂点番号と, 頂点全体をコピーしているかを確かめるための値.
+struct Vertex
+{
+    uint32_t id;
+    uint32_t check;
+};
+
+uint32_t GetCheck(uint32_t id)
+{
+    return id * 2654435761u;
+}
+
+std::vector<Vertex> MakeVertices(size_t count)
+{
+    std::vector<Vertex> vertices(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        vertices[i].id = uint32_t(i);
+        vertices[i].check = GetCheck(uint32_t(i));
+    }
+    return vertices;
+}
+
+// 全ての頂点を使う, 隣り合う頂点を結んだ三角形の列.
+std::vector<uint32_t> MakeStrip(uint32_t vertexCount)
+{
+    std::vector<uint32_t> indices;
+    for (uint32_t i = 0; i + 2 < vertexCount; ++i)
+    {
+        const uint32_t tri[3] = { i, i + 1, i + 2 };
+        indices.insert(indices.end(), tri, tri + 3);
+    }
+    return indices;
+}
+
+// size x size 頂点の格子. 三角形の順を shuffle で混ぜると, 分割の単位に頂点の局所性が無くなる.
+std::vector<uint32_t> MakeGrid(uint32_t size, bool shuffle)
+{
+    std::vector<uint32_t> indices;
+    for (uint32_t y = 0; y + 1 < size; ++y)
+    {
+        for (uint32_t x = 0; x + 1 < size; ++x)
+        {
+            const uint32_t v = y * size + x;
+            const uint32_t quad[6] = { v, v + 1, v + size, v + size, v + 1, v + size + 1 };
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    }
+    if (shuffle)
+    {
+        std::mt19937 random(1);
+        for (size_t t = indices.size() / 3; t > 1; --t)
+        {
+            const size_t other = random() % t;
+            std::swap_ranges(&indices[(t - 1) * 3], &indices[t * 3], &indices[other * 3]);
+        }
+    }
+    return indices;
+}
+
+uint32_t GetIndex(const MeshData& mesh, size_t i)
+{
+    return mesh.index32
+        ? reinterpret_cast<const uint32_t*>(mesh.indices.data())[i]
+        : reinterpret_cast<const uint16_t*>(mesh.indices.data())[i];
+}
+
+// 変換したメッシュを確かめ, 間違いの数を返す.
+// サブメッシュは隙間なく並び, 各サブメッシュの頂点は maxVertices 以下で, 最初に参照された順に並ぶ.
+// サブメッシュの頂点とインデックスから元の三角形が同じ順に得られる.
+int CheckMesh(const MeshData& mesh, const std::vector<uint32_t>& indices, uint32_t maxVertices)
+{
+    if (mesh.vertexStride != sizeof(Vertex))
+    {
+        return 1;
+    }
+    const Vertex* vertices = reinterpret_cast<const Vertex*>(mesh.vertices.data());
+    int wrong = 0;
+    uint32_t baseVertex = 0, startIndex = 0;
+    for (const SubMesh& sub : mesh.subMeshes)
+    {
+        wrong += (sub.baseVertex == baseVertex && sub.startIndex == startIndex) ? 0 : 1;
+        wrong += (sub.vertexCount <= maxVertices && sub.triangleCount > 0) ? 0 : 1;
+        baseVertex += sub.vertexCount;
+        startIndex += sub.triangleCount * 3;
+        if (baseVertex > mesh.GetVertexCount() || startIndex > indices.size())
+        {
+            return wrong + 1;
+        }
+
+        uint32_t nextLocal = 0;
+        for (uint32_t i = sub.startIndex; i < startIndex; ++i)
+        {
+            const uint32_t local = GetIndex(mesh, i);
+            if (local >= sub.vertexCount || local > nextLocal)
+            {
+                ++wrong;
+                continue;
+            }
+            nextLocal = std::max(nextLocal, local + 1);
+            const Vertex& vertex = vertices[sub.baseVertex + local];
+            wrong += (vertex.id == indices[i] && vertex.check == GetCheck(indices[i])) ? 0 : 1;
+        }
+        // サブメッシュの頂点は全て参照される.
+        wrong += nextLocal == sub.vertexCount ? 0 : 1;
+    }
+    wrong += (baseVertex == mesh.GetVertexCount() && startIndex == indices.size()) ? 0 : 1;
+    wrong += mesh.GetIndexCount() == indices.size() ? 0 : 1;
+    return wrong;
+}
+
+MeshData Build(uint32_t vertexCount, const std::vector<uint32_t>& indices, IndexFormatPolicy policy, uint32_t maxVertexIndex)
+{
+    const std::vector<Vertex> vertices = MakeVertices(vertexCount);
+    MeshData mesh;
+    BuildMesh(vertices.data(), vertices.size(), sizeof(Vertex), indices.data(), indices.size(), policy, maxVertexIndex, mesh);
+    return mesh;
+}
+
+// 16 ビットで参照できる頂点数 (デバイスの MaxVertexIndex の方が小さければその数) まではそのまま 16 ビットにする.
+// それを超えると, 32 ビットを許してデバイスも参照できれば 32 ビットにし, それ以外は分割する.
+void TestIndexFormat()
+{
+    const uint32_t NoLimit = 0xFFFFFF;
+    const struct
+    {
+        uint32_t vertexCount;
+        IndexFormatPolicy policy;
+        uint32_t maxVertexIndex;
+        bool index32;
+        bool split;
+        uint32_t limit;     // サブメッシュの頂点数の上限.
+    } cases[] = {
+        { 65536, AllowIndex32, NoLimit, false, false, 65536 },
+        { 65536, SplitToIndex16, NoLimit, false, false, 65536 },
+        { 65537, AllowIndex32, NoLimit, true, false, 65537 },
+        { 65537, SplitToIndex16, NoLimit, false, true, 65536 },
+        // 32 ビットインデックスを扱えないデバイス.
+        { 65537, AllowIndex32, 0xFFFF, false, true, 65536 },
+        // 32 ビットで参照できるのはちょうど MaxVertexIndex + 1 頂点まで.
+        { 65537, AllowIndex32, 65536, true, false, 65537 },
+        { 65538, AllowIndex32, 65536, false, true, 65536 },
+        // 16 ビットの範囲より小さな MaxVertexIndex.
+        { 1001, AllowIndex32, 1000, false, false, 1001 },
+        { 1002, AllowIndex32, 1000, false, true, 1001 },
+        { 1002, SplitToIndex16, 1000, false, true, 1001 },
+        // 0 や 1 は報告されていないものとして 16 ビットの範囲を使う.
+        { 65536, AllowIndex32, 0, false, false, 65536 },
+        { 65536, SplitToIndex16, 1, false, false, 65536 },
+    };
+    for (const auto& c : cases)
+    {
+        const std::vector<uint32_t> indices = MakeStrip(c.vertexCount);
+        const MeshData mesh = Build(c.vertexCount, indices, c.policy, c.maxVertexIndex);
+        TEST_CHECK(mesh.index32 == c.index32);
+        TEST_CHECK(mesh.GetIndexSize() == (c.index32 ? 4u : 2u));
+        TEST_CHECK((mesh.subMeshes.size() > 1) == c.split);
+        if (!c.split)
+        {
+            // 分割しなければ頂点もインデックスもそのまま.
+            TEST_CHECK(mesh.GetVertexCount() == c.vertexCount);
+            TEST_CHECK(mesh.subMeshes.size() == 1 && mesh.subMeshes[0].vertexCount == c.vertexCount);
+        }
+        TEST_CHECK(CheckMesh(mesh, indices, c.limit) == 0);
+    }
+}
+
+// 分割したサブメッシュは上限の頂点数に収まり, 元の三角形をそのまま再現する.
+// 三角形の順に局所性が無くても, 1 つの三角形しか入らない上限でも同じ.
+void TestSplit()
+{
+    const uint32_t GridSize = 300;
+    const uint32_t limits[] = { MaxIndex16Vertices, 20000, 1000, 4, 3 };
+    const std::vector<Vertex> vertices = MakeVertices(GridSize * GridSize);
+    for (bool shuffle : { false, true })
+    {
+        const std::vector<uint32_t> indices = MakeGrid(GridSize, shuffle);
+        for (uint32_t limit : limits)
+        {
+            MeshData mesh;
+            SplitMesh(vertices.data(), vertices.size(), sizeof(Vertex), indices.data(), indices.size(), limit, mesh);
+            TEST_CHECK(!mesh.index32);
+            TEST_CHECK(mesh.subMeshes.size() > 1);
+            TEST_CHECK(CheckMesh(mesh, indices, limit) == 0);
+            TEST_CHECK(mesh.GetVertexCount() >= vertices.size());
+            if (limit == 3)
+            {
+                TEST_CHECK(mesh.subMeshes.size() == indices.size() / 3);
+            }
+        }
+    }
+
+    // 順に並んだ格子なら, 複製する頂点は境界の行の分だけ.
+    const std::vector<uint32_t> indices = MakeGrid(GridSize, false);
+    MeshData mesh;
+    SplitMesh(vertices.data(), vertices.size(), sizeof(Vertex), indices.data(), indices.size(), MaxIndex16Vertices, mesh);
+    TEST_CHECK(mesh.subMeshes.size() == 2);
+    TEST_CHECK(mesh.GetVertexCount() <= vertices.size() + GridSize * 2);
+}
+
+// 空のメッシュは空のまま. 縮退した三角形も三角形として残し, 同じ頂点を重複して数えない.
+void TestEmptyAndDegenerate()
+{
+    const std::vector<uint32_t> none;
+    const IndexFormatPolicy policies[] = { SplitToIndex16, AllowIndex32 };
+    for (IndexFormatPolicy policy : policies)
+    {
+        MeshData mesh;
+        BuildMesh(nullptr, 0, sizeof(Vertex), nullptr, 0, policy, 0xFFFFFF, mesh);
+        TEST_CHECK(!mesh.index32);
+        TEST_CHECK(mesh.vertices.empty() && mesh.indices.empty());
+        TEST_CHECK(mesh.subMeshes.empty());
+    }
+    {
+        MeshData mesh;
+        SplitMesh(nullptr, 0, sizeof(Vertex), nullptr, 0, 3, mesh);
+        TEST_CHECK(mesh.vertices.empty() && mesh.indices.empty() && mesh.subMeshes.empty());
+    }
+    {
+        // 三角形の無いメッシュは頂点をまとめない.
+        const std::vector<Vertex> vertices = MakeVertices(100000);
+        MeshData mesh;
+        BuildMesh(vertices.data(), vertices.size(), sizeof(Vertex), nullptr, 0, SplitToIndex16, 0xFFFFFF, mesh);
+        TEST_CHECK(mesh.vertices.empty() && mesh.indices.empty() && mesh.subMeshes.empty());
+
+        // 分割しない頂点数なら頂点はそのまま残るが, 描画するサブメッシュは無い.
+        BuildMesh(vertices.data(), 1000, sizeof(Vertex), nullptr, 0, SplitToIndex16, 0xFFFFFF, mesh);
+        TEST_CHECK(mesh.GetVertexCount() == 1000 && mesh.indices.empty() && mesh.subMeshes.empty());
+    }
+
+    // 同じ頂点だけの三角形は 1 頂点と数えるので, 3 頂点の上限に 3 つ入る.
+    const std::vector<Vertex> vertices = MakeVertices(8);
+    const std::vector<uint32_t> points = { 0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3 };
+    MeshData mesh;
+    SplitMesh(vertices.data(), vertices.size(), sizeof(Vertex), points.data(), points.size(), 3, mesh);
+    TEST_CHECK(mesh.subMeshes.size() == 2);
+    TEST_CHECK(mesh.subMeshes[0].triangleCount == 3 && mesh.subMeshes[0].vertexCount == 3);
+    TEST_CHECK(CheckMesh(mesh, points, 3) == 0);
+
+    // 2 頂点が同じ三角形は, どの位置が重なっていても 2 頂点と数えるので, 1 頂点の三角形の後に 3 頂点の上限で入る.
+    const uint32_t lines[][3] = { { 1, 1, 2 }, { 1, 2, 2 }, { 1, 2, 1 } };
+    for (const auto& line : lines)
+    {
+        const std::vector<uint32_t> indices = { 0, 0, 0, line[0], line[1], line[2] };
+        SplitMesh(vertices.data(), vertices.size(), sizeof(Vertex), indices.data(), indices.size(), 3, mesh);
+        TEST_CHECK(mesh.subMeshes.size() == 1);
+        TEST_CHECK(CheckMesh(mesh, indices, 3) == 0);
+    }
+
+    // 縮退した三角形が混ざった大きなメッシュの分割.
+    std::vector<uint32_t> indices = MakeStrip(70000);
+    for (size_t t = 0; t < indices.size() / 3; t += 7)
+    {
+        indices[t * 3 + t % 3] = indices[t * 3 + (t + 1) % 3];
+    }
+    const MeshData split = Build(70000, indices, SplitToIndex16, 0xFFFFFF);
+    TEST_CHECK(split.subMeshes.size() == 2);
+    TEST_CHECK(CheckMesh(split, indices, MaxIndex16Vertices) == 0);
+}
+}
+
+int main()
+{
+    Test::Run("index format", TestIndexFormat);
+    Test::Run("split", TestSplit);
+    Test::Run("empty and degenerate", TestEmptyAndDegenerate);
+    return Test::Finish();
+}
@@ -0,0 +1,231 @@
+﻿// RenderTargetPool のテスト. tests/run_tests.sh でビルドして実行します.
+//
+// D3D デバイスの代わりに, 作成と破棄を記録するだけのアロケータを使います.
+// 同じ作成パラメータのターゲットの再利用, 貸し出し中のターゲットを重複して貸さないこと,
+// 同時に保持した数の最大, 使われなくなったターゲットの破棄を確かめます.
+#include "RenderTargetPool.h"
+#include "Test.h"
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+// プールはポインタしか扱わないので, テストでは D3D のテクスチャの代わりに番号だけを持つ.
+class RenderTarget
+{
+public:
+    explicit RenderTarget(int id) : m_id(id) {}
+    int GetId() const { return m_id; }
+
+private:
+    int m_id;
+};
+
+namespace
+{
+const uint32_t FormatRgba8 = 21;    // D3DFMT_A8R8G8B8.
+const uint32_t FormatRgba16F = 113; // D3DFMT_A16B16G16R16F.
+const uint32_t UsageRenderTarget = 1;
+
+class FakeAllocator : public RenderTargetAllocator
+{
+public:
+    FakeAllocator()
+        : m_nextId(0), m_failCreate(false)
+    {
+    }
+
+    virtual ~FakeAllocator()
+    {
+        for (RenderTarget* target : m_live)
+        {
+            delete target;
+        }
+    }
+
+    virtual RenderTarget* Create(const RenderTargetDesc& desc)
+    {
+        if (m_failCreate)
+        {
+            return nullptr;
+        }
+        RenderTarget* target = new RenderTarget(m_nextId++);
+        m_live.insert(target);
+        m_created.push_back(desc);
+        return target;
+    }
+
+    virtual void Destroy(RenderTarget* target)
+    {
+        TEST_CHECK(m_live.erase(target) == 1);
+        m_destroyed.push_back(target->GetId());
+        delete target;
+    }
+
+    virtual uint64_t EstimateSize(const RenderTargetDesc& desc) const
+    {
+        return uint64_t(desc.width) * desc.height * (desc.format == FormatRgba16F ? 8 : 4);
+    }
+
+    size_t GetLiveCount() const { return m_live.size(); }
+    const std::vector<RenderTargetDesc>& GetCreated() const { return m_created; }
+    const std::vector<int>& GetDestroyed() const { return m_destroyed; }
+    void SetFailCreate(bool fail) { m_failCreate = fail; }
+
+private:
+    int m_nextId;
+    bool m_failCreate;
+    std::set<RenderTarget*> m_live;
+    std::vector<RenderTargetDesc> m_created;
+    std::vector<int> m_destroyed;
+};
+
+RenderTargetDesc MakeDesc(uint32_t width, uint32_t height, uint32_t format)
+{
+    RenderTargetDesc desc;
+    desc.width = width;
+    desc.height = height;
+    desc.format = format;
+    desc.usage = UsageRenderTarget;
+    return desc;
+}
+
+// 返却したターゲットは, 幅, 高さ, フォーマット, 用途が全て同じ要求にだけ再利用される.
+void TestReuse()
+{
+    FakeAllocator allocator;
+    RenderTargetPool pool(&allocator);
+    const RenderTargetDesc desc = MakeDesc(640, 360, FormatRgba8);
+
+    RenderTarget* first = pool.Acquire(desc);
+    TEST_CHECK(first != nullptr);
+    pool.Release(first);
+    TEST_CHECK(pool.Acquire(desc) == first);
+    pool.Release(first);
+    TEST_CHECK(pool.GetStats().createCount == 1);
+    TEST_CHECK(pool.GetStats().reuseCount == 1);
+
+    // どれか 1 つでも違えば新しく作る.
+    RenderTargetDesc others[4] = { desc, desc, desc, desc };
+    others[0].width = 320;
+    others[1].height = 180;
+    others[2].format = FormatRgba16F;
+    others[3].usage = 0;
+    for (const RenderTargetDesc& other : others)
+    {
+        RenderTarget* target = pool.Acquire(other);
+        TEST_CHECK(target != nullptr && target != first);
+        pool.Release(target);
+    }
+    TEST_CHECK(pool.GetStats().createCount == 5);
+    TEST_CHECK(allocator.GetCreated().size() == 5);
+    TEST_CHECK(pool.GetStats().allocatedBytes == 640 * 360 * 4 + 320 * 360 * 4 + 640 * 180 * 4 + 640 * 360 * 8 + 640 * 360 * 4);
+    TEST_CHECK(pool.GetStats().inUseBytes == 0);
+
+    // 作成に失敗すれば nullptr を返し, 何も保持しない.
+    allocator.SetFailCreate(true);
+    TEST_CHECK(pool.Acquire(MakeDesc(1, 1, FormatRgba8)) == nullptr);
+    TEST_CHECK(pool.GetStats().targetCount == 5);
+}
+
+// 貸し出し中のターゲットは, 同じ作成パラメータでも別の要求には貸さない.
+// 同時に貸し出した数が保持する数の最大になり, 返却後は最大の数を超えて作らない.
+void TestLiveTargetsAreDistinct()
+{
+    const int Count = 6;
+    FakeAllocator allocator;
+    RenderTargetPool pool(&allocator);
+    const RenderTargetDesc desc = MakeDesc(256, 256, FormatRgba16F);
+
+    for (int frame = 0; frame < 10; ++frame)
+    {
+        // フレームごとに同時に借りる数を変える.
+        const int live = 1 + (frame * 5) % Count;
+        std::vector<RenderTarget*> targets;
+        for (int i = 0; i < live; ++i)
+        {
+            targets.push_back(pool.Acquire(desc));
+        }
+        std::set<RenderTarget*> unique(targets.begin(), targets.end());
+        TEST_CHECK(unique.size() == targets.size());
+        TEST_CHECK(unique.count(nullptr) == 0);
+        TEST_CHECK(pool.GetStats().inUseBytes == uint64_t(live) * 256 * 256 * 8);
+        for (RenderTarget* target : targets)
+        {
+            pool.Release(target);
+        }
+        pool.EndFrame();
+    }
+
+    TEST_CHECK(pool.GetStats().peakTargetCount == Count);
+    TEST_CHECK(pool.GetStats().targetCount == Count);
+    TEST_CHECK(pool.GetStats().createCount == Count);
+    TEST_CHECK(allocator.GetLiveCount() == Count);
+    TEST_CHECK(pool.GetStats().peakInUseBytes == uint64_t(Count) * 256 * 256 * 8);
+
+    // 返却済みのターゲットを二重に返却しても, 貸し出し中の量は変わらない.
+    RenderTarget* target = pool.Acquire(desc);
+    pool.Release(target);
+    pool.Release(target);
+    TEST_CHECK(pool.GetStats().inUseBytes == 0);
+}
+
+// MaxUnusedFrames を超えて使われなかったターゲットだけを EndFrame で破棄する.
+// 貸し出し中のターゲットは何フレーム経っても破棄しない.
+void TestEviction()
+{
+    FakeAllocator allocator;
+    RenderTargetPool pool(&allocator);
+    const RenderTargetDesc used = MakeDesc(64, 64, FormatRgba8);
+    const RenderTargetDesc unused = MakeDesc(128, 128, FormatRgba8);
+    const RenderTargetDesc held = MakeDesc(32, 32, FormatRgba8);
+
+    RenderTarget* heldTarget = pool.Acquire(held);
+    RenderTarget* unusedTarget = pool.Acquire(unused);
+    const int unusedId = unusedTarget->GetId();
+    pool.Release(unusedTarget);
+    for (uint32_t frame = 0; frame <= RenderTargetPool::MaxUnusedFrames; ++frame)
+    {
+        pool.Release(pool.Acquire(used));
+        pool.EndFrame();
+    }
+    // 返却したフレームから MaxUnusedFrames 経つまでは残る.
+    TEST_CHECK(pool.GetStats().targetCount == 3);
+    TEST_CHECK(allocator.GetDestroyed().empty());
+
+    pool.Release(pool.Acquire(used));
+    pool.EndFrame();
+    TEST_CHECK(pool.GetStats().targetCount == 2);
+    TEST_CHECK(allocator.GetDestroyed() == std::vector<int>({ unusedId }));
+    TEST_CHECK(pool.GetStats().allocatedBytes == 64 * 64 * 4 + 32 * 32 * 4);
+
+    // 毎フレーム使っているターゲットと貸し出し中のターゲットは残り続ける.
+    for (uint32_t frame = 0; frame < RenderTargetPool::MaxUnusedFrames * 2; ++frame)
+    {
+        pool.Release(pool.Acquire(used));
+        pool.EndFrame();
+    }
+    TEST_CHECK(pool.GetStats().targetCount == 2);
+    TEST_CHECK(allocator.GetDestroyed().size() == 1);
+
+    // 破棄した後の同じ要求は作り直す.
+    RenderTarget* recreated = pool.Acquire(unused);
+    TEST_CHECK(recreated != nullptr && recreated->GetId() != unusedId);
+    pool.Release(recreated);
+    pool.Release(heldTarget);
+
+    // Clear() は全てを破棄する.
+    pool.Clear();
+    TEST_CHECK(allocator.GetLiveCount() == 0);
+    TEST_CHECK(pool.GetStats().targetCount == 0);
+    TEST_CHECK(pool.GetStats().allocatedBytes == 0);
+}
+}
+
+int main()
+{
+    Test::Run("reuse", TestReuse);
+    Test::Run("live targets are distinct", TestLiveTargetsAreDistinct);
+    Test::Run("eviction", TestEviction);
+    return Test::Finish();
+}
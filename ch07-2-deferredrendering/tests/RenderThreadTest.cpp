@@ -0,0 +1,389 @@
+﻿// RenderThread と, 描画スレッドとの受け渡しに使う SpscQueue, TripleBuffer のテスト.
+// tests/run_tests.sh でビルドして実行します. SANITIZE=thread でも実行してください.
+//
+// ウィンドウのメッセージの代わりに, 別のスレッドから連番のイベントを送ります.
+#include "RenderThread.h"
+#include "SpscQueue.h"
+#include "TripleBuffer.h"
+#include "Test.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+// 条件が満たされるまで待つ. 壊れていてもテストが止まらないよう, 10 秒で諦めて false を返す.
+template<class Condition>
+bool WaitUntil(Condition condition)
+{
+    const auto limit = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!condition())
+    {
+        if (std::chrono::steady_clock::now() > limit)
+        {
+            return false;
+        }
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+// 連番と, それから求めた値を持つ要素. 別の要素と混ざったり途中までしか書かれていなければ検査で分かる.
+struct Item
+{
+    uint64_t sequence;
+    uint64_t check;
+
+    static Item Make(uint64_t sequence)
+    {
+        Item item = { sequence, ~sequence * 0x9E3779B97F4A7C15ull };
+        return item;
+    }
+    bool IsValid() const { return check == ~sequence * 0x9E3779B97F4A7C15ull; }
+};
+
+// 1 つのスレッドの中で, 容量, 空と一杯のときの動作, 先に入れたものから出ること, 位置が一周しても壊れないことを確かめる.
+void TestQueueSingleThread()
+{
+    SpscQueue<Item> small(3);
+    TEST_CHECK(small.GetCapacity() == 4);
+    SpscQueue<Item> tiny(0);
+    TEST_CHECK(tiny.GetCapacity() == 2);
+
+    SpscQueue<Item> queue(8);
+    Item item;
+    TEST_CHECK(!queue.TryPop(item));
+
+    uint64_t pushed = 0, popped = 0;
+    int wrong = 0;
+    // 毎回入れる数と出す数を変えて, 位置を何周もさせる.
+    for (int round = 0; round < 1000; ++round)
+    {
+        const int pushCount = 1 + round % 11;
+        for (int i = 0; i < pushCount; ++i)
+        {
+            const bool full = pushed - popped == queue.GetCapacity();
+            const bool accepted = queue.TryPush(Item::Make(pushed));
+            wrong += accepted == !full ? 0 : 1;
+            pushed += accepted ? 1 : 0;
+        }
+        const int popCount = 1 + (round * 7) % 9;
+        for (int i = 0; i < popCount; ++i)
+        {
+            const bool empty = pushed == popped;
+            const bool valid = queue.TryPop(item);
+            wrong += valid == !empty ? 0 : 1;
+            if (valid)
+            {
+                wrong += (item.IsValid() && item.sequence == popped) ? 0 : 1;
+                popped++;
+            }
+        }
+    }
+    TEST_CHECK(wrong == 0);
+    TEST_CHECK(pushed > queue.GetCapacity() * 100);
+
+    // 一杯にしてから全て取り出す.
+    while (queue.TryPop(item))
+    {
+        popped++;
+    }
+    TEST_CHECK(pushed == popped);
+    for (size_t i = 0; i < queue.GetCapacity(); ++i)
+    {
+        TEST_CHECK(queue.TryPush(Item::Make(i)));
+    }
+    TEST_CHECK(!queue.TryPush(Item::Make(0)));
+    for (size_t i = 0; i < queue.GetCapacity(); ++i)
+    {
+        TEST_CHECK(queue.TryPop(item) && item.sequence == i);
+    }
+    TEST_CHECK(!queue.TryPop(item));
+}
+
+// 追加するスレッドと取り出すスレッドで, 小さいキューを何度も一杯と空にしながら全てを順番どおりに渡す.
+void TestQueueTwoThreads()
+{
+    const uint64_t Count = 200000;
+    SpscQueue<Item> queue(8);
+    std::atomic<uint64_t> fullCount(0);
+    std::thread producer([&]() {
+        for (uint64_t i = 0; i < Count; )
+        {
+            if (queue.TryPush(Item::Make(i)))
+            {
+                ++i;
+            }
+            else
+            {
+                fullCount++;
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    uint64_t next = 0, emptyCount = 0;
+    int wrong = 0;
+    Item item;
+    while (next < Count)
+    {
+        if (!queue.TryPop(item))
+        {
+            emptyCount++;
+            std::this_thread::yield();
+            continue;
+        }
+        wrong += (item.IsValid() && item.sequence == next) ? 0 : 1;
+        next++;
+    }
+    producer.join();
+    TEST_CHECK(wrong == 0);
+    TEST_CHECK(!queue.TryPop(item));
+    // 両方の状態を通ったことを確かめる (スレッドの進み方によるので, どちらかは必ず起きる).
+    TEST_CHECK(fullCount.load() + emptyCount > 0);
+}
+
+// 読む側は Publish() した値だけを見て, Update() すれば最新のものに切り替わる.
+void TestTripleBufferSingleThread()
+{
+    TripleBuffer<Item> buffer(Item::Make(0));
+    TEST_CHECK(!buffer.Update());
+    TEST_CHECK(buffer.GetReadBuffer().sequence == 0);
+
+    buffer.GetWriteBuffer() = Item::Make(1);
+    TEST_CHECK(buffer.GetReadBuffer().sequence == 0);
+    buffer.Publish();
+    TEST_CHECK(buffer.GetReadBuffer().sequence == 0);
+    TEST_CHECK(buffer.Update());
+    TEST_CHECK(buffer.GetReadBuffer().sequence == 1);
+    TEST_CHECK(!buffer.Update());
+    TEST_CHECK(buffer.GetReadBuffer().sequence == 1);
+
+    // 読む前に何度も渡した場合は, 最後のものだけを読む.
+    for (uint64_t i = 2; i <= 10; ++i)
+    {
+        buffer.GetWriteBuffer() = Item::Make(i);
+        buffer.Publish();
+    }
+    TEST_CHECK(buffer.Update());
+    TEST_CHECK(buffer.GetReadBuffer().sequence == 10);
+    TEST_CHECK(!buffer.Update());
+
+    // 書き込み中の値は読む側から見えない.
+    buffer.GetWriteBuffer() = Item::Make(11);
+    TEST_CHECK(!buffer.Update());
+    TEST_CHECK(buffer.GetReadBuffer().sequence == 10);
+}
+
+// 大きめの値を書き込みながら読む. 読んだ値は途中まで書かれたものではなく, 連番は戻らず, 最後には最新の値を読む.
+void TestTripleBufferTwoThreads()
+{
+    const uint64_t Count = 100000;
+    struct Snapshot
+    {
+        uint64_t values[32];
+    };
+    Snapshot initial = {};
+    TripleBuffer<Snapshot> buffer(initial);
+    std::atomic<bool> finished(false);
+
+    std::thread writer([&]() {
+        for (uint64_t i = 1; i <= Count; ++i)
+        {
+            Snapshot& snapshot = buffer.GetWriteBuffer();
+            for (uint64_t& value : snapshot.values)
+            {
+                value = i;
+            }
+            buffer.Publish();
+            if (i % 64 == 0)
+            {
+                std::this_thread::yield();
+            }
+        }
+        finished.store(true);
+    });
+
+    uint64_t last = 0, updates = 0;
+    int torn = 0, backwards = 0;
+    // 渡した回数より多く切り替わることはない.
+    while (updates <= Count)
+    {
+        const bool done = finished.load();
+        if (buffer.Update())
+        {
+            const Snapshot& snapshot = buffer.GetReadBuffer();
+            for (uint64_t value : snapshot.values)
+            {
+                torn += value == snapshot.values[0] ? 0 : 1;
+            }
+            backwards += snapshot.values[0] > last ? 0 : 1;
+            last = snapshot.values[0];
+            updates++;
+        }
+        else if (done)
+        {
+            break;
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+    writer.join();
+    TEST_CHECK(torn == 0);
+    TEST_CHECK(backwards == 0);
+    TEST_CHECK(updates > 0 && updates <= Count);
+    TEST_CHECK(last == Count);
+    TEST_CHECK(buffer.GetReadBuffer().values[31] == Count);
+}
+
+// 受け取ったイベントとフレームを記録する. 描画スレッドから呼ばれる.
+class RecordingClient : public RenderThread::Client
+{
+public:
+    RecordingClient()
+        : m_handled(0), m_frames(0)
+    {
+    }
+
+    virtual void WaitForFrame()
+    {
+        std::this_thread::yield();
+    }
+
+    virtual void HandleEvent(const RenderEvent& event)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_keys.push_back(event.key);
+        }
+        m_handled.fetch_add(1);
+    }
+
+    virtual void RenderFrame()
+    {
+        m_frames.fetch_add(1);
+    }
+
+    uint64_t GetHandled() const { return m_handled.load(); }
+    uint64_t GetFrames() const { return m_frames.load(); }
+    std::vector<uint32_t> GetKeys() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_keys;
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    std::vector<uint32_t> m_keys;
+    std::atomic<uint64_t> m_handled;
+    std::atomic<uint64_t> m_frames;
+};
+
+RenderEvent MakeEvent(uint32_t key)
+{
+    RenderEvent event;
+    event.type = (key % 2 == 0) ? RenderEvent::KeyDown : RenderEvent::KeyUp;
+    event.key = key;
+    event.modifiers = key % 8;
+    return event;
+}
+
+// 別のスレッドから送ったイベントは全て, 送った順に描画スレッドに届く.
+// キューが一杯で捨てたものは dropped に数え, 送り直せば届く.
+void TestRenderThreadDelivery()
+{
+    const uint32_t Count = 20000;
+    RecordingClient client;
+    RenderThread thread(16);
+    thread.Start(&client);
+    TEST_CHECK(thread.IsRunning());
+
+    std::atomic<uint64_t> rejected(0);
+    std::thread producer([&]() {
+        for (uint32_t i = 0; i < Count; )
+        {
+            if (thread.Post(MakeEvent(i)))
+            {
+                ++i;
+            }
+            else
+            {
+                rejected++;
+                std::this_thread::yield();
+            }
+        }
+    });
+    producer.join();
+    TEST_CHECK(WaitUntil([&]() { return client.GetHandled() >= Count; }));
+    // 描画が進んでいることも確かめる.
+    const uint64_t frames = client.GetFrames();
+    TEST_CHECK(WaitUntil([&]() { return client.GetFrames() >= frames + 2; }));
+    thread.Stop();
+    TEST_CHECK(!thread.IsRunning());
+
+    const std::vector<uint32_t> keys = client.GetKeys();
+    TEST_CHECK(keys.size() == Count);
+    int wrong = 0;
+    for (uint32_t i = 0; i < keys.size(); ++i)
+    {
+        wrong += keys[i] == i ? 0 : 1;
+    }
+    TEST_CHECK(wrong == 0);
+
+    const RenderThread::Stats stats = thread.GetStats();
+    TEST_CHECK(stats.events == Count);
+    TEST_CHECK(stats.dropped == rejected.load());
+    TEST_CHECK(stats.frames == client.GetFrames());
+    TEST_CHECK(stats.maxEventMsec >= 0.0 && stats.totalPresentMsec >= stats.totalEventMsec);
+}
+
+// Stop() はスレッドを終了して待ち, 何度呼んでもよい. 止めた後に Start() し直せば, また描画する.
+void TestRenderThreadStop()
+{
+    RecordingClient client;
+    {
+        RenderThread thread(4);
+        thread.Stop();
+        TEST_CHECK(!thread.IsRunning());
+
+        for (int run = 0; run < 3; ++run)
+        {
+            thread.Start(&client);
+            const uint64_t frames = client.GetFrames();
+            TEST_CHECK(WaitUntil([&]() { return client.GetFrames() >= frames + 3; }));
+            thread.Stop();
+            TEST_CHECK(!thread.IsRunning());
+            // 止めた後はフレームが進まない.
+            const uint64_t stopped = client.GetFrames();
+            TEST_CHECK(thread.GetFrameCount() == stopped);
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            TEST_CHECK(client.GetFrames() == stopped);
+            thread.Stop();
+        }
+
+        // 止める前に届いたイベントは, 次に Start() したときに渡す.
+        TEST_CHECK(thread.Post(MakeEvent(7)));
+        thread.Start(&client);
+        TEST_CHECK(WaitUntil([&]() { return client.GetHandled() >= 1; }));
+        // 動いたままデストラクタで止める.
+    }
+    TEST_CHECK(client.GetKeys() == std::vector<uint32_t>({ 7 }));
+}
+}
+
+int main()
+{
+    Test::Run("queue (single thread)", TestQueueSingleThread);
+    Test::Run("queue (two threads)", TestQueueTwoThreads);
+    Test::Run("triple buffer (single thread)", TestTripleBufferSingleThread);
+    Test::Run("triple buffer (two threads)", TestTripleBufferTwoThreads);
+    Test::Run("render thread delivery", TestRenderThreadDelivery);
+    Test::Run("render thread stop", TestRenderThreadStop);
+    return Test::Finish();
+}
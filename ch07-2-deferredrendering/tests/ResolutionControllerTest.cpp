@@ -0,0 +1,212 @@
+﻿// ResolutionController のテスト. tests/run_tests.sh でビルドして実行します.
+//
+// 等倍で描いた場合の GPU 時間を並べたトレースを, 画素数に比例する負荷の模型で倍率に応じた時間に直して与えます.
+// 計測結果は実際と同じく数フレーム遅れて届きます. 目標の時間に収束すること, 倍率が範囲に収まること,
+// 1 フレームだけの負荷の跳ねで振動しないことを確かめます.
+#include "ResolutionController.h"
+#include "Test.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace
+{
+const double BudgetSec = 1.0 / 60.0;
+const double TargetSec = BudgetSec * 0.9;  // 既定の headroom を引いた目標.
+const double FixedSec = 0.002;              // 倍率に依らない時間 (合成や UI).
+const int Latencies[] = { 0, 1, 3, 5 };     // 計測結果が届くまでのフレーム数.
+
+// トレースの区間. 等倍での GPU 時間が frames フレーム続く.
+struct Segment
+{
+    int frames;
+    double fullSec;
+};
+
+// 区間を並べ, jitter の割合で揺らしたトレースを作る. 揺れは固定の種から作るので毎回同じです.
+std::vector<double> MakeTrace(const std::vector<Segment>& segments, double jitter)
+{
+    std::vector<double> trace;
+    uint32_t seed = 1;
+    for (const Segment& segment : segments)
+    {
+        for (int i = 0; i < segment.frames; ++i)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            const double noise = (seed >> 8) / double(1 << 24) * 2.0 - 1.0;
+            trace.push_back(segment.fullSec * (1.0 + jitter * noise));
+        }
+    }
+    return trace;
+}
+
+// 各フレームの倍率とフレーム時間.
+struct Frame
+{
+    double scale;
+    double frameSec;
+};
+
+std::vector<Frame> Run(ResolutionController& controller, const std::vector<double>& trace, int latency)
+{
+    std::vector<Frame> frames;
+    std::deque<Frame> pending;
+    for (double fullSec : trace)
+    {
+        Frame frame;
+        frame.scale = controller.GetScale();
+        frame.frameSec = FixedSec + fullSec * frame.scale * frame.scale;
+        frames.push_back(frame);
+        pending.push_back(frame);
+        if (int(pending.size()) > latency)
+        {
+            controller.Update(pending.front().frameSec, pending.front().scale);
+            pending.pop_front();
+        }
+    }
+    return frames;
+}
+
+// 目標の時間になる倍率.
+double GetSteadyScale(double fullSec)
+{
+    return sqrt((TargetSec - FixedSec) / fullSec);
+}
+
+// 負荷が一定なら目標の時間に収束し, そこから動かない. 揺れがあっても予算は超えず, 揺れを大きくもしない.
+void TestConvergence()
+{
+    const double Loads[] = { 0.018, 0.022, 0.030, 0.040 };
+    for (int latency : Latencies)
+    {
+        for (double load : Loads)
+        {
+            ResolutionController controller;
+            controller.Configure(ResolutionController::GetDefaultSettings(BudgetSec));
+            const std::vector<Frame> frames = Run(controller, MakeTrace({ { 120, load } }, 0.0), latency);
+
+            const double steady = GetSteadyScale(load);
+            TEST_CHECK(fabs(controller.GetScale() - steady) < 1e-3);
+            int wrong = 0;
+            for (size_t i = 60; i < frames.size(); ++i)
+            {
+                wrong += fabs(frames[i].frameSec / TargetSec - 1.0) < 0.01 ? 0 : 1;
+            }
+            TEST_CHECK(wrong == 0);
+
+            const double Jitter = 0.04;
+            ResolutionController noisy;
+            noisy.Configure(ResolutionController::GetDefaultSettings(BudgetSec));
+            const std::vector<Frame> noisyFrames = Run(noisy, MakeTrace({ { 400, load } }, Jitter), latency);
+            wrong = 0;
+            double scaleSum = 0.0;
+            for (size_t i = 100; i < noisyFrames.size(); ++i)
+            {
+                wrong += fabs(noisyFrames[i].frameSec / TargetSec - 1.0) < Jitter * 1.25 ? 0 : 1;
+                scaleSum += noisyFrames[i].scale;
+            }
+            TEST_CHECK(wrong == 0);
+            TEST_CHECK(fabs(scaleSum / (noisyFrames.size() - 100) / steady - 1.0) < 0.01);
+        }
+    }
+}
+
+// 倍率は範囲を出ず, 端に張り付いている間も積分が溜まらないので, 負荷が変わればすぐに離れる.
+void TestClamping()
+{
+    for (int latency : Latencies)
+    {
+        // 最小の倍率でも目標を超える負荷から, 等倍でも目標に届かない負荷へ移る.
+        ResolutionController controller;
+        controller.Configure(ResolutionController::GetDefaultSettings(BudgetSec));
+        const std::vector<Frame> frames = Run(controller, MakeTrace({ { 120, 0.080 }, { 120, 0.008 } }, 0.0), latency);
+        TEST_CHECK(controller.GetStats().lowestScale == 0.5);
+        TEST_CHECK(frames[119].scale == 0.5);
+        TEST_CHECK(controller.GetScale() == 1.0);
+        int arrival = -1;
+        for (size_t i = 120; i < frames.size() && arrival < 0; ++i)
+        {
+            arrival = frames[i].scale == 1.0 ? int(i - 120) : -1;
+        }
+        TEST_CHECK(arrival >= 0 && arrival <= 20 + latency);
+
+        // 逆に等倍に張り付いた後で重くなれば, すぐに下がり始める.
+        ResolutionController light;
+        light.Configure(ResolutionController::GetDefaultSettings(BudgetSec));
+        const std::vector<Frame> lightFrames = Run(light, MakeTrace({ { 120, 0.008 }, { 60, 0.022 } }, 0.0), latency);
+        TEST_CHECK(lightFrames[119].scale == 1.0);
+        TEST_CHECK(lightFrames[120 + latency + 1].scale < 0.95);
+        TEST_CHECK(fabs(light.GetScale() - GetSteadyScale(0.022)) < 1e-3);
+
+        // 既定以外の範囲も守る.
+        ResolutionController narrow;
+        ResolutionController::Settings settings = ResolutionController::GetDefaultSettings(BudgetSec);
+        settings.minScale = 0.7;
+        settings.maxScale = 0.9;
+        narrow.Configure(settings);
+        const std::vector<Frame> narrowFrames = Run(narrow, MakeTrace({ { 60, 0.008 }, { 60, 0.080 }, { 60, 0.008 } }, 0.1), latency);
+        int wrong = 0;
+        for (const Frame& frame : narrowFrames)
+        {
+            wrong += (frame.scale >= 0.7 && frame.scale <= 0.9) ? 0 : 1;
+        }
+        TEST_CHECK(wrong == 0);
+        TEST_CHECK(narrowFrames[119].scale == 0.7);
+        TEST_CHECK(narrowFrames.back().scale == 0.9);
+    }
+}
+
+// 一定の負荷の中で 1 フレームだけ 3 倍に跳ねても, 倍率は一度下がってから行き過ぎずに戻る.
+// 予算を超えるのは跳ねたフレームだけで, 制御が原因で超えるフレームは無い.
+void TestSpikes()
+{
+    const double Load = 0.022;
+    const int Period = 40;
+    const int SpikeCount = 8;
+    for (int latency : Latencies)
+    {
+        std::vector<double> trace = MakeTrace({ { 60 + Period * SpikeCount, Load } }, 0.0);
+        for (int i = 0; i < SpikeCount; ++i)
+        {
+            trace[60 + Period * i] *= 3.0;
+        }
+        ResolutionController controller;
+        controller.Configure(ResolutionController::GetDefaultSettings(BudgetSec));
+        const std::vector<Frame> frames = Run(controller, trace, latency);
+
+        const double steady = GetSteadyScale(Load);
+        int overBudget = 0, overshoot = 0, unrecovered = 0;
+        for (size_t i = 60; i < frames.size(); ++i)
+        {
+            overBudget += frames[i].frameSec > BudgetSec ? 1 : 0;
+        }
+        TEST_CHECK(overBudget == SpikeCount);
+        double lowest = 1.0;
+        for (int i = 0; i < SpikeCount; ++i)
+        {
+            const int spike = 60 + Period * i;
+            for (int j = spike; j < spike + Period; ++j)
+            {
+                overshoot += frames[j].scale < steady * 1.005 ? 0 : 1;
+                lowest = std::min(lowest, frames[j].scale);
+            }
+            unrecovered += fabs(frames[spike + Period - 1].scale / steady - 1.0) < 0.005 ? 0 : 1;
+        }
+        TEST_CHECK(overshoot == 0);
+        TEST_CHECK(unrecovered == 0);
+        // 1 フレームの跳ねで, 倍率を大きく下げすぎない.
+        TEST_CHECK(lowest > steady * 0.75);
+    }
+}
+}
+
+int main()
+{
+    Test::Run("convergence", TestConvergence);
+    Test::Run("clamping", TestClamping);
+    Test::Run("spikes", TestSpikes);
+    return Test::Finish();
+}
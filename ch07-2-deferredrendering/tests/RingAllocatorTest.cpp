@@ -0,0 +1,252 @@
+﻿// RingAllocator のテスト. tests/run_tests.sh でビルドして実行します.
+//
+// 頂点バッファの代わりに, 書き込んだバイトごとにフレーム番号を覚える MockBuffer を使い,
+// GPU がまだ読んでいる領域へ書き込んでいないことを確かめます.
+#include "RingAllocator.h"
+#include "Test.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace
+{
+// DynamicBuffer の持つ D3DUSAGE_DYNAMIC のバッファの模型.
+// フレームは発行した順に完了するので, 完了した最後のフレーム番号だけを覚えます.
+class MockBuffer
+{
+public:
+    explicit MockBuffer(uint32_t capacity)
+        : m_owner(capacity, Free), m_completed(-1)
+    {
+    }
+
+    // D3DLOCK_DISCARD. 以前の内容は GPU 側に残ったまま, 新しいメモリに置き換わる.
+    void Discard()
+    {
+        std::fill(m_owner.begin(), m_owner.end(), Free);
+    }
+
+    // D3DLOCK_NOOVERWRITE の書き込み. 完了していないフレームの領域と重なれば false を返します.
+    bool Write(uint32_t offset, uint32_t size, int frame)
+    {
+        if (uint64_t(offset) + size > m_owner.size())
+        {
+            return false;
+        }
+        bool valid = true;
+        for (uint32_t i = offset; i < offset + size; ++i)
+        {
+            if (m_owner[i] != Free && m_owner[i] > m_completed)
+            {
+                valid = false;
+            }
+            m_owner[i] = frame;
+        }
+        return valid;
+    }
+
+    void Complete(int frame) { m_completed = frame; }
+
+private:
+    enum { Free = -1 };
+    std::vector<int> m_owner;
+    int m_completed;
+};
+
+// フレームの終わりに EndFrame() を呼び, GPU が latency フレーム遅れで追いつく様子を再現します.
+// DynamicBuffer と同じく, 完了したフェンスを古い順に RetireOldest() で通知します.
+class Simulation
+{
+public:
+    Simulation(uint32_t capacity, int latency)
+        : m_buffer(capacity), m_latency(latency), m_frame(0), m_overwrites(0)
+    {
+        m_ring.Reset(capacity);
+        for (auto& frame : m_fenceFrame)
+        {
+            frame = -1;
+        }
+    }
+
+    uint32_t Allocate(uint32_t size, uint32_t alignment)
+    {
+        bool discard;
+        uint32_t offset = m_ring.Allocate(size, alignment, &discard);
+        if (offset == RingAllocator::InvalidOffset)
+        {
+            return offset;
+        }
+        if (discard)
+        {
+            m_buffer.Discard();
+        }
+        if (!m_buffer.Write(offset, size, m_frame))
+        {
+            m_overwrites++;
+        }
+        return offset;
+    }
+
+    void EndFrame()
+    {
+        // 統合されたスロットはフェンスを発行し直すので, 最後のフレームを覚える.
+        int slot = m_ring.EndFrame();
+        if (slot >= 0)
+        {
+            m_fenceFrame[slot] = m_frame;
+        }
+
+        const int completed = m_frame - m_latency;
+        m_buffer.Complete(completed);
+        while (m_ring.HasPendingFrame() && m_fenceFrame[m_ring.GetOldestSlot()] <= completed)
+        {
+            m_ring.RetireOldest();
+        }
+        m_frame++;
+    }
+
+    RingAllocator& GetRing() { return m_ring; }
+    int GetOverwrites() const { return m_overwrites; }
+
+private:
+    RingAllocator m_ring;
+    MockBuffer m_buffer;
+    int m_fenceFrame[RingAllocator::MaxFramesInFlight];
+    int m_latency;
+    int m_frame;
+    int m_overwrites;
+};
+
+void TestAlignment()
+{
+    RingAllocator ring;
+    ring.Reset(1024);
+    bool discard;
+    TEST_CHECK(ring.Allocate(10, 1, &discard) == 0);
+    TEST_CHECK(ring.Allocate(20, 16, &discard) == 16);
+    TEST_CHECK(ring.Allocate(4, 4, &discard) == 36);
+    TEST_CHECK(!discard);
+    TEST_CHECK(ring.GetUsedBytes() == 40);
+    TEST_CHECK(ring.Allocate(0, 1, &discard) == RingAllocator::InvalidOffset);
+    TEST_CHECK(ring.Allocate(1025, 1, &discard) == RingAllocator::InvalidOffset);
+    TEST_CHECK(ring.GetStats().allocations == 3);
+}
+
+void TestFenceRetirement()
+{
+    Simulation sim(1000, 2);
+    RingAllocator& ring = sim.GetRing();
+
+    // 完了していないフレームの領域は使われ続ける.
+    TEST_CHECK(sim.Allocate(300, 1) == 0);
+    sim.EndFrame();
+    TEST_CHECK(sim.Allocate(300, 1) == 300);
+    sim.EndFrame();
+    TEST_CHECK(ring.GetUsedBytes() == 600);
+
+    // 3 フレーム目の終わりに 1 フレーム目が完了し, その領域が空く.
+    TEST_CHECK(sim.Allocate(300, 1) == 600);
+    sim.EndFrame();
+    TEST_CHECK(ring.GetUsedBytes() == 600);
+
+    // 確保の無いフレームはフェンスを増やさない.
+    TEST_CHECK(ring.EndFrame() == -1);
+    TEST_CHECK(sim.GetOverwrites() == 0);
+}
+
+void TestWrapAround()
+{
+    Simulation sim(1000, 1);
+    RingAllocator& ring = sim.GetRing();
+
+    TEST_CHECK(sim.Allocate(400, 1) == 0);
+    sim.EndFrame();
+    TEST_CHECK(sim.Allocate(400, 1) == 400);
+    sim.EndFrame();
+
+    // 末尾に 200 バイトしか残っていないので, 解放済みの先頭へ折り返す.
+    TEST_CHECK(sim.Allocate(300, 1) == 0);
+    TEST_CHECK(ring.GetStats().wraps == 1);
+    TEST_CHECK(ring.GetStats().discards == 0);
+
+    // 折り返した後は, まだ使用中の [400, 800) の手前までしか使えない.
+    TEST_CHECK(sim.Allocate(99, 1) == 300);
+    TEST_CHECK(sim.GetOverwrites() == 0);
+
+    // head が tail に追いつくと空と区別できないので, 最後の 1 バイトは使わずに DISCARD する.
+    bool discard = false;
+    TEST_CHECK(ring.Allocate(1, 1, &discard) == 0);
+    TEST_CHECK(discard);
+}
+
+void TestDiscardFallback()
+{
+    Simulation sim(1000, 3);
+    RingAllocator& ring = sim.GetRing();
+
+    TEST_CHECK(sim.Allocate(600, 1) == 0);
+    sim.EndFrame();
+
+    // GPU が読んでいる領域しか残っていないので DISCARD して先頭から使う.
+    bool discard = false;
+    TEST_CHECK(ring.Allocate(600, 1, &discard) == 0);
+    TEST_CHECK(discard);
+    TEST_CHECK(ring.GetStats().discards == 1);
+    TEST_CHECK(!ring.HasPendingFrame());
+    TEST_CHECK(ring.GetUsedBytes() == 600);
+}
+
+void TestMergedFences()
+{
+    // 追跡できる数を超えたフレームは最新のスロットへ統合され, 遅い方のフェンスを待つ.
+    Simulation sim(4096, RingAllocator::MaxFramesInFlight + 2);
+    RingAllocator& ring = sim.GetRing();
+    for (int i = 0; i < RingAllocator::MaxFramesInFlight + 2; ++i)
+    {
+        TEST_CHECK(sim.Allocate(100, 1) == uint32_t(i * 100));
+        sim.EndFrame();
+    }
+    TEST_CHECK(ring.GetUsedBytes() == 100 * uint32_t(RingAllocator::MaxFramesInFlight + 2));
+    TEST_CHECK(sim.GetOverwrites() == 0);
+}
+
+void TestRandomStreaming()
+{
+    // 大きさと遅延を変えながら書き込み, 使用中の領域を上書きしないことを確かめる.
+    std::mt19937 random(12345);
+    const uint32_t alignments[] = { 1, 4, 16, 32 };
+    for (int latency = 0; latency <= 5; ++latency)
+    {
+        Simulation sim(64 * 1024, latency);
+        for (int frame = 0; frame < 2000; ++frame)
+        {
+            const int count = 1 + int(random() % 8);
+            for (int i = 0; i < count; ++i)
+            {
+                const uint32_t size = 1 + random() % 4000;
+                const uint32_t alignment = alignments[random() % 4];
+                const uint32_t offset = sim.Allocate(size, alignment);
+                TEST_CHECK(offset != RingAllocator::InvalidOffset);
+                TEST_CHECK(offset % alignment == 0);
+            }
+            sim.EndFrame();
+        }
+        const RingAllocator::Stats& stats = sim.GetRing().GetStats();
+        TEST_CHECK(sim.GetOverwrites() == 0);
+        TEST_CHECK(latency == 0 || stats.wraps > 0);
+        printf("  latency %d: %u allocations, %u wraps, %u discards\n", latency, stats.allocations, stats.wraps, stats.discards);
+    }
+}
+}
+
+int main()
+{
+    Test::Run("alignment", TestAlignment);
+    Test::Run("fence retirement", TestFenceRetirement);
+    Test::Run("wrap around", TestWrapAround);
+    Test::Run("discard fallback", TestDiscardFallback);
+    Test::Run("merged fences", TestMergedFences);
+    Test::Run("random streaming", TestRandomStreaming);
+    return Test::Finish();
+}
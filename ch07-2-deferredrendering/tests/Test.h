@@ -0,0 +1,44 @@
+﻿#pragma once
+#include <cstdio>
+
+// tests/ 以下のテストで使う小さな補助.
+// TEST_CHECK は失敗した条件を表示して数えるだけで, 処理は続けます.
+// main() では Test::Run() で各テストを呼び出し, 最後に Test::Finish() の値を返します.
+namespace Test
+{
+inline int& Failures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+inline bool Check(bool condition, const char* expr, const char* file, int line)
+{
+    if (!condition)
+    {
+        fprintf(stderr, "%s(%d): FAILED: %s\n", file, line, expr);
+        Failures()++;
+    }
+    return condition;
+}
+
+template <class Func>
+void Run(const char* name, Func func)
+{
+    const int before = Failures();
+    func();
+    printf("%s %s\n", Failures() == before ? "[  OK  ]" : "[ FAIL ]", name);
+}
+
+inline int Finish()
+{
+    if (Failures() > 0)
+    {
+        printf("%d check(s) failed\n", Failures());
+        return 1;
+    }
+    return 0;
+}
+}
+
+#define TEST_CHECK(expr) Test::Check((expr), #expr, __FILE__, __LINE__)
@@ -0,0 +1,38 @@
+#!/bin/sh
+# D3D に依存しないモジュールのテストを Linux でビルドして実行します.
+#
+#   tests/run_tests.sh [出力ディレクトリ]
+#
+# 環境変数 CXX でコンパイラを, SANITIZE でサニタイザー (既定は address,undefined) を変えられます.
+# 失敗したテストがあれば 1 を返します.
+cd "$(dirname "$0")/.." || exit 1
+OUT=${1:-${TMPDIR:-/tmp}/ch07-2-tests}
+CXX=${CXX:-g++}
+SANITIZE=${SANITIZE:-address,undefined}
+mkdir -p "$OUT" || exit 1
+
+failed=0
+run()
+{
+    name=$1
+    shift
+    echo "== $name"
+    if $CXX -std=c++17 -g -O1 -pthread -fsanitize=$SANITIZE -fno-sanitize-recover=all -I. "$@" -o "$OUT/$name" && "$OUT/$name"; then
+        :
+    else
+        echo "$name: FAILED"
+        failed=1
+    fi
+}
+
+run RingAllocatorTest tests/RingAllocatorTest.cpp RingAllocator.cpp
+run RenderTargetPoolTest tests/RenderTargetPoolTest.cpp RenderTargetPool.cpp
+run FrameGraphCompilerTest tests/FrameGraphCompilerTest.cpp FrameGraphCompiler.cpp
+run CaptureQueueTest tests/CaptureQueueTest.cpp CaptureQueue.cpp ImageWriter.cpp PixelConvert.cpp
+run JobSystemTest tests/JobSystemTest.cpp JobSystem.cpp
+run RenderThreadTest tests/RenderThreadTest.cpp RenderThread.cpp
+run FramePacerTest tests/FramePacerTest.cpp FramePacer.cpp
+run ResolutionControllerTest tests/ResolutionControllerTest.cpp ResolutionController.cpp
+run MeshBuilderTest tests/MeshBuilderTest.cpp MeshBuilder.cpp
+
+exit $failed
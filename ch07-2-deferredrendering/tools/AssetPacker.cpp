@@ -0,0 +1,223 @@
+﻿// AssetArchive を作るコマンドラインツール.
+// サンプル本体とは別に, Linux (または Windows のコマンドライン) で次のようにビルドします.
+//
+//   g++ -std=c++17 -O2 -pthread -I.. AssetPacker.cpp ../AssetArchive.cpp ../JobSystem.cpp ../Lz4Codec.cpp ../MappedFile.cpp -o AssetPacker
+//
+// 使い方:
+//   AssetPacker [-C ディレクトリ] [-threads N] [-store 拡張子] 出力ファイル ファイルまたはディレクトリ...
+//     ディレクトリは中のファイルを全て追加します. 名前は -C のディレクトリ (省略時はカレント) からの相対パスです.
+//     -store で指定した拡張子 (例: .png) のファイルは圧縮せずに置きます. 複数回指定できます.
+//     .png と .jpg は既に圧縮されているので, 指定しなくても圧縮しません.
+//   AssetPacker -list アーカイブ
+//     格納しているファイルの一覧を表示します.
+#include "AssetArchive.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+struct Options
+{
+    std::string root;
+    int threadCount = 0;
+    std::vector<std::string> storeExtensions;
+    std::string output;
+    std::vector<std::string> inputs;
+};
+
+void PrintUsage()
+{
+    fputs("usage: AssetPacker [-C dir] [-threads N] [-store .ext] output.pak files_or_dirs...\n"
+        "       AssetPacker -list archive.pak\n", stderr);
+}
+
+bool ParseOptions(int argc, char* argv[], Options& options)
+{
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; ++i)
+    {
+        if (i + 1 >= argc)
+        {
+            return false;
+        }
+        if (strcmp(argv[i], "-C") == 0)
+        {
+            options.root = argv[++i];
+        }
+        else if (strcmp(argv[i], "-threads") == 0)
+        {
+            options.threadCount = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-store") == 0)
+        {
+            options.storeExtensions.push_back(AssetArchive::NormalizeName(argv[++i]));
+        }
+        else
+        {
+            return false;
+        }
+    }
+    if (argc - i < 2)
+    {
+        return false;
+    }
+    options.output = argv[i++];
+    options.inputs.assign(argv + i, argv + argc);
+    return true;
+}
+
+bool ShouldCompress(const std::string& name, const Options& options)
+{
+    std::string extension = AssetArchive::NormalizeName(fs::path(name).extension().string().c_str());
+    if (extension == ".png" || extension == ".jpg" || extension == ".jpeg")
+    {
+        return false;
+    }
+    return std::find(options.storeExtensions.begin(), options.storeExtensions.end(), extension) ==
+        options.storeExtensions.end();
+}
+
+// 入力に指定されたファイルとディレクトリの中のファイルを, アーカイブに入れる名前の順に集める.
+bool CollectFiles(const Options& options, std::vector<std::string>& names)
+{
+    const fs::path root = options.root.empty() ? fs::path(".") : fs::path(options.root);
+    for (const auto& input : options.inputs)
+    {
+        const fs::path path = root / input;
+        std::error_code ec;
+        if (fs::is_directory(path, ec))
+        {
+            for (const auto& item : fs::recursive_directory_iterator(path, ec))
+            {
+                // 以前に作ったアーカイブ自身は入れない.
+                if (item.is_regular_file() && !fs::equivalent(item.path(), options.output, ec))
+                {
+                    names.push_back(fs::relative(item.path(), root).generic_string());
+                }
+            }
+        }
+        else if (fs::is_regular_file(path, ec))
+        {
+            names.push_back(fs::path(input).lexically_normal().generic_string());
+        }
+        else
+        {
+            fprintf(stderr, "AssetPacker: %s not found\n", path.string().c_str());
+            return false;
+        }
+    }
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    return true;
+}
+
+int Pack(const Options& options)
+{
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::string> names;
+    if (!CollectFiles(options, names))
+    {
+        return 1;
+    }
+
+    const fs::path root = options.root.empty() ? fs::path(".") : fs::path(options.root);
+    AssetArchiveWriter writer;
+    uint64_t totalSize = 0;
+    for (const auto& name : names)
+    {
+        MappedFile file;
+        if (!file.Open((root / name).string().c_str(), MappedFile::Sequential))
+        {
+            fprintf(stderr, "AssetPacker: failed to read %s\n", name.c_str());
+            return 1;
+        }
+        if (!writer.AddFile(name.c_str(), file.GetData(), file.GetSize(), ShouldCompress(name, options)))
+        {
+            fprintf(stderr, "AssetPacker: duplicate name %s\n", name.c_str());
+            return 1;
+        }
+        totalSize += file.GetSize();
+    }
+    if (!writer.Write(options.output.c_str(), options.threadCount))
+    {
+        fprintf(stderr, "AssetPacker: failed to write %s\n", options.output.c_str());
+        return 1;
+    }
+
+    // 書き込んだアーカイブを開き直し, 全てのファイルが元と一致するか確かめる.
+    AssetArchive archive;
+    if (!archive.Open(options.output.c_str()))
+    {
+        fprintf(stderr, "AssetPacker: failed to verify %s\n", options.output.c_str());
+        return 1;
+    }
+    uint64_t storedSize = 0;
+    int compressedCount = 0;
+    std::vector<uint8_t> buf;
+    for (const auto& name : names)
+    {
+        const AssetArchive::Entry* entry = archive.Find(name.c_str());
+        MappedFile file;
+        file.Open((root / name).string().c_str(), MappedFile::Sequential);
+        buf.resize(file.GetSize());
+        if (!entry || entry->size != file.GetSize() || !archive.Read(*entry, buf.data(), options.threadCount) ||
+            (file.GetSize() > 0 && memcmp(buf.data(), file.GetData(), file.GetSize()) != 0))
+        {
+            fprintf(stderr, "AssetPacker: verification failed for %s\n", name.c_str());
+            return 1;
+        }
+        storedSize += entry->storedSize;
+        compressedCount += entry->blockCount != 0 ? 1 : 0;
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    printf("%s: %d files (%d compressed), %llu -> %llu bytes (%.1f%%), %.1f ms\n",
+        options.output.c_str(), int(names.size()), compressedCount,
+        (unsigned long long)totalSize, (unsigned long long)storedSize,
+        totalSize > 0 ? storedSize * 100.0 / totalSize : 100.0,
+        std::chrono::duration<double, std::milli>(end - begin).count());
+    return 0;
+}
+
+int List(const char* fileName)
+{
+    AssetArchive archive;
+    if (!archive.Open(fileName))
+    {
+        fprintf(stderr, "AssetPacker: failed to open %s\n", fileName);
+        return 1;
+    }
+    for (size_t i = 0; i < archive.GetEntryCount(); ++i)
+    {
+        const AssetArchive::Entry& entry = archive.GetEntry(i);
+        printf("%12llu %12llu %6u  %s\n",
+            (unsigned long long)entry.size, (unsigned long long)entry.storedSize, entry.blockCount,
+            archive.GetName(entry).c_str());
+    }
+    return 0;
+}
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc == 3 && strcmp(argv[1], "-list") == 0)
+    {
+        return List(argv[2]);
+    }
+    Options options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        PrintUsage();
+        return 2;
+    }
+    return Pack(options);
+}
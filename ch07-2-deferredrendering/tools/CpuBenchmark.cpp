@@ -0,0 +1,66 @@
+﻿// D3D を使わない CPU 側のベンチマーク (CpuBenchmarks) を実行するコマンドラインツール.
+// サンプル本体の -benchmark と同じ項目のうち, ヌルデバイスを使わないものを Linux でも計測できます.
+// DirectXMath のヘッダー (https://github.com/microsoft/DirectXMath) が必要です.
+//
+//   g++ -std=c++17 -O2 -pthread -I.. -I<DirectXMath の Inc> CpuBenchmark.cpp ../CpuBenchmarks.cpp ../Benchmark.cpp
+//     ../AssetArchive.cpp ../CaptureQueue.cpp ../DeferredScene.cpp ../FrameGraphCompiler.cpp ../GeometryProcessing.cpp
+//     ../ImageWriter.cpp ../JobSystem.cpp ../LightingReference.cpp ../Lz4Codec.cpp ../MappedFile.cpp ../MeshBuilder.cpp
+//     ../MeshCodec.cpp ../MeshImporter.cpp ../MeshSimplifier.cpp ../Meshlet.cpp ../PixelConvert.cpp -o CpuBenchmark
+//
+// 使い方:
+//   CpuBenchmark [-out ファイル] [-baseline ファイル] [-threshold パーセント]
+//     結果を JSON で標準出力 (-out があればそのファイル) へ書き出し, -baseline のファイルと比較します.
+//     ベースラインより threshold (既定は 10%) を超えて遅くなった項目があれば 1 を返します.
+//
+// benchmarks/baseline_linux.json は 1 コアの x86-64 Linux の仮想マシンで 3 回実行し, 各項目の中央値の最も遅い値を取ったものです.
+// 計測する環境が変わったら -out で記録し直してください.
+// DirectXMath の計算が主な項目 (カリング, 法線・接線, カメラ行列, ライティング) は,
+// 記録した環境で SIMD 版の DirectXMath を使えなかったため含めていません ("no baseline" と表示されます).
+#include "Benchmark.h"
+#include "CpuBenchmarks.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+int main(int argc, char* argv[])
+{
+    const char* outFile = nullptr;
+    const char* baselineFile = nullptr;
+    double threshold = 0.1;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (i + 1 >= argc)
+        {
+            fprintf(stderr, "usage: CpuBenchmark [-out file] [-baseline file] [-threshold percent]\n");
+            return 2;
+        }
+        if (strcmp(argv[i], "-out") == 0)
+        {
+            outFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "-baseline") == 0)
+        {
+            baselineFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "-threshold") == 0)
+        {
+            threshold = atof(argv[++i]) / 100.0;
+        }
+        else
+        {
+            fprintf(stderr, "unknown option: %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    std::vector<Benchmark::Result> results;
+    RunCpuBenchmarks(results);
+
+    std::string report;
+    int regressions = Benchmark::WriteAndCompare(results, outFile, baselineFile, threshold, report);
+    fputs(report.c_str(), stdout);
+    return regressions != 0 ? 1 : 0;
+}
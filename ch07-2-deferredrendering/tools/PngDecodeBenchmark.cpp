@@ -0,0 +1,319 @@
+﻿// stb_image の PNG の展開を計測するコマンドラインツール.
+// 計測用の画像 (コーパス) はその場で合成するので, 画像ファイルをリポジトリに置く必要はありません.
+// Linux (または Windows のコマンドライン) で次のようにビルドします.
+//
+//   g++ -std=c++17 -O2 -I.. PngDecodeBenchmark.cpp ../Benchmark.cpp ../ImageWriter.cpp ../PixelConvert.cpp -o PngDecodeBenchmark
+//
+// 別の stb_image.h (例えば変更前のもの) と比べるには, その stb ディレクトリを含むディレクトリを -I.. より前に指定します.
+//
+// 使い方:
+//   PngDecodeBenchmark [-write ディレクトリ] [-out ファイル] [-baseline ファイル] [-threshold パーセント] [PNG ファイル...]
+//     コーパスと指定した PNG ファイルを展開し, 結果を JSON で標準出力 (-out があればそのファイル) へ書き出します.
+//     コーパスは展開した結果が元の画素と一致するかも確かめ, 一致しなければ 1 を返します.
+//     -write を指定すると, コーパスをそのディレクトリへ PNG ファイルとして書き出します.
+//     -baseline のファイルより threshold (既定は 10%) を超えて遅くなった項目があれば 1 を返します.
+//
+// コーパスの内容:
+//   1023x768 の RGB / RGBA で, 全ての行を同じフィルタ (None, Sub, Up, Average, Paeth) にしたものと,
+//   行ごとにフィルタを変えたもの. 幅が 3 や 4 の倍数でない小さなグレー, グレー + アルファ, RGB, RGBA の画像.
+//   圧縮は ImageWriter の固定ハフマン符号なので, 動的ハフマン符号の展開も計るには実際の PNG ファイルを指定してください.
+//
+// benchmarks/png_decode_linux.json は ../../ch07-1-dynamicshadercompile/Parrots.png を加えて,
+// 1 コアの x86-64 Linux の仮想マシンで 3 回実行し, 各項目の中央値の最も遅い値を取ったものです.
+#include "Benchmark.h"
+#include "ImageWriter.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb/stb_image.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+enum Filter { FilterNone, FilterSub, FilterUp, FilterAverage, FilterPaeth, FilterMixed };
+
+struct CorpusImage
+{
+    std::string name;
+    int width, height, components;
+    std::vector<uint8_t> pixels;    // 行の間を詰めた, components チャンネルの画素.
+    std::vector<uint8_t> png;
+};
+
+// なめらかな変化に少しの雑音を加えた画像. フィルタによって圧縮後の大きさが変わるようにする.
+std::vector<uint8_t> MakePixels(int width, int height, int components)
+{
+    std::vector<uint8_t> pixels(size_t(width) * height * components);
+    uint32_t random = 12345;
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            uint8_t* p = &pixels[(size_t(y) * width + x) * components];
+            for (int c = 0; c < components; ++c)
+            {
+                random = random * 1664525 + 1013904223;
+                p[c] = uint8_t(x * (c + 1) + y * (3 - c) + ((random >> 24) & 7));
+            }
+        }
+    }
+    return pixels;
+}
+
+int Paeth(int a, int b, int c)
+{
+    const int p = a + b - c;
+    const int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc)
+    {
+        return a;
+    }
+    return pb <= pc ? b : c;
+}
+
+void PutBE32(std::vector<uint8_t>& out, uint32_t v)
+{
+    out.push_back(uint8_t(v >> 24));
+    out.push_back(uint8_t(v >> 16));
+    out.push_back(uint8_t(v >> 8));
+    out.push_back(uint8_t(v));
+}
+
+void PutChunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data)
+{
+    PutBE32(out, uint32_t(data.size()));
+    const size_t begin = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    PutBE32(out, ImageWriter::Crc32(out.data() + begin, out.size() - begin));
+}
+
+// 指定したフィルタで 8 ビットの PNG を作る. ImageWriter::EncodePng は行ごとにフィルタを選ぶので使わない.
+std::vector<uint8_t> EncodePng(const std::vector<uint8_t>& pixels, int width, int height, int components, Filter filter)
+{
+    static const uint8_t colorTypes[] = { 0, 0, 4, 2, 6 };
+    const size_t lineBytes = size_t(width) * components;
+    std::vector<uint8_t> filtered;
+    filtered.reserve((lineBytes + 1) * height);
+    for (int y = 0; y < height; ++y)
+    {
+        const int type = (filter == FilterMixed) ? y % 5 : int(filter);
+        const uint8_t* row = &pixels[y * lineBytes];
+        const uint8_t* prior = y > 0 ? row - lineBytes : nullptr;
+        filtered.push_back(uint8_t(type));
+        for (size_t i = 0; i < lineBytes; ++i)
+        {
+            const int a = i >= size_t(components) ? row[i - components] : 0;
+            const int b = prior ? prior[i] : 0;
+            const int c = (prior && i >= size_t(components)) ? prior[i - components] : 0;
+            int predicted = 0;
+            switch (type)
+            {
+            case FilterSub: predicted = a; break;
+            case FilterUp: predicted = b; break;
+            case FilterAverage: predicted = (a + b) / 2; break;
+            case FilterPaeth: predicted = Paeth(a, b, c); break;
+            default: break;
+            }
+            filtered.push_back(uint8_t(row[i] - predicted));
+        }
+    }
+
+    std::vector<uint8_t> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    std::vector<uint8_t> header;
+    PutBE32(header, uint32_t(width));
+    PutBE32(header, uint32_t(height));
+    header.push_back(8);
+    header.push_back(colorTypes[components]);
+    header.push_back(0);
+    header.push_back(0);
+    header.push_back(0);
+    PutChunk(png, "IHDR", header);
+    std::vector<uint8_t> compressed;
+    ImageWriter::CompressZlib(filtered.data(), filtered.size(), compressed);
+    PutChunk(png, "IDAT", compressed);
+    PutChunk(png, "IEND", std::vector<uint8_t>());
+    return png;
+}
+
+void AddImage(std::vector<CorpusImage>& corpus, const char* name, int width, int height, int components, Filter filter)
+{
+    CorpusImage image;
+    image.name = name;
+    image.width = width;
+    image.height = height;
+    image.components = components;
+    image.pixels = MakePixels(width, height, components);
+    image.png = EncodePng(image.pixels, width, height, components, filter);
+    corpus.push_back(image);
+}
+
+void MakeCorpus(std::vector<CorpusImage>& corpus)
+{
+    static const char* filterNames[] = { "none", "sub", "up", "avg", "paeth", "mixed" };
+    char name[64];
+    for (int components = 3; components <= 4; ++components)
+    {
+        for (int filter = FilterNone; filter <= FilterMixed; ++filter)
+        {
+            snprintf(name, sizeof(name), "%s_1023x768_%s", components == 3 ? "rgb" : "rgba", filterNames[filter]);
+            AddImage(corpus, name, 1023, 768, components, Filter(filter));
+        }
+    }
+    static const char* componentNames[] = { "", "gray", "gray_alpha", "rgb", "rgba" };
+    static const int sizes[][2] = { { 1, 1 }, { 7, 3 }, { 33, 17 } };
+    for (int components = 1; components <= 4; ++components)
+    {
+        for (const auto& size : sizes)
+        {
+            snprintf(name, sizeof(name), "%s_%dx%d_mixed", componentNames[components], size[0], size[1]);
+            AddImage(corpus, name, size[0], size[1], components, FilterMixed);
+        }
+    }
+}
+
+// req_comp が 0 (ファイルのまま) と 4 (RGBA) の両方で, 元の画素と一致するか.
+bool Verify(const CorpusImage& image)
+{
+    bool matched = true;
+    for (int requested = 0; requested <= 4; requested += 4)
+    {
+        int width = 0, height = 0, components = 0;
+        uint8_t* decoded = stbi_load_from_memory(image.png.data(), int(image.png.size()), &width, &height, &components, requested);
+        if (!decoded || width != image.width || height != image.height || components != image.components)
+        {
+            stbi_image_free(decoded);
+            return false;
+        }
+        const int outComponents = requested ? requested : components;
+        for (size_t i = 0; i < size_t(width) * height && matched; ++i)
+        {
+            const uint8_t* src = &image.pixels[i * components];
+            const uint8_t* dst = &decoded[i * outComponents];
+            uint8_t expected[4];
+            if (outComponents == components)
+            {
+                memcpy(expected, src, components);
+            }
+            else
+            {
+                // stb_image と同じく, グレーは RGB へ広げ, アルファが無ければ 255 にする.
+                const bool gray = components <= 2;
+                expected[0] = src[0];
+                expected[1] = gray ? src[0] : src[1];
+                expected[2] = gray ? src[0] : src[2];
+                expected[3] = (components == 2 || components == 4) ? src[components - 1] : 255;
+            }
+            matched = memcmp(expected, dst, outComponents) == 0;
+        }
+        stbi_image_free(decoded);
+    }
+    return matched;
+}
+
+bool ReadFile(const char* fileName, std::vector<uint8_t>& data)
+{
+    std::ifstream infile(fileName, std::ios::binary);
+    if (!infile)
+    {
+        return false;
+    }
+    std::stringstream ss;
+    ss << infile.rdbuf();
+    const std::string text = ss.str();
+    data.assign(text.begin(), text.end());
+    return true;
+}
+
+// 大きな画像は少ない回数, 小さな画像は多い回数で計る.
+Benchmark::Result BenchDecode(const std::string& name, const std::vector<uint8_t>& png, size_t pixelCount)
+{
+    const int iterations = pixelCount >= 100000 ? 15 : 2000;
+    return Benchmark::Run("png_decode_" + name, iterations, [&]() {
+        int width, height, components;
+        stbi_image_free(stbi_load_from_memory(png.data(), int(png.size()), &width, &height, &components, 4));
+    });
+}
+}
+
+int main(int argc, char* argv[])
+{
+    const char* writeDir = nullptr;
+    const char* outFile = nullptr;
+    const char* baselineFile = nullptr;
+    double threshold = 0.1;
+    std::vector<const char*> files;
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "-write") == 0 && hasValue)
+        {
+            writeDir = argv[++i];
+        }
+        else if (strcmp(argv[i], "-out") == 0 && hasValue)
+        {
+            outFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "-baseline") == 0 && hasValue)
+        {
+            baselineFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "-threshold") == 0 && hasValue)
+        {
+            threshold = atof(argv[++i]) / 100.0;
+        }
+        else if (argv[i][0] == '-')
+        {
+            fprintf(stderr, "usage: PngDecodeBenchmark [-write dir] [-out file] [-baseline file] [-threshold percent] [png...]\n");
+            return 2;
+        }
+        else
+        {
+            files.push_back(argv[i]);
+        }
+    }
+
+    std::vector<CorpusImage> corpus;
+    MakeCorpus(corpus);
+    int mismatches = 0;
+    std::vector<Benchmark::Result> results;
+    for (const auto& image : corpus)
+    {
+        if (writeDir && !ImageWriter::WriteFile((std::string(writeDir) + "/" + image.name + ".png").c_str(), image.png))
+        {
+            fprintf(stderr, "%s: failed to write\n", image.name.c_str());
+            return 1;
+        }
+        if (!Verify(image))
+        {
+            fprintf(stderr, "%s: decoded pixels do not match\n", image.name.c_str());
+            ++mismatches;
+        }
+        results.push_back(BenchDecode(image.name, image.png, size_t(image.width) * image.height));
+    }
+    for (const char* fileName : files)
+    {
+        std::vector<uint8_t> png;
+        int width, height, components;
+        if (!ReadFile(fileName, png) || !stbi_info_from_memory(png.data(), int(png.size()), &width, &height, &components))
+        {
+            fprintf(stderr, "%s: not a readable image\n", fileName);
+            return 1;
+        }
+        std::string name = fileName;
+        name = name.substr(name.find_last_of("/\\") + 1);
+        results.push_back(BenchDecode(name, png, size_t(width) * height));
+    }
+
+    std::string report;
+    int regressions = Benchmark::WriteAndCompare(results, outFile, baselineFile, threshold, report);
+    fputs(report.c_str(), stdout);
+    return (mismatches != 0 || regressions != 0) ? 1 : 0;
+}